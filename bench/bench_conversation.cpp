@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+#include "conversation_manager.h"
+#include <filesystem>
+#include <string>
+
+using namespace mag;
+
+namespace {
+
+// A session of `turns` user/assistant pairs stored under a scratch directory
+class Session {
+public:
+    explicit Session(size_t turns) : dir_(std::filesystem::temp_directory_path() / "mag_bench_sessions") {
+        std::filesystem::remove_all(dir_);
+        manager_.set_storage_directory(dir_.string());
+        for (size_t i = 0; i < turns; ++i) {
+            add_turn(i);
+        }
+    }
+    
+    ~Session() {
+        std::filesystem::remove_all(dir_);
+    }
+    
+    void add_turn(size_t i) {
+        manager_.add_user_message("Question " + std::to_string(i) + ": how should the cache handle eviction?");
+        manager_.add_assistant_message("Answer " + std::to_string(i) + ": " + std::string(400, 'a'), "bench");
+    }
+    
+    ConversationManager& manager() { return manager_; }
+
+private:
+    std::filesystem::path dir_;
+    ConversationManager manager_;
+};
+
+void BM_TrimToLastN(benchmark::State& state) {
+    size_t turns = static_cast<size_t>(state.range(0));
+    Session session(turns);
+    size_t next = turns;
+    for (auto _ : state) {
+        session.add_turn(next++);
+        session.manager().trim_to_last_n_messages(turns * 2);
+    }
+}
+
+void BM_TrimToTokenLimit(benchmark::State& state) {
+    size_t turns = static_cast<size_t>(state.range(0));
+    Session session(turns);
+    size_t limit = session.manager().get_token_count();
+    size_t next = turns;
+    for (auto _ : state) {
+        session.add_turn(next++);
+        session.manager().trim_to_token_limit(limit);
+    }
+}
+
+void BM_SaveSession(benchmark::State& state) {
+    Session session(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        session.manager().save_to_disk();
+    }
+}
+
+void BM_LoadSession(benchmark::State& state) {
+    Session session(static_cast<size_t>(state.range(0)));
+    session.manager().save_to_disk();
+    std::string id = session.manager().get_current_session_id();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(session.manager().load_session(id));
+    }
+}
+
+} // anonymous namespace
+
+BENCHMARK(BM_TrimToLastN)->ArgName("turns")->Arg(50)->Arg(1000);
+BENCHMARK(BM_TrimToTokenLimit)->ArgName("turns")->Arg(50)->Arg(1000);
+BENCHMARK(BM_SaveSession)->ArgName("turns")->Arg(50)->Arg(1000);
+BENCHMARK(BM_LoadSession)->ArgName("turns")->Arg(50)->Arg(1000);
@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+#include "coordinator.h"
+#include "tool_call_parser.h"
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace mag;
+
+namespace {
+
+// A chat reply with `calls` add_todo calls between paragraphs of prose, then a listing
+std::string chat_reply(size_t calls) {
+    std::string reply = "Sure, here is a plan for the refactor.\n\n";
+    for (size_t i = 0; i < calls; ++i) {
+        reply += "Step " + std::to_string(i) + " keeps the build green while the parser moves over.\n";
+        reply += "add_todo(\"Step " + std::to_string(i) + "\", \"Move part " + std::to_string(i) +
+                 " of the parser and update its tests\")\n";
+    }
+    reply += "\nlist_todos()\n\nLet me know when to start.";
+    return reply;
+}
+
+class CannedChat : public ILLMClient {
+public:
+    explicit CannedChat(std::string reply) : reply_(std::move(reply)) {}
+    
+    WriteFileCommand request_plan(const std::string&) override { return {}; }
+    GenericCommand request_generic_plan(const std::string&) override { return {}; }
+    std::string request_chat(const std::string&) override { return reply_; }
+    void set_provider(const std::string&) override {}
+    std::string get_current_provider() const override { return "bench"; }
+
+private:
+    std::string reply_;
+};
+
+// The coordinator reports on stdout; keep that out of the benchmark output
+class SilenceStdout {
+public:
+    SilenceStdout() : saved_(std::cout.rdbuf(nullptr)) {}
+    ~SilenceStdout() {
+        std::cout.rdbuf(saved_);
+        std::cout.clear();
+    }
+
+private:
+    std::streambuf* saved_;
+};
+
+void BM_ParseToolCalls(benchmark::State& state) {
+    std::string reply = chat_reply(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ToolCallParser::parse(reply));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * reply.size()));
+}
+
+// Coordinator::parse_and_execute_todo_operations through the chat path: the
+// calls are parsed, the todos added and listed, and the reply rewritten
+void BM_ExecuteTodoOperations(benchmark::State& state) {
+    Coordinator coordinator(std::make_unique<CannedChat>(chat_reply(static_cast<size_t>(state.range(0)))),
+                            nullptr);
+    SilenceStdout silence;
+    for (auto _ : state) {
+        coordinator.get_todo_manager().clear_todos(); // so every iteration starts from an empty list
+        benchmark::DoNotOptimize(coordinator.run_with_conversation_history("plan the refactor", {}));
+    }
+}
+
+} // anonymous namespace
+
+BENCHMARK(BM_ParseToolCalls)->ArgName("calls")->Arg(1)->Arg(20)->Arg(200);
+BENCHMARK(BM_ExecuteTodoOperations)->ArgName("calls")->Arg(1)->Arg(20)->Arg(200);
@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+#include "message.h"
+
+using namespace mag;
+
+namespace {
+
+WriteFileCommand make_command(size_t content_bytes) {
+    WriteFileCommand command;
+    command.command = "WriteFile";
+    command.path = "src/generated/module.cpp";
+    command.content.reserve(content_bytes);
+    // Source-like text with the quotes and newlines JSON has to escape
+    while (command.content.size() < content_bytes) {
+        command.content += "    std::string name = \"value\"; // line\n";
+    }
+    command.content.resize(content_bytes);
+    return command;
+}
+
+void BM_SerializeCommand(benchmark::State& state) {
+    WriteFileCommand command = make_command(static_cast<size_t>(state.range(0)));
+    WireFormat format = static_cast<WireFormat>(state.range(1));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MessageHandler::serialize_command(command, format));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_DeserializeCommand(benchmark::State& state) {
+    WireFormat format = static_cast<WireFormat>(state.range(1));
+    std::string encoded = MessageHandler::serialize_command(make_command(static_cast<size_t>(state.range(0))), format);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MessageHandler::deserialize_command(encoded));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+// Content size x wire format (JSON, MSGPACK, CBOR)
+void content_sizes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"bytes", "format"});
+    for (int64_t bytes : {64, 4 << 10, 256 << 10}) {
+        for (int64_t format : {0, 1, 2}) {
+            benchmark->Args({bytes, format});
+        }
+    }
+}
+
+} // anonymous namespace
+
+BENCHMARK(BM_SerializeCommand)->Apply(content_sizes);
+BENCHMARK(BM_DeserializeCommand)->Apply(content_sizes);
@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include "llm_provider.h"
+#include <string>
+#include <vector>
+
+using namespace mag;
+
+namespace {
+
+// Providers in ProviderFactory::descriptors() order, minus replay (it needs a capture)
+const std::vector<std::string> PROVIDERS = {"anthropic", "openai", "gemini", "mistral"};
+
+std::string system_prompt() {
+    std::string prompt = "You are a coding assistant. Reply with a single JSON command.\n";
+    while (prompt.size() < 8 << 10) {
+        prompt += "- Allowed directories: src/, tests/, docs/. Never write outside them.\n";
+    }
+    return prompt;
+}
+
+std::vector<ConversationMessage> history(size_t turns) {
+    std::vector<ConversationMessage> messages;
+    for (size_t i = 0; i < turns; ++i) {
+        messages.emplace_back(i % 2 == 0 ? "user" : "assistant",
+                              "Turn " + std::to_string(i) + ": please update the parser to handle \"quoted\" names.");
+    }
+    return messages;
+}
+
+// The provider's wire format wrapped around a WriteFile command of content_bytes
+std::string response_body(const std::string& provider, size_t content_bytes) {
+    nlohmann::json command = {{"command", "WriteFile"}, {"path", "src/app.py"},
+                              {"content", std::string(content_bytes, 'x')}};
+    std::string text = command.dump();
+    nlohmann::json body;
+    if (provider == "anthropic") {
+        body = {{"content", {{{"type", "text"}, {"text", text}}}}};
+    } else if (provider == "gemini") {
+        body = {{"candidates", {{{"content", {{"parts", {{{"text", text}}}}}}}}}};
+    } else {
+        body = {{"choices", {{{"message", {{"role", "assistant"}, {"content", text}}}}}}};
+    }
+    return body.dump();
+}
+
+void BM_BuildRequestPayload(benchmark::State& state) {
+    auto provider = ProviderFactory::create_provider(PROVIDERS[static_cast<size_t>(state.range(0))]);
+    std::string prompt = system_prompt();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(provider->build_request_payload(prompt, "create src/app.py", "model").dump());
+    }
+    state.SetLabel(provider->get_name());
+}
+
+void BM_WriteConversationPayload(benchmark::State& state) {
+    auto provider = ProviderFactory::create_provider(PROVIDERS[static_cast<size_t>(state.range(0))]);
+    std::string prompt = system_prompt();
+    std::vector<ConversationMessage> messages = history(static_cast<size_t>(state.range(1)));
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        provider->write_conversation_payload(out, prompt, messages, "model");
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetLabel(provider->get_name());
+}
+
+void BM_ParseResponse(benchmark::State& state) {
+    auto provider = ProviderFactory::create_provider(PROVIDERS[static_cast<size_t>(state.range(0))]);
+    std::string body = response_body(provider->get_name(), static_cast<size_t>(state.range(1)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(provider->parse_response(body));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+    state.SetLabel(provider->get_name());
+}
+
+} // anonymous namespace
+
+BENCHMARK(BM_BuildRequestPayload)->ArgName("provider")->DenseRange(0, 3);
+BENCHMARK(BM_WriteConversationPayload)->ArgNames({"provider", "turns"})
+    ->ArgsProduct({{0, 1, 2, 3}, {10, 200}});
+BENCHMARK(BM_ParseResponse)->ArgNames({"provider", "bytes"})
+    ->ArgsProduct({{0, 1, 2, 3}, {1 << 10, 64 << 10}});
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief New content for a file, written to a temp file beside it
+ *
+ * The temp file lives in the target's directory so commit() is a plain
+ * rename(): readers see either the old file or the complete new one, never
+ * a truncated mix. A file that already exists keeps its permission bits,
+ * and a symlink is followed so the link itself survives. If the staged
+ * file is destroyed before commit(), the temp file is removed.
+ *
+ * With durable staging the kernel starts writing the data back as soon as
+ * it is staged, so a batch can stage every file first and then sync() each
+ * of them while their flushes overlap.
+ */
+class StagedFile {
+public:
+    /**
+     * @throws std::runtime_error if the temp file cannot be created or written
+     */
+    StagedFile(const std::string& path, std::string_view content, bool durable);
+    ~StagedFile();
+    
+    StagedFile(const StagedFile&) = delete;
+    StagedFile& operator=(const StagedFile&) = delete;
+    
+    /**
+     * @brief Write more of the content at offset (chunked transfers)
+     *
+     * Positional, so pieces may be written in any order and from several
+     * threads at once. Throws std::runtime_error on failure.
+     */
+    void write_at(uint64_t offset, std::string_view bytes);
+    
+    // fdatasync the temp file (no-op unless durable)
+    void sync();
+    
+    // Rename the temp file over the target; throws std::runtime_error on failure
+    void commit();
+    
+    const std::string& path() const { return path_; }
+    const std::string& temp_path() const { return temp_path_; }
+    bool committed() const { return committed_; }
+    
+private:
+    std::string path_; // symlinks resolved
+    std::string temp_path_;
+    int fd_ = -1;
+    bool durable_;
+    bool committed_ = false;
+};
+
+/**
+ * @brief Make renames in these directories durable, one fsync per directory
+ */
+void sync_parent_directories(const std::vector<std::string>& paths);
+
+/**
+ * @brief Replace path with content atomically (stage, sync, rename, sync directory)
+ * @param durable Skip both syncs when false; the replace stays atomic but may
+ *        be lost on power failure
+ * @throws std::runtime_error on failure; the original file is left untouched
+ */
+void write_file_atomically(const std::string& path, std::string_view content, bool durable);
+
+} // namespace mag
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "bash_tool.h"
+#include "cancellation.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mag {
+
+enum class BashJobState {
+    QUEUED,
+    RUNNING,
+    DONE
+};
+
+std::string job_state_to_string(BashJobState state);
+
+/**
+ * @brief A snapshot of one job; result is only meaningful once state is DONE
+ *
+ * stdout_delta and stderr_delta hold the output produced since the last
+ * take_output() of a streamed job and are empty otherwise.
+ */
+struct BashJobStatus {
+    std::string job_id;
+    std::string session;
+    std::string command;
+    BashJobState state = BashJobState::QUEUED;
+    CommandResult result;
+    std::string stdout_delta;
+    std::string stderr_delta;
+};
+
+/**
+ * @brief Bash commands run by a bounded set of workers
+ *
+ * Jobs start in submission order, but a job waits while an earlier job of
+ * the same session is queued or running, so one session's commands never
+ * overlap or reorder. Jobs of different sessions run side by side, up to
+ * the number of workers.
+ *
+ * Finished jobs are kept for STREAM_IDLE_EXPIRY_SECONDS after anyone last
+ * asked about them; a running job nobody asks about for that long is
+ * cancelled. A finished job is dropped as soon as take_output() has
+ * delivered its end, as streamed jobs have a single reader.
+ */
+class BashJobQueue {
+public:
+    using Runner = std::function<CommandResult(const BashTool::OutputHandler&, const CancellationToken&)>;
+    
+    explicit BashJobQueue(size_t workers);
+    ~BashJobQueue(); // cancels what is left and joins the workers
+    
+    BashJobQueue(const BashJobQueue&) = delete;
+    BashJobQueue& operator=(const BashJobQueue&) = delete;
+    
+    /**
+     * @brief Queue a command
+     * @param stream Buffer its output for take_output() while it runs
+     * @return The job id
+     */
+    std::string submit(const std::string& session, const std::string& command, Runner run, bool stream = false);
+    
+    std::optional<BashJobStatus> status(const std::string& job_id);
+    
+    // Waits up to timeout for the job to finish
+    std::optional<BashJobStatus> wait(const std::string& job_id, std::chrono::milliseconds timeout);
+    
+    // Waits up to timeout for new output or the end, and hands over the output produced so far
+    std::optional<BashJobStatus> take_output(const std::string& job_id, std::chrono::milliseconds timeout);
+    
+    // A queued job finishes cancelled without running; a running one is killed
+    bool cancel(const std::string& job_id);
+    
+    // Every job still held, in submission order, without results
+    std::vector<BashJobStatus> list();
+    
+    size_t workers() const { return workers_.size(); }
+
+private:
+    struct Job {
+        uint64_t sequence = 0;
+        std::string session;
+        std::string command;
+        Runner run;
+        bool stream = false;
+        BashJobState state = BashJobState::QUEUED;
+        CommandResult result;
+        std::string stdout_pending;
+        std::string stderr_pending;
+        CancellationToken cancel;
+        std::chrono::steady_clock::time_point last_activity = std::chrono::steady_clock::now();
+    };
+    
+    std::mutex mutex_;
+    std::condition_variable work_cv_; // a job may have become runnable
+    std::condition_variable done_cv_; // a job finished or produced output
+    std::map<std::string, std::shared_ptr<Job>> jobs_;
+    std::deque<std::string> queued_;
+    std::set<std::string> busy_sessions_;
+    uint64_t next_id_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+    
+    // mutex_ held for the rest
+    std::shared_ptr<Job> find(const std::string& job_id);
+    BashJobStatus snapshot(const std::string& job_id, const Job& job) const;
+    std::shared_ptr<Job> next_runnable(std::string& job_id);
+    void finish(Job& job, CommandResult result);
+    void reap_expired();
+    
+    void worker_loop();
+};
+
+} // namespace mag
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "bash_tool.h"
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Results of read-only bash commands, valid while the files they read are unchanged
+ *
+ * Only commands made of known read-only programs (ls, cat, grep, find,
+ * git status, ...) that the policy also allows are cached, optionally
+ * piped into each other, and only without redirections, substitutions,
+ * variables or options that write (find -delete, sort -o, ...).
+ *
+ * Entries are keyed on the command and working directory and carry a
+ * fingerprint of the paths the command names: type, size, mtime and inode
+ * of each, walking directories recursively. A command naming no existing
+ * path is fingerprinted on its working directory, and git commands on the
+ * whole work tree. A tree with more than max_entries entries, or with an
+ * mtime too recent to trust (see ContentHashCache), is not cached.
+ *
+ * Safe to share between threads.
+ */
+class BashResultCache {
+public:
+    /**
+     * @param allowed_commands The policy's allowed programs; empty allows every read-only one
+     * @param capacity Results kept, least recently used dropped first
+     * @param ttl Results older than this are misses whatever the fingerprint says
+     * @param max_entries Largest number of files and directories fingerprinted per command
+     */
+    BashResultCache(const std::vector<std::string>& allowed_commands, size_t capacity, std::chrono::seconds ttl,
+                    size_t max_entries);
+    
+    bool is_cacheable(const std::string& command) const;
+    
+    /**
+     * @brief Fingerprint what command would read, taken before running it
+     * @return nullopt if the command is not cacheable or the tree cannot be fingerprinted
+     */
+    std::optional<uint64_t> fingerprint(const std::string& command, const std::string& working_directory) const;
+    
+    // The stored result if it was stored under the same fingerprint and has not expired
+    std::optional<CommandResult> lookup(const std::string& command, const std::string& working_directory,
+                                        uint64_t fingerprint);
+    
+    /**
+     * @brief Keep a finished result, if the tree still has the fingerprint taken before it ran
+     *
+     * Failed runs are kept too, as a grep without matches fails; timed out,
+     * cancelled, killed and spilled runs are not.
+     */
+    void store(const std::string& command, const std::string& working_directory, uint64_t fingerprint,
+               const CommandResult& result);
+    
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        uint64_t fingerprint = 0;
+        CommandResult result;
+        std::chrono::steady_clock::time_point stored_at;
+    };
+    using LruList = std::list<std::pair<std::string, Entry>>;
+    
+    std::set<std::string> programs_; // read-only programs the policy allows
+    size_t capacity_;
+    std::chrono::seconds ttl_;
+    size_t max_entries_;
+    mutable std::mutex mutex_;
+    LruList lru_; // most recently used at the front
+    std::unordered_map<std::string, LruList::iterator> index_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    
+    static std::string key_for(const std::string& command, const std::string& working_directory);
+};
+
+} // namespace mag
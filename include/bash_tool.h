@@ -1,8 +1,15 @@
 #pragma once
 
+#include "cancellation.h"
+#include "process_runner.h"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 
 namespace mag {
 
@@ -20,8 +27,19 @@ struct CommandResult {
     std::string working_directory;    // Working directory where command was executed
     std::string pwd_after_execution;  // Working directory after command execution
     bool success;                     // Whether the command succeeded (exit_code == 0)
+    bool timed_out = false;           // Killed for running past its timeout
+    bool cancelled = false;           // Killed because the caller cancelled it
+    bool cached = false;              // Answered by BashResultCache without running
     std::string error_message;        // Error message if execution failed
     
+    // The outputs above keep the start and end of each stream; all of it is in the log, if any
+    uint64_t stdout_bytes = 0;
+    uint64_t stderr_bytes = 0;
+    std::string stdout_log;           // read back with BashTool::read_log()
+    std::string stderr_log;
+    
+    ResourceUsage usage;              // CPU, peak memory and block I/O of the command
+    
     // Timing information
     std::chrono::system_clock::time_point start_time;
     std::chrono::system_clock::time_point end_time;
@@ -31,6 +49,17 @@ struct CommandResult {
     std::string get_combined_output() const;
     std::string to_string() const;
     bool has_output() const;
+    
+    // Status and the start and end of each stream in at most about max_bytes, with the log paths
+    std::string summary(size_t max_bytes) const;
+};
+
+// A piece of a spilled output log
+struct LogChunk {
+    std::string data;
+    uint64_t offset = 0;
+    uint64_t total_bytes = 0;   // size of the whole log
+    bool eof = false;
 };
 
 /**
@@ -45,6 +74,9 @@ struct CommandResult {
  */
 class BashTool {
 public:
+    // Receives output while the command runs; is_stderr tells the two streams apart
+    using OutputHandler = std::function<void(bool is_stderr, std::string_view chunk)>;
+    
     BashTool();
     ~BashTool() = default;
     
@@ -52,13 +84,23 @@ public:
      * @brief Execute a bash command and capture results
      * @param command The command to execute
      * @param working_directory Optional working directory (uses current if empty)
-     * @param timeout_ms Timeout in milliseconds (default 30 seconds)
+     * @param timeout_ms Timeout in milliseconds; negative uses set_default_timeout(), 0 means none
+     * @param on_output Optional; called with each piece of output as it arrives
+     * @param cancel Optional; cancelling it stops the command like a timeout
+     * @param session Optional; runs the command in the persistent shell of that name (see set_sessions())
      * @return CommandResult with execution details
      * @throws std::runtime_error if command execution fails
+     *
+     * stdout and stderr are captured separately. A command still running at
+     * the timeout has its whole process group sent SIGTERM, then SIGKILL.
+     * The result holds the full output whether or not on_output saw it.
      */
     CommandResult execute_command(const std::string& command, 
                                  const std::string& working_directory = "",
-                                 int timeout_ms = 30000);
+                                 int timeout_ms = -1,
+                                 const OutputHandler& on_output = nullptr,
+                                 const CancellationToken* cancel = nullptr,
+                                 const std::string& session = "");
     
     /**
      * @brief Execute command and capture pwd context automatically
@@ -93,20 +135,67 @@ public:
      * @param timeout_ms Default timeout for command execution
      */
     void set_default_timeout(int timeout_ms) { default_timeout_ms_ = timeout_ms; }
+    
+    /**
+     * @brief Keep shells alive between commands that name a session
+     * @param sessions Shared pool of shells; null starts a fresh shell for every command
+     *
+     * In a session, cd, exported variables and shell functions carry over
+     * from one command to the next.
+     */
+    void set_sessions(std::shared_ptr<ShellSessions> sessions) { sessions_ = std::move(sessions); }
+    
+    /**
+     * @brief Set how much of each stream a result keeps and where the rest is logged
+     * @param capture_bytes Kept from the start and again from the end of each stream
+     * @param log_directory Where streams that outgrow that are written in full; empty for nowhere
+     */
+    void set_output_limits(size_t capture_bytes, std::string log_directory) {
+        capture_bytes_ = capture_bytes;
+        log_directory_ = std::move(log_directory);
+    }
+    
+    /**
+     * @brief Set the rlimits each command runs under (by default from the MAG_BASH_CPU_SECONDS,
+     *        MAG_BASH_MEMORY_MB and MAG_BASH_FILE_MB variables)
+     *
+     * Commands in a session run under the limits its ShellSessions was made with.
+     */
+    void set_limits(const ResourceLimits& limits) { limits_ = limits; }
+    const ResourceLimits& limits() const { return limits_; }
+    
+    /**
+     * @brief Read part of a log named in a CommandResult
+     * @throws std::invalid_argument if path is not a log of this tool
+     * @throws std::runtime_error if it cannot be read
+     */
+    LogChunk read_log(const std::string& path, uint64_t offset, size_t max_bytes) const;
 
 private:
     bool capture_context_ = true;        // Whether to auto-capture pwd after execution
-    int default_timeout_ms_ = 30000;     // Default timeout (30 seconds)
+    int default_timeout_ms_ = 30000;     // Default timeout (BashToolConfig::DEFAULT_TIMEOUT_MS)
+    std::shared_ptr<ShellSessions> sessions_; // null: a fresh shell per command
+    size_t capture_bytes_;
+    std::string log_directory_;
+    ResourceLimits limits_;
+    std::mutex prune_mutex_;
+    std::chrono::steady_clock::time_point last_prune_{};
+    
+    // Creates the log directory and deletes old logs (at most once a minute); empty if unusable
+    std::string prepare_log_directory();
     
     // Security and policy methods
     std::vector<std::string> get_blocked_commands() const;
-    std::vector<std::string> get_dangerous_patterns() const;
+    std::vector<std::pair<std::string, std::string>> get_dangerous_patterns() const; // regex, literal it needs
     bool contains_dangerous_pattern(const std::string& command) const;
     
     // Platform-specific execution methods
     CommandResult execute_unix_command(const std::string& command, 
                                       const std::string& working_directory,
-                                      int timeout_ms);
+                                      int timeout_ms,
+                                      const OutputHandler& on_output,
+                                      const CancellationToken* cancel,
+                                      const std::string& session);
     CommandResult execute_windows_command(const std::string& command,
                                          const std::string& working_directory, 
                                          int timeout_ms);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "interfaces/llm_client_interface.h"
+#include "interfaces/file_client_interface.h"
+#include "policy.h"
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+// One prompt of a batch file
+struct BatchItem {
+    size_t line = 0;  // 1-based line in the batch file
+    std::string id;   // "id" or "request_id" from the line, else "line-N"
+    std::string prompt;
+};
+
+// Outcome of one prompt, written as one JSONL line
+struct BatchResult {
+    size_t line = 0;
+    std::string id;
+    std::string status; // applied, unchanged, dry_run, needs_confirmation, denied or failed
+    std::string command;
+    std::string path;
+    std::string error;
+    double plan_ms = 0;
+    double dry_run_ms = 0;
+    double apply_ms = 0;
+    double total_ms = 0;
+    
+    nlohmann::json to_json() const;
+};
+
+struct BatchSummary {
+    std::map<std::string, size_t> by_status;
+    size_t total = 0;
+    double wall_ms = 0;
+    
+    size_t count(const std::string& status) const;
+};
+
+/**
+ * @brief Headless driver that runs many prompts through plan, dry run and apply at once
+ *
+ * Each prompt goes through the same stages as Coordinator::run: the LLM
+ * plans a file change, the policy is checked, the file tool dry-runs it and,
+ * once approved, applies it. Up to `concurrency` prompts are in flight
+ * together on the shared clients, so throughput grows with the adapters and
+ * file tool workers behind them rather than being one prompt at a time.
+ *
+ * Nothing is read from the terminal. Approval is decided by the Approval mode
+ * or an approver hook, and results are written as JSONL in completion order
+ * (each carries its line number for reordering).
+ */
+class BatchRunner {
+public:
+    enum class Approval {
+        POLICY, // apply when the policy does not require confirmation for the operation
+        ALL,    // apply everything the policy allows
+        NONE    // dry runs only
+    };
+    
+    // Returns whether a dry-run plan may be applied
+    using Approver = std::function<bool(const WriteFileCommand& command, const DryRunResult& dry_run)>;
+    
+    BatchRunner(ILLMClient& llm_client, IFileClient& file_client, PolicyChecker policy_checker,
+                size_t concurrency, Approval approval = Approval::POLICY);
+    
+    // Replaces the Approval mode's decision for plans the policy allows
+    void set_approver(Approver approver) { approver_ = std::move(approver); }
+    
+    BatchSummary run(std::istream& input, std::ostream& output);
+    BatchResult run_one(const BatchItem& item);
+    
+    // Reads one JSONL line: "prompt", or "title" and "body"; nullopt for a blank line
+    static std::optional<BatchItem> parse_line(const std::string& line, size_t line_number);
+    static std::optional<Approval> parse_approval(const std::string& name);
+
+private:
+    ILLMClient& llm_client_;
+    IFileClient& file_client_;
+    PolicyChecker policy_checker_;
+    size_t concurrency_;
+    Approval approval_;
+    Approver approver_;
+    
+    bool approve(const WriteFileCommand& command, const DryRunResult& dry_run) const;
+};
+
+} // namespace mag
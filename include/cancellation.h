@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace mag {
+
+/**
+ * @brief Shared cancellation flag for abandoning in-flight work
+ *
+ * Copies share state, so one copy can be handed to the worker while another
+ * stays with whoever decides to cancel. Registered callbacks run once, on the
+ * cancelling thread (or immediately if already cancelled).
+ */
+class CancellationToken {
+public:
+    CancellationToken();
+    
+    void cancel() const;
+    bool is_cancelled() const;
+    
+    // Sleep for up to timeout; returns true (early) if the token is cancelled
+    bool wait_for(std::chrono::milliseconds timeout) const;
+    
+    /**
+     * @brief Run callback when the token is cancelled
+     * @return Registration id for remove_callback()
+     */
+    size_t on_cancel(std::function<void()> callback) const;
+    void remove_callback(size_t id) const;
+    
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool cancelled = false;
+        size_t next_id = 1;
+        std::map<size_t, std::function<void()>> callbacks;
+    };
+    std::shared_ptr<State> state_;
+};
+
+} // namespace mag
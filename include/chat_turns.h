@@ -0,0 +1,42 @@
+#pragma once
+
+#include "llm_provider.h"
+#include <string_view>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief One provider-side turn: consecutive history messages of the same role
+ */
+struct ChatTurn {
+    std::string_view role;                          // role as the provider spells it
+    std::vector<const ConversationMessage*> messages; // each becomes one content block/part
+};
+
+/**
+ * @brief How a provider wants the history shaped
+ */
+struct ChatTurnOptions {
+    std::string_view assistant_role = "assistant"; // Gemini calls it "model"
+    bool require_user_first = true;                // open with a placeholder user turn if needed
+};
+
+/**
+ * @brief Map a history onto strictly alternating user/assistant turns
+ *
+ * For providers whose APIs reject anything else (Anthropic, Gemini):
+ * "system" messages are skipped (callers fold them into the system prompt),
+ * unknown roles are sent as user turns, empty messages are dropped, and runs
+ * of the same role are merged into one turn so they never appear back to
+ * back. Messages are referenced, not copied; the history must outlive the
+ * result.
+ */
+std::vector<ChatTurn> group_chat_turns(HistoryView conversation_history, const ChatTurnOptions& options = {});
+
+/**
+ * @brief Role to send for a message to OpenAI-style APIs ("user" for anything unknown)
+ */
+std::string_view openai_role(const ConversationMessage& message);
+
+} // namespace mag
@@ -4,8 +4,13 @@
 #include "input_handler.h"
 #include "conversation_manager.h"
 #include <memory>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 
 namespace mag {
 
@@ -17,6 +22,8 @@ namespace mag {
  * - Provider switching commands
  * - Chat mode with todo integration
  * - Debug logging and status commands
+ * - Non-blocking input: requests run on a job thread while the prompt stays
+ *   live, so /pause, /stop and /cancel act at once and other lines queue up
  * 
  * Falls back to simple stdin on Windows for universal compatibility.
  */
@@ -38,12 +45,50 @@ private:
     std::ofstream debug_log_;
     bool running_;
     
+    // Event loop state: requests run on job_ while the main thread keeps reading input
+    int wake_pipe_[2] = {-1, -1};     // written by the job when it finishes or asks a question
+    std::future<void> job_;
+    std::deque<std::string> queued_;  // type-ahead, run in order once the job finishes
+    std::mutex question_mutex_;
+    std::optional<std::string> question_; // a confirmation the job is waiting on
+    std::promise<std::string> answer_;
+    bool closing_ = false;             // input has ended: questions are turned down unasked
+    std::thread::id loop_thread_;
+    
+    static constexpr size_t SESSIONS_PER_PAGE = 10;
+    
     /**
      * @brief Handle a single command from the user
      * @param input The user's input
      */
     void handle_command(const std::string& input);
     
+    /**
+     * @brief Run a command on the job thread, or right away when it is quick
+     * @param input A non-empty line
+     */
+    void dispatch(const std::string& input);
+    
+    /**
+     * @brief Act on /pause, /resume, /stop or /cancel while a job runs
+     * @return false if the line is not one of those
+     */
+    bool handle_control_command(const std::string& input);
+    
+    /**
+     * @brief Ask the main loop for a line; called from the job thread
+     */
+    std::string ask(const std::string& question);
+    void answer(const std::string& line);
+    bool question_pending();
+    
+    /**
+     * @brief Stop the running job, if any, and wait for it; no more questions are asked
+     */
+    void finish_job();
+    
+    void wake(char reason);
+    
     /**
      * @brief Handle slash commands (provider switching, help, etc.)
      * @param command The command without the leading slash
@@ -79,6 +124,8 @@ private:
      * @brief Set up tab completion for commands
      */
     void setup_completion();
+    void setup_compaction();
+    void setup_event_loop();
     
     /**
      * @brief Get the current prompt string
@@ -115,6 +162,12 @@ private:
      */
     void handle_do_command(const std::string& command);
     
+    /**
+     * @brief Submit or check provider batch jobs of todo plans
+     * @param command The arguments after "todo batch" ("" submits, "status" checks)
+     */
+    void handle_todo_batch_command(const std::string& command);
+    
     /**
      * @brief Handle provider switching with conversation context
      * @param provider_name The new provider to switch to
@@ -126,6 +179,11 @@ private:
      */
     void show_conversation_history();
     
+    /**
+     * @brief Show the provider token usage reported for this session
+     */
+    void show_usage_stats();
+    
     /**
      * @brief Handle conversation session commands
      * @param command The session command
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
+#include <cstdlib>
 
 namespace mag {
 
@@ -13,16 +15,483 @@ struct NetworkConfig {
     static constexpr const char* BASH_TOOL_HOST = "127.0.0.1";
     static constexpr int BASH_TOOL_PORT = 5557;
     
-    static std::string get_llm_adapter_url() {
-        return std::string("tcp://") + LLM_ADAPTER_HOST + ":" + std::to_string(LLM_ADAPTER_PORT);
+    // Streamed chat replies
+    static constexpr int STREAM_POLL_WAIT_MS = 200;          // long-poll window per stream_next
+    static constexpr int STREAM_IDLE_EXPIRY_SECONDS = 300;   // undrained streams are dropped after this
+    static constexpr int MAX_CONCURRENT_STREAMS = 16;        // per adapter; later ones wait for a free slot
+    static constexpr int MAX_QUEUED_STREAMS = 64;            // waiting beyond that, a stream start is refused
+    
+    // Runtime endpoints; the constants above are only the tcp defaults.
+    // See EndpointConfig for the config file and MAG_TRANSPORT etc.
+    static std::string get_llm_adapter_url();
+    static std::string get_file_tool_url();
+    static std::string get_bash_tool_url();
+};
+
+// Service concurrency configuration
+struct ServiceConfig {
+    static constexpr int DEFAULT_LLM_WORKERS = 4;
+    static constexpr int CONTEXTS_PER_WORKER = 2; // lets requests queue behind slow calls
+    
+    static int get_env_int(const char* name, int fallback) {
+        const char* value = std::getenv(name);
+        if (!value || !*value) {
+            return fallback;
+        }
+        char* end = nullptr;
+        long parsed = std::strtol(value, &end, 10);
+        return (end && *end == '\0' && parsed > 0) ? static_cast<int>(parsed) : fallback;
+    }
+    
+    static int get_llm_worker_count() {
+        return get_env_int("MAG_LLM_WORKERS", DEFAULT_LLM_WORKERS);
+    }
+    
+    static constexpr int DEFAULT_FILE_WORKERS = 4;
+    
+    static int get_file_worker_count() {
+        return get_env_int("MAG_FILE_WORKERS", DEFAULT_FILE_WORKERS);
+    }
+    
+    static constexpr int DEFAULT_BASH_WORKERS = 4;
+    
+    static int get_bash_worker_count() {
+        return get_env_int("MAG_BASH_WORKERS", DEFAULT_BASH_WORKERS);
+    }
+};
+
+// Deadlines for orchestrator requests to the services
+struct RequestTimeoutConfig {
+    static constexpr int LLM_TIMEOUT_MS = 180000;  // a slow provider plus its retries
+    static constexpr int FILE_TIMEOUT_MS = 30000;
+    static constexpr int BASH_TIMEOUT_MS = 120000; // BashTool's own 30s limit plus process start-up
+    
+    static int get_llm_timeout_ms() { return ServiceConfig::get_env_int("MAG_LLM_TIMEOUT_MS", LLM_TIMEOUT_MS); }
+    static int get_file_timeout_ms() { return ServiceConfig::get_env_int("MAG_FILE_TIMEOUT_MS", FILE_TIMEOUT_MS); }
+    static int get_bash_timeout_ms() { return ServiceConfig::get_env_int("MAG_BASH_TIMEOUT_MS", BASH_TIMEOUT_MS); }
+};
+
+// Client-side load balancing over several workers of one service (see EndpointPool)
+struct EndpointPoolConfig {
+    static constexpr size_t EJECT_AFTER_FAILURES = 3; // consecutive failures or missed deadlines
+    static constexpr int EJECT_BASE_MS = 5000;        // first cool-down; doubles per ejection in a row
+    static constexpr int EJECT_MAX_MS = 60000;
+    static constexpr int REDIAL_INTERVAL_MS = 5000;   // between attempts to reach an unreachable worker
+    static constexpr int REGISTRY_SCAN_MS = 2000;     // how often the worker registry is re-read
+};
+
+// Prometheus endpoint each process serves on 127.0.0.1 (see MetricsServer)
+struct MetricsConfig {
+    // Port of each process relative to MAG_METRICS_PORT_BASE
+    static constexpr int LLM_ADAPTER_OFFSET = 0;
+    static constexpr int FILE_TOOL_OFFSET = 1;
+    static constexpr int BASH_TOOL_OFFSET = 2;
+    static constexpr int ORCHESTRATOR_OFFSET = 3;
+    
+    // 0 (the default) leaves the endpoint off; the "metrics" operation always works
+    static int get_port(int offset) {
+        int base = ServiceConfig::get_env_int("MAG_METRICS_PORT_BASE", 0);
+        return base > 0 ? base + offset : 0;
+    }
+};
+
+// File tool limits
+struct FileToolConfig {
+    static constexpr size_t MAX_BATCH_COMMANDS = 1000; // per dry_run_batch / apply_batch message
+    static constexpr size_t MAX_DIFF_PREVIEW_BYTES = 64 * 1024; // dry-run diffs beyond this are cut short
+    static constexpr int DEFAULT_IO_THREADS = 8; // staging and syncing the files of one batch
+    static constexpr size_t MAX_READ_BYTES = 1024 * 1024; // per read / read_range reply
+    static constexpr size_t COPY_READ_BYTES = 64 * 1024; // read slices up to this are copied out of the mapping
+    
+    static size_t get_io_threads() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_FILE_IO_THREADS", DEFAULT_IO_THREADS));
+    }
+    
+    // MAG_ATOMIC_BATCH=1 makes /execute write a plan's files all-or-nothing
+    static bool atomic_batches() {
+        const char* value = std::getenv("MAG_ATOMIC_BATCH");
+        return value && std::string(value) == "1";
+    }
+    
+    // Writes are fdatasync'd (and their directory fsync'd) unless MAG_FILE_SYNC=0
+    static bool durable_writes() {
+        const char* value = std::getenv("MAG_FILE_SYNC");
+        return !value || std::string(value) != "0";
+    }
+};
+
+// Project context index kept by file_tool (see ProjectIndex)
+struct ContextConfig {
+    static constexpr size_t MAX_FILES = 20000;              // larger trees are indexed up to this many files
+    static constexpr size_t MAX_OUTLINE_BYTES = 1024 * 1024; // larger files are listed but not outlined
+    static constexpr size_t MAX_SYMBOLS = 64;               // outline entries kept per file
+    static constexpr size_t MAX_BUDGET_TOKENS = 16000;      // per context reply, whatever is asked for
+    static constexpr int RESCAN_SECONDS = 5;                // mtime rescans when inotify is unavailable
+    
+    // MAG_CONTEXT_BUDGET: tokens of project context sent with each prompt; unset sends none
+    static size_t get_budget() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_CONTEXT_BUDGET", 0));
+    }
+};
+
+// Bash tool limits
+struct BashToolConfig {
+    static constexpr int DEFAULT_TIMEOUT_MS = 30000;              // then SIGTERM, then SIGKILL to the process group
+    static constexpr size_t CAPTURE_BYTES = 256 * 1024;           // per stream, kept from the start and from the end
+    static constexpr uint64_t MAX_LOG_BYTES = 1024ull * 1024 * 1024; // full output written to disk per stream
+    static constexpr int LOG_RETENTION_SECONDS = 24 * 3600;       // then the log is deleted
+    static constexpr size_t MAX_LOG_READ_BYTES = 1024 * 1024;     // per read_log reply
+    static constexpr size_t SUMMARY_BYTES = 16 * 1024;            // of a result that is shown after the fact
+    static constexpr size_t MAX_SESSIONS = 16;                    // persistent shells per bash tool
+    static constexpr int SESSION_IDLE_SECONDS = 1800;             // an unused shell is closed after this
+    static constexpr int DEFAULT_JOB_WORKERS = 4;                 // queued jobs running at once
+    static constexpr int MAX_WAIT_MS = 10000;                     // longest single "wait" request
+    static constexpr size_t RESULT_CACHE_ENTRIES = 256;           // read-only command results kept
+    static constexpr int RESULT_CACHE_TTL_SECONDS = 300;
+    static constexpr size_t RESULT_CACHE_MAX_FILES = 20000;       // larger trees are not fingerprinted
+    static constexpr size_t RESULT_CACHE_MAX_OUTPUT_BYTES = 64 * 1024;
+    
+    static size_t get_capture_bytes() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_BASH_CAPTURE_BYTES", CAPTURE_BYTES));
+    }
+    
+    // Where output that outgrows the capture is logged (MAG_BASH_LOG_DIR)
+    static std::string get_log_directory() {
+        const char* value = std::getenv("MAG_BASH_LOG_DIR");
+        if (value && *value) {
+            return value;
+        }
+        const char* tmp = std::getenv("TMPDIR");
+        return std::string(tmp && *tmp ? tmp : "/tmp") + "/mag-bash-logs";
+    }
+    
+    static size_t get_job_workers() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_BASH_JOB_WORKERS", DEFAULT_JOB_WORKERS));
+    }
+    
+    // MAG_CONCURRENT_BASH=1 lets /execute run a run of consecutive bash todos at the same time
+    static bool concurrent_todos() {
+        const char* value = std::getenv("MAG_CONCURRENT_BASH");
+        return value && std::string(value) == "1";
+    }
+    
+    // Per-command rlimits (MAG_BASH_CPU_SECONDS, MAG_BASH_MEMORY_MB, MAG_BASH_FILE_MB); 0 = none
+    static uint64_t get_cpu_seconds() {
+        return static_cast<uint64_t>(ServiceConfig::get_env_int("MAG_BASH_CPU_SECONDS", 0));
+    }
+    
+    static uint64_t get_memory_bytes() {
+        return static_cast<uint64_t>(ServiceConfig::get_env_int("MAG_BASH_MEMORY_MB", 0)) * 1024 * 1024;
+    }
+    
+    static uint64_t get_file_bytes() {
+        return static_cast<uint64_t>(ServiceConfig::get_env_int("MAG_BASH_FILE_MB", 0)) * 1024 * 1024;
+    }
+    
+    // MAG_BASH_RESULT_CACHE=1 answers repeated read-only commands on an unchanged tree from memory
+    static bool result_cache_enabled() {
+        const char* value = std::getenv("MAG_BASH_RESULT_CACHE");
+        return value && std::string(value) == "1";
+    }
+    
+    // Commands share a long-lived shell per session unless MAG_BASH_SESSIONS=0
+    static bool sessions_enabled() {
+        const char* value = std::getenv("MAG_BASH_SESSIONS");
+        return !value || std::string(value) != "0";
+    }
+};
+
+// Todo execution (/do, execute_all)
+struct TodoConfig {
+    // MAG_TODO_PARALLELISM=N runs up to N independent todos at once, following their dependencies;
+    // 1 (the default) keeps the strict list order
+    static size_t get_parallelism() {
+        int width = ServiceConfig::get_env_int("MAG_TODO_PARALLELISM", 1);
+        return width > 1 ? static_cast<size_t>(width) : 1;
+    }
+    
+    // MAG_TODO_PREFETCH=K requests the plans of up to K upcoming file todos while earlier
+    // todos run in list order; 0 (the default) plans each todo when it is reached
+    static size_t get_prefetch_depth() {
+        int depth = ServiceConfig::get_env_int("MAG_TODO_PREFETCH", 0);
+        return depth > 0 ? static_cast<size_t>(depth) : 0;
+    }
+    
+    // MAG_TODO_JOURNAL=<path> keeps the todo list in an append-only journal there, so it
+    // survives restarts and crashes; unset (the default) keeps todos in memory only
+    static std::string get_journal_path() {
+        const char* path = std::getenv("MAG_TODO_JOURNAL");
+        return path ? std::string(path) : std::string();
+    }
+    
+    static constexpr size_t MAX_PLAN_BATCH = 10000; // todos per provider batch job (/todo batch)
+    
+    // MAG_PLAN_BATCHES=<path>: provider batch jobs and the plans they returned, kept
+    // across sessions since a job can take hours
+    static std::string get_plan_batch_path() {
+        const char* path = std::getenv("MAG_PLAN_BATCHES");
+        return path && *path ? std::string(path) : std::string(".mag/plan_batches.json");
+    }
+};
+
+// Headless batch runs (main_orchestrator --batch)
+struct BatchConfig {
+    // MAG_BATCH_CONCURRENCY=N prompts in flight; by default one per LLM worker across the adapters
+    static size_t get_concurrency(size_t adapters) {
+        int fallback = ServiceConfig::get_llm_worker_count() * static_cast<int>(adapters > 0 ? adapters : 1);
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_BATCH_CONCURRENCY", fallback));
+    }
+};
+
+// Chunked writes of large files between the orchestrator and file_tool
+struct FileTransferConfig {
+    static constexpr size_t CHUNK_BYTES = 256 * 1024;    // per write_chunk message
+    static constexpr size_t WINDOW = 4;                  // chunks in flight per transfer
+    static constexpr size_t MAX_ACTIVE = 64;             // open transfers per file_tool process
+    static constexpr int IDLE_TIMEOUT_MS = 60000;        // an unfinished transfer is dropped after this
+    static constexpr int DEFAULT_THRESHOLD_BYTES = 1024 * 1024;
+    
+    // Writes larger than MAG_FILE_CHUNK_THRESHOLD bytes go in chunks
+    static size_t get_threshold() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_FILE_CHUNK_THRESHOLD", DEFAULT_THRESHOLD_BYTES));
+    }
+};
+
+// HTTP transport configuration
+struct HttpConfig {
+    static constexpr long MAX_HOST_CONNECTIONS = 8;   // per provider host
+    static constexpr long MAX_TOTAL_CONNECTIONS = 32; // connection cache size
+    static constexpr long CONNECT_TIMEOUT_MS = 10000;
+    static constexpr long KEEPALIVE_IDLE_SECONDS = 60;
+    static constexpr long POLL_INTERVAL_MS = 1000;
+    static constexpr long PREWARM_TIMEOUT_MS = 5000;  // connection warm-up HEAD request
+};
+
+// Logging configuration (see Logger for the MAG_LOG* variables)
+struct LogConfig {
+    static constexpr size_t QUEUE_CAPACITY = 8192;      // records buffered before new ones are dropped
+    static constexpr size_t DEFAULT_PAYLOAD_LIMIT = 512; // bytes of a payload dump kept
+    static constexpr const char* DEFAULT_SPEC = "info";
+};
+
+// Provider call policy: rate limiting, retries and circuit breaking
+struct ResilienceConfig {
+    static constexpr int DEFAULT_REQUESTS_PER_MINUTE = 300; // per provider and API key
+    static constexpr int DEFAULT_BURST = 10;
+    static constexpr int MAX_RETRIES = 3;
+    static constexpr int BASE_BACKOFF_MS = 500;
+    static constexpr int MAX_BACKOFF_MS = 20000;
+    static constexpr int MAX_RETRY_AFTER_MS = 60000;   // longer server hints fail over instead
+    static constexpr int BREAKER_FAILURE_THRESHOLD = 5; // consecutive failures that open the circuit
+    static constexpr int BREAKER_OPEN_MS = 30000;
+    
+    static int get_requests_per_minute() {
+        return ServiceConfig::get_env_int("MAG_PROVIDER_RPM", DEFAULT_REQUESTS_PER_MINUTE);
+    }
+    
+    static int get_burst() {
+        return ServiceConfig::get_env_int("MAG_PROVIDER_BURST", DEFAULT_BURST);
+    }
+};
+
+// LLM response cache configuration
+struct ResponseCacheConfig {
+    static constexpr const char* DEFAULT_DIRECTORY = ".mag/cache/llm";
+    static constexpr size_t MEMORY_ENTRIES = 256;
+    static constexpr int DEFAULT_TTL_SECONDS = 24 * 60 * 60;
+    static constexpr int DEFAULT_DISK_ENTRIES = 10000;
+    
+    // MAG_RESPONSE_CACHE: unset/"0" disables, "1" uses the default directory, anything else is a directory
+    static std::string get_directory() {
+        const char* value = std::getenv("MAG_RESPONSE_CACHE");
+        if (!value || !*value || std::string(value) == "0") {
+            return "";
+        }
+        return std::string(value) == "1" ? DEFAULT_DIRECTORY : value;
+    }
+    
+    static int get_ttl_seconds() {
+        return ServiceConfig::get_env_int("MAG_RESPONSE_CACHE_TTL", DEFAULT_TTL_SECONDS);
+    }
+    
+    // Oldest entries are deleted beyond this many files
+    static size_t get_disk_entries() {
+        int entries = ServiceConfig::get_env_int("MAG_RESPONSE_CACHE_MAX_ENTRIES", DEFAULT_DISK_ENTRIES);
+        return entries > 0 ? static_cast<size_t>(entries) : 1;
+    }
+};
+
+// Hedged (racing) plan requests across providers
+struct HedgeConfig {
+    static constexpr int DEFAULT_PERCENTILE = 95;
+    static constexpr int INITIAL_DELAY_MS = 3000;   // used until MIN_SAMPLES latencies are known
+    static constexpr int MIN_DELAY_MS = 250;
+    static constexpr int MAX_DELAY_MS = 15000;
+    static constexpr size_t MIN_SAMPLES = 20;
+    static constexpr size_t WINDOW_SIZE = 256;
+    static constexpr size_t MAX_ATTEMPTS = 2;       // primary plus one hedge
+    
+    // MAG_RACE_PROVIDERS=1 races every plan request; requests may also opt in with "race": true
+    static bool race_by_default() {
+        const char* value = std::getenv("MAG_RACE_PROVIDERS");
+        return value && std::string(value) == "1";
+    }
+    
+    static int get_percentile() {
+        int p = ServiceConfig::get_env_int("MAG_HEDGE_PERCENTILE", DEFAULT_PERCENTILE);
+        return p > 100 ? DEFAULT_PERCENTILE : p;
+    }
+};
+
+// Tenants sharing one llm_adapter: fair scheduling, quotas and per-tenant providers
+struct TenantConfig {
+    static constexpr size_t MAX_TENANTS = 256;     // named tenants tracked; later ones share OVERFLOW_TENANT
+    static constexpr int DEFAULT_MAX_QUEUED = 32;  // requests a tenant may have waiting for a worker
+    static constexpr const char* OVERFLOW_TENANT = "other";
+    
+    // Sent with every orchestrator request: MAG_TENANT, else the login name
+    static std::string get_tenant() {
+        const char* value = std::getenv("MAG_TENANT");
+        if (!value || !*value) {
+            value = std::getenv("USER");
+        }
+        return value ? std::string(value) : "";
+    }
+    
+    // Adapter side: "alice=2,bob=1" shares the workers 2:1 between them while both wait
+    static std::string get_weights() {
+        const char* value = std::getenv("MAG_TENANT_WEIGHTS");
+        return value ? std::string(value) : "";
+    }
+    
+    // Adapter side: "alice=anthropic,bob=openai" picks each tenant's default provider
+    static std::string get_providers() {
+        const char* value = std::getenv("MAG_TENANT_PROVIDERS");
+        return value ? std::string(value) : "";
+    }
+    
+    // Further requests from a tenant with this many waiting are turned away
+    static size_t get_max_queued() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_TENANT_MAX_QUEUED", DEFAULT_MAX_QUEUED));
+    }
+};
+
+// Record/replay of provider responses for offline runs and benchmarks
+struct ReplayConfig {
+    static constexpr const char* DEFAULT_CAPTURE_FILE = ".mag/replay/capture.jsonl";
+    
+    static std::string get_env_string(const char* name, const std::string& fallback) {
+        const char* value = std::getenv(name);
+        return (value && *value) ? std::string(value) : fallback;
+    }
+    
+    // Capture replayed by the "replay" provider
+    static std::string get_capture_file() {
+        return get_env_string("MAG_REPLAY_FILE", DEFAULT_CAPTURE_FILE);
+    }
+    
+    // Provider whose wire format the capture holds; empty takes it from the capture
+    static std::string get_format() {
+        return get_env_string("MAG_REPLAY_FORMAT", "");
+    }
+    
+    static int get_latency_ms() {
+        return ServiceConfig::get_env_int("MAG_REPLAY_LATENCY_MS", 0);
+    }
+    
+    static int get_jitter_ms() {
+        return ServiceConfig::get_env_int("MAG_REPLAY_JITTER_MS", 0);
     }
     
-    static std::string get_file_tool_url() {
-        return std::string("tcp://") + FILE_TOOL_HOST + ":" + std::to_string(FILE_TOOL_PORT);
+    // Strict replay fails on unrecorded requests; otherwise captured responses are served in rotation
+    static bool is_strict() {
+        return get_env_string("MAG_REPLAY_STRICT", "1") != "0";
     }
     
-    static std::string get_bash_tool_url() {
-        return std::string("tcp://") + BASH_TOOL_HOST + ":" + std::to_string(BASH_TOOL_PORT);
+    // Live responses are appended here when set (MAG_RECORD_FILE)
+    static std::string get_record_file() {
+        return get_env_string("MAG_RECORD_FILE", "");
+    }
+};
+
+// Background summarization of old conversation turns
+struct CompactionConfig {
+    static constexpr int DEFAULT_TRIGGER_TOKENS = 6000;  // history size that starts a compaction
+    static constexpr int DEFAULT_KEEP_RECENT = 6;        // newest messages always sent verbatim
+    
+    // MAG_COMPACTION=0 disables compaction and keeps resending the full transcript
+    static bool enabled() {
+        const char* value = std::getenv("MAG_COMPACTION");
+        return !value || std::string(value) != "0";
+    }
+    
+    static int get_trigger_tokens() {
+        return ServiceConfig::get_env_int("MAG_COMPACTION_TOKENS", DEFAULT_TRIGGER_TOKENS);
+    }
+    
+    static int get_keep_recent() {
+        return ServiceConfig::get_env_int("MAG_COMPACTION_KEEP", DEFAULT_KEEP_RECENT);
+    }
+    
+    // Summaries go to a cheap model; empty means the adapter's default provider and its default model
+    static std::string get_summary_provider() {
+        return ReplayConfig::get_env_string("MAG_SUMMARY_PROVIDER", "");
+    }
+    
+    static std::string get_summary_model() {
+        return ReplayConfig::get_env_string("MAG_SUMMARY_MODEL", "");
+    }
+};
+
+// Append-only session journals (.mag/conversations/<session>.jsonl)
+struct JournalConfig {
+    static constexpr size_t SYNC_EVERY_RECORDS = 32;      // fdatasync after this many unsynced appends
+    static constexpr int SYNC_INTERVAL_MS = 1000;         // ... or once this much time has passed
+    static constexpr size_t COMPACT_AFTER_DROPPED = 256;  // rewrite once this many records are dead
+    static constexpr size_t READ_CHUNK_BYTES = 64 * 1024;
+    
+    // MAG_RESUME_MESSAGES=N loads only the newest N messages of a resumed session (default: all)
+    static size_t get_resume_messages() {
+        return static_cast<size_t>(ServiceConfig::get_env_int("MAG_RESUME_MESSAGES", 0));
+    }
+};
+
+// Encoding of messages between MAG services
+struct WireConfig {
+    // MAG_WIRE_FORMAT=json|msgpack|cbor picks what clients send; services answer in kind.
+    // json keeps the traffic readable when debugging.
+    static std::string get_format() {
+        return ReplayConfig::get_env_string("MAG_WIRE_FORMAT", "msgpack");
+    }
+};
+
+// Distributed tracing (see Tracer)
+struct TraceConfig {
+    static constexpr const char* DEFAULT_TRACE_FILE = ".mag/trace.json";
+    static constexpr const char* DEFAULT_OTLP_ENDPOINT = "http://localhost:4318/v1/traces";
+    
+    // MAG_TRACE=chrome, otlp or chrome,otlp turns tracing on; off by default
+    static std::string get_exporters() {
+        return ReplayConfig::get_env_string("MAG_TRACE", "");
+    }
+    
+    // Chrome trace file every process of a run appends to
+    static std::string get_trace_file() {
+        return ReplayConfig::get_env_string("MAG_TRACE_FILE", DEFAULT_TRACE_FILE);
+    }
+    
+    static std::string get_otlp_endpoint() {
+        return ReplayConfig::get_env_string("MAG_OTLP_ENDPOINT", DEFAULT_OTLP_ENDPOINT);
+    }
+};
+
+// Single-process mode: the orchestrator calls the providers, FileTool and
+// BashTool directly instead of the llm_adapter/file_tool/bash_tool services
+struct EmbeddedConfig {
+    // MAG_EMBEDDED=1 (or main_orchestrator --embedded) turns it on
+    static bool is_enabled() {
+        const char* value = std::getenv("MAG_EMBEDDED");
+        return value && std::string(value) == "1";
     }
 };
 
@@ -35,14 +504,23 @@ struct APIConfig {
     // OpenAI API
     static constexpr const char* OPENAI_BASE_URL = "https://api.openai.com/v1/chat/completions";
     static constexpr const char* OPENAI_DEFAULT_MODEL = "gpt-3.5-turbo";
+    static constexpr const char* OPENAI_FILES_URL = "https://api.openai.com/v1/files";     // batch input and output
+    static constexpr const char* OPENAI_BATCHES_URL = "https://api.openai.com/v1/batches";
     
     // Anthropic API
     static constexpr const char* ANTHROPIC_BASE_URL = "https://api.anthropic.com/v1/messages";
     static constexpr const char* ANTHROPIC_DEFAULT_MODEL = "claude-3-haiku-20240307";
+    static constexpr const char* ANTHROPIC_BATCHES_URL = "https://api.anthropic.com/v1/messages/batches";
     
     // Mistral API
     static constexpr const char* MISTRAL_BASE_URL = "https://api.mistral.ai/v1/chat/completions";
-    static constexpr const char* MISTRAL_DEFAULT_MODEL = "mistral-tiny";
+    static constexpr const char* MISTRAL_DEFAULT_MODEL = "mistral-small-latest";
+    
+    // Provider-side prompt caching is on unless MAG_PROMPT_CACHING=0
+    static bool prompt_caching_enabled() {
+        const char* value = std::getenv("MAG_PROMPT_CACHING");
+        return !value || std::string(value) != "0";
+    }
 };
 
 } // namespace mag
\ No newline at end of file
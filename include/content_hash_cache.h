@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace mag {
+
+/**
+ * @brief Remembers the content hash of files the file tool has seen
+ *
+ * Entries are keyed by path and only trusted while the file's size, mtime
+ * and inode are the ones recorded with the hash, so an edit made by anyone
+ * else (or a rename over the path) shows up as a miss. A different size
+ * never needs a hash at all. On a miss the file is read and compared byte
+ * for byte, and its hash is recorded for next time.
+ *
+ * Like git's index, an entry whose mtime is too close to the moment it was
+ * hashed is "racy": another write in the same timestamp tick could leave
+ * size and mtime unchanged. Such entries are re-read once; the check then
+ * lands well after the mtime and the entry becomes trusted.
+ */
+class ContentHashCache {
+public:
+    explicit ContentHashCache(size_t max_entries = DEFAULT_MAX_ENTRIES);
+    
+    /**
+     * @brief True when path is a regular file that already holds exactly content
+     */
+    bool matches(const std::string& path, std::string_view content);
+    
+    // Same check for content known only by its size and Utils::hash64
+    bool matches_hash(const std::string& path, uint64_t size, uint64_t hash);
+    
+    /**
+     * @brief Record that path now holds content (called right after writing it)
+     *
+     * Only a file whose mtime is already older than RACY_WINDOW, e.g. one
+     * whose bytes were staged a while ago, is recorded; for a fresh write
+     * the old entry is dropped and the first check after the window reads
+     * the file once.
+     */
+    void remember(const std::string& path, std::string_view content);
+    void remember_hash(const std::string& path, uint64_t size, uint64_t hash);
+    void forget(const std::string& path);
+    
+    size_t size() const;
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }   // answered without reading
+    uint64_t reads() const { return reads_.load(std::memory_order_relaxed); } // had to read the file
+    
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 4096;
+    static constexpr std::chrono::nanoseconds RACY_WINDOW = std::chrono::seconds(2);
+    
+private:
+    struct Entry {
+        off_t size = 0;
+        int64_t mtime_ns = 0;
+        ino_t inode = 0;
+        dev_t device = 0;
+        uint64_t hash = 0;
+        int64_t hashed_at_ns = 0; // wall clock, comparable with mtime
+    };
+    
+    size_t max_entries_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> reads_{0};
+    
+    void store(const std::string& path, Entry entry);
+    
+    // The recorded hash if the entry for path is trustworthy for a file with this stat
+    std::optional<uint64_t> lookup(const std::string& path, const struct stat& st) const;
+    
+    // Record hash unless the file changed since st was taken
+    void record(const std::string& path, const struct stat& st, uint64_t hash, int64_t hashed_at_ns);
+};
+
+} // namespace mag
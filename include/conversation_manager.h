@@ -1,9 +1,18 @@
 #pragma once
 
 #include "llm_provider.h"
+#include "token_counter.h"
+#include "session_journal.h"
+#include "session_index.h"
+#include "history_buffer.h"
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <nlohmann/json.hpp>
 
 namespace mag {
@@ -21,6 +30,8 @@ public:
     
     // History access
     std::vector<ConversationMessage> get_history() const;
+    // Zero-copy view of the same messages; valid until the history is next modified
+    HistoryView history_view() const;
     std::vector<ConversationMessage> get_history_since(const std::string& timestamp) const;
     size_t get_message_count() const;
     bool is_empty() const;
@@ -28,7 +39,27 @@ public:
     // History management
     void clear_history();
     void trim_to_last_n_messages(size_t n);
-    void trim_to_token_limit(size_t max_tokens); // Rough estimation
+    // Drop the oldest messages until the history fits; O(messages removed)
+    void trim_to_token_limit(size_t max_tokens);
+    
+    // Token accounting: every message caches its count and the total is kept current.
+    // By default counts are calibrated by the usage reports passed to record_usage()
+    // (or usage_recorder()); a message is counted with the ratio known when it is added.
+    void set_token_counter(std::shared_ptr<const TokenCounter> counter); // nullptr: the default
+    size_t get_token_count() const;
+    
+    // Context compaction: once the history passes trigger_tokens, everything but the
+    // newest keep_recent messages is summarized once, in the background, and replaced
+    // by a single system message. Finished summaries are applied on the next add.
+    using Summarizer = std::function<std::string(const std::vector<ConversationMessage>& turns,
+                                                 const std::string& previous_summary)>;
+    void enable_compaction(Summarizer summarizer, size_t trigger_tokens, size_t keep_recent);
+    void disable_compaction();
+    bool is_compacting() const;
+    void wait_for_compaction(); // block until an in-flight summary is done, then apply it
+    
+    static constexpr const char* SUMMARY_PREFIX = "[Summary of earlier conversation]\n";
+    static bool is_summary(const ConversationMessage& message);
     
     // Session management
     void start_new_session();
@@ -38,8 +69,13 @@ public:
     // Persistence
     void save_to_disk();
     void load_from_disk();
-    bool load_session(const std::string& session_id);
+    // max_messages > 0 reads only that many of the newest messages from the journal tail
+    bool load_session(const std::string& session_id, size_t max_messages = 0);
     std::vector<std::string> get_available_sessions() const;
+    // Served from the session index: newest activity first, paged
+    std::vector<SessionInfo> list_sessions(size_t offset, size_t limit) const;
+    std::optional<SessionInfo> find_session(const std::string& session_id) const;
+    size_t get_session_count() const;
     
     // Configuration
     void set_storage_directory(const std::string& dir);
@@ -49,29 +85,83 @@ public:
     std::string get_session_created_time() const;
     std::string get_last_activity_time() const;
     std::string get_last_provider_used() const;
+    
+    // Provider usage: billed tokens per "provider/model" for this session, saved
+    // with its metadata. Safe to call from any thread.
+    void record_usage(const ProviderUsage& usage);
+    std::map<std::string, UsageTotals> get_usage_by_model() const;
+    UsageTotals get_usage_totals() const;
+    // record_usage as a callback that may outlive this manager, for the
+    // background summarizer's client
+    std::function<void(const ProviderUsage&)> usage_recorder() const;
 
 private:
-    std::vector<ConversationMessage> conversation_history_;
+    HistoryBuffer conversation_history_;
+    TextArena text_arena_; // message contents of the current session
+    std::shared_ptr<CalibratedTokenCounter> calibrated_counter_; // shared with usage_recorder() callbacks
+    std::shared_ptr<const TokenCounter> token_counter_;
+    size_t total_tokens_ = 0;
+    uint64_t next_sequence_ = 0;      // journal sequence for the next appended message
+    uint64_t history_generation_ = 0; // bumped whenever the history is replaced wholesale
+    
+    // Shared with the background summarizer so it can outlive this manager
+    struct CompactionState {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool in_flight = false;
+        bool ready = false;
+        uint64_t generation = 0;      // history the summary was built from
+        uint64_t covers_until = 0;    // summary replaces messages with a lower sequence number
+        std::string summary;
+    };
+    std::shared_ptr<CompactionState> compaction_;
+    Summarizer summarizer_;
+    size_t compaction_trigger_tokens_ = 0;
+    size_t compaction_keep_recent_ = 0;
     std::string session_id_;
     std::string storage_directory_;
     std::string session_created_time_;
     std::string last_activity_time_;
     std::string last_provider_used_;
+    // Shared with usage_recorder() callbacks
+    struct UsageState {
+        std::mutex mutex;
+        std::map<std::string, UsageTotals> by_model;
+    };
+    std::shared_ptr<UsageState> usage_;
     
     // Helper methods
     std::string generate_session_id() const;
     std::string get_session_file_path() const;
     std::string get_session_file_path(const std::string& session_id) const;
+    std::string get_legacy_session_file_path(const std::string& session_id) const;
+    bool load_legacy_session(const std::string& session_id);
     void update_last_activity();
+    void append_message(ConversationMessage message);
+    void adopt_message(ConversationMessage message); // in-memory only, sequence already set
+    void drop_oldest(size_t count);
+    void reset_history();
+    void maybe_start_compaction();
+    void apply_compaction();
     void ensure_storage_directory_exists();
     
-    // JSON serialization
-    nlohmann::json to_json() const;
+    // Persistence: an append-only journal per session, opened on first write
+    std::unique_ptr<SessionJournal> journal_;
+    bool journal_is_new_session_ = true;
+    SessionJournal& open_journal();
+    void journal_write(const std::function<void(SessionJournal&)>& write);
+    void apply_metadata(const nlohmann::json& metadata);
+    nlohmann::json usage_to_json() const;
+    
+    // Listing and lookup without opening session files; one per storage directory
+    mutable std::unique_ptr<SessionIndex> session_index_;
+    SessionIndex& session_index() const;
+    
+    // Legacy whole-file JSON sessions
     void from_json(const nlohmann::json& j);
     
     // Constants
     static constexpr size_t DEFAULT_TOKEN_LIMIT = 8000; // Conservative estimate
-    static constexpr size_t CHARS_PER_TOKEN = 4; // Rough approximation
 };
 
 } // namespace mag
\ No newline at end of file
@@ -1,22 +1,33 @@
 #pragma once
 
 #include "message.h"
+#include "config.h"
 #include "policy.h"
 #include "todo_manager.h"
+#include "tool_call_parser.h"
+#include "plan_prefetcher.h"
+#include "plan_batch_store.h"
+#include "execution_controller.h"
+#include "local_planner.h"
+#include "batch_runner.h"
 #include "bash_tool.h"
 #include "llm_provider.h"
 #include "interfaces/llm_client_interface.h"
 #include "interfaces/file_client_interface.h"
+#include "interfaces/bash_client_interface.h"
 #include <string>
 #include <memory>
 #include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
 
 namespace mag {
 
 class Coordinator {
 public:
     // Execution control state
-    enum class ExecutionState { STOPPED, RUNNING, PAUSED, CANCELLED };
+    using ExecutionState = ExecutionController::State;
     
     // Original constructors for backward compatibility
     Coordinator();
@@ -26,17 +37,35 @@ public:
     Coordinator(std::unique_ptr<ILLMClient> llm_client, 
                 std::unique_ptr<IFileClient> file_client,
                 PolicyChecker policy_checker = PolicyChecker(),
-                TodoManager todo_manager = TodoManager());
+                TodoManager todo_manager = TodoManager(),
+                std::unique_ptr<IBashClient> bash_client = nullptr);
     
     ~Coordinator();
     
     void run(const std::string& user_prompt);
+    // Headless: one JSONL prompt per line in, one JSONL result per prompt out (see BatchRunner)
+    BatchSummary run_batch(std::istream& input, std::ostream& output, size_t concurrency,
+                           BatchRunner::Approval approval);
     std::string run_with_conversation_history(const std::string& user_prompt, 
-                                             const std::vector<ConversationMessage>& conversation_history);
+                                             HistoryView conversation_history);
     void set_provider(const std::string& provider_name);
     std::string get_current_provider() const { return current_provider_; }
     void set_chat_mode(bool enabled);
     void toggle_chat_mode();
+    void set_streaming(bool enabled) { streaming_ = enabled; }
+    
+    // Where confirmation answers come from; the default reads std::cin. The CLI
+    // routes them through its input loop so they can be asked from a worker thread.
+    using LineReader = std::function<std::string(const std::string& prompt)>;
+    void set_line_reader(LineReader reader) { line_reader_ = std::move(reader); }
+    bool is_streaming() const { return streaming_; }
+    
+    // Provider usage reported with each LLM response (see ILLMClient::set_usage_observer)
+    void set_usage_observer(ILLMClient::UsageObserver observer) {
+        if (llm_client_) {
+            llm_client_->set_usage_observer(std::move(observer));
+        }
+    }
     
     // Todo operations
     TodoManager& get_todo_manager() { return todo_manager_; }
@@ -46,63 +75,88 @@ public:
     void execute_todos_range(int start_id, int end_id); // Execute todos in range [start_id, end_id]
     void execute_single_todo(const TodoItem& todo);
     
+    // Plans for many todos from one provider batch job: cheaper, but ready within
+    // hours rather than seconds. The plans are kept (see PlanBatchStore) and used
+    // when their todos run, still dry-run and policy-checked like any other plan.
+    void submit_plan_batch();  // the pending file todos that have no plan yet
+    void check_plan_batches(); // poll the jobs in flight and keep the plans of those that ended
+    
     // Execution control methods
     void pause_execution();
     void resume_execution();
     void stop_execution();
-    void cancel_execution();
-    ExecutionState get_execution_state() const { return execution_state_; }
+    void cancel_execution(); // also aborts requests still waiting on a service
+    ExecutionState get_execution_state() const { return execution_.state(); }
     
 private:
     PolicyChecker policy_checker_;
     TodoManager todo_manager_;
     bool always_approve_ = false;
     bool chat_mode_ = true; // Default to chat mode
+    bool streaming_ = true; // Render chat replies as they are generated
     
-    ExecutionState execution_state_ = ExecutionState::STOPPED;
-    std::atomic<bool> should_stop_execution_{false};
-    std::atomic<bool> should_pause_execution_{false};
+    ExecutionController execution_;
+    std::mutex confirmation_mutex_; // one confirmation prompt at a time
+    LineReader line_reader_;
     
     // Interface-based communication (new design)
     std::unique_ptr<ILLMClient> llm_client_;
     std::unique_ptr<IFileClient> file_client_;
-    
-    // Legacy NNG communication (for backward compatibility)
-    void* llm_socket_;
-    void* file_socket_;
-    void* bash_socket_;
+    std::unique_ptr<IBashClient> bash_client_;
     std::string current_provider_;
+    mutable std::atomic<std::shared_ptr<const LocalCommandPlanner>> local_planner_; // rebuilt when the policy changes
+    std::unique_ptr<PlanPrefetcher> plan_prefetcher_; // plans ahead of the todo being executed, during a run
+    PlanBatchStore plan_batches_{TodoConfig::get_plan_batch_path()};
     
     // Initialization methods
-    void initialize_sockets();
-    void cleanup_sockets();
     void initialize_with_defaults();
+    void initialize_embedded();
+    // Send each prompt with a slice of the project index (MAG_CONTEXT_BUDGET)
+    void attach_project_context();
     
     // Network communication methods
     WriteFileCommand request_plan_from_llm(const std::string& user_prompt);
     GenericCommand request_generic_plan_from_llm(const std::string& user_prompt);
     std::string request_chat_from_llm(const std::string& user_prompt);
+    std::string request_streamed_chat_from_llm(const std::string& user_prompt);
     std::string request_chat_from_llm_with_history(const std::string& user_prompt,
-                                                   const std::vector<ConversationMessage>& conversation_history);
+                                                   HistoryView conversation_history);
     DryRunResult request_dry_run(const WriteFileCommand& command);
+    std::future<DryRunResult> request_dry_run_async(const WriteFileCommand& command);
     ApplyResult request_apply(const WriteFileCommand& command);
+    BatchDryRunResult request_dry_run_batch(const std::vector<WriteFileCommand>& commands);
+    BatchApplyResult request_apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing);
     
-    // Bash command communication
+    // Bash command communication; output is printed live as it arrives
     CommandResult request_bash_execution(const BashCommand& command);
+    void cancel_pending_requests();
+    void begin_run(); // cancelling the run aborts the requests it is waiting on
     
     // Todo execution methods
     bool should_execute_as_bash_command(const std::string& prompt);
     void execute_todo_as_bash_command(const TodoItem& todo);
+    BashCommand plan_bash_todo(const TodoItem& todo, bool check_policy = true); // throws if no command or refused
+    void execute_bash_todo_group(const std::vector<TodoItem>& todos);
     void execute_todo_as_file_operation(const TodoItem& todo);
+    std::string todo_prompt(const TodoItem& todo) const;
+    WriteFileCommand plan_file_todo(const TodoItem& todo); // the policy is checked for the whole batch
+    WriteFileCommand request_todo_plan(const TodoItem& todo); // prefetched when a run has started a prefetch
+    void start_plan_prefetch(const std::vector<TodoItem>& todos);
+    std::string plan_batch_context() const; // provider and policy, the same in every session
+    void execute_file_todo_batch(const std::vector<TodoItem>& todos);
+    void execute_todo_graph(const std::vector<TodoItem>& todos, size_t width);
     void execute_generic_command(const GenericCommand& command);
     
     // Helper methods
-    std::string extract_bash_command_from_prompt(const std::string& prompt);
-    void display_bash_result(const CommandResult& result);
+    std::string extract_bash_command_from_prompt(const std::string& prompt); // for todos the local planner is unsure of
+    std::shared_ptr<const LocalCommandPlanner> local_planner() const;
+    void display_bash_result(const CommandResult& result, bool output_shown = false);
     
     bool get_user_confirmation(const DryRunResult& dry_run_result);
     void display_result(const ApplyResult& result);
     std::string parse_and_execute_todo_operations(const std::string& llm_response);
+    std::string run_tool_call(const ToolCall& call, std::string& execution_log); // returns the call's replacement text
+    void report_tool_calls(const std::string& execution_log);
 };
 
 } // namespace mag
\ No newline at end of file
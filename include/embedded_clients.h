@@ -0,0 +1,105 @@
+#pragma once
+
+#include "interfaces/llm_client_interface.h"
+#include "interfaces/file_client_interface.h"
+#include "interfaces/bash_client_interface.h"
+#include "llm_client.h"
+#include "file_operations.h"
+#include "bash_tool.h"
+#include "project_index.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace mag {
+
+/**
+ * @brief ILLMClient that calls the providers directly instead of the llm_adapter
+ *
+ * Requests go through an LLMClientPool with the same provider selection as
+ * the adapter service: an explicit provider is used as-is, otherwise the
+ * default fails over to the next provider with a key. The response cache and
+ * recorder are configured from the same environment as the adapter. Hedged
+ * plan racing is an adapter feature and is not available here. The default
+ * client is prewarmed in the background while the session starts up.
+ */
+class EmbeddedLLMClient : public ILLMClient {
+public:
+    explicit EmbeddedLLMClient(const std::string& provider_override = "");
+    
+    WriteFileCommand request_plan(const std::string& user_prompt) override;
+    GenericCommand request_generic_plan(const std::string& user_prompt) override;
+    std::string request_chat(const std::string& user_prompt) override;
+    std::string request_chat_stream(const std::string& user_prompt,
+                                    const std::function<void(const std::string&)>& on_chunk) override;
+    std::string request_chat_with_history(HistoryView conversation_history) override;
+    std::string request_summary(const std::vector<ConversationMessage>& turns,
+                                const std::string& previous_summary) override;
+    PlanBatchStatus submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) override;
+    PlanBatchStatus poll_plan_batch(const PlanBatchStatus& batch) override;
+    std::vector<PlanBatchResult> collect_plan_batch(const PlanBatchStatus& batch) override;
+    void set_provider(const std::string& provider_name) override;
+    std::string get_current_provider() const override;
+    void cancel_pending() override; // aborts the HTTP transfers of plans in flight
+    
+private:
+    LLMClientPool clients_;
+    std::string current_provider_;
+    std::mutex pending_mutex_;
+    CancellationToken pending_; // shared by the plan requests in flight
+    std::future<void> prewarm_; // last, so it is waited for before the pool goes
+    
+    template <typename Call>
+    auto call_provider(const std::string& provider, Call&& call)
+        -> decltype(call(std::declval<const LLMClient&>()));
+};
+
+/**
+ * @brief IFileClient backed by an in-process FileTool
+ *
+ * Reads, and the project index behind context(), are held to the file_tool
+ * read policy, as in the file_tool service.
+ */
+class EmbeddedFileClient : public IFileClient {
+public:
+    EmbeddedFileClient();
+    
+    DryRunResult dry_run(const WriteFileCommand& command) override;
+    ApplyResult apply(const WriteFileCommand& command) override;
+    BatchDryRunResult dry_run_batch(const std::vector<WriteFileCommand>& commands) override;
+    BatchApplyResult apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) override;
+    ReadFileResult read(const ReadFileRequest& request) override;
+    FileStatResult stat(const std::string& path) override;
+    ContextSlice context(const std::string& query, size_t budget_tokens) override;
+    
+private:
+    FileTool file_tool_;
+    std::unique_ptr<ProjectIndex> index_; // walks the tree on the first context()
+};
+
+/**
+ * @brief IBashClient backed by an in-process BashTool
+ *
+ * Keeps the working directory between commands the way bash_tool_service
+ * does, so "cd build" in one todo carries over to the next. Commands share
+ * one persistent shell, so exported variables carry over as well.
+ */
+class EmbeddedBashClient : public IBashClient {
+public:
+    EmbeddedBashClient();
+    
+    CommandResult execute(const BashCommand& command) override;
+    CommandResult execute_stream(const BashCommand& command, const BashTool::OutputHandler& on_output) override;
+    LogChunk read_log(const std::string& path, uint64_t offset, size_t max_bytes) override;
+    void cancel_pending() override;
+    const std::string& working_directory() const { return working_directory_; }
+    
+private:
+    BashTool bash_tool_;
+    std::string working_directory_;
+    std::mutex running_mutex_;
+    CancellationToken running_; // of the command in progress
+};
+
+} // namespace mag
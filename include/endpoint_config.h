@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Where the MAG services listen and dial
+ *
+ * Resolved once per process from, in increasing precedence: the built-in
+ * tcp loopback defaults, .mag/network.json (or the file named by
+ * MAG_NETWORK_CONFIG) and environment variables:
+ *
+ *   MAG_TRANSPORT     tcp | ipc | inproc
+ *   MAG_INSTANCE      name that keeps several MAG instances on one host apart
+ *   MAG_HOST          tcp host (default 127.0.0.1)
+ *   MAG_PORT_BASE     tcp port of the LLM adapter; file tool +1, bash tool +2
+ *   MAG_IPC_DIR       directory for ipc sockets (default $XDG_RUNTIME_DIR or /tmp)
+ *   MAG_LLM_ADAPTER_URL, MAG_FILE_TOOL_URL, MAG_BASH_TOOL_URL
+ *                     full URL for one service, overriding everything above;
+ *                     a comma-separated list names several workers
+ *   MAG_WORKER_REGISTRY
+ *                     directory where workers register themselves (off by default)
+ *
+ * The file uses the same settings in lower case ("transport", "instance",
+ * "host", "port_base", "ipc_dir", "worker_registry") plus an "endpoints"
+ * object keyed by service name whose values are a URL or an array of URLs.
+ * ipc:// (Unix domain sockets) skips the TCP stack entirely for same-host
+ * hops; inproc:// only reaches services in the same process.
+ *
+ * A service process listens on the first URL; clients spread their
+ * requests over all of them (see EndpointPool).
+ */
+class EndpointConfig {
+public:
+    enum class Service { LLM_ADAPTER, FILE_TOOL, BASH_TOOL };
+
+    using EnvLookup = std::function<std::optional<std::string>(const char* name)>;
+
+    // Process-wide settings, loaded on first use
+    static const EndpointConfig& instance();
+
+    // Testing hook: an explicit config file and environment
+    static EndpointConfig load(const std::string& config_file, const EnvLookup& env);
+
+    std::string url(Service service) const;
+    std::vector<std::string> urls(Service service) const;
+    
+    const std::string& registry_directory() const { return registry_directory_; }
+
+    const std::string& transport() const { return transport_; }
+    const std::string& instance_name() const { return instance_; }
+
+    static const char* service_name(Service service);
+
+private:
+    std::string transport_ = "tcp";
+    std::string instance_;
+    std::string host_;
+    int port_base_ = 0;
+    std::string ipc_directory_;
+    std::string registry_directory_;
+    std::map<std::string, std::vector<std::string>> overrides_; // service name -> full URLs
+
+    int port_offset(Service service) const;
+};
+
+} // namespace mag
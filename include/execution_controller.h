@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cancellation.h"
+#include <condition_variable>
+#include <mutex>
+
+namespace mag {
+
+/**
+ * @brief Pause, resume, stop and cancel for a todo run, without polling
+ *
+ * The run calls proceed() before each todo. It blocks while the run is
+ * paused and wakes the moment the run is resumed, stopped or cancelled.
+ * Each run has its own CancellationToken; cancel() fires it, so whatever
+ * was registered on it (aborting requests still in flight) happens at once
+ * rather than when the current todo finishes.
+ */
+class ExecutionController {
+public:
+    enum class State { STOPPED, RUNNING, PAUSED, CANCELLED };
+    
+    // Starts a run; the token fires if the run is cancelled
+    CancellationToken begin();
+    void end();
+    
+    // Each returns false when there is no run in a state it applies to
+    bool pause();
+    bool resume();
+    bool stop();   // no further todos start; the current one finishes
+    bool cancel(); // also fires the run's token
+    
+    // Blocks while paused; false once the run has been stopped or cancelled
+    bool proceed();
+    bool stopping() const;
+    
+    State state() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    State state_ = State::STOPPED;
+    bool active_ = false;   // between begin() and end()
+    bool stopping_ = false; // stop() or cancel() during this run
+    CancellationToken token_;
+};
+
+} // namespace mag
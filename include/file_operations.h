@@ -1,20 +1,165 @@
 #pragma once
 
+#include "config.h"
+#include "content_hash_cache.h"
+#include "file_transfer.h"
+#include "mapped_file.h"
 #include "message.h"
+#include "path_locks.h"
+#include "policy.h"
+#include "thread_pool.h"
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace mag {
 
+/**
+ * @brief A read whose content still lies in the file's mapping
+ *
+ * result.content stays empty; content views file, or copy for slices of at
+ * most FileToolConfig::COPY_READ_BYTES and for files that shrank while
+ * mapped, and is valid as long as this slice lives.
+ */
+struct FileSlice {
+    ReadFileResult result;
+    std::shared_ptr<const MappedFile> file;
+    std::shared_ptr<const std::string> copy;
+    std::string_view content;
+};
+
+/**
+ * @brief Validates and performs file writes
+ *
+ * Every write goes to a temp file in the target's directory and is renamed
+ * into place, so the target is never seen half-written. Durable writes
+ * (the default, see FileToolConfig::durable_writes()) also sync the data
+ * and the directory before reporting success.
+ *
+ * A write whose content the file already holds is skipped and reported as
+ * unchanged, so mtimes (and the rebuilds they trigger) stay put. The check
+ * goes through a ContentHashCache shared by copies of this FileTool.
+ *
+ * FileTool is safe to call from several threads. Writes to the same path
+ * are serialized in arrival order (see PathLocks) and writes to different
+ * paths run side by side.
+ */
 class FileTool {
 public:
-    FileTool() = default;
+    FileTool();
+    
+    /**
+     * @param io_threads Workers that stage and sync the files of a batch in
+     *        parallel; 1 does everything on the calling thread
+     */
+    explicit FileTool(bool durable, size_t io_threads = FileToolConfig::get_io_threads());
     
     DryRunResult dry_run(const std::string& path, const std::string& content) const;
     ApplyResult apply(const std::string& path, const std::string& content) const;
     
+    /**
+     * @brief Edit a file with a unified diff or search/replace blocks (see apply_patch())
+     *
+     * The dry run reports the diff the patch would make; a patch that does
+     * not match the file fails both calls and leaves the file untouched.
+     */
+    DryRunResult dry_run_patch(const std::string& path, const std::string& patch) const;
+    ApplyResult apply_patch(const std::string& path, const std::string& patch) const;
+    
+    // WriteFile or PatchFile, by command.command
+    DryRunResult dry_run(const WriteFileCommand& command) const;
+    ApplyResult apply(const WriteFileCommand& command) const;
+    
+    /**
+     * @brief Validate and describe many writes at once
+     *
+     * On top of the single-item dry run every command must name a path
+     * that is not a directory, and no two commands may write the same path.
+     */
+    BatchDryRunResult dry_run_batch(const std::vector<WriteFileCommand>& commands) const;
+    
+    /**
+     * @brief Write many files in request order
+     * @param all_or_nothing Refuse the batch if any item fails validation, and
+     *        leave every target untouched if any write fails
+     *
+     * Every file is staged before any is renamed into place, then the data
+     * syncs run with all the writebacks already in flight, and each
+     * directory is synced once, so a batch does not pay one full flush per
+     * file. Staging and syncing are spread over the I/O workers; renames
+     * stay in request order. Each parent directory is created once however
+     * many items share it. Without all_or_nothing every valid item is
+     * written on its own.
+     * Parent directories created for a rolled-back batch are left in place.
+     */
+    BatchApplyResult apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) const;
+    
+    /**
+     * @brief Chunked writes of large files (see FileTransferRequest)
+     *
+     * Chunks go to the staged file as they arrive. commit_transfer() checks
+     * the assembled file against the announced hash, then takes the path
+     * lock and puts it in place like apply(), or reports it unchanged.
+     * begin_transfer() refuses a size above the policy's max_file_size_mb
+     * (the default policy's without a read policy).
+     */
+    FileTransferReply begin_transfer(const std::string& path, uint64_t size, uint64_t hash) const;
+    FileTransferReply write_chunk(const std::string& transfer_id, uint64_t offset, std::string_view data) const;
+    ApplyResult commit_transfer(const std::string& transfer_id) const;
+    bool abort_transfer(const std::string& transfer_id) const;
+    size_t active_transfers() const { return transfers_->active(); }
+    
+    // Dry run of a write known only by its size and Utils::hash64; there is no diff
+    DryRunResult dry_run_digest(const std::string& path, uint64_t size, uint64_t hash) const;
+    
+    /**
+     * @brief Read a file, or the lines or bytes a ReadFileRequest selects
+     *
+     * The file is mmap'd and only the lines up to the requested range are
+     * scanned. Replies stop at FileToolConfig::MAX_READ_BYTES (at a line
+     * boundary for line reads) and set truncated. A range past the end of
+     * the file is an empty success. With a read policy set, paths it denies
+     * for file_tool reads fail.
+     */
+    FileSlice read_slice(const ReadFileRequest& request) const;
+    ReadFileResult read(const ReadFileRequest& request) const; // read_slice() with the content copied out
+    
+    // A missing file is a success with exists == false
+    FileStatResult stat(const std::string& path) const;
+    
+    // Checked by read_slice() and stat(); MAG's write policy is applied by the orchestrator
+    void set_read_policy(std::shared_ptr<const PolicyChecker> policy) { read_policy_ = std::move(policy); }
+    
+    bool durable() const { return durable_; }
+    const ContentHashCache& content_hashes() const { return *hashes_; }
+    size_t io_threads() const { return io_pool_ ? io_pool_->size() : 1; }
+    
 private:
-    std::string generate_dry_run_description(const std::string& path, const std::string& content) const;
-    std::string generate_apply_description(const std::string& path, const std::string& content) const;
+    bool durable_;
+    std::shared_ptr<ContentHashCache> hashes_;
+    std::shared_ptr<PathLocks> path_locks_;
+    std::shared_ptr<ThreadPool> io_pool_; // null when io_threads is 1
+    std::shared_ptr<const PolicyChecker> read_policy_;
+    std::shared_ptr<FileTransfers> transfers_;
+    
+    // Empty when the read policy allows path
+    std::string read_denied(const std::string& path) const;
+    
+    // apply() once the path is locked
+    ApplyResult write_locked(const std::string& path, const std::string& content) const;
+    
+    // Run task(0) .. task(count - 1) on the I/O workers and wait for all of them
+    void for_each_parallel(size_t count, const std::function<void(size_t)>& task) const;
+    
+    ApplyResult applied(const std::string& path, uint64_t size, const std::string& working_dir_before) const;
+    ApplyResult unchanged(const std::string& path, uint64_t size, const std::string& working_dir_before) const;
+    
+    // The file's content after the patch; throws PatchError if it does not apply
+    std::string patched_content(const std::string& path, const std::string& patch) const;
+
+    std::string generate_dry_run_description(const std::string& path, uint64_t size) const;
+    std::string generate_apply_description(const std::string& path, uint64_t size) const;
 };
 
 } // namespace mag
\ No newline at end of file
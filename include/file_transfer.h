@@ -0,0 +1,78 @@
+#pragma once
+
+#include "atomic_write.h"
+#include "config.h"
+#include "message.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Chunked writes in progress in one file_tool process
+ *
+ * Each transfer stages its file with StagedFile and writes every chunk at
+ * its offset the moment it arrives, so the process holds at most one chunk
+ * per request in flight whatever the size of the file. Chunks of different
+ * transfers are written side by side. A transfer left idle for
+ * IDLE_TIMEOUT_MS is dropped (and its temp file removed) by the next
+ * begin(), and at most MAX_ACTIVE run at once.
+ */
+class FileTransfers {
+public:
+    // A transfer with every chunk written, ready to be put in place
+    struct Finished {
+        std::string path;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        std::unique_ptr<StagedFile> staged;
+    };
+    
+    explicit FileTransfers(bool durable, size_t chunk_size = FileTransferConfig::CHUNK_BYTES);
+    
+    // Refuses a size above max_size before anything is staged or allocated for it
+    FileTransferReply begin(const std::string& path, uint64_t size, uint64_t hash, uint64_t max_size);
+    FileTransferReply write_chunk(const std::string& transfer_id, uint64_t offset, std::string_view data);
+    
+    /**
+     * @brief Take a complete transfer out of the table
+     * @throws std::runtime_error if it is unknown or chunks are missing; the transfer is dropped either way
+     */
+    Finished finish(const std::string& transfer_id);
+    
+    bool abort(const std::string& transfer_id);
+    size_t active() const;
+    size_t chunk_size() const { return chunk_size_; }
+    
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Transfer {
+        std::mutex mutex;
+        std::string path;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        std::unique_ptr<StagedFile> staged;
+        std::vector<bool> received; // per chunk
+        size_t chunks_received = 0;
+        uint64_t bytes_received = 0;
+        Clock::time_point last_used;
+    };
+    
+    bool durable_;
+    size_t chunk_size_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Transfer>> transfers_;
+    std::mt19937_64 random_;
+    
+    void expire_idle(Clock::time_point now); // mutex_ held
+};
+
+} // namespace mag
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "message.h"
+#include "llm_client.h"
+#include "cancellation.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <functional>
+
+namespace mag {
+
+/**
+ * @brief Sliding window of request latencies with percentile queries
+ */
+class LatencyTracker {
+public:
+    explicit LatencyTracker(size_t window_size);
+    
+    void record(std::chrono::milliseconds latency);
+    
+    // Nearest-rank percentile (0-100) over the window; nullopt when empty
+    std::optional<std::chrono::milliseconds> percentile(double p) const;
+    size_t sample_count() const;
+    
+private:
+    size_t window_size_;
+    mutable std::mutex mutex_;
+    std::vector<std::chrono::milliseconds> samples_; // ring buffer
+    size_t next_ = 0;
+};
+
+struct HedgedPlanResult {
+    WriteFileCommand command;
+    std::string provider;      // provider whose plan won
+    bool hedged = false;       // a duplicate request was sent
+    bool cache_hit = false;
+    std::chrono::milliseconds latency{0};
+    ProviderUsage usage;       // the winning response's
+};
+
+/**
+ * @brief Races plan requests across providers to cut tail latency
+ *
+ * The primary provider is asked first. If it has not produced a valid plan by
+ * its observed latency percentile (or it fails outright), the same prompt goes
+ * to the next provider. The first valid plan wins and the rest are cancelled.
+ * Each provider asked adds a sample to its latency window; one cancelled
+ * while still waiting adds how long it had waited.
+ * Safe to share between threads.
+ */
+class HedgedPlanner {
+public:
+    using PlanAttempt = std::function<WriteFileCommand(const std::string& provider,
+                                                       const std::string& user_prompt,
+                                                       const CancellationToken& cancel,
+                                                       ResponseMetadata* metadata)>;
+    
+    /**
+     * @param providers Candidate providers in preference order
+     * @param attempt Performs one plan request; must honour cancel
+     * @param percentile Latency percentile of the primary that triggers a hedge
+     * @param max_attempts Maximum providers asked per plan
+     */
+    HedgedPlanner(std::vector<std::string> providers, PlanAttempt attempt,
+                  double percentile, size_t max_attempts);
+    
+    /**
+     * @brief Get a plan, hedging to secondary providers when the primary stalls
+     * @param primary Provider to ask first; empty uses the first candidate
+     * @throws std::runtime_error if every attempted provider fails
+     */
+    HedgedPlanResult plan(const std::string& user_prompt, const std::string& primary = "");
+    
+    // Delay before a duplicate request is sent when provider is the one in flight
+    std::chrono::milliseconds hedge_delay(const std::string& provider);
+    
+    void record_latency(const std::string& provider, std::chrono::milliseconds latency);
+    
+private:
+    std::vector<std::string> providers_;
+    PlanAttempt attempt_;
+    double percentile_;
+    size_t max_attempts_;
+    std::mutex trackers_mutex_;
+    std::map<std::string, std::unique_ptr<LatencyTracker>> trackers_;
+    
+    LatencyTracker& tracker_for(const std::string& provider);
+};
+
+} // namespace mag
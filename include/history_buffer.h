@@ -0,0 +1,73 @@
+#pragma once
+
+#include "llm_provider.h"
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Contiguous message store with cheap removal at the front
+ *
+ * Holds the history in one vector starting at head_, so the live messages
+ * can be handed out as a HistoryView (std::span) without copying, while
+ * pop_front() stays O(1): it only advances head_ and releases the message's
+ * hold on its text block. The dead prefix is erased once it outweighs the
+ * live part, which keeps the amortized cost constant. push_front() reuses that prefix when
+ * it can (compaction puts the summary exactly where trimmed turns were).
+ */
+class HistoryBuffer {
+public:
+    using iterator = std::vector<ConversationMessage>::iterator;
+    using const_iterator = std::vector<ConversationMessage>::const_iterator;
+
+    size_t size() const { return items_.size() - head_; }
+    bool empty() const { return size() == 0; }
+
+    ConversationMessage& operator[](size_t i) { return items_[head_ + i]; }
+    const ConversationMessage& operator[](size_t i) const { return items_[head_ + i]; }
+    const ConversationMessage& front() const { return items_[head_]; }
+    const ConversationMessage& back() const { return items_.back(); }
+
+    iterator begin() { return items_.begin() + static_cast<std::ptrdiff_t>(head_); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin() + static_cast<std::ptrdiff_t>(head_); }
+    const_iterator end() const { return items_.end(); }
+
+    // Valid until the next modification
+    HistoryView view() const { return HistoryView(items_.data() + head_, size()); }
+
+    void push_back(ConversationMessage message) { items_.push_back(std::move(message)); }
+
+    void push_front(ConversationMessage message) {
+        if (head_ > 0) {
+            items_[--head_] = std::move(message);
+        } else {
+            items_.insert(items_.begin(), std::move(message));
+        }
+    }
+
+    void pop_front() {
+        items_[head_].content = MessageText(); // the text is what costs memory
+        ++head_;
+        if (head_ >= MIN_COMPACT && head_ * 2 >= items_.size()) {
+            items_.erase(items_.begin(), items_.begin() + static_cast<std::ptrdiff_t>(head_));
+            head_ = 0;
+        }
+    }
+
+    void clear() {
+        items_.clear();
+        head_ = 0;
+    }
+
+private:
+    static constexpr size_t MIN_COMPACT = 16;
+
+    std::vector<ConversationMessage> items_;
+    size_t head_ = 0;
+};
+
+} // namespace mag
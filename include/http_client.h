@@ -3,6 +3,14 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 
 namespace mag {
 
@@ -11,23 +19,141 @@ struct HttpResponse {
     long status_code;
     bool success;
     std::string error_message;
+    std::map<std::string, std::string> headers; // final response headers, names lower-cased
+    
+    // Value of a response header by case-insensitive name ("" if absent)
+    std::string header(const std::string& name) const;
+    
+    // An unsuccessful response with an empty body and no headers
+    static HttpResponse failure(std::string message, long status_code = 0);
+};
+
+struct HttpRequest {
+    std::string url;
+    std::string payload;
+    std::vector<std::string> headers;
+    long timeout_ms = 0; // 0 = no overall timeout
+    bool head_only = false; // HEAD: nothing is sent, only the connection is set up
+    bool get = false;       // GET instead of POST; the payload is not sent
+    
+    // Invoked on the transport thread for every body chunk as it arrives
+    std::function<void(const char* data, size_t length)> on_data;
+};
+
+/**
+ * @brief Handle for a request submitted to the shared HttpTransport
+ *
+ * The call completes on the transport thread; callers poll with is_done(),
+ * block with wait()/wait_for(), or abandon it with cancel().
+ */
+class HttpCall {
+public:
+    bool is_done() const;
+    HttpResponse wait();
+    bool wait_for(std::chrono::milliseconds timeout);
+    void cancel();
+    bool is_cancelled() const { return cancelled_.load(); }
+
+private:
+    friend class HttpTransport;
+
+    HttpRequest request_;
+    HttpResponse response_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    std::atomic<bool> cancelled_{false};
+    void* easy_ = nullptr;          // CURL easy handle while in flight
+    void* header_list_ = nullptr;   // curl_slist owned by the call
+
+    void complete(HttpResponse response);
+};
+
+using HttpCallHandle = std::shared_ptr<HttpCall>;
+
+/**
+ * @brief Process-wide HTTP transport built on the curl multi interface
+ *
+ * All HttpClient instances share one multi handle, so TCP/TLS connections,
+ * DNS lookups and TLS sessions are reused across requests and providers.
+ * HTTP/2 is negotiated where available and requests to the same host are
+ * multiplexed over a single connection.
+ */
+class HttpTransport {
+public:
+    static HttpTransport& instance();
+
+    HttpTransport();
+    ~HttpTransport();
+
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+    // Queue a request; never blocks on the network
+    HttpCallHandle submit(HttpRequest request);
+
+    size_t in_flight() const { return in_flight_.load(); }
+
+    // Interrupt the transport thread's poll (new work or cancellation)
+    void wake();
+
+private:
+    void* multi_;   // CURLM handle
+    void* share_;   // CURLSH handle (DNS + TLS session cache)
+    std::thread worker_;
+    mutable std::mutex mutex_;
+    std::deque<HttpCallHandle> pending_;
+    std::vector<HttpCallHandle> active_;
+    std::vector<void*> idle_easy_;
+    std::atomic<bool> running_{true};
+    std::atomic<size_t> in_flight_{0};
+
+    void run();
+    void start_pending();
+    void reap_cancelled();
+    void finish(void* easy, int curl_code);
+    void* acquire_easy();
+    void release_easy(void* easy);
+
+    static size_t write_callback(char* contents, size_t size, size_t nmemb, void* userdata);
+    static size_t header_callback(char* contents, size_t size, size_t nmemb, void* userdata);
 };
 
 class HttpClient {
 public:
     HttpClient();
     ~HttpClient();
-    
+
     HttpResponse post(
         const std::string& url,
         const std::string& payload,
         const std::vector<std::string>& headers
     ) const;
-    
+
+    // Non-blocking variant of post(); complete with HttpCall::wait()
+    HttpCallHandle submit(
+        const std::string& url,
+        const std::string& payload,
+        const std::vector<std::string>& headers
+    ) const;
+
+    // Blocking GET (polling a provider batch job, downloading its results)
+    HttpResponse get(const std::string& url, const std::vector<std::string>& headers) const;
+
+    // Blocking post that also hands each body chunk to on_data as it arrives
+    HttpResponse post_stream(
+        const std::string& url,
+        const std::string& payload,
+        const std::vector<std::string>& headers,
+        std::function<void(const char* data, size_t length)> on_data
+    ) const;
+
+    // Open (and TLS-handshake) a pooled connection to url's host in the background
+    // so the first real request skips the setup; the response is ignored
+    void prewarm(const std::string& url) const;
+
 private:
-    void* curl_; // CURL handle
-    
-    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* response);
+    HttpTransport& transport_;
 };
 
 } // namespace mag
\ No newline at end of file
@@ -14,6 +14,12 @@ namespace mag {
  */
 class InputHandler {
 public:
+    enum class InputEvent {
+        LINE,  // a complete line was typed
+        WOKEN, // wake_fd became readable first
+        END    // EOF (Ctrl+D)
+    };
+    
     virtual ~InputHandler() = default;
     
     /**
@@ -23,6 +29,19 @@ public:
      */
     virtual std::string get_line(const std::string& prompt) = 0;
     
+    /**
+     * @brief Wait for a line without blocking the rest of the program's work
+     * @param prompt Shown while the line is typed; may change between calls
+     * @param wake_fd Ends the wait with WOKEN once readable (the caller drains it)
+     * @param line Receives the line when LINE is returned
+     * @return What ended the wait
+     *
+     * Keystrokes are taken as they arrive, so a line typed while the caller
+     * was busy is returned by the next call. The default implementation polls
+     * stdin and wake_fd and collects bytes up to a newline.
+     */
+    virtual InputEvent wait_for_line(const std::string& prompt, int wake_fd, std::string& line);
+    
     /**
      * @brief Add a line to the command history
      * @param line The command to add to history
@@ -50,6 +69,12 @@ public:
      * @return true if advanced features are supported
      */
     virtual bool supports_advanced_features() const = 0;
+
+protected:
+    std::string pending_input_; // bytes after the last complete line
+    std::string shown_prompt_;
+    bool prompt_shown_ = false;
+    bool input_closed_ = false;
 };
 
 /**
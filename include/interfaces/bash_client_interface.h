@@ -0,0 +1,85 @@
+#pragma once
+
+#include "message.h"
+#include "bash_tool.h"
+#include <stdexcept>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Interface for bash command execution
+ * 
+ * This interface abstracts the communication with the bash tool,
+ * so the Coordinator can run commands in-process or over the network.
+ */
+class IBashClient {
+public:
+    virtual ~IBashClient() = default;
+    
+    /**
+     * @brief Execute a bash command
+     * @param command The command to run (empty working_directory keeps the current one)
+     * @return CommandResult with output, exit code and the directory afterwards
+     *
+     * Failures are reported in the result rather than thrown.
+     */
+    virtual CommandResult execute(const BashCommand& command) = 0;
+    
+    /**
+     * @brief Execute a bash command, delivering its output while it runs
+     * @param command The command to run
+     * @param on_output Called with each piece of stdout or stderr, in order
+     * @return The same CommandResult execute() returns, with the full output
+     *
+     * The default implementation delivers the output once the command is done.
+     */
+    virtual CommandResult execute_stream(const BashCommand& command, const BashTool::OutputHandler& on_output) {
+        CommandResult result = execute(command);
+        if (on_output) {
+            if (!result.stdout_output.empty()) {
+                on_output(false, result.stdout_output);
+            }
+            if (!result.stderr_output.empty()) {
+                on_output(true, result.stderr_output);
+            }
+        }
+        return result;
+    }
+    
+    /**
+     * @brief Execute commands that do not depend on each other, possibly at the same time
+     * @return One CommandResult per command, in the same order
+     *
+     * Concurrent commands do not see each other's cd or exported variables,
+     * and their output is only delivered in the results. The default
+     * implementation runs them one after another.
+     */
+    virtual std::vector<CommandResult> execute_concurrently(const std::vector<BashCommand>& commands) {
+        std::vector<CommandResult> results;
+        results.reserve(commands.size());
+        for (const auto& command : commands) {
+            results.push_back(execute(command));
+        }
+        return results;
+    }
+    
+    /**
+     * @brief Read part of the full output log named in a CommandResult
+     * @throws std::runtime_error if the log cannot be read
+     */
+    virtual LogChunk read_log(const std::string& path, uint64_t offset, size_t max_bytes) {
+        (void)offset;
+        (void)max_bytes;
+        throw std::runtime_error("This bash client cannot read " + path);
+    }
+    
+    /**
+     * @brief Abandon requests in flight; they report a failed CommandResult
+     *
+     * A command running under execute_stream() is killed and reports cancelled.
+     */
+    virtual void cancel_pending() {}
+};
+
+} // namespace mag
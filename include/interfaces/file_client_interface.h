@@ -1,6 +1,8 @@
 #pragma once
 
 #include "message.h"
+#include <future>
+#include <vector>
 
 namespace mag {
 
@@ -22,6 +24,17 @@ public:
      */
     virtual DryRunResult dry_run(const WriteFileCommand& command) = 0;
     
+    /**
+     * @brief Start a dry run without waiting for it
+     * @param command The file operation to simulate
+     * @return Future for the DryRunResult; get() throws what dry_run() would
+     *
+     * The default implementation runs dry_run() when the result is requested.
+     */
+    virtual std::future<DryRunResult> dry_run_async(const WriteFileCommand& command) {
+        return std::async(std::launch::deferred, [this, command]() { return dry_run(command); });
+    }
+    
     /**
      * @brief Apply a file operation
      * @param command The file operation to execute
@@ -29,6 +42,92 @@ public:
      * @throws std::runtime_error on communication failure
      */
     virtual ApplyResult apply(const WriteFileCommand& command) = 0;
+    
+    /**
+     * @brief Dry-run many operations in one round trip
+     * @return One result per command, in order
+     * @throws std::runtime_error on communication failure
+     *
+     * The default implementation calls dry_run() per command and skips the
+     * batch-level checks (duplicate paths) the file tool performs.
+     */
+    virtual BatchDryRunResult dry_run_batch(const std::vector<WriteFileCommand>& commands) {
+        BatchDryRunResult batch;
+        batch.success = true;
+        for (const auto& command : commands) {
+            batch.results.push_back(dry_run(command));
+            batch.success = batch.success && batch.results.back().success;
+        }
+        return batch;
+    }
+    
+    /**
+     * @brief Apply many operations in one round trip
+     * @param all_or_nothing Leave every file untouched unless all of them succeed
+     * @return One result per command, in order
+     * @throws std::runtime_error on communication failure
+     *
+     * The default implementation calls apply() per command. It stops at the
+     * first failure when all_or_nothing is set but cannot roll back.
+     */
+    virtual BatchApplyResult apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) {
+        BatchApplyResult batch;
+        batch.success = true;
+        for (const auto& command : commands) {
+            if (all_or_nothing && !batch.success) {
+                ApplyResult skipped;
+                skipped.success = false;
+                skipped.error_message = "Not applied: an earlier item failed";
+                batch.results.push_back(std::move(skipped));
+                continue;
+            }
+            batch.results.push_back(apply(command));
+            batch.success = batch.success && batch.results.back().success;
+        }
+        return batch;
+    }
+    
+    /**
+     * @brief Read a file, or some of its lines or bytes (see FileTool::read_slice())
+     * @throws std::runtime_error on communication failure
+     *
+     * The default implementation reports that this client cannot read.
+     */
+    virtual ReadFileResult read(const ReadFileRequest& request) {
+        ReadFileResult result;
+        result.error_message = "Reading '" + request.path + "' is not supported by this file client";
+        return result;
+    }
+    
+    /**
+     * @brief Size, type and mtime of a file; a missing file is not an error
+     * @throws std::runtime_error on communication failure
+     */
+    virtual FileStatResult stat(const std::string& path) {
+        FileStatResult result;
+        result.error_message = "stat of '" + path + "' is not supported by this file client";
+        return result;
+    }
+    
+    /**
+     * @brief The project's files relevant to query, described in at most budget_tokens
+     * @throws std::runtime_error on communication failure
+     *
+     * See ProjectIndex::slice(). The default implementation reports that
+     * this client has no project index.
+     */
+    virtual ContextSlice context(const std::string& query, size_t budget_tokens) {
+        (void)query;
+        (void)budget_tokens;
+        ContextSlice slice;
+        slice.error_message = "Project context is not supported by this file client";
+        return slice;
+    }
+    
+    /**
+     * @brief Abandon requests in flight; their callers see RequestCancelledError
+     */
+    virtual void cancel_pending() {}
 };
 
 } // namespace mag
\ No newline at end of file
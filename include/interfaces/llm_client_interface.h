@@ -1,7 +1,12 @@
 #pragma once
 
 #include "message.h"
+#include "llm_provider.h"
 #include <string>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace mag {
 
@@ -39,6 +44,86 @@ public:
      */
     virtual std::string request_chat(const std::string& user_prompt) = 0;
     
+    /**
+     * @brief Request a chat response, delivering text as it is generated
+     * @param user_prompt The user's message
+     * @param on_chunk Called with each text delta in order
+     * @return The complete chat response
+     * @throws std::runtime_error on communication failure
+     *
+     * The default implementation delivers the whole reply as a single chunk.
+     */
+    virtual std::string request_chat_stream(const std::string& user_prompt,
+                                            const std::function<void(const std::string&)>& on_chunk) {
+        std::string response = request_chat(user_prompt);
+        if (on_chunk) {
+            on_chunk(response);
+        }
+        return response;
+    }
+    
+    /**
+     * @brief Request a chat response that sees the whole conversation
+     * @param conversation_history Prior turns, ending with the user's new message
+     * @return LLM's chat response (may contain todo operations)
+     * @throws std::runtime_error on communication failure
+     *
+     * The default implementation only sends the latest user message.
+     */
+    virtual std::string request_chat_with_history(HistoryView conversation_history) {
+        for (auto it = conversation_history.rbegin(); it != conversation_history.rend(); ++it) {
+            if (it->role == "user") {
+                return request_chat(it->content.str());
+            }
+        }
+        return request_chat("");
+    }
+    
+    /**
+     * @brief Condense older conversation turns into a short summary
+     * @param turns The turns to fold into the summary, oldest first
+     * @param previous_summary Summary produced by an earlier compaction ("" if none)
+     * @return The new summary, or "" when the client cannot summarize
+     * @throws std::runtime_error on communication failure
+     */
+    virtual std::string request_summary(const std::vector<ConversationMessage>& turns,
+                                        const std::string& previous_summary) {
+        return "";
+    }
+    
+    /**
+     * @brief Ask the current provider for many plans as one batch job
+     * @param prompts Id (letters, digits, '-' and '_') and user prompt of each plan
+     * @return The job as the provider first reports it
+     * @throws std::runtime_error on communication failure, or when the client
+     *         or provider has no batch API (the default)
+     *
+     * Batch jobs are cheaper than one request per plan but finish within
+     * hours rather than seconds, so they suit plans that are not needed yet.
+     */
+    virtual PlanBatchStatus submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) {
+        (void)prompts;
+        throw std::runtime_error("Provider batch jobs are not supported by this LLM client");
+    }
+    
+    /**
+     * @brief The job's progress as its provider reports it now
+     * @throws std::runtime_error as submit_plan_batch()
+     */
+    virtual PlanBatchStatus poll_plan_batch(const PlanBatchStatus& batch) {
+        (void)batch;
+        throw std::runtime_error("Provider batch jobs are not supported by this LLM client");
+    }
+    
+    /**
+     * @brief The plans of a job that has ended, one per prompt the provider answered
+     * @throws std::runtime_error as submit_plan_batch()
+     */
+    virtual std::vector<PlanBatchResult> collect_plan_batch(const PlanBatchStatus& batch) {
+        (void)batch;
+        throw std::runtime_error("Provider batch jobs are not supported by this LLM client");
+    }
+    
     /**
      * @brief Set the LLM provider to use
      * @param provider_name Provider name (anthropic, openai, gemini, mistral)
@@ -50,6 +135,49 @@ public:
      * @return Current provider name
      */
     virtual std::string get_current_provider() const = 0;
+    
+    /**
+     * @brief Abandon requests in flight; their callers see RequestCancelledError
+     */
+    virtual void cancel_pending() {}
+    
+    using UsageObserver = std::function<void(const ProviderUsage&)>;
+    
+    /**
+     * @brief Receive the provider's usage report for each response that carried one
+     *
+     * Called on the requesting thread before the request method returns.
+     * Set it before making requests.
+     */
+    void set_usage_observer(UsageObserver observer) { usage_observer_ = std::move(observer); }
+    
+    using ContextSource = std::function<std::string(const std::string& prompt)>;
+    
+    /**
+     * @brief Supply project context (see ProjectIndex::slice()) for each prompt
+     *
+     * Plan and chat requests pass their prompt (for a history, the latest
+     * user message) and send what comes back ahead of it. The context goes
+     * to the provider only; it is not added to the conversation history.
+     * Set it before making requests.
+     */
+    void set_context_source(ContextSource source) { context_source_ = std::move(source); }
+    
+protected:
+    void report_usage(const ProviderUsage& usage) const {
+        if (usage_observer_ && usage.reported) {
+            usage_observer_(usage);
+        }
+    }
+    
+    // "" without a context source
+    std::string project_context(const std::string& prompt) const {
+        return context_source_ ? context_source_(prompt) : std::string();
+    }
+    
+private:
+    UsageObserver usage_observer_;
+    ContextSource context_source_;
 };
 
 } // namespace mag
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "message.h"
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+/**
+ * @brief Raised when a document handed to the extraction helpers is not valid JSON
+ */
+class JsonExtractError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief One step of a JsonPath: an object key or an array index
+ */
+struct JsonPathStep {
+    std::string_view key;
+    size_t index = 0;
+    bool is_index = false;
+
+    JsonPathStep(const char* k) : key(k) {}
+    JsonPathStep(std::string_view k) : key(k) {}
+    JsonPathStep(int i) : index(static_cast<size_t>(i)), is_index(true) {}
+};
+
+using JsonPath = std::vector<JsonPathStep>;
+
+/**
+ * @brief Pull a single string value out of a JSON document without building a DOM
+ *
+ * The document is walked with a SAX handler that only tracks whether it is
+ * still on the requested path; parsing stops as soon as the value is found,
+ * so trailing fields (usage blocks, safety ratings) are never tokenized.
+ * The decoded string is moved out of the parser, not copied.
+ *
+ * @return The value, or nullopt if the path is absent or not a string
+ * @throws JsonExtractError if the document is malformed before the value
+ */
+std::optional<std::string> extract_json_string(std::string_view json, const JsonPath& path);
+
+/**
+ * @brief Same walk as extract_json_string() for a non-negative integer value
+ */
+std::optional<uint64_t> extract_json_uint(std::string_view json, const JsonPath& path);
+
+/**
+ * @brief Copy the named top-level members of a JSON object in a single walk
+ *
+ * Only the requested members are built into a DOM; everything else (a long
+ * generated reply, say) is skipped, and parsing stops once all of them have
+ * been seen. Suited to small trailing blocks such as a response's usage.
+ *
+ * @return An object holding the members that are present
+ * @throws JsonExtractError if the document is malformed before they are all found
+ */
+nlohmann::json extract_json_members(std::string_view json, std::initializer_list<std::string_view> keys);
+
+/**
+ * @brief Decode a WriteFile command object straight into a WriteFileCommand
+ *
+ * Same contract as WriteFileCommand::from_json ("command", "path" and
+ * "content" required, "request_execution" optional) but without the
+ * intermediate DOM, so a multi-megabyte "content" is decoded once.
+ *
+ * @throws JsonExtractError on malformed JSON, missing fields or wrong types
+ */
+WriteFileCommand decode_write_file_command(std::string_view json);
+
+} // namespace mag
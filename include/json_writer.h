@@ -0,0 +1,56 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief Streaming JSON serializer that appends straight to a caller's string
+ *
+ * No DOM and no temporaries: keys and values are escaped into the output
+ * buffer as they are written, so a caller that reuses (and reserves) its
+ * buffer serializes without allocating. Output matches nlohmann::json's
+ * compact dump() for the same document when keys are written in sorted
+ * order, which keeps cache keys and recorded payloads stable.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+    JsonWriter& key(std::string_view name);
+
+    JsonWriter& value(std::string_view text);
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(const std::string& text) { return value(std::string_view(text)); }
+    JsonWriter& value(bool flag);
+    JsonWriter& value(double number);
+    template <std::integral T>
+        requires (!std::same_as<T, bool>)
+    JsonWriter& value(T number) {
+        separate();
+        out_ += std::to_string(number);
+        return *this;
+    }
+
+    // A string value assembled from several pieces, each escaped as it is appended
+    JsonWriter& begin_string();
+    JsonWriter& append_string(std::string_view piece);
+    JsonWriter& end_string();
+
+    static void escape_into(std::string& out, std::string_view text);
+
+private:
+    std::string& out_;
+    bool needs_comma_ = false;
+
+    void separate();
+};
+
+} // namespace mag
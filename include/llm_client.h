@@ -3,11 +3,30 @@
 #include "message.h"
 #include "llm_provider.h"
 #include "http_client.h"
+#include "policy.h"
+#include "response_cache.h"
+#include "cancellation.h"
+#include "provider_resilience.h"
+#include "providers/replay_provider.h"
+#include "logger.h"
+#include <atomic>
 #include <string>
 #include <memory>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
 
 namespace mag {
 
+/**
+ * @brief Per-request details reported alongside an LLM response
+ */
+struct ResponseMetadata {
+    bool cache_hit = false; // served from the response cache without a provider call
+    ProviderUsage usage;    // what the provider billed; not reported for cache hits
+};
+
 class LLMClient {
 public:
     // Constructor with auto-detection
@@ -17,9 +36,36 @@ public:
     LLMClient(const std::string& provider_name, const std::string& api_key = "", 
               const std::string& model = "");
     
-    WriteFileCommand get_plan_from_llm(const std::string& user_prompt) const;
-    std::string get_chat_response(const std::string& user_prompt) const;
-    std::string get_chat_response_with_history(const std::vector<ConversationMessage>& conversation_history) const;
+    WriteFileCommand get_plan_from_llm(const std::string& user_prompt,
+                                       ResponseMetadata* metadata = nullptr,
+                                       const CancellationToken* cancel = nullptr) const;
+    std::string get_chat_response(const std::string& user_prompt,
+                                  ResponseMetadata* metadata = nullptr) const;
+    std::string get_chat_response_with_history(HistoryView conversation_history,
+                                               ResponseMetadata* metadata = nullptr) const;
+    
+    // Fold older turns (and any earlier summary) into a compact summary for context compaction
+    std::string summarize_conversation(const std::vector<ConversationMessage>& turns,
+                                       const std::string& previous_summary,
+                                       ResponseMetadata* metadata = nullptr) const;
+    
+    // Plans for many prompts as one provider batch job (see LLMProvider::supports_batches()).
+    // prompts: id and prompt of each; the ids must suit the provider's custom ids.
+    // The job bypasses the response cache, rate limiter and retries: it is
+    // submitted once and the provider schedules it.
+    bool supports_batches() const;
+    PlanBatchStatus submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) const;
+    PlanBatchStatus poll_plan_batch(const PlanBatchStatus& batch) const;
+    // One result per prompt the provider answered, failed ones included; call once the job has ended
+    std::vector<PlanBatchResult> collect_plan_batch(const PlanBatchStatus& batch) const;
+    
+    // Streaming chat: on_token receives text deltas as the provider produces them,
+    // the full reply is returned once the stream ends
+    using TokenCallback = std::function<void(const std::string&)>;
+    std::string stream_chat_response(const std::string& user_prompt, const TokenCallback& on_token) const;
+    std::string stream_chat_response_with_history(HistoryView conversation_history,
+                                                  const TokenCallback& on_token) const;
+    bool supports_streaming() const;
     
     // Information methods
     std::string get_current_provider() const;
@@ -28,17 +74,139 @@ public:
     // Provider management
     void set_provider(const std::string& provider_name, const std::string& model = "");
     
+    // Do the first request's setup now: build the provider and system prompts and
+    // open a connection to the provider's host (without waiting for it)
+    void prewarm() const;
+    
+    // Non-streaming requests consult this cache before calling the provider; null disables
+    void set_response_cache(std::shared_ptr<ResponseCache> cache) { response_cache_ = std::move(cache); }
+    
+    // Live (network) responses are appended to this capture for later replay; null disables
+    void set_recorder(std::shared_ptr<ResponseRecorder> recorder) { recorder_ = std::move(recorder); }
+    
+    // prompt preceded by project context (see ILLMClient::set_context_source()); prompt as-is when context is empty
+    static std::string with_project_context(const std::string& context, const std::string& prompt);
+    // A copy of the history with the context put ahead of its latest user message
+    static std::vector<ConversationMessage> with_project_context(const std::string& context,
+                                                                 HistoryView conversation_history);
+    
 private:
-    std::unique_ptr<LLMProvider> provider_;
+    std::string provider_name_;
+    // Created on first use by provider(); name and model come from the descriptor table
+    mutable std::unique_ptr<LLMProvider> provider_;
+    std::unique_ptr<std::once_flag> provider_once_;
     std::string api_key_;
     std::string model_;
-    std::string system_prompt_;
+    // The system prompts spell out the policy, so they are rebuilt when it changes
+    struct SystemPrompts {
+        uint64_t policy_version = 0;
+        std::string plan;
+        std::string chat;         // single-turn chat, with examples
+        std::string chat_history; // multi-turn chat
+    };
+    mutable std::atomic<std::shared_ptr<const SystemPrompts>> system_prompts_;
     HttpClient http_client_;
+    std::shared_ptr<ResponseCache> response_cache_;
+    std::shared_ptr<ResponseRecorder> recorder_;
     
     void initialize_provider(const std::string& provider_name, const std::string& api_key, 
                             const std::string& model);
     std::string get_api_key_for_provider(const std::string& provider_name) const;
-    std::string generate_policy_aware_system_prompt() const;
+    const LLMProvider& provider() const;
+    std::shared_ptr<const SystemPrompts> system_prompts() const;
+    std::string generate_policy_aware_system_prompt(const PolicyChecker* policy) const;
+    std::string generate_chat_system_prompt(const PolicyChecker* policy, bool include_examples) const;
+    std::string stream_request(nlohmann::json payload, const TokenCallback& on_token) const;
+    // The body of a batch job call; throws when it fails
+    std::string batch_call(const ProviderBatchCall& call) const;
+    
+    // Serve from the response cache or the provider, then hand the body to parse.
+    // A body is only cached once parse accepts it; cancelling aborts the transfer.
+    void fetch_response_body(const std::string& url, const std::string& payload,
+                             const std::vector<std::string>& headers, ResponseMetadata* metadata,
+                             const std::function<void(const std::string& body)>& parse,
+                             const CancellationToken* cancel = nullptr) const;
+    
+    // Capacity to reserve for a serialized conversation request
+    static size_t estimate_payload_size(const std::string& system_prompt, HistoryView conversation_history);
+    
+    // Usage from a provider's (or a replayed) response body, with the request id and
+    // server time from its headers; counted in the per-provider metrics
+    ProviderUsage collect_usage(const std::string& body, const HttpResponse* response) const;
+    
+    // Attach the heuristic estimate of the prompt to its usage report, so the CLI
+    // can calibrate the counter its history trimming uses against the billed count
+    static void estimate_prompt_tokens(ProviderUsage& usage, const std::string& system_prompt,
+                                       HistoryView conversation_history);
 };
 
+/**
+ * @brief Long-lived registry of ready LLM clients keyed by provider and model
+ *
+ * Clients are created on first use and are never rebuilt, so switching
+ * provider per request costs a map lookup. Creating one is cheap (its provider
+ * and system prompts are built by its first request); prewarm() does that
+ * work ahead of time for the client that will be used first.
+ * LLMClient request methods are const and share the process-wide HTTP
+ * transport, so a client handed out here may be used from several threads.
+ */
+class LLMClientPool {
+public:
+    // Empty default provider means auto-detect from available API keys
+    explicit LLMClientPool(const std::string& default_provider = "", const std::string& default_model = "");
+    
+    /**
+     * @brief Get the client for provider+model, creating it if needed
+     * @param provider_name Provider name; empty selects the pool default
+     * @param model Model name; empty selects the provider's default model
+     * @throws std::runtime_error if the provider is unknown or has no API key
+     */
+    const LLMClient& get(const std::string& provider_name = "", const std::string& model = "");
+    
+    std::string get_default_provider() const { return default_provider_; }
+    size_t size() const;
+    
+    // LLMClient::prewarm for provider_name's client (empty = default); failures are only logged
+    void prewarm(const std::string& provider_name = "");
+    
+    /**
+     * @brief Run call on provider_name's client, failing over to the other available
+     * providers (in preference order) while it throws ProviderUnavailableError
+     * @throws ProviderUnavailableError if no provider could serve the call
+     */
+    template <typename Call>
+    auto with_failover(const std::string& provider_name, Call&& call)
+        -> decltype(call(std::declval<const LLMClient&>()));
+    
+    // provider_name (or the default) first, then every other provider with a key
+    std::vector<std::string> failover_order(const std::string& provider_name) const;
+    
+    // Shared by every client in the pool, including ones created later
+    void set_response_cache(std::shared_ptr<ResponseCache> cache);
+    void set_recorder(std::shared_ptr<ResponseRecorder> recorder);
+    
+private:
+    std::string default_provider_;
+    std::string default_model_;
+    std::shared_ptr<ResponseCache> response_cache_;
+    std::shared_ptr<ResponseRecorder> recorder_;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<LLMClient>> clients_;
+};
+
+template <typename Call>
+auto LLMClientPool::with_failover(const std::string& provider_name, Call&& call)
+    -> decltype(call(std::declval<const LLMClient&>())) {
+    std::string last_error = "no providers configured";
+    for (const auto& provider : failover_order(provider_name)) {
+        try {
+            return call(get(provider));
+        } catch (const ProviderUnavailableError& e) {
+            last_error = e.what();
+            MAG_LOG_WARN("llm", "Provider " << provider << " unavailable, failing over: " << last_error);
+        }
+    }
+    throw ProviderUnavailableError("No LLM provider available: " + last_error);
+}
+
 } // namespace mag
\ No newline at end of file
@@ -1,32 +1,103 @@
 #pragma once
 
 #include "message.h"
+#include "message_text.h"
+#include "sse_parser.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <span>
 #include <nlohmann/json.hpp>
 
 namespace mag {
 
 // Conversation message for chat history
+//
+// Kept small because long sessions hold many of them: role and provider are
+// interned, the timestamp is an integer, and the content lives in a shared
+// text block (a ConversationManager packs its session's messages into one
+// TextArena). Copies are cheap and share the text.
 struct ConversationMessage {
-    std::string role;      // "user", "assistant", "system"
-    std::string content;   // Message content
-    std::string timestamp; // ISO 8601 timestamp
-    std::string provider;  // Provider that generated this message (for assistant messages)
+    InternedString role;      // "user", "assistant", "system"
+    InternedString provider;  // Provider that generated this message (for assistant messages)
+    MessageText content;      // Message content
+    int64_t timestamp_ms = 0; // Milliseconds since the Unix epoch
+    size_t token_count = 0;   // Cached by ConversationManager, including per-message overhead (0 = not counted)
+    uint64_t sequence = 0;    // Position in the session journal, assigned by ConversationManager
     
-    ConversationMessage(const std::string& r, const std::string& c) 
-        : role(r), content(c), timestamp(get_current_timestamp()), provider("") {}
+    ConversationMessage(InternedString r, MessageText c, InternedString p = {})
+        : role(r), provider(p), content(std::move(c)), timestamp_ms(current_time_ms()) {}
     
-    ConversationMessage(const std::string& r, const std::string& c, const std::string& p) 
-        : role(r), content(c), timestamp(get_current_timestamp()), provider(p) {}
-    
-    // JSON serialization support
+    // JSON serialization support; the timestamp is written as ISO 8601
     nlohmann::json to_json() const;
     static ConversationMessage from_json(const nlohmann::json& j);
     
     // Utility methods
     static std::string get_current_timestamp();
+    static int64_t current_time_ms();
+    static std::string format_timestamp(int64_t timestamp_ms); // "2024-01-02T03:04:05.678Z"
+    static std::optional<int64_t> parse_timestamp(std::string_view timestamp);
+    std::string timestamp() const { return format_timestamp(timestamp_ms); }
+};
+
+// Read-only, non-owning view of a conversation history (oldest first)
+using HistoryView = std::span<const ConversationMessage>;
+
+// What a provider reported about one response: billed tokens and request details
+struct ProviderUsage {
+    bool reported = false;            // the response carried a usage block
+    std::string provider;
+    std::string model;                // model that served the request, as the provider names it
+    std::string request_id;           // provider's id for the request, for support tickets
+    uint64_t input_tokens = 0;        // all prompt tokens, including the cached ones
+    uint64_t output_tokens = 0;
+    uint64_t cached_tokens = 0;       // prompt tokens read from the provider's prompt cache
+    uint64_t cache_write_tokens = 0;  // prompt tokens written to it (Anthropic)
+    int64_t server_latency_ms = -1;   // provider-side processing time (-1 = not reported)
+    uint64_t estimated_input_tokens = 0; // HeuristicTokenCounter's count of the prompt (0 = not made)
+    
+    nlohmann::json to_json() const;
+    static ProviderUsage from_json(const nlohmann::json& j);
+};
+
+// Running totals of usage reports (a session's, or one model's within it)
+struct UsageTotals {
+    uint64_t requests = 0;
+    uint64_t input_tokens = 0;
+    uint64_t output_tokens = 0;
+    uint64_t cached_tokens = 0;
+    uint64_t cache_write_tokens = 0;
+    uint64_t server_latency_ms = 0;   // summed over the timed_requests that reported it
+    uint64_t timed_requests = 0;
+    
+    void add(const ProviderUsage& usage);
+    void merge(const UsageTotals& other);
+    // Share of prompt tokens served from the provider's cache
+    double cache_hit_ratio() const {
+        return input_tokens ? static_cast<double>(cached_tokens) / static_cast<double>(input_tokens) : 0.0;
+    }
+    
+    nlohmann::json to_json() const;
+    static UsageTotals from_json(const nlohmann::json& j);
+};
+
+// An HTTP call a provider needs made for a batch job
+struct ProviderBatchCall {
+    std::string url;
+    std::string payload;              // not sent with a GET
+    std::vector<std::string> headers;
+    bool get = false;
+};
+
+// One request's outcome in a batch job's results
+struct ProviderBatchEntry {
+    std::string custom_id;
+    bool success = false;
+    std::string body;                 // the response a synchronous call would have had
+    std::string error;
 };
 
 // Abstract base class for LLM providers
@@ -54,16 +125,27 @@ public:
     // Request building with conversation history
     virtual nlohmann::json build_conversation_payload(
         const std::string& system_prompt,
-        const std::vector<ConversationMessage>& conversation_history,
+        HistoryView conversation_history,
         const std::string& model
     ) const {
         // Default implementation: use only the last user message for backward compatibility
         if (!conversation_history.empty() && conversation_history.back().role == "user") {
-            return build_request_payload(system_prompt, conversation_history.back().content, model);
+            return build_request_payload(system_prompt, conversation_history.back().content.str(), model);
         }
         return build_request_payload(system_prompt, "", model);
     }
     
+    // Append build_conversation_payload(...).dump() to out without building the DOM.
+    // Overrides must produce the same bytes; the default goes through the DOM.
+    virtual void write_conversation_payload(
+        std::string& out,
+        const std::string& system_prompt,
+        HistoryView conversation_history,
+        const std::string& model
+    ) const {
+        out += build_conversation_payload(system_prompt, conversation_history, model).dump();
+    }
+    
     // Header configuration
     virtual std::vector<std::string> get_headers(const std::string& api_key) const = 0;
     
@@ -73,9 +155,87 @@ public:
         // Default implementation: return placeholder
         return "Chat response parsing not implemented for this provider";
     }
+    // Token counts and ids from a response body; reported stays false when it has no usage block.
+    // Must not throw: usage is telemetry and never fails a request.
+    virtual ProviderUsage parse_usage(const std::string& response) const {
+        return {};
+    }
+    // Prompt tokens the provider billed (nullopt if not reported)
+    std::optional<size_t> parse_prompt_tokens(const std::string& response) const {
+        ProviderUsage usage = parse_usage(response);
+        if (!usage.reported) {
+            return std::nullopt;
+        }
+        return static_cast<size_t>(usage.input_tokens);
+    }
+    
+    // Streaming (server-sent events) support
+    virtual bool supports_streaming() const { return false; }
+    virtual void enable_streaming(nlohmann::json& payload) const {
+        payload["stream"] = true;
+    }
+    virtual std::string get_stream_url(const std::string& api_key, const std::string& model = "") const {
+        return get_full_url(api_key, model);
+    }
+    // Text delta carried by a single stream event ("" when the event has none)
+    virtual std::string parse_stream_event(const SseEvent& event) const {
+        return "";
+    }
+    
+    // Provider-side prompt caching: lets the provider reuse its prefill of the
+    // large, unchanging system prompt across requests
+    virtual bool supports_prompt_caching() const { return false; }
+    void set_prompt_caching(bool enabled) { prompt_caching_enabled_ = enabled; }
+    bool prompt_caching_enabled() const { return prompt_caching_enabled_ && supports_prompt_caching(); }
+    
+    // Asynchronous batch jobs: many requests in one job, answered within 24 hours at a
+    // lower price and under their own rate limits. A job is submitted with
+    // build_batch_submit() and, when it returns a call, build_batch_create() made with
+    // the first reply; it is then polled until it ends and its results are fetched.
+    // Without batch support the build and parse methods throw std::runtime_error.
+    virtual bool supports_batches() const { return false; }
+    // requests: custom id and build_request_payload() of each request
+    virtual ProviderBatchCall build_batch_submit(
+        const std::string& api_key,
+        const std::vector<std::pair<std::string, nlohmann::json>>& requests
+    ) const;
+    virtual std::optional<ProviderBatchCall> build_batch_create(const std::string& api_key,
+                                                                const std::string& submit_response) const {
+        return std::nullopt;
+    }
+    virtual ProviderBatchCall build_batch_poll(const std::string& api_key, const std::string& batch_id) const;
+    virtual ProviderBatchCall build_batch_results(const std::string& api_key, const PlanBatchStatus& status) const;
+    // The job as a create or poll reply describes it; provider is left to the caller
+    virtual PlanBatchStatus parse_batch_status(const std::string& response) const;
+    virtual std::vector<ProviderBatchEntry> parse_batch_results(const std::string& response) const;
     
     // Environment variable for API key
     virtual std::string get_api_key_env_var() const = 0;
+    virtual bool requires_api_key() const { return true; }
+    
+    // Offline providers answer here instead of over HTTP; nullopt means "send the request"
+    virtual std::optional<std::string> serve_locally(const std::string& payload) const {
+        return std::nullopt;
+    }
+    
+protected:
+    bool prompt_caching_enabled_ = true;
+};
+
+/**
+ * @brief Static facts about a provider, known without constructing it
+ *
+ * Looking up a key, a default model or a base URL through the descriptor
+ * table costs nothing at startup; the provider itself is only built when a
+ * request needs it.
+ */
+struct ProviderDescriptor {
+    std::string_view name;
+    std::string_view api_key_env;   // for the replay provider, the capture file variable
+    std::string_view default_model; // empty when it depends on the provider's state (replay)
+    std::string_view base_url;      // empty for offline providers
+    bool requires_api_key;
+    std::unique_ptr<LLMProvider> (*create)();
 };
 
 // Factory for creating providers
@@ -83,11 +243,13 @@ class ProviderFactory {
 public:
     static std::unique_ptr<LLMProvider> create_provider(const std::string& provider_name);
     static std::string detect_available_provider();
+    // Every provider with an API key set, in the same preference order
+    static std::vector<std::string> detect_available_providers();
     static std::vector<std::string> get_supported_providers();
     
-private:
-    static void register_providers();
-    static std::vector<std::string> supported_providers_;
+    // Every provider in preference order; nullptr from find_descriptor for an unknown name
+    static std::span<const ProviderDescriptor> descriptors();
+    static const ProviderDescriptor* find_descriptor(std::string_view provider_name);
 };
 
 } // namespace mag
\ No newline at end of file
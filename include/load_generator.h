@@ -0,0 +1,128 @@
+#pragma once
+
+#include "endpoint_config.h"
+#include "metrics.h"
+#include "network/nng_message.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+// Request types mag_loadgen can send, each in its service's own protocol
+enum class LoadOperation {
+    PLAN,     // llm_adapter file plan
+    CHAT,     // llm_adapter chat reply
+    DRY_RUN,  // file_tool dry_run of a WriteFile
+    APPLY,    // file_tool apply of a WriteFile (writes under LoadConfig::directory)
+    STAT,     // file_tool stat
+    EXECUTE   // bash_tool_service execute
+};
+
+struct LoadMixEntry {
+    LoadOperation operation;
+    double weight = 1;
+};
+
+struct LoadConfig {
+    enum class Mode {
+        CLOSED, // each of `concurrency` workers sends its next request as soon as the last one returns
+        OPEN    // requests are due at `rate` per second whether or not earlier ones have returned
+    };
+
+    Mode mode = Mode::CLOSED;
+    size_t concurrency = 8;
+    double rate = 100;                          // open loop only
+    std::chrono::milliseconds duration{10000};
+    size_t max_requests = 0;                    // 0: until duration runs out
+    size_t payload_bytes = 1024;                // prompt, file content or echoed text
+    std::vector<LoadMixEntry> mix = {{LoadOperation::PLAN, 1}, {LoadOperation::DRY_RUN, 1},
+                                     {LoadOperation::EXECUTE, 1}};
+    std::string provider = "replay";            // sent with PLAN and CHAT requests
+    std::string directory = "loadgen";          // where DRY_RUN, APPLY and STAT point
+    size_t file_count = 64;                     // distinct paths cycled through in directory
+    uint64_t seed = 1;
+};
+
+/**
+ * @brief Drives llm_adapter, file_tool and bash_tool_service with synthetic load
+ *
+ * Requests are built with the same encoders the NNG clients use and sent
+ * through a Dispatch, which mag_loadgen backs with one EndpointPool per
+ * service. The operation for each request is drawn from the weighted mix.
+ *
+ * In closed-loop mode `concurrency` workers each wait for their reply before
+ * sending again, so the offered load adapts to the services. In open-loop
+ * mode requests fall due at a fixed `rate` and `concurrency` workers send
+ * them; latency is measured from when a request was due, not from when a
+ * worker got to it, so a backlog shows up in the percentiles rather than
+ * slowing the schedule down (no coordinated omission). Requests still
+ * waiting when the run ends are reported as unsent.
+ *
+ * A reply carrying "error" or "success": false counts as an error; a missed
+ * deadline as a timeout; any other exception as a failure. All of them are
+ * included in the latency histograms.
+ */
+class LoadGenerator {
+public:
+    // Sends one request to service and returns its reply; throws on transport failure
+    using Dispatch = std::function<NngMessage(EndpointConfig::Service service, NngMessage request)>;
+
+    static constexpr size_t OPERATION_COUNT = 6;
+
+    LoadGenerator(LoadConfig config, Dispatch dispatch);
+
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+    // Blocks until the duration has passed or max_requests have been sent
+    void run();
+
+    // Throughput and p50/p99/p999 latency overall and per operation
+    nlohmann::json report() const;
+    std::string summary() const;
+
+    NngMessage build_request(LoadOperation operation, uint64_t sequence) const;
+
+    static EndpointConfig::Service service_of(LoadOperation operation);
+    static const char* operation_name(LoadOperation operation);
+    static std::optional<LoadOperation> parse_operation(const std::string& name);
+
+    // "plan:2,dry_run:5,execute" (weight defaults to 1); nullopt if malformed
+    static std::optional<std::vector<LoadMixEntry>> parse_mix(const std::string& spec);
+    static bool is_error_reply(std::string_view reply);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct OperationStats {
+        LatencyHistogram latency;
+        Counter ok;
+        Counter errors;
+        Counter timeouts;
+        Counter failures;
+    };
+
+    LoadConfig config_;
+    Dispatch dispatch_;
+    WireFormat format_;
+    std::array<OperationStats, OPERATION_COUNT> stats_;
+    LatencyHistogram overall_;
+    std::atomic<uint64_t> next_sequence_{0}; // closed loop
+    uint64_t unsent_ = 0;
+    double elapsed_seconds_ = 0;
+
+    // Sends one request and records it against `due`
+    void issue(LoadOperation operation, uint64_t sequence, Clock::time_point due);
+    void run_closed(Clock::time_point deadline);
+    void run_open(Clock::time_point deadline);
+    std::string path_for(uint64_t sequence) const;
+};
+
+} // namespace mag
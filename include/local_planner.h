@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+// How a todo should run, as far as can be told without asking the LLM
+struct LocalPlan {
+    static constexpr double CONFIDENT = 0.8;
+    
+    bool is_bash = false;
+    std::string command;     // the shell command, when it could be read off the todo
+    double confidence = 0.0; // in is_bash and command, from 0 to 1
+    std::string reason;      // which rule decided, for the debug log
+    
+    bool confident() const { return confidence >= CONFIDENT; }
+};
+
+/**
+ * @brief Deterministic classifier for todos that spell out their own shell command
+ *
+ * A backticked command, "run <command>" or a title that is itself a command
+ * line ("make test", "git status", "ls -la src/") gives a confident bash
+ * plan whose command is used as written, with no LLM round trip. Command
+ * names match case-sensitively and, in a bare title, must be followed only
+ * by flags, paths and the like, so prose that happens to open with a
+ * command word ("Make install", "touch up README.md") is not run. Titles that ask for files to be
+ * written go to the LLM for a file plan. Anything else that only mentions a
+ * build or shell word is bash with low confidence, and the command is left
+ * to the caller to work out.
+ *
+ * Known command names are a built-in list plus the bash_tool's
+ * allowed_commands from the policy.
+ */
+class LocalCommandPlanner {
+public:
+    explicit LocalCommandPlanner(const std::vector<std::string>& allowed_commands = {}, uint64_t policy_version = 0);
+    
+    LocalPlan plan(const std::string& prompt) const;
+    
+    uint64_t policy_version() const { return policy_version_; }
+
+private:
+    std::set<std::string> commands_;
+    std::set<std::string> policy_commands_;
+    uint64_t policy_version_;
+    
+    bool is_command(const std::string& word) const;
+    // words[from] onwards are a command and its arguments, with no prose
+    bool is_command_line(const std::vector<std::string>& words, size_t from) const;
+};
+
+} // namespace mag
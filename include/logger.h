@@ -0,0 +1,163 @@
+#pragma once
+
+#include "mpmc_queue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace mag {
+
+enum class LogLevel : int {
+    TRACE = 0,
+    DEBUG,
+    INFO,
+    WARN,
+    ERROR,
+    OFF
+};
+
+enum class LogFormat {
+    TEXT,  // "2026-01-01T00:00:00.000Z INFO  [llm] message"
+    JSON   // one JSON object per line
+};
+
+struct LogRecord {
+    LogLevel level = LogLevel::INFO;
+    std::string component;
+    std::string message;
+    std::chrono::system_clock::time_point time;
+    size_t thread_hash = 0;
+};
+
+/**
+ * @brief Process-wide asynchronous, leveled logger
+ *
+ * Call sites enqueue records on a lock-free queue and a background thread
+ * formats and writes them, so logging never blocks on terminal or file I/O.
+ * When the queue is full records are dropped (and counted) rather than
+ * stalling the caller. Use the MAG_LOG_* macros: a disabled level costs one
+ * atomic load and the message expression is never evaluated.
+ *
+ * Configured from the environment on first use:
+ *   MAG_LOG=info,llm=debug,bash=off   default level plus per-component levels
+ *   MAG_LOG_FILE=path                 append to a file instead of stderr
+ *   MAG_LOG_FORMAT=json               structured output
+ *   MAG_LOG_PAYLOAD_MAX=bytes         truncation limit for payload dumps
+ */
+class Logger {
+public:
+    using Sink = std::function<void(const std::string& line)>;
+    
+    static Logger& instance();
+    
+    Logger();
+    ~Logger();
+    
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+    
+    /**
+     * @brief Apply a filter spec such as "warn,llm=debug"
+     * @throws std::runtime_error on an unknown level name
+     */
+    void configure(const std::string& spec);
+    void set_level(LogLevel level);
+    void set_component_level(const std::string& component, LogLevel level);
+    void set_format(LogFormat format);
+    
+    // Replace the output (stderr or MAG_LOG_FILE); null restores stderr
+    void set_sink(Sink sink);
+    
+    bool enabled(LogLevel level, std::string_view component) const {
+        if (static_cast<int>(level) < min_level_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        return passes_filter(level, component);
+    }
+    
+    void log(LogLevel level, std::string_view component, std::string message);
+    
+    // Block until every record logged before the call has been written
+    void flush();
+    
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    
+    // Payload prefix of at most max_bytes, suffixed with how much was cut
+    static std::string truncate(std::string_view payload, size_t max_bytes);
+    static std::string truncate(std::string_view payload) { return truncate(payload, instance().payload_limit()); }
+    size_t payload_limit() const { return payload_limit_.load(std::memory_order_relaxed); }
+    
+    static const char* level_name(LogLevel level);
+    static std::optional<LogLevel> parse_level(std::string_view name);
+    
+private:
+    MpmcQueue<LogRecord> queue_;
+    std::atomic<int> min_level_;
+    std::atomic<size_t> payload_limit_;
+    std::atomic<size_t> dropped_{0};
+    std::atomic<size_t> dropped_reported_{0};
+    
+    mutable std::shared_mutex filter_mutex_;
+    LogLevel default_level_ = LogLevel::INFO;
+    std::map<std::string, LogLevel, std::less<>> component_levels_;
+    
+    std::mutex sink_mutex_;
+    Sink sink_;
+    FILE* file_ = nullptr;
+    std::atomic<LogFormat> format_{LogFormat::TEXT};
+    
+    // Consumer wake-up and flush tracking via C++20 atomic wait/notify
+    std::atomic<uint32_t> wake_signal_{0};
+    std::atomic<bool> consumer_waiting_{false};
+    std::atomic<uint64_t> accepted_{0};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<bool> running_{true};
+    std::thread consumer_;
+    
+    bool passes_filter(LogLevel level, std::string_view component) const;
+    void recompute_min_level_locked();
+    void wake_consumer();
+    void run();
+    void write_line(const LogRecord& record);
+};
+
+/**
+ * @brief Lets through one in every N calls (for sampling hot-path dumps)
+ */
+class LogSampler {
+public:
+    explicit LogSampler(uint32_t every) : every_(every == 0 ? 1 : every) {}
+    bool sample() { return counter_.fetch_add(1, std::memory_order_relaxed) % every_ == 0; }
+    
+private:
+    uint32_t every_;
+    std::atomic<uint32_t> counter_{0};
+};
+
+} // namespace mag
+
+// Stream-style logging; the message is only built when the level is enabled:
+//   MAG_LOG_DEBUG("llm", "payload: " << mag::Logger::truncate(payload));
+#define MAG_LOG(level, component, message_expr)                                       \
+    do {                                                                              \
+        if (::mag::Logger::instance().enabled((level), (component))) {                \
+            std::ostringstream mag_log_stream_;                                       \
+            mag_log_stream_ << message_expr;                                          \
+            ::mag::Logger::instance().log((level), (component), mag_log_stream_.str()); \
+        }                                                                             \
+    } while (0)
+
+#define MAG_LOG_TRACE(component, message_expr) MAG_LOG(::mag::LogLevel::TRACE, component, message_expr)
+#define MAG_LOG_DEBUG(component, message_expr) MAG_LOG(::mag::LogLevel::DEBUG, component, message_expr)
+#define MAG_LOG_INFO(component, message_expr) MAG_LOG(::mag::LogLevel::INFO, component, message_expr)
+#define MAG_LOG_WARN(component, message_expr) MAG_LOG(::mag::LogLevel::WARN, component, message_expr)
+#define MAG_LOG_ERROR(component, message_expr) MAG_LOG(::mag::LogLevel::ERROR, component, message_expr)
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief Read-only view of a whole file
+ *
+ * Regular files are mmap'd, so a slice of them can be sent on without ever
+ * being read into a buffer of ours. Files mmap cannot map (pipes, /proc)
+ * are read into memory instead; empty files need neither.
+ *
+ * MAG replaces files by rename, which leaves an existing mapping of the old
+ * file intact. A file truncated in place by someone else while it is mapped
+ * raises SIGBUS when the lost pages are touched, so the file is kept open:
+ * intact() tells whether it still covers the mapping, and read_at() reads
+ * through the descriptor rather than the mapping.
+ */
+class MappedFile {
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    std::string_view bytes() const { return mapping_ ? std::string_view(mapping_, size_) : std::string_view(copy_); }
+    size_t size() const { return bytes().size(); }
+    bool mapped() const { return mapping_ != nullptr; }
+    
+    // The file still holds every mapped byte
+    bool intact() const;
+    // Up to length bytes from offset, read from the file itself; short if it shrank
+    std::string read_at(size_t offset, size_t length) const;
+    
+private:
+    const char* mapping_ = nullptr;
+    size_t size_ = 0;
+    int fd_ = -1;      // open while mapped
+    std::string copy_; // when the file could not be mapped
+    
+    void unmap();
+};
+
+} // namespace mag
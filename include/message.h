@@ -1,7 +1,9 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <chrono>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 namespace mag {
@@ -9,12 +11,75 @@ namespace mag {
 // Forward declarations
 struct WriteFileCommand;
 
+/**
+ * @brief Encoding of a message exchanged between MAG services
+ */
+enum class WireFormat {
+    JSON,     // text, for debugging
+    MSGPACK,  // binary, raw byte fields
+    CBOR      // binary, raw byte fields
+};
+
+/**
+ * @brief Destination for encoded bytes other than a std::string
+ *
+ * Lets a message be serialized straight into its transport buffer (an
+ * nng_msg, say) instead of into a string that is then copied.
+ */
+class WireSink {
+public:
+    virtual ~WireSink() = default;
+    virtual void write(const char* data, size_t size) = 0;
+};
+
+/**
+ * @brief Encodes and decodes service messages in any WireFormat
+ *
+ * Formats are told apart by the first byte: JSON objects open with '{',
+ * MessagePack maps with 0x80-0x8f and CBOR maps with 0xa0-0xbf. Those are
+ * UTF-8 continuation bytes, so no text prompt is ever mistaken for binary.
+ * Services decode whatever arrives and reply in the same format, so a
+ * client choosing a format is all the negotiation needed.
+ *
+ * In the binary formats, file content and command output travel as raw
+ * byte strings: no escaping on either side and no UTF-8 requirement.
+ */
+class WireCodec {
+public:
+    static WireFormat detect(std::string_view payload);
+    static nlohmann::json decode(std::string_view payload);
+    static std::string encode(const nlohmann::json& j, WireFormat format);
+    static void encode(const nlohmann::json& j, WireFormat format, WireSink& sink);
+    
+    // From WireConfig (MAG_WIRE_FORMAT); unknown names fall back to JSON
+    static WireFormat configured();
+    static WireFormat parse_format(const std::string& name);
+    static const char* format_name(WireFormat format);
+    
+    // A byte field: a binary value in MessagePack/CBOR, a string in JSON
+    static void set_bytes(nlohmann::json& j, const char* key, const std::string& bytes, WireFormat format);
+    // Reads either representation; throws like json::at() when the key is missing
+    static std::string get_bytes(const nlohmann::json& j, const char* key);
+    
+    /**
+     * @brief Encode j with one more byte field streamed straight from bytes
+     *
+     * In MessagePack and CBOR the bytes go from their buffer (an mmap'd
+     * file, say) to the sink without ever entering the DOM. j must be an
+     * object of fewer than 15 keys that does not contain key. JSON has to
+     * escape the bytes and takes the ordinary path.
+     */
+    static void encode_with_bytes(const nlohmann::json& j, const char* key, std::string_view bytes,
+                                  WireFormat format, WireSink& sink);
+};
+
 /**
  * @brief Type of operation to perform
  */
 enum class OperationType {
     FILE_WRITE,    // Create or write to a file
-    BASH_COMMAND   // Execute a bash command
+    BASH_COMMAND,  // Execute a bash command
+    FILE_PATCH     // Edit a file with a unified diff or search/replace blocks
 };
 
 /**
@@ -37,12 +102,25 @@ struct ExecutionContext {
     std::string to_summary_string() const;
 };
 
+/**
+ * @brief A file change planned by the LLM
+ *
+ * command is "WriteFile" (content is the whole new file) or "PatchFile"
+ * (content is a unified diff or search/replace blocks against the file
+ * as it is on disk; see apply_patch()).
+ */
 struct WriteFileCommand {
     std::string command;
     std::string path;
     std::string content;
     bool request_execution = false;  // Whether LLM suggests executing after creation
     
+    static constexpr const char* WRITE = "WriteFile";
+    static constexpr const char* PATCH = "PatchFile";
+    
+    bool is_patch() const { return command == PATCH; }
+    bool is_file_change() const { return command == WRITE || command == PATCH; }
+    
     void to_json(nlohmann::json& j) const;
     void from_json(const nlohmann::json& j);
 };
@@ -72,7 +150,7 @@ struct GenericCommand {
     OperationType type;
     std::string description;  // Human-readable description of the operation
     
-    // For FILE_WRITE operations
+    // For FILE_WRITE and FILE_PATCH operations (file_content is the patch for the latter)
     std::string file_path;
     std::string file_content;
     
@@ -84,7 +162,7 @@ struct GenericCommand {
     void from_json(const nlohmann::json& j);
     
     // Helper methods
-    bool is_file_operation() const { return type == OperationType::FILE_WRITE; }
+    bool is_file_operation() const { return type == OperationType::FILE_WRITE || type == OperationType::FILE_PATCH; }
     bool is_bash_operation() const { return type == OperationType::BASH_COMMAND; }
     WriteFileCommand to_write_file_command() const;
     std::string get_operation_summary() const;
@@ -94,6 +172,8 @@ struct DryRunResult {
     std::string description;
     bool success;
     std::string error_message;
+    std::string diff;  // unified diff against the file on disk; empty for new or unchanged files
+    bool unchanged = false;  // the file already holds this content
     
     void to_json(nlohmann::json& j) const;
     void from_json(const nlohmann::json& j);
@@ -104,6 +184,7 @@ struct ApplyResult {
     bool success;
     std::string error_message;
     ExecutionContext execution_context;  // Context captured after execution
+    bool unchanged = false;  // content was already on disk; the file was not rewritten
     
     void to_json(nlohmann::json& j) const;
     void from_json(const nlohmann::json& j);
@@ -113,22 +194,241 @@ struct ApplyResult {
     bool has_context_output() const;
 };
 
+/**
+ * @brief Results of a dry_run_batch, one per command in request order
+ */
+struct BatchDryRunResult {
+    std::vector<DryRunResult> results;
+    bool success = false;        // every item passed
+    std::string error_message;   // why the batch as a whole was refused
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief Results of an apply_batch, one per command in request order
+ *
+ * When the batch was all-or-nothing and success is false, no file was
+ * left changed: either validation refused the batch before the first
+ * write, or the files already written were restored (rolled_back).
+ */
+struct BatchApplyResult {
+    std::vector<ApplyResult> results;
+    bool success = false;
+    bool rolled_back = false;
+    std::string error_message;
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief A read of a whole file or of a slice of it
+ *
+ * Lines are 1-based and inclusive; offset/length select bytes when no line
+ * is given. A zero length or last_line reads to the end of the file.
+ */
+struct ReadFileRequest {
+    std::string path;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    size_t first_line = 0;  // 0: byte range
+    size_t last_line = 0;
+    
+    bool by_lines() const { return first_line > 0; }
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+struct ReadFileResult {
+    bool success = false;
+    std::string error_message;
+    std::string content;
+    uint64_t offset = 0;       // of content within the file
+    uint64_t file_size = 0;
+    size_t first_line = 0;     // lines content covers, for line reads
+    size_t last_line = 0;
+    bool truncated = false;    // cut at FileToolConfig::MAX_READ_BYTES
+    
+    // Every field but content, which travels as a byte field
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief The part of the project index relevant to a prompt (see ProjectIndex::slice())
+ *
+ * Asked for with {"operation": "context", "query": prompt, "budget": tokens}.
+ */
+struct ContextSlice {
+    bool success = false;
+    std::string error_message;
+    std::string context;       // ready to go in a prompt; empty when nothing matched
+    size_t files = 0;          // files it describes
+    size_t tokens = 0;         // estimated size of context
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief A provider batch job of plan requests, as the provider last reported it
+ *
+ * Batch jobs (see LLMProvider::supports_batches()) take minutes to hours.
+ * The llm_adapter submits one with {"operation": "plan_batch_submit",
+ * "prompts": [{"id", "prompt", "context"}]} and answers "plan_batch_status" and
+ * "plan_batch_results" requests that carry this status back as "batch".
+ */
+struct PlanBatchStatus {
+    std::string id;            // the provider's batch id
+    std::string provider;      // provider that runs it; later requests go to it
+    std::string state;         // the provider's word for it ("in_progress", "ended", "completed", ...)
+    bool ended = false;        // finished one way or another; results can be collected
+    size_t total = 0;          // requests in the job
+    size_t succeeded = 0;
+    size_t failed = 0;         // including expired and cancelled requests
+    std::string results;       // where the provider keeps the results (a URL or a file id)
+    std::string error_message; // why the job as a whole failed, if it did
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+// The plan for one prompt of a batch job
+struct PlanBatchResult {
+    std::string id;            // as given when the job was submitted
+    bool success = false;
+    std::string error_message;
+    WriteFileCommand command;
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+struct FileStatResult {
+    bool success = false;
+    std::string error_message;
+    bool exists = false;
+    bool is_directory = false;
+    uint64_t size = 0;
+    int64_t modified = 0;      // seconds since the epoch
+    uint32_t mode = 0;         // permission bits
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief One step of a chunked write of a large file
+ *
+ * "write_begin" names path, size and the Utils::hash64 of the content and
+ * gets back a transfer_id and the chunk size to use. "write_chunk" carries
+ * the data at offset, a multiple of the chunk size; chunks may arrive in
+ * any order. "write_commit" puts the assembled file in place and replies
+ * with an ApplyResult; "write_abort" drops it. Every step of a transfer
+ * goes to the same file_tool worker. "dry_run_digest" is the dry run of
+ * such a write, judged from path, size and hash alone.
+ */
+struct FileTransferRequest {
+    std::string transfer_id;
+    std::string path;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    uint64_t offset = 0;
+    std::string data;  // write_chunk only; travels as a byte field
+    
+    // Every field but data
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+struct FileTransferReply {
+    bool success = false;
+    std::string error_message;
+    std::string transfer_id;
+    uint64_t chunk_size = 0;
+    uint64_t received = 0;  // bytes of the transfer written so far
+    
+    void to_json(nlohmann::json& j) const;
+    void from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief Serialization of service messages; deserializers accept every WireFormat
+ */
 class MessageHandler {
 public:
-    static std::string serialize_command(const WriteFileCommand& cmd);
-    static WriteFileCommand deserialize_command(const std::string& json_str);
+    static std::string serialize_command(const WriteFileCommand& cmd, WireFormat format = WireFormat::JSON);
+    static void serialize_command(const WriteFileCommand& cmd, WireFormat format, WireSink& sink);
+    static WriteFileCommand deserialize_command(std::string_view data);
+    
+    // {"operation": "dry_run"|"apply", "command": {...}} as sent to the file tool
+    static std::string serialize_file_request(const std::string& operation, const WriteFileCommand& cmd,
+                                              WireFormat format = WireFormat::JSON);
+    static void serialize_file_request(const std::string& operation, const WriteFileCommand& cmd,
+                                       WireFormat format, WireSink& sink);
+    
+    // {"operation": "dry_run_batch"|"apply_batch", "commands": [...], "all_or_nothing": bool}
+    static std::string serialize_file_batch_request(const std::string& operation,
+                                                    const std::vector<WriteFileCommand>& commands,
+                                                    bool all_or_nothing, WireFormat format = WireFormat::JSON);
+    static void serialize_file_batch_request(const std::string& operation,
+                                             const std::vector<WriteFileCommand>& commands,
+                                             bool all_or_nothing, WireFormat format, WireSink& sink);
+    
+    static std::string serialize_batch_dry_run_result(const BatchDryRunResult& result,
+                                                      WireFormat format = WireFormat::JSON);
+    static void serialize_batch_dry_run_result(const BatchDryRunResult& result, WireFormat format, WireSink& sink);
+    static BatchDryRunResult deserialize_batch_dry_run_result(std::string_view data);
+    
+    static std::string serialize_batch_apply_result(const BatchApplyResult& result,
+                                                    WireFormat format = WireFormat::JSON);
+    static void serialize_batch_apply_result(const BatchApplyResult& result, WireFormat format, WireSink& sink);
+    static BatchApplyResult deserialize_batch_apply_result(std::string_view data);
+    
+    static std::string serialize_dry_run_result(const DryRunResult& result, WireFormat format = WireFormat::JSON);
+    static void serialize_dry_run_result(const DryRunResult& result, WireFormat format, WireSink& sink);
+    static DryRunResult deserialize_dry_run_result(std::string_view data);
+    
+    static std::string serialize_apply_result(const ApplyResult& result, WireFormat format = WireFormat::JSON);
+    static void serialize_apply_result(const ApplyResult& result, WireFormat format, WireSink& sink);
+    static ApplyResult deserialize_apply_result(std::string_view data);
+    
+    // {"operation": "read"|"read_range"|"stat", "read": {...}}
+    static void serialize_read_request(const std::string& operation, const ReadFileRequest& request,
+                                       WireFormat format, WireSink& sink);
+    
+    // content is sent from where it lies; result.content is ignored
+    static void serialize_read_result(const ReadFileResult& result, std::string_view content,
+                                      WireFormat format, WireSink& sink);
+    static ReadFileResult deserialize_read_result(std::string_view data);
+    
+    // {"operation": "write_begin"|..., "transfer": {...}, "data": bytes}; data is sent from where it lies
+    static void serialize_transfer_request(const std::string& operation, const FileTransferRequest& request,
+                                           std::string_view data, WireFormat format, WireSink& sink);
+    static void serialize_transfer_reply(const FileTransferReply& reply, WireFormat format, WireSink& sink);
+    static FileTransferReply deserialize_transfer_reply(std::string_view data);
+    
+    static void serialize_stat_result(const FileStatResult& result, WireFormat format, WireSink& sink);
+    static FileStatResult deserialize_stat_result(std::string_view data);
     
-    static std::string serialize_dry_run_result(const DryRunResult& result);
-    static DryRunResult deserialize_dry_run_result(const std::string& json_str);
+    static void serialize_context_request(const std::string& query, size_t budget_tokens, WireFormat format,
+                                          WireSink& sink);
+    static void serialize_context_slice(const ContextSlice& slice, WireFormat format, WireSink& sink);
+    static ContextSlice deserialize_context_slice(std::string_view data);
     
-    static std::string serialize_apply_result(const ApplyResult& result);
-    static ApplyResult deserialize_apply_result(const std::string& json_str);
+    static std::string serialize_execution_context(const ExecutionContext& context,
+                                                   WireFormat format = WireFormat::JSON);
+    static ExecutionContext deserialize_execution_context(std::string_view data);
     
-    static std::string serialize_execution_context(const ExecutionContext& context);
-    static ExecutionContext deserialize_execution_context(const std::string& json_str);
+    static std::string serialize_bash_command(const BashCommand& cmd, WireFormat format = WireFormat::JSON);
+    static BashCommand deserialize_bash_command(std::string_view data);
     
-    static std::string serialize_bash_command(const BashCommand& cmd);
-    static BashCommand deserialize_bash_command(const std::string& json_str);
+    // Turn the byte fields of an already-built message into raw bytes for format
+    static void encode_command_bytes(nlohmann::json& j, const WriteFileCommand& cmd, WireFormat format);
+    static void encode_context_bytes(nlohmann::json& j, const ExecutionContext& context, WireFormat format);
 };
 
 } // namespace mag
\ No newline at end of file
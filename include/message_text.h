@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief A string from a small, process-wide set of values, stored once
+ *
+ * For message roles and provider names: the same handful of values repeat
+ * on every message, so each message keeps one pointer into a shared table
+ * instead of its own string. Values are never freed, and equal values share
+ * a pointer, so comparing two InternedStrings is a pointer compare. The
+ * table holds at most MAX_VALUES distinct values; past that, interning
+ * throws std::length_error rather than grow on input from the wire.
+ */
+class InternedString {
+public:
+    static constexpr size_t MAX_VALUES = 4096;
+
+    InternedString();
+    InternedString(std::string_view value);
+    InternedString(const std::string& value) : InternedString(std::string_view(value)) {}
+    InternedString(const char* value) : InternedString(std::string_view(value)) {}
+
+    const std::string& str() const { return *value_; }
+    std::string_view view() const { return *value_; }
+    operator std::string_view() const { return *value_; }
+    bool empty() const { return value_->empty(); }
+
+    friend bool operator==(const InternedString& a, const InternedString& b) { return a.value_ == b.value_; }
+    friend bool operator==(const InternedString& a, std::string_view b) { return a.view() == b; }
+    friend bool operator==(const InternedString& a, const std::string& b) { return a.view() == b; }
+    friend bool operator==(const InternedString& a, const char* b) { return a.view() == b; }
+    friend std::ostream& operator<<(std::ostream& out, const InternedString& s) { return out << *s.value_; }
+
+private:
+    const std::string* value_;
+};
+
+/**
+ * @brief Immutable message text, held in a reference-counted block
+ *
+ * Many texts share one block: a TextArena packs a session's messages into
+ * blocks back to back, and a block is freed in one go once the last text in
+ * it is released (the oldest messages are trimmed, or the session is
+ * dropped). A text built on its own gets a block of exactly its size.
+ * Copies share the block, so a copy handed to another thread (the
+ * background summarizer) stays valid after the history moves on.
+ */
+class MessageText {
+public:
+    MessageText() = default;
+    MessageText(std::string_view text);
+    MessageText(const std::string& text) : MessageText(std::string_view(text)) {}
+    MessageText(const char* text) : MessageText(std::string_view(text)) {}
+    ~MessageText() { release(); }
+
+    MessageText(const MessageText& other);
+    MessageText(MessageText&& other) noexcept;
+    MessageText& operator=(const MessageText& other);
+    MessageText& operator=(MessageText&& other) noexcept;
+
+    std::string_view view() const { return block_ ? std::string_view(block_->data() + offset_, size_) : std::string_view(); }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(view()); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Bytes of the block this text lives in, shared with every other text there
+    size_t block_capacity() const { return block_ ? block_->capacity : 0; }
+    bool shares_block_with(const MessageText& other) const { return block_ && block_ == other.block_; }
+
+    friend bool operator==(const MessageText& a, std::string_view b) { return a.view() == b; }
+    friend std::ostream& operator<<(std::ostream& out, const MessageText& text) { return out << text.view(); }
+
+private:
+    friend class TextArena;
+
+    struct Block {
+        std::atomic<uint32_t> refs{1};
+        uint32_t capacity = 0;
+        bool pooled = false; // carved up by a TextArena rather than sized to one text
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+        const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+        static Block* allocate(size_t capacity, bool pooled);
+        static void retain(Block* block) { block->refs.fetch_add(1, std::memory_order_relaxed); }
+        static void release(Block* block);
+    };
+
+    MessageText(Block* block, uint32_t offset, uint32_t size) : block_(block), offset_(offset), size_(size) {}
+    void release();
+
+    Block* block_ = nullptr;
+    uint32_t offset_ = 0;
+    uint32_t size_ = 0;
+};
+
+/**
+ * @brief Packs the texts of one conversation into shared blocks
+ *
+ * Texts are appended to the current block until it is full; a text larger
+ * than LARGE_TEXT gets a block of its own so a big paste doesn't strand the
+ * rest of a block. The arena itself only keeps the current block open:
+ * everything else is owned by the texts, so blocks go away as their
+ * messages do. Not thread-safe; the texts it hands out are.
+ */
+class TextArena {
+public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    static constexpr size_t LARGE_TEXT = BLOCK_SIZE / 4;
+
+    TextArena() = default;
+    ~TextArena() { reset(); }
+
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    MessageText store(std::string_view text);
+    // text itself if it already shares a block, otherwise a copy in this arena
+    MessageText adopt(MessageText text);
+
+    // Stop filling the current block; texts already stored stay valid
+    void reset();
+
+private:
+    MessageText::Block* current_ = nullptr;
+    uint32_t used_ = 0;
+};
+
+} // namespace mag
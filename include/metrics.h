@@ -0,0 +1,213 @@
+#pragma once
+
+#include "tracing.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief Monotonic event or byte count
+ */
+class Counter {
+public:
+    void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+    
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+/**
+ * @brief Value that goes up and down (queue depth, requests in flight)
+ */
+class Gauge {
+public:
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+    
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+/**
+ * @brief Log-linear latency histogram in the style of HdrHistogram
+ *
+ * Durations are kept in microseconds. Each power of two is split into
+ * SUB_BUCKETS linear buckets, so any recorded value is reported within
+ * 1/SUB_BUCKETS (about 3%) from 1us up to MAX_MICROS (about 19 hours);
+ * longer values land in the last bucket. record() is one relaxed
+ * fetch_add per field and never allocates or locks.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+    static constexpr int MAX_MAGNITUDE = 36;
+    static constexpr uint64_t MAX_MICROS = (uint64_t{1} << MAX_MAGNITUDE) - 1;
+    static constexpr size_t BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    
+    void record(std::chrono::microseconds duration);
+    void record_micros(uint64_t micros);
+    
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_micros() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max_micros() const { return max_.load(std::memory_order_relaxed); }
+    
+    // Value at quantile q in [0, 1]; 0 when nothing was recorded
+    uint64_t percentile_micros(double q) const;
+    
+    // Recorded values at or below micros
+    uint64_t count_at_or_below(uint64_t micros) const;
+    
+    static size_t bucket_index(uint64_t micros);
+    static uint64_t bucket_lower_bound(size_t index);
+    static uint64_t bucket_upper_bound(size_t index);
+    
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief Records the lifetime of a scope into a histogram
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { histogram_.record(elapsed()); }
+    
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    
+    std::chrono::microseconds elapsed() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+    }
+    
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Process-wide named metrics
+ *
+ * A metric is a family name plus a label set, e.g.
+ * mag_request_seconds{service="file_tool",operation="apply"}. Looking one
+ * up takes a mutex, so hot paths look it up once and keep the reference;
+ * references stay valid for the life of the process. Updating a metric
+ * is lock-free.
+ *
+ * Snapshots come out as JSON (the "metrics" operation every service
+ * answers) or as Prometheus text exposition (MetricsServer). Histograms
+ * are exported to Prometheus with the fixed prometheus_buckets() bounds.
+ */
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+    
+    Counter& counter(const std::string& name, const MetricLabels& labels = {}, const std::string& help = "");
+    Gauge& gauge(const std::string& name, const MetricLabels& labels = {}, const std::string& help = "");
+    LatencyHistogram& histogram(const std::string& name, const MetricLabels& labels = {},
+                                const std::string& help = "");
+    
+    nlohmann::json to_json() const;
+    std::string to_prometheus() const;
+    
+    // Upper bounds in seconds of the exported Prometheus buckets (+Inf is implied)
+    static const std::vector<double>& prometheus_buckets();
+    
+private:
+    template <typename Metric>
+    struct Family {
+        std::string help;
+        std::map<MetricLabels, std::unique_ptr<Metric>> series;
+    };
+    
+    mutable std::mutex mutex_;
+    std::map<std::string, Family<Counter>> counters_;
+    std::map<std::string, Family<Gauge>> gauges_;
+    std::map<std::string, Family<LatencyHistogram>> histograms_;
+    
+    template <typename Metric>
+    static Metric& find_or_add(std::map<std::string, Family<Metric>>& families, const std::string& name,
+                               const MetricLabels& labels, const std::string& help);
+};
+
+/**
+ * @brief The series a service keeps about the requests it answers
+ *
+ * mag_request_seconds{service,operation} for latency,
+ * mag_request_errors_total{service,operation},
+ * mag_request_bytes_total{service,direction} and
+ * mag_requests_in_flight{service}.
+ */
+class ServiceMetrics {
+public:
+    explicit ServiceMetrics(std::string service, MetricsRegistry& registry = MetricsRegistry::instance());
+    
+    void record(const std::string& operation, std::chrono::microseconds elapsed, size_t bytes_in,
+                size_t bytes_out, bool failed = false);
+    
+    Gauge& in_flight() { return in_flight_; }
+    const std::string& service() const { return service_; }
+    
+    /**
+     * @brief One request in progress; recorded when the scope ends
+     *
+     * A traced request is also a span, named "<service> <operation>".
+     */
+    class RequestScope {
+    public:
+        RequestScope(ServiceMetrics& metrics, size_t bytes_in);
+        ~RequestScope();
+        
+        RequestScope(const RequestScope&) = delete;
+        RequestScope& operator=(const RequestScope&) = delete;
+        
+        void set_operation(std::string operation) {
+            if (span_.active()) {
+                span_.set_name(metrics_.service() + " " + operation);
+            }
+            operation_ = std::move(operation);
+        }
+        void add_reply_bytes(size_t bytes) { bytes_out_ += bytes; }
+        void fail() {
+            failed_ = true;
+            span_.set_error();
+        }
+        
+    private:
+        ServiceMetrics& metrics_;
+        std::string operation_ = "unknown";
+        size_t bytes_in_;
+        size_t bytes_out_ = 0;
+        bool failed_ = false;
+        std::chrono::steady_clock::time_point started_;
+        Span span_;
+    };
+    
+private:
+    std::string service_;
+    MetricsRegistry& registry_;
+    Counter& bytes_received_;
+    Counter& bytes_sent_;
+    Gauge& in_flight_;
+};
+
+} // namespace mag
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace mag {
+
+/**
+ * @brief Minimal HTTP endpoint that serves MetricsRegistry as Prometheus text
+ *
+ * Listens on 127.0.0.1 only and answers GET /metrics; everything else gets
+ * a 404. Requests are served one at a time on a single thread, which is
+ * plenty for a scraper polling every few seconds.
+ */
+class MetricsServer {
+public:
+    /**
+     * @param port Port to listen on; 0 picks a free one (see port())
+     * @throws std::runtime_error if the port cannot be bound
+     */
+    explicit MetricsServer(int port);
+    ~MetricsServer();
+    
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    
+    int port() const { return port_; }
+    
+    // Server on MetricsConfig::get_port(offset); null when metrics are off or
+    // the port is taken (logged)
+    static std::unique_ptr<MetricsServer> start(int offset);
+    
+private:
+    int port_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+    
+    void serve();
+    void answer(int client_fd);
+};
+
+} // namespace mag
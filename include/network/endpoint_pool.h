@@ -0,0 +1,155 @@
+#pragma once
+
+#include "endpoint_config.h"
+#include "network/nng_req_client.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Health bookkeeping for one endpoint of an EndpointPool
+ *
+ * EJECT_AFTER_FAILURES consecutive failures (a send error or a missed
+ * deadline; cancellations do not count) eject the endpoint for a cool-down
+ * that doubles with each ejection in a row, up to EJECT_MAX_MS. Once the
+ * cool-down has passed the endpoint is tried again: a success restores it
+ * fully, a failure ejects it straight away.
+ */
+class EndpointHealth {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    void record(NNGReqClient::Outcome outcome, Clock::time_point now = Clock::now());
+    bool available(Clock::time_point now = Clock::now()) const;
+    
+    Clock::time_point ejected_until() const;
+    size_t consecutive_failures() const;
+    
+private:
+    mutable std::mutex mutex_;
+    size_t consecutive_failures_ = 0;
+    size_t ejections_in_a_row_ = 0;
+    Clock::time_point ejected_until_{};
+};
+
+/**
+ * @brief Snapshot of one endpoint, for diagnostics
+ */
+struct EndpointStatus {
+    std::string url;
+    bool connected = false;
+    bool available = false;
+    size_t in_flight = 0;
+    size_t consecutive_failures = 0;
+};
+
+/**
+ * @brief Spreads requests for one service over several workers
+ *
+ * Each endpoint gets its own NNGReqClient. A request goes to the healthy
+ * endpoint with the fewest requests in flight (ties rotate), so a worker
+ * stuck on a slow provider call stops receiving new work. Endpoints come
+ * from EndpointConfig and, when a worker registry is configured, from the
+ * registered workers; the registry is re-read every REGISTRY_SCAN_MS so
+ * workers can join and leave while the client runs. An endpoint that
+ * cannot be dialed is retried every REDIAL_INTERVAL_MS. If every endpoint
+ * is ejected the one due back first is used rather than failing outright.
+ *
+ * The request API is the same as NNGReqClient's. Exchanges that must stay
+ * on one worker (a streamed reply) take a client from pin(); state that
+ * outlives an exchange (a bash session's shell) is reached with pin(key),
+ * which keeps sending a key to the worker it first went to.
+ */
+class EndpointPool {
+public:
+    /**
+     * @brief Pool over the configured endpoints and registry for service
+     * @throws std::runtime_error if no endpoint can be reached and there is no registry
+     */
+    EndpointPool(EndpointConfig::Service service, std::string service_name,
+                 std::chrono::milliseconds default_timeout);
+    
+    /**
+     * @param registry_directory Worker registry to follow; empty for a fixed set
+     * @param registry_service Service name used in the registry ("llm_adapter")
+     */
+    EndpointPool(const std::vector<std::string>& urls, std::string service_name,
+                 std::chrono::milliseconds default_timeout,
+                 std::string registry_directory = "", std::string registry_service = "");
+    ~EndpointPool();
+    
+    EndpointPool(const EndpointPool&) = delete;
+    EndpointPool& operator=(const EndpointPool&) = delete;
+    
+    std::future<NngMessage> send_async(NngMessage request,
+                                       std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                       const CancellationToken* cancel = nullptr);
+    NngMessage send(NngMessage request,
+                    std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                    const CancellationToken* cancel = nullptr);
+    std::future<std::string> request_async(const std::string& payload,
+                                           std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                           const CancellationToken* cancel = nullptr);
+    std::string request(const std::string& payload,
+                        std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                        const CancellationToken* cancel = nullptr);
+    
+    /**
+     * @brief The endpoint the next request would go to, held for several requests
+     * @throws std::runtime_error if no endpoint is reachable
+     */
+    std::shared_ptr<NNGReqClient> pin();
+    
+    /**
+     * @brief The endpoint key was last pinned to, while it stays in the pool and healthy
+     *
+     * Otherwise the one pin() would pick, which key then sticks to.
+     * @throws std::runtime_error if no endpoint is reachable
+     */
+    std::shared_ptr<NNGReqClient> pin(const std::string& key);
+    
+    // Static membership changes; registered workers are managed by the registry scan
+    void add_endpoint(const std::string& url);
+    void remove_endpoint(const std::string& url);
+    
+    void cancel_all();
+    size_t in_flight() const;
+    size_t size() const;
+    std::vector<EndpointStatus> status() const;
+    const std::string& service_name() const { return service_name_; }
+    
+private:
+    using Clock = EndpointHealth::Clock;
+    
+    struct Endpoint {
+        std::string url;
+        bool registered = false;                // came from the worker registry
+        std::shared_ptr<NNGReqClient> client;   // null until dialed
+        std::shared_ptr<EndpointHealth> health = std::make_shared<EndpointHealth>();
+        Clock::time_point next_dial{};
+        std::string last_error;
+    };
+    
+    std::string service_name_;
+    std::chrono::milliseconds default_timeout_;
+    std::string registry_directory_;
+    std::string registry_service_;
+    
+    mutable std::mutex mutex_;
+    std::vector<Endpoint> endpoints_;
+    std::map<std::string, std::string> sticky_; // pin(key) key -> endpoint url
+    size_t rotation_ = 0;
+    Clock::time_point next_scan_{};
+    
+    // All three run with mutex_ held
+    std::shared_ptr<NNGReqClient> pick(std::vector<std::shared_ptr<NNGReqClient>>& retired);
+    bool connect(Endpoint& endpoint, Clock::time_point now);
+    void scan_registry(Clock::time_point now, std::vector<std::shared_ptr<NNGReqClient>>& retired);
+};
+
+} // namespace mag
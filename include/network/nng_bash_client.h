@@ -0,0 +1,51 @@
+#pragma once
+
+#include "interfaces/bash_client_interface.h"
+#include "network/endpoint_pool.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace mag {
+
+/**
+ * @brief NNG-based implementation of bash client interface
+ * 
+ * This class implements the IBashClient interface using NNG sockets
+ * to communicate with the bash tool service.
+ *
+ * execute() and execute_stream() run in bash_tool's default session, so
+ * they always go to the worker that session was first sent to (see
+ * EndpointPool::pin(key)) and its shell state carries over between todos.
+ * execute_stream() starts a job on that worker and long-polls it
+ * with "execute_next" for the output produced so far.
+ * execute_concurrently() submits every command to one worker's job queue,
+ * each in a session of its own, and collects them with "wait".
+ */
+class NNGBashClient : public IBashClient {
+public:
+    /**
+     * @brief Constructor - connects to the bash tool service
+     */
+    NNGBashClient();
+    
+    /**
+     * @brief Destructor - cancels outstanding requests
+     */
+    ~NNGBashClient() override;
+    
+    // IBashClient interface implementation
+    CommandResult execute(const BashCommand& command) override;
+    CommandResult execute_stream(const BashCommand& command, const BashTool::OutputHandler& on_output) override;
+    std::vector<CommandResult> execute_concurrently(const std::vector<BashCommand>& commands) override;
+    LogChunk read_log(const std::string& path, uint64_t offset, size_t max_bytes) override;
+    void cancel_pending() override;
+    
+private:
+    std::unique_ptr<EndpointPool> client_;
+    std::mutex streaming_mutex_;
+    CancellationToken streaming_; // of the execute_stream() or execute_concurrently() call in progress
+    std::atomic<uint64_t> concurrent_batches_{0};
+};
+
+} // namespace mag
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "interfaces/file_client_interface.h"
+#include "network/endpoint_pool.h"
+#include <memory>
 
 namespace mag {
 
@@ -9,28 +11,42 @@ namespace mag {
  * 
  * This class implements the IFileClient interface using NNG sockets
  * to communicate with the file tool service.
+ *
+ * A WriteFile larger than FileTransferConfig::get_threshold() is sent as
+ * a chunked transfer to one pinned worker, with WINDOW chunks in flight,
+ * so neither side builds one message holding the whole file. Its dry run
+ * sends only the size and hash. Batches still carry their content inline.
  */
 class NNGFileClient : public IFileClient {
 public:
     /**
-     * @brief Constructor - initializes NNG socket connection
+     * @brief Constructor - connects to the file tool
      */
     NNGFileClient();
     
     /**
-     * @brief Destructor - cleans up NNG socket
+     * @brief Destructor - cancels outstanding requests
      */
     ~NNGFileClient() override;
     
     // IFileClient interface implementation
     DryRunResult dry_run(const WriteFileCommand& command) override;
+    std::future<DryRunResult> dry_run_async(const WriteFileCommand& command) override;
     ApplyResult apply(const WriteFileCommand& command) override;
+    BatchDryRunResult dry_run_batch(const std::vector<WriteFileCommand>& commands) override;
+    BatchApplyResult apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) override;
+    ReadFileResult read(const ReadFileRequest& request) override;
+    FileStatResult stat(const std::string& path) override;
+    ContextSlice context(const std::string& query, size_t budget_tokens) override;
+    void cancel_pending() override;
     
 private:
-    void* file_socket_;
+    std::unique_ptr<EndpointPool> client_;
+    size_t chunk_threshold_;
     
-    void initialize_socket();
-    void cleanup_socket();
+    // WriteFile content too large for one message goes in chunks (FileTransferConfig)
+    bool chunked(const WriteFileCommand& command) const;
+    ApplyResult apply_chunked(const WriteFileCommand& command);
 };
 
 } // namespace mag
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "interfaces/llm_client_interface.h"
+#include "network/endpoint_pool.h"
+#include <memory>
 #include <string>
 
 namespace mag {
@@ -20,7 +22,7 @@ public:
     explicit NNGLLMClient(const std::string& provider_override = "");
     
     /**
-     * @brief Destructor - cleans up NNG socket
+     * @brief Destructor - cancels outstanding requests
      */
     ~NNGLLMClient() override;
     
@@ -28,15 +30,26 @@ public:
     WriteFileCommand request_plan(const std::string& user_prompt) override;
     GenericCommand request_generic_plan(const std::string& user_prompt) override;
     std::string request_chat(const std::string& user_prompt) override;
+    std::string request_chat_stream(const std::string& user_prompt,
+                                    const std::function<void(const std::string&)>& on_chunk) override;
+    std::string request_chat_with_history(HistoryView conversation_history) override;
+    std::string request_summary(const std::vector<ConversationMessage>& turns,
+                                const std::string& previous_summary) override;
+    PlanBatchStatus submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) override;
+    PlanBatchStatus poll_plan_batch(const PlanBatchStatus& batch) override;
+    std::vector<PlanBatchResult> collect_plan_batch(const PlanBatchStatus& batch) override;
     void set_provider(const std::string& provider_name) override;
     std::string get_current_provider() const override;
+    void cancel_pending() override;
     
 private:
-    void* llm_socket_;
+    std::unique_ptr<EndpointPool> client_;
     std::string current_provider_;
+    std::string tenant_; // MAG_TENANT: the adapter queues requests by it and gives it its own clients
     
-    void initialize_socket();
-    void cleanup_socket();
+    std::string send_request(const std::string& request_str);
+    // The chat text from an {"response", "usage"} reply, reporting its usage
+    std::string open_chat_envelope(std::string reply);
     
     // Helper function to escape regex special characters
     std::string regex_escape(const std::string& str);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "message.h"
+#include <string_view>
+
+struct nng_msg;
+
+namespace mag {
+
+/**
+ * @brief Owning handle for an nng_msg
+ *
+ * Requests are decoded straight from body() and replies are encoded
+ * straight into the message (it is a WireSink), so a payload is never
+ * staged in a std::string on its way to or from the socket. Ownership
+ * passes to NNG with release() once a send succeeds.
+ */
+class NngMessage : public WireSink {
+public:
+    NngMessage() = default;
+    explicit NngMessage(nng_msg* msg) : msg_(msg) {} // adopts msg
+    ~NngMessage() override;
+    
+    NngMessage(NngMessage&& other) noexcept : msg_(other.release()) {}
+    NngMessage& operator=(NngMessage&& other) noexcept;
+    NngMessage(const NngMessage&) = delete;
+    NngMessage& operator=(const NngMessage&) = delete;
+    
+    /**
+     * @brief An empty message with room for capacity body bytes
+     * @throws std::runtime_error if NNG cannot allocate it
+     */
+    static NngMessage allocate(size_t capacity = 0);
+    static NngMessage copy_of(std::string_view data);
+    static NngMessage encode(const nlohmann::json& j, WireFormat format);
+    
+    // Appends to the body, allocating the message on first use
+    void write(const char* data, size_t size) override;
+    
+    std::string_view body() const;
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    
+    nng_msg* get() const { return msg_; }
+    nng_msg* release();
+    
+private:
+    nng_msg* msg_ = nullptr;
+};
+
+} // namespace mag
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "thread_pool.h"
+#include "network/nng_message.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace mag {
+
+/**
+ * @brief Concurrent NNG REP server built on contexts and asynchronous I/O
+ *
+ * Each context runs its own receive/reply state machine, so up to
+ * `contexts` requests can be in flight at once. Requests are handed to a
+ * ThreadPool; the handler receives the worker index so services can keep
+ * per-worker state. The handler reads the request in place from the
+ * received message and returns the reply message that is sent as is.
+ * A trace header in front of a request (TraceContext::strip_header) is
+ * removed first and becomes the handler's trace context.
+ *
+ * An optional admitter looks at each request as it arrives, on the NNG
+ * callback thread, and picks the pool queue it waits in (ThreadPool's
+ * fair-queuing key) or turns it away with an immediate reply.
+ *
+ * An optional deferrer, also on the callback thread and before the
+ * admitter, can take a request over, for long polls: it keeps the
+ * DeferredReply and completes it once it has an answer, from any thread.
+ * Until then the request holds its context but no worker; if the timeout
+ * passes first, on_timeout's reply is sent instead, from an NNG timer.
+ */
+class NNGRepServer {
+    struct Context;
+    
+public:
+    // request views the received message body and is only valid during the call
+    using Handler = std::function<NngMessage(size_t worker_index, std::string_view request)>;
+    
+    struct Admission {
+        std::string key;       // ThreadPool queue the request waits in
+        NngMessage rejection;  // when set, the reply sent at once instead of queuing the request
+    };
+    // Must be quick: it runs before the request is queued
+    using Admitter = std::function<Admission(std::string_view request)>;
+    
+    // The reply to a request a deferrer took; only the first answer counts
+    class DeferredReply {
+    public:
+        // Sends reply unless this request was answered already (e.g. timed out); false then
+        bool complete(NngMessage reply);
+        
+    private:
+        friend class NNGRepServer;
+        Context* context_ = nullptr;
+        std::mutex mutex_;
+        NngMessage reply_;
+        bool completed_ = false;
+        bool timer_armed_ = false;
+    };
+    
+    struct Deferral {
+        bool taken = false;                      // otherwise the request is queued as usual
+        std::chrono::milliseconds timeout{0};
+        std::function<NngMessage()> on_timeout;  // the reply when nothing completed it in time
+    };
+    // Must be quick, and complete the reply rather than block when the answer is already known
+    using Deferrer = std::function<Deferral(std::string_view request, const std::shared_ptr<DeferredReply>& reply)>;
+    
+    /**
+     * @param url Endpoint to listen on
+     * @param contexts Number of concurrent request contexts
+     * @param pool Worker pool that runs the handler
+     * @param handler Produces the reply for one request
+     */
+    NNGRepServer(const std::string& url, size_t contexts, ThreadPool& pool, Handler handler);
+    ~NNGRepServer();
+    
+    NNGRepServer(const NNGRepServer&) = delete;
+    NNGRepServer& operator=(const NNGRepServer&) = delete;
+    
+    // Set before start(); without one every request joins the pool's default queue
+    void set_admitter(Admitter admitter) { admitter_ = std::move(admitter); }
+    
+    // Set before start(); a request it takes is neither admitted nor queued
+    void set_deferrer(Deferrer deferrer) { deferrer_ = std::move(deferrer); }
+    
+    /**
+     * @brief Open the socket, listen and start receiving on every context
+     * @throws std::runtime_error if the socket cannot be opened or bound
+     */
+    void start();
+    
+    /**
+     * @brief Close the socket and wait for outstanding I/O to finish
+     */
+    void stop();
+    
+    size_t in_flight() const { return in_flight_.load(); }
+    
+private:
+    std::string url_;
+    size_t context_count_;
+    ThreadPool& pool_;
+    Handler handler_;
+    Admitter admitter_;
+    Deferrer deferrer_;
+    void* socket_;
+    bool started_ = false;
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> in_flight_{0};
+    std::vector<std::unique_ptr<Context>> contexts_;
+    
+    static void aio_callback(void* arg);
+    static void timer_callback(void* arg);
+    void on_io_complete(Context* context);
+    void on_timer(Context* context);
+    void receive(Context* context);
+    void defer(Context* context, std::shared_ptr<DeferredReply> deferred, Deferral deferral);
+    void finish(Context* context, NngMessage reply); // send a worked-on request's reply
+};
+
+} // namespace mag
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "cancellation.h"
+#include "network/nng_message.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+class Counter;
+class LatencyHistogram;
+
+/**
+ * @brief A service did not answer within the request deadline
+ */
+class RequestTimeoutError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief A request was abandoned through cancel_all() or its CancellationToken
+ */
+class RequestCancelledError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Asynchronous NNG REQ client with per-call deadlines and cancellation
+ *
+ * Every request runs on its own context with its own aio, so several requests
+ * to the same service can be in flight at once and a slow reply does not
+ * hold up the next request. The message API hands NngMessages to and from
+ * the socket without copying; the string API copies once each way. The
+ * send and the receive share one deadline. Results come back through a
+ * std::future. A timeout raises
+ * RequestTimeoutError and a cancellation raises RequestCancelledError.
+ * The destructor cancels whatever is still outstanding and waits for the
+ * callbacks to finish. Each call's latency is recorded in
+ * mag_client_request_seconds{service,outcome}. A call made from a traced
+ * thread is also recorded as a span, and its trace context travels in a
+ * header in front of the request.
+ */
+class NNGReqClient {
+public:
+    enum class Outcome { OK, TIMED_OUT, FAILED, CANCELLED };
+    using CompletionHook = std::function<void(Outcome)>;
+    
+    /**
+     * @param url Endpoint of the service
+     * @param service_name Used in error messages ("file tool", "LLM adapter")
+     * @param default_timeout Deadline for calls that do not pass their own
+     * @throws std::runtime_error if the socket cannot be opened or dialed
+     */
+    NNGReqClient(const std::string& url, std::string service_name, std::chrono::milliseconds default_timeout);
+    ~NNGReqClient();
+    
+    NNGReqClient(const NNGReqClient&) = delete;
+    NNGReqClient& operator=(const NNGReqClient&) = delete;
+    
+    /**
+     * @brief Send request and return a future for the reply
+     * @param timeout Deadline for this call; zero uses the default
+     * @param cancel Optional token that abandons this call when cancelled
+     */
+    std::future<NngMessage> send_async(NngMessage request,
+                                       std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                       const CancellationToken* cancel = nullptr);
+    
+    // Blocking form of send_async()
+    NngMessage send(NngMessage request,
+                    std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                    const CancellationToken* cancel = nullptr);
+    
+    // String forms of the above
+    std::future<std::string> request_async(const std::string& payload,
+                                           std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                           const CancellationToken* cancel = nullptr);
+    
+    std::string request(const std::string& payload,
+                        std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                        const CancellationToken* cancel = nullptr);
+    
+    // Abort every call in flight; their futures raise RequestCancelledError
+    void cancel_all();
+    
+    size_t in_flight() const;
+    const std::string& service_name() const { return service_name_; }
+    
+    // Runs on the completing thread as each call ends, before its future is
+    // ready; install it before the first request
+    void set_completion_hook(CompletionHook hook) { completion_hook_ = std::move(hook); }
+    
+private:
+    struct Call;
+    
+    std::string service_name_;
+    std::chrono::milliseconds default_timeout_;
+    void* socket_;
+    CompletionHook completion_hook_;
+    std::array<LatencyHistogram*, 4> latency_; // by Outcome
+    Counter* bytes_sent_;
+    Counter* bytes_received_;
+    
+    // Recursive: NNG may complete a cancelled operation on the cancelling thread
+    mutable std::recursive_mutex mutex_;
+    std::condition_variable_any idle_;
+    std::vector<std::unique_ptr<Call>> slots_; // context + aio pairs, reused across calls
+    std::vector<Call*> free_slots_;
+    std::map<uint64_t, Call*> calls_;          // in flight, by call id
+    uint64_t next_call_id_ = 1;
+    
+    Call* acquire_slot();
+    
+    static void aio_callback(void* arg);
+    void on_io_complete(Call* call);
+    void cancel_call(uint64_t id);
+    void finish(Call* call, int rv, NngMessage reply);
+};
+
+} // namespace mag
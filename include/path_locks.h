@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief First-come, first-served locks on file paths
+ *
+ * lock() takes a ticket on every path it names in one step, so a caller
+ * waits only for callers that asked earlier for one of the same paths.
+ * Writes to the same file therefore keep their arrival order, writes to
+ * different files never wait for each other, and since tickets form one
+ * global order a multi-path lock cannot deadlock. Paths are compared after
+ * making them absolute and lexically normal.
+ */
+class PathLocks {
+public:
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& other) noexcept;
+        Guard& operator=(Guard&& other) noexcept;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() { release(); }
+        
+        void release();
+        
+    private:
+        friend class PathLocks;
+        PathLocks* owner_ = nullptr;
+        std::vector<std::string> keys_;
+    };
+    
+    // Blocks until every path is free of earlier holders
+    Guard lock(const std::vector<std::string>& paths);
+    
+    size_t queued(const std::string& path) const; // holder plus waiters
+    
+private:
+    struct Queue {
+        uint64_t next_ticket = 0;
+        uint64_t serving = 0;
+    };
+    
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    std::unordered_map<std::string, Queue> queues_;
+    
+    void unlock(const std::vector<std::string>& keys);
+};
+
+} // namespace mag
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+namespace mag {
+
+/**
+ * @brief Answers "does this path resolve inside the working directory?" with few syscalls
+ *
+ * The canonical working directory is kept as a snapshot and refreshed
+ * only when stat(".") shows a chdir: another device or inode. Its ctime is
+ * left out, as every file created in it would change that.
+ * Canonical forms of the directories below it are cached, keyed on their
+ * path relative to it. An entry is trusted only while every level of that
+ * path still has the device, inode and ctime it had when the entry was
+ * made. Swapping a level for a symlink, or renaming it, changes one of
+ * them, so a check costs one stat per level instead of a full realpath of
+ * both the path and the working directory.
+ *
+ * Paths with ".." components, paths that are not lexically below the
+ * working directory and paths ending in a symlink are resolved in full,
+ * as before. Comparison is by whole components, so /repo2 is not inside
+ * /repo. Safe to share between threads.
+ */
+class PathResolver {
+public:
+    explicit PathResolver(size_t max_entries = DEFAULT_MAX_ENTRIES);
+    
+    static PathResolver& instance();
+    
+    bool is_within_cwd(const std::string& path);
+    
+    // Canonical working directory, from the snapshot
+    std::string cwd();
+    
+    // True when path is root or below it, comparing whole components of two canonical paths
+    static bool is_within(std::string_view path, std::string_view root);
+    
+    size_t size() const;
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+    
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 4096;
+
+private:
+    struct Stamp {
+        dev_t device = 0;
+        ino_t inode = 0;
+        int64_t ctime_ns = -1;
+        
+        bool operator==(const Stamp&) const = default;
+        bool same_file(const Stamp& other) const { return device == other.device && inode == other.inode; }
+    };
+    
+    struct Directory {
+        std::string canonical;
+        std::vector<Stamp> levels; // one per component of the relative path, outermost first
+    };
+    
+    struct Cwd {
+        std::string canonical;
+        Stamp stamp;
+    };
+    
+    size_t max_entries_;
+    mutable std::mutex mutex_;
+    std::shared_ptr<const Cwd> cwd_;
+    std::unordered_map<std::string, std::shared_ptr<const Directory>> directories_; // emptied with cwd_
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    
+    static std::optional<Stamp> stamp_of(const std::string& path); // follows symlinks
+    std::shared_ptr<const Cwd> current_cwd();
+    
+    // Canonical form of the directory cwd/relative, if it exists
+    std::string resolve_directory(const Cwd& cwd, const std::vector<std::string>& components, size_t count);
+};
+
+} // namespace mag
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "message.h"
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Provider batch jobs of todo plans, and the plans they returned, kept on disk
+ *
+ * A batch job (see ILLMClient::submit_plan_batch()) can take hours, so the
+ * jobs in flight are saved to survive the session that submitted them and
+ * their plans wait here until the todos run. Like PlanPrefetcher, each job
+ * remembers the context its plans were requested under (provider and
+ * policy); take() never hands out a plan made under a different one.
+ *
+ * Every change rewrites the file atomically. A missing or unreadable file
+ * is an empty store. Safe to call from several threads.
+ */
+class PlanBatchStore {
+public:
+    struct Job {
+        PlanBatchStatus status;
+        std::map<std::string, std::string> prompts; // custom id -> todo prompt
+        std::string context;
+    };
+
+    explicit PlanBatchStore(std::string path);
+
+    PlanBatchStore(const PlanBatchStore&) = delete;
+    PlanBatchStore& operator=(const PlanBatchStore&) = delete;
+
+    // Each throws std::runtime_error when the store cannot be saved
+    void add_job(Job job);
+    void update_job(const PlanBatchStatus& status);
+    // Keep the job's successful plans and forget the job; returns how many were kept
+    size_t store_results(const std::string& batch_id, const std::vector<PlanBatchResult>& results);
+
+    std::vector<Job> jobs() const;
+
+    // The plan for prompt, once; a plan made under another context is dropped instead
+    std::optional<WriteFileCommand> take(const std::string& prompt, const std::string& context);
+    bool has_plan(const std::string& prompt, const std::string& context) const;
+    // A plan for prompt is stored, or a job in flight will bring one
+    bool covers(const std::string& prompt, const std::string& context) const;
+    size_t plans() const;
+
+    const std::string& path() const { return path_; }
+
+private:
+    struct Plan {
+        WriteFileCommand command;
+        std::string context;
+    };
+
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::vector<Job> jobs_;               // in submission order
+    std::map<std::string, Plan> plans_;   // by todo prompt
+
+    void load();
+    void save() const; // with mutex_ held
+};
+
+} // namespace mag
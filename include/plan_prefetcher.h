@@ -0,0 +1,66 @@
+#pragma once
+
+#include "message.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Requests LLM plans for upcoming todos while the current one is still being worked on
+ *
+ * Up to depth plans are in flight or waiting at a time, in the order the run
+ * will take them, so the LLM round trip of the next todo overlaps the dry
+ * run, confirmation and execution of this one. Each plan remembers the
+ * context it was requested under; take() asks again when the context has
+ * changed since, so a stale plan is never handed out.
+ */
+class PlanPrefetcher {
+public:
+    using Planner = std::function<WriteFileCommand(const std::string& prompt)>;
+    using Context = std::function<std::string()>;
+    
+    /**
+     * @param prompts Every plan the run may need, in the order they will be taken
+     * @param context Called on the owning thread; plans made under a different one are stale
+     */
+    PlanPrefetcher(std::vector<std::string> prompts, size_t depth, Planner planner, Context context);
+    ~PlanPrefetcher(); // waits for requests still in flight and drops their plans
+    
+    PlanPrefetcher(const PlanPrefetcher&) = delete;
+    PlanPrefetcher& operator=(const PlanPrefetcher&) = delete;
+    
+    // The plan for prompt; prompts skipped on the way are dropped. Throws what the planner threw.
+    WriteFileCommand take(const std::string& prompt);
+    
+    size_t hits() const { return hits_; }     // taken from a prefetch
+    size_t stale() const { return stale_; }   // prefetched, then dropped because the context changed
+    size_t misses() const { return misses_; } // never prefetched, planned on the spot
+
+private:
+    struct Pending {
+        std::string prompt;
+        std::string context;
+        std::future<WriteFileCommand> plan;
+    };
+    
+    std::vector<std::string> prompts_;
+    size_t next_ = 0; // first prompt not yet requested
+    size_t depth_;
+    Planner planner_;
+    Context context_;
+    std::deque<Pending> ahead_; // requested and not yet taken, in order
+    ThreadPool pool_;
+    size_t hits_ = 0;
+    size_t stale_ = 0;
+    size_t misses_ = 0;
+    
+    void fill();
+};
+
+} // namespace mag
@@ -1,26 +1,128 @@
 #pragma once
 
 #include "policy_config.h"
+#include "policy_matcher.h"
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 namespace mag {
 
+/**
+ * @brief Decisions already made against one policy snapshot
+ *
+ * Keyed on tool, operation and normalized input. Only what depends on the
+ * policy alone is kept; whether a path stays inside the working directory
+ * depends on the filesystem and is checked every time. Emptied when full.
+ */
+class PolicyDecisionCache {
+public:
+    static constexpr size_t MAX_ENTRIES = 4096;
+    
+    std::optional<bool> lookup(const std::string& key) const;
+    void store(const std::string& key, bool allowed);
+    size_t size() const;
+    
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, bool> decisions_;
+};
+
+// A policy as loaded at one moment, compiled once for all the checks made against it
+struct PolicySnapshot {
+    PolicySnapshot(PolicySettings policy_settings, uint64_t policy_version)
+        : settings(std::move(policy_settings)), compiled(settings), version(policy_version) {}
+    
+    const PolicySettings settings;
+    const CompiledPolicy compiled;
+    const uint64_t version; // grows with every reload
+    mutable PolicyDecisionCache decisions; // goes away with the snapshot when a new one is published
+};
+
+/**
+ * @brief The process-wide policy, reloaded when .mag/policy.json changes
+ *
+ * Readers get the current snapshot with one atomic load and keep it for as
+ * long as they use it. At most every RELOAD_CHECK_MS, the reader that finds
+ * the check due stats the file; if its mtime, size or inode changed, that
+ * reader parses and compiles it and publishes the result, while everyone
+ * else carries on with the old snapshot. A file that no longer parses
+ * leaves the previous policy in force.
+ *
+ * The file is the one in the working directory of the first use, created
+ * with the defaults if missing (see PolicyConfig::load_or_create()).
+ */
+class PolicyStore {
+public:
+    static constexpr int64_t RELOAD_CHECK_MS = 1000;
+    
+    static PolicyStore& instance();
+    
+    std::shared_ptr<const PolicySnapshot> current();
+    
+    // Checks the file right away; true if that published a new snapshot
+    bool refresh();
+    
+    // Publish settings that were just saved to the file
+    void publish(const PolicySettings& settings);
+    
+private:
+    struct FileStamp {
+        int64_t mtime_ns = -1;
+        int64_t size = -1;
+        uint64_t inode = 0;
+        
+        bool operator==(const FileStamp&) const = default;
+    };
+    
+    std::string path_;
+    std::atomic<std::shared_ptr<const PolicySnapshot>> snapshot_;
+    std::atomic<int64_t> next_check_ms_{0};
+    std::mutex reload_mutex_; // held while checking and reloading
+    FileStamp stamp_;         // of the file behind snapshot_; reload_mutex_
+    
+    PolicyStore();
+    FileStamp stamp_of_file() const;
+    bool reload_if_changed(); // reload_mutex_ held
+};
+
+/**
+ * @brief Policy checks against the process-wide PolicyStore
+ *
+ * A default-constructed checker always judges by the latest policy; one
+ * made from a snapshot keeps judging by that snapshot.
+ */
 class PolicyChecker {
 public:
     PolicyChecker();
+    explicit PolicyChecker(std::shared_ptr<const PolicySnapshot> snapshot);
     
     // Check if operation is allowed for tool+operation+path combination
     bool is_allowed(const std::string& tool, Operation operation, const std::string& path) const;
     
+    /**
+     * @brief Check a whole plan against one snapshot of the policy, before any of it runs
+     * @return One decision per path (or command), in order
+     */
+    std::vector<bool> evaluate_batch(const std::string& tool, Operation operation,
+                                     const std::vector<std::string>& paths) const;
+    std::vector<bool> evaluate_bash_batch(const std::vector<std::string>& commands) const;
+    
     // Legacy method for backward compatibility
     bool is_allowed(const std::string& path) const;
     bool is_extension_blocked(const std::string& path) const;
     bool is_file_size_allowed(size_t size_bytes) const;
     
-    // Get current policy settings
-    const PolicySettings& get_settings() const { return *settings_; }
+    // Get current policy settings; hold on to the pointer rather than calling again
+    std::shared_ptr<const PolicySettings> get_settings() const;
+    
+    // Version of the snapshot checks are judged by; changes with every reload
+    uint64_t version() const;
     
     // Get allowed directories for a specific tool and operation
     std::vector<std::string> get_allowed_directories(const std::string& tool, const std::string& operation) const;
@@ -34,11 +136,16 @@ public:
     bool update_settings(const PolicySettings& new_settings, std::string& error_message);
     
 private:
-    std::unique_ptr<PolicySettings> settings_;
+    std::shared_ptr<const PolicySnapshot> pinned_; // null: follow the store
+    
+    std::shared_ptr<const PolicySnapshot> snapshot() const;
+    bool is_allowed(const PolicySnapshot& policy, const std::string& tool, Operation operation,
+                    const std::string& path) const;
+    bool is_bash_command_allowed(const PolicySnapshot& policy, const std::string& command) const;
     
     bool is_within_cwd(const std::string& path) const;
     bool has_allowed_prefix(const std::string& tool, Operation operation, const std::string& path) const;
     bool has_allowed_prefix(const std::string& path) const; // Legacy method
 };
 
-} // namespace mag
\ No newline at end of file
+} // namespace mag
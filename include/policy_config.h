@@ -70,6 +70,9 @@ public:
     // Main entry point - loads existing config or creates default
     static std::unique_ptr<PolicySettings> load_or_create();
     
+    // The existing config, or the defaults if there is none or it is invalid; writes nothing
+    static std::unique_ptr<PolicySettings> load_or_default();
+    
     // Save policy settings to .mag/policy.json
     static bool save(const PolicySettings& settings, std::string& error_message);
     
@@ -79,6 +82,12 @@ public:
     // Get policy.json file path
     static std::string get_policy_file_path();
     
+    // Parse existing policy.json file
+    static std::unique_ptr<PolicySettings> parse_config(const std::string& file_path, std::string& error_message);
+    
+    // Convert PolicySettings to JSON (the policy.json form)
+    static nlohmann::json settings_to_json(const PolicySettings& settings);
+    
 private:
     // Create .mag/ directory if it doesn't exist
     static bool ensure_mag_directory_exists(std::string& error_message);
@@ -86,15 +95,10 @@ private:
     // Create default policy.json file
     static bool create_default_config(std::string& error_message);
     
-    // Parse existing policy.json file
-    static std::unique_ptr<PolicySettings> parse_config(const std::string& file_path, std::string& error_message);
     
     // Validate JSON schema
     static bool validate_json_schema(const nlohmann::json& json, std::string& error_message);
     
-    // Convert PolicySettings to JSON
-    static nlohmann::json settings_to_json(const PolicySettings& settings);
-    
     // Convert JSON to PolicySettings
     static std::unique_ptr<PolicySettings> json_to_settings(const nlohmann::json& json);
 };
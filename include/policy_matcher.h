@@ -0,0 +1,106 @@
+#pragma once
+
+#include "policy_config.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Byte trie answering "does any stored prefix start this string?"
+ *
+ * Costs one step per byte of the string, whatever the number of prefixes.
+ */
+class PrefixTrie {
+public:
+    void insert(std::string_view prefix);
+    bool matches(std::string_view text) const;
+    bool empty() const { return nodes_.size() == 1 && !nodes_[0].terminal; }
+
+private:
+    struct Node {
+        std::vector<std::pair<unsigned char, uint32_t>> children; // sorted by byte
+        bool terminal = false;
+    };
+    std::vector<Node> nodes_{1};
+    
+    uint32_t child(uint32_t node, unsigned char byte) const; // 0 if none
+};
+
+/**
+ * @brief Aho-Corasick automaton finding every occurrence of many literal patterns in one pass
+ */
+class MultiPatternMatcher {
+public:
+    explicit MultiPatternMatcher(const std::vector<std::string>& patterns = {}, bool ignore_case = false);
+    
+    /**
+     * @brief Report occurrences in the order they end until on_match returns true
+     * @param on_match Gets the pattern's index and where the occurrence starts
+     * @return Whether on_match accepted one
+     */
+    bool find(std::string_view text, const std::function<bool(size_t pattern, size_t start)>& on_match) const;
+    
+    bool contains_any(std::string_view text) const;
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    
+    struct Node {
+        std::vector<std::pair<unsigned char, uint32_t>> children; // sorted by byte
+        uint32_t fail = 0;
+        uint32_t next_output = NONE; // nearest node down the fail chain that ends a pattern
+        std::vector<uint32_t> patterns;
+    };
+    std::vector<Node> nodes_{1};
+    std::vector<size_t> lengths_;
+    std::vector<size_t> empty_patterns_; // match at 0 of any text, like std::string::find("")
+    bool ignore_case_;
+    
+    uint32_t child(uint32_t node, unsigned char byte) const; // NONE if none
+};
+
+/**
+ * @brief PolicySettings turned into matchers, so checks cost the same however many rules there are
+ *
+ * Directory rules keep their string-prefix meaning ("src/" admits
+ * "src/a.cpp"; an empty entry admits everything), blocked commands their
+ * substring meaning and allowed commands their first-word meaning.
+ * Immutable once built; compile again after the settings change.
+ */
+class CompiledPolicy {
+public:
+    explicit CompiledPolicy(const PolicySettings& settings);
+    
+    bool is_operation_allowed(const std::string& tool, Operation op, std::string_view path) const;
+    const std::vector<std::string>& allowed_directories(const std::string& tool, Operation op) const;
+    bool is_extension_blocked(const std::string& extension) const;
+    
+    // Allowed means not blocked and, if the policy lists commands, the first word among them
+    bool is_bash_command_allowed(std::string_view command) const;
+    bool is_bash_command_blocked(std::string_view command) const;
+
+private:
+    struct OperationRules {
+        std::vector<std::string> directories;
+        bool any_directory = false;
+        PrefixTrie prefixes;
+    };
+    
+    std::map<std::string, std::array<OperationRules, 4>, std::less<>> tools_; // indexed by Operation
+    std::unordered_set<std::string> blocked_extensions_;
+    bool has_bash_tool_ = false;
+    std::unordered_set<std::string> allowed_commands_;
+    MultiPatternMatcher blocked_commands_;
+    
+    const OperationRules* rules(const std::string& tool, Operation op) const;
+};
+
+} // namespace mag
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "cancellation.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Bounded capture of one output stream
+ *
+ * The first head_bytes are kept as they arrive, and after them the last
+ * head_bytes in a ring buffer, so memory stays flat however much is
+ * written. Once the stream outgrows the head and a spill directory is set,
+ * all of it also goes to a log file there (up to max_spill_bytes). The log
+ * is removed again by finish() if nothing was dropped from memory after all.
+ */
+class OutputCapture {
+public:
+    explicit OutputCapture(size_t head_bytes = SIZE_MAX, std::string spill_directory = "",
+                           uint64_t max_spill_bytes = UINT64_MAX);
+    ~OutputCapture();
+    
+    OutputCapture(const OutputCapture&) = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+    
+    // Returns how many leading bytes of data went to the head
+    size_t append(std::string_view data);
+    
+    // Closes the log; call once the stream has ended
+    void finish();
+    
+    // The head, then a note of what was dropped and the tail
+    std::string text() const;
+    
+    // What text() holds beyond the head, i.e. what append() did not report
+    std::string continuation() const;
+    
+    uint64_t total_bytes() const { return total_; }
+    bool truncated() const { return total_ > head_limit_ + tail_filled_; }
+    const std::string& log_path() const { return log_path_; }
+    
+private:
+    size_t head_limit_;
+    std::string head_;
+    std::string tail_;      // ring buffer of head_limit_ bytes, once the head is full
+    size_t tail_start_ = 0; // oldest byte in tail_
+    size_t tail_filled_ = 0;
+    uint64_t total_ = 0;
+    std::string spill_directory_;
+    uint64_t max_spill_bytes_;
+    std::string log_path_;
+    int log_fd_ = -1;
+    uint64_t logged_ = 0;
+    
+    void push_tail(std::string_view data);
+    std::string tail_after_head() const;
+    void spill(std::string_view data);
+};
+
+// What a process and the children it waited for used
+struct ResourceUsage {
+    std::chrono::microseconds user_cpu{0};
+    std::chrono::microseconds system_cpu{0};
+    uint64_t max_rss_kb = 0;      // largest single process; 0 where unknown (ShellSession commands)
+    uint64_t blocks_read = 0;     // filesystem block input operations
+    uint64_t blocks_written = 0;
+};
+
+// Per-process rlimits for the child, inherited by everything it starts; 0 = unlimited
+struct ResourceLimits {
+    uint64_t cpu_seconds = 0;     // RLIMIT_CPU: SIGXCPU, then SIGKILL
+    uint64_t memory_bytes = 0;    // RLIMIT_AS: allocations beyond it fail
+    uint64_t file_bytes = 0;      // RLIMIT_FSIZE: SIGXFSZ on writing past it
+    
+    bool any() const { return cpu_seconds > 0 || memory_bytes > 0 || file_bytes > 0; }
+};
+
+/**
+ * @brief What to run and how long to let it run
+ *
+ * argv is executed directly (argv[0] is looked up on PATH); nothing is
+ * passed through a shell unless argv names one. With capture_fd3 the child
+ * also gets a third pipe as fd 3, for out-of-band reports such as its final
+ * working directory. on_output sees the head of stdout (1) and stderr (2)
+ * as it is read, and the rest of what is kept once the process is done;
+ * cancelling cancel ends the run like a timeout does.
+ */
+struct ProcessSpec {
+    std::vector<std::string> argv;
+    std::chrono::milliseconds timeout{30000};   // 0 = no limit
+    std::chrono::milliseconds kill_grace{2000}; // between SIGTERM and SIGKILL
+    size_t max_output_bytes = 256 * 1024;       // per stream, kept from both the start and the end
+    std::string spill_directory;                // where outgrown streams are logged; empty = nowhere
+    uint64_t max_spill_bytes = UINT64_MAX;      // per log file
+    bool capture_fd3 = false;
+    ResourceLimits limits;                      // set in the child before argv runs (Linux only)
+    std::function<void(int fd, std::string_view chunk)> on_output;
+    const CancellationToken* cancel = nullptr;
+};
+
+struct ProcessOutput {
+    int exit_code = -1;         // 128 + signal number if the process was killed
+    std::string stdout_output;  // OutputCapture::text() of each stream
+    std::string stderr_output;
+    std::string fd3_output;
+    uint64_t stdout_bytes = 0;  // as written by the process
+    uint64_t stderr_bytes = 0;
+    std::string stdout_log;     // full stream, if it was spilled
+    std::string stderr_log;
+    bool timed_out = false;
+    bool cancelled = false;
+    bool truncated = false;     // bytes were dropped from the middle of some stream
+    ResourceUsage usage;
+};
+
+/**
+ * @brief Runs a child process with posix_spawn and collects its output
+ *
+ * The child gets /dev/null as stdin and its own process group. stdout,
+ * stderr (and fd 3) are read separately through non-blocking pipes with
+ * poll() and large reads. When the timeout passes, the whole group gets
+ * SIGTERM and, after kill_grace, SIGKILL. Output that background children
+ * still hold open is not waited for once the child itself has exited.
+ */
+class ProcessRunner {
+public:
+    // Throws std::runtime_error if the pipes cannot be set up or the spawn fails
+    static ProcessOutput run(const ProcessSpec& spec);
+};
+
+/**
+ * @brief A long-lived bash that runs one command after another
+ *
+ * Commands are fed to the shell on stdin as NUL-terminated directory and
+ * command strings and eval'd in the shell itself, so cd, exported
+ * variables, an activated virtualenv and shell functions carry over to the
+ * next command. After each one the shell writes its exit status and $PWD,
+ * NUL-delimited, to fd 3. Commands read /dev/null as stdin.
+ *
+ * A timeout or cancellation kills the shell's whole process group, as does
+ * a command that exits the shell; alive() is false afterwards and the
+ * session has to be replaced.
+ *
+ * The limits apply to the shell and each process it starts. A command's
+ * usage is the CPU time the shell and its children took while it ran, as
+ * bash's times builtin reports it; peak memory and I/O are not known.
+ */
+class ShellSession {
+public:
+    // Throws std::runtime_error if bash cannot be started
+    explicit ShellSession(const ResourceLimits& limits = {});
+    ~ShellSession();
+    
+    ShellSession(const ShellSession&) = delete;
+    ShellSession& operator=(const ShellSession&) = delete;
+    
+    /**
+     * @brief Run one command; spec supplies the limits and callbacks, its argv is ignored
+     * @return Output as ProcessRunner::run gives it, with the final $PWD as fd3_output
+     */
+    ProcessOutput run(const std::string& command, const std::string& working_directory, const ProcessSpec& spec);
+    
+    bool alive() const { return pid_ > 0; }
+    
+private:
+    struct Pipes;
+    
+    pid_t pid_ = -1;
+    std::unique_ptr<Pipes> pipes_;
+    ResourceUsage consumed_; // by the shell and its children so far
+    
+    void shut_down(); // kill the group and reap the shell
+};
+
+/**
+ * @brief ShellSessions by name, started on first use
+ *
+ * Each name has at most one shell and runs one command at a time. A dead
+ * shell is replaced by a fresh one on the next command. Sessions idle for
+ * longer than idle_timeout are closed, and once max_sessions are open the
+ * least recently used idle one makes room for a new name.
+ */
+class ShellSessions {
+public:
+    ShellSessions(size_t max_sessions, std::chrono::seconds idle_timeout, ResourceLimits limits = {});
+    
+    /**
+     * @brief Run command in the session called name
+     * @param fresh Set to true when a new shell had to be started for it
+     * @throws std::runtime_error if no shell can be started
+     */
+    ProcessOutput run(const std::string& name, const std::string& command, const std::string& working_directory,
+                      const ProcessSpec& spec, bool* fresh = nullptr);
+    
+    bool close(const std::string& name);
+    size_t size() const;
+    
+private:
+    struct Slot {
+        std::mutex mutex; // held while a command runs
+        std::unique_ptr<ShellSession> shell;
+        std::chrono::steady_clock::time_point last_used = std::chrono::steady_clock::now();
+        bool busy = false;
+    };
+    
+    size_t max_sessions_;
+    std::chrono::seconds idle_timeout_;
+    ResourceLimits limits_;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Slot>> slots_;
+    
+    // mutex_ held for both
+    void reap_idle(std::chrono::steady_clock::time_point now);
+    void make_room(); // close the least recently used idle session when full
+};
+
+} // namespace mag
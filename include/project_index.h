@@ -0,0 +1,153 @@
+#pragma once
+
+#include "config.h"
+#include "message.h"
+#include "policy.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief What the project index knows about one file
+ */
+struct IndexedFile {
+    std::string path;         // relative to the index root
+    std::string language;     // "cpp", "python", ...; empty when unknown
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint64_t hash = 0;        // Utils::hash64 chained over the content's 64 KiB chunks
+    size_t lines = 0;
+    std::vector<std::string> symbols; // declarations in file order (see ProjectIndex::outline())
+};
+
+/**
+ * @brief File tree, hashes and symbol outlines of the project, kept current
+ *
+ * The first start() walks the tree once. After that a background thread
+ * follows changes: with inotify it re-reads only the files it was told
+ * about; without it (or once the kernel's watch limit is reached) it
+ * re-stats the tree every ContextConfig::RESCAN_SECONDS and re-reads only
+ * files whose size or mtime moved. Either way a slice for a prompt is
+ * built from memory, never by walking the tree.
+ *
+ * Hidden files and directories, dependency and build trees (node_modules,
+ * any directory holding a CMakeCache.txt, ...), binary files and files the
+ * read policy denies to file_tool are left out, so nothing reaches a
+ * prompt that file_tool would not let a reader see. At most
+ * ContextConfig::MAX_FILES files are indexed.
+ *
+ * Safe to call from several threads; refreshes run one at a time and read
+ * files without holding up slices.
+ */
+class ProjectIndex {
+public:
+    explicit ProjectIndex(std::string root = ".", std::shared_ptr<const PolicyChecker> policy = nullptr);
+    ~ProjectIndex();
+
+    ProjectIndex(const ProjectIndex&) = delete;
+    ProjectIndex& operator=(const ProjectIndex&) = delete;
+
+    // Index the tree and start following it; later calls do nothing
+    void start();
+    void stop();
+
+    /**
+     * @brief Catch up with changes now instead of waiting for the background thread
+     *
+     * Applies the inotify events already queued or, without inotify,
+     * re-stats the tree. Only files that changed are read.
+     */
+    void refresh();
+
+    /**
+     * @brief The files relevant to query, described in at most budget_tokens
+     *
+     * Files are ranked by how well their path and symbols match the words
+     * of query (a path or file name quoted in it counts most). The slice
+     * opens with a one-line summary of the tree, then gives each file's
+     * path, language and length followed by as many of its symbols as fit.
+     * Starts the index if need be.
+     */
+    ContextSlice slice(const std::string& query, size_t budget_tokens);
+
+    std::optional<IndexedFile> find(const std::string& path) const;
+    size_t size() const;
+    bool watching() const { return inotify_fd_ >= 0 && !watch_limit_reached_; }
+    uint64_t files_read() const { return files_read_.load(std::memory_order_relaxed); } // to hash and outline
+
+    // By extension or well-known file name; "" when unknown
+    static std::string language_of(std::string_view path);
+
+    /**
+     * @brief Declarations of classes, functions and the like, one line each
+     *
+     * Recognised line by line from their leading keywords (or, in C-family
+     * languages, from the shape of a declaration), without parsing, and
+     * trimmed to the signature.
+     */
+    static std::vector<std::string> outline(std::string_view content, std::string_view language,
+                                            size_t max_symbols = ContextConfig::MAX_SYMBOLS);
+
+private:
+    struct Stat {
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+    };
+
+    std::string root_;
+    std::shared_ptr<const PolicyChecker> policy_;
+
+    mutable std::mutex mutex_;                  // files_, unindexed_
+    std::map<std::string, IndexedFile> files_;  // by relative path
+    std::map<std::string, Stat> unindexed_;     // binary, denied or unreadable; read again once they change
+
+    std::mutex refresh_mutex_;                  // one refresh at a time; owns the fields below
+    bool started_ = false;
+    int inotify_fd_ = -1;
+    std::map<int, std::string> watches_;        // watch descriptor -> directory
+    std::set<std::string> changed_files_;
+    std::set<std::string> changed_directories_;
+    bool rescan_ = false;                       // inotify lost events
+    std::atomic<bool> watch_limit_reached_{false}; // rescanning from then on
+
+    std::atomic<bool> stopping_{false};
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    std::thread watcher_;
+    std::atomic<uint64_t> files_read_{0};
+
+    std::string absolute(const std::string& relative) const;
+    bool skipped_directory(const std::string& relative) const;
+    bool allowed(const std::string& relative) const;
+
+    // Every indexable file under directory (relative, "" for the root), watching each directory on the way
+    std::map<std::string, Stat> walk(const std::string& directory);
+    void watch(const std::string& directory);
+    // Forget the watches under directory once it no longer exists
+    void unwatch_missing(const std::string& directory);
+
+    // Bring the index in line with found; files under scope that were not found are dropped.
+    // force re-reads files even when their size and mtime match.
+    void update(const std::map<std::string, Stat>& found, const std::string& scope, bool force);
+    void update(const std::map<std::string, Stat>& found, const std::vector<std::string>& gone, bool force);
+
+    // Read and outline one file; nullopt for a binary file or one that vanished
+    std::optional<IndexedFile> load(const std::string& relative, const Stat& stat);
+
+    void drain_events();
+    void refresh_locked();
+    void watch_loop();
+};
+
+} // namespace mag
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "http_client.h"
+#include "cancellation.h"
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+namespace mag {
+
+/**
+ * @brief Thrown when a provider cannot serve a request right now (circuit open
+ * or retries exhausted), signalling that another provider should be tried
+ */
+class ProviderUnavailableError : public std::runtime_error {
+public:
+    explicit ProviderUnavailableError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/**
+ * @brief Token-bucket rate limiter
+ */
+class TokenBucket {
+public:
+    TokenBucket(double tokens_per_second, double burst);
+    
+    // Take a token if one is available; otherwise return the wait until the next one
+    std::chrono::milliseconds try_acquire();
+    
+    // Block until a token is taken; false if cancel fired first
+    bool acquire(const CancellationToken* cancel = nullptr);
+    
+private:
+    double rate_;
+    double capacity_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_refill_;
+    std::mutex mutex_;
+};
+
+/**
+ * @brief Which failures to retry and how long to back off between attempts
+ */
+struct RetryPolicy {
+    int max_retries;
+    std::chrono::milliseconds base_delay;
+    std::chrono::milliseconds max_delay;
+    std::chrono::milliseconds max_retry_after;
+    
+    // Transport errors, 408, 429, 5xx and Anthropic's 529 (overloaded)
+    static bool is_retryable(const HttpResponse& response);
+    
+    // retry-after-ms / Retry-After (delta-seconds or HTTP-date), if present and
+    // well-formed; capped at MAX_RETRY_AFTER_HINT, so a huge value still reads as too long
+    static std::optional<std::chrono::milliseconds> retry_after(const HttpResponse& response);
+    
+    static constexpr std::chrono::milliseconds MAX_RETRY_AFTER_HINT = std::chrono::hours(24);
+    
+    // Server hint when given, else full-jitter exponential backoff for the 0-based retry
+    std::chrono::milliseconds backoff(int retry, const HttpResponse& response) const;
+};
+
+/**
+ * @brief Consecutive-failure circuit breaker
+ *
+ * CLOSED until failure_threshold failures in a row, then OPEN (requests are
+ * refused) for open_duration, then HALF_OPEN where a single probe decides
+ * whether to close again or re-open. A caller that gets no answer at all
+ * (cancelled, or never sent) calls release_probe() so the next request can
+ * probe instead.
+ *
+ * Outcomes are reported with the Permit their request was admitted with.
+ * Only the probe's outcome moves a HALF_OPEN breaker, and outcomes of
+ * requests admitted before the breaker last opened are ignored, so a late
+ * success cannot close it and a late failure cannot free the probe slot.
+ */
+class CircuitBreaker {
+public:
+    enum class State { CLOSED, OPEN, HALF_OPEN };
+    
+    struct Permit {
+        bool allowed = false;
+        bool probe = false;      // the HALF_OPEN probe
+        uint64_t generation = 0; // how many times the breaker had opened at admission
+        
+        explicit operator bool() const { return allowed; }
+    };
+    
+    CircuitBreaker(int failure_threshold, std::chrono::milliseconds open_duration);
+    
+    Permit allow_request();
+    void record_success(const Permit& permit);
+    void record_failure(const Permit& permit);
+    void release_probe(const Permit& permit); // the request ended without an outcome; state is unchanged
+    State state() const;
+    
+private:
+    int failure_threshold_;
+    std::chrono::milliseconds open_duration_;
+    mutable std::mutex mutex_;
+    State state_ = State::CLOSED;
+    int consecutive_failures_ = 0;
+    bool probe_in_flight_ = false;
+    uint64_t generation_ = 0;
+    std::chrono::steady_clock::time_point opened_at_;
+    
+    bool is_current_probe(const Permit& permit) const; // with mutex_ held
+    void open();                                       // with mutex_ held
+};
+
+/**
+ * @brief Process-wide call policy for LLM providers
+ *
+ * Rate limiters are kept per provider and API key, circuit breakers per
+ * provider, so every LLMClient talking to the same endpoint shares them.
+ */
+class ProviderResilience {
+public:
+    static ProviderResilience& instance();
+    
+    ProviderResilience();
+    
+    TokenBucket& rate_limiter(const std::string& provider, const std::string& api_key);
+    CircuitBreaker& breaker(const std::string& provider);
+    const RetryPolicy& retry_policy() const { return retry_policy_; }
+    
+private:
+    RetryPolicy retry_policy_;
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<TokenBucket>> limiters_;
+    std::map<std::string, std::unique_ptr<CircuitBreaker>> breakers_;
+};
+
+} // namespace mag
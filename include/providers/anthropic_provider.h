@@ -18,14 +18,42 @@ public:
     
     nlohmann::json build_conversation_payload(
         const std::string& system_prompt,
-        const std::vector<ConversationMessage>& conversation_history,
+        HistoryView conversation_history,
+        const std::string& model
+    ) const override;
+    
+    void write_conversation_payload(
+        std::string& out,
+        const std::string& system_prompt,
+        HistoryView conversation_history,
         const std::string& model
     ) const override;
     
     std::vector<std::string> get_headers(const std::string& api_key) const override;
     WriteFileCommand parse_response(const std::string& response) const override;
     std::string parse_chat_response(const std::string& response) const override;
+    ProviderUsage parse_usage(const std::string& response) const override;
     std::string get_api_key_env_var() const override;
+    
+    bool supports_streaming() const override { return true; }
+    std::string parse_stream_event(const SseEvent& event) const override;
+    
+    // Marks the system block with cache_control so it is cached server-side
+    bool supports_prompt_caching() const override { return true; }
+    
+    // Message Batches API: one call submits every request
+    bool supports_batches() const override { return true; }
+    ProviderBatchCall build_batch_submit(
+        const std::string& api_key,
+        const std::vector<std::pair<std::string, nlohmann::json>>& requests
+    ) const override;
+    ProviderBatchCall build_batch_poll(const std::string& api_key, const std::string& batch_id) const override;
+    ProviderBatchCall build_batch_results(const std::string& api_key, const PlanBatchStatus& status) const override;
+    PlanBatchStatus parse_batch_status(const std::string& response) const override;
+    std::vector<ProviderBatchEntry> parse_batch_results(const std::string& response) const override;
+    
+private:
+    nlohmann::json build_system(const std::string& system_prompt) const;
 };
 
 } // namespace mag
\ No newline at end of file
@@ -18,14 +18,25 @@ public:
     
     nlohmann::json build_conversation_payload(
         const std::string& system_prompt,
-        const std::vector<ConversationMessage>& conversation_history,
+        HistoryView conversation_history,
+        const std::string& model
+    ) const override;
+    
+    void write_conversation_payload(
+        std::string& out,
+        const std::string& system_prompt,
+        HistoryView conversation_history,
         const std::string& model
     ) const override;
     
     std::vector<std::string> get_headers(const std::string& api_key) const override;
     WriteFileCommand parse_response(const std::string& response) const override;
     std::string parse_chat_response(const std::string& response) const override;
+    ProviderUsage parse_usage(const std::string& response) const override;
     std::string get_api_key_env_var() const override;
+    
+    bool supports_streaming() const override { return true; }
+    std::string parse_stream_event(const SseEvent& event) const override;
 };
 
 } // namespace mag
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "llm_provider.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace mag {
+
+/**
+ * @brief One captured provider exchange (a line of the JSONL capture file)
+ */
+struct ReplayEntry {
+    std::string key;        // ReplayProvider::request_key of the request payload
+    std::string provider;   // provider whose wire format response is in
+    std::string model;
+    std::string response;   // raw response body
+};
+
+/**
+ * @brief Appends live provider exchanges to a JSONL capture file
+ *
+ * Each line holds the key, provider, model, request payload and raw response,
+ * so the file can be inspected or edited by hand and replayed by ReplayProvider.
+ */
+class ResponseRecorder {
+public:
+    explicit ResponseRecorder(const std::string& capture_file);
+    
+    void record(const std::string& provider, const std::string& model,
+                const std::string& payload, const std::string& response);
+    size_t recorded() const;
+    
+private:
+    std::string capture_file_;
+    mutable std::mutex mutex_;
+    size_t recorded_ = 0;
+};
+
+/**
+ * @brief Offline provider that answers from a capture file
+ *
+ * Requests are built and responses parsed in the wire format of the provider
+ * that made the capture, so the whole client pipeline runs unchanged. Latency
+ * (plus uniform jitter) can be injected to model a remote API. In strict mode
+ * an unrecorded request is an error; otherwise captured responses are served
+ * in rotation.
+ */
+class ReplayProvider : public LLMProvider {
+public:
+    // Configured from MAG_REPLAY_* environment variables
+    ReplayProvider();
+    
+    /**
+     * @param format Provider the capture was recorded with; empty reads it from the capture
+     */
+    ReplayProvider(const std::string& capture_file, const std::string& format,
+                   int latency_ms, int jitter_ms, bool strict);
+    
+    // Key that matches a request to its capture; ignores model, stream and cache markers
+    static std::string request_key(const std::string& payload);
+    
+    std::string get_name() const override;
+    std::string get_api_url() const override;
+    std::string get_default_model() const override;
+    
+    nlohmann::json build_request_payload(
+        const std::string& system_prompt,
+        const std::string& user_prompt,
+        const std::string& model
+    ) const override;
+    
+    nlohmann::json build_conversation_payload(
+        const std::string& system_prompt,
+        HistoryView conversation_history,
+        const std::string& model
+    ) const override;
+    
+    void write_conversation_payload(
+        std::string& out,
+        const std::string& system_prompt,
+        HistoryView conversation_history,
+        const std::string& model
+    ) const override;
+    
+    std::vector<std::string> get_headers(const std::string& api_key) const override;
+    WriteFileCommand parse_response(const std::string& response) const override;
+    std::string parse_chat_response(const std::string& response) const override;
+    ProviderUsage parse_usage(const std::string& response) const override;
+    std::string get_api_key_env_var() const override;
+    bool requires_api_key() const override { return false; }
+    
+    std::optional<std::string> serve_locally(const std::string& payload) const override;
+    
+    size_t entry_count() const;
+    
+private:
+    std::string capture_file_;
+    std::string format_;
+    int latency_ms_;
+    int jitter_ms_;
+    bool strict_;
+    
+    mutable std::once_flag loaded_;
+    mutable std::unique_ptr<LLMProvider> format_provider_;
+    mutable std::vector<ReplayEntry> entries_;
+    mutable std::unordered_map<std::string, size_t> by_key_;
+    mutable std::atomic<size_t> next_entry_{0};
+    
+    const LLMProvider& format_provider() const;
+    void load() const;
+    void inject_latency() const;
+};
+
+} // namespace mag
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "input_handler.h"
+#include <deque>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -15,6 +17,7 @@ namespace mag {
  * - Line editing (arrow keys, Ctrl+A/E, etc.)
  * - History search (Ctrl+R)
  * - Multi-line input support
+ * - Callback-mode reading, so keystrokes are handled while requests run
  */
 class ReadlineInputHandler : public InputHandler {
 public:
@@ -22,6 +25,7 @@ public:
     ~ReadlineInputHandler() override;
     
     std::string get_line(const std::string& prompt) override;
+    InputEvent wait_for_line(const std::string& prompt, int wake_fd, std::string& line) override;
     void add_history(const std::string& line) override;
     void save_history() override;
     void load_history() override;
@@ -32,9 +36,14 @@ private:
     std::string history_file_;
     std::vector<std::string> completion_list_;
     
+    // Callback-mode state for wait_for_line; a null entry is EOF
+    bool callback_installed_ = false;
+    std::deque<std::unique_ptr<std::string>> completed_lines_;
+    
     // Static callback for readline tab completion
     static char** completion_callback(const char* text, int start, int end);
     static char* completion_generator(const char* text, int state);
+    static void line_callback(char* line);
     
     // Static pointer to current instance for callback access
     static ReadlineInputHandler* current_instance_;
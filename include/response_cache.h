@@ -0,0 +1,82 @@
+#pragma once
+
+#include "config.h"
+#include <string>
+#include <string_view>
+#include <optional>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <initializer_list>
+
+namespace mag {
+
+/**
+ * @brief Content-addressed cache of raw LLM provider response bodies
+ *
+ * Entries live in a bounded in-memory LRU and, when a directory is given, in
+ * one JSON file per key on disk so identical prompts are answered across
+ * adapter restarts. Both tiers honour the same TTL. Expired files are deleted
+ * when they are looked up, and the directory is pruned on construction and
+ * every PRUNE_INTERVAL puts: expired files go first, then the oldest until at
+ * most disk_capacity remain. Safe to share between threads.
+ */
+class ResponseCache {
+public:
+    /**
+     * @param directory Disk tier location; empty keeps the cache memory-only
+     * @param memory_capacity Maximum entries held in memory
+     * @param ttl Entries older than this are treated as misses
+     * @param disk_capacity Maximum entries kept on disk
+     */
+    ResponseCache(const std::string& directory, size_t memory_capacity, std::chrono::seconds ttl,
+                  size_t disk_capacity = ResponseCacheConfig::DEFAULT_DISK_ENTRIES);
+    
+    static constexpr size_t PRUNE_INTERVAL = 64;
+    
+    /**
+     * @brief Build a 128-bit hex key from the fields that determine a response
+     *
+     * Fields are length-prefixed before hashing so ("ab", "c") and ("a", "bc") differ.
+     */
+    static std::string make_key(std::initializer_list<std::string_view> fields);
+    
+    std::optional<std::string> get(const std::string& key);
+    void put(const std::string& key, const std::string& body);
+    void erase(const std::string& key);
+    
+    size_t memory_size() const;
+    size_t disk_size() const; // entry files in the directory
+    size_t hits() const;
+    size_t misses() const;
+    
+private:
+    struct Entry {
+        std::string body;
+        int64_t created_at; // seconds since epoch
+    };
+    using LruList = std::list<std::pair<std::string, Entry>>;
+    
+    std::string directory_;
+    size_t memory_capacity_;
+    std::chrono::seconds ttl_;
+    size_t disk_capacity_;
+    mutable std::mutex mutex_;
+    LruList lru_; // most recently used at the front
+    std::unordered_map<std::string, LruList::iterator> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t puts_since_prune_ = 0;
+    std::mutex prune_mutex_; // one prune at a time
+    
+    bool is_expired(int64_t created_at) const;
+    std::string path_for(const std::string& key) const;
+    std::optional<Entry> load_from_disk(const std::string& key) const;
+    void store_to_disk(const std::string& key, const Entry& entry) const;
+    void remove_from_disk(const std::string& key) const;
+    void prune_disk();
+    void insert_locked(const std::string& key, Entry entry);
+};
+
+} // namespace mag
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+/**
+ * @brief What the session index knows about one saved conversation
+ */
+struct SessionInfo {
+    std::string id;
+    std::string created;
+    std::string last_activity;
+    std::string last_provider;
+    size_t message_count = 0;
+
+    nlohmann::json to_json() const;
+    static SessionInfo from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief Index of the sessions in a conversation storage directory
+ *
+ * Kept in <storage>/.index/sessions.json and updated on every save, so
+ * listing and lookups never open the session files. Lookups are a hash
+ * probe and listing walks an ordered set (newest activity first).
+ *
+ * The index lives in its own subdirectory so that replacing it does not
+ * touch the storage directory's mtime: if the storage directory is newer
+ * than the index, a session file was created, removed or rewritten behind
+ * the index's back and it is rebuilt by scanning. Writers serialize on
+ * an flock()ed lock file, so several MAG instances can share a directory.
+ */
+class SessionIndex {
+public:
+    explicit SessionIndex(std::string storage_directory);
+
+    void update(const SessionInfo& info);
+    std::optional<SessionInfo> find(const std::string& session_id);
+    // Newest first; offset/limit page through the listing
+    std::vector<SessionInfo> list(size_t offset = 0, size_t limit = std::numeric_limits<size_t>::max());
+    size_t size();
+
+    // Re-scan every session file and rewrite the index
+    void rebuild();
+
+    const std::string& path() const { return index_path_; }
+
+private:
+    std::string directory_;
+    std::string index_directory_;
+    std::string index_path_;
+    std::unordered_map<std::string, SessionInfo> sessions_;
+    std::set<std::pair<std::string, std::string>, std::greater<>> order_; // (last_activity, id)
+    std::optional<std::filesystem::file_time_type> loaded_mtime_;
+
+    void refresh();
+    void refresh_locked();
+    bool is_stale() const;
+    bool load_file();
+    void write_file();
+    void rebuild_locked();
+    void insert(SessionInfo info);
+    void clear();
+};
+
+} // namespace mag
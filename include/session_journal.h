@@ -0,0 +1,78 @@
+#pragma once
+
+#include "llm_provider.h"
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+/**
+ * @brief Live state of a session as reconstructed from its journal
+ */
+struct JournalSnapshot {
+    std::vector<ConversationMessage> messages; // oldest first; a compaction summary leads if live
+    nlohmann::json metadata = nlohmann::json::object(); // latest "meta" record
+    uint64_t next_sequence = 0;                // sequence number for the next appended message
+    bool has_summary = false;                  // messages.front() is a compaction summary
+    bool complete = true;                      // false when max_messages cut older messages off
+};
+
+/**
+ * @brief Append-only JSONL journal of one conversation session
+ *
+ * Each change to the history is one line: "message" appends at the back,
+ * "summary" puts a compaction summary at the front, "drop" forgets every
+ * message below a sequence number and "clear" empties the session. Lines
+ * are written with a single write() so a crash loses at most the last
+ * record, and fdatasync is batched (every SYNC_EVERY_RECORDS appends or
+ * SYNC_INTERVAL_MS). A torn final line is skipped on read.
+ *
+ * read() walks the file backwards from the end, so loading the newest N
+ * messages costs O(N) rather than O(session). Once enough records are dead
+ * (dropped or cleared), compact() rewrites the file as a snapshot.
+ */
+class SessionJournal {
+public:
+    explicit SessionJournal(std::string path);
+    ~SessionJournal();
+
+    SessionJournal(const SessionJournal&) = delete;
+    SessionJournal& operator=(const SessionJournal&) = delete;
+
+    void append_message(const ConversationMessage& message);
+    void append_summary(const ConversationMessage& summary);
+    void append_drop(uint64_t front_sequence, size_t dropped);
+    void append_clear(size_t dropped);
+    void append_metadata(const nlohmann::json& metadata);
+
+    void sync();
+    bool needs_compaction() const { return dead_records_ >= compact_after_; }
+    void compact();
+
+    // Replace the journal with exactly this state (temp file + fsync + rename)
+    void rewrite(const JournalSnapshot& snapshot);
+
+    const std::string& path() const { return path_; }
+    void set_compact_after(size_t dead_records) { compact_after_ = dead_records; }
+
+    static JournalSnapshot read(const std::string& path,
+                                size_t max_messages = std::numeric_limits<size_t>::max());
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    size_t unsynced_ = 0;
+    size_t dead_records_ = 0;
+    size_t compact_after_;
+    std::chrono::steady_clock::time_point last_sync_;
+
+    void open_for_append();
+    void append(const nlohmann::json& record);
+};
+
+} // namespace mag
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+namespace mag {
+
+// A single server-sent event
+struct SseEvent {
+    std::string event; // event type ("message" when the stream doesn't name one)
+    std::string data;  // data lines joined with '\n'
+    std::string id;
+};
+
+/**
+ * @brief Incremental parser for text/event-stream bodies
+ *
+ * Bytes are fed as they arrive from the network; complete events are
+ * delivered through the callback. Partial lines are buffered between calls.
+ */
+class SseParser {
+public:
+    using EventCallback = std::function<void(const SseEvent&)>;
+
+    explicit SseParser(EventCallback on_event);
+
+    void feed(const char* data, size_t length);
+    void feed(const std::string& data) { feed(data.data(), data.size()); }
+
+    // Flush a trailing event that wasn't terminated by a blank line
+    void finish();
+
+    size_t events_parsed() const { return events_parsed_; }
+
+private:
+    EventCallback on_event_;
+    std::string line_buffer_;
+    SseEvent current_;
+    bool has_data_ = false;
+    bool skip_lf_ = false;
+    size_t events_parsed_ = 0;
+
+    void process_line(const std::string& line);
+    void dispatch();
+};
+
+} // namespace mag
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "config.h"
+#include "llm_client.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief The tenants (people or teams) sharing one llm_adapter
+ *
+ * Requests name their tenant in a "tenant" field. Requests without one
+ * belong to the default tenant "", served as before by each worker's own
+ * clients. A named tenant gets an LLMClientPool of its own, shared by the
+ * workers and defaulting to the provider configured for it. Its requests
+ * wait in their own ThreadPool queue, and its weight sets its share of the
+ * workers while others are waiting too. The first max_tenants names are
+ * tracked; any beyond that are served together as
+ * TenantConfig::OVERFLOW_TENANT, which keeps the adapter's state bounded
+ * whatever clients send.
+ */
+class TenantRegistry {
+public:
+    explicit TenantRegistry(std::string default_provider = "", size_t max_tenants = TenantConfig::MAX_TENANTS);
+
+    // "alice=2,bob=1"; nullopt if an entry has no name or no value
+    static std::optional<std::map<std::string, std::string>> parse_assignments(std::string_view spec);
+
+    /**
+     * @brief Apply MAG_TENANT_WEIGHTS / MAG_TENANT_PROVIDERS style settings
+     * @throws std::invalid_argument on a malformed list or a non-positive weight
+     */
+    void configure(std::string_view weights, std::string_view providers);
+
+    const std::map<std::string, double>& weights() const { return weights_; }
+
+    // Name a request's tenant is tracked under (see resolve)
+    std::string tenant_of(std::string_view request);
+    // name itself while there is room for it, otherwise the overflow tenant
+    std::string resolve(const std::string& name);
+
+    // The tenant's own clients, created on first use; not for the default tenant
+    LLMClientPool& clients(const std::string& tenant);
+    std::string provider_for(const std::string& tenant) const;
+
+    // Shared by every tenant's clients, including ones created later
+    void set_response_cache(std::shared_ptr<ResponseCache> cache) { response_cache_ = std::move(cache); }
+    void set_recorder(std::shared_ptr<ResponseRecorder> recorder) { recorder_ = std::move(recorder); }
+
+    size_t size() const;
+
+private:
+    std::string default_provider_;
+    size_t max_tenants_;
+    std::map<std::string, double> weights_;
+    std::map<std::string, std::string> providers_;
+    std::shared_ptr<ResponseCache> response_cache_;
+    std::shared_ptr<ResponseRecorder> recorder_;
+
+    mutable std::mutex mutex_;
+    std::set<std::string, std::less<>> known_;
+    std::map<std::string, std::unique_ptr<LLMClientPool>> pools_;
+};
+
+} // namespace mag
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief Raised when a patch does not fit the text it is applied to
+ */
+class PatchError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Line diff of two texts, rendered as a unified diff
+ */
+struct TextDiff {
+    std::string unified;     // empty when the texts are equal
+    size_t lines_added = 0;
+    size_t lines_removed = 0;
+    
+    bool empty() const { return lines_added == 0 && lines_removed == 0; }
+};
+
+/**
+ * @brief Diff two texts line by line with Myers' O(ND) algorithm
+ *
+ * The common prefix and suffix are stripped first and lines are compared
+ * as interned ids, so a small edit to a large file costs little more than
+ * one pass over it. Past MAX_DIFF_EDITS edits the remaining middle is
+ * reported as replaced wholesale rather than searched for a minimal script.
+ *
+ * @param path Shown in the ---/+++ header lines
+ * @param context Unchanged lines kept around each change
+ */
+TextDiff diff_lines(std::string_view before, std::string_view after, const std::string& path,
+                    size_t context = 3);
+
+constexpr size_t MAX_DIFF_EDITS = 4000;
+
+/**
+ * @brief Apply a unified diff or a list of search/replace blocks
+ *
+ * Search/replace blocks look like
+ *
+ *     <<<<<<< SEARCH
+ *     old lines
+ *     =======
+ *     new lines
+ *     >>>>>>> REPLACE
+ *
+ * and each search text must appear exactly once (an empty one only in an
+ * empty file). Unified diff hunks are placed by their context rather than
+ * trusted line numbers, since model-written diffs often get those wrong;
+ * the nearest match to the stated position wins.
+ *
+ * @return The patched text
+ * @throws PatchError if the patch is malformed or a hunk or block does not match
+ */
+std::string apply_patch(std::string_view original, std::string_view patch);
+
+bool is_search_replace_patch(std::string_view patch);
+
+} // namespace mag
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <type_traits>
+
+namespace mag {
+
+/**
+ * @brief Fixed-size worker pool
+ *
+ * Tasks receive the index of the worker running them, so callers can keep
+ * per-worker state (e.g. one LLMClient per worker) without extra locking.
+ * A task runs in the trace of the thread that submitted it.
+ *
+ * Tasks can be queued under a key (a tenant, say). Each key's tasks run in
+ * the order they were submitted, and the keys share the workers by weighted
+ * fair queuing (start-time fair queuing): a task is tagged with the
+ * virtual time at which its key's previous tasks will have had their
+ * share, and the earliest tag runs next. A key that floods the pool only
+ * delays itself; a key with weight 2 gets twice the turns of one with
+ * weight 1 while both have work waiting. Idle keys earn no credit. Tasks
+ * submitted without a key all share the "" key, which is plain FIFO.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t worker_index)>;
+
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task) { submit(std::string(), std::move(task)); }
+    void submit(const std::string& key, Task task);
+
+    // Convenience wrapper returning a future for the task's result
+    template <typename F>
+    auto submit_with_result(F&& fn) -> std::future<std::invoke_result_t<F, size_t>> {
+        using Result = std::invoke_result_t<F, size_t>;
+        auto task = std::make_shared<std::packaged_task<Result(size_t)>>(std::forward<F>(fn));
+        std::future<Result> result = task->get_future();
+        submit([task](size_t worker_index) { (*task)(worker_index); });
+        return result;
+    }
+
+    // Finish queued work and join all workers; further submits are rejected
+    void shutdown();
+
+    // Relative share of the workers for key's tasks (default 1; must be positive)
+    void set_weight(const std::string& key, double weight);
+
+    size_t size() const { return workers_.size(); }
+    size_t queued() const;
+    size_t queued(const std::string& key) const;
+
+private:
+    struct Queued {
+        Task task;
+        double start_tag;
+        uint64_t order; // submission order, breaks ties between keys
+    };
+    struct KeyQueue {
+        std::deque<Queued> tasks;
+        double last_finish = 0; // finish tag of the key's newest task
+    };
+
+    std::vector<std::thread> workers_;
+    std::map<std::string, KeyQueue> queues_; // keys with work waiting or a recent finish tag
+    std::map<std::string, double> weights_;
+    size_t queued_ = 0;
+    double virtual_time_ = 0;
+    uint64_t next_order_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+    void worker_loop(size_t worker_index);
+    Task take_next(); // with mutex_ held and queued_ > 0
+};
+
+} // namespace mag
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "todo_manager.h"
+#include <chrono>
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+/**
+ * @brief Append-only JSONL journal of a TodoManager's state changes
+ *
+ * Each change is one line: "todo" records the full state of one item (an
+ * add or any update), "delete" removes one and "clear" removes them all.
+ * Like SessionJournal, lines are written with a single write() and
+ * fdatasync is batched, so a crash loses at most the last few records and
+ * a torn final line is skipped on read.
+ *
+ * Replaying forward gives the state in TodoManager::to_json() form. Once
+ * superseded records outnumber live todos, compact() rewrites the file with
+ * one record per todo, keeping the journal proportional to the list.
+ */
+class TodoJournal {
+public:
+    explicit TodoJournal(std::string path);
+    ~TodoJournal();
+
+    TodoJournal(const TodoJournal&) = delete;
+    TodoJournal& operator=(const TodoJournal&) = delete;
+
+    void append_todo(const TodoItem& item, bool replaces);
+    void append_delete(int id);
+    void append_clear(size_t dropped);
+
+    void sync();
+    bool needs_compaction(size_t live_todos) const;
+
+    // Replace the journal with exactly this state (temp file + fsync + rename)
+    void rewrite(const nlohmann::json& state);
+
+    const std::string& path() const { return path_; }
+
+    // The journaled state as {"next_id", "todos"}; empty when there is no file
+    static nlohmann::json read(const std::string& path);
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    size_t unsynced_ = 0;
+    size_t dead_records_ = 0;
+    std::chrono::steady_clock::time_point last_sync_;
+
+    void open_for_append();
+    void append(const nlohmann::json& record);
+};
+
+} // namespace mag
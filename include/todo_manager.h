@@ -4,6 +4,11 @@
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <array>
+#include <functional>
+#include <iterator>
+#include <set>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 
 namespace mag {
@@ -19,6 +24,7 @@ struct TodoItem {
     std::string title;
     std::string description;
     TodoStatus status;
+    std::vector<int> depends_on; // ids that must complete first; more are inferred when executing
     std::chrono::system_clock::time_point created_at;
     std::chrono::system_clock::time_point updated_at;
     
@@ -27,21 +33,86 @@ struct TodoItem {
     void from_json(const nlohmann::json& j);
 };
 
+class TodoJournal;
+
+/**
+ * @brief Read-only range over todos in id order, without copying them
+ *
+ * A view reads the manager's index directly, so it is only valid until the
+ * todos it covers are added, deleted or change status. Loops that change
+ * statuses as they go should take a copy first (list_todos and friends).
+ */
+class TodoView {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = TodoItem;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const TodoItem*;
+        using reference = const TodoItem&;
+        
+        iterator() = default;
+        iterator(std::set<int>::const_iterator id, const std::unordered_map<int, TodoItem>* items)
+            : id_(id), items_(items) {}
+        
+        reference operator*() const { return items_->find(*id_)->second; }
+        pointer operator->() const { return &**this; }
+        iterator& operator++() { ++id_; return *this; }
+        iterator operator++(int) { iterator previous = *this; ++id_; return previous; }
+        bool operator==(const iterator& other) const { return id_ == other.id_; }
+        bool operator!=(const iterator& other) const { return id_ != other.id_; }
+    
+    private:
+        std::set<int>::const_iterator id_;
+        const std::unordered_map<int, TodoItem>* items_ = nullptr;
+    };
+    
+    TodoView(const std::set<int>& ids, const std::unordered_map<int, TodoItem>& items) : ids_(&ids), items_(&items) {}
+    
+    iterator begin() const { return iterator(ids_->begin(), items_); }
+    iterator end() const { return iterator(ids_->end(), items_); }
+    size_t size() const { return ids_->size(); }
+    bool empty() const { return ids_->empty(); }
+    std::vector<TodoItem> to_vector() const { return std::vector<TodoItem>(begin(), end()); }
+
+private:
+    const std::set<int>* ids_;
+    const std::unordered_map<int, TodoItem>* items_;
+};
+
+/**
+ * @brief Todo list indexed by id, with one ordered id set per status
+ *
+ * Lookups and status changes cost O(1) or O(log n) however long the list
+ * is, and all()/with_status() walk the todos without copying them. Ids only
+ * grow, so id order is creation order and doubles as the execution order.
+ *
+ * With a journal attached, every change is appended to it as it happens,
+ * so the list survives a crash and attach_journal() resumes it by replay.
+ */
 class TodoManager {
 public:
     TodoManager();
+    ~TodoManager();
+    TodoManager(TodoManager&&) noexcept;
+    TodoManager& operator=(TodoManager&&) noexcept;
     
     // Core CRUD operations
-    int add_todo(const std::string& title, const std::string& description = "");
+    int add_todo(const std::string& title, const std::string& description = "",
+                 const std::vector<int>& depends_on = {});
     std::vector<TodoItem> list_todos(bool show_completed = false) const;
     bool update_todo(int id, const std::string* title = nullptr, 
                      const std::string* description = nullptr, 
                      const TodoStatus* status = nullptr);
+    bool set_dependencies(int id, const std::vector<int>& depends_on);
     bool delete_todo(int id);
     void clear_todos();
     
-    // Query operations
-    TodoItem* get_todo(int id);
+    // Query operations; change todos through the calls above so the index stays in step
+    const TodoItem* get_todo(int id) const;
+    TodoView all() const;
+    TodoView with_status(TodoStatus status) const;
     std::vector<TodoItem> get_pending_todos() const;
     std::vector<TodoItem> get_completed_todos() const;
     bool is_empty() const;
@@ -55,7 +126,7 @@ public:
     
     // Execution planning and control  
     std::vector<TodoItem> get_execution_queue() const; // pending todos in order
-    TodoItem* get_next_pending(); // Get next todo to execute (or nullptr)
+    const TodoItem* get_next_pending() const; // Get next todo to execute (or nullptr)
     std::vector<TodoItem> get_todos_until(int stop_id) const; // Get todos from start until (not including) stop_id
     std::vector<TodoItem> get_todos_range(int start_id, int end_id) const; // Get todos in range [start_id, end_id]
     
@@ -63,13 +134,23 @@ public:
     nlohmann::json to_json() const;
     void from_json(const nlohmann::json& j);
     
+    // Loads the journaled list (todos left in progress by a crash go back to
+    // pending) and journals every later change; throws if the file cannot be opened
+    void attach_journal(const std::string& path);
+
 private:
-    std::vector<TodoItem> todos_;
+    std::unordered_map<int, TodoItem> todos_;
+    std::set<int> ids_;                 // every todo, in id order
+    std::array<std::set<int>, 3> by_status_;
     int next_id_;
+    std::unique_ptr<TodoJournal> journal_;
     
     void update_timestamp(TodoItem& item);
-    std::vector<TodoItem>::iterator find_todo(int id);
-    std::vector<TodoItem>::const_iterator find_todo(int id) const;
+    TodoItem* find_todo(int id);
+    std::set<int>& bucket(TodoStatus status) { return by_status_[static_cast<size_t>(status)]; }
+    const std::set<int>& bucket(TodoStatus status) const { return by_status_[static_cast<size_t>(status)]; }
+    void insert(TodoItem item);
+    void journal_write(const std::function<void(TodoJournal&)>& write);
 };
 
 // Utility functions
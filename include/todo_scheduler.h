@@ -0,0 +1,76 @@
+#pragma once
+
+#include "todo_manager.h"
+#include <cstddef>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+// What one todo waits for before it may start
+struct TodoDependencies {
+    std::vector<size_t> after; // indices of todos in the same run
+    std::vector<int> unmet;    // ids of todos outside the run that have not completed
+};
+
+/**
+ * @brief Runs todos as a dependency graph, each one as soon as everything it depends on has completed
+ *
+ * Up to width todos run at once on worker threads, so a plan takes as long
+ * as its longest chain of dependent todos rather than the sum of all of
+ * them. Ready todos start in list order. A todo whose dependency failed is
+ * not run, nor is anything depending on it.
+ */
+class TodoScheduler {
+public:
+    enum class Outcome {
+        COMPLETED,
+        FAILED,
+        BLOCKED, // a dependency failed, was blocked, never completed or is part of a cycle
+        NOT_RUN  // execution was stopped before it started
+    };
+    
+    struct Result {
+        Outcome outcome = Outcome::NOT_RUN;
+        std::string error; // why it failed or was blocked
+    };
+    
+    using IsBash = std::function<bool(const TodoItem&)>;
+    
+    /**
+     * @brief Declared dependencies plus the ones the todos imply
+     *
+     * A bash todo comes after the previous bash todo, whose shell state
+     * (cd, export) it inherits, and after every file todo before it, which
+     * it may build or run. A file todo comes after the previous bash todo
+     * and after earlier file todos naming the same path or a directory of it.
+     *
+     * @param unfinished Ids of todos outside this run that exist and have not completed
+     */
+    static std::vector<TodoDependencies> plan(const std::vector<TodoItem>& todos, const IsBash& is_bash,
+                                              const std::set<int>& unfinished = {});
+    
+    explicit TodoScheduler(size_t width);
+    
+    /**
+     * @param run Executes one todo on a worker thread; throws to fail it
+     * @param on_start Called on the calling thread just before a todo is handed to a worker
+     * @param on_finish Called on the calling thread once per todo that completed, failed or was blocked
+     * @param should_stop Asked before each start; todos already running still finish
+     * @return One result per todo, in order
+     */
+    std::vector<Result> run(const std::vector<TodoItem>& todos, const std::vector<TodoDependencies>& dependencies,
+                            const std::function<void(const TodoItem&)>& run,
+                            const std::function<void(const TodoItem&)>& on_start,
+                            const std::function<void(const TodoItem&, const Result&)>& on_finish,
+                            const std::function<bool()>& should_stop) const;
+    
+    size_t width() const { return width_; }
+
+private:
+    size_t width_;
+};
+
+} // namespace mag
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mag {
+
+/**
+ * @brief Counts the tokens a provider will bill for a piece of text
+ */
+class TokenCounter {
+public:
+    virtual ~TokenCounter() = default;
+
+    virtual size_t count(std::string_view text) const = 0;
+
+    // Fixed cost of wrapping one message (role markers, separators)
+    virtual size_t message_overhead() const { return 4; }
+
+    size_t count_message(std::string_view content) const { return count(content) + message_overhead(); }
+};
+
+/**
+ * @brief Tokenizer-free estimate that follows how BPE vocabularies split text
+ *
+ * Text is pre-tokenized the way GPT/Claude-style tokenizers do it: a word
+ * (with its leading space) is usually one token and long words split every
+ * few letters, digits group in threes, each punctuation mark and each
+ * non-ASCII code point costs a token, and whitespace runs collapse. This
+ * tracks real counts far better than bytes/4 on code and non-English text.
+ */
+class HeuristicTokenCounter : public TokenCounter {
+public:
+    size_t count(std::string_view text) const override;
+
+    static std::shared_ptr<const HeuristicTokenCounter> shared();
+};
+
+/**
+ * @brief Scales a base counter by the ratio observed in provider usage reports
+ *
+ * Every response that reports its prompt token count feeds calibrate() with
+ * the base estimate for the same prompt (ProviderUsage::estimated_input_tokens,
+ * made by the llm_adapter that sent it). The ratio is smoothed so a single
+ * odd response cannot swing it far, and clamped to a sane range.
+ */
+class CalibratedTokenCounter : public TokenCounter {
+public:
+    explicit CalibratedTokenCounter(std::shared_ptr<const TokenCounter> base = HeuristicTokenCounter::shared());
+
+    size_t count(std::string_view text) const override;
+    size_t message_overhead() const override { return base_->message_overhead(); }
+
+    void calibrate(size_t estimated_tokens, size_t actual_tokens);
+    double ratio() const { return ratio_.load(std::memory_order_relaxed); }
+    size_t samples() const { return samples_.load(std::memory_order_relaxed); }
+    const TokenCounter& base() const { return *base_; }
+
+    static constexpr double SMOOTHING = 0.2;
+    static constexpr double MIN_RATIO = 0.25;
+    static constexpr double MAX_RATIO = 4.0;
+
+private:
+    std::shared_ptr<const TokenCounter> base_;
+    std::atomic<double> ratio_{1.0};
+    std::atomic<size_t> samples_{0};
+};
+
+} // namespace mag
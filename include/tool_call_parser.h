@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mag {
+
+// One tool call written into an LLM reply
+struct ToolCall {
+    enum class Kind {
+        ADD_TODO,         // add_todo("title", "description") or a <TODO_SEPARATOR> block
+        LIST_TODOS,       // list_todos()
+        MARK_COMPLETE,    // mark_complete(id)
+        DELETE_TODO,      // delete_todo(id)
+        EXECUTE_NEXT,     // execute_next()
+        EXECUTE_ALL,      // execute_all()
+        EXECUTE_TODO,     // execute_todo(id)
+        REQUEST_APPROVAL  // request_user_approval("reason")
+    };
+    
+    Kind kind = Kind::LIST_TODOS;
+    std::string title;           // ADD_TODO
+    std::string description;     // ADD_TODO
+    std::vector<int> depends_on; // ADD_TODO, from a block's "Depends on:" line
+    int id = 0;                  // MARK_COMPLETE, DELETE_TODO, EXECUTE_TODO
+    std::string reason;          // REQUEST_APPROVAL
+    std::string text;            // the call as written
+    
+    bool executes() const {
+        return kind == Kind::EXECUTE_NEXT || kind == Kind::EXECUTE_ALL || kind == Kind::EXECUTE_TODO;
+    }
+};
+
+/**
+ * @brief Incremental scanner for the tool calls an LLM writes into its reply
+ *
+ * The reply is fed as it arrives and scanned once. Text between calls and
+ * the calls themselves come out in the order they appear, so the caller
+ * can write each call's result in its place while building the output.
+ * Text that could still turn into a call (an unfinished "add_todo(" or
+ * "<TODO_SEPARATOR>" block) is held back until it is complete or ruled
+ * out; finish() passes whatever is left through as text.
+ *
+ * Quoted arguments end at the first quote that the rest of the call can
+ * follow, cannot span lines, and may use either quote character.
+ */
+class ToolCallParser {
+public:
+    using TextCallback = std::function<void(std::string_view text)>;
+    using CallCallback = std::function<void(const ToolCall& call)>;
+    
+    ToolCallParser(TextCallback on_text, CallCallback on_call);
+    
+    void feed(std::string_view chunk);
+    void finish();
+    
+    // Whole-reply convenience: the calls in order, with the text left out
+    static std::vector<ToolCall> parse(std::string_view reply);
+
+private:
+    enum class Scan { CALL, TEXT, NO_MATCH, NEED_MORE };
+    
+    TextCallback on_text_;
+    CallCallback on_call_;
+    std::string buffer_;
+    size_t scanned_ = 0; // buffer_ before this has been passed on
+    bool finishing_ = false;
+    
+    void scan();
+    
+    // What starts at at; length is how much of buffer_ the call or text covers
+    Scan scan_at(size_t at, size_t& length, ToolCall& call) const;
+    Scan scan_arguments(ToolCall::Kind kind, size_t open, size_t& end, ToolCall& call) const;
+    Scan scan_block(size_t at, size_t& length, ToolCall& call) const;
+};
+
+} // namespace mag
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief Identifies a span within a trace (W3C trace context ids)
+ *
+ * The trace id is 128 bits, the span id 64; all zero means "no trace".
+ * Every thread has a current context: the innermost open Span, or a
+ * parent installed by a TraceScope.
+ */
+struct TraceContext {
+    uint64_t trace_high = 0;
+    uint64_t trace_low = 0;
+    uint64_t span_id = 0;
+
+    // Prefix on an NNG request body: 0x00 'T', trace id and span id, big-endian
+    static constexpr size_t HEADER_SIZE = 2 + 16 + 8;
+
+    bool valid() const { return trace_high != 0 || trace_low != 0; }
+
+    std::string trace_id_hex() const;
+    std::string span_id_hex() const;
+
+    // "00-<trace id>-<span id>-01"
+    std::string traceparent() const;
+    static std::optional<TraceContext> parse_traceparent(std::string_view value);
+
+    void write_header(char (&out)[HEADER_SIZE]) const;
+
+    // Reads and removes the header from the front of body, if one is there
+    static std::optional<TraceContext> strip_header(std::string_view& body);
+
+    static TraceContext current();
+};
+
+/**
+ * @brief A finished span, as handed to the exporters
+ */
+struct SpanRecord {
+    TraceContext context;
+    uint64_t parent_span_id = 0;
+    std::string name;
+    int64_t start_unix_us = 0;
+    int64_t duration_us = 0;
+    uint64_t thread_id = 0;
+    bool error = false;
+    std::vector<std::pair<std::string, std::string>> attributes;
+};
+
+/**
+ * @brief Destination for finished spans; called from the Tracer's flush thread
+ */
+class SpanExporter {
+public:
+    virtual ~SpanExporter() = default;
+    virtual void export_spans(const std::vector<SpanRecord>& spans, const std::string& service) = 0;
+};
+
+/**
+ * @brief Appends spans to a Chrome trace file (chrome://tracing, Perfetto)
+ *
+ * The file uses the trace event JSON array format without its closing
+ * bracket, which the viewers accept. That lets every MAG process append
+ * its complete ("X") events to the same file, one write per batch, and
+ * the services of a run show up side by side as separate processes.
+ */
+class ChromeTraceExporter : public SpanExporter {
+public:
+    explicit ChromeTraceExporter(std::string path);
+    void export_spans(const std::vector<SpanRecord>& spans, const std::string& service) override;
+
+private:
+    std::string path_;
+    bool named_process_ = false;
+};
+
+/**
+ * @brief Posts spans to an OpenTelemetry collector as OTLP/HTTP JSON
+ */
+class OtlpExporter : public SpanExporter {
+public:
+    explicit OtlpExporter(std::string endpoint); // e.g. http://localhost:4318/v1/traces
+    void export_spans(const std::vector<SpanRecord>& spans, const std::string& service) override;
+
+    // The ExportTraceServiceRequest body for spans
+    static std::string to_json(const std::vector<SpanRecord>& spans, const std::string& service);
+
+private:
+    std::string endpoint_;
+};
+
+/**
+ * @brief Process-wide span collection
+ *
+ * Off unless MAG_TRACE names exporters (see TraceConfig). Finished spans are
+ * buffered and handed to the exporters by a background thread every
+ * FLUSH_INTERVAL_MS, or sooner once BATCH_SIZE are waiting, so recording
+ * a span never waits on disk or network. The buffer is flushed when the
+ * process exits. When tracing is off, a Span costs one relaxed load.
+ */
+class Tracer {
+public:
+    static constexpr size_t BATCH_SIZE = 512;
+    static constexpr size_t MAX_BUFFERED = 65536; // older spans are dropped beyond this
+    static constexpr int FLUSH_INTERVAL_MS = 1000;
+
+    static Tracer& instance();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Name this process's spans are reported under ("orchestrator", "file_tool", ...)
+    void set_service_name(std::string service);
+    std::string service_name() const;
+
+    // Turns tracing on; exporters from MAG_TRACE are added at start-up
+    void add_exporter(std::unique_ptr<SpanExporter> exporter);
+
+    void record(SpanRecord span);
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(); }
+
+    // A fresh random span id (never zero)
+    static uint64_t new_span_id();
+    // Microseconds since the Unix epoch, comparable across processes
+    static int64_t now_unix_us();
+    static uint64_t current_thread_id();
+
+private:
+    Tracer();
+
+    static std::atomic<bool> enabled_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string service_ = "mag";
+    std::vector<std::unique_ptr<SpanExporter>> exporters_;
+    std::vector<SpanRecord> buffer_;
+    std::mutex export_mutex_; // one batch at a time reaches the exporters
+    std::atomic<uint64_t> dropped_{0};
+    bool stopping_ = false;
+    std::thread flusher_;
+
+    void flush_loop();
+    void export_batch(std::vector<SpanRecord> batch);
+};
+
+/**
+ * @brief One timed operation; becomes the thread's current span while open
+ *
+ * A span is a child of the thread's current context. Without one it is
+ * inactive, unless it is a root span, which starts a new trace. Inactive
+ * spans (and every span while tracing is off) record nothing.
+ */
+class Span {
+public:
+    enum class Kind { CHILD, ROOT };
+
+    explicit Span(std::string_view name, Kind kind = Kind::CHILD);
+    ~Span();
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    bool active() const { return active_; }
+    const TraceContext& context() const { return record_.context; }
+
+    void set_name(std::string name);
+    void set_attribute(std::string key, std::string value);
+    void set_error(const std::string& message = "");
+
+private:
+    bool active_ = false;
+    SpanRecord record_;
+    TraceContext previous_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+/**
+ * @brief Makes context the thread's current one for a scope
+ *
+ * Used where work crosses a boundary: a request arriving from another
+ * process, or a task handed to another thread.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const TraceContext& context);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceContext previous_;
+};
+
+} // namespace mag
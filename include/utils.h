@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <cstdint>
 
 namespace mag {
 
@@ -11,6 +13,10 @@ public:
     static bool file_exists(const std::string& path);
     static size_t get_file_size(const std::string& content);
     static bool create_directories(const std::string& path);
+    
+    // Fast non-cryptographic content hash (XXH64)
+    static uint64_t hash64(std::string_view data, uint64_t seed = 0);
+    static std::string hash_to_hex(uint64_t hash);
 };
 
 } // namespace mag
\ No newline at end of file
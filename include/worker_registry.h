@@ -0,0 +1,44 @@
+#pragma once
+
+#include "endpoint_config.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mag {
+
+/**
+ * @brief A service worker's entry in the worker registry directory
+ *
+ * A worker that listens on a non-default URL announces it by writing
+ * <registry>/<service>/<pid>.url; the entry is removed again when the
+ * registration is destroyed. discover() skips (and deletes) entries whose
+ * process is gone, so a worker that crashed drops out on the next scan.
+ * The pid check assumes workers and clients share a host; remote workers
+ * belong in the static "endpoints" list instead.
+ */
+class WorkerRegistration {
+public:
+    /**
+     * @throws std::runtime_error if the entry cannot be written
+     */
+    WorkerRegistration(const std::string& directory, const std::string& service, const std::string& url);
+    ~WorkerRegistration();
+    
+    WorkerRegistration(const WorkerRegistration&) = delete;
+    WorkerRegistration& operator=(const WorkerRegistration&) = delete;
+    
+    const std::string& path() const { return path_; }
+    
+    // URLs of the live workers for service, sorted
+    static std::vector<std::string> discover(const std::string& directory, const std::string& service);
+    
+    // Registration in the configured registry; null when MAG_WORKER_REGISTRY
+    // is unset or the entry could not be written (logged)
+    static std::unique_ptr<WorkerRegistration> announce(EndpointConfig::Service service, const std::string& url);
+    
+private:
+    std::string path_;
+};
+
+} // namespace mag
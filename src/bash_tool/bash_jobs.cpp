@@ -0,0 +1,247 @@
+#include "bash_jobs.h"
+#include "config.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace mag {
+
+std::string job_state_to_string(BashJobState state) {
+    switch (state) {
+        case BashJobState::QUEUED: return "queued";
+        case BashJobState::RUNNING: return "running";
+        case BashJobState::DONE: return "done";
+    }
+    return "unknown";
+}
+
+BashJobQueue::BashJobQueue(size_t workers) {
+    workers = std::max<size_t>(1, workers);
+    workers_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+BashJobQueue::~BashJobQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& [job_id, job] : jobs_) {
+            job->cancel.cancel();
+        }
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::string BashJobQueue::submit(const std::string& session, const std::string& command, Runner run, bool stream) {
+    std::string job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reap_expired();
+        auto job = std::make_shared<Job>();
+        job->sequence = ++next_id_;
+        job->session = session;
+        job->command = command;
+        job->run = std::move(run);
+        job->stream = stream;
+        job_id = "job-" + std::to_string(job->sequence);
+        jobs_[job_id] = job;
+        queued_.push_back(job_id);
+    }
+    work_cv_.notify_all();
+    return job_id;
+}
+
+std::optional<BashJobStatus> BashJobQueue::status(const std::string& job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) {
+        return std::nullopt;
+    }
+    return snapshot(job_id, *job);
+}
+
+std::optional<BashJobStatus> BashJobQueue::wait(const std::string& job_id, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) {
+        return std::nullopt;
+    }
+    done_cv_.wait_for(lock, timeout, [&job] { return job->state == BashJobState::DONE; });
+    job->last_activity = std::chrono::steady_clock::now();
+    return snapshot(job_id, *job);
+}
+
+std::optional<BashJobStatus> BashJobQueue::take_output(const std::string& job_id, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) {
+        return std::nullopt;
+    }
+    done_cv_.wait_for(lock, timeout, [&job] {
+        return !job->stdout_pending.empty() || !job->stderr_pending.empty() || job->state == BashJobState::DONE;
+    });
+    job->last_activity = std::chrono::steady_clock::now();
+    
+    BashJobStatus status = snapshot(job_id, *job);
+    status.stdout_delta = std::move(job->stdout_pending);
+    status.stderr_delta = std::move(job->stderr_pending);
+    job->stdout_pending.clear();
+    job->stderr_pending.clear();
+    if (job->state == BashJobState::DONE) {
+        jobs_.erase(job_id);
+    }
+    return status;
+}
+
+bool BashJobQueue::cancel(const std::string& job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) {
+        return false;
+    }
+    job->cancel.cancel();
+    if (job->state == BashJobState::QUEUED) {
+        queued_.erase(std::find(queued_.begin(), queued_.end(), job_id));
+        CommandResult result;
+        result.command = job->command;
+        result.success = false;
+        result.cancelled = true;
+        result.stderr_output = "[Command was cancelled before it started]\n";
+        if (job->stream) {
+            job->stderr_pending += result.stderr_output;
+        }
+        finish(*job, std::move(result));
+        work_cv_.notify_all(); // a later job of the session may run now
+    }
+    return true;
+}
+
+std::vector<BashJobStatus> BashJobQueue::list() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reap_expired();
+    std::vector<std::pair<uint64_t, BashJobStatus>> ordered;
+    for (const auto& [job_id, job] : jobs_) {
+        BashJobStatus status;
+        status.job_id = job_id;
+        status.session = job->session;
+        status.command = job->command;
+        status.state = job->state;
+        ordered.emplace_back(job->sequence, std::move(status));
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    std::vector<BashJobStatus> statuses;
+    statuses.reserve(ordered.size());
+    for (auto& entry : ordered) {
+        statuses.push_back(std::move(entry.second));
+    }
+    return statuses;
+}
+
+std::shared_ptr<BashJobQueue::Job> BashJobQueue::find(const std::string& job_id) {
+    auto it = jobs_.find(job_id);
+    return it == jobs_.end() ? nullptr : it->second;
+}
+
+BashJobStatus BashJobQueue::snapshot(const std::string& job_id, const Job& job) const {
+    BashJobStatus status;
+    status.job_id = job_id;
+    status.session = job.session;
+    status.command = job.command;
+    status.state = job.state;
+    if (job.state == BashJobState::DONE) {
+        status.result = job.result;
+    }
+    return status;
+}
+
+std::shared_ptr<BashJobQueue::Job> BashJobQueue::next_runnable(std::string& job_id) {
+    // The first queued job of each session is the only one that may start
+    std::set<std::string> passed;
+    for (auto it = queued_.begin(); it != queued_.end(); ++it) {
+        std::shared_ptr<Job> job = jobs_.at(*it);
+        if (busy_sessions_.count(job->session) == 0 && passed.count(job->session) == 0) {
+            job_id = *it;
+            queued_.erase(it);
+            return job;
+        }
+        passed.insert(job->session);
+    }
+    return nullptr;
+}
+
+void BashJobQueue::finish(Job& job, CommandResult result) {
+    job.result = std::move(result);
+    job.state = BashJobState::DONE;
+    job.run = nullptr;
+    job.last_activity = std::chrono::steady_clock::now();
+    done_cv_.notify_all();
+}
+
+void BashJobQueue::reap_expired() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = jobs_.begin(); it != jobs_.end();) {
+        Job& job = *it->second;
+        auto idle = std::chrono::duration_cast<std::chrono::seconds>(now - job.last_activity);
+        if (idle.count() <= NetworkConfig::STREAM_IDLE_EXPIRY_SECONDS || job.state == BashJobState::QUEUED) {
+            ++it; // a queued job is waiting on us, not on its client
+        } else if (job.state == BashJobState::DONE) {
+            it = jobs_.erase(it);
+        } else {
+            job.cancel.cancel(); // dropped once it has stopped and expired again
+            ++it;
+        }
+    }
+}
+
+void BashJobQueue::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        std::string job_id;
+        std::shared_ptr<Job> job;
+        work_cv_.wait(lock, [&] { return stopping_ || (job = next_runnable(job_id)) != nullptr; });
+        if (!job) {
+            return;
+        }
+        
+        job->state = BashJobState::RUNNING;
+        busy_sessions_.insert(job->session);
+        Runner run = std::move(job->run);
+        lock.unlock();
+        
+        CommandResult result;
+        try {
+            result = run([this, &job](bool is_stderr, std::string_view chunk) {
+                if (!job->stream) {
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> output_lock(mutex_);
+                    (is_stderr ? job->stderr_pending : job->stdout_pending).append(chunk);
+                }
+                done_cv_.notify_all();
+            }, job->cancel);
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("bash_tool", "Job " << job_id << " failed: " << e.what());
+            result.command = job->command;
+            result.success = false;
+            result.exit_code = -1;
+            result.stderr_output = "Command execution error: " + std::string(e.what());
+            if (job->stream) {
+                std::lock_guard<std::mutex> output_lock(mutex_);
+                job->stderr_pending += result.stderr_output;
+            }
+        }
+        
+        lock.lock();
+        busy_sessions_.erase(job->session);
+        finish(*job, std::move(result));
+        work_cv_.notify_all(); // the session's next job, if any
+    }
+}
+
+} // namespace mag
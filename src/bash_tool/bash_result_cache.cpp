@@ -0,0 +1,339 @@
+#include "bash_result_cache.h"
+#include "config.h"
+#include "content_hash_cache.h"
+#include "utils.h"
+#include <algorithm>
+#include <filesystem>
+#include <sys/stat.h>
+
+namespace mag {
+
+namespace {
+
+// Programs that only read, and for git the subcommands that only read
+const std::set<std::string> READ_ONLY_PROGRAMS = {
+    "cat", "cmp", "diff", "du", "egrep", "fgrep", "file", "find", "git", "grep",
+    "head", "ls", "pwd", "sort", "stat", "tail", "tree", "uniq", "wc"
+};
+const std::set<std::string> READ_ONLY_GIT = {
+    "blame", "diff", "grep", "log", "ls-files", "rev-parse", "show", "status"
+};
+const std::set<std::string> FIND_ACTIONS_THAT_WRITE = {
+    "-delete", "-exec", "-execdir", "-fls", "-fprint", "-fprint0", "-fprintf", "-ok", "-okdir"
+};
+
+struct Word {
+    std::string text;
+    bool glob = false; // an unquoted *, ? or [
+};
+using Stage = std::vector<Word>;
+
+/**
+ * Splits a pipeline into its commands and their words, honouring quotes.
+ * Anything the shell would expand or redirect makes it nullopt.
+ */
+std::optional<std::vector<Stage>> parse_pipeline(const std::string& command) {
+    std::vector<Stage> stages(1);
+    std::optional<Word> word;
+    char quote = 0;
+    for (char c : command) {
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            } else if (quote == '"' && (c == '$' || c == '`' || c == '\\')) {
+                return std::nullopt;
+            } else {
+                word->text += c;
+            }
+            continue;
+        }
+        switch (c) {
+            case '\'':
+            case '"':
+                quote = c;
+                if (!word) {
+                    word = Word{};
+                }
+                break;
+            case ' ':
+            case '\t':
+            case '|':
+                if (word) {
+                    stages.back().push_back(std::move(*word));
+                    word.reset();
+                }
+                if (c == '|') {
+                    if (stages.back().empty()) {
+                        return std::nullopt; // || or a leading pipe
+                    }
+                    stages.emplace_back();
+                }
+                break;
+            case '>': case '<': case ';': case '&': case '(': case ')': case '`': case '$': case '\\':
+            case '\n': case '{': case '}': case '~': case '!': case '#':
+                return std::nullopt;
+            default:
+                if (!word) {
+                    word = Word{};
+                }
+                word->glob = word->glob || c == '*' || c == '?' || c == '[';
+                word->text += c;
+        }
+    }
+    if (quote) {
+        return std::nullopt;
+    }
+    if (word) {
+        stages.back().push_back(std::move(*word));
+    }
+    if (stages.back().empty()) {
+        return std::nullopt;
+    }
+    return stages;
+}
+
+bool has_short_option(const Stage& stage, char option) {
+    return std::any_of(stage.begin() + 1, stage.end(), [option](const Word& word) {
+        return word.text.size() > 1 && word.text[0] == '-' && word.text[1] != '-' &&
+               word.text.find(option) != std::string::npos;
+    });
+}
+
+bool has_word_starting(const Stage& stage, const std::string& prefix) {
+    return std::any_of(stage.begin() + 1, stage.end(),
+                       [&prefix](const Word& word) { return word.text.rfind(prefix, 0) == 0; });
+}
+
+// The words of a stage that may name files, past the program (and git's subcommand)
+std::vector<const Word*> operands(const Stage& stage) {
+    std::vector<const Word*> words;
+    for (size_t i = stage[0].text == "git" ? 2 : 1; i < stage.size(); ++i) {
+        if (!stage[i].text.empty() && stage[i].text[0] != '-') {
+            words.push_back(&stage[i]);
+        }
+    }
+    return words;
+}
+
+bool writes_anything(const Stage& stage) {
+    const std::string& program = stage[0].text;
+    if (program == "find") {
+        return std::any_of(stage.begin() + 1, stage.end(),
+                           [](const Word& word) { return FIND_ACTIONS_THAT_WRITE.count(word.text) > 0; });
+    }
+    if (program == "sort") {
+        return has_short_option(stage, 'o') || has_word_starting(stage, "--output");
+    }
+    if (program == "tree") {
+        return has_short_option(stage, 'o') || has_word_starting(stage, "--output");
+    }
+    if (program == "file") { // -C compiles the magic file into magic.mgc
+        return has_short_option(stage, 'C') || has_word_starting(stage, "--compile");
+    }
+    if (program == "uniq") {
+        return operands(stage).size() > 1; // uniq IN OUT
+    }
+    if (program == "tail") { // following never ends rather than writing, but is no more cacheable
+        return has_short_option(stage, 'f') || has_short_option(stage, 'F') || has_word_starting(stage, "--follow");
+    }
+    if (program == "git") {
+        return stage.size() < 2 || READ_ONLY_GIT.count(stage[1].text) == 0 || has_word_starting(stage, "--output") ||
+               has_word_starting(stage, "--ext-diff");
+    }
+    return false;
+}
+
+std::string resolve(const std::string& working_directory, const std::string& path) {
+    std::filesystem::path resolved(path);
+    if (resolved.is_relative()) {
+        resolved = std::filesystem::path(working_directory) / resolved;
+    }
+    return resolved.lexically_normal().string();
+}
+
+// The directory holding .git at or above directory, else directory itself
+std::string work_tree_of(const std::string& directory) {
+    std::error_code ec;
+    for (std::filesystem::path dir(directory); !dir.empty(); dir = dir.parent_path()) {
+        if (std::filesystem::exists(dir / ".git", ec)) {
+            return dir.string();
+        }
+        if (dir == dir.parent_path()) {
+            break;
+        }
+    }
+    return directory;
+}
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+BashResultCache::BashResultCache(const std::vector<std::string>& allowed_commands, size_t capacity,
+                                 std::chrono::seconds ttl, size_t max_entries)
+    : capacity_(std::max<size_t>(1, capacity)), ttl_(ttl), max_entries_(max_entries) {
+    for (const std::string& program : READ_ONLY_PROGRAMS) {
+        if (allowed_commands.empty() ||
+            std::find(allowed_commands.begin(), allowed_commands.end(), program) != allowed_commands.end()) {
+            programs_.insert(program);
+        }
+    }
+}
+
+bool BashResultCache::is_cacheable(const std::string& command) const {
+    auto stages = parse_pipeline(command);
+    if (!stages) {
+        return false;
+    }
+    return std::all_of(stages->begin(), stages->end(), [this](const Stage& stage) {
+        return programs_.count(stage[0].text) > 0 && !stage[0].glob && !writes_anything(stage);
+    });
+}
+
+std::optional<uint64_t> BashResultCache::fingerprint(const std::string& command,
+                                                     const std::string& working_directory) const {
+    if (!is_cacheable(command)) {
+        return std::nullopt;
+    }
+    
+    std::vector<Stage> stages = *parse_pipeline(command);
+    std::set<std::string> roots;
+    for (const Stage& stage : stages) {
+        if (stage[0].text == "git") {
+            roots.insert(work_tree_of(resolve(working_directory, ".")));
+            continue;
+        }
+        bool named_existing = false;
+        for (const Word* word : operands(stage)) {
+            std::string path = resolve(working_directory, word->text);
+            if (word->glob) {
+                path = std::filesystem::path(path).parent_path().string(); // what the glob can match
+            }
+            std::error_code ec;
+            named_existing = named_existing || std::filesystem::exists(path, ec);
+            roots.insert(path); // missing ones too, in case they appear
+        }
+        if (!named_existing) {
+            roots.insert(resolve(working_directory, "."));
+        }
+    }
+    
+    // Order-independent sum of one hash per path, so directory listing order does not matter
+    uint64_t sum = Utils::hash64(working_directory);
+    size_t count = 0;
+    int64_t racy_after = now_ns() - std::chrono::nanoseconds(ContentHashCache::RACY_WINDOW).count();
+    auto add = [&](const std::string& path) {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0) {
+            sum += Utils::hash64("missing\n" + path);
+            return true;
+        }
+        int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        if (mtime_ns > racy_after || ++count > max_entries_) {
+            return false;
+        }
+        uint64_t fields[] = {static_cast<uint64_t>(st.st_mode), static_cast<uint64_t>(st.st_size),
+                             static_cast<uint64_t>(mtime_ns), static_cast<uint64_t>(st.st_ino),
+                             static_cast<uint64_t>(st.st_dev)};
+        sum += Utils::hash64(std::string_view(reinterpret_cast<const char*>(fields), sizeof(fields)),
+                             Utils::hash64(path));
+        return true;
+    };
+    
+    for (const std::string& root : roots) {
+        if (!add(root)) {
+            return std::nullopt;
+        }
+        std::error_code ec;
+        if (!std::filesystem::is_directory(std::filesystem::symlink_status(root, ec))) {
+            continue;
+        }
+        std::filesystem::recursive_directory_iterator it(
+            root, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            const std::filesystem::path& path = it->path();
+            if (!add(path.string())) {
+                return std::nullopt;
+            }
+            // Git objects are never rewritten; refs and the index say what changed
+            if (path.filename() == "objects" && path.parent_path().filename() == ".git") {
+                it.disable_recursion_pending();
+            }
+        }
+        if (ec) {
+            return std::nullopt;
+        }
+    }
+    return sum;
+}
+
+std::optional<CommandResult> BashResultCache::lookup(const std::string& command, const std::string& working_directory,
+                                                     uint64_t fingerprint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key_for(command, working_directory));
+    if (it == index_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    const Entry& entry = it->second->second;
+    if (entry.fingerprint != fingerprint || std::chrono::steady_clock::now() - entry.stored_at > ttl_) {
+        lru_.erase(it->second);
+        index_.erase(it);
+        ++misses_;
+        return std::nullopt;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    ++hits_;
+    return entry.result;
+}
+
+void BashResultCache::store(const std::string& command, const std::string& working_directory, uint64_t fingerprint,
+                            const CommandResult& result) {
+    if (result.timed_out || result.cancelled || result.exit_code < 0 || result.exit_code > 128 ||
+        !result.stdout_log.empty() || !result.stderr_log.empty() ||
+        result.stdout_output.size() + result.stderr_output.size() > BashToolConfig::RESULT_CACHE_MAX_OUTPUT_BYTES) {
+        return;
+    }
+    // Something changed the tree while the command ran; its output may reflect either state
+    if (this->fingerprint(command, working_directory) != fingerprint) {
+        return;
+    }
+    
+    std::string key = key_for(command, working_directory);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.emplace_front(key, Entry{fingerprint, result, std::chrono::steady_clock::now()});
+    index_[key] = lru_.begin();
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+size_t BashResultCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+uint64_t BashResultCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t BashResultCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+std::string BashResultCache::key_for(const std::string& command, const std::string& working_directory) {
+    return working_directory + '\0' + command;
+}
+
+} // namespace mag
@@ -1,14 +1,128 @@
 #include "bash_tool.h"
+#include "bash_jobs.h"
+#include "bash_result_cache.h"
 #include "message.h"
 #include "config.h"
-#include <nng/nng.h>
-#include <nng/protocol/reqrep0/rep.h>
+#include "policy_config.h"
+#include "worker_registry.h"
+#include "logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "network/nng_message.h"
+#include "network/nng_rep_server.h"
+#include "thread_pool.h"
+#include "tracing.h"
 #include <iostream>
-#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <nlohmann/json.hpp>
 
 using namespace mag;
 
+namespace {
+
+Counter& cpu_micros(const std::string& mode) {
+    return MetricsRegistry::instance().counter("mag_bash_cpu_microseconds_total", {{"mode", mode}},
+                                               "CPU time used by bash commands");
+}
+
+Counter& blocks(const std::string& direction) {
+    return MetricsRegistry::instance().counter("mag_bash_io_blocks_total", {{"direction", direction}},
+                                               "Filesystem block operations of bash commands");
+}
+
+Gauge& peak_rss_kb() {
+    static Gauge& gauge = MetricsRegistry::instance().gauge(
+        "mag_bash_peak_rss_kb", {}, "Largest resident set of any bash command so far");
+    return gauge;
+}
+
+LatencyHistogram& command_cpu() {
+    static LatencyHistogram& histogram = MetricsRegistry::instance().histogram(
+        "mag_bash_command_cpu_seconds", {}, "User plus system CPU time per bash command");
+    return histogram;
+}
+
+Counter& cache_lookups(const std::string& result) {
+    return MetricsRegistry::instance().counter("mag_bash_result_cache_total", {{"result", result}},
+                                               "Read-only commands answered from the result cache, or run");
+}
+
+// The programs the policy lets bash_tool run
+std::vector<std::string> policy_allowed_commands() {
+    std::unique_ptr<PolicySettings> settings = PolicyConfig::load_or_default();
+    auto it = settings->tools.find("bash_tool");
+    return it == settings->tools.end() ? std::vector<std::string>{} : it->second.create.allowed_commands;
+}
+
+void record_usage(const ResourceUsage& usage) {
+    cpu_micros("user").add(static_cast<uint64_t>(usage.user_cpu.count()));
+    cpu_micros("system").add(static_cast<uint64_t>(usage.system_cpu.count()));
+    blocks("read").add(usage.blocks_read);
+    blocks("write").add(usage.blocks_written);
+    command_cpu().record(usage.user_cpu + usage.system_cpu);
+    
+    Gauge& peak = peak_rss_kb();
+    int64_t rss = static_cast<int64_t>(usage.max_rss_kb);
+    for (int64_t seen = peak.value(); rss > seen; seen = peak.value()) {
+        peak.set(rss); // a lost race only costs a momentarily lower peak
+    }
+}
+
+// The execute reply; streamed jobs leave the output out of their final reply
+nlohmann::json command_reply(const CommandResult& result, WireFormat format, bool with_output) {
+    nlohmann::json response;
+    response["success"] = result.success;
+    response["exit_code"] = result.exit_code;
+    response["timed_out"] = result.timed_out;
+    response["cancelled"] = result.cancelled;
+    response["cached"] = result.cached;
+    if (with_output) {
+        // Output travels as raw bytes in binary formats
+        WireCodec::set_bytes(response, "stdout_output", result.stdout_output, format);
+        WireCodec::set_bytes(response, "stderr_output", result.stderr_output, format);
+    }
+    response["stdout_bytes"] = result.stdout_bytes;
+    response["stderr_bytes"] = result.stderr_bytes;
+    if (!result.stdout_log.empty()) {
+        response["stdout_log"] = result.stdout_log;
+    }
+    if (!result.stderr_log.empty()) {
+        response["stderr_log"] = result.stderr_log;
+    }
+    response["working_directory_before"] = result.working_directory;
+    response["working_directory_after"] = result.pwd_after_execution;
+    response["execution_duration_ms"] = result.execution_duration.count();
+    response["usage"] = {{"user_cpu_us", result.usage.user_cpu.count()},
+                         {"system_cpu_us", result.usage.system_cpu.count()},
+                         {"max_rss_kb", result.usage.max_rss_kb},
+                         {"blocks_read", result.usage.blocks_read},
+                         {"blocks_written", result.usage.blocks_written}};
+    return response;
+}
+
+// A job's state, plus its result once it is done
+nlohmann::json job_reply(const BashJobStatus& status, WireFormat format, bool with_output) {
+    bool done = status.state == BashJobState::DONE;
+    nlohmann::json reply = done ? command_reply(status.result, format, with_output) : nlohmann::json::object();
+    reply["job_id"] = status.job_id;
+    reply["session"] = status.session;
+    reply["state"] = job_state_to_string(status.state);
+    reply["done"] = done;
+    return reply;
+}
+
+nlohmann::json unknown_job(const std::string& job_id) {
+    return {{"job_id", job_id}, {"done", true}, {"success", false}, {"error_message", "Unknown job: " + job_id}};
+}
+
+} // anonymous namespace
+
 /**
  * @brief Bash Tool Service - Handles bash command execution with persistent state
  * 
@@ -17,174 +131,298 @@ using namespace mag;
  */
 class BashToolService {
 public:
-    BashToolService() : bash_tool_() {
+    BashToolService() : bash_tool_(), metrics_("bash_tool"), jobs_(BashToolConfig::get_job_workers()) {
+        if (BashToolConfig::sessions_enabled()) {
+            bash_tool_.set_sessions(std::make_shared<ShellSessions>(
+                BashToolConfig::MAX_SESSIONS, std::chrono::seconds(BashToolConfig::SESSION_IDLE_SECONDS),
+                bash_tool_.limits()));
+        }
+        if (BashToolConfig::result_cache_enabled()) {
+            result_cache_ = std::make_unique<BashResultCache>(
+                policy_allowed_commands(), BashToolConfig::RESULT_CACHE_ENTRIES,
+                std::chrono::seconds(BashToolConfig::RESULT_CACHE_TTL_SECONDS), BashToolConfig::RESULT_CACHE_MAX_FILES);
+        }
         // Initialize with current working directory
         current_working_directory_ = bash_tool_.get_current_directory();
         std::cout << "Bash Tool Service initialized with working directory: " 
                   << current_working_directory_ << std::endl;
     }
     
-    std::string handle_request(const std::string& request_data) {
+    NngMessage handle_request(std::string_view request_data) {
+        ServiceMetrics::RequestScope scope(metrics_, request_data.size());
+        NngMessage reply = dispatch(request_data, scope);
+        scope.add_reply_bytes(reply.size());
+        return reply;
+    }
+    
+private:
+    BashTool bash_tool_;
+    std::unique_ptr<BashResultCache> result_cache_; // null unless MAG_BASH_RESULT_CACHE=1
+    std::mutex directory_mutex_; // requests and jobs run on their own threads
+    std::string current_working_directory_;
+    ServiceMetrics metrics_;
+    BashJobQueue jobs_;
+    
+    NngMessage dispatch(std::string_view request_data, ServiceMetrics::RequestScope& scope) {
+        // Reply in whatever encoding the request arrived in
+        WireFormat format = WireCodec::detect(request_data);
         try {
-            nlohmann::json request_json = nlohmann::json::parse(request_data);
+            nlohmann::json request_json;
+            {
+                Span parse("parse");
+                request_json = WireCodec::decode(request_data);
+            }
             
             std::string operation = request_json["operation"];
+            scope.set_operation(operation);
             
             if (operation == "execute") {
-                return handle_execute_command(request_json);
+                nlohmann::json response = handle_execute_command(request_json, format);
+                if (response.contains("error_message")) {
+                    scope.fail(); // the tool failed, not just the command
+                }
+                return NngMessage::encode(response, format);
+            } else if (operation == "execute_start" || operation == "submit") {
+                return NngMessage::encode(handle_submit(request_json, operation == "execute_start"), format);
+            } else if (operation == "execute_next" || operation == "status" || operation == "wait") {
+                nlohmann::json response = handle_job_query(request_json, operation, format);
+                if (response.contains("error_message")) {
+                    scope.fail();
+                }
+                return NngMessage::encode(response, format);
+            } else if (operation == "execute_cancel" || operation == "cancel") {
+                std::string job_id = request_json.value("job_id", "");
+                return NngMessage::encode({{"job_id", job_id}, {"success", jobs_.cancel(job_id)}}, format);
+            } else if (operation == "list") {
+                return NngMessage::encode(handle_list(), format);
+            } else if (operation == "read_log") {
+                return NngMessage::encode(handle_read_log(request_json, format), format);
             } else if (operation == "get_pwd") {
-                return handle_get_pwd();
+                return NngMessage::encode(handle_get_pwd(), format);
             } else if (operation == "set_pwd") {
-                return handle_set_pwd(request_json);
+                return NngMessage::encode(handle_set_pwd(request_json), format);
+            } else if (operation == "metrics") {
+                return NngMessage::encode(MetricsRegistry::instance().to_json(), format);
             } else {
                 throw std::runtime_error("Unknown operation: " + operation);
             }
             
         } catch (const std::exception& e) {
-            return create_error_response("Request handling error: " + std::string(e.what()));
+            scope.fail();
+            return NngMessage::encode(create_error_response("Request handling error: " + std::string(e.what())), format);
         }
     }
     
-private:
-    BashTool bash_tool_;
-    std::string current_working_directory_;
-    
-    std::string handle_execute_command(const nlohmann::json& request) {
+    nlohmann::json handle_execute_command(const nlohmann::json& request, WireFormat format) {
         try {
             std::string command = request["command"];
-            std::string working_dir = current_working_directory_;
-            
-            // If a specific working directory is provided, use it
-            if (request.contains("working_directory") && !request["working_directory"].empty()) {
-                working_dir = request["working_directory"];
-            }
+            std::string working_dir = working_directory_for(request);
             
-            std::cout << "Executing command: " << command 
-                      << " in directory: " << working_dir << std::endl;
+            MAG_LOG_INFO("bash_tool", "Executing command: " << command
+                         << " in directory: " << working_dir);
             
             // Execute command with context capture
-            CommandResult result = bash_tool_.execute_command(command, working_dir);
-            
-            // Update persistent working directory from result
-            if (!result.pwd_after_execution.empty()) {
-                current_working_directory_ = result.pwd_after_execution;
-                std::cout << "Updated working directory to: " << current_working_directory_ << std::endl;
-            }
+            CommandResult result = run_command(command, working_dir, session_for(request), nullptr, nullptr);
             
-            // Convert CommandResult to JSON response
-            nlohmann::json response;
-            response["success"] = result.success;
-            response["exit_code"] = result.exit_code;
-            response["stdout_output"] = result.stdout_output;
-            response["stderr_output"] = result.stderr_output;
-            response["working_directory_before"] = result.working_directory;
-            response["working_directory_after"] = result.pwd_after_execution;
-            response["execution_duration_ms"] = result.execution_duration.count();
-            
-            return response.dump();
+            return command_reply(result, format, true);
             
         } catch (const std::exception& e) {
             return create_error_response("Command execution error: " + std::string(e.what()));
         }
     }
     
-    std::string handle_get_pwd() {
+    // execute_start streams the output through execute_next; submit keeps it for status and wait
+    nlohmann::json handle_submit(const nlohmann::json& request, bool stream) {
+        std::string command = request.at("command");
+        std::string working_dir = working_directory_for(request);
+        std::string session = session_for(request);
+        MAG_LOG_INFO("bash_tool", (stream ? "Streaming" : "Queueing") << " command: " << command
+                     << " in directory: " << working_dir << " (session " << session << ")");
+        
+        std::string job_id = jobs_.submit(session, command,
+            [this, command, working_dir, session](const BashTool::OutputHandler& on_output,
+                                                  const CancellationToken& cancel) {
+                return run_command(command, working_dir, session, on_output, &cancel);
+            }, stream);
+        return {{"job_id", job_id}, {"session", session}, {"state", "queued"}, {"success", true}};
+    }
+    
+    nlohmann::json handle_job_query(const nlohmann::json& request, const std::string& operation, WireFormat format) {
+        std::string job_id = request.value("job_id", "");
+        if (operation == "execute_next") {
+            auto status = jobs_.take_output(job_id, std::chrono::milliseconds(NetworkConfig::STREAM_POLL_WAIT_MS));
+            if (!status) {
+                return unknown_job(job_id);
+            }
+            nlohmann::json reply = job_reply(*status, format, false);
+            WireCodec::set_bytes(reply, "stdout_delta", status->stdout_delta, format);
+            WireCodec::set_bytes(reply, "stderr_delta", status->stderr_delta, format);
+            return reply;
+        }
+        
+        std::optional<BashJobStatus> status;
+        if (operation == "wait") {
+            int wait_ms = std::clamp(request.value("wait_ms", BashToolConfig::MAX_WAIT_MS), 0,
+                                     BashToolConfig::MAX_WAIT_MS);
+            status = jobs_.wait(job_id, std::chrono::milliseconds(wait_ms));
+        } else {
+            status = jobs_.status(job_id);
+        }
+        return status ? job_reply(*status, format, true) : unknown_job(job_id);
+    }
+    
+    nlohmann::json handle_list() {
+        nlohmann::json jobs = nlohmann::json::array();
+        for (const BashJobStatus& status : jobs_.list()) {
+            jobs.push_back({{"job_id", status.job_id}, {"session", status.session}, {"command", status.command},
+                            {"state", job_state_to_string(status.state)}});
+        }
+        return {{"success", true}, {"jobs", jobs}};
+    }
+    
+    nlohmann::json handle_read_log(const nlohmann::json& request, WireFormat format) {
+        LogChunk chunk = bash_tool_.read_log(request.at("path"), request.value("offset", uint64_t{0}),
+                                             request.value("length", BashToolConfig::MAX_LOG_READ_BYTES));
+        nlohmann::json response = {{"success", true}, {"offset", chunk.offset}, {"total_bytes", chunk.total_bytes},
+                                   {"eof", chunk.eof}};
+        WireCodec::set_bytes(response, "data", chunk.data, format);
+        return response;
+    }
+    
+    // Runs command, or answers it from the result cache when it only reads an unchanged tree
+    CommandResult run_command(const std::string& command, const std::string& working_dir, const std::string& session,
+                              const BashTool::OutputHandler& on_output, const CancellationToken* cancel) {
+        std::optional<uint64_t> fingerprint;
+        if (result_cache_) {
+            fingerprint = result_cache_->fingerprint(command, working_dir);
+        }
+        if (fingerprint) {
+            if (std::optional<CommandResult> cached = result_cache_->lookup(command, working_dir, *fingerprint)) {
+                cache_lookups("hit").add();
+                MAG_LOG_DEBUG("bash_tool", "Answered from the result cache: " << command);
+                cached->cached = true;
+                cached->usage = {};
+                cached->start_time = cached->end_time = std::chrono::system_clock::now();
+                cached->execution_duration = std::chrono::milliseconds(0);
+                if (on_output) {
+                    on_output(false, cached->stdout_output);
+                    on_output(true, cached->stderr_output);
+                }
+                return *cached;
+            }
+            cache_lookups("miss").add();
+        }
+        
+        CommandResult result = bash_tool_.execute_command(command, working_dir, -1, on_output, cancel, session);
+        record_usage(result.usage);
+        adopt_working_directory(result, session);
+        if (fingerprint) {
+            result_cache_->store(command, working_dir, *fingerprint, result);
+        }
+        return result;
+    }
+    
+    // The request's directory if it names one, else the persistent one
+    std::string working_directory_for(const nlohmann::json& request) {
+        if (request.contains("working_directory") && !request["working_directory"].empty()) {
+            return request["working_directory"];
+        }
+        std::lock_guard<std::mutex> lock(directory_mutex_);
+        return current_working_directory_;
+    }
+    
+    // Commands that name no session share the default shell
+    static std::string session_for(const nlohmann::json& request) {
+        std::string session = request.value("session", "");
+        return session.empty() ? "default" : session;
+    }
+    
+    // Update persistent working directory from result; other sessions keep theirs to themselves
+    void adopt_working_directory(const CommandResult& result, const std::string& session) {
+        if (session == "default" && !result.pwd_after_execution.empty()) {
+            std::lock_guard<std::mutex> lock(directory_mutex_);
+            current_working_directory_ = result.pwd_after_execution;
+            MAG_LOG_DEBUG("bash_tool", "Updated working directory to: " << current_working_directory_);
+        }
+    }
+    
+    nlohmann::json handle_get_pwd() {
+        std::lock_guard<std::mutex> lock(directory_mutex_);
         nlohmann::json response;
         response["success"] = true;
         response["working_directory"] = current_working_directory_;
-        return response.dump();
+        return response;
     }
     
-    std::string handle_set_pwd(const nlohmann::json& request) {
+    nlohmann::json handle_set_pwd(const nlohmann::json& request) {
         try {
             std::string new_directory = request["working_directory"];
             
             // Validate directory exists (optional safety check)
             // For now, just accept it
+            std::lock_guard<std::mutex> lock(directory_mutex_);
             current_working_directory_ = new_directory;
             
             nlohmann::json response;
             response["success"] = true;
             response["working_directory"] = current_working_directory_;
-            return response.dump();
+            return response;
             
         } catch (const std::exception& e) {
             return create_error_response("Set working directory error: " + std::string(e.what()));
         }
     }
     
-    std::string create_error_response(const std::string& error_message) {
+    nlohmann::json create_error_response(const std::string& error_message) {
         nlohmann::json error_response;
         error_response["success"] = false;
         error_response["error_message"] = error_message;
-        return error_response.dump();
+        return error_response;
     }
 };
 
-void handle_request(const std::string& request_data, nng_socket sock, BashToolService& service) {
-    try {
-        std::string response = service.handle_request(request_data);
-        
-        // Send response
-        int rv = nng_send(sock, const_cast<char*>(response.c_str()), response.length(), 0);
-        if (rv != 0) {
-            std::cerr << "nng_send: " << nng_strerror(rv) << std::endl;
-        } else {
-            std::cout << "Sent response" << std::endl;
+int main(int argc, char* argv[]) {
+    int worker_count = ServiceConfig::get_bash_worker_count();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--workers=", 0) == 0) {
+            worker_count = std::max(1, std::atoi(arg.substr(10).c_str()));
         }
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error handling request: " << e.what() << std::endl;
-        
-        // Send error response
-        std::string error_response = "{\"success\": false, \"error_message\": \"" + 
-                                   std::string(e.what()) + "\"}";
-        nng_send(sock, const_cast<char*>(error_response.c_str()), error_response.length(), 0);
-    }
-}
-
-int main() {
-    nng_socket sock;
-    int rv;
-    
-    // Create NNG reply socket
-    if ((rv = nng_rep0_open(&sock)) != 0) {
-        std::cerr << "nng_rep0_open: " << nng_strerror(rv) << std::endl;
-        return 1;
     }
     
-    // Listen on the bash tool URL (port 5557)
-    std::string url = "tcp://127.0.0.1:5557";
-    if ((rv = nng_listen(sock, url.c_str(), nullptr, 0)) != 0) {
-        std::cerr << "nng_listen: " << nng_strerror(rv) << std::endl;
-        nng_close(sock);
-        return 1;
-    }
-    
-    std::cout << "Bash Tool Service listening on " << url << std::endl;
-    
-    // Create service instance
-    BashToolService service;
-    
-    // Main service loop
-    while (true) {
-        char* buf = nullptr;
-        size_t sz;
+    try {
+        Tracer::instance().set_service_name("bash_tool");
+        BashToolService service;
         
-        // Receive message
-        if ((rv = nng_recv(sock, &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-            std::cerr << "nng_recv: " << nng_strerror(rv) << std::endl;
-            continue;
-        }
+        // A long execute holds one worker; status, pwd and the job operations keep being served
+        ThreadPool pool(static_cast<size_t>(worker_count));
+        std::string url = NetworkConfig::get_bash_tool_url();
+        NNGRepServer server(url, static_cast<size_t>(worker_count) * ServiceConfig::CONTEXTS_PER_WORKER, pool,
+            [&service](size_t, std::string_view request) {
+                MAG_LOG_DEBUG("bash_tool", "Received " << WireCodec::format_name(WireCodec::detect(request))
+                              << " request: " << Logger::truncate(request));
+                return service.handle_request(request);
+            });
+        server.start();
         
-        std::string request_data(buf, sz);
-        nng_free(buf, sz);
+        std::cout << "Bash Tool Service listening on " << url << " with " << worker_count << " workers and "
+                  << BashToolConfig::get_job_workers() << " job workers" << std::endl;
         
-        std::cout << "Received request: " << request_data << std::endl;
+        // Lets pooled clients find this worker (MAG_WORKER_REGISTRY)
+        auto registration = WorkerRegistration::announce(EndpointConfig::Service::BASH_TOOL, url);
         
-        handle_request(request_data, sock, service);
+        // Prometheus scrape endpoint (MAG_METRICS_PORT_BASE)
+        auto metrics_server = MetricsServer::start(MetricsConfig::BASH_TOOL_OFFSET);
+        
+        // Requests are served from NNG callbacks and the pool
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return 1;
     }
     
-    nng_close(sock);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,12 @@
 #include "bash_tool.h"
+#include "config.h"
+#include "policy_matcher.h"
+#include "process_runner.h"
+#include "tracing.h"
 #include "utils.h"
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -15,6 +21,46 @@
 
 namespace mag {
 
+namespace {
+
+// Dangerous patterns compiled once; a regex only runs where its literal occurs
+struct DangerousPatterns {
+    MultiPatternMatcher literals;
+    std::vector<std::regex> regexes;
+    bool broken = false; // a pattern failed to compile, so every command is refused
+    
+    explicit DangerousPatterns(const std::vector<std::pair<std::string, std::string>>& patterns) {
+        std::vector<std::string> needed;
+        for (const auto& [pattern, literal] : patterns) {
+            try {
+                regexes.emplace_back(pattern, std::regex_constants::icase);
+                needed.push_back(literal);
+            } catch (const std::regex_error& e) {
+                // If regex fails, err on the side of caution
+                std::cerr << "Regex error in security check: " << e.what() << std::endl;
+                broken = true;
+            }
+        }
+        literals = MultiPatternMatcher(needed, true);
+    }
+    
+    bool match(const std::string& command) const {
+        if (broken) {
+            return true;
+        }
+        std::vector<bool> tried(regexes.size(), false);
+        return literals.find(command, [&](size_t pattern, size_t) {
+            if (tried[pattern]) {
+                return false;
+            }
+            tried[pattern] = true;
+            return std::regex_search(command, regexes[pattern]);
+        });
+    }
+};
+
+} // anonymous namespace
+
 // CommandResult helper methods
 std::string CommandResult::get_combined_output() const {
     std::string combined = stdout_output;
@@ -53,22 +99,126 @@ bool CommandResult::has_output() const {
     return !stdout_output.empty() || !stderr_output.empty();
 }
 
+std::string CommandResult::summary(size_t max_bytes) const {
+    std::ostringstream oss;
+    oss << "Command: " << command << "\n"
+        << "Exit code: " << exit_code << (timed_out ? " (timed out)" : cancelled ? " (cancelled)" : "") << "\n";
+    
+    // Each stream gets its share of the budget, split between its start and its end
+    size_t share = max_bytes / 2;
+    auto section = [&oss, share](const char* name, const std::string& text, uint64_t total, const std::string& log) {
+        if (text.empty()) {
+            return;
+        }
+        oss << name << " (" << std::max<uint64_t>(total, text.size()) << " bytes";
+        if (!log.empty()) {
+            oss << ", full log: " << log;
+        }
+        oss << "):\n";
+        if (text.size() <= share) {
+            oss << text;
+        } else {
+            oss << text.substr(0, share / 2) << "\n[... " << text.size() - share / 2 * 2 << " bytes not shown ...]\n"
+                << text.substr(text.size() - share / 2);
+        }
+        if (text.back() != '\n') {
+            oss << "\n";
+        }
+    };
+    section("Output", stdout_output, stdout_bytes, stdout_log);
+    section("Error output", stderr_output, stderr_bytes, stderr_log);
+    if (!error_message.empty()) {
+        oss << "Error: " << error_message << "\n";
+    }
+    return oss.str();
+}
+
 // BashTool implementation
 BashTool::BashTool() {
     // Initialize with sensible defaults
     capture_context_ = true;
-    default_timeout_ms_ = 30000;
+    default_timeout_ms_ = BashToolConfig::DEFAULT_TIMEOUT_MS;
+    capture_bytes_ = BashToolConfig::get_capture_bytes();
+    log_directory_ = BashToolConfig::get_log_directory();
+    limits_.cpu_seconds = BashToolConfig::get_cpu_seconds();
+    limits_.memory_bytes = BashToolConfig::get_memory_bytes();
+    limits_.file_bytes = BashToolConfig::get_file_bytes();
+}
+
+std::string BashTool::prepare_log_directory() {
+    if (log_directory_.empty()) {
+        return "";
+    }
+    std::lock_guard<std::mutex> lock(prune_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (last_prune_ != std::chrono::steady_clock::time_point{} && now - last_prune_ < std::chrono::minutes(1)) {
+        return log_directory_;
+    }
+    last_prune_ = now;
+    
+    std::error_code ec;
+    std::filesystem::create_directories(log_directory_, ec);
+    std::filesystem::permissions(log_directory_, std::filesystem::perms::owner_all, ec);
+    if (!std::filesystem::is_directory(log_directory_, ec)) {
+        std::cerr << "Bash output logs disabled, cannot use " << log_directory_ << std::endl;
+        log_directory_.clear();
+        return "";
+    }
+    
+    auto cutoff = std::filesystem::file_time_type::clock::now() -
+                  std::chrono::seconds(BashToolConfig::LOG_RETENTION_SECONDS);
+    for (const auto& entry : std::filesystem::directory_iterator(log_directory_, ec)) {
+        if (entry.is_regular_file(ec) && entry.last_write_time(ec) < cutoff) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+    return log_directory_;
+}
+
+LogChunk BashTool::read_log(const std::string& path, uint64_t offset, size_t max_bytes) const {
+    // Only files directly in the log directory, however the path is spelled
+    std::error_code ec;
+    std::filesystem::path log = std::filesystem::weakly_canonical(path, ec);
+    std::filesystem::path directory = std::filesystem::weakly_canonical(log_directory_, ec);
+    if (log_directory_.empty() || log.parent_path() != directory) {
+        throw std::invalid_argument("Not a bash output log: " + path);
+    }
+    
+    std::ifstream file(log, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open log " + path + " (it may have expired)");
+    }
+    LogChunk chunk;
+    file.seekg(0, std::ios::end);
+    chunk.total_bytes = static_cast<uint64_t>(file.tellg());
+    chunk.offset = std::min(offset, chunk.total_bytes);
+    size_t length = static_cast<size_t>(std::min<uint64_t>(std::min(max_bytes, BashToolConfig::MAX_LOG_READ_BYTES),
+                                                           chunk.total_bytes - chunk.offset));
+    chunk.data.resize(length);
+    file.seekg(static_cast<std::streamoff>(chunk.offset));
+    file.read(chunk.data.data(), static_cast<std::streamsize>(length));
+    chunk.data.resize(static_cast<size_t>(file.gcount()));
+    chunk.eof = chunk.offset + chunk.data.size() >= chunk.total_bytes;
+    return chunk;
 }
 
 CommandResult BashTool::execute_command(const std::string& command, 
                                        const std::string& working_directory,
-                                       int timeout_ms) {
+                                       int timeout_ms,
+                                       const OutputHandler& on_output,
+                                       const CancellationToken* cancel,
+                                       const std::string& session) {
     CommandResult result;
     result.command = command;
     result.start_time = std::chrono::system_clock::now();
     
     // Security check
-    if (!is_command_allowed(command)) {
+    bool allowed;
+    {
+        Span policy("policy");
+        allowed = is_command_allowed(command);
+    }
+    if (!allowed) {
         result.success = false;
         result.exit_code = -1;
         result.error_message = "Command blocked by security policy: " + command;
@@ -78,17 +228,26 @@ CommandResult BashTool::execute_command(const std::string& command,
         return result;
     }
     
+    if (timeout_ms < 0) {
+        timeout_ms = default_timeout_ms_;
+    }
+    
     // Set working directory
     std::string work_dir = working_directory.empty() ? get_current_directory() : working_directory;
     result.working_directory = work_dir;
+    auto start_time = result.start_time;
     
     try {
         // Execute command based on platform
 #ifdef _WIN32
         result = execute_windows_command(command, work_dir, timeout_ms);
+        if (on_output) {
+            on_output(false, result.stdout_output);
+        }
 #else
-        result = execute_unix_command(command, work_dir, timeout_ms);
+        result = execute_unix_command(command, work_dir, timeout_ms, on_output, cancel, session);
 #endif
+        result.start_time = start_time;
         
         // Capture execution context if enabled
         if (capture_context_) {
@@ -127,16 +286,13 @@ std::string BashTool::get_current_directory() const {
 }
 
 bool BashTool::is_command_allowed(const std::string& command) const {
-    // Check against blocked commands
-    auto blocked = get_blocked_commands();
-    std::string cmd_lower = command;
-    std::transform(cmd_lower.begin(), cmd_lower.end(), cmd_lower.begin(), ::tolower);
-    
-    for (const auto& blocked_cmd : blocked) {
-        if (cmd_lower.find(blocked_cmd) == 0 || 
-            cmd_lower.find(" " + blocked_cmd) != std::string::npos) {
-            return false;
-        }
+    // Check against blocked commands, at the start or after a space, ignoring case
+    static const MultiPatternMatcher blocked(get_blocked_commands(), true);
+    bool is_blocked = blocked.find(command, [&command](size_t, size_t start) {
+        return start == 0 || command[start - 1] == ' ';
+    });
+    if (is_blocked) {
+        return false;
     }
     
     // Check for dangerous patterns
@@ -170,94 +326,104 @@ std::vector<std::string> BashTool::get_blocked_commands() const {
     };
 }
 
-std::vector<std::string> BashTool::get_dangerous_patterns() const {
+std::vector<std::pair<std::string, std::string>> BashTool::get_dangerous_patterns() const {
     return {
-        R"(>\s*/dev/)",     // Redirecting to device files
-        R"(/dev/sd[a-z])",  // Direct disk access
-        R"(rm\s+.*-rf)",    // Recursive force remove
-        R"(\|.*rm)",        // Piped to rm
-        R"(;\s*rm)",        // Chained with rm
-        R"(&&.*rm)",        // AND chained with rm
-        R"(\$\([^)]*rm)",   // Command substitution with rm
+        {R"(>\s*/dev/)", "/dev/"},       // Redirecting to device files
+        {R"(/dev/sd[a-z])", "/dev/sd"},  // Direct disk access
+        {R"(rm\s+.*-rf)", "rm"},         // Recursive force remove
+        {R"(\|.*rm)", "rm"},             // Piped to rm
+        {R"(;\s*rm)", "rm"},             // Chained with rm
+        {R"(&&.*rm)", "rm"},             // AND chained with rm
+        {R"(\$\([^)]*rm)", "rm"},        // Command substitution with rm
     };
 }
 
 bool BashTool::contains_dangerous_pattern(const std::string& command) const {
-    auto patterns = get_dangerous_patterns();
-    
-    for (const auto& pattern : patterns) {
-        try {
-            std::regex danger_regex(pattern, std::regex_constants::icase);
-            if (std::regex_search(command, danger_regex)) {
-                return true;
-            }
-        } catch (const std::regex_error& e) {
-            // If regex fails, err on the side of caution
-            std::cerr << "Regex error in security check: " << e.what() << std::endl;
-            return true;
-        }
-    }
-    
-    return false;
+    static const DangerousPatterns patterns(get_dangerous_patterns());
+    return patterns.match(command);
 }
 
 CommandResult BashTool::execute_unix_command(const std::string& command, 
                                             const std::string& working_directory,
-                                            int timeout_ms) {
+                                            int timeout_ms,
+                                            const OutputHandler& on_output,
+                                            const CancellationToken* cancel,
+                                            const std::string& session) {
     CommandResult result;
     result.command = command;
     result.working_directory = working_directory;
     
-    // Prepare command with working directory change and pwd capture
-    std::string full_command = "cd \"" + working_directory + "\" && " + command;
-    
-    // Append pwd capture to get final working directory
-    if (capture_context_) {
-        full_command += " ; echo \"__PWD_MARKER__$(pwd)\"";
+    ProcessSpec spec;
+    spec.timeout = std::chrono::milliseconds(timeout_ms);
+    spec.max_output_bytes = capture_bytes_;
+    spec.spill_directory = prepare_log_directory();
+    spec.max_spill_bytes = BashToolConfig::MAX_LOG_BYTES;
+    spec.limits = limits_;
+    spec.cancel = cancel;
+    if (on_output) {
+        spec.on_output = [&on_output](int fd, std::string_view chunk) { on_output(fd == 2, chunk); };
     }
     
-    // Use popen to capture output
-    std::string cmd_with_stderr = full_command + " 2>&1";
-    
-    FILE* pipe = popen(cmd_with_stderr.c_str(), "r");
-    if (!pipe) {
-        throw std::runtime_error("Failed to execute command: " + command);
+    ProcessOutput output;
+    bool in_session = sessions_ && !session.empty();
+    if (in_session) {
+        // The session's shell reports its $PWD after every command
+        output = sessions_->run(session, command, working_directory, spec);
+    } else {
+        // The directory and the command reach bash as $1 and $2, never spliced into the script.
+        // With context capture the final working directory is reported on fd 3 as the shell exits.
+        spec.argv = {"bash", "-c",
+                     capture_context_ ? "cd -- \"$1\" || exit; trap 'pwd >&3' EXIT; eval \"$2\""
+                                      : "cd -- \"$1\" || exit; eval \"$2\"",
+                     "mag-bash", working_directory, command};
+        spec.capture_fd3 = capture_context_;
+        output = ProcessRunner::run(spec);
     }
-    
-    // Read output
-    char buffer[128];
-    std::string output;
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        output += buffer;
+    result.exit_code = output.exit_code;
+    result.success = output.exit_code == 0 && !output.timed_out && !output.cancelled;
+    result.timed_out = output.timed_out;
+    result.cancelled = output.cancelled;
+    result.stdout_output = std::move(output.stdout_output);
+    result.stderr_output = std::move(output.stderr_output);
+    result.stdout_bytes = output.stdout_bytes;
+    result.stderr_bytes = output.stderr_bytes;
+    result.stdout_log = std::move(output.stdout_log);
+    result.stderr_log = std::move(output.stderr_log);
+    result.usage = output.usage;
+    
+    std::string pwd = std::move(output.fd3_output);
+    while (!pwd.empty() && (pwd.back() == '\n' || pwd.back() == '\r')) {
+        pwd.pop_back();
+    }
+    result.pwd_after_execution = pwd;
+    if (in_session && pwd.empty() && !output.timed_out && !output.cancelled) {
+        result.error_message = "The command ended its shell session; the next one starts afresh";
     }
     
-    // Get exit code
-    int status = pclose(pipe);
-    result.exit_code = WEXITSTATUS(status);
-    result.success = (result.exit_code == 0);
-    
-    // Extract pwd if captured
-    if (capture_context_) {
-        std::string pwd_marker = "__PWD_MARKER__";
-        size_t pwd_pos = output.find(pwd_marker);
-        if (pwd_pos != std::string::npos) {
-            size_t pwd_start = pwd_pos + pwd_marker.length();
-            size_t pwd_end = output.find('\n', pwd_start);
-            if (pwd_end == std::string::npos) pwd_end = output.length();
-            
-            result.pwd_after_execution = output.substr(pwd_start, pwd_end - pwd_start);
-            
-            // Remove the pwd marker line from output
-            size_t line_start = output.rfind('\n', pwd_pos);
-            if (line_start == std::string::npos) line_start = 0;
-            else line_start++; // Skip the newline
-            
-            output.erase(line_start, pwd_end - line_start + (pwd_end < output.length() ? 1 : 0));
+    bool over_limit = output.exit_code == 128 + SIGXCPU || output.exit_code == 128 + SIGXFSZ;
+    if (output.timed_out || output.cancelled || over_limit) {
+        if (over_limit) {
+            result.error_message = output.exit_code == 128 + SIGXCPU
+                ? "Command was killed for exceeding its CPU time limit"
+                : "Command was killed for writing past the file size limit";
+        } else {
+            result.error_message = output.timed_out
+                ? "Command timed out after " + std::to_string(timeout_ms) + " ms and was killed"
+                : "Command was cancelled and killed";
+            if (in_session) {
+                result.error_message += "; its shell session starts afresh";
+            }
+        }
+        std::string note = "[" + result.error_message + "]\n";
+        if (!result.stderr_output.empty() && result.stderr_output.back() != '\n') {
+            note.insert(0, "\n");
+        }
+        result.stderr_output += note;
+        if (on_output) {
+            on_output(true, note);
         }
     }
     
-    result.stdout_output = output;
-    
     return result;
 }
 
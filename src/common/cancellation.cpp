@@ -0,0 +1,53 @@
+#include "cancellation.h"
+
+namespace mag {
+
+CancellationToken::CancellationToken() : state_(std::make_shared<State>()) {
+}
+
+void CancellationToken::cancel() const {
+    std::map<size_t, std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->cancelled) {
+            return;
+        }
+        state_->cancelled = true;
+        callbacks.swap(state_->callbacks);
+    }
+    state_->cv.notify_all();
+    // Run outside the lock so callbacks may touch the token
+    for (auto& [id, callback] : callbacks) {
+        callback();
+    }
+}
+
+bool CancellationToken::is_cancelled() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->cancelled;
+}
+
+bool CancellationToken::wait_for(std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    return state_->cv.wait_for(lock, timeout, [this] { return state_->cancelled; });
+}
+
+size_t CancellationToken::on_cancel(std::function<void()> callback) const {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->cancelled) {
+            size_t id = state_->next_id++;
+            state_->callbacks.emplace(id, std::move(callback));
+            return id;
+        }
+    }
+    callback();
+    return 0;
+}
+
+void CancellationToken::remove_callback(size_t id) const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->callbacks.erase(id);
+}
+
+} // namespace mag
@@ -0,0 +1,40 @@
+#include "chat_turns.h"
+
+namespace mag {
+
+namespace {
+
+// Stands in for user turns lost to trimming, so the first turn is still the user's
+const ConversationMessage& omitted_turns_placeholder() {
+    static const ConversationMessage placeholder("user", "[Earlier conversation omitted]");
+    return placeholder;
+}
+
+} // anonymous namespace
+
+std::vector<ChatTurn> group_chat_turns(HistoryView conversation_history, const ChatTurnOptions& options) {
+    std::vector<ChatTurn> turns;
+    for (const auto& message : conversation_history) {
+        if (message.role == "system" || message.content.empty()) {
+            continue;
+        }
+        std::string_view role = message.role == "assistant" ? options.assistant_role : std::string_view("user");
+        if (turns.empty() && role != "user" && options.require_user_first) {
+            turns.push_back({"user", {&omitted_turns_placeholder()}});
+        }
+        if (turns.empty() || turns.back().role != role) {
+            turns.push_back({role, {}});
+        }
+        turns.back().messages.push_back(&message);
+    }
+    return turns;
+}
+
+std::string_view openai_role(const ConversationMessage& message) {
+    if (message.role == "system" || message.role == "assistant") {
+        return message.role;
+    }
+    return "user";
+}
+
+} // namespace mag
@@ -1,8 +1,14 @@
 #include "cli_interface.h"
 #include "utils.h"
+#include "config.h"
+#include "network/nng_llm_client.h"
 #include <iostream>
 #include <chrono>
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace mag {
 
@@ -10,6 +16,8 @@ CLIInterface::CLIInterface()
     : coordinator_(), running_(true) {
     input_handler_ = create_input_handler();
     conversation_manager_ = std::make_unique<ConversationManager>();
+    setup_compaction();
+    setup_event_loop();
     init_debug_log();
     setup_completion();
     debug_log_ << "[CLI] CLIInterface initialized with conversation persistence" << std::endl;
@@ -19,12 +27,54 @@ CLIInterface::CLIInterface(const std::string& provider_override)
     : coordinator_(provider_override), running_(true) {
     input_handler_ = create_input_handler();
     conversation_manager_ = std::make_unique<ConversationManager>();
+    setup_compaction();
+    setup_event_loop();
     init_debug_log();
     setup_completion();
     debug_log_ << "[CLI] CLIInterface initialized with provider: " << provider_override << " and conversation persistence" << std::endl;
 }
 
+void CLIInterface::setup_compaction() {
+    if (!CompactionConfig::enabled()) {
+        return;
+    }
+    
+    // Summaries run on a background thread, so they get their own adapter connection
+    // rather than sharing the coordinator's REQ socket mid-request
+    auto summary_client = std::make_shared<std::unique_ptr<NNGLLMClient>>();
+    conversation_manager_->enable_compaction(
+        [summary_client, record_usage = conversation_manager_->usage_recorder()](
+            const std::vector<ConversationMessage>& turns, const std::string& previous_summary) {
+            if (!*summary_client) {
+                *summary_client = std::make_unique<NNGLLMClient>();
+                (*summary_client)->set_usage_observer(record_usage);
+            }
+            return (*summary_client)->request_summary(turns, previous_summary);
+        },
+        CompactionConfig::get_trigger_tokens(), CompactionConfig::get_keep_recent());
+}
+
+void CLIInterface::setup_event_loop() {
+    if (::pipe(wake_pipe_) != 0) {
+        throw std::runtime_error("Failed to create the CLI wake pipe: " + std::string(std::strerror(errno)));
+    }
+    for (int fd : wake_pipe_) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    
+    // Confirmations asked by a running job are answered through the input loop
+    coordinator_.set_line_reader([this](const std::string& question) { return ask(question); });
+    coordinator_.set_usage_observer(conversation_manager_->usage_recorder());
+}
+
 CLIInterface::~CLIInterface() {
+    finish_job();
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
     if (debug_log_.is_open()) {
         debug_log_ << "[CLI] CLIInterface destroyed" << std::endl;
         debug_log_.close();
@@ -35,16 +85,57 @@ void CLIInterface::run() {
     show_welcome();
     
     debug_log_ << "[CLI] Starting main command loop" << std::endl;
+    loop_thread_ = std::this_thread::get_id();
     
     while (running_) {
-        std::string input = input_handler_->get_line(get_prompt());
+        // Type-ahead runs once the job before it has finished
+        if (!job_.valid() && !queued_.empty()) {
+            std::string input = std::move(queued_.front());
+            queued_.pop_front();
+            print_colored(get_prompt() + input, "90"); // Grey
+            std::cout << std::endl;
+            dispatch(input);
+            continue;
+        }
+        
+        std::string prompt;
+        {
+            std::lock_guard<std::mutex> lock(question_mutex_);
+            prompt = question_ ? *question_ : (job_.valid() ? "" : get_prompt());
+        }
+        
+        std::string input;
+        InputHandler::InputEvent event = input_handler_->wait_for_line(prompt, wake_pipe_[0], input);
+        
+        if (event == InputHandler::InputEvent::WOKEN) {
+            char reasons[64];
+            bool finished = false;
+            for (ssize_t n; (n = ::read(wake_pipe_[0], reasons, sizeof(reasons))) > 0;) {
+                finished = finished || std::string(reasons, static_cast<size_t>(n)).find('d') != std::string::npos;
+            }
+            if (finished && job_.valid()) {
+                job_.get();
+            }
+            continue;
+        }
         
         // Handle EOF (Ctrl+D)
-        if (input.empty()) {
+        if (event == InputHandler::InputEvent::END) {
+            finish_job();
             std::cout << "\nGoodbye!\n";
             break;
         }
         
+        if (question_pending()) {
+            // /stop and /cancel also turn the change down; anything else is the answer
+            if (handle_control_command(input)) {
+                answer("n");
+            } else {
+                answer(input);
+            }
+            continue;
+        }
+        
         // Skip empty lines
         if (input.find_first_not_of(" \t") == std::string::npos) {
             continue;
@@ -53,13 +144,107 @@ void CLIInterface::run() {
         // Add to history
         input_handler_->add_history(input);
         
-        // Handle the command
-        handle_command(input);
+        if (job_.valid()) {
+            // Control commands act on the running job now; the rest waits its turn
+            if (!handle_control_command(input)) {
+                queued_.push_back(input);
+                print_colored("(queued: " + input + ")", "90");
+                std::cout << std::endl;
+            }
+            continue;
+        }
+        
+        dispatch(input);
     }
     
     debug_log_ << "[CLI] Main command loop ended" << std::endl;
 }
 
+void CLIInterface::dispatch(const std::string& input) {
+    // Slash commands other than /do and /todo batch are quick and run here; chat
+    // requests, todo runs and batch jobs (uploads and polls of the provider) go
+    // to the job thread so the prompt stays responsive
+    bool long_running = input[0] != '/' || input.compare(1, 2, "do") == 0 || input.compare(1, 10, "todo batch") == 0;
+    if (!long_running) {
+        handle_command(input);
+        return;
+    }
+    
+    job_ = std::async(std::launch::async, [this, input] {
+        handle_command(input);
+        wake('d');
+    });
+}
+
+bool CLIInterface::handle_control_command(const std::string& input) {
+    // Only the coordinator's thread-safe execution controls, and no debug_log_ writes
+    if (input == "/pause") {
+        coordinator_.pause_execution();
+    } else if (input == "/resume") {
+        coordinator_.resume_execution();
+    } else if (input == "/stop") {
+        coordinator_.stop_execution();
+    } else if (input == "/cancel") {
+        coordinator_.cancel_execution();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string CLIInterface::ask(const std::string& question) {
+    if (std::this_thread::get_id() == loop_thread_) {
+        return input_handler_->get_line(question); // nobody else would read the answer
+    }
+    
+    std::future<std::string> reply;
+    {
+        std::lock_guard<std::mutex> lock(question_mutex_);
+        if (closing_) {
+            return ""; // nobody is left to answer: "no"
+        }
+        answer_ = std::promise<std::string>();
+        reply = answer_.get_future();
+        question_ = question;
+    }
+    wake('q');
+    return reply.get();
+}
+
+void CLIInterface::answer(const std::string& line) {
+    std::lock_guard<std::mutex> lock(question_mutex_);
+    if (question_) {
+        question_.reset();
+        answer_.set_value(line);
+    }
+}
+
+void CLIInterface::finish_job() {
+    {
+        std::lock_guard<std::mutex> lock(question_mutex_);
+        closing_ = true;
+    }
+    if (job_.valid()) {
+        // A job waiting on a confirmation takes it as "no", and the rest of it is stopped
+        answer("");
+        if (coordinator_.get_execution_state() != Coordinator::ExecutionState::STOPPED) {
+            coordinator_.stop_execution();
+        }
+        job_.wait();
+    }
+}
+
+bool CLIInterface::question_pending() {
+    std::lock_guard<std::mutex> lock(question_mutex_);
+    return question_.has_value();
+}
+
+void CLIInterface::wake(char reason) {
+    // The pipe is non-blocking: if it is full the loop is already due to wake
+    ssize_t written = ::write(wake_pipe_[1], &reason, 1);
+    (void)written;
+}
+
 void CLIInterface::handle_command(const std::string& input) {
     debug_log_ << "[CLI] Handling command: " << input << std::endl;
     
@@ -82,8 +267,8 @@ void CLIInterface::handle_command(const std::string& input) {
                   << conversation_manager_->get_message_count() << " messages)" << std::endl;
         
         // Use conversation history for better context
-        auto history = conversation_manager_->get_history();
-        std::string response = coordinator_.run_with_conversation_history(input, history);
+        // A view, not a copy: the history is not modified until the reply is added
+        std::string response = coordinator_.run_with_conversation_history(input, conversation_manager_->history_view());
         
         // Save assistant response to conversation history if we got one
         if (!response.empty() && response.find("Error:") != 0) {
@@ -115,6 +300,8 @@ void CLIInterface::handle_slash_command(const std::string& command) {
         running_ = false;
     } else if (command == "gemini" || command == "claude" || command == "chatgpt" || command == "mistral") {
         switch_provider_with_context(command);
+    } else if (command.substr(0, 10) == "todo batch") {
+        handle_todo_batch_command(command.substr(10));
     } else if (command == "todo") {
         show_todo_list();
     } else if (command.substr(0, 2) == "do") {
@@ -131,6 +318,8 @@ void CLIInterface::handle_slash_command(const std::string& command) {
         show_execution_status();
     } else if (command == "history") {
         show_conversation_history();
+    } else if (command == "stats") {
+        show_usage_stats();
     } else if (command.substr(0, 7) == "session") {
         handle_session_command(command.substr(7));
     } else {
@@ -158,12 +347,14 @@ void CLIInterface::show_help() {
     std::cout << "  /gemini, /claude, /chatgpt, /mistral  - Switch LLM provider\n";
     std::cout << "  /debug                                - Show debug information\n";
     std::cout << "  /todo                                 - Show todo list\n";
+    std::cout << "  /todo batch [status]                  - Plan pending todos in a provider batch job, or check on it\n";
     std::cout << "  /do [all|next|until N|N-M]           - Execute todos\n";
     std::cout << "  /pause                                - Pause execution\n";
     std::cout << "  /resume                               - Resume paused execution\n";
     std::cout << "  /stop                                 - Stop execution\n";
     std::cout << "  /cancel                               - Cancel execution\n";
     std::cout << "  /status                               - Show execution status\n";
+    std::cout << "  /stats                                - Show provider token usage for this session\n";
     std::cout << "  /help, /h                             - Show this help\n";
     std::cout << "  /exit, /quit, /q                      - Exit MAG\n";
     std::cout << "\nOr just type your request naturally:\n";
@@ -217,8 +408,9 @@ void CLIInterface::setup_completion() {
     std::vector<std::string> completions = {
         "/help", "/h",
         "/status",
+        "/stats",
         "/debug", 
-        "/todo",
+        "/todo", "/todo batch", "/todo batch status",
         "/do", "/do all", "/do next",
         "/exit", "/quit", "/q",
         "/gemini", "/claude", "/chatgpt", "/mistral"
@@ -250,7 +442,7 @@ bool CLIInterface::supports_colors() const {
 }
 
 void CLIInterface::show_todo_list() {
-    auto todos = coordinator_.get_todo_manager().list_todos(true);
+    TodoView todos = coordinator_.get_todo_manager().all();
     
     std::cout << "\n=== Todo List ===\n";
     if (todos.empty()) {
@@ -437,7 +629,7 @@ void CLIInterface::show_conversation_history() {
             
             // Show timestamp for recent messages or if requested
             if (i >= history.size() - 5 || history.size() <= 10) {
-                std::cout << "  " << msg.timestamp << std::endl;
+                std::cout << "  " << msg.timestamp() << std::endl;
             }
             std::cout << std::endl;
         }
@@ -450,6 +642,61 @@ void CLIInterface::show_conversation_history() {
     }
 }
 
+void CLIInterface::show_usage_stats() {
+    auto by_model = conversation_manager_->get_usage_by_model();
+    
+    print_colored("=== Provider Usage ===", "34"); // Blue
+    std::cout << " (Session: " << conversation_manager_->get_current_session_id() << ")" << std::endl;
+    
+    if (by_model.empty()) {
+        print_colored("No provider usage reported yet.", "33"); // Yellow
+        std::cout << std::endl;
+        return;
+    }
+    
+    auto print_totals = [](const UsageTotals& totals) {
+        std::cout << totals.requests << " requests, " << totals.input_tokens << " input tokens";
+        if (totals.cached_tokens > 0 || totals.cache_write_tokens > 0) {
+            std::cout << " (" << totals.cached_tokens << " cached, " << totals.cache_write_tokens << " cache writes)";
+        }
+        std::cout << ", " << totals.output_tokens << " output tokens";
+        if (totals.timed_requests > 0) {
+            std::cout << ", " << totals.server_latency_ms / totals.timed_requests << "ms avg server time";
+        }
+        std::cout << std::endl;
+    };
+    
+    UsageTotals total;
+    for (const auto& [model, totals] : by_model) {
+        std::cout << "  " << model << ": ";
+        print_totals(totals);
+        total.merge(totals);
+    }
+    std::cout << "  Total: ";
+    print_totals(total);
+    
+    std::cout << "  Prompt cache hit ratio: " << static_cast<int>(total.cache_hit_ratio() * 100 + 0.5) << "%" << std::endl;
+    // The estimate sizes history trimming; compare it with what the provider billed
+    std::cout << "  History estimate: " << conversation_manager_->get_token_count() << " tokens";
+    if (total.requests > 0) {
+        std::cout << ", " << total.input_tokens / total.requests << " input tokens billed per request";
+    }
+    std::cout << std::endl;
+}
+
+void CLIInterface::handle_todo_batch_command(const std::string& command) {
+    size_t start = command.find_first_not_of(" ");
+    std::string args = start == std::string::npos ? "" : command.substr(start);
+    if (args.empty()) {
+        coordinator_.submit_plan_batch();
+    } else if (args == "status") {
+        coordinator_.check_plan_batches();
+    } else {
+        print_colored("Usage: /todo batch [status]", "33"); // Yellow
+        std::cout << std::endl;
+    }
+}
+
 void CLIInterface::handle_session_command(const std::string& command) {
     debug_log_ << "[CLI] Handling session command: " << command << std::endl;
     
@@ -461,42 +708,56 @@ void CLIInterface::handle_session_command(const std::string& command) {
             trimmed_command = trimmed_command.substr(start);
         }
         
-        if (trimmed_command.empty() || trimmed_command == " list") {
-            // List available sessions
-            auto sessions = conversation_manager_->get_available_sessions();
+        if (trimmed_command.empty() || trimmed_command.substr(0, 4) == "list") {
+            // List available sessions, a page at a time
+            size_t page = 1;
+            std::string page_arg = trimmed_command.size() > 4 ? trimmed_command.substr(4) : "";
+            if (page_arg.find_first_not_of(" ") != std::string::npos) {
+                page = std::max<size_t>(1, std::stoul(page_arg));
+            }
+            size_t total = conversation_manager_->get_session_count();
+            auto sessions = conversation_manager_->list_sessions((page - 1) * SESSIONS_PER_PAGE, SESSIONS_PER_PAGE);
             
             print_colored("=== Available Conversation Sessions ===", "34"); // Blue
             std::cout << std::endl;
             
             if (sessions.empty()) {
-                print_colored("No saved sessions found.", "33"); // Yellow
+                print_colored(total == 0 ? "No saved sessions found." : "No sessions on this page.", "33"); // Yellow
                 std::cout << std::endl;
             } else {
-                for (size_t i = 0; i < sessions.size() && i < 10; ++i) {
-                    const auto& session = sessions[i];
-                    std::cout << "  " << (i + 1) << ". " << session;
+                size_t number = (page - 1) * SESSIONS_PER_PAGE;
+                for (const auto& session : sessions) {
+                    std::cout << "  " << ++number << ". " << session.id
+                              << "  " << session.message_count << " messages";
+                    if (!session.last_provider.empty()) {
+                        std::cout << ", " << session.last_provider;
+                    }
+                    if (!session.last_activity.empty()) {
+                        std::cout << ", last active " << session.last_activity;
+                    }
                     
-                    if (session == conversation_manager_->get_current_session_id()) {
+                    if (session.id == conversation_manager_->get_current_session_id()) {
                         print_colored(" (current)", "32"); // Green
                     }
                     std::cout << std::endl;
                 }
                 
-                if (sessions.size() > 10) {
-                    std::cout << "  ... and " << (sessions.size() - 10) << " more" << std::endl;
+                if (number < total) {
+                    std::cout << "  ... and " << (total - number) << " more (/session list "
+                              << (page + 1) << ")" << std::endl;
                 }
             }
             
-        } else if (trimmed_command == " new") {
+        } else if (trimmed_command == "new") {
             // Start new session
             conversation_manager_->start_new_session();
             print_colored("Started new conversation session: " + 
                          conversation_manager_->get_current_session_id(), "32");
             std::cout << std::endl;
             
-        } else if (trimmed_command.substr(0, 5) == " load") {
+        } else if (trimmed_command.substr(0, 4) == "load") {
             // Load specific session
-            std::string session_id = trimmed_command.substr(5);
+            std::string session_id = trimmed_command.substr(4);
             // Remove leading spaces
             size_t start = session_id.find_first_not_of(" ");
             if (start != std::string::npos) {
@@ -506,7 +767,7 @@ void CLIInterface::handle_session_command(const std::string& command) {
             if (session_id.empty()) {
                 print_colored("Usage: /session load <session_id>", "33");
                 std::cout << std::endl;
-            } else if (conversation_manager_->load_session(session_id)) {
+            } else if (conversation_manager_->load_session(session_id, JournalConfig::get_resume_messages())) {
                 print_colored("Loaded session: " + session_id + 
                              " (" + std::to_string(conversation_manager_->get_message_count()) + 
                              " messages)", "32");
@@ -519,7 +780,7 @@ void CLIInterface::handle_session_command(const std::string& command) {
         } else {
             print_colored("Unknown session command. Usage:", "33");
             std::cout << std::endl;
-            std::cout << "  /session       - List available sessions" << std::endl;
+            std::cout << "  /session [list [page]] - List available sessions" << std::endl;
             std::cout << "  /session new   - Start new session" << std::endl;
             std::cout << "  /session load <id> - Load specific session" << std::endl;
         }
@@ -1,4 +1,6 @@
 #include "conversation_manager.h"
+#include "logger.h"
+#include "config.h"
 #include <fstream>
 #include <filesystem>
 #include <chrono>
@@ -6,16 +8,23 @@
 #include <sstream>
 #include <algorithm>
 #include <iostream>
+#include <thread>
+#include <map>
+#include <limits>
 
 namespace mag {
 
 ConversationManager::ConversationManager() 
-    : storage_directory_(".mag/conversations") {
+    : calibrated_counter_(std::make_shared<CalibratedTokenCounter>()), token_counter_(calibrated_counter_),
+      compaction_(std::make_shared<CompactionState>()),
+      storage_directory_(".mag/conversations"), usage_(std::make_shared<UsageState>()) {
     start_new_session();
 }
 
 ConversationManager::ConversationManager(const std::string& session_id) 
-    : session_id_(session_id), storage_directory_(".mag/conversations") {
+    : calibrated_counter_(std::make_shared<CalibratedTokenCounter>()), token_counter_(calibrated_counter_),
+      compaction_(std::make_shared<CompactionState>()),
+      session_id_(session_id), storage_directory_(".mag/conversations"), usage_(std::make_shared<UsageState>()) {
     if (!load_session(session_id)) {
         start_new_session(session_id);
     }
@@ -32,29 +41,40 @@ ConversationManager::~ConversationManager() {
 }
 
 void ConversationManager::add_user_message(const std::string& content) {
-    conversation_history_.emplace_back("user", content);
+    apply_compaction();
+    append_message(ConversationMessage("user", text_arena_.store(content)));
     update_last_activity();
+    maybe_start_compaction();
 }
 
 void ConversationManager::add_assistant_message(const std::string& content, const std::string& provider) {
-    conversation_history_.emplace_back("assistant", content, provider);
+    apply_compaction();
+    append_message(ConversationMessage("assistant", text_arena_.store(content), provider));
     last_provider_used_ = provider;
     update_last_activity();
+    maybe_start_compaction();
 }
 
 void ConversationManager::add_system_message(const std::string& content) {
-    conversation_history_.emplace_back("system", content);
+    apply_compaction();
+    append_message(ConversationMessage("system", text_arena_.store(content)));
     update_last_activity();
+    maybe_start_compaction();
 }
 
 std::vector<ConversationMessage> ConversationManager::get_history() const {
-    return conversation_history_;
+    return std::vector<ConversationMessage>(conversation_history_.begin(), conversation_history_.end());
+}
+
+HistoryView ConversationManager::history_view() const {
+    return conversation_history_.view();
 }
 
 std::vector<ConversationMessage> ConversationManager::get_history_since(const std::string& timestamp) const {
+    int64_t since = ConversationMessage::parse_timestamp(timestamp).value_or(0);
     std::vector<ConversationMessage> result;
     for (const auto& msg : conversation_history_) {
-        if (msg.timestamp >= timestamp) {
+        if (msg.timestamp_ms >= since) {
             result.push_back(msg);
         }
     }
@@ -70,42 +90,76 @@ bool ConversationManager::is_empty() const {
 }
 
 void ConversationManager::clear_history() {
-    conversation_history_.clear();
+    if (journal_) {
+        journal_write([&](SessionJournal& journal) { journal.append_clear(conversation_history_.size()); });
+    }
+    reset_history();
     update_last_activity();
 }
 
 void ConversationManager::trim_to_last_n_messages(size_t n) {
     if (conversation_history_.size() > n) {
-        conversation_history_.erase(
-            conversation_history_.begin(), 
-            conversation_history_.end() - n
-        );
+        drop_oldest(conversation_history_.size() - n);
         update_last_activity();
     }
 }
 
 void ConversationManager::trim_to_token_limit(size_t max_tokens) {
-    size_t estimated_tokens = 0;
-    auto it = conversation_history_.rbegin();
-    
-    // Count from the end to keep the most recent messages
-    while (it != conversation_history_.rend() && 
-           estimated_tokens < max_tokens) {
-        estimated_tokens += it->content.length() / CHARS_PER_TOKEN;
-        ++it;
+    // The running total makes this a walk over the removed prefix only.
+    // The most recent message is always kept, even if it alone is over the limit.
+    size_t to_drop = 0;
+    size_t remaining = total_tokens_;
+    while (remaining > max_tokens && to_drop + 1 < conversation_history_.size()) {
+        remaining -= conversation_history_[to_drop].token_count;
+        ++to_drop;
     }
     
-    // Remove messages from the beginning if we exceeded the limit
-    if (it != conversation_history_.rend()) {
-        size_t messages_to_keep = std::distance(it, conversation_history_.rend());
-        conversation_history_.erase(
-            conversation_history_.begin(),
-            conversation_history_.begin() + (conversation_history_.size() - messages_to_keep)
-        );
+    if (to_drop > 0) {
+        drop_oldest(to_drop);
         update_last_activity();
     }
 }
 
+void ConversationManager::set_token_counter(std::shared_ptr<const TokenCounter> counter) {
+    token_counter_ = counter ? std::move(counter) : calibrated_counter_;
+    total_tokens_ = 0;
+    for (auto& message : conversation_history_) {
+        message.token_count = token_counter_->count_message(message.content);
+        total_tokens_ += message.token_count;
+    }
+}
+
+size_t ConversationManager::get_token_count() const {
+    return total_tokens_;
+}
+
+void ConversationManager::enable_compaction(Summarizer summarizer, size_t trigger_tokens, size_t keep_recent) {
+    summarizer_ = std::move(summarizer);
+    compaction_trigger_tokens_ = trigger_tokens;
+    compaction_keep_recent_ = keep_recent;
+}
+
+void ConversationManager::disable_compaction() {
+    summarizer_ = nullptr;
+}
+
+bool ConversationManager::is_compacting() const {
+    std::lock_guard<std::mutex> lock(compaction_->mutex);
+    return compaction_->in_flight;
+}
+
+void ConversationManager::wait_for_compaction() {
+    {
+        std::unique_lock<std::mutex> lock(compaction_->mutex);
+        compaction_->cv.wait(lock, [this] { return !compaction_->in_flight; });
+    }
+    apply_compaction();
+}
+
+bool ConversationManager::is_summary(const ConversationMessage& message) {
+    return message.role == "system" && message.content.view().starts_with(SUMMARY_PREFIX);
+}
+
 void ConversationManager::start_new_session() {
     start_new_session(generate_session_id());
 }
@@ -117,10 +171,14 @@ void ConversationManager::start_new_session(const std::string& session_id) {
     }
     
     session_id_ = session_id;
-    conversation_history_.clear();
+    journal_.reset();
+    journal_is_new_session_ = true;
+    reset_history();
     session_created_time_ = ConversationMessage::get_current_timestamp();
     last_activity_time_ = session_created_time_;
     last_provider_used_ = "";
+    std::lock_guard<std::mutex> lock(usage_->mutex);
+    usage_->by_model.clear();
 }
 
 std::string ConversationManager::get_current_session_id() const {
@@ -128,23 +186,35 @@ std::string ConversationManager::get_current_session_id() const {
 }
 
 void ConversationManager::save_to_disk() {
-    if (conversation_history_.empty()) {
+    if (conversation_history_.empty() && !journal_) {
         return; // Don't save empty conversations
     }
     
     try {
-        ensure_storage_directory_exists();
-        
-        std::string file_path = get_session_file_path();
-        std::ofstream file(file_path);
-        if (!file) {
-            throw std::runtime_error("Failed to open conversation file for writing: " + file_path);
+        // Messages are already journaled as they arrive; a save records the
+        // session metadata, makes everything durable and compacts if due
+        SessionJournal& journal = open_journal();
+        journal.append_metadata({
+            {"session_id", session_id_},
+            {"created", session_created_time_},
+            {"last_activity", last_activity_time_},
+            {"last_provider", last_provider_used_},
+            {"usage", usage_to_json()}
+        });
+        if (journal.needs_compaction()) {
+            journal.compact();
         }
+        journal.sync();
         
-        nlohmann::json j = to_json();
-        file << j.dump(2) << std::endl;
+        try {
+            session_index().update({session_id_, session_created_time_, last_activity_time_,
+                                    last_provider_used_, conversation_history_.size()});
+        } catch (const std::exception& e) {
+            // The journal is the source of truth; a stale index is rebuilt on the next listing
+            MAG_LOG_WARN("conversation", "Failed to update session index: " << e.what());
+        }
         
-        std::cout << "Conversation saved to: " << file_path << std::endl;
+        std::cout << "Conversation saved to: " << journal.path() << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Error saving conversation: " << e.what() << std::endl;
         throw;
@@ -155,28 +225,30 @@ void ConversationManager::load_from_disk() {
     load_session(session_id_);
 }
 
-bool ConversationManager::load_session(const std::string& session_id) {
+bool ConversationManager::load_session(const std::string& session_id, size_t max_messages) {
     try {
         std::string file_path = get_session_file_path(session_id);
-        
         if (!std::filesystem::exists(file_path)) {
-            return false;
-        }
-        
-        std::ifstream file(file_path);
-        if (!file) {
-            std::cerr << "Warning: Failed to open conversation file: " << file_path << std::endl;
-            return false;
+            return load_legacy_session(session_id);
         }
         
-        nlohmann::json j;
-        file >> j;
+        JournalSnapshot snapshot = SessionJournal::read(file_path,
+            max_messages > 0 ? max_messages : std::numeric_limits<size_t>::max());
         
-        from_json(j);
+        journal_.reset();
+        reset_history();
+        for (auto& message : snapshot.messages) {
+            adopt_message(std::move(message));
+        }
+        next_sequence_ = snapshot.next_sequence;
+        apply_metadata(snapshot.metadata);
         session_id_ = session_id;
+        journal_ = std::make_unique<SessionJournal>(file_path);
+        journal_is_new_session_ = false;
         
         std::cout << "Loaded conversation session: " << session_id << 
-                     " (" << conversation_history_.size() << " messages)" << std::endl;
+                     " (" << conversation_history_.size() << " messages" <<
+                     (snapshot.complete ? "" : ", most recent only") << ")" << std::endl;
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error loading conversation session " << session_id << ": " << e.what() << std::endl;
@@ -184,35 +256,93 @@ bool ConversationManager::load_session(const std::string& session_id) {
     }
 }
 
+bool ConversationManager::load_legacy_session(const std::string& session_id) {
+    std::string legacy_path = get_legacy_session_file_path(session_id);
+    if (!std::filesystem::exists(legacy_path)) {
+        return false;
+    }
+    
+    std::ifstream file(legacy_path);
+    if (!file) {
+        std::cerr << "Warning: Failed to open conversation file: " << legacy_path << std::endl;
+        return false;
+    }
+    
+    nlohmann::json j;
+    file >> j;
+    
+    journal_.reset();
+    from_json(j);
+    session_id_ = session_id;
+    {
+        std::lock_guard<std::mutex> lock(usage_->mutex);
+        usage_->by_model.clear(); // predates usage tracking
+    }
+    
+    // Convert to a journal once; the old file is left in place
+    ensure_storage_directory_exists();
+    JournalSnapshot snapshot;
+    snapshot.messages.assign(conversation_history_.begin(), conversation_history_.end());
+    snapshot.has_summary = !conversation_history_.empty() && is_summary(conversation_history_.front());
+    snapshot.next_sequence = next_sequence_;
+    snapshot.metadata = {{"session_id", session_id_}, {"created", session_created_time_},
+                         {"last_activity", last_activity_time_}, {"last_provider", last_provider_used_}};
+    journal_ = std::make_unique<SessionJournal>(get_session_file_path(session_id));
+    journal_->rewrite(snapshot);
+    journal_is_new_session_ = false;
+    
+    std::cout << "Loaded conversation session: " << session_id << 
+                 " (" << conversation_history_.size() << " messages)" << std::endl;
+    return true;
+}
+
 std::vector<std::string> ConversationManager::get_available_sessions() const {
     std::vector<std::string> sessions;
-    
+    for (const auto& info : list_sessions(0, std::numeric_limits<size_t>::max())) {
+        sessions.push_back(info.id);
+    }
+    return sessions;
+}
+
+std::vector<SessionInfo> ConversationManager::list_sessions(size_t offset, size_t limit) const {
     try {
-        if (!std::filesystem::exists(storage_directory_)) {
-            return sessions;
-        }
-        
-        for (const auto& entry : std::filesystem::directory_iterator(storage_directory_)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".json") {
-                std::string filename = entry.path().stem().string();
-                sessions.push_back(filename);
-            }
-        }
-        
-        // Sort by modification time (newest first)
-        std::sort(sessions.begin(), sessions.end(), [this](const std::string& a, const std::string& b) {
-            auto time_a = std::filesystem::last_write_time(get_session_file_path(a));
-            auto time_b = std::filesystem::last_write_time(get_session_file_path(b));
-            return time_a > time_b;
-        });
+        return session_index().list(offset, limit);
     } catch (const std::exception& e) {
         std::cerr << "Error getting available sessions: " << e.what() << std::endl;
+        return {};
+    }
+}
+
+std::optional<SessionInfo> ConversationManager::find_session(const std::string& session_id) const {
+    try {
+        return session_index().find(session_id);
+    } catch (const std::exception& e) {
+        std::cerr << "Error looking up session " << session_id << ": " << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+size_t ConversationManager::get_session_count() const {
+    try {
+        return session_index().size();
+    } catch (const std::exception& e) {
+        std::cerr << "Error counting sessions: " << e.what() << std::endl;
+        return 0;
     }
-    
-    return sessions;
+}
+
+SessionIndex& ConversationManager::session_index() const {
+    if (!session_index_) {
+        session_index_ = std::make_unique<SessionIndex>(storage_directory_);
+    }
+    return *session_index_;
 }
 
 void ConversationManager::set_storage_directory(const std::string& dir) {
+    if (dir != storage_directory_) {
+        journal_.reset(); // the next write opens the journal in the new directory
+        session_index_.reset();
+    }
     storage_directory_ = dir;
 }
 
@@ -232,6 +362,38 @@ std::string ConversationManager::get_last_provider_used() const {
     return last_provider_used_;
 }
 
+void ConversationManager::record_usage(const ProviderUsage& usage) {
+    usage_recorder()(usage);
+}
+
+std::function<void(const ProviderUsage&)> ConversationManager::usage_recorder() const {
+    return [state = usage_, counter = calibrated_counter_](const ProviderUsage& usage) {
+        if (!usage.reported) {
+            return;
+        }
+        if (usage.estimated_input_tokens > 0) {
+            counter->calibrate(static_cast<size_t>(usage.estimated_input_tokens),
+                               static_cast<size_t>(usage.input_tokens));
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->by_model[usage.provider + "/" + usage.model].add(usage);
+    };
+}
+
+std::map<std::string, UsageTotals> ConversationManager::get_usage_by_model() const {
+    std::lock_guard<std::mutex> lock(usage_->mutex);
+    return usage_->by_model;
+}
+
+UsageTotals ConversationManager::get_usage_totals() const {
+    std::lock_guard<std::mutex> lock(usage_->mutex);
+    UsageTotals total;
+    for (const auto& [model, totals] : usage_->by_model) {
+        total.merge(totals);
+    }
+    return total;
+}
+
 // Private methods
 
 std::string ConversationManager::generate_session_id() const {
@@ -248,13 +410,189 @@ std::string ConversationManager::get_session_file_path() const {
 }
 
 std::string ConversationManager::get_session_file_path(const std::string& session_id) const {
+    return storage_directory_ + "/" + session_id + ".jsonl";
+}
+
+std::string ConversationManager::get_legacy_session_file_path(const std::string& session_id) const {
     return storage_directory_ + "/" + session_id + ".json";
 }
 
+SessionJournal& ConversationManager::open_journal() {
+    if (!journal_) {
+        ensure_storage_directory_exists();
+        std::string path = get_session_file_path();
+        bool reused_file = journal_is_new_session_ && std::filesystem::exists(path) &&
+                           std::filesystem::file_size(path) > 0;
+        journal_ = std::make_unique<SessionJournal>(path);
+        if (reused_file) {
+            // A new session that collides with an old id replaces it, as a full rewrite used to
+            journal_->append_clear(0);
+        }
+        journal_is_new_session_ = false;
+    }
+    return *journal_;
+}
+
+void ConversationManager::journal_write(const std::function<void(SessionJournal&)>& write) {
+    try {
+        write(open_journal());
+    } catch (const std::exception& e) {
+        MAG_LOG_ERROR("conversation", "Session journal write failed: " << e.what());
+    }
+}
+
+void ConversationManager::apply_metadata(const nlohmann::json& metadata) {
+    if (metadata.contains("created")) {
+        session_created_time_ = metadata["created"];
+    }
+    if (metadata.contains("last_activity")) {
+        last_activity_time_ = metadata["last_activity"];
+    }
+    if (metadata.contains("last_provider")) {
+        last_provider_used_ = metadata["last_provider"];
+    }
+    std::lock_guard<std::mutex> lock(usage_->mutex);
+    usage_->by_model.clear();
+    if (metadata.contains("usage") && metadata["usage"].is_object()) {
+        for (const auto& [model, totals] : metadata["usage"].items()) {
+            usage_->by_model[model] = UsageTotals::from_json(totals);
+        }
+    }
+}
+
+nlohmann::json ConversationManager::usage_to_json() const {
+    std::lock_guard<std::mutex> lock(usage_->mutex);
+    nlohmann::json usage = nlohmann::json::object();
+    for (const auto& [model, totals] : usage_->by_model) {
+        usage[model] = totals.to_json();
+    }
+    return usage;
+}
+
 void ConversationManager::update_last_activity() {
     last_activity_time_ = ConversationMessage::get_current_timestamp();
 }
 
+void ConversationManager::append_message(ConversationMessage message) {
+    message.sequence = next_sequence_++;
+    adopt_message(std::move(message));
+    journal_write([this](SessionJournal& journal) { journal.append_message(conversation_history_.back()); });
+}
+
+void ConversationManager::adopt_message(ConversationMessage message) {
+    message.content = text_arena_.adopt(std::move(message.content));
+    message.token_count = token_counter_->count_message(message.content);
+    total_tokens_ += message.token_count;
+    next_sequence_ = std::max(next_sequence_, message.sequence + 1);
+    conversation_history_.push_back(std::move(message));
+}
+
+void ConversationManager::drop_oldest(size_t count) {
+    size_t dropped = 0;
+    for (; dropped < count && !conversation_history_.empty(); ++dropped) {
+        total_tokens_ -= conversation_history_.front().token_count;
+        conversation_history_.pop_front();
+    }
+    if (dropped > 0 && journal_) {
+        uint64_t front = conversation_history_.empty() ? next_sequence_ : conversation_history_.front().sequence;
+        journal_write([&](SessionJournal& journal) { journal.append_drop(front, dropped); });
+    }
+}
+
+void ConversationManager::reset_history() {
+    conversation_history_.clear();
+    text_arena_.reset(); // the old session's blocks go once nothing else holds their texts
+    total_tokens_ = 0;
+    next_sequence_ = 0;
+    ++history_generation_; // an in-flight summary no longer applies
+}
+
+void ConversationManager::maybe_start_compaction() {
+    if (!summarizer_ || total_tokens_ <= compaction_trigger_tokens_ ||
+        conversation_history_.size() <= compaction_keep_recent_) {
+        return;
+    }
+    
+    // Everything but the newest messages is folded into the summary; an existing
+    // summary at the front is extended rather than summarized again
+    size_t covered = conversation_history_.size() - compaction_keep_recent_;
+    size_t first = is_summary(conversation_history_.front()) ? 1 : 0;
+    if (covered <= first) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(compaction_->mutex);
+        if (compaction_->in_flight) {
+            return;
+        }
+        compaction_->in_flight = true;
+        compaction_->ready = false;
+    }
+    
+    std::string previous_summary = first ? std::string(conversation_history_.front().content.view().substr(
+        std::char_traits<char>::length(SUMMARY_PREFIX))) : "";
+    std::vector<ConversationMessage> turns(conversation_history_.begin() + first,
+                                           conversation_history_.begin() + covered);
+    uint64_t covers_until = covered < conversation_history_.size()
+        ? conversation_history_[covered].sequence : next_sequence_;
+    uint64_t generation = history_generation_;
+    
+    MAG_LOG_DEBUG("conversation", "Compacting " << turns.size() << " turns (" << total_tokens_ << " tokens)");
+    std::thread([state = compaction_, summarizer = summarizer_, turns = std::move(turns),
+                 previous_summary = std::move(previous_summary), covers_until, generation]() {
+        std::string summary;
+        try {
+            summary = summarizer(turns, previous_summary);
+        } catch (const std::exception& e) {
+            MAG_LOG_WARN("conversation", "Context compaction failed: " << e.what());
+        }
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->in_flight = false;
+            state->ready = !summary.empty();
+            state->summary = std::move(summary);
+            state->covers_until = covers_until;
+            state->generation = generation;
+        }
+        state->cv.notify_all();
+    }).detach();
+}
+
+void ConversationManager::apply_compaction() {
+    std::string summary;
+    uint64_t covers_until;
+    {
+        std::lock_guard<std::mutex> lock(compaction_->mutex);
+        if (!compaction_->ready) {
+            return;
+        }
+        compaction_->ready = false;
+        if (compaction_->generation != history_generation_) {
+            return;
+        }
+        summary = std::move(compaction_->summary);
+        covers_until = compaction_->covers_until;
+    }
+    
+    // Messages trimmed while the summary was being written are already gone
+    size_t covered = 0;
+    while (covered < conversation_history_.size() && conversation_history_[covered].sequence < covers_until) {
+        ++covered;
+    }
+    drop_oldest(covered);
+    
+    // The summary takes the last covered sequence number, ahead of every kept message
+    ConversationMessage message("system", text_arena_.store(SUMMARY_PREFIX + summary), "summary");
+    message.sequence = covers_until - 1;
+    message.token_count = token_counter_->count_message(message.content);
+    total_tokens_ += message.token_count;
+    conversation_history_.push_front(std::move(message));
+    journal_write([this](SessionJournal& journal) { journal.append_summary(conversation_history_.front()); });
+    
+    MAG_LOG_DEBUG("conversation", "Applied compaction summary; history now " << total_tokens_ << " tokens");
+}
+
 void ConversationManager::ensure_storage_directory_exists() {
     try {
         std::filesystem::create_directories(storage_directory_);
@@ -263,28 +601,14 @@ void ConversationManager::ensure_storage_directory_exists() {
     }
 }
 
-nlohmann::json ConversationManager::to_json() const {
-    nlohmann::json messages = nlohmann::json::array();
-    for (const auto& msg : conversation_history_) {
-        messages.push_back(msg.to_json());
-    }
-    
-    return nlohmann::json{
-        {"session_id", session_id_},
-        {"created", session_created_time_},
-        {"last_activity", last_activity_time_},
-        {"last_provider", last_provider_used_},
-        {"message_count", conversation_history_.size()},
-        {"messages", messages}
-    };
-}
-
 void ConversationManager::from_json(const nlohmann::json& j) {
-    conversation_history_.clear();
+    reset_history();
     
     if (j.contains("messages") && j["messages"].is_array()) {
         for (const auto& msg_json : j["messages"]) {
-            conversation_history_.push_back(ConversationMessage::from_json(msg_json));
+            ConversationMessage message = ConversationMessage::from_json(msg_json);
+            message.sequence = next_sequence_;
+            adopt_message(std::move(message));
         }
     }
     
@@ -0,0 +1,174 @@
+#include "endpoint_config.h"
+#include "config.h"
+#include "logger.h"
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+namespace {
+
+constexpr const char* DEFAULT_CONFIG_FILE = ".mag/network.json";
+
+std::optional<std::string> process_env(const char* name) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return std::nullopt;
+    }
+    return std::string(value);
+}
+
+const char* url_env_var(EndpointConfig::Service service) {
+    switch (service) {
+        case EndpointConfig::Service::LLM_ADAPTER: return "MAG_LLM_ADAPTER_URL";
+        case EndpointConfig::Service::FILE_TOOL: return "MAG_FILE_TOOL_URL";
+        case EndpointConfig::Service::BASH_TOOL: return "MAG_BASH_TOOL_URL";
+    }
+    return "";
+}
+
+std::vector<std::string> split_urls(const std::string& list) {
+    std::vector<std::string> urls;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string url = list.substr(start, comma - start);
+        url.erase(0, url.find_first_not_of(" \t"));
+        url.erase(url.find_last_not_of(" \t") + 1);
+        if (!url.empty()) {
+            urls.push_back(url);
+        }
+        start = comma + 1;
+    }
+    return urls;
+}
+
+constexpr EndpointConfig::Service ALL_SERVICES[] = {
+    EndpointConfig::Service::LLM_ADAPTER,
+    EndpointConfig::Service::FILE_TOOL,
+    EndpointConfig::Service::BASH_TOOL
+};
+
+} // anonymous namespace
+
+const EndpointConfig& EndpointConfig::instance() {
+    static const EndpointConfig config = [] {
+        std::string file = process_env("MAG_NETWORK_CONFIG").value_or(DEFAULT_CONFIG_FILE);
+        return load(file, process_env);
+    }();
+    return config;
+}
+
+EndpointConfig EndpointConfig::load(const std::string& config_file, const EnvLookup& env) {
+    EndpointConfig config;
+    config.host_ = NetworkConfig::LLM_ADAPTER_HOST;
+    config.port_base_ = NetworkConfig::LLM_ADAPTER_PORT;
+    std::string default_ipc_dir = env("XDG_RUNTIME_DIR").value_or("/tmp");
+    config.ipc_directory_ = default_ipc_dir;
+
+    std::ifstream file(config_file);
+    if (file) {
+        try {
+            nlohmann::json j = nlohmann::json::parse(file);
+            config.transport_ = j.value("transport", config.transport_);
+            config.instance_ = j.value("instance", config.instance_);
+            config.host_ = j.value("host", config.host_);
+            config.port_base_ = j.value("port_base", config.port_base_);
+            config.ipc_directory_ = j.value("ipc_dir", config.ipc_directory_);
+            config.registry_directory_ = j.value("worker_registry", config.registry_directory_);
+            if (j.contains("endpoints") && j["endpoints"].is_object()) {
+                for (const auto& [service, url] : j["endpoints"].items()) {
+                    if (url.is_array()) {
+                        config.overrides_[service] = url.get<std::vector<std::string>>();
+                    } else {
+                        config.overrides_[service] = split_urls(url.get<std::string>());
+                    }
+                }
+            }
+        } catch (const std::exception& e) {
+            MAG_LOG_WARN("network", "Ignoring unreadable " << config_file << ": " << e.what());
+        }
+    }
+
+    config.transport_ = env("MAG_TRANSPORT").value_or(config.transport_);
+    config.instance_ = env("MAG_INSTANCE").value_or(config.instance_);
+    config.host_ = env("MAG_HOST").value_or(config.host_);
+    config.ipc_directory_ = env("MAG_IPC_DIR").value_or(config.ipc_directory_);
+    config.registry_directory_ = env("MAG_WORKER_REGISTRY").value_or(config.registry_directory_);
+    if (auto port = env("MAG_PORT_BASE")) {
+        try {
+            config.port_base_ = std::stoi(*port);
+        } catch (const std::exception&) {
+            MAG_LOG_WARN("network", "Ignoring invalid MAG_PORT_BASE: " << *port);
+        }
+    }
+    for (Service service : ALL_SERVICES) {
+        if (auto url = env(url_env_var(service))) {
+            config.overrides_[service_name(service)] = split_urls(*url);
+        }
+    }
+
+    if (config.transport_ != "tcp" && config.transport_ != "ipc" && config.transport_ != "inproc") {
+        MAG_LOG_WARN("network", "Unknown transport '" << config.transport_ << "', using tcp");
+        config.transport_ = "tcp";
+    }
+    return config;
+}
+
+std::string EndpointConfig::url(Service service) const {
+    return urls(service).front();
+}
+
+std::vector<std::string> EndpointConfig::urls(Service service) const {
+    auto override_it = overrides_.find(service_name(service));
+    if (override_it != overrides_.end() && !override_it->second.empty()) {
+        return override_it->second;
+    }
+
+    std::string name = std::string("mag-") + (instance_.empty() ? "" : instance_ + "-") + service_name(service);
+    if (transport_ == "ipc") {
+        return {"ipc://" + ipc_directory_ + "/" + name + ".ipc"};
+    }
+    if (transport_ == "inproc") {
+        return {"inproc://" + name};
+    }
+    return {"tcp://" + host_ + ":" + std::to_string(port_base_ + port_offset(service))};
+}
+
+const char* EndpointConfig::service_name(Service service) {
+    switch (service) {
+        case Service::LLM_ADAPTER: return "llm_adapter";
+        case Service::FILE_TOOL: return "file_tool";
+        case Service::BASH_TOOL: return "bash_tool";
+    }
+    return "";
+}
+
+int EndpointConfig::port_offset(Service service) const {
+    switch (service) {
+        case Service::LLM_ADAPTER: return 0;
+        case Service::FILE_TOOL: return NetworkConfig::FILE_TOOL_PORT - NetworkConfig::LLM_ADAPTER_PORT;
+        case Service::BASH_TOOL: return NetworkConfig::BASH_TOOL_PORT - NetworkConfig::LLM_ADAPTER_PORT;
+    }
+    return 0;
+}
+
+// NetworkConfig's URL accessors resolve through the process-wide settings
+std::string NetworkConfig::get_llm_adapter_url() {
+    return EndpointConfig::instance().url(EndpointConfig::Service::LLM_ADAPTER);
+}
+
+std::string NetworkConfig::get_file_tool_url() {
+    return EndpointConfig::instance().url(EndpointConfig::Service::FILE_TOOL);
+}
+
+std::string NetworkConfig::get_bash_tool_url() {
+    return EndpointConfig::instance().url(EndpointConfig::Service::BASH_TOOL);
+}
+
+} // namespace mag
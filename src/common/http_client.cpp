@@ -1,71 +1,305 @@
 #include "http_client.h"
+#include "config.h"
 #include <curl/curl.h>
 #include <stdexcept>
+#include <algorithm>
+#include <cctype>
 
 namespace mag {
 
-HttpClient::HttpClient() {
-    curl_ = curl_easy_init();
-    if (!curl_) {
-        throw std::runtime_error("Failed to initialize CURL");
+// ---------------------------------------------------------------------------
+// HttpResponse
+
+std::string HttpResponse::header(const std::string& name) const {
+    std::string key = name;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    auto it = headers.find(key);
+    return it == headers.end() ? "" : it->second;
+}
+
+HttpResponse HttpResponse::failure(std::string message, long status_code) {
+    HttpResponse response;
+    response.status_code = status_code;
+    response.success = false;
+    response.error_message = std::move(message);
+    return response;
+}
+
+// ---------------------------------------------------------------------------
+// HttpCall
+
+bool HttpCall::is_done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+}
+
+HttpResponse HttpCall::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return done_; });
+    return response_;
+}
+
+bool HttpCall::wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [this] { return done_; });
+}
+
+void HttpCall::cancel() {
+    cancelled_.store(true);
+    HttpTransport::instance().wake();
+}
+
+void HttpCall::complete(HttpResponse response) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_) {
+            return;
+        }
+        response_ = std::move(response);
+        done_ = true;
+    }
+    cv_.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// HttpTransport
+
+HttpTransport& HttpTransport::instance() {
+    static HttpTransport transport;
+    return transport;
+}
+
+HttpTransport::HttpTransport() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        throw std::runtime_error("Failed to initialize CURL multi handle");
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, HttpConfig::MAX_HOST_CONNECTIONS);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, HttpConfig::MAX_TOTAL_CONNECTIONS);
+    multi_ = multi;
+
+    // The share handle is only touched from the transport thread, so no lock callbacks are needed
+    CURLSH* share = curl_share_init();
+    if (share) {
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    share_ = share;
+
+    worker_ = std::thread([this] { run(); });
+}
+
+HttpTransport::~HttpTransport() {
+    running_.store(false);
+    wake();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+
+    CURLM* multi = static_cast<CURLM*>(multi_);
+    for (auto& call : active_) {
+        curl_multi_remove_handle(multi, static_cast<CURL*>(call->easy_));
+        curl_easy_cleanup(static_cast<CURL*>(call->easy_));
+        curl_slist_free_all(static_cast<curl_slist*>(call->header_list_));
+        call->easy_ = nullptr;
+        call->header_list_ = nullptr;
+        call->complete(HttpResponse::failure("HTTP transport shut down"));
+    }
+    for (auto& call : pending_) {
+        call->complete(HttpResponse::failure("HTTP transport shut down"));
     }
+    for (void* easy : idle_easy_) {
+        curl_easy_cleanup(static_cast<CURL*>(easy));
+    }
+
+    curl_multi_cleanup(multi);
+    if (share_) {
+        curl_share_cleanup(static_cast<CURLSH*>(share_));
+    }
+}
+
+HttpCallHandle HttpTransport::submit(HttpRequest request) {
+    auto call = std::make_shared<HttpCall>();
+    call->request_ = std::move(request);
+    call->response_.status_code = 0;
+    call->response_.success = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(call);
+    }
+    in_flight_.fetch_add(1);
+    wake();
+    return call;
+}
+
+void HttpTransport::wake() {
+    curl_multi_wakeup(static_cast<CURLM*>(multi_));
 }
 
-HttpClient::~HttpClient() {
-    if (curl_) {
-        curl_easy_cleanup(static_cast<CURL*>(curl_));
+void* HttpTransport::acquire_easy() {
+    if (!idle_easy_.empty()) {
+        void* easy = idle_easy_.back();
+        idle_easy_.pop_back();
+        // Reset clears per-request options; live connections stay in the multi's pool
+        curl_easy_reset(static_cast<CURL*>(easy));
+        return easy;
     }
+    return curl_easy_init();
 }
 
-size_t HttpClient::WriteCallback(void* contents, size_t size, size_t nmemb, std::string* response) {
+void HttpTransport::release_easy(void* easy) {
+    if (idle_easy_.size() < static_cast<size_t>(HttpConfig::MAX_TOTAL_CONNECTIONS)) {
+        idle_easy_.push_back(easy);
+    } else {
+        curl_easy_cleanup(static_cast<CURL*>(easy));
+    }
+}
+
+size_t HttpTransport::write_callback(char* contents, size_t size, size_t nmemb, void* userdata) {
     size_t total_size = size * nmemb;
-    response->append(static_cast<char*>(contents), total_size);
+    HttpCall* call = static_cast<HttpCall*>(userdata);
+    call->response_.data.append(contents, total_size);
+    if (call->request_.on_data) {
+        call->request_.on_data(contents, total_size);
+    }
     return total_size;
 }
 
-HttpResponse HttpClient::post(
-    const std::string& url,
-    const std::string& payload,
-    const std::vector<std::string>& headers
-) const {
-    HttpResponse response;
-    response.success = false;
-    response.status_code = 0;
-    
-    CURL* curl = static_cast<CURL*>(curl_);
-    
-    // Reset curl for new request
-    curl_easy_reset(curl);
-    
-    // Set URL
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    
-    // Set POST data
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, payload.length());
+size_t HttpTransport::header_callback(char* contents, size_t size, size_t nmemb, void* userdata) {
+    size_t total_size = size * nmemb;
+    HttpCall* call = static_cast<HttpCall*>(userdata);
+    std::string line(contents, total_size);
     
-    // Set headers
-    struct curl_slist* header_list = nullptr;
-    for (const auto& header : headers) {
-        header_list = curl_slist_append(header_list, header.c_str());
+    // A new status line starts a new header block (redirects, 100 Continue); keep only the last
+    if (line.rfind("HTTP/", 0) == 0) {
+        call->response_.headers.clear();
+        return total_size;
     }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
-    
-    // Set write callback
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.data);
-    
-    // Perform the request
-    CURLcode res = curl_easy_perform(curl);
-    
-    // Get response code
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status_code);
-    
-    // Cleanup headers
-    if (header_list) {
-        curl_slist_free_all(header_list);
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        return total_size;
     }
-    
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    size_t value_start = line.find_first_not_of(" \t", colon + 1);
+    size_t value_end = line.find_last_not_of(" \t\r\n");
+    std::string value = (value_start == std::string::npos || value_end < value_start)
+        ? "" : line.substr(value_start, value_end - value_start + 1);
+    call->response_.headers[name] = value;
+    return total_size;
+}
+
+void HttpTransport::start_pending() {
+    std::deque<HttpCallHandle> to_start;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        to_start.swap(pending_);
+    }
+
+    CURLM* multi = static_cast<CURLM*>(multi_);
+    for (auto& call : to_start) {
+        if (call->is_cancelled()) {
+            in_flight_.fetch_sub(1);
+            call->complete(HttpResponse::failure("Request cancelled"));
+            continue;
+        }
+
+        CURL* curl = static_cast<CURL*>(acquire_easy());
+        if (!curl) {
+            in_flight_.fetch_sub(1);
+            call->complete(HttpResponse::failure("Failed to initialize CURL"));
+            continue;
+        }
+
+        const HttpRequest& request = call->request_;
+
+        curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+        if (request.head_only) {
+            curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        } else if (request.get) {
+            curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        } else {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.payload.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.payload.length()));
+        }
+
+        struct curl_slist* header_list = nullptr;
+        for (const auto& header : request.headers) {
+            header_list = curl_slist_append(header_list, header.c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, call.get());
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, call.get());
+
+        // Connection reuse and multiplexing
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, HttpConfig::KEEPALIVE_IDLE_SECONDS);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, HttpConfig::CONNECT_TIMEOUT_MS);
+        if (request.timeout_ms > 0) {
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, request.timeout_ms);
+        }
+        if (share_) {
+            curl_easy_setopt(curl, CURLOPT_SHARE, static_cast<CURLSH*>(share_));
+        }
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, call.get());
+
+        call->easy_ = curl;
+        call->header_list_ = header_list;
+        active_.push_back(call);
+        curl_multi_add_handle(multi, curl);
+    }
+}
+
+void HttpTransport::reap_cancelled() {
+    CURLM* multi = static_cast<CURLM*>(multi_);
+    for (auto it = active_.begin(); it != active_.end();) {
+        auto& call = *it;
+        if (!call->is_cancelled()) {
+            ++it;
+            continue;
+        }
+        CURL* curl = static_cast<CURL*>(call->easy_);
+        curl_multi_remove_handle(multi, curl);
+        curl_slist_free_all(static_cast<curl_slist*>(call->header_list_));
+        call->easy_ = nullptr;
+        call->header_list_ = nullptr;
+        // A half-finished transfer leaves its connection unusable; don't recycle the handle
+        curl_easy_cleanup(curl);
+        in_flight_.fetch_sub(1);
+        call->complete(HttpResponse::failure("Request cancelled"));
+        it = active_.erase(it);
+    }
+}
+
+void HttpTransport::finish(void* easy, int curl_code) {
+    auto it = std::find_if(active_.begin(), active_.end(),
+                           [easy](const HttpCallHandle& call) { return call->easy_ == easy; });
+    if (it == active_.end()) {
+        return;
+    }
+    HttpCallHandle call = *it;
+    active_.erase(it);
+
+    CURL* curl = static_cast<CURL*>(easy);
+    curl_multi_remove_handle(static_cast<CURLM*>(multi_), curl);
+
+    HttpResponse response;
+    response.data = std::move(call->response_.data);
+    response.headers = std::move(call->response_.headers);
+    response.status_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status_code);
+
+    CURLcode res = static_cast<CURLcode>(curl_code);
     if (res != CURLE_OK) {
         response.error_message = curl_easy_strerror(res);
         response.success = false;
@@ -75,8 +309,105 @@ HttpResponse HttpClient::post(
         response.success = false;
         response.error_message = "HTTP error: " + std::to_string(response.status_code);
     }
-    
-    return response;
+
+    curl_slist_free_all(static_cast<curl_slist*>(call->header_list_));
+    call->header_list_ = nullptr;
+    call->easy_ = nullptr;
+    release_easy(curl);
+
+    in_flight_.fetch_sub(1);
+    call->complete(std::move(response));
+}
+
+void HttpTransport::run() {
+    CURLM* multi = static_cast<CURLM*>(multi_);
+
+    while (running_.load()) {
+        start_pending();
+        reap_cancelled();
+
+        int still_running = 0;
+        curl_multi_perform(multi, &still_running);
+
+        int msgs_left = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &msgs_left)) {
+            if (msg->msg == CURLMSG_DONE) {
+                finish(msg->easy_handle, msg->data.result);
+            }
+        }
+
+        curl_multi_poll(multi, nullptr, 0, HttpConfig::POLL_INTERVAL_MS, nullptr);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// HttpClient
+
+HttpClient::HttpClient() : transport_(HttpTransport::instance()) {
+}
+
+HttpClient::~HttpClient() = default;
+
+HttpCallHandle HttpClient::submit(
+    const std::string& url,
+    const std::string& payload,
+    const std::vector<std::string>& headers
+) const {
+    HttpRequest request;
+    request.url = url;
+    request.payload = payload;
+    request.headers = headers;
+    return transport_.submit(std::move(request));
+}
+
+void HttpClient::prewarm(const std::string& url) const {
+    if (url.empty()) {
+        return;
+    }
+    HttpRequest request;
+    request.url = url;
+    request.head_only = true;
+    request.timeout_ms = HttpConfig::PREWARM_TIMEOUT_MS;
+    transport_.submit(std::move(request)); // the transport keeps the call until it completes
+}
+
+HttpResponse HttpClient::post(
+    const std::string& url,
+    const std::string& payload,
+    const std::vector<std::string>& headers
+) const {
+    if (url.empty()) {
+        return HttpResponse::failure("Empty URL");
+    }
+    return submit(url, payload, headers)->wait();
+}
+
+HttpResponse HttpClient::get(const std::string& url, const std::vector<std::string>& headers) const {
+    if (url.empty()) {
+        return HttpResponse::failure("Empty URL");
+    }
+    HttpRequest request;
+    request.url = url;
+    request.headers = headers;
+    request.get = true;
+    return transport_.submit(std::move(request))->wait();
+}
+
+HttpResponse HttpClient::post_stream(
+    const std::string& url,
+    const std::string& payload,
+    const std::vector<std::string>& headers,
+    std::function<void(const char* data, size_t length)> on_data
+) const {
+    if (url.empty()) {
+        return HttpResponse::failure("Empty URL");
+    }
+    HttpRequest request;
+    request.url = url;
+    request.payload = payload;
+    request.headers = headers;
+    request.on_data = std::move(on_data);
+    return transport_.submit(std::move(request))->wait();
 }
 
 } // namespace mag
\ No newline at end of file
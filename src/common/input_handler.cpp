@@ -1,10 +1,68 @@
 #include "input_handler.h"
 #include "readline_input_handler.h"
 #include "simple_input_handler.h"
+#include <cerrno>
 #include <iostream>
 
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 namespace mag {
 
+InputHandler::InputEvent InputHandler::wait_for_line(const std::string& prompt, int wake_fd, std::string& line) {
+#ifdef _WIN32
+    // No poll() on console handles; read the line as before
+    (void)wake_fd;
+    line = get_line(prompt);
+    return line.empty() ? InputEvent::END : InputEvent::LINE;
+#else
+    while (true) {
+        size_t newline = pending_input_.find('\n');
+        if (newline != std::string::npos || (input_closed_ && !pending_input_.empty())) {
+            line = pending_input_.substr(0, newline);
+            pending_input_.erase(0, newline == std::string::npos ? std::string::npos : newline + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            prompt_shown_ = false;
+            return InputEvent::LINE;
+        }
+        if (input_closed_) {
+            return InputEvent::END;
+        }
+        
+        if (!prompt_shown_ || prompt != shown_prompt_) {
+            std::cout << prompt << std::flush;
+            shown_prompt_ = prompt;
+            prompt_shown_ = true;
+        }
+        
+        pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (::poll(fds, wake_fd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            input_closed_ = true;
+            continue;
+        }
+        if (wake_fd >= 0 && (fds[1].revents & POLLIN)) {
+            return InputEvent::WOKEN;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            char buffer[4096];
+            ssize_t n = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n > 0) {
+                pending_input_.append(buffer, static_cast<size_t>(n));
+            } else if (n == 0 || errno != EINTR) {
+                input_closed_ = true;
+            }
+        }
+    }
+#endif
+}
+
 std::unique_ptr<InputHandler> create_input_handler() {
 #ifdef HAS_READLINE
     std::cout << "MAG using readline for enhanced CLI experience\n";
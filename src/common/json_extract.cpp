@@ -0,0 +1,388 @@
+#include "json_extract.h"
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+namespace {
+
+using json = nlohmann::json;
+
+/**
+ * @brief SAX handler that captures the value at one path and then stops
+ *
+ * Only a small frame per open container is kept: whether the container sits
+ * on the path, the next array index, and whether the pending object key
+ * matches the next path step. Keys off the path are never copied.
+ */
+class PathExtractor : public nlohmann::json_sax<json> {
+public:
+    explicit PathExtractor(const JsonPath& path) : path_(path) {}
+
+    std::optional<std::string> result;
+    std::optional<uint64_t> number;
+    bool finished = false;      // stopped deliberately (found, or path proved absent)
+    std::string error;
+
+    bool null() override { return scalar(); }
+    bool boolean(bool) override { return scalar(); }
+    bool number_integer(number_integer_t) override { return scalar(); }
+    bool number_float(number_float_t, const string_t&) override { return scalar(); }
+    bool binary(binary_t&) override { return scalar(); }
+
+    bool number_unsigned(number_unsigned_t value) override {
+        Position position = enter_value();
+        if (position == Position::TARGET) {
+            number = value;
+        }
+        if (position != Position::OFF_PATH) {
+            finished = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool string(string_t& value) override {
+        if (enter_value() == Position::TARGET) {
+            result = std::move(value);
+            finished = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override { return start_container(false); }
+    bool start_array(std::size_t) override { return start_container(true); }
+
+    bool key(string_t& value) override {
+        Frame& frame = frames_.back();
+        if (frame.on_path) {
+            const JsonPathStep& step = path_[frame.depth];
+            frame.key_matches = !step.is_index && step.key == value;
+        }
+        return true;
+    }
+
+    bool end_object() override { return end_container(); }
+    bool end_array() override { return end_container(); }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        error = ex.what();
+        return false;
+    }
+
+private:
+    enum class Position { OFF_PATH, ON_PATH, TARGET };
+
+    struct Frame {
+        bool is_array;
+        bool on_path;
+        size_t depth;           // path steps consumed to reach this container
+        size_t next_index = 0;
+        bool key_matches = false;
+    };
+
+    const JsonPath& path_;
+    std::vector<Frame> frames_;
+
+    // Classify the value that is about to start, advancing the parent's array index
+    Position enter_value() {
+        if (frames_.empty()) {
+            return path_.empty() ? Position::TARGET : Position::ON_PATH;
+        }
+        Frame& parent = frames_.back();
+        bool matches = false;
+        if (parent.is_array) {
+            size_t index = parent.next_index++;
+            matches = parent.on_path && path_[parent.depth].is_index && path_[parent.depth].index == index;
+        } else {
+            matches = parent.on_path && parent.key_matches;
+        }
+        if (!matches) {
+            return Position::OFF_PATH;
+        }
+        return parent.depth + 1 == path_.size() ? Position::TARGET : Position::ON_PATH;
+    }
+
+    bool scalar() {
+        if (enter_value() == Position::OFF_PATH) {
+            return true;
+        }
+        // The path ends at (or runs through) a non-string value
+        finished = true;
+        return false;
+    }
+
+    bool start_container(bool is_array) {
+        Position position = enter_value();
+        if (position == Position::TARGET) {
+            finished = true;
+            return false;
+        }
+        size_t depth = frames_.empty() ? 0 : frames_.back().depth + 1;
+        frames_.push_back(Frame{is_array, position == Position::ON_PATH, depth});
+        return true;
+    }
+
+    bool end_container() {
+        bool was_on_path = frames_.back().on_path;
+        frames_.pop_back();
+        // Leaving the container that held the path means the value is absent
+        if (was_on_path) {
+            finished = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief SAX handler that builds the wanted top-level members and skips the rest
+ *
+ * stack_ holds the captured containers that are still open. Object members
+ * live in a map and an array only grows at its open end, so the pointers
+ * stay valid while their containers are being filled.
+ */
+class MemberExtractor : public nlohmann::json_sax<json> {
+public:
+    explicit MemberExtractor(std::initializer_list<std::string_view> keys) : keys_(keys) {}
+
+    json result = json::object();
+    bool finished = false; // every wanted member has been seen
+    std::string error;
+
+    bool null() override { return value(nullptr); }
+    bool boolean(bool v) override { return value(v); }
+    bool number_integer(number_integer_t v) override { return value(v); }
+    bool number_unsigned(number_unsigned_t v) override { return value(v); }
+    bool number_float(number_float_t v, const string_t&) override { return value(v); }
+    bool binary(binary_t&) override { return value(nullptr); } // not produced by JSON text
+    bool string(string_t& v) override { return value(std::move(v)); }
+
+    bool start_object(std::size_t) override { return start(json::object()); }
+    bool start_array(std::size_t) override { return start(json::array()); }
+    bool end_object() override { return end(); }
+    bool end_array() override { return end(); }
+
+    bool key(string_t& value) override {
+        if (!stack_.empty()) {
+            key_ = std::move(value);
+        } else if (depth_ == 1) {
+            capturing_ = std::find(keys_.begin(), keys_.end(), value) != keys_.end();
+            if (capturing_) {
+                key_ = std::move(value);
+            }
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        error = ex.what();
+        return false;
+    }
+
+private:
+    std::initializer_list<std::string_view> keys_;
+    std::vector<json*> stack_;
+    std::string key_;
+    int depth_ = 0;
+    bool capturing_ = false; // the current top-level member is wanted
+    size_t found_ = 0;
+
+    bool captured() const { return !stack_.empty() || (depth_ == 1 && capturing_); }
+
+    json* place(json v) {
+        if (!stack_.empty() && stack_.back()->is_array()) {
+            stack_.back()->push_back(std::move(v));
+            return &stack_.back()->back();
+        }
+        json& slot = stack_.empty() ? result[key_] : (*stack_.back())[key_];
+        slot = std::move(v);
+        return &slot;
+    }
+
+    // A top-level member is complete; stop once all of them are in
+    bool member_done() {
+        capturing_ = false;
+        if (++found_ == keys_.size()) {
+            finished = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool value(json v) {
+        if (!captured()) {
+            return true;
+        }
+        place(std::move(v));
+        return stack_.empty() ? member_done() : true;
+    }
+
+    bool start(json v) {
+        if (captured()) {
+            stack_.push_back(place(std::move(v)));
+        }
+        ++depth_;
+        return true;
+    }
+
+    bool end() {
+        --depth_;
+        if (stack_.empty()) {
+            return true;
+        }
+        stack_.pop_back();
+        return stack_.empty() ? member_done() : true;
+    }
+};
+
+/**
+ * @brief SAX handler that fills a WriteFileCommand from its top-level fields
+ */
+class WriteFileCommandDecoder : public nlohmann::json_sax<json> {
+public:
+    WriteFileCommand command;
+    bool has_command = false;
+    bool has_path = false;
+    bool has_content = false;
+    std::string error;
+
+    bool null() override { return other("null"); }
+    bool boolean(bool value) override {
+        if (at_field() && field_ == Field::REQUEST_EXECUTION) {
+            command.request_execution = value;
+            return true;
+        }
+        return other("boolean");
+    }
+    bool number_integer(number_integer_t) override { return other("number"); }
+    bool number_unsigned(number_unsigned_t) override { return other("number"); }
+    bool number_float(number_float_t, const string_t&) override { return other("number"); }
+    bool binary(binary_t&) override { return other("binary"); }
+
+    bool string(string_t& value) override {
+        if (!at_field()) {
+            return depth_ > 0 || fail("command must be a JSON object");
+        }
+        switch (field_) {
+            case Field::COMMAND: command.command = std::move(value); has_command = true; return true;
+            case Field::PATH: command.path = std::move(value); has_path = true; return true;
+            case Field::CONTENT: command.content = std::move(value); has_content = true; return true;
+            case Field::REQUEST_EXECUTION: return type_error("boolean", "string");
+            case Field::OTHER: return true;
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override { return start_container(true); }
+    bool start_array(std::size_t) override { return start_container(false); }
+    bool end_object() override { --depth_; return true; }
+    bool end_array() override { --depth_; return true; }
+
+    bool key(string_t& value) override {
+        if (depth_ == 1) {
+            field_ = value == "command" ? Field::COMMAND
+                   : value == "path" ? Field::PATH
+                   : value == "content" ? Field::CONTENT
+                   : value == "request_execution" ? Field::REQUEST_EXECUTION
+                   : Field::OTHER;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        error = ex.what();
+        return false;
+    }
+
+private:
+    enum class Field { COMMAND, PATH, CONTENT, REQUEST_EXECUTION, OTHER };
+
+    int depth_ = 0;
+    Field field_ = Field::OTHER;
+
+    bool at_field() const { return depth_ == 1; }
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    bool type_error(const char* expected, const char* actual) {
+        static const char* names[] = {"command", "path", "content", "request_execution"};
+        return fail(std::string("field '") + names[static_cast<int>(field_)] +
+                    "' must be a " + expected + ", got " + actual);
+    }
+
+    bool other(const char* type) {
+        if (depth_ == 0) {
+            return fail("command must be a JSON object");
+        }
+        if (at_field() && field_ != Field::OTHER) {
+            return type_error(field_ == Field::REQUEST_EXECUTION ? "boolean" : "string", type);
+        }
+        return true;
+    }
+
+    bool start_container(bool is_object) {
+        if (depth_ == 0 && !is_object) {
+            return fail("command must be a JSON object");
+        }
+        if (at_field() && field_ != Field::OTHER) {
+            return type_error(field_ == Field::REQUEST_EXECUTION ? "boolean" : "string",
+                              is_object ? "object" : "array");
+        }
+        ++depth_;
+        return true;
+    }
+};
+
+} // anonymous namespace
+
+std::optional<std::string> extract_json_string(std::string_view json_text, const JsonPath& path) {
+    PathExtractor extractor(path);
+    json::sax_parse(json_text.begin(), json_text.end(), &extractor);
+    if (extractor.finished) {
+        return std::move(extractor.result);
+    }
+    if (!extractor.error.empty()) {
+        throw JsonExtractError(extractor.error);
+    }
+    return std::nullopt;
+}
+
+std::optional<uint64_t> extract_json_uint(std::string_view json_text, const JsonPath& path) {
+    PathExtractor extractor(path);
+    json::sax_parse(json_text.begin(), json_text.end(), &extractor);
+    if (extractor.finished) {
+        return extractor.number;
+    }
+    if (!extractor.error.empty()) {
+        throw JsonExtractError(extractor.error);
+    }
+    return std::nullopt;
+}
+
+json extract_json_members(std::string_view json_text, std::initializer_list<std::string_view> keys) {
+    MemberExtractor extractor(keys);
+    json::sax_parse(json_text.begin(), json_text.end(), &extractor);
+    if (!extractor.finished && !extractor.error.empty()) {
+        throw JsonExtractError(extractor.error);
+    }
+    return std::move(extractor.result);
+}
+
+WriteFileCommand decode_write_file_command(std::string_view json_text) {
+    WriteFileCommandDecoder decoder;
+    if (!json::sax_parse(json_text.begin(), json_text.end(), &decoder)) {
+        throw JsonExtractError(decoder.error.empty() ? "invalid command JSON" : decoder.error);
+    }
+    if (!decoder.has_command || !decoder.has_path || !decoder.has_content) {
+        const char* missing = !decoder.has_command ? "command" : !decoder.has_path ? "path" : "content";
+        throw JsonExtractError(std::string("command is missing required field '") + missing + "'");
+    }
+    return std::move(decoder.command);
+}
+
+} // namespace mag
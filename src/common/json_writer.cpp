@@ -0,0 +1,133 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+
+namespace mag {
+
+namespace {
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+} // anonymous namespace
+
+void JsonWriter::escape_into(std::string& out, std::string_view text) {
+    size_t run_start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (!needs_escape(c)) {
+            continue;
+        }
+        // Copy the clean run in one go, then the escape
+        out.append(text.data() + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += HEX_DIGITS[c >> 4];
+                out += HEX_DIGITS[c & 0x0F];
+                break;
+        }
+    }
+    out.append(text.data() + run_start, text.size() - run_start);
+}
+
+void JsonWriter::separate() {
+    if (needs_comma_) {
+        out_ += ',';
+    }
+    needs_comma_ = true;
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    separate();
+    out_ += '{';
+    needs_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    out_ += '}';
+    needs_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    separate();
+    out_ += '[';
+    needs_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    out_ += ']';
+    needs_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    separate();
+    out_ += '"';
+    escape_into(out_, name);
+    out_ += "\":";
+    needs_comma_ = false; // the value follows directly
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view text) {
+    separate();
+    out_ += '"';
+    escape_into(out_, text);
+    out_ += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double number) {
+    separate();
+    if (!std::isfinite(number)) {
+        out_ += "null"; // as nlohmann::json does
+        return *this;
+    }
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    std::string_view digits(buffer, static_cast<size_t>(result.ptr - buffer));
+    out_ += digits;
+    if (digits.find_first_of(".e") == std::string_view::npos) {
+        out_ += ".0"; // keep it a float on the wire
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_string() {
+    separate();
+    out_ += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::append_string(std::string_view piece) {
+    escape_into(out_, piece);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_string() {
+    out_ += '"';
+    return *this;
+}
+
+} // namespace mag
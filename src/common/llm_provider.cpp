@@ -3,102 +3,281 @@
 #include "providers/anthropic_provider.h"
 #include "providers/gemini_provider.h"
 #include "providers/mistral_provider.h"
+#include "providers/replay_provider.h"
+#include "config.h"
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <iomanip>
 #include <sstream>
 #include <chrono>
+#include <cctype>
+#include <cstdio>
 
 namespace mag {
 
-std::vector<std::string> ProviderFactory::supported_providers_;
+namespace {
+
+template <typename Provider>
+std::unique_ptr<LLMProvider> make_provider() {
+    return std::make_unique<Provider>();
+}
+
+// In order of preference for auto-detection
+constexpr ProviderDescriptor PROVIDERS[] = {
+    {"anthropic", "ANTHROPIC_API_KEY", APIConfig::ANTHROPIC_DEFAULT_MODEL, APIConfig::ANTHROPIC_BASE_URL,
+     true, make_provider<AnthropicProvider>},
+    {"openai", "OPENAI_API_KEY", APIConfig::OPENAI_DEFAULT_MODEL, APIConfig::OPENAI_BASE_URL,
+     true, make_provider<OpenAIProvider>},
+    {"gemini", "GEMINI_API_KEY", APIConfig::GEMINI_DEFAULT_MODEL, APIConfig::GEMINI_BASE_URL,
+     true, make_provider<GeminiProvider>},
+    {"mistral", "MISTRAL_API_KEY", APIConfig::MISTRAL_DEFAULT_MODEL, APIConfig::MISTRAL_BASE_URL,
+     true, make_provider<MistralProvider>},
+    // Offline: serves a capture file (MAG_REPLAY_FILE)
+    {"replay", "MAG_REPLAY_FILE", "", "", false, make_provider<ReplayProvider>},
+};
+
+} // anonymous namespace
+
+std::span<const ProviderDescriptor> ProviderFactory::descriptors() {
+    return PROVIDERS;
+}
+
+const ProviderDescriptor* ProviderFactory::find_descriptor(std::string_view provider_name) {
+    for (const auto& descriptor : PROVIDERS) {
+        if (descriptor.name == provider_name) {
+            return &descriptor;
+        }
+    }
+    return nullptr;
+}
 
 std::unique_ptr<LLMProvider> ProviderFactory::create_provider(const std::string& provider_name) {
-    if (provider_name == "openai") {
-        return std::make_unique<OpenAIProvider>();
-    } else if (provider_name == "anthropic") {
-        return std::make_unique<AnthropicProvider>();
-    } else if (provider_name == "gemini") {
-        return std::make_unique<GeminiProvider>();
-    } else if (provider_name == "mistral") {
-        return std::make_unique<MistralProvider>();
-    } else {
+    const ProviderDescriptor* descriptor = find_descriptor(provider_name);
+    if (!descriptor) {
         throw std::runtime_error("Unsupported LLM provider: " + provider_name);
     }
+    return descriptor->create();
 }
 
 std::string ProviderFactory::detect_available_provider() {
-    // Check for available API keys in order of preference
-    const char* anthropic_key = std::getenv("ANTHROPIC_API_KEY");
-    if (anthropic_key && strlen(anthropic_key) > 0) {
-        return "anthropic";
-    }
-    
-    const char* openai_key = std::getenv("OPENAI_API_KEY");
-    if (openai_key && strlen(openai_key) > 0) {
-        return "openai";
+    std::vector<std::string> available = detect_available_providers();
+    if (available.empty()) {
+        throw std::runtime_error("No supported LLM provider API key found. Please set one of: ANTHROPIC_API_KEY, OPENAI_API_KEY, GEMINI_API_KEY, MISTRAL_API_KEY");
     }
-    
-    const char* gemini_key = std::getenv("GEMINI_API_KEY");
-    if (gemini_key && strlen(gemini_key) > 0) {
-        return "gemini";
-    }
-    
-    const char* mistral_key = std::getenv("MISTRAL_API_KEY");
-    if (mistral_key && strlen(mistral_key) > 0) {
-        return "mistral";
+    return available.front();
+}
+
+std::vector<std::string> ProviderFactory::detect_available_providers() {
+    // Offline providers are only used when asked for by name
+    std::vector<std::string> available;
+    for (const auto& descriptor : PROVIDERS) {
+        if (!descriptor.requires_api_key) {
+            continue;
+        }
+        const char* key = std::getenv(std::string(descriptor.api_key_env).c_str());
+        if (key && strlen(key) > 0) {
+            available.emplace_back(descriptor.name);
+        }
     }
-    
-    throw std::runtime_error("No supported LLM provider API key found. Please set one of: ANTHROPIC_API_KEY, OPENAI_API_KEY, GEMINI_API_KEY, MISTRAL_API_KEY");
+    return available;
 }
 
 std::vector<std::string> ProviderFactory::get_supported_providers() {
-    if (supported_providers_.empty()) {
-        register_providers();
+    std::vector<std::string> names;
+    for (const auto& descriptor : PROVIDERS) {
+        names.emplace_back(descriptor.name);
     }
-    return supported_providers_;
+    return names;
 }
 
-void ProviderFactory::register_providers() {
-    supported_providers_ = {
-        "anthropic",
-        "openai",
-        "gemini",     // Future implementation
-        "mistral"     // Future implementation
-    };
+// Batch defaults, for providers without a batch API
+ProviderBatchCall LLMProvider::build_batch_submit(
+    const std::string& api_key,
+    const std::vector<std::pair<std::string, nlohmann::json>>& requests
+) const {
+    throw std::runtime_error(get_name() + " has no batch API");
+}
+
+ProviderBatchCall LLMProvider::build_batch_poll(const std::string& api_key, const std::string& batch_id) const {
+    throw std::runtime_error(get_name() + " has no batch API");
+}
+
+ProviderBatchCall LLMProvider::build_batch_results(const std::string& api_key, const PlanBatchStatus& status) const {
+    throw std::runtime_error(get_name() + " has no batch API");
+}
+
+PlanBatchStatus LLMProvider::parse_batch_status(const std::string& response) const {
+    throw std::runtime_error(get_name() + " has no batch API");
+}
+
+std::vector<ProviderBatchEntry> LLMProvider::parse_batch_results(const std::string& response) const {
+    throw std::runtime_error(get_name() + " has no batch API");
 }
 
 // ConversationMessage implementations
 std::string ConversationMessage::get_current_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
+    return format_timestamp(current_time_ms());
+}
+
+int64_t ConversationMessage::current_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string ConversationMessage::format_timestamp(int64_t timestamp_ms) {
+    std::chrono::sys_time<std::chrono::milliseconds> time{std::chrono::milliseconds(timestamp_ms)};
+    auto time_t = std::chrono::system_clock::to_time_t(time);
+    auto ms = timestamp_ms % 1000;
+    if (ms < 0) {
+        ms += 1000;
+    }
     
     std::stringstream ss;
     ss << std::put_time(std::gmtime(&time_t), "%Y-%m-%dT%H:%M:%S");
-    ss << '.' << std::setfill('0') << std::setw(3) << ms.count() << 'Z';
+    ss << '.' << std::setfill('0') << std::setw(3) << ms << 'Z';
     return ss.str();
 }
 
+std::optional<int64_t> ConversationMessage::parse_timestamp(std::string_view timestamp) {
+    // YYYY-MM-DDTHH:MM:SS, optionally with fractional seconds; always UTC
+    int year, month, day, hour, minute, second;
+    int consumed = 0;
+    std::string text(timestamp);
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n",
+                    &year, &month, &day, &hour, &minute, &second, &consumed) != 6) {
+        return std::nullopt;
+    }
+    
+    std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(static_cast<unsigned>(month)),
+                                     std::chrono::day(static_cast<unsigned>(day))};
+    if (!date.ok() || hour > 23 || minute > 59 || second > 60) {
+        return std::nullopt;
+    }
+    int64_t ms = 0;
+    size_t i = static_cast<size_t>(consumed);
+    if (i < text.size() && text[i] == '.') {
+        int64_t scale = 100;
+        for (++i; i < text.size() && std::isdigit(static_cast<unsigned char>(text[i])); ++i) {
+            ms += (text[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    
+    auto time = std::chrono::sys_days(date) + std::chrono::hours(hour) +
+                std::chrono::minutes(minute) + std::chrono::seconds(second);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() + ms;
+}
+
 nlohmann::json ConversationMessage::to_json() const {
     return nlohmann::json{
-        {"role", role},
-        {"content", content},
-        {"timestamp", timestamp},
-        {"provider", provider}
+        {"role", role.str()},
+        {"content", content.view()},
+        {"timestamp", timestamp()},
+        {"provider", provider.str()}
     };
 }
 
 ConversationMessage ConversationMessage::from_json(const nlohmann::json& j) {
-    ConversationMessage msg(j.at("role"), j.at("content"));
-    if (j.contains("timestamp")) {
-        msg.timestamp = j.at("timestamp");
+    ConversationMessage msg(j.at("role").get_ref<const std::string&>(),
+                            j.at("content").get_ref<const std::string&>());
+    if (j.contains("timestamp") && j["timestamp"].is_string()) {
+        if (auto timestamp = parse_timestamp(j["timestamp"].get_ref<const std::string&>())) {
+            msg.timestamp_ms = *timestamp;
+        }
     }
     if (j.contains("provider")) {
-        msg.provider = j.at("provider");
+        msg.provider = j.at("provider").get_ref<const std::string&>();
     }
     return msg;
 }
 
+nlohmann::json ProviderUsage::to_json() const {
+    nlohmann::json j = {
+        {"provider", provider},
+        {"model", model},
+        {"input_tokens", input_tokens},
+        {"output_tokens", output_tokens},
+        {"cached_tokens", cached_tokens},
+        {"cache_write_tokens", cache_write_tokens}
+    };
+    if (!request_id.empty()) {
+        j["request_id"] = request_id;
+    }
+    if (server_latency_ms >= 0) {
+        j["server_latency_ms"] = server_latency_ms;
+    }
+    if (estimated_input_tokens > 0) {
+        j["estimated_input_tokens"] = estimated_input_tokens;
+    }
+    return j;
+}
+
+ProviderUsage ProviderUsage::from_json(const nlohmann::json& j) {
+    ProviderUsage usage;
+    usage.reported = j.is_object();
+    if (!usage.reported) {
+        return usage;
+    }
+    usage.provider = j.value("provider", "");
+    usage.model = j.value("model", "");
+    usage.request_id = j.value("request_id", "");
+    usage.input_tokens = j.value("input_tokens", uint64_t{0});
+    usage.output_tokens = j.value("output_tokens", uint64_t{0});
+    usage.cached_tokens = j.value("cached_tokens", uint64_t{0});
+    usage.cache_write_tokens = j.value("cache_write_tokens", uint64_t{0});
+    usage.server_latency_ms = j.value("server_latency_ms", int64_t{-1});
+    usage.estimated_input_tokens = j.value("estimated_input_tokens", uint64_t{0});
+    return usage;
+}
+
+void UsageTotals::add(const ProviderUsage& usage) {
+    if (!usage.reported) {
+        return;
+    }
+    ++requests;
+    input_tokens += usage.input_tokens;
+    output_tokens += usage.output_tokens;
+    cached_tokens += usage.cached_tokens;
+    cache_write_tokens += usage.cache_write_tokens;
+    if (usage.server_latency_ms >= 0) {
+        server_latency_ms += static_cast<uint64_t>(usage.server_latency_ms);
+        ++timed_requests;
+    }
+}
+
+void UsageTotals::merge(const UsageTotals& other) {
+    requests += other.requests;
+    input_tokens += other.input_tokens;
+    output_tokens += other.output_tokens;
+    cached_tokens += other.cached_tokens;
+    cache_write_tokens += other.cache_write_tokens;
+    server_latency_ms += other.server_latency_ms;
+    timed_requests += other.timed_requests;
+}
+
+nlohmann::json UsageTotals::to_json() const {
+    return nlohmann::json{
+        {"requests", requests},
+        {"input_tokens", input_tokens},
+        {"output_tokens", output_tokens},
+        {"cached_tokens", cached_tokens},
+        {"cache_write_tokens", cache_write_tokens},
+        {"server_latency_ms", server_latency_ms},
+        {"timed_requests", timed_requests}
+    };
+}
+
+UsageTotals UsageTotals::from_json(const nlohmann::json& j) {
+    UsageTotals totals;
+    totals.requests = j.value("requests", uint64_t{0});
+    totals.input_tokens = j.value("input_tokens", uint64_t{0});
+    totals.output_tokens = j.value("output_tokens", uint64_t{0});
+    totals.cached_tokens = j.value("cached_tokens", uint64_t{0});
+    totals.cache_write_tokens = j.value("cache_write_tokens", uint64_t{0});
+    totals.server_latency_ms = j.value("server_latency_ms", uint64_t{0});
+    totals.timed_requests = j.value("timed_requests", uint64_t{0});
+    return totals;
+}
+
 } // namespace mag
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include "logger.h"
+#include "config.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <stdexcept>
+
+namespace mag {
+
+namespace {
+
+std::string format_timestamp(std::chrono::system_clock::time_point time) {
+    auto seconds = std::chrono::system_clock::to_time_t(time);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()) % 1000;
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    std::ostringstream ss;
+    ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << ms.count() << 'Z';
+    return ss.str();
+}
+
+} // namespace
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : queue_(LogConfig::QUEUE_CAPACITY)
+    , min_level_(static_cast<int>(LogLevel::INFO))
+    , payload_limit_(LogConfig::DEFAULT_PAYLOAD_LIMIT) {
+    const char* spec = std::getenv("MAG_LOG");
+    try {
+        configure(spec && *spec ? spec : LogConfig::DEFAULT_SPEC);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Ignoring MAG_LOG: %s\n", e.what());
+        configure(LogConfig::DEFAULT_SPEC);
+    }
+    
+    const char* format = std::getenv("MAG_LOG_FORMAT");
+    if (format && std::string(format) == "json") {
+        format_.store(LogFormat::JSON);
+    }
+    
+    const char* limit = std::getenv("MAG_LOG_PAYLOAD_MAX");
+    if (limit && *limit) {
+        payload_limit_.store(std::strtoul(limit, nullptr, 10));
+    }
+    
+    const char* path = std::getenv("MAG_LOG_FILE");
+    if (path && *path) {
+        file_ = std::fopen(path, "a");
+        if (!file_) {
+            std::fprintf(stderr, "Cannot open MAG_LOG_FILE %s; logging to stderr\n", path);
+        }
+    }
+    
+    consumer_ = std::thread([this] { run(); });
+}
+
+Logger::~Logger() {
+    running_.store(false);
+    wake_consumer();
+    if (consumer_.joinable()) {
+        consumer_.join();
+    }
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+void Logger::configure(const std::string& spec) {
+    LogLevel default_level = LogLevel::INFO;
+    std::map<std::string, LogLevel, std::less<>> component_levels;
+    
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), [](unsigned char c) { return std::isspace(c); }),
+                   item.end());
+        if (item.empty()) {
+            continue;
+        }
+        size_t eq = item.find('=');
+        std::string level_name = eq == std::string::npos ? item : item.substr(eq + 1);
+        auto level = parse_level(level_name);
+        if (!level) {
+            throw std::runtime_error("Unknown log level: " + level_name);
+        }
+        if (eq == std::string::npos) {
+            default_level = *level;
+        } else {
+            component_levels[item.substr(0, eq)] = *level;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(filter_mutex_);
+    default_level_ = default_level;
+    component_levels_ = std::move(component_levels);
+    recompute_min_level_locked();
+}
+
+void Logger::set_level(LogLevel level) {
+    std::unique_lock<std::shared_mutex> lock(filter_mutex_);
+    default_level_ = level;
+    recompute_min_level_locked();
+}
+
+void Logger::set_component_level(const std::string& component, LogLevel level) {
+    std::unique_lock<std::shared_mutex> lock(filter_mutex_);
+    component_levels_[component] = level;
+    recompute_min_level_locked();
+}
+
+void Logger::set_format(LogFormat format) {
+    format_.store(format);
+}
+
+void Logger::set_sink(Sink sink) {
+    flush();
+    std::lock_guard<std::mutex> lock(sink_mutex_);
+    sink_ = std::move(sink);
+}
+
+void Logger::recompute_min_level_locked() {
+    LogLevel lowest = default_level_;
+    for (const auto& [component, level] : component_levels_) {
+        lowest = std::min(lowest, level);
+    }
+    min_level_.store(static_cast<int>(lowest), std::memory_order_relaxed);
+}
+
+bool Logger::passes_filter(LogLevel level, std::string_view component) const {
+    if (level == LogLevel::OFF) {
+        return false;
+    }
+    std::shared_lock<std::shared_mutex> lock(filter_mutex_);
+    auto it = component_levels_.find(component);
+    LogLevel threshold = it == component_levels_.end() ? default_level_ : it->second;
+    return level >= threshold;
+}
+
+void Logger::log(LogLevel level, std::string_view component, std::string message) {
+    LogRecord record;
+    record.level = level;
+    record.component.assign(component.data(), component.size());
+    record.message = std::move(message);
+    record.time = std::chrono::system_clock::now();
+    record.thread_hash = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    
+    if (!queue_.try_push(std::move(record))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    accepted_.fetch_add(1, std::memory_order_release);
+    
+    // Pairs with the fence in run(): either we see the consumer waiting or it sees our record
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting_.load(std::memory_order_relaxed)) {
+        wake_consumer();
+    }
+}
+
+void Logger::wake_consumer() {
+    wake_signal_.fetch_add(1, std::memory_order_release);
+    wake_signal_.notify_one();
+}
+
+void Logger::flush() {
+    uint64_t target = accepted_.load(std::memory_order_acquire);
+    wake_consumer();
+    uint64_t written = written_.load(std::memory_order_acquire);
+    while (written < target) {
+        written_.wait(written, std::memory_order_acquire);
+        written = written_.load(std::memory_order_acquire);
+    }
+}
+
+void Logger::run() {
+    LogRecord record;
+    while (true) {
+        uint64_t batch = 0;
+        while (queue_.try_pop(record)) {
+            write_line(record);
+            ++batch;
+        }
+        
+        size_t dropped = dropped_.load(std::memory_order_relaxed);
+        size_t reported = dropped_reported_.load(std::memory_order_relaxed);
+        if (dropped > reported) {
+            dropped_reported_.store(dropped, std::memory_order_relaxed);
+            LogRecord notice{LogLevel::WARN, "log",
+                             std::to_string(dropped - reported) + " log records dropped (queue full)",
+                             std::chrono::system_clock::now(), 0};
+            write_line(notice);
+        }
+        
+        if (batch > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                std::fflush(file_ ? file_ : stderr);
+            }
+            written_.fetch_add(batch, std::memory_order_release);
+            written_.notify_all();
+            continue;
+        }
+        
+        if (!running_.load() && queue_.empty()) {
+            break;
+        }
+        
+        uint32_t seen = wake_signal_.load(std::memory_order_acquire);
+        consumer_waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!queue_.empty() || !running_.load()) {
+            // Work raced in (or shutdown): spin back instead of sleeping
+            consumer_waiting_.store(false, std::memory_order_relaxed);
+            if (!running_.load() && queue_.empty()) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        wake_signal_.wait(seen, std::memory_order_acquire);
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::write_line(const LogRecord& record) {
+    std::string line;
+    if (format_.load(std::memory_order_relaxed) == LogFormat::JSON) {
+        nlohmann::json j = {
+            {"ts", format_timestamp(record.time)},
+            {"level", level_name(record.level)},
+            {"component", record.component},
+            {"thread", record.thread_hash},
+            {"msg", record.message}
+        };
+        line = j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    } else {
+        std::ostringstream ss;
+        ss << format_timestamp(record.time) << ' ' << std::left << std::setw(5) << level_name(record.level)
+           << " [" << record.component << "] " << record.message;
+        line = ss.str();
+    }
+    
+    std::lock_guard<std::mutex> lock(sink_mutex_);
+    if (sink_) {
+        sink_(line);
+        return;
+    }
+    FILE* out = file_ ? file_ : stderr;
+    std::fwrite(line.data(), 1, line.size(), out);
+    std::fputc('\n', out);
+}
+
+std::string Logger::truncate(std::string_view payload, size_t max_bytes) {
+    if (payload.size() <= max_bytes) {
+        return std::string(payload);
+    }
+    std::string result(payload.substr(0, max_bytes));
+    result += "...(" + std::to_string(payload.size() - max_bytes) + " more bytes)";
+    return result;
+}
+
+const char* Logger::level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::TRACE: return "TRACE";
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::WARN: return "WARN";
+        case LogLevel::ERROR: return "ERROR";
+        case LogLevel::OFF: return "OFF";
+    }
+    return "INFO";
+}
+
+std::optional<LogLevel> Logger::parse_level(std::string_view name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower == "trace") return LogLevel::TRACE;
+    if (lower == "debug") return LogLevel::DEBUG;
+    if (lower == "info") return LogLevel::INFO;
+    if (lower == "warn" || lower == "warning") return LogLevel::WARN;
+    if (lower == "error") return LogLevel::ERROR;
+    if (lower == "off" || lower == "none") return LogLevel::OFF;
+    return std::nullopt;
+}
+
+} // namespace mag
@@ -1,7 +1,11 @@
 #include "message.h"
+#include "config.h"
 #include <stdexcept>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
 
 namespace mag {
 
@@ -12,7 +16,7 @@ void GenericCommand::to_json(nlohmann::json& j) const {
         {"description", description}
     };
     
-    if (type == OperationType::FILE_WRITE) {
+    if (is_file_operation()) {
         j["file_path"] = file_path;
         j["file_content"] = file_content;
     } else if (type == OperationType::BASH_COMMAND) {
@@ -25,9 +29,9 @@ void GenericCommand::from_json(const nlohmann::json& j) {
     type = static_cast<OperationType>(j.at("type").get<int>());
     j.at("description").get_to(description);
     
-    if (type == OperationType::FILE_WRITE) {
+    if (is_file_operation()) {
         if (j.contains("file_path")) j.at("file_path").get_to(file_path);
-        if (j.contains("file_content")) j.at("file_content").get_to(file_content);
+        if (j.contains("file_content")) file_content = WireCodec::get_bytes(j, "file_content");
     } else if (type == OperationType::BASH_COMMAND) {
         if (j.contains("bash_command")) j.at("bash_command").get_to(bash_command);
         if (j.contains("working_directory")) j.at("working_directory").get_to(working_directory);
@@ -36,8 +40,8 @@ void GenericCommand::from_json(const nlohmann::json& j) {
 
 WriteFileCommand GenericCommand::to_write_file_command() const {
     WriteFileCommand cmd;
-    if (type == OperationType::FILE_WRITE) {
-        cmd.command = "write";
+    if (is_file_operation()) {
+        cmd.command = type == OperationType::FILE_PATCH ? WriteFileCommand::PATCH : "write";
         cmd.path = file_path;
         cmd.content = file_content;
     } else {
@@ -49,6 +53,8 @@ WriteFileCommand GenericCommand::to_write_file_command() const {
 std::string GenericCommand::get_operation_summary() const {
     if (type == OperationType::FILE_WRITE) {
         return "WriteFile " + file_path;
+    } else if (type == OperationType::FILE_PATCH) {
+        return "PatchFile " + file_path;
     } else if (type == OperationType::BASH_COMMAND) {
         return "BashCommand: " + bash_command;
     }
@@ -78,10 +84,10 @@ void ExecutionContext::from_json(const nlohmann::json& j) {
         j.at("working_directory_after").get_to(working_directory_after);
     }
     if (j.contains("command_output")) {
-        j.at("command_output").get_to(command_output);
+        command_output = WireCodec::get_bytes(j, "command_output");
     }
     if (j.contains("command_stderr")) {
-        j.at("command_stderr").get_to(command_stderr);
+        command_stderr = WireCodec::get_bytes(j, "command_stderr");
     }
     if (j.contains("exit_code")) {
         j.at("exit_code").get_to(exit_code);
@@ -132,7 +138,7 @@ void WriteFileCommand::to_json(nlohmann::json& j) const {
 void WriteFileCommand::from_json(const nlohmann::json& j) {
     j.at("command").get_to(command);
     j.at("path").get_to(path);
-    j.at("content").get_to(content);
+    content = WireCodec::get_bytes(j, "content");
     if (j.contains("request_execution")) {
         j.at("request_execution").get_to(request_execution);
     }
@@ -177,6 +183,12 @@ void DryRunResult::to_json(nlohmann::json& j) const {
         {"success", success},
         {"error_message", error_message}
     };
+    if (!diff.empty()) {
+        j["diff"] = diff;
+    }
+    if (unchanged) {
+        j["unchanged"] = true;
+    }
 }
 
 void DryRunResult::from_json(const nlohmann::json& j) {
@@ -185,6 +197,8 @@ void DryRunResult::from_json(const nlohmann::json& j) {
     if (j.contains("error_message")) {
         j.at("error_message").get_to(error_message);
     }
+    diff = j.value("diff", "");
+    unchanged = j.value("unchanged", false);
 }
 
 void ApplyResult::to_json(nlohmann::json& j) const {
@@ -198,6 +212,9 @@ void ApplyResult::to_json(nlohmann::json& j) const {
     nlohmann::json context_json;
     execution_context.to_json(context_json);
     j["execution_context"] = context_json;
+    if (unchanged) {
+        j["unchanged"] = true;
+    }
 }
 
 void ApplyResult::from_json(const nlohmann::json& j) {
@@ -211,6 +228,230 @@ void ApplyResult::from_json(const nlohmann::json& j) {
     if (j.contains("execution_context")) {
         execution_context.from_json(j.at("execution_context"));
     }
+    unchanged = j.value("unchanged", false);
+}
+
+void ReadFileRequest::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{{"path", path}};
+    if (by_lines()) {
+        j["first_line"] = first_line;
+        j["last_line"] = last_line;
+    } else {
+        j["offset"] = offset;
+        j["length"] = length;
+    }
+}
+
+void ReadFileRequest::from_json(const nlohmann::json& j) {
+    j.at("path").get_to(path);
+    offset = j.value("offset", uint64_t{0});
+    length = j.value("length", uint64_t{0});
+    first_line = j.value("first_line", size_t{0});
+    last_line = j.value("last_line", size_t{0});
+}
+
+void ReadFileResult::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"success", success},
+        {"offset", offset},
+        {"file_size", file_size}
+    };
+    if (!error_message.empty()) {
+        j["error_message"] = error_message;
+    }
+    if (first_line > 0) {
+        j["first_line"] = first_line;
+        j["last_line"] = last_line;
+    }
+    if (truncated) {
+        j["truncated"] = true;
+    }
+}
+
+void ReadFileResult::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    content = j.contains("content") ? WireCodec::get_bytes(j, "content") : "";
+    offset = j.value("offset", uint64_t{0});
+    file_size = j.value("file_size", uint64_t{0});
+    first_line = j.value("first_line", size_t{0});
+    last_line = j.value("last_line", size_t{0});
+    truncated = j.value("truncated", false);
+}
+
+void FileTransferRequest::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{{"transfer_id", transfer_id}, {"path", path}, {"size", size}, {"hash", hash}, {"offset", offset}};
+}
+
+void FileTransferRequest::from_json(const nlohmann::json& j) {
+    transfer_id = j.value("transfer_id", "");
+    path = j.value("path", "");
+    size = j.value("size", uint64_t{0});
+    hash = j.value("hash", uint64_t{0});
+    offset = j.value("offset", uint64_t{0});
+}
+
+void FileTransferReply::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"success", success},
+        {"transfer_id", transfer_id},
+        {"chunk_size", chunk_size},
+        {"received", received}
+    };
+    if (!error_message.empty()) {
+        j["error_message"] = error_message;
+    }
+}
+
+void FileTransferReply::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    transfer_id = j.value("transfer_id", "");
+    chunk_size = j.value("chunk_size", uint64_t{0});
+    received = j.value("received", uint64_t{0});
+}
+
+void FileStatResult::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"success", success},
+        {"exists", exists},
+        {"is_directory", is_directory},
+        {"size", size},
+        {"modified", modified},
+        {"mode", mode}
+    };
+    if (!error_message.empty()) {
+        j["error_message"] = error_message;
+    }
+}
+
+void FileStatResult::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    exists = j.value("exists", false);
+    is_directory = j.value("is_directory", false);
+    size = j.value("size", uint64_t{0});
+    modified = j.value("modified", int64_t{0});
+    mode = j.value("mode", uint32_t{0});
+}
+
+void ContextSlice::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"success", success},
+        {"context", context},
+        {"files", files},
+        {"tokens", tokens}
+    };
+    if (!error_message.empty()) {
+        j["error_message"] = error_message;
+    }
+}
+
+void ContextSlice::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    context = j.value("context", "");
+    files = j.value("files", size_t{0});
+    tokens = j.value("tokens", size_t{0});
+}
+
+void PlanBatchStatus::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"id", id},
+        {"provider", provider},
+        {"state", state},
+        {"ended", ended},
+        {"total", total},
+        {"succeeded", succeeded},
+        {"failed", failed},
+        {"results", results}
+    };
+    if (!error_message.empty()) {
+        j["error_message"] = error_message;
+    }
+}
+
+void PlanBatchStatus::from_json(const nlohmann::json& j) {
+    j.at("id").get_to(id);
+    provider = j.value("provider", "");
+    state = j.value("state", "");
+    ended = j.value("ended", false);
+    total = j.value("total", size_t{0});
+    succeeded = j.value("succeeded", size_t{0});
+    failed = j.value("failed", size_t{0});
+    results = j.value("results", "");
+    error_message = j.value("error_message", "");
+}
+
+void PlanBatchResult::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"id", id},
+        {"success", success}
+    };
+    if (success) {
+        command.to_json(j["command"]);
+    } else {
+        j["error_message"] = error_message;
+    }
+}
+
+void PlanBatchResult::from_json(const nlohmann::json& j) {
+    j.at("id").get_to(id);
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    if (j.contains("command")) {
+        command.from_json(j["command"]);
+    }
+}
+
+void BatchDryRunResult::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"results", nlohmann::json::array()},
+        {"success", success},
+        {"error_message", error_message}
+    };
+    for (const auto& result : results) {
+        nlohmann::json item;
+        result.to_json(item);
+        j["results"].push_back(std::move(item));
+    }
+}
+
+void BatchDryRunResult::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    error_message = j.value("error_message", "");
+    results.clear();
+    for (const auto& item : j.at("results")) {
+        DryRunResult result;
+        result.from_json(item);
+        results.push_back(std::move(result));
+    }
+}
+
+void BatchApplyResult::to_json(nlohmann::json& j) const {
+    j = nlohmann::json{
+        {"results", nlohmann::json::array()},
+        {"success", success},
+        {"rolled_back", rolled_back},
+        {"error_message", error_message}
+    };
+    for (const auto& result : results) {
+        nlohmann::json item;
+        result.to_json(item);
+        j["results"].push_back(std::move(item));
+    }
+}
+
+void BatchApplyResult::from_json(const nlohmann::json& j) {
+    j.at("success").get_to(success);
+    rolled_back = j.value("rolled_back", false);
+    error_message = j.value("error_message", "");
+    results.clear();
+    for (const auto& item : j.at("results")) {
+        ApplyResult result;
+        result.from_json(item);
+        results.push_back(std::move(result));
+    }
 }
 
 std::string ApplyResult::get_execution_summary() const {
@@ -226,66 +467,494 @@ bool ApplyResult::has_context_output() const {
     return execution_context.has_output();
 }
 
-std::string MessageHandler::serialize_command(const WriteFileCommand& cmd) {
+WireFormat WireCodec::detect(std::string_view payload) {
+    if (!payload.empty()) {
+        auto first = static_cast<unsigned char>(payload.front());
+        if (first >= 0x80 && first <= 0x8f) {
+            return WireFormat::MSGPACK; // fixmap
+        }
+        if (first >= 0xa0 && first <= 0xbf) {
+            return WireFormat::CBOR; // map
+        }
+    }
+    return WireFormat::JSON;
+}
+
+nlohmann::json WireCodec::decode(std::string_view payload) {
+    switch (detect(payload)) {
+        case WireFormat::MSGPACK:
+            return nlohmann::json::from_msgpack(payload.begin(), payload.end());
+        case WireFormat::CBOR:
+            return nlohmann::json::from_cbor(payload.begin(), payload.end());
+        case WireFormat::JSON:
+            break;
+    }
+    return nlohmann::json::parse(payload);
+}
+
+std::string WireCodec::encode(const nlohmann::json& j, WireFormat format) {
+    std::string out;
+    switch (format) {
+        case WireFormat::MSGPACK:
+            nlohmann::json::to_msgpack(j, out);
+            return out;
+        case WireFormat::CBOR:
+            nlohmann::json::to_cbor(j, out);
+            return out;
+        case WireFormat::JSON:
+            break;
+    }
+    return j.dump();
+}
+
+namespace {
+
+// Buffers encoder output and hands it to a WireSink in blocks, so small
+// tokens do not cost a virtual call each
+class SinkStreambuf : public std::streambuf {
+public:
+    explicit SinkStreambuf(WireSink& sink) : sink_(sink) {
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+    
+    void flush() {
+        if (pptr() > pbase()) {
+            sink_.write(pbase(), static_cast<size_t>(pptr() - pbase()));
+            setp(buffer_, buffer_ + sizeof(buffer_));
+        }
+    }
+    
+protected:
+    int_type overflow(int_type c) override {
+        flush();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        if (size > static_cast<std::streamsize>(epptr() - pptr())) {
+            // Large fields (file content) skip the buffer
+            flush();
+            sink_.write(data, static_cast<size_t>(size));
+            return size;
+        }
+        std::memcpy(pptr(), data, static_cast<size_t>(size));
+        pbump(static_cast<int>(size));
+        return size;
+    }
+    
+    int sync() override {
+        flush();
+        return 0;
+    }
+    
+private:
+    WireSink& sink_;
+    char buffer_[4096];
+};
+
+} // anonymous namespace
+
+void WireCodec::encode(const nlohmann::json& j, WireFormat format, WireSink& sink) {
+    SinkStreambuf buffer(sink);
+    std::ostream out(&buffer);
+    out.exceptions(std::ios::badbit);
+    switch (format) {
+        case WireFormat::MSGPACK:
+            nlohmann::json::to_msgpack(j, out);
+            break;
+        case WireFormat::CBOR:
+            nlohmann::json::to_cbor(j, out);
+            break;
+        case WireFormat::JSON:
+            out << j;
+            break;
+    }
+    buffer.flush();
+}
+
+WireFormat WireCodec::configured() {
+    static const WireFormat format = parse_format(WireConfig::get_format());
+    return format;
+}
+
+WireFormat WireCodec::parse_format(const std::string& name) {
+    if (name == "msgpack") {
+        return WireFormat::MSGPACK;
+    }
+    if (name == "cbor") {
+        return WireFormat::CBOR;
+    }
+    return WireFormat::JSON;
+}
+
+const char* WireCodec::format_name(WireFormat format) {
+    switch (format) {
+        case WireFormat::MSGPACK: return "msgpack";
+        case WireFormat::CBOR: return "cbor";
+        case WireFormat::JSON: break;
+    }
+    return "json";
+}
+
+void WireCodec::set_bytes(nlohmann::json& j, const char* key, const std::string& bytes, WireFormat format) {
+    if (format == WireFormat::JSON) {
+        j[key] = bytes;
+        return;
+    }
+    j[key] = nlohmann::json::binary(std::vector<std::uint8_t>(bytes.begin(), bytes.end()));
+}
+
+std::string WireCodec::get_bytes(const nlohmann::json& j, const char* key) {
+    const nlohmann::json& value = j.at(key);
+    if (value.is_binary()) {
+        const auto& bytes = value.get_binary();
+        return std::string(bytes.begin(), bytes.end());
+    }
+    return value.get<std::string>();
+}
+
+namespace {
+
+void append_big_endian(std::string& out, uint64_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out += static_cast<char>((value >> shift) & 0xFF);
+    }
+}
+
+// MessagePack bin or CBOR byte string header for size bytes
+void append_bytes_header(std::string& out, size_t size, WireFormat format) {
+    if (format == WireFormat::MSGPACK) {
+        if (size <= 0xFF) {
+            out += static_cast<char>(0xc4);
+            append_big_endian(out, size, 1);
+        } else if (size <= 0xFFFF) {
+            out += static_cast<char>(0xc5);
+            append_big_endian(out, size, 2);
+        } else {
+            out += static_cast<char>(0xc6);
+            append_big_endian(out, size, 4);
+        }
+        return;
+    }
+    if (size < 24) {
+        out += static_cast<char>(0x40 | size);
+    } else if (size <= 0xFF) {
+        out += static_cast<char>(0x58);
+        append_big_endian(out, size, 1);
+    } else if (size <= 0xFFFF) {
+        out += static_cast<char>(0x59);
+        append_big_endian(out, size, 2);
+    } else if (size <= 0xFFFFFFFF) {
+        out += static_cast<char>(0x5a);
+        append_big_endian(out, size, 4);
+    } else {
+        out += static_cast<char>(0x5b);
+        append_big_endian(out, size, 8);
+    }
+}
+
+} // anonymous namespace
+
+void WireCodec::encode_with_bytes(const nlohmann::json& j, const char* key, std::string_view bytes,
+                                  WireFormat format, WireSink& sink) {
+    size_t key_length = std::strlen(key);
+    if (!j.is_object() || j.size() >= 15 || j.contains(key) || key_length >= 24) {
+        throw std::invalid_argument("encode_with_bytes needs a small object without \"" + std::string(key) + "\"");
+    }
+    if (format == WireFormat::JSON) {
+        nlohmann::json with_bytes = j;
+        with_bytes[key] = std::string(bytes);
+        encode(with_bytes, format, sink);
+        return;
+    }
+    if (format == WireFormat::MSGPACK && bytes.size() > 0xFFFFFFFF) {
+        throw std::invalid_argument("MessagePack byte fields are limited to 4 GiB");
+    }
+    
+    // A small map carries its entry count in the first byte (fixmap 0x8N, CBOR 0xAN),
+    // so the extra entry is one increment and an append
+    std::string head = encode(j, format);
+    head[0] = static_cast<char>(head[0] + 1);
+    head += static_cast<char>((format == WireFormat::MSGPACK ? 0xa0 : 0x60) | key_length);
+    head.append(key, key_length);
+    append_bytes_header(head, bytes.size(), format);
+    sink.write(head.data(), head.size());
+    if (!bytes.empty()) {
+        sink.write(bytes.data(), bytes.size());
+    }
+}
+
+void MessageHandler::encode_command_bytes(nlohmann::json& j, const WriteFileCommand& cmd, WireFormat format) {
+    if (format != WireFormat::JSON) {
+        WireCodec::set_bytes(j, "content", cmd.content, format);
+    }
+}
+
+void MessageHandler::encode_context_bytes(nlohmann::json& j, const ExecutionContext& context, WireFormat format) {
+    if (format != WireFormat::JSON) {
+        WireCodec::set_bytes(j, "command_output", context.command_output, format);
+        WireCodec::set_bytes(j, "command_stderr", context.command_stderr, format);
+    }
+}
+
+namespace {
+
+nlohmann::json command_message(const WriteFileCommand& cmd, WireFormat format) {
     nlohmann::json j;
     cmd.to_json(j);
-    return j.dump();
+    MessageHandler::encode_command_bytes(j, cmd, format);
+    return j;
+}
+
+nlohmann::json file_command_object(const WriteFileCommand& cmd, WireFormat format) {
+    nlohmann::json command = {
+        {"command", cmd.command},
+        {"path", cmd.path}
+    };
+    WireCodec::set_bytes(command, "content", cmd.content, format);
+    return command;
+}
+
+nlohmann::json file_request_message(const std::string& operation, const WriteFileCommand& cmd, WireFormat format) {
+    return {{"operation", operation}, {"command", file_command_object(cmd, format)}};
+}
+
+nlohmann::json file_batch_request_message(const std::string& operation, const std::vector<WriteFileCommand>& commands,
+                                          bool all_or_nothing, WireFormat format) {
+    nlohmann::json items = nlohmann::json::array();
+    for (const auto& cmd : commands) {
+        items.push_back(file_command_object(cmd, format));
+    }
+    return {{"operation", operation}, {"commands", std::move(items)}, {"all_or_nothing", all_or_nothing}};
+}
+
+nlohmann::json dry_run_message(const DryRunResult& result) {
+    nlohmann::json j;
+    result.to_json(j);
+    return j;
 }
 
-WriteFileCommand MessageHandler::deserialize_command(const std::string& json_str) {
-    nlohmann::json j = nlohmann::json::parse(json_str);
+nlohmann::json apply_message(const ApplyResult& result, WireFormat format) {
+    nlohmann::json j;
+    result.to_json(j);
+    MessageHandler::encode_context_bytes(j["execution_context"], result.execution_context, format);
+    return j;
+}
+
+nlohmann::json batch_apply_message(const BatchApplyResult& result, WireFormat format) {
+    nlohmann::json j;
+    result.to_json(j);
+    for (size_t i = 0; i < result.results.size(); ++i) {
+        MessageHandler::encode_context_bytes(j["results"][i]["execution_context"],
+                                             result.results[i].execution_context, format);
+    }
+    return j;
+}
+
+} // anonymous namespace
+
+std::string MessageHandler::serialize_command(const WriteFileCommand& cmd, WireFormat format) {
+    return WireCodec::encode(command_message(cmd, format), format);
+}
+
+void MessageHandler::serialize_command(const WriteFileCommand& cmd, WireFormat format, WireSink& sink) {
+    WireCodec::encode(command_message(cmd, format), format, sink);
+}
+
+WriteFileCommand MessageHandler::deserialize_command(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
     WriteFileCommand cmd;
     cmd.from_json(j);
     return cmd;
 }
 
-std::string MessageHandler::serialize_dry_run_result(const DryRunResult& result) {
+std::string MessageHandler::serialize_file_request(const std::string& operation, const WriteFileCommand& cmd,
+                                                   WireFormat format) {
+    return WireCodec::encode(file_request_message(operation, cmd, format), format);
+}
+
+void MessageHandler::serialize_file_request(const std::string& operation, const WriteFileCommand& cmd,
+                                            WireFormat format, WireSink& sink) {
+    WireCodec::encode(file_request_message(operation, cmd, format), format, sink);
+}
+
+std::string MessageHandler::serialize_file_batch_request(const std::string& operation,
+                                                         const std::vector<WriteFileCommand>& commands,
+                                                         bool all_or_nothing, WireFormat format) {
+    return WireCodec::encode(file_batch_request_message(operation, commands, all_or_nothing, format), format);
+}
+
+void MessageHandler::serialize_file_batch_request(const std::string& operation,
+                                                  const std::vector<WriteFileCommand>& commands,
+                                                  bool all_or_nothing, WireFormat format, WireSink& sink) {
+    WireCodec::encode(file_batch_request_message(operation, commands, all_or_nothing, format), format, sink);
+}
+
+std::string MessageHandler::serialize_batch_dry_run_result(const BatchDryRunResult& result, WireFormat format) {
     nlohmann::json j;
     result.to_json(j);
-    return j.dump();
+    return WireCodec::encode(j, format);
 }
 
-DryRunResult MessageHandler::deserialize_dry_run_result(const std::string& json_str) {
-    nlohmann::json j = nlohmann::json::parse(json_str);
-    DryRunResult result;
+void MessageHandler::serialize_batch_dry_run_result(const BatchDryRunResult& result, WireFormat format,
+                                                    WireSink& sink) {
+    nlohmann::json j;
+    result.to_json(j);
+    WireCodec::encode(j, format, sink);
+}
+
+BatchDryRunResult MessageHandler::deserialize_batch_dry_run_result(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
+    BatchDryRunResult result;
     result.from_json(j);
     return result;
 }
 
-std::string MessageHandler::serialize_apply_result(const ApplyResult& result) {
+std::string MessageHandler::serialize_batch_apply_result(const BatchApplyResult& result, WireFormat format) {
+    return WireCodec::encode(batch_apply_message(result, format), format);
+}
+
+void MessageHandler::serialize_batch_apply_result(const BatchApplyResult& result, WireFormat format, WireSink& sink) {
+    WireCodec::encode(batch_apply_message(result, format), format, sink);
+}
+
+BatchApplyResult MessageHandler::deserialize_batch_apply_result(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
+    BatchApplyResult result;
+    result.from_json(j);
+    return result;
+}
+
+void MessageHandler::serialize_read_request(const std::string& operation, const ReadFileRequest& request,
+                                            WireFormat format, WireSink& sink) {
+    nlohmann::json read;
+    request.to_json(read);
+    WireCodec::encode(nlohmann::json{{"operation", operation}, {"read", std::move(read)}}, format, sink);
+}
+
+void MessageHandler::serialize_read_result(const ReadFileResult& result, std::string_view content,
+                                           WireFormat format, WireSink& sink) {
     nlohmann::json j;
     result.to_json(j);
-    return j.dump();
+    WireCodec::encode_with_bytes(j, "content", content, format, sink);
+}
+
+ReadFileResult MessageHandler::deserialize_read_result(std::string_view data) {
+    ReadFileResult result;
+    result.from_json(WireCodec::decode(data));
+    return result;
+}
+
+void MessageHandler::serialize_transfer_request(const std::string& operation, const FileTransferRequest& request,
+                                                std::string_view data, WireFormat format, WireSink& sink) {
+    nlohmann::json transfer;
+    request.to_json(transfer);
+    nlohmann::json j{{"operation", operation}, {"transfer", std::move(transfer)}};
+    if (data.empty()) {
+        WireCodec::encode(j, format, sink);
+    } else {
+        WireCodec::encode_with_bytes(j, "data", data, format, sink);
+    }
+}
+
+void MessageHandler::serialize_transfer_reply(const FileTransferReply& reply, WireFormat format, WireSink& sink) {
+    nlohmann::json j;
+    reply.to_json(j);
+    WireCodec::encode(j, format, sink);
 }
 
-ApplyResult MessageHandler::deserialize_apply_result(const std::string& json_str) {
-    nlohmann::json j = nlohmann::json::parse(json_str);
+FileTransferReply MessageHandler::deserialize_transfer_reply(std::string_view data) {
+    FileTransferReply reply;
+    reply.from_json(WireCodec::decode(data));
+    return reply;
+}
+
+void MessageHandler::serialize_stat_result(const FileStatResult& result, WireFormat format, WireSink& sink) {
+    nlohmann::json j;
+    result.to_json(j);
+    WireCodec::encode(j, format, sink);
+}
+
+FileStatResult MessageHandler::deserialize_stat_result(std::string_view data) {
+    FileStatResult result;
+    result.from_json(WireCodec::decode(data));
+    return result;
+}
+
+void MessageHandler::serialize_context_request(const std::string& query, size_t budget_tokens, WireFormat format,
+                                               WireSink& sink) {
+    WireCodec::encode(nlohmann::json{{"operation", "context"}, {"query", query}, {"budget", budget_tokens}},
+                      format, sink);
+}
+
+void MessageHandler::serialize_context_slice(const ContextSlice& slice, WireFormat format, WireSink& sink) {
+    nlohmann::json j;
+    slice.to_json(j);
+    WireCodec::encode(j, format, sink);
+}
+
+ContextSlice MessageHandler::deserialize_context_slice(std::string_view data) {
+    ContextSlice slice;
+    slice.from_json(WireCodec::decode(data));
+    return slice;
+}
+
+std::string MessageHandler::serialize_dry_run_result(const DryRunResult& result, WireFormat format) {
+    return WireCodec::encode(dry_run_message(result), format);
+}
+
+void MessageHandler::serialize_dry_run_result(const DryRunResult& result, WireFormat format, WireSink& sink) {
+    WireCodec::encode(dry_run_message(result), format, sink);
+}
+
+DryRunResult MessageHandler::deserialize_dry_run_result(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
+    DryRunResult result;
+    result.from_json(j);
+    return result;
+}
+
+std::string MessageHandler::serialize_apply_result(const ApplyResult& result, WireFormat format) {
+    return WireCodec::encode(apply_message(result, format), format);
+}
+
+void MessageHandler::serialize_apply_result(const ApplyResult& result, WireFormat format, WireSink& sink) {
+    WireCodec::encode(apply_message(result, format), format, sink);
+}
+
+ApplyResult MessageHandler::deserialize_apply_result(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
     ApplyResult result;
     result.from_json(j);
     return result;
 }
 
-std::string MessageHandler::serialize_execution_context(const ExecutionContext& context) {
+std::string MessageHandler::serialize_execution_context(const ExecutionContext& context, WireFormat format) {
     nlohmann::json j;
     context.to_json(j);
-    return j.dump();
+    encode_context_bytes(j, context, format);
+    return WireCodec::encode(j, format);
 }
 
-ExecutionContext MessageHandler::deserialize_execution_context(const std::string& json_str) {
-    nlohmann::json j = nlohmann::json::parse(json_str);
+ExecutionContext MessageHandler::deserialize_execution_context(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
     ExecutionContext context;
     context.from_json(j);
     return context;
 }
 
-std::string MessageHandler::serialize_bash_command(const BashCommand& cmd) {
+std::string MessageHandler::serialize_bash_command(const BashCommand& cmd, WireFormat format) {
     nlohmann::json j;
     cmd.to_json(j);
-    return j.dump();
+    return WireCodec::encode(j, format);
 }
 
-BashCommand MessageHandler::deserialize_bash_command(const std::string& json_str) {
-    nlohmann::json j = nlohmann::json::parse(json_str);
+BashCommand MessageHandler::deserialize_bash_command(std::string_view data) {
+    nlohmann::json j = WireCodec::decode(data);
     BashCommand cmd;
     cmd.from_json(j);
     return cmd;
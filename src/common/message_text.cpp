@@ -0,0 +1,165 @@
+#include "message_text.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mag {
+
+namespace {
+
+struct InternTable {
+    // The values nearly every message carries, found without taking the lock
+    std::array<std::string, 4> common{"", "user", "assistant", "system"};
+
+    std::mutex mutex;
+    std::unordered_map<std::string_view, std::unique_ptr<const std::string>> values;
+};
+
+InternTable& intern_table() {
+    static InternTable* table = new InternTable(); // never destroyed: messages may outlive static teardown
+    return *table;
+}
+
+const std::string* intern(std::string_view value) {
+    InternTable& table = intern_table();
+    for (const std::string& common : table.common) {
+        if (common == value) {
+            return &common;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto it = table.values.find(value);
+    if (it != table.values.end()) {
+        return it->second.get();
+    }
+    if (table.values.size() >= InternedString::MAX_VALUES) {
+        throw std::length_error("Too many distinct message roles or providers");
+    }
+    auto stored = std::make_unique<const std::string>(value);
+    const std::string* result = stored.get();
+    table.values.emplace(*result, std::move(stored));
+    return result;
+}
+
+uint32_t checked_size(std::string_view text) {
+    if (text.size() > UINT32_MAX) {
+        throw std::length_error("Message text larger than 4 GiB");
+    }
+    return static_cast<uint32_t>(text.size());
+}
+
+} // anonymous namespace
+
+InternedString::InternedString() : value_(&intern_table().common[0]) {}
+
+InternedString::InternedString(std::string_view value) : value_(intern(value)) {}
+
+MessageText::Block* MessageText::Block::allocate(size_t capacity, bool pooled) {
+    void* memory = ::operator new(sizeof(Block) + capacity);
+    Block* block = new (memory) Block();
+    block->capacity = static_cast<uint32_t>(capacity);
+    block->pooled = pooled;
+    return block;
+}
+
+void MessageText::Block::release(Block* block) {
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        block->~Block();
+        ::operator delete(block);
+    }
+}
+
+MessageText::MessageText(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    size_ = checked_size(text);
+    block_ = Block::allocate(size_, false);
+    text.copy(block_->data(), size_);
+}
+
+MessageText::MessageText(const MessageText& other)
+    : block_(other.block_), offset_(other.offset_), size_(other.size_) {
+    if (block_) {
+        Block::retain(block_);
+    }
+}
+
+MessageText::MessageText(MessageText&& other) noexcept
+    : block_(other.block_), offset_(other.offset_), size_(other.size_) {
+    other.block_ = nullptr;
+    other.offset_ = 0;
+    other.size_ = 0;
+}
+
+MessageText& MessageText::operator=(const MessageText& other) {
+    if (this != &other) {
+        MessageText copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+MessageText& MessageText::operator=(MessageText&& other) noexcept {
+    if (this != &other) {
+        release();
+        block_ = other.block_;
+        offset_ = other.offset_;
+        size_ = other.size_;
+        other.block_ = nullptr;
+        other.offset_ = 0;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void MessageText::release() {
+    if (block_) {
+        Block::release(block_);
+        block_ = nullptr;
+    }
+    offset_ = 0;
+    size_ = 0;
+}
+
+MessageText TextArena::store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    uint32_t size = checked_size(text);
+    if (size > LARGE_TEXT) {
+        return MessageText(text);
+    }
+    if (!current_ || current_->capacity - used_ < size) {
+        reset();
+        current_ = MessageText::Block::allocate(BLOCK_SIZE, true);
+        used_ = 0;
+    }
+
+    text.copy(current_->data() + used_, size);
+    MessageText::Block::retain(current_);
+    MessageText stored(current_, used_, size);
+    used_ += size;
+    return stored;
+}
+
+MessageText TextArena::adopt(MessageText text) {
+    if (text.empty() || text.block_->pooled || text.size() > LARGE_TEXT) {
+        return text;
+    }
+    return store(text.view());
+}
+
+void TextArena::reset() {
+    if (current_) {
+        MessageText::Block::release(current_);
+        current_ = nullptr;
+    }
+    used_ = 0;
+}
+
+} // namespace mag
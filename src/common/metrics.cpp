@@ -0,0 +1,285 @@
+#include "metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace mag {
+
+namespace {
+
+std::string escape_label_value(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// {a="1",b="2"} with an optional trailing label; empty when there are none
+std::string render_labels(const MetricLabels& labels, const std::string& extra_name = "",
+                          const std::string& extra_value = "") {
+    if (labels.empty() && extra_name.empty()) {
+        return "";
+    }
+    std::string out = "{";
+    bool first = true;
+    for (const auto& [name, value] : labels) {
+        out += (first ? "" : ",") + name + "=\"" + escape_label_value(value) + "\"";
+        first = false;
+    }
+    if (!extra_name.empty()) {
+        out += (first ? "" : ",") + extra_name + "=\"" + extra_value + "\"";
+    }
+    return out + "}";
+}
+
+nlohmann::json labels_json(const MetricLabels& labels) {
+    nlohmann::json j = nlohmann::json::object();
+    for (const auto& [name, value] : labels) {
+        j[name] = value;
+    }
+    return j;
+}
+
+std::string format_double(double value) {
+    std::ostringstream out;
+    out << std::setprecision(9) << value;
+    return out.str();
+}
+
+double micros_to_ms(uint64_t micros) {
+    return static_cast<double>(micros) / 1000.0;
+}
+
+} // anonymous namespace
+
+size_t LatencyHistogram::bucket_index(uint64_t micros) {
+    micros = std::min(micros, MAX_MICROS);
+    if (micros < SUB_BUCKETS) {
+        return static_cast<size_t>(micros);
+    }
+    int magnitude = std::bit_width(micros) - 1; // floor(log2)
+    int shift = magnitude - SUB_BUCKET_BITS;
+    return static_cast<size_t>((shift + 1) * SUB_BUCKETS + (micros >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    uint64_t shift = index / SUB_BUCKETS - 1;
+    uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+    return sub << shift;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    uint64_t shift = index / SUB_BUCKETS - 1;
+    return bucket_lower_bound(index) + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::microseconds duration) {
+    record_micros(duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0);
+}
+
+void LatencyHistogram::record_micros(uint64_t micros) {
+    buckets_[bucket_index(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t seen = max_.load(std::memory_order_relaxed);
+    while (micros > seen && !max_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile_micros(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    q = std::clamp(q, 0.0, 1.0);
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+    
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            // Highest value the bucket stands for, but never above what was seen
+            return std::min(bucket_upper_bound(i), max_micros());
+        }
+    }
+    return max_micros(); // buckets and count raced; the tail is the answer
+}
+
+uint64_t LatencyHistogram::count_at_or_below(uint64_t micros) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT && bucket_upper_bound(i) <= micros; ++i) {
+        total += buckets_[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+const std::vector<double>& MetricsRegistry::prometheus_buckets() {
+    static const std::vector<double> buckets = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300
+    };
+    return buckets;
+}
+
+template <typename Metric>
+Metric& MetricsRegistry::find_or_add(std::map<std::string, Family<Metric>>& families, const std::string& name,
+                                     const MetricLabels& labels, const std::string& help) {
+    Family<Metric>& family = families[name];
+    if (family.help.empty()) {
+        family.help = help;
+    }
+    auto& metric = family.series[labels];
+    if (!metric) {
+        metric = std::make_unique<Metric>();
+    }
+    return *metric;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const MetricLabels& labels, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find_or_add(counters_, name, labels, help);
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const MetricLabels& labels, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find_or_add(gauges_, name, labels, help);
+}
+
+LatencyHistogram& MetricsRegistry::histogram(const std::string& name, const MetricLabels& labels,
+                                             const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find_or_add(histograms_, name, labels, help);
+}
+
+nlohmann::json MetricsRegistry::to_json() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nlohmann::json j = {
+        {"counters", nlohmann::json::array()},
+        {"gauges", nlohmann::json::array()},
+        {"histograms", nlohmann::json::array()}
+    };
+    for (const auto& [name, family] : counters_) {
+        for (const auto& [labels, metric] : family.series) {
+            j["counters"].push_back({{"name", name}, {"labels", labels_json(labels)}, {"value", metric->value()}});
+        }
+    }
+    for (const auto& [name, family] : gauges_) {
+        for (const auto& [labels, metric] : family.series) {
+            j["gauges"].push_back({{"name", name}, {"labels", labels_json(labels)}, {"value", metric->value()}});
+        }
+    }
+    for (const auto& [name, family] : histograms_) {
+        for (const auto& [labels, metric] : family.series) {
+            j["histograms"].push_back({
+                {"name", name},
+                {"labels", labels_json(labels)},
+                {"count", metric->count()},
+                {"sum_ms", micros_to_ms(metric->sum_micros())},
+                {"max_ms", micros_to_ms(metric->max_micros())},
+                {"p50_ms", micros_to_ms(metric->percentile_micros(0.5))},
+                {"p90_ms", micros_to_ms(metric->percentile_micros(0.9))},
+                {"p99_ms", micros_to_ms(metric->percentile_micros(0.99))},
+                {"p999_ms", micros_to_ms(metric->percentile_micros(0.999))}
+            });
+        }
+    }
+    return j;
+}
+
+std::string MetricsRegistry::to_prometheus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    
+    auto header = [&out](const std::string& name, const std::string& help, const char* type) {
+        if (!help.empty()) {
+            out << "# HELP " << name << " " << help << "\n";
+        }
+        out << "# TYPE " << name << " " << type << "\n";
+    };
+    
+    for (const auto& [name, family] : counters_) {
+        header(name, family.help, "counter");
+        for (const auto& [labels, metric] : family.series) {
+            out << name << render_labels(labels) << " " << metric->value() << "\n";
+        }
+    }
+    for (const auto& [name, family] : gauges_) {
+        header(name, family.help, "gauge");
+        for (const auto& [labels, metric] : family.series) {
+            out << name << render_labels(labels) << " " << metric->value() << "\n";
+        }
+    }
+    for (const auto& [name, family] : histograms_) {
+        header(name, family.help, "histogram");
+        for (const auto& [labels, metric] : family.series) {
+            for (double bound : prometheus_buckets()) {
+                uint64_t micros = static_cast<uint64_t>(std::llround(bound * 1e6));
+                out << name << "_bucket" << render_labels(labels, "le", format_double(bound)) << " "
+                    << metric->count_at_or_below(micros) << "\n";
+            }
+            out << name << "_bucket" << render_labels(labels, "le", "+Inf") << " " << metric->count() << "\n";
+            out << name << "_sum" << render_labels(labels) << " "
+                << format_double(static_cast<double>(metric->sum_micros()) / 1e6) << "\n";
+            out << name << "_count" << render_labels(labels) << " " << metric->count() << "\n";
+        }
+    }
+    return out.str();
+}
+
+ServiceMetrics::ServiceMetrics(std::string service, MetricsRegistry& registry)
+    : service_(std::move(service))
+    , registry_(registry)
+    , bytes_received_(registry.counter("mag_request_bytes_total", {{"service", service_}, {"direction", "in"}},
+                                       "Request and reply payload bytes"))
+    , bytes_sent_(registry.counter("mag_request_bytes_total", {{"service", service_}, {"direction", "out"}},
+                                   "Request and reply payload bytes"))
+    , in_flight_(registry.gauge("mag_requests_in_flight", {{"service", service_}},
+                                "Requests being handled right now")) {
+}
+
+void ServiceMetrics::record(const std::string& operation, std::chrono::microseconds elapsed, size_t bytes_in,
+                            size_t bytes_out, bool failed) {
+    MetricLabels labels = {{"service", service_}, {"operation", operation}};
+    registry_.histogram("mag_request_seconds", labels, "Time to answer one request").record(elapsed);
+    if (failed) {
+        registry_.counter("mag_request_errors_total", labels, "Requests answered with an error").add();
+    }
+    bytes_received_.add(bytes_in);
+    bytes_sent_.add(bytes_out);
+}
+
+ServiceMetrics::RequestScope::RequestScope(ServiceMetrics& metrics, size_t bytes_in)
+    : metrics_(metrics), bytes_in_(bytes_in), started_(std::chrono::steady_clock::now()),
+      span_("request") {
+    metrics_.in_flight().add(1);
+}
+
+ServiceMetrics::RequestScope::~RequestScope() {
+    metrics_.in_flight().add(-1);
+    metrics_.record(operation_, std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - started_),
+                    bytes_in_, bytes_out_, failed_);
+}
+
+} // namespace mag
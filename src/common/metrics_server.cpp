@@ -0,0 +1,139 @@
+#include "metrics_server.h"
+#include "metrics.h"
+#include "config.h"
+#include "logger.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+constexpr int POLL_INTERVAL_MS = 200;     // how soon the destructor is noticed
+constexpr size_t MAX_REQUEST_BYTES = 8192; // request line and headers
+constexpr int CLIENT_TIMEOUT_SECONDS = 2;
+
+void send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; // scraper went away
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+std::string http_response(const char* status, const char* content_type, const std::string& body) {
+    return std::string("HTTP/1.1 ") + status + "\r\n"
+           "Content-Type: " + content_type + "\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: close\r\n\r\n" + body;
+}
+
+} // anonymous namespace
+
+MetricsServer::MetricsServer(int port) : port_(port) {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Failed to open metrics socket: " + std::string(std::strerror(errno)));
+    }
+    int reuse = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listen_fd_, 16) != 0) {
+        std::string error = std::strerror(errno);
+        ::close(listen_fd_);
+        throw std::runtime_error("Failed to listen for metrics on port " + std::to_string(port) + ": " + error);
+    }
+    
+    socklen_t length = sizeof(address);
+    if (::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) == 0) {
+        port_ = ntohs(address.sin_port);
+    }
+    thread_ = std::thread([this] { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+    stopping_.store(true);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    ::close(listen_fd_);
+}
+
+std::unique_ptr<MetricsServer> MetricsServer::start(int offset) {
+    int port = MetricsConfig::get_port(offset);
+    if (port == 0) {
+        return nullptr;
+    }
+    try {
+        auto server = std::make_unique<MetricsServer>(port);
+        MAG_LOG_INFO("metrics", "Serving Prometheus metrics on http://127.0.0.1:" << port << "/metrics");
+        return server;
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("metrics", e.what());
+        return nullptr;
+    }
+}
+
+void MetricsServer::serve() {
+    while (!stopping_.load()) {
+        pollfd waiting{listen_fd_, POLLIN, 0};
+        int ready = ::poll(&waiting, 1, POLL_INTERVAL_MS);
+        if (ready <= 0) {
+            continue;
+        }
+        int client_fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            continue;
+        }
+        answer(client_fd);
+        ::close(client_fd);
+    }
+}
+
+void MetricsServer::answer(int client_fd) {
+    // A stalled client must not hold the only serving thread for long
+    timeval timeout{CLIENT_TIMEOUT_SECONDS, 0};
+    ::setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_BYTES) {
+        ssize_t n = ::recv(client_fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(n));
+    }
+    
+    std::string request_line = request.substr(0, request.find("\r\n"));
+    bool is_metrics = request_line.rfind("GET /metrics ", 0) == 0 || request_line.rfind("GET /metrics?", 0) == 0;
+    if (!is_metrics) {
+        send_all(client_fd, http_response("404 Not Found", "text/plain", "Not found\n"));
+        return;
+    }
+    send_all(client_fd, http_response("200 OK", "text/plain; version=0.0.4",
+                                      MetricsRegistry::instance().to_prometheus()));
+}
+
+} // namespace mag
@@ -0,0 +1,163 @@
+#include "path_resolver.h"
+#include "utils.h"
+#include <filesystem>
+#include <optional>
+#include <sys/stat.h>
+
+namespace mag {
+
+namespace {
+
+void append_component(std::string& path, const std::string& component) {
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += component;
+}
+
+} // anonymous namespace
+
+PathResolver::PathResolver(size_t max_entries) : max_entries_(max_entries) {
+}
+
+std::optional<PathResolver::Stamp> PathResolver::stamp_of(const std::string& path) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+        return std::nullopt;
+    }
+    return Stamp{st.st_dev, st.st_ino, static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec};
+}
+
+PathResolver& PathResolver::instance() {
+    static PathResolver resolver;
+    return resolver;
+}
+
+bool PathResolver::is_within(std::string_view path, std::string_view root) {
+    if (root.size() > 1 && root.back() == '/') {
+        root.remove_suffix(1);
+    }
+    if (path.substr(0, root.size()) != root) {
+        return false;
+    }
+    return path.size() == root.size() || root == "/" || path[root.size()] == '/';
+}
+
+std::string PathResolver::cwd() {
+    return current_cwd()->canonical;
+}
+
+size_t PathResolver::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directories_.size();
+}
+
+std::shared_ptr<const PathResolver::Cwd> PathResolver::current_cwd() {
+    std::optional<Stamp> stamp = stamp_of(".");
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cwd_ && stamp && cwd_->stamp.same_file(*stamp)) {
+        return cwd_;
+    }
+    
+    // A chdir: everything cached is relative to the old directory
+    auto fresh = std::make_shared<Cwd>();
+    fresh->canonical = Utils::get_real_path(Utils::get_current_working_directory());
+    fresh->stamp = stamp.value_or(Stamp{});
+    cwd_ = fresh;
+    directories_.clear();
+    return cwd_;
+}
+
+bool PathResolver::is_within_cwd(const std::string& path) {
+    std::shared_ptr<const Cwd> cwd = current_cwd();
+    auto resolve_fully = [&]() {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return is_within(Utils::get_real_path(path), cwd->canonical);
+    };
+    
+    std::filesystem::path given(path);
+    for (const auto& part : given) {
+        if (part == "..") {
+            return resolve_fully(); // lexically and physically different when a level is a symlink
+        }
+    }
+    std::filesystem::path absolute = given.is_absolute() ? given : std::filesystem::path(cwd->canonical) / given;
+    std::string lexical = absolute.lexically_normal().string();
+    if (!is_within(lexical, cwd->canonical)) {
+        return resolve_fully(); // may still lead back inside through a symlink
+    }
+    
+    std::vector<std::string> components;
+    std::string full = cwd->canonical;
+    for (const auto& part : std::filesystem::path(lexical.substr(cwd->canonical.size()))) {
+        std::string component = part.string();
+        if (!component.empty() && component != "/" && component != ".") {
+            components.push_back(component);
+            append_component(full, component);
+        }
+    }
+    if (components.empty()) {
+        return true; // the working directory itself
+    }
+    
+    // A symlink as the last component can point anywhere; a missing file is named by its parent
+    struct stat st {};
+    if (::lstat(full.c_str(), &st) == 0 && S_ISLNK(st.st_mode)) {
+        return resolve_fully();
+    }
+    if (components.size() == 1) {
+        return true;
+    }
+    return is_within(resolve_directory(*cwd, components, components.size() - 1), cwd->canonical);
+}
+
+std::string PathResolver::resolve_directory(const Cwd& cwd, const std::vector<std::string>& components,
+                                            size_t count) {
+    std::string key;
+    std::string path = cwd.canonical;
+    std::vector<Stamp> levels;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            key += '/';
+        }
+        key += components[i];
+        append_component(path, components[i]);
+        if (levels.size() == i) {
+            if (std::optional<Stamp> stamp = stamp_of(path)) {
+                levels.push_back(*stamp);
+            }
+        }
+    }
+    
+    std::shared_ptr<const Directory> cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = directories_.find(key);
+        if (it != directories_.end()) {
+            cached = it->second;
+        }
+    }
+    if (cached && cached->levels == levels) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return cached->canonical;
+    }
+    
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    auto resolved = std::make_shared<Directory>();
+    resolved->levels = std::move(levels); // taken first: a change while resolving only costs a miss later
+    try {
+        resolved->canonical = std::filesystem::weakly_canonical(path).string();
+    } catch (const std::filesystem::filesystem_error&) {
+        return std::filesystem::path(path).lexically_normal().string();
+    }
+    if (resolved->levels.size() == count) { // a directory still to be created has nothing to stamp
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (directories_.size() >= max_entries_) {
+            directories_.clear();
+        }
+        directories_[key] = resolved;
+    }
+    return resolved->canonical;
+}
+
+} // namespace mag
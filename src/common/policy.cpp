@@ -1,34 +1,184 @@
 #include "policy.h"
-#include "utils.h"
+#include "path_resolver.h"
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <sys/stat.h>
 
 namespace mag {
 
-PolicyChecker::PolicyChecker() {
+namespace {
+
+int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+std::optional<bool> PolicyDecisionCache::lookup(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = decisions_.find(key);
+    if (it == decisions_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void PolicyDecisionCache::store(const std::string& key, bool allowed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (decisions_.size() >= MAX_ENTRIES) {
+        decisions_.clear();
+    }
+    decisions_[key] = allowed;
+}
+
+size_t PolicyDecisionCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return decisions_.size();
+}
+
+PolicyStore& PolicyStore::instance() {
+    static PolicyStore store;
+    return store;
+}
+
+PolicyStore::PolicyStore() : path_(PolicyConfig::get_policy_file_path()) {
     // Load or create policy configuration
-    settings_ = PolicyConfig::load_or_create();
-    if (!settings_) {
+    std::unique_ptr<PolicySettings> settings = PolicyConfig::load_or_create();
+    if (!settings) {
         // This should not happen due to load_or_create's error handling
         std::cerr << "CRITICAL: Failed to initialize policy settings" << std::endl;
         std::exit(1);
     }
+    stamp_ = stamp_of_file();
+    snapshot_.store(std::make_shared<const PolicySnapshot>(std::move(*settings), 1));
+    next_check_ms_.store(steady_ms() + RELOAD_CHECK_MS);
+}
+
+std::shared_ptr<const PolicySnapshot> PolicyStore::current() {
+    int64_t now = steady_ms();
+    if (now >= next_check_ms_.load(std::memory_order_relaxed)) {
+        std::unique_lock<std::mutex> lock(reload_mutex_, std::try_to_lock);
+        if (lock.owns_lock()) { // someone else is already checking otherwise
+            next_check_ms_.store(now + RELOAD_CHECK_MS, std::memory_order_relaxed);
+            reload_if_changed();
+        }
+    }
+    return snapshot_.load(std::memory_order_acquire);
+}
+
+bool PolicyStore::refresh() {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    return reload_if_changed();
+}
+
+void PolicyStore::publish(const PolicySettings& settings) {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    uint64_t version = snapshot_.load()->version + 1;
+    stamp_ = stamp_of_file(); // the save is already in force
+    snapshot_.store(std::make_shared<const PolicySnapshot>(settings, version), std::memory_order_release);
+}
+
+PolicyStore::FileStamp PolicyStore::stamp_of_file() const {
+    FileStamp stamp;
+    struct stat st;
+    if (::stat(path_.c_str(), &st) == 0) {
+        stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        stamp.size = static_cast<int64_t>(st.st_size);
+        stamp.inode = static_cast<uint64_t>(st.st_ino);
+    }
+    return stamp;
+}
+
+bool PolicyStore::reload_if_changed() {
+    FileStamp stamp = stamp_of_file();
+    if (stamp == stamp_) {
+        return false;
+    }
+    stamp_ = stamp;
+    if (stamp.size < 0) {
+        std::cerr << "Policy file " << path_ << " is gone; keeping the policy in force" << std::endl;
+        return false;
+    }
+    
+    std::string error_message;
+    std::unique_ptr<PolicySettings> settings = PolicyConfig::parse_config(path_, error_message);
+    if (!settings) {
+        std::cerr << "Policy file " << path_ << " not reloaded, keeping the policy in force: "
+                  << error_message << std::endl;
+        return false;
+    }
+    uint64_t version = snapshot_.load()->version + 1;
+    snapshot_.store(std::make_shared<const PolicySnapshot>(std::move(*settings), version),
+                    std::memory_order_release);
+    std::cerr << "Policy reloaded from " << path_ << std::endl;
+    return true;
+}
+
+PolicyChecker::PolicyChecker() {
+    PolicyStore::instance(); // the first checker loads (or creates) the policy file
+}
+
+PolicyChecker::PolicyChecker(std::shared_ptr<const PolicySnapshot> snapshot) : pinned_(std::move(snapshot)) {}
+
+std::shared_ptr<const PolicySnapshot> PolicyChecker::snapshot() const {
+    return pinned_ ? pinned_ : PolicyStore::instance().current();
+}
+
+std::shared_ptr<const PolicySettings> PolicyChecker::get_settings() const {
+    std::shared_ptr<const PolicySnapshot> current = snapshot();
+    return std::shared_ptr<const PolicySettings>(current, &current->settings);
+}
+
+uint64_t PolicyChecker::version() const {
+    return snapshot()->version;
 }
 
 bool PolicyChecker::is_allowed(const std::string& tool, Operation operation, const std::string& path) const {
+    return is_allowed(*snapshot(), tool, operation, path);
+}
+
+bool PolicyChecker::is_allowed(const PolicySnapshot& policy, const std::string& tool, Operation operation,
+                               const std::string& path) const {
     // First check if path is within current working directory
     if (!is_within_cwd(path)) {
         return false;
     }
     
-    // Check if file extension is blocked
-    if (is_extension_blocked(path)) {
-        return false;
+    // The rest depends only on the policy; "./src/a" and "src/b/../a" are judged as "src/a"
+    std::string normalized = std::filesystem::path(path).lexically_normal().string();
+    std::string key = tool + '\0' + std::to_string(static_cast<int>(operation)) + '\0' + normalized;
+    if (std::optional<bool> known = policy.decisions.lookup(key)) {
+        return *known;
     }
-    
-    // Use PolicySettings method for tool-specific operation checking
-    return settings_->is_operation_allowed(tool, operation, path);
+    std::string extension = std::filesystem::path(normalized).extension().string();
+    bool allowed = (extension.empty() || !policy.compiled.is_extension_blocked(extension)) &&
+                   policy.compiled.is_operation_allowed(tool, operation, normalized);
+    policy.decisions.store(key, allowed);
+    return allowed;
+}
+
+std::vector<bool> PolicyChecker::evaluate_batch(const std::string& tool, Operation operation,
+                                                const std::vector<std::string>& paths) const {
+    std::shared_ptr<const PolicySnapshot> policy = snapshot(); // a reload mid-plan cannot split the verdict
+    std::vector<bool> decisions;
+    decisions.reserve(paths.size());
+    for (const std::string& path : paths) {
+        decisions.push_back(is_allowed(*policy, tool, operation, path));
+    }
+    return decisions;
+}
+
+std::vector<bool> PolicyChecker::evaluate_bash_batch(const std::vector<std::string>& commands) const {
+    std::shared_ptr<const PolicySnapshot> policy = snapshot();
+    std::vector<bool> decisions;
+    decisions.reserve(commands.size());
+    for (const std::string& command : commands) {
+        decisions.push_back(is_bash_command_allowed(*policy, command));
+    }
+    return decisions;
 }
 
 bool PolicyChecker::is_allowed(const std::string& path) const {
@@ -44,13 +194,11 @@ bool PolicyChecker::is_extension_blocked(const std::string& path) const {
         return false; // No extension, not blocked
     }
     
-    return std::find(settings_->global.blocked_extensions.begin(), 
-                     settings_->global.blocked_extensions.end(), 
-                     extension) != settings_->global.blocked_extensions.end();
+    return snapshot()->compiled.is_extension_blocked(extension);
 }
 
 bool PolicyChecker::is_file_size_allowed(size_t size_bytes) const {
-    size_t max_bytes = settings_->global.max_file_size_mb * 1024 * 1024;
+    size_t max_bytes = snapshot()->settings.global.max_file_size_mb * 1024 * 1024;
     return size_bytes <= max_bytes;
 }
 
@@ -65,22 +213,20 @@ bool PolicyChecker::update_settings(const PolicySettings& new_settings, std::str
         return false;
     }
     
-    // Update in-memory settings
-    settings_ = std::make_unique<PolicySettings>(new_settings);
+    // Every checker in the process sees the new settings from now on
+    PolicyStore::instance().publish(new_settings);
+    if (pinned_) {
+        pinned_ = PolicyStore::instance().current();
+    }
     return true;
 }
 
 bool PolicyChecker::is_within_cwd(const std::string& path) const {
-    std::string real_path = Utils::get_real_path(path);
-    std::string safe_cwd = Utils::get_real_path(Utils::get_current_working_directory());
-    
-    // Ensure the path starts with the current working directory
-    return real_path.find(safe_cwd) == 0;
+    return PathResolver::instance().is_within_cwd(path);
 }
 
 bool PolicyChecker::has_allowed_prefix(const std::string& tool, Operation operation, const std::string& path) const {
-    // Use PolicySettings method for tool-specific operation checking
-    return settings_->is_operation_allowed(tool, operation, path);
+    return snapshot()->compiled.is_operation_allowed(tool, operation, path);
 }
 
 bool PolicyChecker::has_allowed_prefix(const std::string& path) const {
@@ -103,78 +249,25 @@ std::vector<std::string> PolicyChecker::get_allowed_directories(const std::strin
         return {}; // Unknown operation
     }
     
-    // Get tool policy from settings
-    auto tool_policies = settings_->tools;
-    auto tool_it = tool_policies.find(tool);
-    if (tool_it == tool_policies.end()) {
-        return {}; // Tool not found
-    }
-    
-    const ToolPolicy& tool_policy = tool_it->second;
-    
-    // Get allowed directories for the specific operation
-    switch (op) {
-        case Operation::CREATE:
-            return tool_policy.create.allowed_directories;
-        case Operation::READ:
-            return tool_policy.read.allowed_directories;
-        case Operation::UPDATE:
-            return tool_policy.update.allowed_directories;
-        case Operation::DELETE:
-            return tool_policy.delete_op.allowed_directories;
-        default:
-            return {};
-    }
+    return snapshot()->compiled.allowed_directories(tool, op);
 }
 
 bool PolicyChecker::is_bash_command_allowed(const std::string& command) const {
-    // First check if command is explicitly blocked
-    if (is_bash_command_blocked(command)) {
-        return false;
-    }
-    
-    // Get bash_tool policy
-    auto bash_tool_it = settings_->tools.find("bash_tool");
-    if (bash_tool_it == settings_->tools.end()) {
-        return false; // No bash_tool policy found
-    }
-    
-    const auto& bash_policy = bash_tool_it->second.create;
-    
-    // If no allowed commands specified, allow anything not explicitly blocked
-    if (bash_policy.allowed_commands.empty()) {
-        return true;
-    }
-    
-    // Extract the base command (first word)
-    std::string base_command = command;
-    size_t space_pos = command.find(' ');
-    if (space_pos != std::string::npos) {
-        base_command = command.substr(0, space_pos);
+    return is_bash_command_allowed(*snapshot(), command);
+}
+
+bool PolicyChecker::is_bash_command_allowed(const PolicySnapshot& policy, const std::string& command) const {
+    std::string key = std::string("\0bash\0", 6) + command; // no tool name is empty
+    if (std::optional<bool> known = policy.decisions.lookup(key)) {
+        return *known;
     }
-    
-    // Check if base command is in allowed list
-    return std::find(bash_policy.allowed_commands.begin(), 
-                     bash_policy.allowed_commands.end(), 
-                     base_command) != bash_policy.allowed_commands.end();
+    bool allowed = policy.compiled.is_bash_command_allowed(command);
+    policy.decisions.store(key, allowed);
+    return allowed;
 }
 
 bool PolicyChecker::is_bash_command_blocked(const std::string& command) const {
-    auto bash_tool_it = settings_->tools.find("bash_tool");
-    if (bash_tool_it == settings_->tools.end()) {
-        return true; // No bash_tool policy = blocked
-    }
-    
-    const auto& bash_policy = bash_tool_it->second.create;
-    
-    // Check against blocked commands
-    for (const auto& blocked_cmd : bash_policy.blocked_commands) {
-        if (command.find(blocked_cmd) != std::string::npos) {
-            return true; // Command contains blocked substring
-        }
-    }
-    
-    return false;
+    return snapshot()->compiled.is_bash_command_blocked(command);
 }
 
 std::string PolicyChecker::get_bash_command_violation_reason(const std::string& command) const {
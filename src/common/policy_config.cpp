@@ -133,6 +133,16 @@ bool PolicySettings::is_operation_allowed(const std::string& tool, Operation op,
     return false;
 }
 
+std::unique_ptr<PolicySettings> PolicyConfig::load_or_default() {
+    std::string error_message;
+    std::string policy_file = get_policy_file_path();
+    std::unique_ptr<PolicySettings> settings;
+    if (std::filesystem::exists(policy_file)) {
+        settings = parse_config(policy_file, error_message);
+    }
+    return settings ? std::move(settings) : std::make_unique<PolicySettings>();
+}
+
 std::unique_ptr<PolicySettings> PolicyConfig::load_or_create() {
     std::string error_message;
     std::string policy_file = get_policy_file_path();
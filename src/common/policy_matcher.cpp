@@ -0,0 +1,209 @@
+#include "policy_matcher.h"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+
+namespace mag {
+
+namespace {
+
+template <typename Children>
+uint32_t find_child(const Children& children, unsigned char byte, uint32_t missing) {
+    auto it = std::lower_bound(children.begin(), children.end(), byte,
+                               [](const auto& entry, unsigned char b) { return entry.first < b; });
+    return it != children.end() && it->first == byte ? it->second : missing;
+}
+
+template <typename Node>
+uint32_t add_child(std::vector<Node>& nodes, uint32_t node, unsigned char byte) {
+    auto& children = nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), byte,
+                               [](const auto& entry, unsigned char b) { return entry.first < b; });
+    if (it != children.end() && it->first == byte) {
+        return it->second;
+    }
+    uint32_t created = static_cast<uint32_t>(nodes.size());
+    children.insert(it, {byte, created}); // before emplace_back, which may move children
+    nodes.emplace_back();
+    return created;
+}
+
+unsigned char fold(unsigned char byte, bool ignore_case) {
+    return ignore_case ? static_cast<unsigned char>(std::tolower(byte)) : byte;
+}
+
+} // anonymous namespace
+
+// PrefixTrie
+
+void PrefixTrie::insert(std::string_view prefix) {
+    uint32_t node = 0;
+    for (char c : prefix) {
+        node = add_child(nodes_, node, static_cast<unsigned char>(c));
+    }
+    nodes_[node].terminal = true;
+}
+
+bool PrefixTrie::matches(std::string_view text) const {
+    uint32_t node = 0;
+    if (nodes_[node].terminal) {
+        return true;
+    }
+    for (char c : text) {
+        node = child(node, static_cast<unsigned char>(c));
+        if (node == 0) {
+            return false;
+        }
+        if (nodes_[node].terminal) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t PrefixTrie::child(uint32_t node, unsigned char byte) const {
+    return find_child(nodes_[node].children, byte, 0);
+}
+
+// MultiPatternMatcher
+
+MultiPatternMatcher::MultiPatternMatcher(const std::vector<std::string>& patterns, bool ignore_case)
+    : ignore_case_(ignore_case) {
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        lengths_.push_back(patterns[i].size());
+        if (patterns[i].empty()) {
+            empty_patterns_.push_back(i);
+            continue;
+        }
+        uint32_t node = 0;
+        for (char c : patterns[i]) {
+            node = add_child(nodes_, node, fold(static_cast<unsigned char>(c), ignore_case_));
+        }
+        nodes_[node].patterns.push_back(static_cast<uint32_t>(i));
+    }
+    
+    // Breadth first, so every fail target is finished before the nodes that point at it
+    std::deque<uint32_t> queue;
+    for (const auto& [byte, next] : nodes_[0].children) {
+        queue.push_back(next);
+    }
+    while (!queue.empty()) {
+        uint32_t node = queue.front();
+        queue.pop_front();
+        for (const auto& [byte, next] : nodes_[node].children) {
+            uint32_t fallback = nodes_[node].fail;
+            while (fallback != 0 && child(fallback, byte) == NONE) {
+                fallback = nodes_[fallback].fail;
+            }
+            uint32_t target = child(fallback, byte);
+            nodes_[next].fail = target == NONE ? 0 : target;
+            const Node& fail = nodes_[nodes_[next].fail];
+            nodes_[next].next_output = fail.patterns.empty() ? fail.next_output : nodes_[next].fail;
+            queue.push_back(next);
+        }
+    }
+}
+
+bool MultiPatternMatcher::find(std::string_view text,
+                               const std::function<bool(size_t pattern, size_t start)>& on_match) const {
+    for (size_t pattern : empty_patterns_) {
+        if (on_match(pattern, 0)) {
+            return true;
+        }
+    }
+    if (nodes_.size() == 1) {
+        return false;
+    }
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char byte = fold(static_cast<unsigned char>(text[i]), ignore_case_);
+        while (state != 0 && child(state, byte) == NONE) {
+            state = nodes_[state].fail;
+        }
+        uint32_t next = child(state, byte);
+        state = next == NONE ? 0 : next;
+        
+        for (uint32_t out = nodes_[state].patterns.empty() ? nodes_[state].next_output : state; out != NONE;
+             out = nodes_[out].next_output) {
+            for (uint32_t pattern : nodes_[out].patterns) {
+                if (on_match(pattern, i + 1 - lengths_[pattern])) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool MultiPatternMatcher::contains_any(std::string_view text) const {
+    return find(text, [](size_t, size_t) { return true; });
+}
+
+uint32_t MultiPatternMatcher::child(uint32_t node, unsigned char byte) const {
+    return find_child(nodes_[node].children, byte, NONE);
+}
+
+// CompiledPolicy
+
+CompiledPolicy::CompiledPolicy(const PolicySettings& settings)
+    : blocked_extensions_(settings.global.blocked_extensions.begin(), settings.global.blocked_extensions.end()) {
+    for (const auto& [tool, policy] : settings.tools) {
+        std::array<OperationRules, 4>& operations = tools_[tool];
+        const OperationPolicy* sources[] = {&policy.create, &policy.read, &policy.update, &policy.delete_op};
+        for (size_t i = 0; i < operations.size(); ++i) {
+            operations[i].directories = sources[i]->allowed_directories;
+            for (const std::string& directory : sources[i]->allowed_directories) {
+                operations[i].any_directory = operations[i].any_directory || directory.empty();
+                operations[i].prefixes.insert(directory);
+            }
+        }
+    }
+    
+    auto bash = settings.tools.find("bash_tool");
+    if (bash != settings.tools.end()) {
+        has_bash_tool_ = true;
+        allowed_commands_.insert(bash->second.create.allowed_commands.begin(),
+                                 bash->second.create.allowed_commands.end());
+        blocked_commands_ = MultiPatternMatcher(bash->second.create.blocked_commands);
+    }
+}
+
+const CompiledPolicy::OperationRules* CompiledPolicy::rules(const std::string& tool, Operation op) const {
+    auto it = tools_.find(tool);
+    return it == tools_.end() ? nullptr : &it->second[static_cast<size_t>(op)];
+}
+
+bool CompiledPolicy::is_operation_allowed(const std::string& tool, Operation op, std::string_view path) const {
+    const OperationRules* operation = rules(tool, op);
+    if (!operation || operation->directories.empty()) {
+        return false; // unknown, or disabled by listing no directories
+    }
+    return operation->any_directory || operation->prefixes.matches(path);
+}
+
+const std::vector<std::string>& CompiledPolicy::allowed_directories(const std::string& tool, Operation op) const {
+    static const std::vector<std::string> none;
+    const OperationRules* operation = rules(tool, op);
+    return operation ? operation->directories : none;
+}
+
+bool CompiledPolicy::is_extension_blocked(const std::string& extension) const {
+    return blocked_extensions_.count(extension) > 0;
+}
+
+bool CompiledPolicy::is_bash_command_allowed(std::string_view command) const {
+    if (is_bash_command_blocked(command)) {
+        return false;
+    }
+    if (allowed_commands_.empty()) {
+        return true;
+    }
+    std::string base_command(command.substr(0, command.find(' ')));
+    return allowed_commands_.count(base_command) > 0;
+}
+
+bool CompiledPolicy::is_bash_command_blocked(std::string_view command) const {
+    return !has_bash_tool_ || blocked_commands_.contains_any(command);
+}
+
+} // namespace mag
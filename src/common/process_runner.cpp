@@ -0,0 +1,715 @@
+#include "process_runner.h"
+#include "tracing.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char** environ;
+
+namespace mag {
+
+namespace {
+
+constexpr size_t READ_BYTES = 64 * 1024;
+constexpr int POLL_TICK_MS = 50;   // how often a running child is checked for exit
+constexpr int REAP_TICK_MS = 5;    // once its pipes are closed
+
+std::string system_error(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+class Fd {
+public:
+    Fd() = default;
+    ~Fd() { reset(); }
+    Fd(const Fd&) = delete;
+    Fd& operator=(const Fd&) = delete;
+    
+    int get() const { return fd_; }
+    void reset(int fd = -1) {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = fd;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// Parent's read end is non-blocking; both ends are close-on-exec (dup2 clears it in the child)
+void open_pipe(Fd& read_end, Fd& write_end) {
+    int fds[2];
+#ifdef __linux__
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+        throw std::runtime_error(system_error("Failed to create pipe"));
+    }
+#else
+    if (::pipe(fds) != 0) {
+        throw std::runtime_error(system_error("Failed to create pipe"));
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+    read_end.reset(fds[0]);
+    write_end.reset(fds[1]);
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+}
+
+struct Stream {
+    Fd fd;
+    int number = 0; // in the child
+    OutputCapture* sink = nullptr;
+};
+
+// Read what is there; closes the stream at EOF
+void drain(Stream& stream, std::vector<char>& buffer, const ProcessSpec& spec) {
+    while (true) {
+        ssize_t n = ::read(stream.fd.get(), buffer.data(), buffer.size());
+        if (n > 0) {
+            size_t head = stream.sink->append(std::string_view(buffer.data(), static_cast<size_t>(n)));
+            if (spec.on_output && head > 0 && stream.number != 3) {
+                spec.on_output(stream.number, std::string_view(buffer.data(), head));
+            }
+        } else if (n == 0) {
+            stream.fd.reset();
+            return;
+        } else if (errno != EINTR) {
+            return; // EAGAIN: nothing more for now
+        }
+    }
+}
+
+uint64_t round_up(uint64_t value, uint64_t unit) {
+    return value / unit + (value % unit != 0);
+}
+
+/**
+ * posix_spawn cannot set rlimits, and setting them from the parent after
+ * the spawn races the child. So a limited argv is run through a /bin/sh
+ * that sets them with ulimit and then execs argv in its place: same pid,
+ * and the limits are in force before argv's first instruction. /bin/sh
+ * counts -v in KiB and -f in 512-byte blocks; byte limits are rounded up.
+ * A program that is not found then exits 127 instead of failing the spawn.
+ */
+std::vector<std::string> with_limits(const std::vector<std::string>& args, const ResourceLimits& limits) {
+#ifdef __linux__
+    if (!limits.any()) {
+        return args;
+    }
+    std::ostringstream script;
+    if (limits.cpu_seconds > 0) {
+        // SIGXCPU first, SIGKILL a little later; soft before hard, which must not go below it
+        script << "ulimit -S -t " << limits.cpu_seconds << "; ulimit -H -t " << limits.cpu_seconds + 5 << "; ";
+    }
+    if (limits.memory_bytes > 0) {
+        script << "ulimit -v " << round_up(limits.memory_bytes, 1024) << "; ";
+    }
+    if (limits.file_bytes > 0) {
+        script << "ulimit -f " << round_up(limits.file_bytes, 512) << "; ";
+    }
+    script << "exec \"$@\"";
+    std::vector<std::string> shim = {"/bin/sh", "-c", script.str(), "mag-limits"};
+    shim.insert(shim.end(), args.begin(), args.end());
+    return shim;
+#else
+    (void)limits;
+    return args;
+#endif
+}
+
+ResourceUsage usage_of(const rusage& usage) {
+    ResourceUsage result;
+    result.user_cpu = std::chrono::seconds(usage.ru_utime.tv_sec) + std::chrono::microseconds(usage.ru_utime.tv_usec);
+    result.system_cpu = std::chrono::seconds(usage.ru_stime.tv_sec) + std::chrono::microseconds(usage.ru_stime.tv_usec);
+#ifdef __APPLE__
+    result.max_rss_kb = static_cast<uint64_t>(usage.ru_maxrss) / 1024; // bytes there
+#else
+    result.max_rss_kb = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    result.blocks_read = static_cast<uint64_t>(usage.ru_inblock);
+    result.blocks_written = static_cast<uint64_t>(usage.ru_oublock);
+    return result;
+}
+
+class SpawnSetup {
+public:
+    SpawnSetup() {
+        posix_spawn_file_actions_init(&actions_);
+        posix_spawnattr_init(&attr_);
+    }
+    ~SpawnSetup() {
+        posix_spawn_file_actions_destroy(&actions_);
+        posix_spawnattr_destroy(&attr_);
+    }
+    
+    posix_spawn_file_actions_t actions_;
+    posix_spawnattr_t attr_;
+};
+
+/**
+ * Start argv in its own process group, so a timeout takes down everything it
+ * started. stdin is stdin_read (or /dev/null) and fds 1.. are write_ends.
+ */
+pid_t spawn(const std::vector<std::string>& args, int stdin_read, Fd* write_ends, size_t count,
+            const ResourceLimits& limits) {
+    Span span("process spawn");
+    if (span.active() && !args.empty()) {
+        span.set_attribute("program", args[0]);
+    }
+    SpawnSetup setup;
+    if (stdin_read >= 0) {
+        posix_spawn_file_actions_adddup2(&setup.actions_, stdin_read, STDIN_FILENO);
+    } else {
+        posix_spawn_file_actions_addopen(&setup.actions_, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        posix_spawn_file_actions_adddup2(&setup.actions_, write_ends[i].get(), static_cast<int>(i) + 1);
+    }
+    
+    sigset_t no_signals;
+    sigset_t defaults;
+    sigemptyset(&no_signals);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    posix_spawnattr_setflags(&setup.attr_, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&setup.attr_, 0);
+    posix_spawnattr_setsigmask(&setup.attr_, &no_signals);
+    posix_spawnattr_setsigdefault(&setup.attr_, &defaults);
+    
+    std::vector<std::string> limited = with_limits(args, limits);
+    std::vector<char*> argv;
+    for (const std::string& arg : limited) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    
+    pid_t pid = 0;
+    int rv = posix_spawnp(&pid, argv[0], &setup.actions_, &setup.attr_, argv.data(), environ);
+    if (rv != 0) {
+        throw std::runtime_error("Failed to start " + args[0] + ": " + std::strerror(rv));
+    }
+    return pid;
+}
+
+int exit_code_of(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return -1;
+}
+
+/**
+ * Read the streams until finished() says the work is done or the child
+ * exits, stopping the process group at the deadline or on cancellation.
+ * Returns true (with status and the child's rusage) if the child exited.
+ */
+bool supervise(pid_t pid, Stream* streams, size_t count, const ProcessSpec& spec, ProcessOutput& output,
+               const std::function<bool()>& finished, int& status, rusage& usage) {
+    using Clock = std::chrono::steady_clock;
+    bool limited = spec.timeout.count() > 0;
+    Clock::time_point deadline = Clock::now() + spec.timeout;
+    Clock::time_point kill_at{};
+    bool terminated = false;
+    bool killed = false;
+    std::vector<char> buffer(READ_BYTES);
+    
+    auto drain_all = [&] {
+        for (size_t i = 0; i < count; ++i) {
+            if (streams[i].fd.get() >= 0) {
+                drain(streams[i], buffer, spec);
+            }
+        }
+    };
+    
+    while (true) {
+        pid_t reaped = ::wait4(pid, &status, WNOHANG, &usage);
+        if (reaped == pid || (reaped < 0 && errno == ECHILD)) {
+            // Take what the child left in the pipes; grandchildren holding them are not waited for
+            drain_all();
+            return true;
+        }
+        if (!terminated && finished && finished()) {
+            drain_all(); // output written before the report is already in the pipes
+            return false;
+        }
+        
+        Clock::time_point now = Clock::now();
+        bool expired = limited && now >= deadline;
+        bool cancelled = spec.cancel && spec.cancel->is_cancelled();
+        if (!terminated && (expired || cancelled)) {
+            ::kill(-pid, SIGTERM);
+            terminated = true;
+            output.timed_out = expired;
+            output.cancelled = !expired;
+            kill_at = now + spec.kill_grace;
+        }
+        if (terminated && !killed && now >= kill_at) {
+            ::kill(-pid, SIGKILL);
+            killed = true;
+        }
+        
+        pollfd fds[3];
+        Stream* polled[3];
+        nfds_t open = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (streams[i].fd.get() >= 0) {
+                fds[open] = pollfd{streams[i].fd.get(), POLLIN, 0};
+                polled[open++] = &streams[i];
+            }
+        }
+        
+        auto wait = std::chrono::milliseconds(open > 0 ? POLL_TICK_MS : REAP_TICK_MS);
+        if (limited && !terminated) {
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now));
+        } else if (terminated && !killed) {
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(kill_at - now));
+        }
+        int ready = ::poll(fds, open, static_cast<int>(std::max<int64_t>(0, wait.count())));
+        if (ready < 0 && errno != EINTR) {
+            ::kill(-pid, SIGKILL);
+            ::wait4(pid, &status, 0, &usage);
+            throw std::runtime_error(system_error("poll failed while running " + spec.argv.front()));
+        }
+        for (nfds_t i = 0; ready > 0 && i < open; ++i) {
+            if (fds[i].revents != 0) {
+                drain(*polled[i], buffer, spec);
+            }
+        }
+    }
+}
+
+// Hands what was captured of stdout and stderr to output, and to on_output whatever it has not seen
+void collect(OutputCapture* captures, const ProcessSpec& spec, ProcessOutput& output) {
+    std::string* texts[2] = {&output.stdout_output, &output.stderr_output};
+    uint64_t* totals[2] = {&output.stdout_bytes, &output.stderr_bytes};
+    std::string* logs[2] = {&output.stdout_log, &output.stderr_log};
+    for (int i = 0; i < 2; ++i) {
+        OutputCapture& capture = captures[i];
+        capture.finish();
+        *texts[i] = capture.text();
+        *totals[i] = capture.total_bytes();
+        *logs[i] = capture.log_path();
+        output.truncated = output.truncated || capture.truncated();
+        if (spec.on_output) {
+            std::string rest = capture.continuation();
+            if (!rest.empty()) {
+                spec.on_output(i + 1, rest);
+            }
+        }
+    }
+}
+
+// Reads NUL-separated directory and command pairs from stdin and reports
+// "status\0pwd\0times\0" on fd 3, times being the output of bash's times builtin
+constexpr const char* SESSION_DRIVER =
+    "while IFS= read -r -d '' __mag_dir && IFS= read -r -d '' __mag_command; do\n"
+    "  if [ -n \"$__mag_dir\" ] && ! cd -- \"$__mag_dir\"; then\n"
+    "    { printf '%s\\0%s\\0' 1 \"$PWD\"; times; printf '\\0'; } >&3\n"
+    "    continue\n"
+    "  fi\n"
+    "  eval \"$__mag_command\" </dev/null\n"
+    "  __mag_status=$?\n"
+    "  { printf '%s\\0%s\\0' \"$__mag_status\" \"$PWD\"; times; printf '\\0'; } >&3\n"
+    "done\n";
+
+// User and system CPU of the shell plus its children from "0m0.010s 0m0.004s" lines
+ResourceUsage parse_times(const std::string& text) {
+    ResourceUsage usage;
+    std::istringstream lines(text);
+    std::string user;
+    std::string system;
+    auto micros = [](const std::string& field) {
+        double minutes = std::strtod(field.c_str(), nullptr);
+        size_t m = field.find('m');
+        double seconds = m == std::string::npos ? 0.0 : std::strtod(field.c_str() + m + 1, nullptr);
+        return std::chrono::microseconds(static_cast<int64_t>((minutes * 60 + seconds) * 1e6 + 0.5));
+    };
+    while (lines >> user >> system) {
+        usage.user_cpu += micros(user);
+        usage.system_cpu += micros(system);
+    }
+    return usage;
+}
+
+} // anonymous namespace
+
+OutputCapture::OutputCapture(size_t head_bytes, std::string spill_directory, uint64_t max_spill_bytes)
+    : head_limit_(head_bytes), spill_directory_(std::move(spill_directory)), max_spill_bytes_(max_spill_bytes) {
+}
+
+OutputCapture::~OutputCapture() {
+    if (log_fd_ >= 0) {
+        ::close(log_fd_);
+    }
+}
+
+size_t OutputCapture::append(std::string_view data) {
+    size_t room = head_limit_ - std::min(head_limit_, head_.size());
+    size_t to_head = std::min(room, data.size());
+    head_.append(data.data(), to_head);
+    std::string_view rest = data.substr(to_head);
+    
+    if (!rest.empty()) {
+        if (log_fd_ < 0 && log_path_.empty() && !spill_directory_.empty()) {
+            std::string name = spill_directory_ + "/output-XXXXXX";
+            int fd = ::mkstemp(name.data());
+            if (fd >= 0) {
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                log_fd_ = fd;
+                log_path_ = name;
+                spill(head_);
+            } else {
+                spill_directory_.clear(); // keep the head and tail only
+            }
+        }
+        spill(rest);
+        push_tail(rest);
+    }
+    total_ += data.size();
+    return to_head;
+}
+
+void OutputCapture::finish() {
+    if (log_fd_ >= 0) {
+        ::close(log_fd_);
+        log_fd_ = -1;
+    }
+    if (!log_path_.empty() && !truncated()) {
+        ::unlink(log_path_.c_str()); // everything is in memory after all
+        log_path_.clear();
+    }
+}
+
+void OutputCapture::spill(std::string_view data) {
+    if (log_fd_ < 0) {
+        return;
+    }
+    size_t size = static_cast<size_t>(std::min<uint64_t>(data.size(), max_spill_bytes_ - logged_));
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::write(log_fd_, data.data() + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close(log_fd_); // disk full: the log ends here
+            log_fd_ = -1;
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    logged_ += written;
+}
+
+void OutputCapture::push_tail(std::string_view data) {
+    size_t capacity = head_limit_;
+    if (capacity == 0) {
+        return;
+    }
+    if (tail_.size() != capacity) {
+        tail_.assign(capacity, '\0');
+    }
+    if (data.size() >= capacity) {
+        tail_.assign(data.substr(data.size() - capacity));
+        tail_start_ = 0;
+        tail_filled_ = capacity;
+        return;
+    }
+    size_t end = (tail_start_ + tail_filled_) % capacity;
+    size_t first = std::min(data.size(), capacity - end);
+    std::memcpy(tail_.data() + end, data.data(), first);
+    std::memcpy(tail_.data(), data.data() + first, data.size() - first);
+    tail_filled_ += data.size();
+    if (tail_filled_ > capacity) {
+        tail_start_ = (tail_start_ + tail_filled_ - capacity) % capacity;
+        tail_filled_ = capacity;
+    }
+}
+
+std::string OutputCapture::tail_after_head() const {
+    std::string tail;
+    tail.reserve(tail_filled_);
+    size_t first = std::min(tail_filled_, tail_.size() - tail_start_);
+    tail.append(tail_, tail_start_, first);
+    tail.append(tail_, 0, tail_filled_ - first);
+    return tail;
+}
+
+std::string OutputCapture::continuation() const {
+    if (!truncated()) {
+        return tail_after_head();
+    }
+    uint64_t dropped = total_ - head_.size() - tail_filled_;
+    std::string note = "\n[... " + std::to_string(dropped) + " bytes omitted";
+    if (!log_path_.empty()) {
+        note += logged_ < total_ ? "; the first " + std::to_string(logged_) + " bytes are in " + log_path_
+                                 : "; full output in " + log_path_;
+    }
+    return note + " ...]\n" + tail_after_head();
+}
+
+std::string OutputCapture::text() const {
+    return head_ + continuation();
+}
+
+ProcessOutput ProcessRunner::run(const ProcessSpec& spec) {
+    if (spec.argv.empty()) {
+        throw std::invalid_argument("ProcessRunner needs a program to run");
+    }
+    
+    ProcessOutput output;
+    OutputCapture captures[2] = {OutputCapture(spec.max_output_bytes, spec.spill_directory, spec.max_spill_bytes),
+                                 OutputCapture(spec.max_output_bytes, spec.spill_directory, spec.max_spill_bytes)};
+    OutputCapture report;
+    Stream streams[3];
+    Fd write_ends[3];
+    size_t stream_count = spec.capture_fd3 ? 3 : 2;
+    streams[0].sink = &captures[0];
+    streams[1].sink = &captures[1];
+    streams[2].sink = &report;
+    for (size_t i = 0; i < stream_count; ++i) {
+        streams[i].number = static_cast<int>(i) + 1;
+        open_pipe(streams[i].fd, write_ends[i]);
+    }
+    
+    pid_t pid = spawn(spec.argv, -1, write_ends, stream_count, spec.limits);
+    for (size_t i = 0; i < stream_count; ++i) {
+        write_ends[i].reset(); // only the child writes; EOF arrives when it is done
+    }
+    
+    int status = 0;
+    rusage usage{};
+    supervise(pid, streams, stream_count, spec, output, nullptr, status, usage);
+    output.exit_code = exit_code_of(status);
+    output.usage = usage_of(usage);
+    collect(captures, spec, output);
+    output.fd3_output = report.text();
+    return output;
+}
+
+struct ShellSession::Pipes {
+    Fd input;        // the shell's stdin
+    Stream streams[3]; // stdout, stderr, reports
+};
+
+ShellSession::ShellSession(const ResourceLimits& limits) : pipes_(std::make_unique<Pipes>()) {
+    // A socket rather than a pipe, so writing to a shell that died raises no SIGPIPE
+    int ends[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+        throw std::runtime_error(system_error("Failed to create shell session socket"));
+    }
+    Fd input_read;
+    input_read.reset(ends[0]);
+    pipes_->input.reset(ends[1]);
+    ::fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+    
+    Fd write_ends[3];
+    for (size_t i = 0; i < 3; ++i) {
+        pipes_->streams[i].number = static_cast<int>(i) + 1;
+        open_pipe(pipes_->streams[i].fd, write_ends[i]);
+    }
+    pid_ = spawn({"bash", "--noprofile", "--norc", "-c", SESSION_DRIVER, "mag-session"},
+                 input_read.get(), write_ends, 3, limits);
+}
+
+ShellSession::~ShellSession() {
+    shut_down();
+}
+
+void ShellSession::shut_down() {
+    if (pid_ > 0) {
+        pipes_->input.reset(); // EOF ends the read loop of a shell that is still idle
+        ::kill(-pid_, SIGKILL);
+        int status = 0;
+        ::waitpid(pid_, &status, 0);
+        pid_ = -1;
+    }
+}
+
+ProcessOutput ShellSession::run(const std::string& command, const std::string& working_directory,
+                                const ProcessSpec& spec) {
+    if (!alive()) {
+        throw std::runtime_error("Shell session has exited");
+    }
+    if (command.find('\0') != std::string::npos || working_directory.find('\0') != std::string::npos) {
+        throw std::invalid_argument("Commands cannot contain NUL bytes");
+    }
+    
+    ProcessOutput output;
+    OutputCapture captures[2] = {OutputCapture(spec.max_output_bytes, spec.spill_directory, spec.max_spill_bytes),
+                                 OutputCapture(spec.max_output_bytes, spec.spill_directory, spec.max_spill_bytes)};
+    OutputCapture report_capture;
+    OutputCapture discarded(0);
+    
+    // Whatever background jobs printed since the last command is not this command's output
+    ProcessSpec quiet;
+    std::vector<char> buffer(READ_BYTES);
+    for (size_t i = 0; i < 2; ++i) {
+        pipes_->streams[i].sink = &discarded;
+        if (pipes_->streams[i].fd.get() >= 0) {
+            drain(pipes_->streams[i], buffer, quiet);
+        }
+    }
+    pipes_->streams[0].sink = &captures[0];
+    pipes_->streams[1].sink = &captures[1];
+    pipes_->streams[2].sink = &report_capture;
+    
+    std::string request = working_directory + '\0' + command + '\0';
+    size_t written = 0;
+    while (written < request.size()) {
+        ssize_t n = ::send(pipes_->input.get(), request.data() + written, request.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            std::string error = system_error("Failed to send command to shell session");
+            shut_down();
+            throw std::runtime_error(error);
+        }
+        written += static_cast<size_t>(n);
+    }
+    
+    // Done once "status\0pwd\0times\0" has arrived on fd 3
+    auto reported = [&report_capture] {
+        std::string report = report_capture.text();
+        return std::count(report.begin(), report.end(), '\0') >= 3;
+    };
+    int status = 0;
+    rusage usage{};
+    bool exited = supervise(pid_, pipes_->streams, 3, spec, output, reported, status, usage);
+    collect(captures, spec, output);
+    
+    if (exited) {
+        pid_ = -1; // reaped by supervise
+        output.exit_code = exit_code_of(status);
+        ResourceUsage total = usage_of(usage); // the whole life of the shell
+        output.usage = total;
+        output.usage.user_cpu = std::max(total.user_cpu - consumed_.user_cpu, std::chrono::microseconds(0));
+        output.usage.system_cpu = std::max(total.system_cpu - consumed_.system_cpu, std::chrono::microseconds(0));
+        shut_down();
+        return output;
+    }
+    std::string report = report_capture.text();
+    size_t end_of_status = report.find('\0');
+    size_t end_of_pwd = report.find('\0', end_of_status + 1);
+    output.exit_code = std::atoi(report.substr(0, end_of_status).c_str());
+    output.fd3_output = report.substr(end_of_status + 1, end_of_pwd - end_of_status - 1);
+    
+    ResourceUsage consumed = parse_times(report.substr(end_of_pwd + 1, report.find('\0', end_of_pwd + 1) - end_of_pwd - 1));
+    output.usage.user_cpu = consumed.user_cpu - consumed_.user_cpu;
+    output.usage.system_cpu = consumed.system_cpu - consumed_.system_cpu;
+    consumed_ = consumed;
+    return output;
+}
+
+ShellSessions::ShellSessions(size_t max_sessions, std::chrono::seconds idle_timeout, ResourceLimits limits)
+    : max_sessions_(std::max<size_t>(1, max_sessions)), idle_timeout_(idle_timeout), limits_(limits) {
+}
+
+ProcessOutput ShellSessions::run(const std::string& name, const std::string& command,
+                                 const std::string& working_directory, const ProcessSpec& spec, bool* fresh) {
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        reap_idle(now);
+        auto it = slots_.find(name);
+        if (it == slots_.end()) {
+            make_room();
+            it = slots_.emplace(name, std::make_shared<Slot>()).first;
+        }
+        slot = it->second;
+        slot->busy = true;
+        slot->last_used = now;
+    }
+    
+    std::lock_guard<std::mutex> running(slot->mutex);
+    auto finish = [&] {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->busy = false;
+        slot->last_used = std::chrono::steady_clock::now();
+    };
+    try {
+        bool started = false;
+        if (!slot->shell || !slot->shell->alive()) {
+            slot->shell = std::make_unique<ShellSession>(limits_);
+            started = true;
+        }
+        if (fresh) {
+            *fresh = started;
+        }
+        ProcessOutput output = slot->shell->run(command, working_directory, spec);
+        finish();
+        return output;
+    } catch (...) {
+        finish();
+        throw;
+    }
+}
+
+bool ShellSessions::close(const std::string& name) {
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = slots_.find(name);
+        if (it == slots_.end()) {
+            return false;
+        }
+        slot = std::move(it->second);
+        slots_.erase(it);
+    }
+    std::lock_guard<std::mutex> running(slot->mutex); // after its command, if one is running
+    slot->shell.reset();
+    return true;
+}
+
+size_t ShellSessions::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slots_.size();
+}
+
+void ShellSessions::reap_idle(std::chrono::steady_clock::time_point now) {
+    for (auto it = slots_.begin(); it != slots_.end();) {
+        if (!it->second->busy && now - it->second->last_used > idle_timeout_) {
+            it = slots_.erase(it); // the shell goes with the last reference
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ShellSessions::make_room() {
+    if (slots_.size() < max_sessions_) {
+        return;
+    }
+    auto lru = slots_.end();
+    for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+        if (!it->second->busy && (lru == slots_.end() || it->second->last_used < lru->second->last_used)) {
+            lru = it;
+        }
+    }
+    if (lru != slots_.end()) {
+        slots_.erase(lru);
+    }
+}
+
+} // namespace mag
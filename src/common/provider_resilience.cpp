@@ -0,0 +1,237 @@
+#include "provider_resilience.h"
+#include "config.h"
+#include "utils.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <thread>
+
+namespace mag {
+
+// ---------------------------------------------------------------------------
+// TokenBucket
+
+TokenBucket::TokenBucket(double tokens_per_second, double burst)
+    : rate_(tokens_per_second)
+    , capacity_(std::max(1.0, burst))
+    , tokens_(capacity_)
+    , last_refill_(std::chrono::steady_clock::now()) {
+}
+
+std::chrono::milliseconds TokenBucket::try_acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+    tokens_ = std::min(capacity_, tokens_ + elapsed * rate_);
+    last_refill_ = now;
+    
+    if (tokens_ >= 1.0) {
+        tokens_ -= 1.0;
+        return std::chrono::milliseconds(0);
+    }
+    if (rate_ <= 0.0) {
+        return std::chrono::milliseconds(1000);
+    }
+    double missing_seconds = (1.0 - tokens_) / rate_;
+    return std::chrono::milliseconds(static_cast<long>(std::ceil(missing_seconds * 1000.0)));
+}
+
+bool TokenBucket::acquire(const CancellationToken* cancel) {
+    while (true) {
+        auto wait = try_acquire();
+        if (wait.count() == 0) {
+            return true;
+        }
+        if (cancel) {
+            if (cancel->wait_for(wait)) {
+                return false;
+            }
+        } else {
+            std::this_thread::sleep_for(wait);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// RetryPolicy
+
+bool RetryPolicy::is_retryable(const HttpResponse& response) {
+    long status = response.status_code;
+    if (status == 0) {
+        return true; // connection, DNS or timeout failure
+    }
+    return status == 408 || status == 429 || status == 529 || (status >= 500 && status <= 599);
+}
+
+std::optional<std::chrono::milliseconds> RetryPolicy::retry_after(const HttpResponse& response) {
+    const double max_ms = static_cast<double>(MAX_RETRY_AFTER_HINT.count());
+    
+    std::string ms_value = response.header("retry-after-ms");
+    if (!ms_value.empty()) {
+        double ms = 0;
+        const char* end = ms_value.data() + ms_value.size();
+        auto [parsed, error] = std::from_chars(ms_value.data(), end, ms);
+        if (error == std::errc::result_out_of_range) {
+            // ms is left untouched: a leading '-' stays rejected, "1e-400" rounds to zero
+            if (ms_value.front() == '-') {
+                ms = -1;
+            } else {
+                ms = ms_value.find('-') == std::string::npos ? max_ms : 0;
+            }
+        }
+        if (parsed == end && (error == std::errc() || error == std::errc::result_out_of_range) &&
+            !std::isnan(ms) && ms >= 0) {
+            // Clamped before converting: a double beyond long's range has no defined cast
+            return std::chrono::milliseconds(static_cast<long>(std::min(ms, max_ms)));
+        }
+    }
+    
+    std::string value = response.header("retry-after");
+    if (value.empty()) {
+        return std::nullopt;
+    }
+    uint64_t seconds = 0;
+    const char* end = value.data() + value.size();
+    auto [parsed, error] = std::from_chars(value.data(), end, seconds);
+    if (parsed == end) {
+        if (error == std::errc::result_out_of_range || seconds * 1000.0 > max_ms) {
+            return MAX_RETRY_AFTER_HINT;
+        }
+        return std::chrono::milliseconds(static_cast<long>(seconds) * 1000);
+    }
+    
+    // HTTP-date, e.g. "Wed, 21 Oct 2015 07:28:00 GMT"
+    std::tm tm{};
+    if (!strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &tm)) {
+        return std::nullopt;
+    }
+    double seconds_until = std::difftime(timegm(&tm), std::time(nullptr));
+    return std::chrono::milliseconds(static_cast<long>(std::clamp(seconds_until * 1000.0, 0.0, max_ms)));
+}
+
+std::chrono::milliseconds RetryPolicy::backoff(int retry, const HttpResponse& response) const {
+    if (auto hinted = retry_after(response)) {
+        return std::min(*hinted, max_retry_after);
+    }
+    
+    // Full jitter: uniform in [0, min(max_delay, base * 2^retry)] spreads retry storms out
+    double ceiling = std::min<double>(max_delay.count(), base_delay.count() * std::pow(2.0, retry));
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(0.0, ceiling);
+    return std::chrono::milliseconds(static_cast<long>(jitter(rng)));
+}
+
+// ---------------------------------------------------------------------------
+// CircuitBreaker
+
+CircuitBreaker::CircuitBreaker(int failure_threshold, std::chrono::milliseconds open_duration)
+    : failure_threshold_(std::max(1, failure_threshold)), open_duration_(open_duration) {
+}
+
+CircuitBreaker::Permit CircuitBreaker::allow_request() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (state_) {
+        case State::CLOSED:
+            return {true, false, generation_};
+        case State::OPEN:
+            if (std::chrono::steady_clock::now() - opened_at_ < open_duration_) {
+                return {};
+            }
+            state_ = State::HALF_OPEN;
+            probe_in_flight_ = true;
+            return {true, true, generation_};
+        case State::HALF_OPEN:
+            // Only one probe at a time; everyone else keeps failing fast
+            if (probe_in_flight_) {
+                return {};
+            }
+            probe_in_flight_ = true;
+            return {true, true, generation_};
+    }
+    return {};
+}
+
+void CircuitBreaker::record_success(const Permit& permit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_current_probe(permit)) {
+        state_ = State::CLOSED;
+        consecutive_failures_ = 0;
+        probe_in_flight_ = false;
+    } else if (!permit.probe && state_ == State::CLOSED && permit.generation == generation_) {
+        consecutive_failures_ = 0;
+    }
+}
+
+void CircuitBreaker::record_failure(const Permit& permit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_current_probe(permit)) {
+        open();
+    } else if (!permit.probe && state_ == State::CLOSED && permit.generation == generation_ &&
+               ++consecutive_failures_ >= failure_threshold_) {
+        open();
+    }
+}
+
+void CircuitBreaker::release_probe(const Permit& permit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_current_probe(permit)) {
+        probe_in_flight_ = false;
+    }
+}
+
+bool CircuitBreaker::is_current_probe(const Permit& permit) const {
+    return permit.probe && state_ == State::HALF_OPEN && probe_in_flight_ && permit.generation == generation_;
+}
+
+void CircuitBreaker::open() {
+    state_ = State::OPEN;
+    opened_at_ = std::chrono::steady_clock::now();
+    probe_in_flight_ = false;
+    ++generation_;
+}
+
+CircuitBreaker::State CircuitBreaker::state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+// ---------------------------------------------------------------------------
+// ProviderResilience
+
+ProviderResilience& ProviderResilience::instance() {
+    static ProviderResilience resilience;
+    return resilience;
+}
+
+ProviderResilience::ProviderResilience()
+    : retry_policy_{ResilienceConfig::MAX_RETRIES,
+                    std::chrono::milliseconds(ResilienceConfig::BASE_BACKOFF_MS),
+                    std::chrono::milliseconds(ResilienceConfig::MAX_BACKOFF_MS),
+                    std::chrono::milliseconds(ResilienceConfig::MAX_RETRY_AFTER_MS)} {
+}
+
+TokenBucket& ProviderResilience::rate_limiter(const std::string& provider, const std::string& api_key) {
+    // Hash the API key so it is not copied into long-lived map keys
+    std::string key = provider + "/" + Utils::hash_to_hex(Utils::hash64(api_key));
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& limiter = limiters_[key];
+    if (!limiter) {
+        limiter = std::make_unique<TokenBucket>(ResilienceConfig::get_requests_per_minute() / 60.0,
+                                                ResilienceConfig::get_burst());
+    }
+    return *limiter;
+}
+
+CircuitBreaker& ProviderResilience::breaker(const std::string& provider) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& breaker = breakers_[provider];
+    if (!breaker) {
+        breaker = std::make_unique<CircuitBreaker>(ResilienceConfig::BREAKER_FAILURE_THRESHOLD,
+                                                   std::chrono::milliseconds(ResilienceConfig::BREAKER_OPEN_MS));
+    }
+    return *breaker;
+}
+
+} // namespace mag
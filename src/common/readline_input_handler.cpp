@@ -6,8 +6,11 @@
 #include <readline/history.h>
 #endif
 
+#include <cerrno>
 #include <iostream>
 #include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
 
 namespace mag {
 
@@ -34,11 +37,18 @@ ReadlineInputHandler::ReadlineInputHandler() {
 }
 
 ReadlineInputHandler::~ReadlineInputHandler() {
+    if (callback_installed_) {
+        rl_callback_handler_remove();
+    }
     save_history();
     current_instance_ = nullptr;
 }
 
 std::string ReadlineInputHandler::get_line(const std::string& prompt) {
+    if (callback_installed_) {
+        rl_callback_handler_remove();
+        callback_installed_ = false;
+    }
     char* line = readline(prompt.c_str());
     
     if (line == nullptr) {
@@ -52,6 +62,59 @@ std::string ReadlineInputHandler::get_line(const std::string& prompt) {
     return result;
 }
 
+InputHandler::InputEvent ReadlineInputHandler::wait_for_line(const std::string& prompt, int wake_fd,
+                                                             std::string& line) {
+    if (!callback_installed_) {
+        rl_callback_handler_install(prompt.c_str(), line_callback);
+        callback_installed_ = true;
+        shown_prompt_ = prompt;
+    } else if (prompt != shown_prompt_) {
+        // Output printed since the last prompt left the cursor on a fresh line
+        rl_set_prompt(prompt.c_str());
+        rl_on_new_line();
+        rl_redisplay();
+        shown_prompt_ = prompt;
+    }
+    
+    while (completed_lines_.empty()) {
+        pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (::poll(fds, wake_fd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return InputEvent::END;
+        }
+        if (wake_fd >= 0 && (fds[1].revents & POLLIN)) {
+            return InputEvent::WOKEN;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            rl_callback_read_char(); // may complete a line through line_callback
+        }
+    }
+    
+    std::unique_ptr<std::string> completed = std::move(completed_lines_.front());
+    completed_lines_.pop_front();
+    if (!completed) {
+        return InputEvent::END;
+    }
+    line = std::move(*completed);
+    return InputEvent::LINE;
+}
+
+void ReadlineInputHandler::line_callback(char* line) {
+    if (!current_instance_) {
+        free(line);
+        return;
+    }
+    current_instance_->completed_lines_.push_back(line ? std::make_unique<std::string>(line) : nullptr);
+    free(line);
+    
+    // Readline redraws the prompt once this returns; leave it blank until the
+    // caller asks for the next line, so a command's output is not run into it
+    rl_set_prompt("");
+    current_instance_->shown_prompt_.clear();
+}
+
 void ReadlineInputHandler::add_history(const std::string& line) {
     if (!line.empty() && line != "exit" && line != "quit") {
         ::add_history(line.c_str());
@@ -126,6 +189,11 @@ std::string ReadlineInputHandler::get_line(const std::string& prompt) {
     return line;
 }
 
+InputHandler::InputEvent ReadlineInputHandler::wait_for_line(const std::string& prompt, int wake_fd,
+                                                             std::string& line) {
+    return InputHandler::wait_for_line(prompt, wake_fd, line);
+}
+
 void ReadlineInputHandler::add_history(const std::string& line) {
     // No-op in fallback
 }
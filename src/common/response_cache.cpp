@@ -0,0 +1,248 @@
+#include "response_cache.h"
+#include "utils.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace mag {
+
+namespace {
+
+constexpr uint64_t KEY_SEED_LOW = 0;
+constexpr uint64_t KEY_SEED_HIGH = 0x9E3779B97F4A7C15ULL;
+
+int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(const std::string& directory, size_t memory_capacity, std::chrono::seconds ttl,
+                             size_t disk_capacity)
+    : directory_(directory), memory_capacity_(memory_capacity), ttl_(ttl), disk_capacity_(disk_capacity) {
+    if (!directory_.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory_, ec);
+        prune_disk();
+    }
+}
+
+std::string ResponseCache::make_key(std::initializer_list<std::string_view> fields) {
+    std::string material;
+    for (std::string_view field : fields) {
+        material += std::to_string(field.size());
+        material += ':';
+        material.append(field.data(), field.size());
+    }
+    return Utils::hash_to_hex(Utils::hash64(material, KEY_SEED_HIGH)) +
+           Utils::hash_to_hex(Utils::hash64(material, KEY_SEED_LOW));
+}
+
+std::optional<std::string> ResponseCache::get(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            if (!is_expired(it->second->second.created_at)) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                ++hits_;
+                return it->second->second.body;
+            }
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+    
+    // Disk is read outside the lock; a concurrent put of the same key is harmless
+    std::optional<Entry> entry = load_from_disk(key);
+    
+    if (entry && is_expired(entry->created_at)) {
+        remove_from_disk(key);
+        entry.reset();
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!entry) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    std::string body = entry->body;
+    insert_locked(key, std::move(*entry));
+    return body;
+}
+
+void ResponseCache::put(const std::string& key, const std::string& body) {
+    Entry entry{body, now_seconds()};
+    store_to_disk(key, entry);
+    
+    bool prune = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert_locked(key, std::move(entry));
+        if (!directory_.empty() && ++puts_since_prune_ >= PRUNE_INTERVAL) {
+            puts_since_prune_ = 0;
+            prune = true;
+        }
+    }
+    if (prune) {
+        prune_disk();
+    }
+}
+
+void ResponseCache::erase(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+    remove_from_disk(key);
+}
+
+size_t ResponseCache::memory_size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+size_t ResponseCache::disk_size() const {
+    if (directory_.empty()) {
+        return 0;
+    }
+    size_t count = 0;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory_, ec)) {
+        count += file.path().extension() == ".json";
+    }
+    return count;
+}
+
+size_t ResponseCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+size_t ResponseCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+bool ResponseCache::is_expired(int64_t created_at) const {
+    return now_seconds() - created_at > ttl_.count();
+}
+
+std::string ResponseCache::path_for(const std::string& key) const {
+    return (std::filesystem::path(directory_) / (key + ".json")).string();
+}
+
+std::optional<ResponseCache::Entry> ResponseCache::load_from_disk(const std::string& key) const {
+    if (directory_.empty()) {
+        return std::nullopt;
+    }
+    std::ifstream file(path_for(key), std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    try {
+        nlohmann::json j = nlohmann::json::parse(file);
+        return Entry{j.at("body").get<std::string>(), j.at("created_at").get<int64_t>()};
+    } catch (const nlohmann::json::exception&) {
+        // Truncated or foreign file; treat as a miss
+        return std::nullopt;
+    }
+}
+
+void ResponseCache::store_to_disk(const std::string& key, const Entry& entry) const {
+    if (directory_.empty()) {
+        return;
+    }
+    std::string path = path_for(key);
+    std::ostringstream temp_name;
+    temp_name << path << ".tmp." << std::this_thread::get_id();
+    std::string temp_path = temp_name.str();
+    
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file << nlohmann::json{{"created_at", entry.created_at}, {"body", entry.body}}.dump();
+        if (!file) {
+            std::error_code ec;
+            std::filesystem::remove(temp_path, ec);
+            return;
+        }
+    }
+    
+    // Rename is atomic, so readers never see a half-written entry
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+    }
+}
+
+void ResponseCache::remove_from_disk(const std::string& key) const {
+    if (!directory_.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(path_for(key), ec);
+    }
+}
+
+void ResponseCache::prune_disk() {
+    std::lock_guard<std::mutex> lock(prune_mutex_);
+    // An entry file is written once, when it is put, so its mtime is its age
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    auto expired_before = std::filesystem::file_time_type::clock::now() - ttl_;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory_, ec)) {
+        if (file.path().extension() != ".json") {
+            continue;
+        }
+        std::error_code stat_ec;
+        auto mtime = file.last_write_time(stat_ec);
+        if (stat_ec) {
+            continue;
+        }
+        if (mtime < expired_before) {
+            std::filesystem::remove(file.path(), stat_ec);
+        } else {
+            files.emplace_back(mtime, file.path());
+        }
+    }
+    if (files.size() <= disk_capacity_) {
+        return;
+    }
+    size_t excess = files.size() - disk_capacity_;
+    std::nth_element(files.begin(), files.begin() + excess, files.end());
+    for (size_t i = 0; i < excess; ++i) {
+        std::filesystem::remove(files[i].second, ec);
+    }
+}
+
+void ResponseCache::insert_locked(const std::string& key, Entry entry) {
+    if (memory_capacity_ == 0) {
+        return;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        it->second->second = std::move(entry);
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    lru_.emplace_front(key, std::move(entry));
+    index_[key] = lru_.begin();
+    while (lru_.size() > memory_capacity_) {
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+} // namespace mag
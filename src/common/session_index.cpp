@@ -0,0 +1,268 @@
+#include "session_index.h"
+#include "session_journal.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+constexpr int INDEX_VERSION = 1;
+
+// Exclusive flock() on the index lock file for the lifetime of the object
+class IndexLock {
+public:
+    explicit IndexLock(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error("Failed to open session index lock " + path + ": " + std::strerror(errno));
+        }
+        while (::flock(fd_, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                ::close(fd_);
+                throw std::runtime_error("Failed to lock session index " + path + ": " + std::strerror(errno));
+            }
+        }
+    }
+
+    ~IndexLock() {
+        ::flock(fd_, LOCK_UN);
+        ::close(fd_);
+    }
+
+    IndexLock(const IndexLock&) = delete;
+    IndexLock& operator=(const IndexLock&) = delete;
+
+private:
+    int fd_ = -1;
+};
+
+SessionInfo scan_journal(const std::filesystem::path& path) {
+    JournalSnapshot snapshot = SessionJournal::read(path.string());
+    SessionInfo info;
+    info.id = path.stem().string();
+    info.created = snapshot.metadata.value("created", "");
+    info.last_activity = snapshot.metadata.value("last_activity", "");
+    info.last_provider = snapshot.metadata.value("last_provider", "");
+    info.message_count = snapshot.messages.size();
+    if (info.last_activity.empty() && !snapshot.messages.empty()) {
+        info.last_activity = snapshot.messages.back().timestamp();
+    }
+    return info;
+}
+
+SessionInfo scan_legacy_file(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    nlohmann::json j = nlohmann::json::parse(file);
+    SessionInfo info;
+    info.id = path.stem().string();
+    info.created = j.value("created", "");
+    info.last_activity = j.value("last_activity", "");
+    info.last_provider = j.value("last_provider", "");
+    if (j.contains("messages") && j["messages"].is_array()) {
+        info.message_count = j["messages"].size();
+    }
+    return info;
+}
+
+} // anonymous namespace
+
+nlohmann::json SessionInfo::to_json() const {
+    return {
+        {"id", id},
+        {"created", created},
+        {"last_activity", last_activity},
+        {"last_provider", last_provider},
+        {"message_count", message_count}
+    };
+}
+
+SessionInfo SessionInfo::from_json(const nlohmann::json& j) {
+    SessionInfo info;
+    info.id = j.at("id").get<std::string>();
+    info.created = j.value("created", "");
+    info.last_activity = j.value("last_activity", "");
+    info.last_provider = j.value("last_provider", "");
+    info.message_count = j.value("message_count", size_t{0});
+    return info;
+}
+
+SessionIndex::SessionIndex(std::string storage_directory)
+    : directory_(std::move(storage_directory)),
+      index_directory_(directory_ + "/.index"),
+      index_path_(index_directory_ + "/sessions.json") {}
+
+void SessionIndex::update(const SessionInfo& info) {
+    std::filesystem::create_directories(index_directory_);
+    IndexLock lock(index_directory_ + "/lock");
+    refresh_locked();
+    insert(info);
+    write_file();
+}
+
+std::optional<SessionInfo> SessionIndex::find(const std::string& session_id) {
+    refresh();
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<SessionInfo> SessionIndex::list(size_t offset, size_t limit) {
+    refresh();
+    std::vector<SessionInfo> page;
+    if (offset >= order_.size()) {
+        return page;
+    }
+    auto it = std::next(order_.begin(), static_cast<std::ptrdiff_t>(offset));
+    for (; it != order_.end() && page.size() < limit; ++it) {
+        page.push_back(sessions_.at(it->second));
+    }
+    return page;
+}
+
+size_t SessionIndex::size() {
+    refresh();
+    return sessions_.size();
+}
+
+void SessionIndex::rebuild() {
+    if (!std::filesystem::exists(directory_)) {
+        clear();
+        return;
+    }
+    std::filesystem::create_directories(index_directory_);
+    IndexLock lock(index_directory_ + "/lock");
+    rebuild_locked();
+}
+
+void SessionIndex::refresh() {
+    if (!std::filesystem::exists(directory_)) {
+        clear();
+        return;
+    }
+    // Readers skip the lock: the index file is only ever replaced by rename
+    if (!is_stale()) {
+        auto mtime = std::filesystem::last_write_time(index_path_);
+        if (loaded_mtime_ == mtime || load_file()) {
+            return;
+        }
+    }
+    std::filesystem::create_directories(index_directory_);
+    IndexLock lock(index_directory_ + "/lock");
+    refresh_locked();
+}
+
+void SessionIndex::refresh_locked() {
+    if (is_stale()) {
+        rebuild_locked();
+        return;
+    }
+    if (loaded_mtime_ != std::filesystem::last_write_time(index_path_) && !load_file()) {
+        rebuild_locked();
+    }
+}
+
+bool SessionIndex::is_stale() const {
+    std::error_code ec;
+    auto index_time = std::filesystem::last_write_time(index_path_, ec);
+    if (ec) {
+        return true;
+    }
+    return std::filesystem::last_write_time(directory_) > index_time;
+}
+
+bool SessionIndex::load_file() {
+    try {
+        auto mtime = std::filesystem::last_write_time(index_path_);
+        std::ifstream file(index_path_);
+        nlohmann::json j = nlohmann::json::parse(file);
+        if (j.value("version", 0) != INDEX_VERSION) {
+            return false;
+        }
+        clear();
+        for (const auto& entry : j.at("sessions")) {
+            insert(SessionInfo::from_json(entry));
+        }
+        loaded_mtime_ = mtime;
+        return true;
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("session_index", "Discarding unreadable session index " << index_path_ << ": " << e.what());
+        return false;
+    }
+}
+
+void SessionIndex::write_file() {
+    nlohmann::json sessions = nlohmann::json::array();
+    for (const auto& [activity, id] : order_) {
+        sessions.push_back(sessions_.at(id).to_json());
+    }
+    nlohmann::json j = {{"version", INDEX_VERSION}, {"sessions", std::move(sessions)}};
+
+    std::string temp_path = index_path_ + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to write session index: " + temp_path);
+        }
+        file << j.dump();
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write session index: " + temp_path);
+        }
+    }
+    std::filesystem::rename(temp_path, index_path_);
+    loaded_mtime_ = std::filesystem::last_write_time(index_path_);
+}
+
+void SessionIndex::rebuild_locked() {
+    clear();
+    for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        const auto& path = entry.path();
+        try {
+            if (path.extension() == ".jsonl") {
+                insert(scan_journal(path));
+            } else if (path.extension() == ".json") {
+                // Legacy session; its journal wins once it has been converted
+                auto journal = std::filesystem::path(path).replace_extension(".jsonl");
+                if (!std::filesystem::exists(journal)) {
+                    insert(scan_legacy_file(path));
+                }
+            }
+        } catch (const std::exception& e) {
+            MAG_LOG_WARN("session_index", "Skipping unreadable session " << path.string() << ": " << e.what());
+        }
+    }
+    MAG_LOG_INFO("session_index", "Rebuilt session index for " << directory_ << " (" << sessions_.size() << " sessions)");
+    write_file();
+}
+
+void SessionIndex::insert(SessionInfo info) {
+    auto it = sessions_.find(info.id);
+    if (it != sessions_.end()) {
+        order_.erase({it->second.last_activity, it->second.id});
+        it->second = std::move(info);
+    } else {
+        std::string id = info.id;
+        it = sessions_.emplace(std::move(id), std::move(info)).first;
+    }
+    order_.emplace(it->second.last_activity, it->second.id);
+}
+
+void SessionIndex::clear() {
+    sessions_.clear();
+    order_.clear();
+    loaded_mtime_.reset();
+}
+
+} // namespace mag
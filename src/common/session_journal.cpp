@@ -0,0 +1,302 @@
+#include "session_journal.h"
+#include "config.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+void write_all(int fd, const std::string& data, const std::string& path) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Failed to write session journal " + path + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+// Hands each line to on_line from the last to the first until it returns false
+void for_each_line_backwards(int fd, const std::function<bool(std::string_view)>& on_line) {
+    off_t pos = ::lseek(fd, 0, SEEK_END);
+    if (pos < 0) {
+        return;
+    }
+
+    std::string data; // bytes from file offset pos that do not form a complete line yet
+    while (true) {
+        size_t length = std::min<size_t>(JournalConfig::READ_CHUNK_BYTES, static_cast<size_t>(pos));
+        pos -= static_cast<off_t>(length);
+        std::string chunk(length, '\0');
+        size_t got = 0;
+        while (got < length) {
+            ssize_t n = ::pread(fd, chunk.data() + got, length - got, pos + static_cast<off_t>(got));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            got += static_cast<size_t>(n);
+        }
+        data.insert(0, chunk);
+
+        // Every segment that follows a newline is a complete line
+        size_t end = data.size();
+        while (end > 0) {
+            size_t newline = data.rfind('\n', end - 1);
+            if (newline == std::string::npos) {
+                break;
+            }
+            std::string_view line(data.data() + newline + 1, end - newline - 1);
+            if (!line.empty() && !on_line(line)) {
+                return;
+            }
+            end = newline;
+        }
+        data.resize(end);
+
+        if (pos == 0) {
+            if (!data.empty()) {
+                on_line(data);
+            }
+            return;
+        }
+    }
+}
+
+nlohmann::json message_record(const char* type, const ConversationMessage& message) {
+    nlohmann::json record = message.to_json();
+    record["type"] = type;
+    record["seq"] = message.sequence;
+    return record;
+}
+
+ConversationMessage message_from_record(const nlohmann::json& record) {
+    ConversationMessage message = ConversationMessage::from_json(record);
+    message.sequence = record.value("seq", uint64_t{0});
+    return message;
+}
+
+} // anonymous namespace
+
+SessionJournal::SessionJournal(std::string path)
+    : path_(std::move(path)), compact_after_(JournalConfig::COMPACT_AFTER_DROPPED),
+      last_sync_(std::chrono::steady_clock::now()) {
+    open_for_append();
+}
+
+SessionJournal::~SessionJournal() {
+    try {
+        sync();
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("journal", "Final sync of " << path_ << " failed: " << e.what());
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void SessionJournal::open_for_append() {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open session journal " + path_ + ": " + std::strerror(errno));
+    }
+}
+
+void SessionJournal::append(const nlohmann::json& record) {
+    // One write per record keeps lines whole even if the process dies mid-session
+    write_all(fd_, record.dump() + "\n", path_);
+    ++unsynced_;
+
+    auto now = std::chrono::steady_clock::now();
+    if (unsynced_ >= JournalConfig::SYNC_EVERY_RECORDS ||
+        now - last_sync_ >= std::chrono::milliseconds(JournalConfig::SYNC_INTERVAL_MS)) {
+        sync();
+    }
+}
+
+void SessionJournal::append_message(const ConversationMessage& message) {
+    append(message_record("message", message));
+}
+
+void SessionJournal::append_summary(const ConversationMessage& summary) {
+    append(message_record("summary", summary));
+}
+
+void SessionJournal::append_drop(uint64_t front_sequence, size_t dropped) {
+    append({{"type", "drop"}, {"front", front_sequence}});
+    dead_records_ += dropped + 1;
+}
+
+void SessionJournal::append_clear(size_t dropped) {
+    append({{"type", "clear"}});
+    dead_records_ += dropped + 1;
+}
+
+void SessionJournal::append_metadata(const nlohmann::json& metadata) {
+    nlohmann::json record = metadata;
+    record["type"] = "meta";
+    append(record);
+    ++dead_records_; // superseded by the next one
+}
+
+void SessionJournal::sync() {
+    if (unsynced_ == 0) {
+        return;
+    }
+    if (::fdatasync(fd_) != 0) {
+        throw std::runtime_error("Failed to sync session journal " + path_ + ": " + std::strerror(errno));
+    }
+    unsynced_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+void SessionJournal::compact() {
+    sync();
+    rewrite(read(path_));
+}
+
+void SessionJournal::rewrite(const JournalSnapshot& snapshot) {
+    std::string contents;
+    if (snapshot.messages.empty()) {
+        // Keeps the sequence counter moving forward across the rewrite
+        contents += nlohmann::json{{"type", "drop"}, {"front", snapshot.next_sequence}}.dump() + "\n";
+    }
+    for (size_t i = 0; i < snapshot.messages.size(); ++i) {
+        const char* type = (i == 0 && snapshot.has_summary) ? "summary" : "message";
+        contents += message_record(type, snapshot.messages[i]).dump() + "\n";
+    }
+    nlohmann::json metadata = snapshot.metadata;
+    metadata["type"] = "meta";
+    contents += metadata.dump() + "\n";
+
+    std::string temp_path = path_ + ".tmp";
+    int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp_fd < 0) {
+        throw std::runtime_error("Failed to create " + temp_path + ": " + std::strerror(errno));
+    }
+    try {
+        write_all(temp_fd, contents, temp_path);
+        if (::fdatasync(temp_fd) != 0) {
+            throw std::runtime_error("Failed to sync " + temp_path + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(temp_fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+    ::close(temp_fd);
+
+    if (::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        throw std::runtime_error("Failed to replace session journal " + path_ + ": " + std::strerror(errno));
+    }
+
+    // Make the rename itself durable
+    std::string directory = std::filesystem::path(path_).parent_path().string();
+    int dir_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    open_for_append();
+    unsynced_ = 0;
+    dead_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+JournalSnapshot SessionJournal::read(const std::string& path, size_t max_messages) {
+    JournalSnapshot snapshot;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return snapshot;
+    }
+
+    // Walking backwards, a message is live if its sequence is at or above
+    // the floor set by newer "drop" and "summary" records. Sequences only
+    // grow between clears, so the first dead message ends the walk.
+    std::vector<ConversationMessage> newest_first;
+    std::optional<ConversationMessage> summary;
+    uint64_t live_floor = 0;
+    bool metadata_seen = false;
+
+    for_each_line_backwards(fd, [&](std::string_view line) {
+        nlohmann::json record = nlohmann::json::parse(line, nullptr, false);
+        if (record.is_discarded() || !record.is_object()) {
+            return true; // torn tail or corrupt line
+        }
+        std::string type = record.value("type", "");
+
+        if (type == "meta") {
+            if (!metadata_seen) {
+                record.erase("type");
+                snapshot.metadata = std::move(record);
+                metadata_seen = true;
+            }
+            return true;
+        }
+        if (type == "clear") {
+            return false;
+        }
+        if (type == "drop") {
+            uint64_t front = record.value("front", uint64_t{0});
+            live_floor = std::max(live_floor, front);
+            snapshot.next_sequence = std::max(snapshot.next_sequence, front);
+            return true;
+        }
+        if (type != "message" && type != "summary") {
+            return true;
+        }
+
+        ConversationMessage message = message_from_record(record);
+        snapshot.next_sequence = std::max(snapshot.next_sequence, message.sequence + 1);
+        if (type == "summary") {
+            // A summary replaces everything at or below its own sequence
+            if (message.sequence >= live_floor && !summary) {
+                summary = std::move(message);
+            }
+            live_floor = std::max(live_floor, record.value("seq", uint64_t{0}) + 1);
+            return true;
+        }
+
+        if (message.sequence < live_floor) {
+            return false;
+        }
+        newest_first.push_back(std::move(message));
+        if (newest_first.size() >= max_messages) {
+            snapshot.complete = false;
+            return false;
+        }
+        return true;
+    });
+    ::close(fd);
+
+    if (summary) {
+        snapshot.messages.push_back(std::move(*summary));
+        snapshot.has_summary = true;
+    }
+    snapshot.messages.insert(snapshot.messages.end(),
+                             std::make_move_iterator(newest_first.rbegin()),
+                             std::make_move_iterator(newest_first.rend()));
+    return snapshot;
+}
+
+} // namespace mag
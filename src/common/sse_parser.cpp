@@ -0,0 +1,97 @@
+#include "sse_parser.h"
+
+namespace mag {
+
+SseParser::SseParser(EventCallback on_event) : on_event_(std::move(on_event)) {
+}
+
+void SseParser::feed(const char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        
+        // "\r\n" counts as one line break
+        if (skip_lf_) {
+            skip_lf_ = false;
+            if (c == '\n') {
+                continue;
+            }
+        }
+        
+        if (c == '\r' || c == '\n') {
+            skip_lf_ = (c == '\r');
+            process_line(line_buffer_);
+            line_buffer_.clear();
+        } else {
+            line_buffer_ += c;
+        }
+    }
+}
+
+void SseParser::finish() {
+    if (!line_buffer_.empty()) {
+        process_line(line_buffer_);
+        line_buffer_.clear();
+    }
+    dispatch();
+}
+
+void SseParser::process_line(const std::string& line) {
+    // Blank line terminates the event
+    if (line.empty()) {
+        dispatch();
+        return;
+    }
+    
+    // Comment / keep-alive
+    if (line[0] == ':') {
+        return;
+    }
+    
+    std::string field;
+    std::string value;
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        field = line;
+    } else {
+        field = line.substr(0, colon);
+        size_t value_start = colon + 1;
+        if (value_start < line.size() && line[value_start] == ' ') {
+            ++value_start;
+        }
+        value = line.substr(value_start);
+    }
+    
+    if (field == "data") {
+        if (has_data_) {
+            current_.data += '\n';
+        }
+        current_.data += value;
+        has_data_ = true;
+    } else if (field == "event") {
+        current_.event = value;
+    } else if (field == "id") {
+        current_.id = value;
+    }
+    // "retry" and unknown fields are ignored
+}
+
+void SseParser::dispatch() {
+    if (!has_data_) {
+        current_.event.clear();
+        return;
+    }
+    
+    if (current_.event.empty()) {
+        current_.event = "message";
+    }
+    
+    ++events_parsed_;
+    if (on_event_) {
+        on_event_(current_);
+    }
+    
+    current_ = SseEvent{};
+    has_data_ = false;
+}
+
+} // namespace mag
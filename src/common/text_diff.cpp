@@ -0,0 +1,450 @@
+#include "text_diff.h"
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace mag {
+
+namespace {
+
+enum class EditOp : unsigned char { EQUAL, DELETE, INSERT };
+
+// Lines keep their '\n'; only the last line of a text may lack one
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t newline = text.find('\n', start);
+        size_t end = newline == std::string_view::npos ? text.size() : newline + 1;
+        lines.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    return lines;
+}
+
+// Myers' greedy forward search; ops for a[0..n) -> b[0..m), or empty if it gives up
+std::vector<EditOp> myers(const int* a, size_t n, const int* b, size_t m) {
+    const long N = static_cast<long>(n);
+    const long M = static_cast<long>(m);
+    const long max_d = std::min<long>(N + M, static_cast<long>(MAX_DIFF_EDITS));
+    const long offset = max_d + 1;
+    std::vector<long> v(static_cast<size_t>(2 * max_d + 3), 0);
+    std::vector<std::vector<long>> trace; // trace[d] = v[-d..d] after step d
+    
+    long found = -1;
+    for (long d = 0; d <= max_d && found < 0; ++d) {
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                ? v[offset + k + 1]       // step down: insert b[y]
+                : v[offset + k - 1] + 1;  // step right: delete a[x]
+            long y = x - k;
+            while (x < N && y < M && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= N && y >= M) {
+                found = d;
+            }
+        }
+        trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+    }
+    if (found < 0) {
+        return {};
+    }
+    
+    std::vector<EditOp> ops;
+    long x = N;
+    long y = M;
+    for (long d = found; d > 0; --d) {
+        const std::vector<long>& prev = trace[static_cast<size_t>(d - 1)];
+        auto at = [&prev, d](long k) { return prev[static_cast<size_t>(k + d - 1)]; };
+        long k = x - y;
+        bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        long prev_k = down ? k + 1 : k - 1;
+        long prev_x = at(prev_k);
+        long prev_y = prev_x - prev_k;
+        long mid_x = down ? prev_x : prev_x + 1;
+        while (x > mid_x) {
+            ops.push_back(EditOp::EQUAL);
+            --x;
+            --y;
+        }
+        ops.push_back(down ? EditOp::INSERT : EditOp::DELETE);
+        x = prev_x;
+        y = prev_y;
+    }
+    while (x > 0) {
+        ops.push_back(EditOp::EQUAL);
+        --x;
+    }
+    std::reverse(ops.begin(), ops.end());
+    return ops;
+}
+
+std::vector<EditOp> line_edits(const std::vector<std::string_view>& before,
+                               const std::vector<std::string_view>& after) {
+    size_t prefix = 0;
+    while (prefix < before.size() && prefix < after.size() && before[prefix] == after[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < before.size() - prefix && suffix < after.size() - prefix &&
+           before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    
+    // Compare ids instead of strings inside the search
+    std::unordered_map<std::string_view, int> ids;
+    auto intern = [&ids](const std::vector<std::string_view>& lines, size_t from, size_t to) {
+        std::vector<int> out;
+        out.reserve(to - from);
+        for (size_t i = from; i < to; ++i) {
+            out.push_back(ids.emplace(lines[i], static_cast<int>(ids.size())).first->second);
+        }
+        return out;
+    };
+    std::vector<int> a = intern(before, prefix, before.size() - suffix);
+    std::vector<int> b = intern(after, prefix, after.size() - suffix);
+    
+    std::vector<EditOp> middle = myers(a.data(), a.size(), b.data(), b.size());
+    if (middle.empty() && (!a.empty() || !b.empty())) {
+        middle.assign(a.size(), EditOp::DELETE);
+        middle.insert(middle.end(), b.size(), EditOp::INSERT);
+    }
+    
+    std::vector<EditOp> ops(prefix, EditOp::EQUAL);
+    ops.insert(ops.end(), middle.begin(), middle.end());
+    ops.insert(ops.end(), suffix, EditOp::EQUAL);
+    return ops;
+}
+
+std::string hunk_range(size_t start, size_t count) {
+    // A range of zero lines names the line before it
+    std::string range = std::to_string(count == 0 ? start : start + 1);
+    if (count != 1) {
+        range += "," + std::to_string(count);
+    }
+    return range;
+}
+
+void append_line(std::string& out, char marker, std::string_view line) {
+    out += marker;
+    out.append(line.data(), line.size());
+    if (line.empty() || line.back() != '\n') {
+        out += "\n\\ No newline at end of file\n";
+    }
+}
+
+std::string_view trim_right(std::string_view line) {
+    size_t end = line.find_last_not_of(" \t\r\n");
+    return end == std::string_view::npos ? std::string_view() : line.substr(0, end + 1);
+}
+
+struct Hunk {
+    size_t old_start = 0; // 1-based; 0 when the header has no numbers
+    std::vector<std::string> old_lines;
+    std::vector<std::string> new_lines;
+};
+
+size_t parse_hunk_start(std::string_view header) {
+    size_t minus = header.find('-');
+    if (minus == std::string_view::npos) {
+        return 0;
+    }
+    return static_cast<size_t>(std::strtoul(std::string(header.substr(minus + 1, 20)).c_str(), nullptr, 10));
+}
+
+std::vector<Hunk> parse_unified_diff(std::string_view patch) {
+    std::vector<Hunk> hunks;
+    std::vector<std::string_view> lines = split_lines(patch);
+    bool in_hunk = false;
+    std::vector<std::string>* last_old = nullptr;
+    std::vector<std::string>* last_new = nullptr;
+    
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::string_view line = lines[i];
+        if (!line.empty() && line.back() == '\n') {
+            line.remove_suffix(1);
+        }
+        if (line.rfind("@@", 0) == 0) {
+            hunks.emplace_back();
+            hunks.back().old_start = parse_hunk_start(line);
+            in_hunk = true;
+            continue;
+        }
+        if (!in_hunk) {
+            continue; // diff/index/---/+++ headers
+        }
+        if (line.rfind("--- ", 0) == 0 && i + 1 < lines.size() && lines[i + 1].rfind("+++ ", 0) == 0) {
+            in_hunk = false; // the next file's header
+            continue;
+        }
+        
+        Hunk& hunk = hunks.back();
+        std::string text = line.empty() ? std::string("\n") : std::string(line.substr(1)) + "\n";
+        char marker = line.empty() ? ' ' : line[0];
+        switch (marker) {
+            case ' ':
+                hunk.old_lines.push_back(text);
+                hunk.new_lines.push_back(std::move(text));
+                last_old = &hunk.old_lines;
+                last_new = &hunk.new_lines;
+                break;
+            case '-':
+                hunk.old_lines.push_back(std::move(text));
+                last_old = &hunk.old_lines;
+                last_new = nullptr;
+                break;
+            case '+':
+                hunk.new_lines.push_back(std::move(text));
+                last_old = nullptr;
+                last_new = &hunk.new_lines;
+                break;
+            case '\\':
+                // "\ No newline at end of file" applies to the line above
+                for (auto* list : {last_old, last_new}) {
+                    if (list && !list->empty() && !list->back().empty() && list->back().back() == '\n') {
+                        list->back().pop_back();
+                    }
+                }
+                break;
+            default:
+                in_hunk = false;
+                break;
+        }
+    }
+    return hunks;
+}
+
+bool block_matches(const std::vector<std::string_view>& text, size_t at, const std::vector<std::string>& block,
+                   bool loose) {
+    for (size_t i = 0; i < block.size(); ++i) {
+        bool same = loose ? trim_right(text[at + i]) == trim_right(block[i]) : text[at + i] == block[i];
+        if (!same) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Position at or after floor where block occurs, nearest to preferred
+std::optional<size_t> locate(const std::vector<std::string_view>& text, size_t floor, size_t preferred,
+                             const std::vector<std::string>& block) {
+    if (block.size() > text.size() || floor > text.size() - block.size()) {
+        return std::nullopt;
+    }
+    size_t last = text.size() - block.size();
+    preferred = std::clamp(preferred, floor, last);
+    for (bool loose : {false, true}) {
+        for (size_t distance = 0; distance <= last - floor; ++distance) {
+            if (preferred >= floor + distance && block_matches(text, preferred - distance, block, loose)) {
+                return preferred - distance;
+            }
+            if (distance > 0 && preferred + distance <= last && block_matches(text, preferred + distance, block, loose)) {
+                return preferred + distance;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::string apply_unified_diff(std::string_view original, std::string_view patch) {
+    std::vector<Hunk> hunks = parse_unified_diff(patch);
+    if (hunks.empty()) {
+        throw PatchError("Patch has no hunks");
+    }
+    std::vector<std::string_view> lines = split_lines(original);
+    std::string result;
+    result.reserve(original.size() + patch.size());
+    size_t cursor = 0;
+    
+    for (size_t h = 0; h < hunks.size(); ++h) {
+        const Hunk& hunk = hunks[h];
+        size_t preferred = hunk.old_start > 0 ? hunk.old_start - 1 : cursor;
+        size_t at;
+        if (hunk.old_lines.empty()) {
+            // Pure insertion: "-N,0" means after line N
+            at = std::clamp<size_t>(hunk.old_start, cursor, lines.size());
+        } else {
+            std::optional<size_t> found = locate(lines, cursor, preferred, hunk.old_lines);
+            if (!found) {
+                throw PatchError("Hunk " + std::to_string(h + 1) + " does not match the file");
+            }
+            at = *found;
+        }
+        for (; cursor < at; ++cursor) {
+            result.append(lines[cursor]);
+        }
+        for (const auto& line : hunk.new_lines) {
+            result += line;
+        }
+        cursor = at + hunk.old_lines.size();
+    }
+    for (; cursor < lines.size(); ++cursor) {
+        result.append(lines[cursor]);
+    }
+    return result;
+}
+
+struct SearchReplaceBlock {
+    std::string search;
+    std::string replace;
+};
+
+std::vector<SearchReplaceBlock> parse_search_replace(std::string_view patch) {
+    enum class State { OUTSIDE, SEARCH, REPLACE };
+    std::vector<SearchReplaceBlock> blocks;
+    State state = State::OUTSIDE;
+    
+    for (std::string_view raw : split_lines(patch)) {
+        std::string_view line = trim_right(raw);
+        if (state == State::OUTSIDE) {
+            if (line.rfind("<<<<<<<", 0) == 0 && line.find("SEARCH") != std::string_view::npos) {
+                blocks.emplace_back();
+                state = State::SEARCH;
+            }
+        } else if (state == State::SEARCH) {
+            if (line == "=======") {
+                state = State::REPLACE;
+            } else {
+                blocks.back().search.append(raw);
+            }
+        } else if (line.rfind(">>>>>>>", 0) == 0 && line.find("REPLACE") != std::string_view::npos) {
+            state = State::OUTSIDE;
+        } else {
+            blocks.back().replace.append(raw);
+        }
+    }
+    if (state != State::OUTSIDE) {
+        throw PatchError("Unterminated SEARCH/REPLACE block");
+    }
+    for (auto& block : blocks) {
+        // The last line of a block is a line even when the patch itself ends without '\n'
+        for (std::string* text : {&block.search, &block.replace}) {
+            if (!text->empty() && text->back() != '\n') {
+                *text += '\n';
+            }
+        }
+    }
+    return blocks;
+}
+
+std::string apply_search_replace(std::string_view original, std::string_view patch) {
+    std::vector<SearchReplaceBlock> blocks = parse_search_replace(patch);
+    if (blocks.empty()) {
+        throw PatchError("Patch has no SEARCH/REPLACE blocks");
+    }
+    std::string text(original);
+    
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        std::string search = blocks[i].search;
+        std::string replace = blocks[i].replace;
+        std::string label = "SEARCH block " + std::to_string(i + 1);
+        
+        if (search.empty()) {
+            if (!text.empty()) {
+                throw PatchError(label + " is empty but the file is not");
+            }
+            text = replace;
+            continue;
+        }
+        
+        size_t pos = text.find(search);
+        if (pos == std::string::npos) {
+            // The file's last line may have no newline
+            std::string unterminated = search.substr(0, search.size() - 1);
+            if (!unterminated.empty() && text.size() >= unterminated.size() &&
+                text.compare(text.size() - unterminated.size(), unterminated.size(), unterminated) == 0) {
+                pos = text.size() - unterminated.size();
+                search = unterminated;
+                if (!replace.empty()) {
+                    replace.pop_back();
+                }
+            }
+        }
+        if (pos == std::string::npos) {
+            throw PatchError(label + " does not match the file");
+        }
+        if (text.find(search, pos + 1) != std::string::npos) {
+            throw PatchError(label + " matches more than one place in the file");
+        }
+        text.replace(pos, search.size(), replace);
+    }
+    return text;
+}
+
+} // anonymous namespace
+
+TextDiff diff_lines(std::string_view before, std::string_view after, const std::string& path, size_t context) {
+    TextDiff diff;
+    if (before == after) {
+        return diff;
+    }
+    std::vector<std::string_view> old_lines = split_lines(before);
+    std::vector<std::string_view> new_lines = split_lines(after);
+    std::vector<EditOp> ops = line_edits(old_lines, new_lines);
+    
+    // Line numbers at the start of every op
+    std::vector<size_t> old_at(ops.size() + 1, 0);
+    std::vector<size_t> new_at(ops.size() + 1, 0);
+    for (size_t i = 0; i < ops.size(); ++i) {
+        old_at[i + 1] = old_at[i] + (ops[i] != EditOp::INSERT ? 1 : 0);
+        new_at[i + 1] = new_at[i] + (ops[i] != EditOp::DELETE ? 1 : 0);
+    }
+    
+    diff.unified = "--- a/" + path + "\n+++ b/" + path + "\n";
+    size_t pos = 0;
+    while (pos < ops.size()) {
+        size_t change = pos;
+        while (change < ops.size() && ops[change] == EditOp::EQUAL) {
+            ++change;
+        }
+        if (change == ops.size()) {
+            break;
+        }
+        
+        // Changes closer than two contexts apart share a hunk
+        size_t last_change = change;
+        for (size_t k = change + 1; k < ops.size() && k - last_change <= 2 * context + 1; ++k) {
+            if (ops[k] != EditOp::EQUAL) {
+                last_change = k;
+            }
+        }
+        size_t start = change >= pos + context ? change - context : pos;
+        size_t end = std::min(ops.size(), last_change + context + 1);
+        
+        diff.unified += "@@ -" + hunk_range(old_at[start], old_at[end] - old_at[start]) + " +" +
+                        hunk_range(new_at[start], new_at[end] - new_at[start]) + " @@\n";
+        for (size_t i = start; i < end; ++i) {
+            switch (ops[i]) {
+                case EditOp::EQUAL:
+                    append_line(diff.unified, ' ', old_lines[old_at[i]]);
+                    break;
+                case EditOp::DELETE:
+                    append_line(diff.unified, '-', old_lines[old_at[i]]);
+                    ++diff.lines_removed;
+                    break;
+                case EditOp::INSERT:
+                    append_line(diff.unified, '+', new_lines[new_at[i]]);
+                    ++diff.lines_added;
+                    break;
+            }
+        }
+        pos = end;
+    }
+    return diff;
+}
+
+bool is_search_replace_patch(std::string_view patch) {
+    return patch.find("<<<<<<< SEARCH") != std::string_view::npos;
+}
+
+std::string apply_patch(std::string_view original, std::string_view patch) {
+    return is_search_replace_patch(patch) ? apply_search_replace(original, patch)
+                                          : apply_unified_diff(original, patch);
+}
+
+} // namespace mag
@@ -0,0 +1,123 @@
+#include "thread_pool.h"
+#include "logger.h"
+#include "tracing.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mag {
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::submit(const std::string& key, Task task) {
+    // Work handed to the pool stays in the submitting thread's trace
+    TraceContext trace = TraceContext::current();
+    if (Tracer::enabled() && trace.valid()) {
+        task = [trace, inner = std::move(task)](size_t worker_index) {
+            TraceScope scope(trace);
+            inner(worker_index);
+        };
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("ThreadPool is shutting down");
+        }
+        auto weight = weights_.find(key);
+        KeyQueue& queue = queues_[key];
+        double start = std::max(virtual_time_, queue.last_finish);
+        queue.last_finish = start + 1.0 / (weight == weights_.end() ? 1.0 : weight->second);
+        queue.tasks.push_back({std::move(task), start, next_order_++});
+        ++queued_;
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::set_weight(const std::string& key, double weight) {
+    if (!(weight > 0)) {
+        throw std::invalid_argument("ThreadPool weight must be positive");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    weights_[key] = weight;
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+size_t ThreadPool::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+size_t ThreadPool::queued(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(key);
+    return it == queues_.end() ? 0 : it->second.tasks.size();
+}
+
+ThreadPool::Task ThreadPool::take_next() {
+    // One pass over the keys: pick the earliest start tag, and forget keys
+    // whose last tag the virtual clock has passed (they would start afresh anyway)
+    auto next = queues_.end();
+    for (auto it = queues_.begin(); it != queues_.end();) {
+        if (it->second.tasks.empty()) {
+            it = it->second.last_finish <= virtual_time_ ? queues_.erase(it) : std::next(it);
+            continue;
+        }
+        const Queued& head = it->second.tasks.front();
+        if (next == queues_.end() || head.start_tag < next->second.tasks.front().start_tag ||
+            (head.start_tag == next->second.tasks.front().start_tag &&
+             head.order < next->second.tasks.front().order)) {
+            next = it;
+        }
+        ++it;
+    }
+    
+    Queued queued = std::move(next->second.tasks.front());
+    next->second.tasks.pop_front();
+    --queued_;
+    virtual_time_ = queued.start_tag;
+    return std::move(queued.task);
+}
+
+void ThreadPool::worker_loop(size_t worker_index) {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+            if (queued_ == 0) {
+                return; // stopping and drained
+            }
+            task = take_next();
+        }
+        try {
+            task(worker_index);
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("thread_pool", "Task failed: " << e.what());
+        }
+    }
+}
+
+} // namespace mag
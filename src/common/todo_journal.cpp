@@ -0,0 +1,189 @@
+#include "todo_journal.h"
+#include "config.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+void write_all(int fd, const std::string& data, const std::string& path) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Failed to write todo journal " + path + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+nlohmann::json todo_record(const nlohmann::json& item) {
+    nlohmann::json record = item;
+    record["type"] = "todo";
+    return record;
+}
+
+} // anonymous namespace
+
+TodoJournal::TodoJournal(std::string path)
+    : path_(std::move(path)), last_sync_(std::chrono::steady_clock::now()) {
+    open_for_append();
+}
+
+TodoJournal::~TodoJournal() {
+    try {
+        sync();
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("todo", "Final sync of " << path_ << " failed: " << e.what());
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void TodoJournal::open_for_append() {
+    std::string directory = std::filesystem::path(path_).parent_path().string();
+    if (!directory.empty()) {
+        std::filesystem::create_directories(directory);
+    }
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open todo journal " + path_ + ": " + std::strerror(errno));
+    }
+}
+
+void TodoJournal::append(const nlohmann::json& record) {
+    write_all(fd_, record.dump() + "\n", path_);
+    ++unsynced_;
+
+    auto now = std::chrono::steady_clock::now();
+    if (unsynced_ >= JournalConfig::SYNC_EVERY_RECORDS ||
+        now - last_sync_ >= std::chrono::milliseconds(JournalConfig::SYNC_INTERVAL_MS)) {
+        sync();
+    }
+}
+
+void TodoJournal::append_todo(const TodoItem& item, bool replaces) {
+    append(todo_record(item.to_json()));
+    if (replaces) {
+        ++dead_records_;
+    }
+}
+
+void TodoJournal::append_delete(int id) {
+    append({{"type", "delete"}, {"id", id}});
+    dead_records_ += 2;
+}
+
+void TodoJournal::append_clear(size_t dropped) {
+    append({{"type", "clear"}});
+    dead_records_ += dropped + 1;
+}
+
+void TodoJournal::sync() {
+    if (unsynced_ == 0) {
+        return;
+    }
+    if (::fdatasync(fd_) != 0) {
+        throw std::runtime_error("Failed to sync todo journal " + path_ + ": " + std::strerror(errno));
+    }
+    unsynced_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+bool TodoJournal::needs_compaction(size_t live_todos) const {
+    return dead_records_ >= JournalConfig::COMPACT_AFTER_DROPPED && dead_records_ > live_todos;
+}
+
+void TodoJournal::rewrite(const nlohmann::json& state) {
+    // The id counter goes first so deleted ids are not handed out again
+    std::string contents = nlohmann::json{{"type", "next_id"}, {"next_id", state.value("next_id", 1)}}.dump() + "\n";
+    for (const auto& item : state.value("todos", nlohmann::json::array())) {
+        contents += todo_record(item).dump() + "\n";
+    }
+
+    std::string temp_path = path_ + ".tmp";
+    int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp_fd < 0) {
+        throw std::runtime_error("Failed to create " + temp_path + ": " + std::strerror(errno));
+    }
+    try {
+        write_all(temp_fd, contents, temp_path);
+        if (::fdatasync(temp_fd) != 0) {
+            throw std::runtime_error("Failed to sync " + temp_path + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(temp_fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+    ::close(temp_fd);
+
+    if (::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        throw std::runtime_error("Failed to replace todo journal " + path_ + ": " + std::strerror(errno));
+    }
+
+    // Make the rename itself durable
+    std::string directory = std::filesystem::path(path_).parent_path().string();
+    int dir_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    open_for_append();
+    unsynced_ = 0;
+    dead_records_ = 0;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+nlohmann::json TodoJournal::read(const std::string& path) {
+    std::map<int, nlohmann::json> live; // by id, which is also list order
+    int next_id = 1;
+
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        nlohmann::json record = nlohmann::json::parse(line, nullptr, false);
+        if (record.is_discarded() || !record.is_object()) {
+            continue; // torn tail or corrupt line
+        }
+        std::string type = record.value("type", "");
+
+        if (type == "todo" && record.contains("id")) {
+            int id = record["id"];
+            record.erase("type");
+            live[id] = std::move(record);
+            next_id = std::max(next_id, id + 1);
+        } else if (type == "delete") {
+            live.erase(record.value("id", 0));
+        } else if (type == "clear") {
+            live.clear();
+        } else if (type == "next_id") {
+            next_id = std::max(next_id, record.value("next_id", 1));
+        }
+    }
+
+    nlohmann::json state = {{"next_id", next_id}, {"todos", nlohmann::json::array()}};
+    for (auto& [id, item] : live) {
+        state["todos"].push_back(std::move(item));
+    }
+    return state;
+}
+
+} // namespace mag
@@ -1,4 +1,6 @@
 #include "todo_manager.h"
+#include "todo_journal.h"
+#include "logger.h"
 #include <algorithm>
 #include <stdexcept>
 
@@ -14,6 +16,7 @@ nlohmann::json TodoItem::to_json() const {
         {"title", title},
         {"description", description},
         {"status", status_to_string(status)},
+        {"depends_on", depends_on},
         {"created_at", static_cast<long>(now_time_t)},
         {"updated_at", static_cast<long>(updated_time_t)}
     };
@@ -24,6 +27,7 @@ void TodoItem::from_json(const nlohmann::json& j) {
     title = j["title"];
     description = j["description"];
     status = string_to_status(j["status"]);
+    depends_on = j.value("depends_on", std::vector<int>());
     
     auto created_time_t = static_cast<std::time_t>(j["created_at"]);
     auto updated_time_t = static_cast<std::time_t>(j["updated_at"]);
@@ -34,7 +38,19 @@ void TodoItem::from_json(const nlohmann::json& j) {
 // TodoManager implementation
 TodoManager::TodoManager() : next_id_(1) {}
 
-int TodoManager::add_todo(const std::string& title, const std::string& description) {
+TodoManager::~TodoManager() = default;
+TodoManager::TodoManager(TodoManager&&) noexcept = default;
+TodoManager& TodoManager::operator=(TodoManager&&) noexcept = default;
+
+void TodoManager::insert(TodoItem item) {
+    int id = item.id;
+    ids_.insert(id);
+    bucket(item.status).insert(id);
+    todos_[id] = std::move(item);
+}
+
+int TodoManager::add_todo(const std::string& title, const std::string& description,
+                          const std::vector<int>& depends_on) {
     if (title.empty()) {
         throw std::invalid_argument("Todo title cannot be empty");
     }
@@ -44,20 +60,22 @@ int TodoManager::add_todo(const std::string& title, const std::string& descripti
     item.title = title;
     item.description = description;
     item.status = TodoStatus::PENDING;
+    item.depends_on = depends_on;
     item.created_at = std::chrono::system_clock::now();
     item.updated_at = item.created_at;
     
-    todos_.push_back(item);
+    journal_write([&item](TodoJournal& journal) { journal.append_todo(item, false); });
+    insert(item);
     return item.id;
 }
 
 std::vector<TodoItem> TodoManager::list_todos(bool show_completed) const {
     if (show_completed) {
-        return todos_;
+        return all().to_vector();
     }
     
     std::vector<TodoItem> active_todos;
-    std::copy_if(todos_.begin(), todos_.end(), std::back_inserter(active_todos),
+    std::copy_if(all().begin(), all().end(), std::back_inserter(active_todos),
                  [](const TodoItem& item) {
                      return item.status != TodoStatus::COMPLETED;
                  });
@@ -67,69 +85,91 @@ std::vector<TodoItem> TodoManager::list_todos(bool show_completed) const {
 bool TodoManager::update_todo(int id, const std::string* title, 
                              const std::string* description, 
                              const TodoStatus* status) {
-    auto it = find_todo(id);
-    if (it == todos_.end()) {
+    TodoItem* item = find_todo(id);
+    if (!item) {
         return false;
     }
     
     bool updated = false;
-    if (title && !title->empty() && it->title != *title) {
-        it->title = *title;
+    if (title && !title->empty() && item->title != *title) {
+        item->title = *title;
         updated = true;
     }
     
-    if (description && it->description != *description) {
-        it->description = *description;
+    if (description && item->description != *description) {
+        item->description = *description;
         updated = true;
     }
     
-    if (status && it->status != *status) {
-        it->status = *status;
+    if (status && item->status != *status) {
+        bucket(item->status).erase(id);
+        bucket(*status).insert(id);
+        item->status = *status;
         updated = true;
     }
     
     if (updated) {
-        update_timestamp(*it);
+        update_timestamp(*item);
+        journal_write([item](TodoJournal& journal) { journal.append_todo(*item, true); });
     }
     
     return updated;
 }
 
+bool TodoManager::set_dependencies(int id, const std::vector<int>& depends_on) {
+    TodoItem* item = find_todo(id);
+    if (!item) {
+        return false;
+    }
+    
+    item->depends_on = depends_on;
+    update_timestamp(*item);
+    journal_write([item](TodoJournal& journal) { journal.append_todo(*item, true); });
+    return true;
+}
+
 bool TodoManager::delete_todo(int id) {
-    auto it = find_todo(id);
-    if (it == todos_.end()) {
+    TodoItem* item = find_todo(id);
+    if (!item) {
         return false;
     }
     
-    todos_.erase(it);
+    bucket(item->status).erase(id);
+    ids_.erase(id);
+    todos_.erase(id);
+    journal_write([id](TodoJournal& journal) { journal.append_delete(id); });
     return true;
 }
 
 void TodoManager::clear_todos() {
+    size_t dropped = todos_.size();
     todos_.clear();
+    ids_.clear();
+    for (auto& ids : by_status_) {
+        ids.clear();
+    }
+    journal_write([dropped](TodoJournal& journal) { journal.append_clear(dropped); });
+}
+
+const TodoItem* TodoManager::get_todo(int id) const {
+    auto it = todos_.find(id);
+    return (it != todos_.end()) ? &it->second : nullptr;
+}
+
+TodoView TodoManager::all() const {
+    return TodoView(ids_, todos_);
 }
 
-TodoItem* TodoManager::get_todo(int id) {
-    auto it = find_todo(id);
-    return (it != todos_.end()) ? &(*it) : nullptr;
+TodoView TodoManager::with_status(TodoStatus status) const {
+    return TodoView(bucket(status), todos_);
 }
 
 std::vector<TodoItem> TodoManager::get_pending_todos() const {
-    std::vector<TodoItem> pending;
-    std::copy_if(todos_.begin(), todos_.end(), std::back_inserter(pending),
-                 [](const TodoItem& item) {
-                     return item.status == TodoStatus::PENDING;
-                 });
-    return pending;
+    return with_status(TodoStatus::PENDING).to_vector();
 }
 
 std::vector<TodoItem> TodoManager::get_completed_todos() const {
-    std::vector<TodoItem> completed;
-    std::copy_if(todos_.begin(), todos_.end(), std::back_inserter(completed),
-                 [](const TodoItem& item) {
-                     return item.status == TodoStatus::COMPLETED;
-                 });
-    return completed;
+    return with_status(TodoStatus::COMPLETED).to_vector();
 }
 
 bool TodoManager::is_empty() const {
@@ -141,10 +181,7 @@ size_t TodoManager::count() const {
 }
 
 size_t TodoManager::count_pending() const {
-    return std::count_if(todos_.begin(), todos_.end(),
-                        [](const TodoItem& item) {
-                            return item.status == TodoStatus::PENDING;
-                        });
+    return bucket(TodoStatus::PENDING).size();
 }
 
 bool TodoManager::mark_in_progress(int id) {
@@ -162,33 +199,19 @@ bool TodoManager::mark_pending(int id) {
     return update_todo(id, nullptr, nullptr, &status);
 }
 
-TodoItem* TodoManager::get_next_pending() {
-    auto it = std::find_if(todos_.begin(), todos_.end(),
-                          [](const TodoItem& item) {
-                              return item.status == TodoStatus::PENDING;
-                          });
-    
-    if (it != todos_.end()) {
-        return &(*it);
-    }
-    return nullptr;
+const TodoItem* TodoManager::get_next_pending() const {
+    const std::set<int>& pending = bucket(TodoStatus::PENDING);
+    return pending.empty() ? nullptr : get_todo(*pending.begin());
 }
 
 std::vector<TodoItem> TodoManager::get_execution_queue() const {
-    auto pending = get_pending_todos();
-    // Sort by creation time (FIFO execution)
-    std::sort(pending.begin(), pending.end(),
-              [](const TodoItem& a, const TodoItem& b) {
-                  return a.created_at < b.created_at;
-              });
-    return pending;
+    // Ids are handed out in creation order, so the pending set is already FIFO
+    return get_pending_todos();
 }
 
 std::vector<TodoItem> TodoManager::get_todos_until(int stop_id) const {
     std::vector<TodoItem> result;
-    auto pending = get_execution_queue(); // Already sorted by creation time
-    
-    for (const auto& todo : pending) {
+    for (const auto& todo : with_status(TodoStatus::PENDING)) {
         if (todo.id == stop_id) {
             break; // Stop before including stop_id
         }
@@ -200,20 +223,15 @@ std::vector<TodoItem> TodoManager::get_todos_until(int stop_id) const {
 
 std::vector<TodoItem> TodoManager::get_todos_range(int start_id, int end_id) const {
     std::vector<TodoItem> result;
-    auto pending = get_execution_queue(); // Already sorted by creation time
+    const std::set<int>& pending = bucket(TodoStatus::PENDING);
+    if (!pending.count(start_id)) {
+        return result;
+    }
     
-    bool found_start = false;
-    for (const auto& todo : pending) {
-        if (todo.id == start_id) {
-            found_start = true;
-        }
-        
-        if (found_start) {
-            result.push_back(todo);
-            
-            if (todo.id == end_id) {
-                break; // Include end_id and stop
-            }
+    for (auto it = pending.find(start_id); it != pending.end(); ++it) {
+        result.push_back(*get_todo(*it));
+        if (*it == end_id) {
+            break; // Include end_id and stop
         }
     }
     
@@ -225,7 +243,7 @@ nlohmann::json TodoManager::to_json() const {
     j["next_id"] = next_id_;
     j["todos"] = nlohmann::json::array();
     
-    for (const auto& todo : todos_) {
+    for (const auto& todo : all()) {
         j["todos"].push_back(todo.to_json());
     }
     
@@ -235,30 +253,55 @@ nlohmann::json TodoManager::to_json() const {
 void TodoManager::from_json(const nlohmann::json& j) {
     next_id_ = j["next_id"];
     todos_.clear();
+    ids_.clear();
+    for (auto& ids : by_status_) {
+        ids.clear();
+    }
     
     for (const auto& todo_json : j["todos"]) {
         TodoItem item;
         item.from_json(todo_json);
-        todos_.push_back(item);
+        next_id_ = std::max(next_id_, item.id + 1);
+        insert(std::move(item));
+    }
+    
+    journal_write([this](TodoJournal& journal) { journal.rewrite(to_json()); });
+}
+
+void TodoManager::attach_journal(const std::string& path) {
+    nlohmann::json state = TodoJournal::read(path);
+    journal_ = std::make_unique<TodoJournal>(path);
+    
+    // Nothing is running yet, so a todo still in progress was cut off by a crash
+    for (auto& todo_json : state["todos"]) {
+        if (todo_json.value("status", "") == status_to_string(TodoStatus::IN_PROGRESS)) {
+            todo_json["status"] = status_to_string(TodoStatus::PENDING);
+        }
     }
+    from_json(state); // also compacts the journal to this state
 }
 
 void TodoManager::update_timestamp(TodoItem& item) {
     item.updated_at = std::chrono::system_clock::now();
 }
 
-std::vector<TodoItem>::iterator TodoManager::find_todo(int id) {
-    return std::find_if(todos_.begin(), todos_.end(),
-                       [id](const TodoItem& item) {
-                           return item.id == id;
-                       });
+TodoItem* TodoManager::find_todo(int id) {
+    auto it = todos_.find(id);
+    return (it != todos_.end()) ? &it->second : nullptr;
 }
 
-std::vector<TodoItem>::const_iterator TodoManager::find_todo(int id) const {
-    return std::find_if(todos_.begin(), todos_.end(),
-                       [id](const TodoItem& item) {
-                           return item.id == id;
-                       });
+void TodoManager::journal_write(const std::function<void(TodoJournal&)>& write) {
+    if (!journal_) {
+        return;
+    }
+    try {
+        write(*journal_);
+        if (journal_->needs_compaction(todos_.size())) {
+            journal_->rewrite(to_json());
+        }
+    } catch (const std::exception& e) {
+        MAG_LOG_ERROR("todo", "Todo journal write failed: " << e.what());
+    }
 }
 
 // Utility functions
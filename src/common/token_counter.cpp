@@ -0,0 +1,100 @@
+#include "token_counter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace mag {
+
+namespace {
+
+constexpr size_t LETTERS_PER_TOKEN = 6;
+constexpr size_t DIGITS_PER_TOKEN = 3;
+
+bool is_letter(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+} // anonymous namespace
+
+size_t HeuristicTokenCounter::count(std::string_view text) const {
+    size_t tokens = 0;
+    size_t i = 0;
+    const size_t n = text.size();
+
+    while (i < n) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t start = i;
+
+        if (is_letter(c)) {
+            while (i < n && is_letter(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+            tokens += (i - start + LETTERS_PER_TOKEN - 1) / LETTERS_PER_TOKEN;
+        } else if (is_digit(c)) {
+            while (i < n && is_digit(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+            tokens += (i - start + DIGITS_PER_TOKEN - 1) / DIGITS_PER_TOKEN;
+        } else if (is_space(c)) {
+            bool has_newline = false;
+            while (i < n && is_space(static_cast<unsigned char>(text[i]))) {
+                has_newline |= text[i] == '\n';
+                ++i;
+            }
+            // A single space merges into the following word; longer runs and
+            // line breaks become their own token
+            if (has_newline || i - start > 1) {
+                ++tokens;
+            }
+        } else if (c < 0x80) {
+            ++tokens;
+            ++i;
+        } else {
+            // One token per UTF-8 code point: skip the continuation bytes
+            ++i;
+            while (i < n && (static_cast<unsigned char>(text[i]) & 0xC0) == 0x80) {
+                ++i;
+            }
+            ++tokens;
+        }
+    }
+    return tokens;
+}
+
+std::shared_ptr<const HeuristicTokenCounter> HeuristicTokenCounter::shared() {
+    static const auto counter = std::make_shared<const HeuristicTokenCounter>();
+    return counter;
+}
+
+CalibratedTokenCounter::CalibratedTokenCounter(std::shared_ptr<const TokenCounter> base)
+    : base_(std::move(base)) {}
+
+size_t CalibratedTokenCounter::count(std::string_view text) const {
+    size_t estimate = base_->count(text);
+    return static_cast<size_t>(std::ceil(static_cast<double>(estimate) * ratio()));
+}
+
+void CalibratedTokenCounter::calibrate(size_t estimated_tokens, size_t actual_tokens) {
+    if (estimated_tokens == 0 || actual_tokens == 0) {
+        return;
+    }
+    double observed = std::clamp(static_cast<double>(actual_tokens) / static_cast<double>(estimated_tokens),
+                                 MIN_RATIO, MAX_RATIO);
+
+    // The first report replaces the neutral prior; later ones are smoothed
+    bool first = samples_.fetch_add(1, std::memory_order_relaxed) == 0;
+    double current = ratio_.load(std::memory_order_relaxed);
+    double updated;
+    do {
+        updated = first ? observed : current + SMOOTHING * (observed - current);
+    } while (!ratio_.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+}
+
+} // namespace mag
@@ -0,0 +1,341 @@
+#include "tool_call_parser.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace mag {
+
+namespace {
+
+struct CallName {
+    std::string_view name;
+    ToolCall::Kind kind;
+};
+
+constexpr CallName CALL_NAMES[] = {
+    {"add_todo", ToolCall::Kind::ADD_TODO},
+    {"list_todos", ToolCall::Kind::LIST_TODOS},
+    {"mark_complete", ToolCall::Kind::MARK_COMPLETE},
+    {"delete_todo", ToolCall::Kind::DELETE_TODO},
+    {"execute_next", ToolCall::Kind::EXECUTE_NEXT},
+    {"execute_all", ToolCall::Kind::EXECUTE_ALL},
+    {"execute_todo", ToolCall::Kind::EXECUTE_TODO},
+    {"request_user_approval", ToolCall::Kind::REQUEST_APPROVAL},
+};
+
+constexpr std::string_view SEPARATOR = "<TODO_SEPARATOR>";
+
+// Characters a call or block can start with
+bool may_start_call(char c) {
+    return c == 'a' || c == 'l' || c == 'm' || c == 'd' || c == 'e' || c == 'r' || c == '<';
+}
+
+bool is_space(char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+bool is_quote(char c) {
+    return c == '"' || c == '\'';
+}
+
+void trim(std::string& text) {
+    text.erase(0, text.find_first_not_of(" \t\r\n"));
+    text.erase(text.find_last_not_of(" \t\r\n") + 1);
+}
+
+} // anonymous namespace
+
+ToolCallParser::ToolCallParser(TextCallback on_text, CallCallback on_call)
+    : on_text_(std::move(on_text)), on_call_(std::move(on_call)) {
+}
+
+void ToolCallParser::feed(std::string_view chunk) {
+    buffer_.append(chunk);
+    scan();
+}
+
+void ToolCallParser::finish() {
+    finishing_ = true;
+    scan();
+    finishing_ = false;
+    buffer_.clear();
+    scanned_ = 0;
+}
+
+std::vector<ToolCall> ToolCallParser::parse(std::string_view reply) {
+    std::vector<ToolCall> calls;
+    ToolCallParser parser([](std::string_view) {}, [&calls](const ToolCall& call) { calls.push_back(call); });
+    parser.feed(reply);
+    parser.finish();
+    return calls;
+}
+
+void ToolCallParser::scan() {
+    size_t text_start = scanned_;
+    size_t at = scanned_;
+    while (at < buffer_.size()) {
+        if (!may_start_call(buffer_[at])) {
+            ++at;
+            continue;
+        }
+        size_t length = 0;
+        ToolCall call;
+        Scan found = scan_at(at, length, call);
+        if (found == Scan::NO_MATCH) {
+            ++at;
+            continue;
+        }
+        if (found == Scan::NEED_MORE) {
+            break; // hold from here until more of the reply arrives
+        }
+        if (found == Scan::TEXT) {
+            at += length;
+            continue;
+        }
+        if (at > text_start) {
+            on_text_(std::string_view(buffer_).substr(text_start, at - text_start));
+        }
+        call.text = buffer_.substr(at, length);
+        at += length;
+        text_start = at;
+        on_call_(call);
+    }
+    
+    if (at > text_start) {
+        on_text_(std::string_view(buffer_).substr(text_start, at - text_start));
+    }
+    scanned_ = at;
+    
+    // Drop what has been passed on once it outweighs what is held back
+    if (scanned_ > 0 && scanned_ >= buffer_.size() - scanned_) {
+        buffer_.erase(0, scanned_);
+        scanned_ = 0;
+    }
+}
+
+ToolCallParser::Scan ToolCallParser::scan_at(size_t at, size_t& length, ToolCall& call) const {
+    std::string_view rest = std::string_view(buffer_).substr(at);
+    if (rest[0] == '<') {
+        return scan_block(at, length, call);
+    }
+    
+    for (const auto& candidate : CALL_NAMES) {
+        if (rest.size() < candidate.name.size()) {
+            // The reply may stop in the middle of the name
+            if (!finishing_ && candidate.name.compare(0, rest.size(), rest) == 0) {
+                return Scan::NEED_MORE;
+            }
+            continue;
+        }
+        if (rest.compare(0, candidate.name.size(), candidate.name) != 0) {
+            continue;
+        }
+        size_t open = at + candidate.name.size();
+        while (open < buffer_.size() && is_space(buffer_[open])) {
+            ++open;
+        }
+        if (open == buffer_.size()) {
+            return finishing_ ? Scan::NO_MATCH : Scan::NEED_MORE;
+        }
+        if (buffer_[open] != '(') {
+            return Scan::NO_MATCH;
+        }
+        
+        size_t end = 0;
+        call.kind = candidate.kind;
+        Scan found = scan_arguments(candidate.kind, open + 1, end, call);
+        if (found == Scan::CALL) {
+            length = end - at;
+        }
+        return found;
+    }
+    return Scan::NO_MATCH;
+}
+
+ToolCallParser::Scan ToolCallParser::scan_arguments(ToolCall::Kind kind, size_t open, size_t& end,
+                                                    ToolCall& call) const {
+    const size_t size = buffer_.size();
+    const Scan incomplete = finishing_ ? Scan::NO_MATCH : Scan::NEED_MORE;
+    auto skip_space = [&](size_t i) {
+        while (i < size && is_space(buffer_[i])) {
+            ++i;
+        }
+        return i;
+    };
+    
+    // Where ")" closes the call after optional whitespace, npos if something else follows
+    auto close_at = [&](size_t i, bool& reached_end) {
+        i = skip_space(i);
+        reached_end = i == size;
+        return (i < size && buffer_[i] == ')') ? i + 1 : std::string::npos;
+    };
+    
+    size_t i = skip_space(open);
+    if (i == size) {
+        return incomplete;
+    }
+    bool reached_end = false;
+    
+    switch (kind) {
+        case ToolCall::Kind::LIST_TODOS:
+        case ToolCall::Kind::EXECUTE_NEXT:
+        case ToolCall::Kind::EXECUTE_ALL: {
+            end = close_at(i, reached_end);
+            if (end != std::string::npos) {
+                return Scan::CALL;
+            }
+            return reached_end ? incomplete : Scan::NO_MATCH;
+        }
+        
+        case ToolCall::Kind::MARK_COMPLETE:
+        case ToolCall::Kind::DELETE_TODO:
+        case ToolCall::Kind::EXECUTE_TODO: {
+            size_t digits = i;
+            while (i < size && std::isdigit(static_cast<unsigned char>(buffer_[i]))) {
+                ++i;
+            }
+            if (i == digits) {
+                return Scan::NO_MATCH;
+            }
+            end = close_at(i, reached_end);
+            if (end == std::string::npos) {
+                return reached_end ? incomplete : Scan::NO_MATCH;
+            }
+            if (i - digits > 9) {
+                return Scan::NO_MATCH; // no todo has an id that large
+            }
+            call.id = std::stoi(buffer_.substr(digits, i - digits));
+            return Scan::CALL;
+        }
+        
+        case ToolCall::Kind::REQUEST_APPROVAL: {
+            if (!is_quote(buffer_[i])) {
+                return Scan::NO_MATCH;
+            }
+            size_t reason_start = i + 1;
+            for (size_t q = reason_start; q < size && buffer_[q] != '\n'; ++q) {
+                if (!is_quote(buffer_[q])) {
+                    continue;
+                }
+                end = close_at(q + 1, reached_end);
+                if (end != std::string::npos) {
+                    call.reason = buffer_.substr(reason_start, q - reason_start);
+                    return Scan::CALL;
+                }
+                if (reached_end) {
+                    return incomplete;
+                }
+            }
+            return buffer_.find('\n', reason_start) == std::string::npos ? incomplete : Scan::NO_MATCH;
+        }
+        
+        case ToolCall::Kind::ADD_TODO: {
+            if (!is_quote(buffer_[i])) {
+                return Scan::NO_MATCH;
+            }
+            size_t title_start = i + 1;
+            bool need_more = false;
+            
+            // Each quote in the title's line may end it; take the first the rest of the call follows
+            for (size_t t = title_start; t < size && buffer_[t] != '\n'; ++t) {
+                if (!is_quote(buffer_[t])) {
+                    continue;
+                }
+                size_t comma = skip_space(t + 1);
+                if (comma == size) {
+                    need_more = true;
+                    break;
+                }
+                if (buffer_[comma] != ',') {
+                    continue;
+                }
+                size_t quote = skip_space(comma + 1);
+                if (quote == size) {
+                    need_more = true;
+                    break;
+                }
+                if (!is_quote(buffer_[quote])) {
+                    continue;
+                }
+                size_t description_start = quote + 1;
+                for (size_t d = description_start; d < size && buffer_[d] != '\n'; ++d) {
+                    if (!is_quote(buffer_[d])) {
+                        continue;
+                    }
+                    end = close_at(d + 1, reached_end);
+                    if (end != std::string::npos) {
+                        call.title = buffer_.substr(title_start, t - title_start);
+                        call.description = buffer_.substr(description_start, d - description_start);
+                        return Scan::CALL;
+                    }
+                    if (reached_end) {
+                        need_more = true;
+                        break;
+                    }
+                }
+                if (need_more || buffer_.find('\n', description_start) == std::string::npos) {
+                    need_more = true;
+                    break;
+                }
+            }
+            if (need_more || buffer_.find('\n', title_start) == std::string::npos) {
+                return incomplete;
+            }
+            return Scan::NO_MATCH;
+        }
+    }
+    return Scan::NO_MATCH;
+}
+
+ToolCallParser::Scan ToolCallParser::scan_block(size_t at, size_t& length, ToolCall& call) const {
+    const Scan incomplete = finishing_ ? Scan::NO_MATCH : Scan::NEED_MORE;
+    std::string_view rest = std::string_view(buffer_).substr(at);
+    if (rest.size() < SEPARATOR.size()) {
+        return SEPARATOR.compare(0, rest.size(), rest) == 0 ? incomplete : Scan::NO_MATCH;
+    }
+    if (rest.compare(0, SEPARATOR.size(), SEPARATOR) != 0) {
+        return Scan::NO_MATCH;
+    }
+    
+    // The block runs from the line after the opening separator to a separator on a line of its own
+    size_t newline = buffer_.find('\n', at + SEPARATOR.size());
+    if (newline == std::string::npos) {
+        return incomplete;
+    }
+    size_t closing = buffer_.find(std::string("\n") + std::string(SEPARATOR), newline);
+    if (closing == std::string::npos) {
+        return incomplete;
+    }
+    length = closing + 1 + SEPARATOR.size() - at;
+    std::string content = buffer_.substr(newline + 1, closing - newline - 1);
+    
+    // An optional "Depends on: 3, 4" line declares todos that must finish first
+    size_t depends_pos = content.find("Depends on:");
+    if (depends_pos != std::string::npos && depends_pos < content.find("Description:")) {
+        size_t depends_end = content.find('\n', depends_pos);
+        std::string ids = content.substr(depends_pos + 11, depends_end - depends_pos - 11);
+        std::replace_if(ids.begin(), ids.end(), [](char c) { return !std::isdigit(static_cast<unsigned char>(c)); }, ' ');
+        std::istringstream parsed(ids);
+        for (int id; parsed >> id;) {
+            call.depends_on.push_back(id);
+        }
+        content.erase(depends_pos, depends_end == std::string::npos ? std::string::npos
+                                                                    : depends_end + 1 - depends_pos);
+    }
+    
+    size_t title_pos = content.find("Title:");
+    size_t description_pos = content.find("Description:");
+    if (title_pos == std::string::npos || description_pos == std::string::npos) {
+        return Scan::TEXT; // a malformed block is left as written
+    }
+    size_t title_start = title_pos + 6;
+    size_t title_end = content.find('\n', title_start);
+    call.kind = ToolCall::Kind::ADD_TODO;
+    call.title = content.substr(title_start, title_end == std::string::npos ? std::string::npos : title_end - title_start);
+    call.description = content.substr(description_pos + 12);
+    trim(call.title);
+    trim(call.description);
+    return Scan::CALL;
+}
+
+} // namespace mag
@@ -0,0 +1,442 @@
+#include "tracing.h"
+#include "config.h"
+#include "http_client.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+namespace {
+
+thread_local TraceContext current_context;
+
+std::string hex64(uint64_t value) {
+    char out[17];
+    std::snprintf(out, sizeof(out), "%016llx", static_cast<unsigned long long>(value));
+    return out;
+}
+
+std::optional<uint64_t> parse_hex64(std::string_view text) {
+    if (text.size() != 16) {
+        return std::nullopt;
+    }
+    uint64_t value = 0;
+    for (char c : text) {
+        int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (digit < 0) {
+            return std::nullopt;
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+    }
+    return value;
+}
+
+void put_u64(char* out, uint64_t value) {
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t get_u64(const char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | static_cast<unsigned char>(in[i]);
+    }
+    return value;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+// ---- TraceContext ----
+
+std::string TraceContext::trace_id_hex() const {
+    return hex64(trace_high) + hex64(trace_low);
+}
+
+std::string TraceContext::span_id_hex() const {
+    return hex64(span_id);
+}
+
+std::string TraceContext::traceparent() const {
+    return "00-" + trace_id_hex() + "-" + span_id_hex() + "-01";
+}
+
+std::optional<TraceContext> TraceContext::parse_traceparent(std::string_view value) {
+    // version(2) - trace id(32) - span id(16) - flags(2)
+    if (value.size() != 55 || value.substr(0, 3) != "00-" || value[35] != '-' || value[52] != '-') {
+        return std::nullopt;
+    }
+    auto high = parse_hex64(value.substr(3, 16));
+    auto low = parse_hex64(value.substr(19, 16));
+    auto span = parse_hex64(value.substr(36, 16));
+    if (!high || !low || !span) {
+        return std::nullopt;
+    }
+    TraceContext context{*high, *low, *span};
+    if (!context.valid()) {
+        return std::nullopt;
+    }
+    return context;
+}
+
+void TraceContext::write_header(char (&out)[HEADER_SIZE]) const {
+    out[0] = '\0';
+    out[1] = 'T';
+    put_u64(out + 2, trace_high);
+    put_u64(out + 10, trace_low);
+    put_u64(out + 18, span_id);
+}
+
+std::optional<TraceContext> TraceContext::strip_header(std::string_view& body) {
+    // No request encoding starts with a NUL byte
+    if (body.size() < HEADER_SIZE || body[0] != '\0' || body[1] != 'T') {
+        return std::nullopt;
+    }
+    TraceContext context{get_u64(body.data() + 2), get_u64(body.data() + 10), get_u64(body.data() + 18)};
+    body.remove_prefix(HEADER_SIZE);
+    if (!context.valid()) {
+        return std::nullopt;
+    }
+    return context;
+}
+
+TraceContext TraceContext::current() {
+    return current_context;
+}
+
+// ---- ChromeTraceExporter ----
+
+ChromeTraceExporter::ChromeTraceExporter(std::string path) : path_(std::move(path)) {}
+
+void ChromeTraceExporter::export_spans(const std::vector<SpanRecord>& spans, const std::string& service) {
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path_).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    // Whoever creates the file opens the array; everyone else only appends
+    int fd = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        write_all(fd, "[\n");
+    } else {
+        fd = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        MAG_LOG_WARN("trace", "Cannot open trace file " << path_ << ": " << std::strerror(errno));
+        return;
+    }
+
+    const int pid = static_cast<int>(::getpid());
+    std::string out;
+    if (!named_process_) {
+        nlohmann::json meta = {{"name", "process_name"}, {"ph", "M"}, {"pid", pid},
+                               {"args", {{"name", service}}}};
+        out += meta.dump() + ",\n";
+        named_process_ = true;
+    }
+    for (const SpanRecord& span : spans) {
+        nlohmann::json args = {{"trace_id", span.context.trace_id_hex()}, {"span_id", span.context.span_id_hex()}};
+        if (span.parent_span_id != 0) {
+            args["parent_id"] = hex64(span.parent_span_id);
+        }
+        if (span.error) {
+            args["error"] = true;
+        }
+        for (const auto& [key, value] : span.attributes) {
+            args[key] = value;
+        }
+        nlohmann::json event = {
+            {"name", span.name}, {"cat", service}, {"ph", "X"},
+            {"ts", span.start_unix_us}, {"dur", span.duration_us},
+            {"pid", pid}, {"tid", span.thread_id}, {"args", args}
+        };
+        out += event.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + ",\n";
+    }
+
+    // One write per batch so processes sharing the file do not interleave events
+    if (!write_all(fd, out)) {
+        MAG_LOG_WARN("trace", "Failed to append to trace file " << path_ << ": " << std::strerror(errno));
+    }
+    ::close(fd);
+}
+
+// ---- OtlpExporter ----
+
+OtlpExporter::OtlpExporter(std::string endpoint) : endpoint_(std::move(endpoint)) {
+    // Constructed before the Tracer finishes constructing, so the transport outlives it
+    HttpTransport::instance();
+}
+
+std::string OtlpExporter::to_json(const std::vector<SpanRecord>& spans, const std::string& service) {
+    auto string_attribute = [](const std::string& key, const std::string& value) {
+        return nlohmann::json{{"key", key}, {"value", {{"stringValue", value}}}};
+    };
+
+    nlohmann::json otlp_spans = nlohmann::json::array();
+    for (const SpanRecord& span : spans) {
+        nlohmann::json attributes = nlohmann::json::array();
+        for (const auto& [key, value] : span.attributes) {
+            attributes.push_back(string_attribute(key, value));
+        }
+        int64_t start_ns = span.start_unix_us * 1000;
+        int64_t end_ns = (span.start_unix_us + span.duration_us) * 1000;
+        nlohmann::json otlp_span = {
+            {"traceId", span.context.trace_id_hex()},
+            {"spanId", span.context.span_id_hex()},
+            {"name", span.name},
+            {"kind", 1}, // SPAN_KIND_INTERNAL
+            {"startTimeUnixNano", std::to_string(start_ns)},
+            {"endTimeUnixNano", std::to_string(end_ns)},
+            {"attributes", attributes},
+            {"status", {{"code", span.error ? 2 : 1}}} // STATUS_CODE_ERROR / STATUS_CODE_OK
+        };
+        if (span.parent_span_id != 0) {
+            otlp_span["parentSpanId"] = hex64(span.parent_span_id);
+        }
+        otlp_spans.push_back(std::move(otlp_span));
+    }
+
+    nlohmann::json request = {
+        {"resourceSpans", {{
+            {"resource", {{"attributes", {string_attribute("service.name", service)}}}},
+            {"scopeSpans", {{
+                {"scope", {{"name", "mag"}}},
+                {"spans", otlp_spans}
+            }}}
+        }}}
+    };
+    return request.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
+
+void OtlpExporter::export_spans(const std::vector<SpanRecord>& spans, const std::string& service) {
+    HttpRequest request;
+    request.url = endpoint_;
+    request.payload = to_json(spans, service);
+    request.headers = {"Content-Type: application/json"};
+    request.timeout_ms = 5000;
+
+    HttpResponse response = HttpTransport::instance().submit(std::move(request))->wait();
+    if (!response.success) {
+        MAG_LOG_WARN("trace", "OTLP export to " << endpoint_ << " failed: " << response.error_message
+                     << " (Status: " << response.status_code << ")");
+    }
+}
+
+// ---- Tracer ----
+
+std::atomic<bool> Tracer::enabled_{false};
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() {
+    std::stringstream exporters(TraceConfig::get_exporters());
+    std::string name;
+    while (std::getline(exporters, name, ',')) {
+        if (name == "chrome") {
+            add_exporter(std::make_unique<ChromeTraceExporter>(TraceConfig::get_trace_file()));
+        } else if (name == "otlp") {
+            add_exporter(std::make_unique<OtlpExporter>(TraceConfig::get_otlp_endpoint()));
+        } else if (!name.empty() && name != "0" && name != "off") {
+            MAG_LOG_WARN("trace", "Unknown trace exporter '" << name << "' (expected chrome or otlp)");
+        }
+    }
+}
+
+Tracer::~Tracer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    enabled_.store(false);
+    flush();
+}
+
+void Tracer::set_service_name(std::string service) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    service_ = std::move(service);
+}
+
+std::string Tracer::service_name() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return service_;
+}
+
+void Tracer::add_exporter(std::unique_ptr<SpanExporter> exporter) {
+    std::lock_guard<std::mutex> export_lock(export_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    exporters_.push_back(std::move(exporter));
+    if (!flusher_.joinable()) {
+        flusher_ = std::thread([this] { flush_loop(); });
+    }
+    enabled_.store(true);
+}
+
+void Tracer::record(SpanRecord span) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (buffer_.size() >= MAX_BUFFERED) {
+        dropped_.fetch_add(1);
+        return;
+    }
+    buffer_.push_back(std::move(span));
+    if (buffer_.size() >= BATCH_SIZE) {
+        lock.unlock();
+        wake_.notify_one();
+    }
+}
+
+void Tracer::flush() {
+    std::vector<SpanRecord> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.swap(buffer_);
+    }
+    export_batch(std::move(batch));
+}
+
+void Tracer::flush_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS),
+                       [this] { return stopping_ || buffer_.size() >= BATCH_SIZE; });
+        std::vector<SpanRecord> batch;
+        batch.swap(buffer_);
+        lock.unlock();
+        export_batch(std::move(batch));
+        lock.lock();
+    }
+}
+
+void Tracer::export_batch(std::vector<SpanRecord> batch) {
+    if (batch.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> export_lock(export_mutex_);
+    std::string service = service_name();
+    for (const auto& exporter : exporters_) {
+        try {
+            exporter->export_spans(batch, service);
+        } catch (const std::exception& e) {
+            MAG_LOG_WARN("trace", "Span export failed: " << e.what());
+        }
+    }
+}
+
+uint64_t Tracer::new_span_id() {
+    thread_local std::mt19937_64 rng(std::random_device{}() ^
+                                     (static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) +
+                                      current_thread_id()));
+    uint64_t id;
+    do {
+        id = rng();
+    } while (id == 0);
+    return id;
+}
+
+int64_t Tracer::now_unix_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t Tracer::current_thread_id() {
+    thread_local uint64_t id = static_cast<uint64_t>(::syscall(SYS_gettid));
+    return id;
+}
+
+// ---- Span ----
+
+Span::Span(std::string_view name, Kind kind) {
+    if (!Tracer::enabled()) {
+        return;
+    }
+    TraceContext parent = current_context;
+    if (!parent.valid()) {
+        if (kind != Kind::ROOT) {
+            return;
+        }
+        parent.trace_high = Tracer::new_span_id();
+        parent.trace_low = Tracer::new_span_id();
+        parent.span_id = 0;
+    }
+    active_ = true;
+    record_.context = {parent.trace_high, parent.trace_low, Tracer::new_span_id()};
+    record_.parent_span_id = parent.span_id;
+    record_.name = std::string(name);
+    record_.start_unix_us = Tracer::now_unix_us();
+    record_.thread_id = Tracer::current_thread_id();
+    started_ = std::chrono::steady_clock::now();
+    previous_ = current_context;
+    current_context = record_.context;
+}
+
+Span::~Span() {
+    if (!active_) {
+        return;
+    }
+    current_context = previous_;
+    record_.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started_).count();
+    Tracer::instance().record(std::move(record_));
+}
+
+void Span::set_name(std::string name) {
+    if (active_) {
+        record_.name = std::move(name);
+    }
+}
+
+void Span::set_attribute(std::string key, std::string value) {
+    if (active_) {
+        record_.attributes.emplace_back(std::move(key), std::move(value));
+    }
+}
+
+void Span::set_error(const std::string& message) {
+    if (!active_) {
+        return;
+    }
+    record_.error = true;
+    if (!message.empty()) {
+        record_.attributes.emplace_back("error", message);
+    }
+}
+
+// ---- TraceScope ----
+
+TraceScope::TraceScope(const TraceContext& context) : previous_(current_context) {
+    current_context = context;
+}
+
+TraceScope::~TraceScope() {
+    current_context = previous_;
+}
+
+} // namespace mag
@@ -0,0 +1,103 @@
+#include "worker_registry.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+bool process_alive(pid_t pid) {
+    return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+}
+
+} // anonymous namespace
+
+WorkerRegistration::WorkerRegistration(const std::string& directory, const std::string& service,
+                                       const std::string& url) {
+    std::filesystem::path service_dir = std::filesystem::path(directory) / service;
+    std::error_code ec;
+    std::filesystem::create_directories(service_dir, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to create worker registry " + service_dir.string() + ": " + ec.message());
+    }
+    
+    // Written under a temporary name so a scan never sees half an entry
+    std::string name = std::to_string(::getpid()) + ".url";
+    path_ = (service_dir / name).string();
+    std::string temp_path = path_ + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        out << url << "\n";
+        if (!out) {
+            throw std::runtime_error("Failed to write worker registration " + temp_path);
+        }
+    }
+    std::filesystem::rename(temp_path, path_, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        throw std::runtime_error("Failed to register worker in " + service_dir.string());
+    }
+    MAG_LOG_INFO("registry", "Registered " << service << " worker " << url);
+}
+
+WorkerRegistration::~WorkerRegistration() {
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+}
+
+std::vector<std::string> WorkerRegistration::discover(const std::string& directory, const std::string& service) {
+    std::vector<std::string> urls;
+    std::error_code ec;
+    std::filesystem::path service_dir = std::filesystem::path(directory) / service;
+    for (const auto& entry : std::filesystem::directory_iterator(service_dir, ec)) {
+        const std::filesystem::path& path = entry.path();
+        if (path.extension() != ".url") {
+            continue;
+        }
+        
+        pid_t pid = 0;
+        try {
+            pid = static_cast<pid_t>(std::stol(path.stem().string()));
+        } catch (const std::exception&) {
+            continue;
+        }
+        if (!process_alive(pid)) {
+            MAG_LOG_DEBUG("registry", "Removing stale registration " << path.string());
+            std::error_code remove_ec;
+            std::filesystem::remove(path, remove_ec);
+            continue;
+        }
+        
+        std::ifstream in(path);
+        std::string url;
+        if (std::getline(in, url) && !url.empty()) {
+            urls.push_back(url);
+        }
+    }
+    std::sort(urls.begin(), urls.end());
+    urls.erase(std::unique(urls.begin(), urls.end()), urls.end());
+    return urls;
+}
+
+std::unique_ptr<WorkerRegistration> WorkerRegistration::announce(EndpointConfig::Service service,
+                                                                 const std::string& url) {
+    const std::string& directory = EndpointConfig::instance().registry_directory();
+    if (directory.empty()) {
+        return nullptr;
+    }
+    try {
+        return std::make_unique<WorkerRegistration>(directory, EndpointConfig::service_name(service), url);
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("registry", e.what());
+        return nullptr;
+    }
+}
+
+} // namespace mag
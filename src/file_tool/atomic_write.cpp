@@ -0,0 +1,159 @@
+#include "atomic_write.h"
+#include "tracing.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+// Keeps the temp name within NAME_MAX however long the target name is
+constexpr size_t MAX_TEMP_STEM = 200;
+
+std::string system_error(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+
+std::string temp_path_for(const std::filesystem::path& target) {
+    static std::atomic<uint64_t> counter{0};
+    std::string stem = target.filename().string().substr(0, MAX_TEMP_STEM);
+    std::string name = "." + stem + ".mag-" + std::to_string(::getpid()) + "-" +
+                       std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+    return (target.parent_path() / name).string();
+}
+
+std::string resolve_target(const std::string& path) {
+    std::error_code ec;
+    if (std::filesystem::is_symlink(path, ec)) {
+        std::filesystem::path resolved = std::filesystem::weakly_canonical(path, ec);
+        if (!ec) {
+            return resolved.string();
+        }
+    }
+    return path;
+}
+
+} // anonymous namespace
+
+StagedFile::StagedFile(const std::string& path, std::string_view content, bool durable)
+    : path_(resolve_target(path)), durable_(durable) {
+    temp_path_ = temp_path_for(path_);
+    
+    // 0666 here lets the umask decide for new files, as a plain open would
+    fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd_ < 0) {
+        throw std::runtime_error(system_error("Failed to open file for writing:", path));
+    }
+    
+    try {
+        struct stat existing;
+        if (::stat(path_.c_str(), &existing) == 0 && ::fchmod(fd_, existing.st_mode & 07777) != 0) {
+            throw std::runtime_error(system_error("Failed to copy permissions of", path));
+        }
+        
+        // One write call per kernel-sized chunk straight from the caller's buffer
+        size_t written = 0;
+        while (written < content.size()) {
+            ssize_t n = ::write(fd_, content.data() + written, content.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(system_error("Failed to write content to file:", path));
+            }
+            written += static_cast<size_t>(n);
+        }
+        
+#ifdef __linux__
+        if (durable_) {
+            // Start writeback now; sync() then mostly waits on I/O already in flight
+            ::sync_file_range(fd_, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+#endif
+    } catch (...) {
+        ::close(fd_);
+        ::unlink(temp_path_.c_str());
+        throw;
+    }
+}
+
+StagedFile::~StagedFile() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (!committed_) {
+        ::unlink(temp_path_.c_str());
+    }
+}
+
+void StagedFile::write_at(uint64_t offset, std::string_view bytes) {
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::pwrite(fd_, bytes.data() + written, bytes.size() - written,
+                             static_cast<off_t>(offset + written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(system_error("Failed to write content to file:", path_));
+        }
+        written += static_cast<size_t>(n);
+    }
+#ifdef __linux__
+    if (durable_) {
+        ::sync_file_range(fd_, static_cast<off_t>(offset), static_cast<off_t>(bytes.size()), SYNC_FILE_RANGE_WRITE);
+    }
+#endif
+}
+
+void StagedFile::sync() {
+    if (durable_ && ::fdatasync(fd_) != 0) {
+        throw std::runtime_error(system_error("Failed to sync", path_));
+    }
+}
+
+void StagedFile::commit() {
+    if (::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error(system_error("Failed to replace", path_));
+    }
+    committed_ = true;
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void sync_parent_directories(const std::vector<std::string>& paths) {
+    std::set<std::string> directories;
+    for (const auto& path : paths) {
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        directories.insert(directory.empty() ? "." : directory);
+    }
+    for (const auto& directory : directories) {
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+}
+
+void write_file_atomically(const std::string& path, std::string_view content, bool durable) {
+    Span span("disk write");
+    if (span.active()) {
+        span.set_attribute("bytes", std::to_string(content.size()));
+    }
+    StagedFile staged(path, content, durable);
+    staged.sync();
+    staged.commit();
+    if (durable) {
+        sync_parent_directories({staged.path()});
+    }
+}
+
+} // namespace mag
@@ -0,0 +1,142 @@
+#include "content_hash_cache.h"
+#include "mapped_file.h"
+#include "utils.h"
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+namespace mag {
+
+namespace {
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+std::optional<struct stat> stat_regular_file(const std::string& path) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return std::nullopt;
+    }
+    return st;
+}
+
+} // anonymous namespace
+
+ContentHashCache::ContentHashCache(size_t max_entries) : max_entries_(max_entries) {
+}
+
+bool ContentHashCache::matches(const std::string& path, std::string_view content) {
+    std::optional<struct stat> st = stat_regular_file(path);
+    if (!st || static_cast<size_t>(st->st_size) != content.size()) {
+        return false;
+    }
+    if (std::optional<uint64_t> known = lookup(path, *st)) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return *known == Utils::hash64(content);
+    }
+    
+    // Same size but nothing trustworthy on record: compare the bytes themselves
+    int64_t hashed_at = now_ns();
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::string existing((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    reads_.fetch_add(1, std::memory_order_relaxed);
+    if (existing.size() == content.size()) {
+        record(path, *st, Utils::hash64(existing), hashed_at);
+    }
+    return existing == content;
+}
+
+bool ContentHashCache::matches_hash(const std::string& path, uint64_t size, uint64_t hash) {
+    std::optional<struct stat> st = stat_regular_file(path);
+    if (!st || static_cast<uint64_t>(st->st_size) != size) {
+        return false;
+    }
+    if (std::optional<uint64_t> known = lookup(path, *st)) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return *known == hash;
+    }
+    
+    int64_t hashed_at = now_ns();
+    uint64_t existing = 0;
+    try {
+        MappedFile file(path); // hashed from the page cache, never copied
+        if (file.size() != size) {
+            return false;
+        }
+        existing = Utils::hash64(file.bytes());
+    } catch (const std::exception&) {
+        return false;
+    }
+    reads_.fetch_add(1, std::memory_order_relaxed);
+    record(path, *st, existing, hashed_at);
+    return existing == hash;
+}
+
+std::optional<uint64_t> ContentHashCache::lookup(const std::string& path, const struct stat& st) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    const Entry& entry = it->second;
+    bool same_file = entry.size == st.st_size && entry.mtime_ns == mtime_ns(st) &&
+                     entry.inode == st.st_ino && entry.device == st.st_dev;
+    bool racy = entry.hashed_at_ns - entry.mtime_ns < RACY_WINDOW.count();
+    if (!same_file || racy) {
+        return std::nullopt;
+    }
+    return entry.hash;
+}
+
+void ContentHashCache::record(const std::string& path, const struct stat& st, uint64_t hash, int64_t hashed_at_ns) {
+    // Skip recording if the file changed while it was being read
+    std::optional<struct stat> after = stat_regular_file(path);
+    if (after && after->st_size == st.st_size && mtime_ns(*after) == mtime_ns(st) && after->st_ino == st.st_ino) {
+        store(path, Entry{st.st_size, mtime_ns(st), st.st_ino, st.st_dev, hash, hashed_at_ns});
+    }
+}
+
+void ContentHashCache::remember(const std::string& path, std::string_view content) {
+    remember_hash(path, content.size(), Utils::hash64(content));
+}
+
+void ContentHashCache::remember_hash(const std::string& path, uint64_t size, uint64_t hash) {
+    std::optional<struct stat> st = stat_regular_file(path);
+    int64_t now = now_ns();
+    // A file written just now is racy, and an entry lookup() would never trust is not worth keeping
+    if (!st || static_cast<uint64_t>(st->st_size) != size || now - mtime_ns(*st) < RACY_WINDOW.count()) {
+        forget(path);
+        return;
+    }
+    store(path, Entry{st->st_size, mtime_ns(*st), st->st_ino, st->st_dev, hash, now});
+}
+
+void ContentHashCache::forget(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(path);
+}
+
+size_t ContentHashCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void ContentHashCache::store(const std::string& path, Entry entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= max_entries_ && entries_.find(path) == entries_.end()) {
+        // Entries are cheap to rebuild; starting over keeps the bound without LRU bookkeeping
+        entries_.clear();
+    }
+    entries_[path] = entry;
+}
+
+} // namespace mag
@@ -1,17 +1,78 @@
 #include "file_operations.h"
+#include "atomic_write.h"
+#include "config.h"
+#include "text_diff.h"
+#include "tracing.h"
 #include "utils.h"
 #include "bash_tool.h"
-#include <fstream>
+#include <algorithm>
 #include <iostream>
+#include <cerrno>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
 
 namespace mag {
 
+namespace {
+
+std::optional<std::string> read_existing(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return std::nullopt;
+    }
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Diff for a dry run, cut short past MAX_DIFF_PREVIEW_BYTES; binary files get none
+TextDiff preview_diff(const std::string& path, std::string_view before, std::string_view after) {
+    if (before.find('\0') != std::string_view::npos || after.find('\0') != std::string_view::npos) {
+        return {};
+    }
+    TextDiff diff = diff_lines(before, after, path);
+    if (diff.unified.size() > FileToolConfig::MAX_DIFF_PREVIEW_BYTES) {
+        size_t cut = diff.unified.rfind('\n', FileToolConfig::MAX_DIFF_PREVIEW_BYTES);
+        diff.unified.resize(cut == std::string::npos ? 0 : cut + 1);
+        diff.unified += "... (diff truncated)\n";
+    }
+    return diff;
+}
+
+std::string line_counts(const TextDiff& diff) {
+    return "+" + std::to_string(diff.lines_added) + " -" + std::to_string(diff.lines_removed) + " lines";
+}
+
+DryRunResult unchanged_dry_run(const std::string& path, size_t size) {
+    DryRunResult result;
+    result.description = "[DRY-RUN] '" + path + "' is unchanged (already " + std::to_string(size) + " bytes of this content).";
+    result.success = true;
+    result.unchanged = true;
+    return result;
+}
+
+} // anonymous namespace
+
 DryRunResult FileTool::dry_run(const std::string& path, const std::string& content) const {
     DryRunResult result;
     
     try {
-        result.description = generate_dry_run_description(path, content);
+        if (hashes_->matches(path, content)) {
+            return unchanged_dry_run(path, content.size());
+        }
+        result.description = generate_dry_run_description(path, content.size());
+        if (std::optional<std::string> existing = read_existing(path)) {
+            result.diff = preview_diff(path, *existing, content).unified;
+        }
         result.success = true;
         result.error_message = "";
     } catch (const std::exception& e) {
@@ -23,59 +84,579 @@ DryRunResult FileTool::dry_run(const std::string& path, const std::string& conte
     return result;
 }
 
+FileTool::FileTool() : FileTool(FileToolConfig::durable_writes()) {
+}
+
+FileTool::FileTool(bool durable, size_t io_threads)
+    : durable_(durable), hashes_(std::make_shared<ContentHashCache>()),
+      path_locks_(std::make_shared<PathLocks>()),
+      io_pool_(io_threads > 1 ? std::make_shared<ThreadPool>(io_threads) : nullptr),
+      transfers_(std::make_shared<FileTransfers>(durable)) {
+}
+
+void FileTool::for_each_parallel(size_t count, const std::function<void(size_t)>& task) const {
+    if (!io_pool_ || count < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+    std::vector<std::future<void>> done;
+    done.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        done.push_back(io_pool_->submit_with_result([&task, i](size_t) { task(i); }));
+    }
+    for (auto& item : done) {
+        item.wait(); // every task refers to this frame
+    }
+    for (auto& item : done) {
+        item.get();
+    }
+}
+
 ApplyResult FileTool::apply(const std::string& path, const std::string& content) const {
-    ApplyResult result;
-    
+    PathLocks::Guard guard = path_locks_->lock({path});
+    return write_locked(path, content);
+}
+
+ApplyResult FileTool::write_locked(const std::string& path, const std::string& content) const {
     // Capture execution context before operation
     BashTool bash_tool;
     std::string working_dir_before = bash_tool.get_current_directory();
     
     try {
+        // Leave identical files alone so their mtime does not trigger rebuilds
+        if (hashes_->matches(path, content)) {
+            return unchanged(path, content.size(), working_dir_before);
+        }
+        
         // Create parent directories if they don't exist
         if (!Utils::create_directories(path)) {
             throw std::runtime_error("Failed to create parent directories");
         }
         
-        // Write the file
-        std::ofstream file(path);
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file for writing: " + path);
-        }
-        
-        file << content;
-        file.close();
-        
-        if (file.fail()) {
-            throw std::runtime_error("Failed to write content to file: " + path);
-        }
-        
-        result.description = generate_apply_description(path, content);
-        result.success = true;
-        result.error_message = "";
+        // Temp file + rename: readers never see a partial file
+        write_file_atomically(path, content, durable_);
+        hashes_->remember(path, content);
+        return applied(path, content.size(), working_dir_before);
         
     } catch (const std::exception& e) {
+        ApplyResult result;
         result.description = "";
         result.success = false;
         result.error_message = e.what();
+        result.execution_context.working_directory_before = working_dir_before;
+        result.execution_context.working_directory_after = bash_tool.get_current_directory();
+        result.execution_context.exit_code = 1;
+        result.execution_context.timestamp = std::chrono::system_clock::now();
+        return result;
     }
+}
+
+DryRunResult FileTool::dry_run_patch(const std::string& path, const std::string& patch) const {
+    DryRunResult result;
+    result.success = false;
+    try {
+        std::string before = read_existing(path).value_or("");
+        std::string after = mag::apply_patch(before, patch);
+        if (after == before && Utils::file_exists(path)) {
+            return unchanged_dry_run(path, after.size());
+        }
+        TextDiff diff = preview_diff(path, before, after);
+        result.description = "[DRY-RUN] Will patch '" + path + "' (" + line_counts(diff) + ", " +
+                             std::to_string(after.size()) + " bytes).";
+        result.diff = std::move(diff.unified);
+        result.success = true;
+    } catch (const std::exception& e) {
+        result.error_message = "Patch for '" + path + "' does not apply: " + e.what();
+    }
+    return result;
+}
+
+ApplyResult FileTool::apply_patch(const std::string& path, const std::string& patch) const {
+    // Held from reading the file to writing it back, so no other edit slips in between
+    PathLocks::Guard guard = path_locks_->lock({path});
+    std::string content;
+    try {
+        content = patched_content(path, patch);
+    } catch (const std::exception& e) {
+        ApplyResult result;
+        result.success = false;
+        result.error_message = "Patch for '" + path + "' does not apply: " + e.what();
+        result.execution_context.exit_code = 1;
+        result.execution_context.timestamp = std::chrono::system_clock::now();
+        return result;
+    }
+    return write_locked(path, content);
+}
+
+DryRunResult FileTool::dry_run(const WriteFileCommand& command) const {
+    return command.is_patch() ? dry_run_patch(command.path, command.content)
+                              : dry_run(command.path, command.content);
+}
+
+ApplyResult FileTool::apply(const WriteFileCommand& command) const {
+    return command.is_patch() ? apply_patch(command.path, command.content)
+                              : apply(command.path, command.content);
+}
+
+std::string FileTool::patched_content(const std::string& path, const std::string& patch) const {
+    return mag::apply_patch(read_existing(path).value_or(""), patch);
+}
+
+ApplyResult FileTool::applied(const std::string& path, uint64_t size, const std::string& working_dir_before) const {
+    ApplyResult result;
+    result.description = generate_apply_description(path, size);
+    result.success = true;
+    result.error_message = "";
     
     // Capture execution context after operation
     result.execution_context.working_directory_before = working_dir_before;
-    result.execution_context.working_directory_after = bash_tool.get_current_directory();
-    result.execution_context.exit_code = result.success ? 0 : 1;
+    result.execution_context.working_directory_after = Utils::get_current_working_directory();
+    result.execution_context.exit_code = 0;
     result.execution_context.timestamp = std::chrono::system_clock::now();
     
     // For file operations, add the file path and size to the output
-    if (result.success) {
-        result.execution_context.command_output = "Created file: " + path + " (" + 
-                                                 std::to_string(content.size()) + " bytes)";
+    result.execution_context.command_output = "Created file: " + path + " (" + std::to_string(size) + " bytes)";
+    return result;
+}
+
+ApplyResult FileTool::unchanged(const std::string& path, uint64_t size, const std::string& working_dir_before) const {
+    ApplyResult result = applied(path, size, working_dir_before);
+    result.description = "[UNCHANGED] '" + path + "' already holds these " + std::to_string(size) +
+                         " bytes; not rewritten.";
+    result.execution_context.command_output = "Unchanged file: " + path + " (" + std::to_string(size) + " bytes)";
+    result.unchanged = true;
+    return result;
+}
+
+namespace {
+
+// The file a batch is about to replace, kept under a side name until the batch is done
+struct PreviousVersion {
+    std::string path;
+    std::string backup; // empty when the file did not exist
+};
+
+PreviousVersion keep_previous_version(const std::string& path) {
+    PreviousVersion previous{path, ""};
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        return previous;
+    }
+    std::filesystem::path target(path);
+    std::string backup = (target.parent_path() / ("." + target.filename().string().substr(0, 200) + ".mag-" +
+                                                 std::to_string(::getpid()) + ".bak")).string();
+    std::filesystem::remove(backup, ec);
+    
+    // A hard link costs nothing; filesystems without them get a copy
+    if (::link(path.c_str(), backup.c_str()) != 0 &&
+        !std::filesystem::copy_file(path, backup, ec)) {
+        throw std::runtime_error("Failed to keep a copy of " + path + " for rollback");
+    }
+    previous.backup = backup;
+    return previous;
+}
+
+bool restore_previous_version(const PreviousVersion& previous) {
+    if (previous.backup.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(previous.path, ec);
+        return !std::filesystem::exists(previous.path, ec);
     }
+    return ::rename(previous.backup.c_str(), previous.path.c_str()) == 0;
+}
+
+ApplyResult not_applied(const std::string& reason) {
+    ApplyResult result;
+    result.success = false;
+    result.error_message = reason;
+    result.execution_context.exit_code = 1;
+    result.execution_context.timestamp = std::chrono::system_clock::now();
+    return result;
+}
+
+} // anonymous namespace
+
+BatchDryRunResult FileTool::dry_run_batch(const std::vector<WriteFileCommand>& commands) const {
+    BatchDryRunResult batch;
+    batch.success = true;
+    std::unordered_map<std::string, size_t> first_writer; // path -> item index
     
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const WriteFileCommand& command = commands[i];
+        DryRunResult result;
+        result.success = false;
+        
+        auto [it, inserted] = first_writer.emplace(command.path, i);
+        if (command.path.empty()) {
+            result.error_message = "Missing file path";
+        } else if (!inserted) {
+            result.error_message = "'" + command.path + "' is also written by item " + std::to_string(it->second + 1);
+        } else if (std::filesystem::is_directory(command.path)) {
+            result.error_message = "'" + command.path + "' is a directory";
+        } else {
+            result = dry_run(command);
+        }
+        
+        batch.success = batch.success && result.success;
+        batch.results.push_back(std::move(result));
+    }
+    if (!batch.success) {
+        batch.error_message = "Batch validation failed";
+    }
+    return batch;
+}
+
+BatchApplyResult FileTool::apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) const {
+    std::vector<std::string> paths;
+    paths.reserve(commands.size());
+    for (const auto& command : commands) {
+        paths.push_back(command.path);
+    }
+    // Validation and writes see the same files
+    PathLocks::Guard guard = path_locks_->lock(paths);
+    
+    BatchApplyResult batch;
+    BatchDryRunResult validation = dry_run_batch(commands);
+    
+    if (all_or_nothing && !validation.success) {
+        for (const auto& checked : validation.results) {
+            batch.results.push_back(not_applied(checked.success ? "Not applied: another item failed validation"
+                                                                : checked.error_message));
+        }
+        batch.error_message = validation.error_message;
+        return batch;
+    }
+    
+    std::string working_dir = Utils::get_current_working_directory();
+    batch.success = true;
+    batch.results.resize(commands.size());
+    std::vector<std::unique_ptr<StagedFile>> staged(commands.size());
+    std::vector<std::string> patched(commands.size()); // new content of PatchFile items
+    std::optional<size_t> failed_item; // all_or_nothing only
+    auto content_of = [&](size_t i) -> const std::string& {
+        return commands[i].is_patch() ? patched[i] : commands[i].content;
+    };
+    
+    auto item_failed = [&](size_t i, const std::string& reason) {
+        batch.results[i] = not_applied(reason);
+        batch.success = false;
+        staged[i].reset();
+        if (all_or_nothing) {
+            failed_item = i;
+        }
+    };
+    
+    // Each parent directory once; sorted order creates a parent before its children
+    std::map<std::filesystem::path, bool> directories; // -> exists now
+    for (size_t i = 0; i < commands.size(); ++i) {
+        std::filesystem::path parent = std::filesystem::path(commands[i].path).parent_path();
+        if (validation.results[i].success && !parent.empty()) {
+            directories.emplace(parent, false);
+        }
+    }
+    for (auto& [directory, ready] : directories) {
+        std::error_code ec;
+        ready = std::filesystem::is_directory(directory, ec) || std::filesystem::create_directories(directory, ec);
+    }
+    
+    // Stage everything first, in parallel; nothing visible has changed yet
+    std::vector<std::string> errors(commands.size());
+    std::vector<char> already_there(commands.size(), 0);
+    for_each_parallel(commands.size(), [&](size_t i) {
+        if (!validation.results[i].success) {
+            errors[i] = validation.results[i].error_message;
+            return;
+        }
+        try {
+            std::filesystem::path parent = std::filesystem::path(commands[i].path).parent_path();
+            if (!parent.empty() && !directories.at(parent)) {
+                throw std::runtime_error("Failed to create parent directories");
+            }
+            if (commands[i].is_patch()) {
+                patched[i] = patched_content(commands[i].path, commands[i].content);
+            }
+            if (hashes_->matches(commands[i].path, content_of(i))) {
+                already_there[i] = 1;
+                return;
+            }
+            staged[i] = std::make_unique<StagedFile>(commands[i].path, content_of(i), durable_);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    });
+    for (size_t i = 0; i < commands.size() && !failed_item; ++i) {
+        if (!errors[i].empty()) {
+            item_failed(i, errors[i]);
+        } else if (already_there[i]) {
+            batch.results[i] = unchanged(commands[i].path, content_of(i).size(), working_dir);
+        }
+    }
+    
+    // Writeback of every file is already under way, so these waits overlap
+    if (!failed_item) {
+        std::fill(errors.begin(), errors.end(), std::string());
+        for_each_parallel(commands.size(), [&](size_t i) {
+            if (!staged[i]) {
+                return;
+            }
+            try {
+                staged[i]->sync();
+            } catch (const std::exception& e) {
+                errors[i] = e.what();
+            }
+        });
+        for (size_t i = 0; i < commands.size() && !failed_item; ++i) {
+            if (!errors[i].empty()) {
+                item_failed(i, errors[i]);
+            }
+        }
+    }
+    
+    // Rename into place, keeping what each rename replaces until the batch is done
+    std::vector<PreviousVersion> replaced;
+    std::vector<std::string> touched;
+    for (size_t i = 0; i < commands.size() && !failed_item; ++i) {
+        if (!staged[i]) {
+            continue;
+        }
+        bool kept = false;
+        try {
+            if (all_or_nothing) {
+                replaced.push_back(keep_previous_version(staged[i]->path()));
+                kept = true;
+            }
+            staged[i]->commit();
+            touched.push_back(staged[i]->path());
+            hashes_->remember(commands[i].path, content_of(i));
+            batch.results[i] = applied(commands[i].path, content_of(i).size(), working_dir);
+        } catch (const std::exception& e) {
+            if (kept && !staged[i]->committed()) {
+                if (!replaced.back().backup.empty()) {
+                    ::unlink(replaced.back().backup.c_str());
+                }
+                replaced.pop_back();
+            }
+            item_failed(i, e.what());
+        }
+    }
+    
+    if (failed_item) {
+        // Put back what was replaced, newest first; staged temps go with their StagedFile
+        batch.rolled_back = true;
+        for (auto previous = replaced.rbegin(); previous != replaced.rend(); ++previous) {
+            if (!restore_previous_version(*previous)) {
+                batch.rolled_back = false;
+            }
+        }
+        replaced.clear();
+        
+        size_t failed = *failed_item;
+        for (size_t done = 0; done < failed; ++done) {
+            if (batch.results[done].unchanged) {
+                continue; // never touched, so still correct
+            }
+            batch.results[done] = not_applied("Rolled back: item " + std::to_string(failed + 1) + " failed");
+        }
+        for (size_t rest = failed + 1; rest < commands.size(); ++rest) {
+            batch.results[rest] = not_applied("Not applied: item " + std::to_string(failed + 1) + " failed");
+        }
+        batch.error_message = batch.results[failed].error_message;
+        if (!batch.rolled_back) {
+            batch.error_message += " (rollback incomplete)";
+        }
+    }
+    
+    // One fsync per directory makes every rename (or restore) durable
+    if (durable_ && !touched.empty()) {
+        sync_parent_directories(touched);
+    }
+    for (const auto& previous : replaced) {
+        if (!previous.backup.empty()) {
+            ::unlink(previous.backup.c_str());
+        }
+    }
+    return batch;
+}
+
+FileTransferReply FileTool::begin_transfer(const std::string& path, uint64_t size, uint64_t hash) const {
+    // The size is the caller's word; it is checked again against the bytes that arrive on commit
+    size_t max_mb = read_policy_ ? read_policy_->get_settings()->global.max_file_size_mb
+                                 : GlobalPolicy().max_file_size_mb;
+    return transfers_->begin(path, size, hash, static_cast<uint64_t>(max_mb) * 1024 * 1024);
+}
+
+FileTransferReply FileTool::write_chunk(const std::string& transfer_id, uint64_t offset, std::string_view data) const {
+    return transfers_->write_chunk(transfer_id, offset, data);
+}
+
+bool FileTool::abort_transfer(const std::string& transfer_id) const {
+    return transfers_->abort(transfer_id);
+}
+
+ApplyResult FileTool::commit_transfer(const std::string& transfer_id) const {
+    std::string working_dir = Utils::get_current_working_directory();
+    try {
+        FileTransfers::Finished finished = transfers_->finish(transfer_id);
+        {
+            // The bytes that arrived are the bytes that were announced
+            MappedFile assembled(finished.staged->temp_path());
+            if (assembled.size() != finished.size || Utils::hash64(assembled.bytes()) != finished.hash) {
+                throw std::runtime_error("Assembled '" + finished.path + "' does not match the announced content hash");
+            }
+        }
+        
+        PathLocks::Guard guard = path_locks_->lock({finished.path});
+        if (hashes_->matches_hash(finished.path, finished.size, finished.hash)) {
+            return unchanged(finished.path, finished.size, working_dir);
+        }
+        finished.staged->sync();
+        finished.staged->commit();
+        if (durable_) {
+            sync_parent_directories({finished.staged->path()});
+        }
+        hashes_->remember_hash(finished.path, finished.size, finished.hash);
+        return applied(finished.path, finished.size, working_dir);
+    } catch (const std::exception& e) {
+        return not_applied(e.what());
+    }
+}
+
+DryRunResult FileTool::dry_run_digest(const std::string& path, uint64_t size, uint64_t hash) const {
+    if (hashes_->matches_hash(path, size, hash)) {
+        return unchanged_dry_run(path, size);
+    }
+    DryRunResult result;
+    result.description = generate_dry_run_description(path, size);
+    result.success = true;
+    return result;
+}
+
+std::string FileTool::read_denied(const std::string& path) const {
+    if (path.empty()) {
+        return "Missing file path";
+    }
+    Span policy("policy");
+    if (read_policy_ && !read_policy_->is_allowed("file_tool", Operation::READ, path)) {
+        policy.set_error("denied");
+        return "Policy does not allow reading '" + path + "'";
+    }
+    return "";
+}
+
+FileSlice FileTool::read_slice(const ReadFileRequest& request) const {
+    FileSlice slice;
+    ReadFileResult& result = slice.result;
+    result.error_message = read_denied(request.path);
+    if (!result.error_message.empty()) {
+        return slice;
+    }
+    if (request.by_lines() && request.last_line > 0 && request.last_line < request.first_line) {
+        result.error_message = "last_line comes before first_line";
+        return slice;
+    }
+    
+    try {
+        slice.file = std::make_shared<const MappedFile>(request.path);
+    } catch (const std::exception& e) {
+        result.error_message = e.what();
+        return slice;
+    }
+    std::string_view bytes = slice.file->bytes();
+    const size_t size = bytes.size();
+    const size_t limit = FileToolConfig::MAX_READ_BYTES;
+    result.file_size = size;
+    result.success = true;
+    
+    size_t start = 0;
+    size_t end = 0;
+    if (request.by_lines()) {
+        // Skip to the first requested line, then take whole lines up to the limit
+        size_t line = 1;
+        while (line < request.first_line && start < size) {
+            const void* newline = std::memchr(bytes.data() + start, '\n', size - start);
+            start = newline ? static_cast<size_t>(static_cast<const char*>(newline) - bytes.data()) + 1 : size;
+            ++line;
+        }
+        end = start;
+        size_t taken = 0;
+        size_t wanted = request.last_line == 0 ? SIZE_MAX : request.last_line - request.first_line + 1;
+        while (line == request.first_line && taken < wanted && end < size) {
+            const void* newline = std::memchr(bytes.data() + end, '\n', size - end);
+            size_t next = newline ? static_cast<size_t>(static_cast<const char*>(newline) - bytes.data()) + 1 : size;
+            if (next - start > limit) {
+                result.truncated = true;
+                if (taken == 0) {
+                    end = start + limit; // a single line longer than the limit
+                    ++taken;
+                }
+                break;
+            }
+            end = next;
+            ++taken;
+        }
+        if (taken > 0) {
+            result.first_line = request.first_line;
+            result.last_line = request.first_line + taken - 1;
+        }
+    } else {
+        start = static_cast<size_t>(std::min<uint64_t>(request.offset, size));
+        uint64_t wanted = request.length == 0 ? size - start : std::min<uint64_t>(request.length, size - start);
+        if (wanted > limit) {
+            result.truncated = true;
+            wanted = limit;
+        }
+        end = start + static_cast<size_t>(wanted);
+    }
+    
+    result.offset = start;
+    const size_t length = end - start;
+    if (length > FileToolConfig::COPY_READ_BYTES && slice.file->intact()) {
+        slice.content = bytes.substr(start, length);
+        return slice;
+    }
+    // Not worth a mapping that faults if someone truncates the file before
+    // the reply is sent, or one that already lost pages
+    slice.copy = std::make_shared<const std::string>(slice.file->read_at(start, length));
+    if (slice.copy->size() < length) {
+        result.truncated = true;
+    }
+    slice.content = *slice.copy;
+    return slice;
+}
+
+ReadFileResult FileTool::read(const ReadFileRequest& request) const {
+    FileSlice slice = read_slice(request);
+    slice.result.content = std::string(slice.content);
+    return std::move(slice.result);
+}
+
+FileStatResult FileTool::stat(const std::string& path) const {
+    FileStatResult result;
+    result.error_message = read_denied(path);
+    if (!result.error_message.empty()) {
+        return result;
+    }
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            result.success = true; // not there is an answer, not an error
+        } else {
+            result.error_message = "Failed to stat '" + path + "': " + std::strerror(errno);
+        }
+        return result;
+    }
+    result.success = true;
+    result.exists = true;
+    result.is_directory = S_ISDIR(st.st_mode);
+    result.size = static_cast<uint64_t>(st.st_size);
+    result.modified = static_cast<int64_t>(st.st_mtim.tv_sec);
+    result.mode = static_cast<uint32_t>(st.st_mode & 07777);
     return result;
 }
 
-std::string FileTool::generate_dry_run_description(const std::string& path, const std::string& content) const {
-    size_t content_size = Utils::get_file_size(content);
+std::string FileTool::generate_dry_run_description(const std::string& path, uint64_t content_size) const {
     
     if (Utils::file_exists(path)) {
         return "[DRY-RUN] Will overwrite existing file '" + path + "' with " + 
@@ -86,8 +667,7 @@ std::string FileTool::generate_dry_run_description(const std::string& path, cons
     }
 }
 
-std::string FileTool::generate_apply_description(const std::string& path, const std::string& content) const {
-    size_t content_size = Utils::get_file_size(content);
+std::string FileTool::generate_apply_description(const std::string& path, uint64_t content_size) const {
     return "[APPLIED] Successfully wrote " + std::to_string(content_size) + " bytes to '" + path + "'.";
 }
 
@@ -0,0 +1,157 @@
+#include "file_transfer.h"
+#include "utils.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mag {
+
+namespace {
+
+FileTransferReply refused(const std::string& reason) {
+    FileTransferReply reply;
+    reply.error_message = reason;
+    return reply;
+}
+
+} // anonymous namespace
+
+FileTransfers::FileTransfers(bool durable, size_t chunk_size)
+    : durable_(durable), chunk_size_(chunk_size), random_(std::random_device{}()) {
+}
+
+FileTransferReply FileTransfers::begin(const std::string& path, uint64_t size, uint64_t hash, uint64_t max_size) {
+    if (path.empty()) {
+        return refused("Missing file path");
+    }
+    if (size > max_size) {
+        return refused("File size " + std::to_string(size) + " bytes exceeds the limit of " +
+                       std::to_string(max_size) + " bytes");
+    }
+    
+    auto transfer = std::make_shared<Transfer>();
+    transfer->path = path;
+    transfer->size = size;
+    transfer->hash = hash;
+    transfer->received.assign(static_cast<size_t>((size + chunk_size_ - 1) / chunk_size_), false);
+    transfer->last_used = Clock::now();
+    
+    std::string transfer_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expire_idle(transfer->last_used);
+        if (transfers_.size() >= FileTransferConfig::MAX_ACTIVE) {
+            return refused("Too many chunked writes in progress");
+        }
+        do {
+            transfer_id = Utils::hash_to_hex(random_());
+        } while (transfers_.count(transfer_id));
+        transfers_[transfer_id] = transfer; // reserves the id while the file is created
+    }
+    
+    try {
+        if (!Utils::create_directories(path)) {
+            throw std::runtime_error("Failed to create parent directories");
+        }
+        transfer->staged = std::make_unique<StagedFile>(path, std::string_view(), durable_);
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transfers_.erase(transfer_id);
+        return refused(e.what());
+    }
+    
+    FileTransferReply reply;
+    reply.success = true;
+    reply.transfer_id = transfer_id;
+    reply.chunk_size = chunk_size_;
+    return reply;
+}
+
+FileTransferReply FileTransfers::write_chunk(const std::string& transfer_id, uint64_t offset, std::string_view data) {
+    std::shared_ptr<Transfer> transfer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = transfers_.find(transfer_id);
+        if (it == transfers_.end()) {
+            return refused("Unknown or expired transfer " + transfer_id);
+        }
+        transfer = it->second;
+    }
+    
+    std::lock_guard<std::mutex> lock(transfer->mutex);
+    if (!transfer->staged) {
+        return refused("Transfer " + transfer_id + " is still starting");
+    }
+    if (offset % chunk_size_ != 0 || offset >= transfer->size) {
+        return refused("Chunk offset " + std::to_string(offset) + " is not a chunk boundary of the file");
+    }
+    size_t chunk = static_cast<size_t>(offset / chunk_size_);
+    uint64_t expected = std::min<uint64_t>(chunk_size_, transfer->size - offset);
+    if (data.size() != expected) {
+        return refused("Chunk at " + std::to_string(offset) + " has " + std::to_string(data.size()) +
+                       " bytes, expected " + std::to_string(expected));
+    }
+    
+    try {
+        transfer->staged->write_at(offset, data);
+    } catch (const std::exception& e) {
+        return refused(e.what());
+    }
+    if (!transfer->received[chunk]) {
+        transfer->received[chunk] = true; // a resent chunk is simply written again
+        ++transfer->chunks_received;
+        transfer->bytes_received += data.size();
+    }
+    transfer->last_used = Clock::now();
+    
+    FileTransferReply reply;
+    reply.success = true;
+    reply.transfer_id = transfer_id;
+    reply.chunk_size = chunk_size_;
+    reply.received = transfer->bytes_received;
+    return reply;
+}
+
+FileTransfers::Finished FileTransfers::finish(const std::string& transfer_id) {
+    std::shared_ptr<Transfer> transfer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = transfers_.find(transfer_id);
+        if (it == transfers_.end()) {
+            throw std::runtime_error("Unknown or expired transfer " + transfer_id);
+        }
+        transfer = std::move(it->second);
+        transfers_.erase(it);
+    }
+    
+    std::lock_guard<std::mutex> lock(transfer->mutex);
+    if (!transfer->staged || transfer->chunks_received != transfer->received.size()) {
+        throw std::runtime_error("Transfer " + transfer_id + " is missing " +
+                                 std::to_string(transfer->size - transfer->bytes_received) + " bytes");
+    }
+    return Finished{transfer->path, transfer->size, transfer->hash, std::move(transfer->staged)};
+}
+
+bool FileTransfers::abort(const std::string& transfer_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transfers_.erase(transfer_id) > 0; // the StagedFile removes its temp file
+}
+
+size_t FileTransfers::active() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transfers_.size();
+}
+
+void FileTransfers::expire_idle(Clock::time_point now) {
+    auto idle = std::chrono::milliseconds(FileTransferConfig::IDLE_TIMEOUT_MS);
+    for (auto it = transfers_.begin(); it != transfers_.end();) {
+        std::unique_lock<std::mutex> busy(it->second->mutex, std::try_to_lock);
+        if (busy.owns_lock() && it->second->staged && now - it->second->last_used > idle) {
+            busy.unlock();
+            it = transfers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace mag
@@ -1,111 +1,312 @@
 #include "file_operations.h"
+#include "policy.h"
+#include "project_index.h"
 #include "message.h"
 #include "config.h"
-#include <nng/nng.h>
-#include <nng/protocol/reqrep0/rep.h>
+#include "worker_registry.h"
+#include "logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "thread_pool.h"
+#include "tracing.h"
+#include "network/nng_message.h"
+#include "network/nng_rep_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
-#include <cstring>
+#include <thread>
 
 using namespace mag;
 
 struct RequestMessage {
-    std::string operation; // "dry_run" or "apply"
+    std::string operation; // "dry_run", "apply", the batch forms, "read", "read_range", "stat" or "context"
     WriteFileCommand command;
 };
 
-void handle_request(const std::string& request_data, nng_socket sock) {
-    FileTool file_tool;
+NngMessage reply(NngMessage& response, ServiceMetrics::RequestScope& scope) {
+    scope.add_reply_bytes(response.size());
+    return std::move(response);
+}
+
+std::vector<WriteFileCommand> batch_commands(const nlohmann::json& request_json) {
+    const nlohmann::json& items = request_json.at("commands");
+    if (!items.is_array()) {
+        throw std::runtime_error("\"commands\" must be an array");
+    }
+    if (items.size() > FileToolConfig::MAX_BATCH_COMMANDS) {
+        throw std::runtime_error("Batch of " + std::to_string(items.size()) + " commands exceeds the limit of " +
+                                 std::to_string(FileToolConfig::MAX_BATCH_COMMANDS));
+    }
+    std::vector<WriteFileCommand> commands(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        commands[i].from_json(items[i]);
+    }
+    return commands;
+}
+
+// Content bytes that reached disk
+Counter& bytes_written() {
+    static Counter& counter = MetricsRegistry::instance().counter(
+        "mag_file_bytes_written_total", {}, "File content bytes written by apply and apply_batch");
+    return counter;
+}
+
+// File bytes sent to readers
+Counter& bytes_read() {
+    static Counter& counter = MetricsRegistry::instance().counter(
+        "mag_file_bytes_read_total", {}, "File content bytes returned by read and read_range");
+    return counter;
+}
+
+// Runs on a pool worker; FileTool orders writes to the same path itself
+NngMessage handle_request(std::string_view request_data, const FileTool& file_tool, ProjectIndex& index,
+                          ServiceMetrics& metrics) {
+    ServiceMetrics::RequestScope scope(metrics, request_data.size());
+    
+    // Reply in whatever encoding the request arrived in
+    WireFormat format = WireCodec::detect(request_data);
     
     try {
-        // Parse the request
-        nlohmann::json request_json = nlohmann::json::parse(request_data);
+        // Parse the request straight from the received message
+        nlohmann::json request_json;
+        {
+            Span parse("parse");
+            request_json = WireCodec::decode(request_data);
+        }
         
         std::string operation = request_json["operation"];
+        scope.set_operation(operation);
+        
+        // Encoded directly into the outgoing message
+        NngMessage response;
+        
+        if (operation == "metrics") {
+            response = NngMessage::encode(MetricsRegistry::instance().to_json(), format);
+            return reply(response, scope);
+        }
+        
+        if (operation == "context") {
+            size_t budget = std::min(request_json.value("budget", size_t{0}), ContextConfig::MAX_BUDGET_TOKENS);
+            ContextSlice slice = index.slice(request_json.value("query", ""), budget);
+            if (!slice.success) {
+                scope.fail();
+            }
+            MessageHandler::serialize_context_slice(slice, format, response);
+            return reply(response, scope);
+        }
+        
+        if (operation == "dry_run_batch" || operation == "apply_batch") {
+            std::vector<WriteFileCommand> commands;
+            try {
+                commands = batch_commands(request_json);
+            } catch (const std::exception& e) {
+                // A malformed batch is refused as a whole, before any item runs
+                if (operation == "dry_run_batch") {
+                    BatchDryRunResult refused;
+                    refused.error_message = e.what();
+                    MessageHandler::serialize_batch_dry_run_result(refused, format, response);
+                } else {
+                    BatchApplyResult refused;
+                    refused.error_message = e.what();
+                    MessageHandler::serialize_batch_apply_result(refused, format, response);
+                }
+                scope.fail();
+                return reply(response, scope);
+            }
+            
+            if (operation == "dry_run_batch") {
+                MessageHandler::serialize_batch_dry_run_result(file_tool.dry_run_batch(commands), format, response);
+            } else {
+                bool all_or_nothing = request_json.value("all_or_nothing", false);
+                BatchApplyResult result = file_tool.apply_batch(commands, all_or_nothing);
+                if (!result.rolled_back) {
+                    for (size_t i = 0; i < result.results.size() && i < commands.size(); ++i) {
+                        if (result.results[i].success && !result.results[i].unchanged) {
+                            bytes_written().add(commands[i].content.size());
+                        }
+                    }
+                }
+                if (!result.success) {
+                    scope.fail();
+                }
+                MessageHandler::serialize_batch_apply_result(result, format, response);
+            }
+            MAG_LOG_DEBUG("file_tool", "Sending " << operation << " result for " << commands.size() << " commands");
+            return reply(response, scope);
+        }
+        
+        if (operation == "write_begin" || operation == "write_chunk" || operation == "write_abort" ||
+            operation == "write_commit" || operation == "dry_run_digest") {
+            FileTransferRequest transfer;
+            transfer.from_json(request_json.at("transfer"));
+            
+            if (operation == "write_commit" || operation == "dry_run_digest") {
+                if (operation == "write_commit") {
+                    ApplyResult result = file_tool.commit_transfer(transfer.transfer_id);
+                    if (result.success && !result.unchanged) {
+                        bytes_written().add(transfer.size);
+                    } else if (!result.success) {
+                        scope.fail();
+                    }
+                    MessageHandler::serialize_apply_result(result, format, response);
+                } else {
+                    MessageHandler::serialize_dry_run_result(
+                        file_tool.dry_run_digest(transfer.path, transfer.size, transfer.hash), format, response);
+                }
+                return reply(response, scope);
+            }
+            
+            FileTransferReply result;
+            if (operation == "write_begin") {
+                result = file_tool.begin_transfer(transfer.path, transfer.size, transfer.hash);
+            } else if (operation == "write_chunk") {
+                // Written straight from the decoded byte field
+                const nlohmann::json& field = request_json.at("data");
+                std::string text;
+                std::string_view data;
+                if (field.is_binary()) {
+                    data = std::string_view(reinterpret_cast<const char*>(field.get_binary().data()),
+                                            field.get_binary().size());
+                } else {
+                    text = field.get<std::string>();
+                    data = text;
+                }
+                result = file_tool.write_chunk(transfer.transfer_id, transfer.offset, data);
+            } else {
+                result.success = file_tool.abort_transfer(transfer.transfer_id);
+                result.transfer_id = transfer.transfer_id;
+            }
+            if (!result.success) {
+                scope.fail();
+            }
+            MessageHandler::serialize_transfer_reply(result, format, response);
+            return reply(response, scope);
+        }
+        
+        if (operation == "read" || operation == "read_range" || operation == "stat") {
+            ReadFileRequest read_request;
+            read_request.from_json(request_json.at("read"));
+            
+            if (operation == "stat") {
+                FileStatResult result = file_tool.stat(read_request.path);
+                if (!result.success) {
+                    scope.fail();
+                }
+                MessageHandler::serialize_stat_result(result, format, response);
+                return reply(response, scope);
+            }
+            if (operation == "read_range" && !read_request.by_lines() && read_request.offset == 0 &&
+                read_request.length == 0) {
+                throw std::runtime_error("read_range needs first_line or offset and length");
+            }
+            
+            // A large slice goes from the file's mapping straight into the reply
+            FileSlice slice = file_tool.read_slice(read_request);
+            if (slice.result.success) {
+                bytes_read().add(slice.content.size());
+            } else {
+                scope.fail();
+            }
+            MessageHandler::serialize_read_result(slice.result, slice.content, format, response);
+            return reply(response, scope);
+        }
+        
         WriteFileCommand command;
         command.from_json(request_json["command"]);
         
-        std::string response;
-        
         if (operation == "dry_run") {
-            DryRunResult result = file_tool.dry_run(command.path, command.content);
-            response = MessageHandler::serialize_dry_run_result(result);
+            DryRunResult result = file_tool.dry_run(command);
+            MessageHandler::serialize_dry_run_result(result, format, response);
         } else if (operation == "apply") {
-            ApplyResult result = file_tool.apply(command.path, command.content);
-            response = MessageHandler::serialize_apply_result(result);
+            ApplyResult result = file_tool.apply(command);
+            if (result.success) {
+                if (!result.unchanged) {
+                    bytes_written().add(command.content.size());
+                }
+            } else {
+                scope.fail();
+            }
+            MessageHandler::serialize_apply_result(result, format, response);
         } else {
             throw std::runtime_error("Unknown operation: " + operation);
         }
         
-        // Send response
-        int rv = nng_send(sock, const_cast<char*>(response.c_str()), response.length(), 0);
-        if (rv != 0) {
-            std::cerr << "nng_send: " << nng_strerror(rv) << std::endl;
-        } else {
-            std::cout << "Sent " << operation << " result" << std::endl;
-        }
+        MAG_LOG_DEBUG("file_tool", "Sending " << operation << " result");
+        return reply(response, scope);
         
     } catch (const std::exception& e) {
-        std::cerr << "Error handling request: " << e.what() << std::endl;
+        MAG_LOG_ERROR("file_tool", "Error handling request: " << e.what());
+        scope.fail();
         
         // Send error response
-        std::string error_response;
-        if (request_data.find("dry_run") != std::string::npos) {
+        NngMessage error_response;
+        if (request_data.find("dry_run") != std::string_view::npos) {
             DryRunResult error_result;
             error_result.success = false;
             error_result.error_message = e.what();
             error_result.description = "";
-            error_response = MessageHandler::serialize_dry_run_result(error_result);
+            MessageHandler::serialize_dry_run_result(error_result, format, error_response);
         } else {
             ApplyResult error_result;
             error_result.success = false;
             error_result.error_message = e.what();
             error_result.description = "";
-            error_response = MessageHandler::serialize_apply_result(error_result);
+            MessageHandler::serialize_apply_result(error_result, format, error_response);
         }
         
-        nng_send(sock, const_cast<char*>(error_response.c_str()), error_response.length(), 0);
+        return reply(error_response, scope);
     }
 }
 
-int main() {
-    nng_socket sock;
-    int rv;
-    
-    // Create NNG reply socket
-    if ((rv = nng_rep0_open(&sock)) != 0) {
-        std::cerr << "nng_rep0_open: " << nng_strerror(rv) << std::endl;
-        return 1;
-    }
-    
-    // Listen on the specified URL
-    std::string url = NetworkConfig::get_file_tool_url();
-    if ((rv = nng_listen(sock, url.c_str(), nullptr, 0)) != 0) {
-        std::cerr << "nng_listen: " << nng_strerror(rv) << std::endl;
-        nng_close(sock);
-        return 1;
+int main(int argc, char* argv[]) {
+    int worker_count = ServiceConfig::get_file_worker_count();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--workers=", 0) == 0) {
+            worker_count = std::max(1, std::atoi(arg.substr(10).c_str()));
+        }
     }
     
-    std::cout << "File Tool listening on " << url << std::endl;
-    
-    // Main service loop
-    while (true) {
-        char* buf = nullptr;
-        size_t sz;
-        
-        // Receive message
-        if ((rv = nng_recv(sock, &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-            std::cerr << "nng_recv: " << nng_strerror(rv) << std::endl;
-            continue;
-        }
+    try {
+        Tracer::instance().set_service_name("file_tool");
+        
+        // Shared by every worker; writes to one path keep their order
+        FileTool file_tool;
+        auto policy = std::make_shared<const PolicyChecker>();
+        file_tool.set_read_policy(policy);
+        // Built on the first "context" request, then kept current
+        ProjectIndex index(".", policy);
+        ServiceMetrics metrics("file_tool");
+        
+        ThreadPool pool(static_cast<size_t>(worker_count));
+        std::string url = NetworkConfig::get_file_tool_url();
+        NNGRepServer server(url, static_cast<size_t>(worker_count) * ServiceConfig::CONTEXTS_PER_WORKER, pool,
+            [&file_tool, &index, &metrics](size_t, std::string_view request) {
+                MAG_LOG_DEBUG("file_tool", "Received " << WireCodec::format_name(WireCodec::detect(request))
+                              << " request of " << request.size() << " bytes");
+                return handle_request(request, file_tool, index, metrics);
+            });
+        server.start();
+        
+        std::cout << "File Tool listening on " << url << " with " << worker_count << " workers and "
+                  << file_tool.io_threads() << " I/O threads" << std::endl;
         
-        std::string request_data(buf, sz);
-        nng_free(buf, sz);
+        // Lets pooled clients find this worker (MAG_WORKER_REGISTRY)
+        auto registration = WorkerRegistration::announce(EndpointConfig::Service::FILE_TOOL, url);
         
-        std::cout << "Received request: " << request_data << std::endl;
+        // Prometheus scrape endpoint (MAG_METRICS_PORT_BASE)
+        auto metrics_server = MetricsServer::start(MetricsConfig::FILE_TOOL_OFFSET);
         
-        handle_request(request_data, sock);
+        // Requests are served from NNG callbacks and the pool
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return 1;
     }
     
-    nng_close(sock);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,118 @@
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace mag {
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to stat " + path + ": " + std::strerror(error));
+    }
+    if (S_ISDIR(st.st_mode)) {
+        ::close(fd);
+        throw std::runtime_error("'" + path + "' is a directory");
+    }
+    
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            mapping_ = static_cast<const char*>(mapping);
+            size_ = static_cast<size_t>(st.st_size);
+            fd_ = fd;
+            return;
+        }
+    }
+    
+    // Nothing to map, or a file whose size stat cannot tell: read it
+    char buffer[65536];
+    while (true) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to read " + path + ": " + std::strerror(error));
+        }
+        if (n == 0) {
+            break;
+        }
+        copy_.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mapping_(std::exchange(other.mapping_, nullptr)), size_(std::exchange(other.size_, 0)),
+      fd_(std::exchange(other.fd_, -1)), copy_(std::move(other.copy_)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        mapping_ = std::exchange(other.mapping_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        fd_ = std::exchange(other.fd_, -1);
+        copy_ = std::move(other.copy_);
+    }
+    return *this;
+}
+
+bool MappedFile::intact() const {
+    if (!mapping_) {
+        return true;
+    }
+    struct stat st {};
+    return ::fstat(fd_, &st) == 0 && static_cast<uint64_t>(st.st_size) >= size_;
+}
+
+std::string MappedFile::read_at(size_t offset, size_t length) const {
+    if (!mapping_) {
+        return offset < copy_.size() ? copy_.substr(offset, length) : std::string();
+    }
+    std::string bytes(length, '\0');
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pread(fd_, bytes.data() + done, length - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    bytes.resize(done);
+    return bytes;
+}
+
+void MappedFile::unmap() {
+    if (mapping_) {
+        ::munmap(const_cast<char*>(mapping_), size_);
+        ::close(fd_);
+        mapping_ = nullptr;
+        size_ = 0;
+        fd_ = -1;
+    }
+}
+
+} // namespace mag
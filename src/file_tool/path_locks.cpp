@@ -0,0 +1,88 @@
+#include "path_locks.h"
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+namespace mag {
+
+namespace {
+
+std::string lock_key(const std::string& path) {
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+    return (ec ? std::filesystem::path(path) : absolute).lexically_normal().string();
+}
+
+} // anonymous namespace
+
+PathLocks::Guard::Guard(Guard&& other) noexcept
+    : owner_(std::exchange(other.owner_, nullptr)), keys_(std::move(other.keys_)) {
+}
+
+PathLocks::Guard& PathLocks::Guard::operator=(Guard&& other) noexcept {
+    if (this != &other) {
+        release();
+        owner_ = std::exchange(other.owner_, nullptr);
+        keys_ = std::move(other.keys_);
+    }
+    return *this;
+}
+
+void PathLocks::Guard::release() {
+    if (owner_) {
+        owner_->unlock(keys_);
+        owner_ = nullptr;
+        keys_.clear();
+    }
+}
+
+PathLocks::Guard PathLocks::lock(const std::vector<std::string>& paths) {
+    std::vector<std::string> keys;
+    keys.reserve(paths.size());
+    for (const auto& path : paths) {
+        keys.push_back(lock_key(path));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::vector<std::pair<Queue*, uint64_t>> tickets;
+    tickets.reserve(keys.size());
+    for (const auto& key : keys) {
+        Queue& queue = queues_[key]; // node-based map, so the pointer stays valid
+        tickets.emplace_back(&queue, queue.next_ticket++);
+    }
+    released_.wait(lock, [&tickets] {
+        return std::all_of(tickets.begin(), tickets.end(),
+                           [](const auto& ticket) { return ticket.first->serving == ticket.second; });
+    });
+    
+    Guard guard;
+    guard.owner_ = this;
+    guard.keys_ = std::move(keys);
+    return guard;
+}
+
+size_t PathLocks::queued(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(lock_key(path));
+    return it == queues_.end() ? 0 : static_cast<size_t>(it->second.next_ticket - it->second.serving);
+}
+
+void PathLocks::unlock(const std::vector<std::string>& keys) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& key : keys) {
+            auto it = queues_.find(key);
+            if (it == queues_.end()) {
+                continue;
+            }
+            if (++it->second.serving == it->second.next_ticket) {
+                queues_.erase(it); // nobody waiting
+            }
+        }
+    }
+    released_.notify_all();
+}
+
+} // namespace mag
@@ -0,0 +1,924 @@
+#include "project_index.h"
+#include "logger.h"
+#include "token_counter.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace mag {
+
+namespace {
+
+constexpr size_t BINARY_PROBE_BYTES = 8192;   // a NUL byte in here marks a binary file
+constexpr size_t READ_CHUNK_BYTES = 64 * 1024; // files are read this much at a time
+constexpr size_t MAX_SYMBOL_CHARS = 120;
+constexpr size_t SLICE_SYMBOLS_PER_FILE = 12; // so one big file can't take the whole budget
+constexpr size_t SLICE_CANDIDATES = 50;
+constexpr size_t SUMMARY_LANGUAGES = 6;
+constexpr size_t SUMMARY_TOP_LEVEL = 16;
+constexpr int POLL_INTERVAL_MS = 250;         // how soon the watcher notices stop()
+
+// Dependency and build output directories, whatever they hold
+const std::set<std::string, std::less<>> SKIPPED_DIRECTORIES = {
+    "node_modules", "__pycache__", "target", "dist", "venv"
+};
+
+// Words too common in prompts to say anything about which files matter
+const std::set<std::string, std::less<>> STOP_WORDS = {
+    "add", "all", "also", "and", "are", "but", "can", "change", "code", "file", "files", "fix", "for",
+    "from", "has", "have", "into", "make", "new", "not", "our", "please", "should", "some", "that",
+    "the", "them", "then", "this", "update", "use", "was", "when", "with", "you"
+};
+
+// C-family lines that start like a declaration but are statements
+const std::set<std::string, std::less<>> STATEMENT_KEYWORDS = {
+    "break", "case", "co_await", "co_return", "co_yield", "continue", "default", "delete", "do", "else",
+    "for", "goto", "if", "new", "return", "sizeof", "static_assert", "switch", "throw", "typedef",
+    "using", "while"
+};
+
+const std::set<std::string, std::less<>> TYPE_KEYWORDS = {
+    "class", "enum", "interface", "record", "struct", "union"
+};
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+std::string lowercase(std::string_view text) {
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower;
+}
+
+// Lowercase without '_' and '-', so project_index, ProjectIndex and project-index compare equal
+std::string normalized(std::string_view text) {
+    std::string result;
+    result.reserve(text.size());
+    for (unsigned char c : text) {
+        if (c != '_' && c != '-') {
+            result += static_cast<char>(std::tolower(c));
+        }
+    }
+    return result;
+}
+
+bool contains_ignoring_case(std::string_view haystack, std::string_view lower_needle) {
+    auto it = std::search(haystack.begin(), haystack.end(), lower_needle.begin(), lower_needle.end(),
+                          [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+    return it != haystack.end();
+}
+
+std::string join(const std::string& directory, std::string_view name) {
+    return directory.empty() ? std::string(name) : directory + "/" + std::string(name);
+}
+
+bool within(const std::string& path, const std::string& directory) {
+    return directory.empty() ||
+           (path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0 &&
+            path[directory.size()] == '/');
+}
+
+std::string_view file_name(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+bool hidden(std::string_view path) {
+    return file_name(path).substr(0, 1) == ".";
+}
+
+std::string_view trim(std::string_view text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+size_t indentation(std::string_view line) {
+    size_t width = 0;
+    for (char c : line) {
+        if (c == ' ') {
+            ++width;
+        } else if (c == '\t') {
+            width += 4;
+        } else {
+            break;
+        }
+    }
+    return width;
+}
+
+bool starts_with_any(std::string_view text, std::initializer_list<std::string_view> prefixes) {
+    for (std::string_view prefix : prefixes) {
+        if (text.substr(0, prefix.size()) == prefix) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string_view> words(std::string_view text) {
+    std::vector<std::string_view> result;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t first = text.find_first_not_of(" \t", start);
+        if (first == std::string_view::npos) {
+            break;
+        }
+        size_t end = text.find_first_of(" \t", first);
+        end = end == std::string_view::npos ? text.size() : end;
+        result.push_back(text.substr(first, end - first));
+        start = end;
+    }
+    return result;
+}
+
+// The signature part of a declaration line, shortened to MAX_SYMBOL_CHARS
+std::string signature(std::string_view line, std::string_view cut_at = "{") {
+    size_t cut = line.find_first_of(cut_at);
+    std::string_view kept = trim(line.substr(0, cut));
+    while (!kept.empty() && (kept.back() == ';' || kept.back() == ',' || kept.back() == ':')) {
+        kept = trim(kept.substr(0, kept.size() - 1));
+    }
+    if (kept.size() > MAX_SYMBOL_CHARS) {
+        return std::string(kept.substr(0, MAX_SYMBOL_CHARS - 3)) + "...";
+    }
+    return std::string(kept);
+}
+
+// Parameters that declare something ("int x", "const T&", "") rather than pass values ("x", "a.b()")
+bool declares_parameters(std::string_view parameters) {
+    // Split at the top-level commas, up to the ')' that closes the list
+    std::vector<std::string_view> list;
+    int depth = 0;
+    size_t start = 0;
+    size_t i = 0;
+    for (; i < parameters.size(); ++i) {
+        char c = parameters[i];
+        if (c == '(' || c == '<' || c == '[' || c == '{') {
+            ++depth;
+        } else if ((c == ')' || c == '>' || c == ']' || c == '}') && depth > 0) {
+            --depth;
+        } else if (c == ')') {
+            break;
+        } else if (c == ',' && depth == 0) {
+            list.push_back(trim(parameters.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+    list.push_back(trim(parameters.substr(start, i - start)));
+
+    if (list.size() == 1 && (list[0].empty() || list[0] == "void")) {
+        return true;
+    }
+    for (std::string_view parameter : list) {
+        if (parameter.find_first_of(" &*") == std::string_view::npos ||
+            parameter.find_first_of(".\"'") != std::string_view::npos || parameter.find("->") != std::string_view::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A class or function declaration in C, C++, Java, C# and the like
+std::optional<std::string> c_family_symbol(std::string_view line) {
+    if (indentation(line) > 4) {
+        return std::nullopt;
+    }
+    std::string_view text = trim(line);
+    if (text.empty() || starts_with_any(text, {"//", "/*", "*", "#", "@", "template", "}"})) {
+        return std::nullopt;
+    }
+
+    size_t paren = text.find('(');
+    std::vector<std::string_view> head = words(text.substr(0, paren));
+    if (head.empty() || STATEMENT_KEYWORDS.count(head.front())) {
+        return std::nullopt;
+    }
+    for (std::string_view word : head) {
+        if (TYPE_KEYWORDS.count(word)) {
+            // A forward declaration says nothing the definition won't
+            if (text.back() == ';' && text.find('{') == std::string_view::npos) {
+                return std::nullopt;
+            }
+            return signature(text);
+        }
+    }
+    if (paren == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    std::string_view prefix = text.substr(0, paren);
+    if (prefix.find_first_of("=.\"!?") != std::string_view::npos || prefix.find("<<") != std::string_view::npos ||
+        prefix.find("->") != std::string_view::npos) {
+        return std::nullopt;
+    }
+    std::string_view name = head.back();
+    bool qualified = name.find("::") != std::string_view::npos;
+    if (head.size() < 2 && !qualified) {
+        return std::nullopt; // a call, or a macro
+    }
+    if (!declares_parameters(text.substr(paren + 1))) {
+        return std::nullopt; // a variable constructed from values
+    }
+    return signature(text);
+}
+
+std::optional<std::string> keyword_symbol(std::string_view line, size_t max_indent,
+                                          std::initializer_list<std::string_view> keywords,
+                                          std::string_view cut_at) {
+    if (indentation(line) > max_indent) {
+        return std::nullopt;
+    }
+    std::string_view text = trim(line);
+    if (!starts_with_any(text, keywords)) {
+        return std::nullopt;
+    }
+    return signature(text, cut_at);
+}
+
+std::optional<std::string> outline_line(std::string_view line, std::string_view language) {
+    if (language == "c" || language == "cpp" || language == "java" || language == "csharp") {
+        return c_family_symbol(line);
+    }
+    if (language == "python") {
+        return keyword_symbol(line, 4, {"def ", "async def ", "class "}, "");
+    }
+    if (language == "go") {
+        return keyword_symbol(line, 0, {"func ", "type "}, "{");
+    }
+    if (language == "rust") {
+        std::string_view text = trim(line);
+        for (std::string_view visibility : {"pub(crate) ", "pub "}) {
+            if (text.substr(0, visibility.size()) == visibility) {
+                text = text.substr(visibility.size());
+            }
+        }
+        if (indentation(line) <= 4 &&
+            starts_with_any(text, {"fn ", "async fn ", "struct ", "enum ", "trait ", "impl", "mod ", "type "})) {
+            return signature(trim(line), "{");
+        }
+        return std::nullopt;
+    }
+    if (language == "javascript" || language == "typescript") {
+        return keyword_symbol(line, 0, {"function ", "async function ", "class ", "export ", "interface ", "type "},
+                              "{");
+    }
+    if (language == "kotlin" || language == "swift") {
+        std::string_view text = trim(line);
+        for (std::string_view word : words(text)) {
+            if (word == "fun" || word == "func" || word == "class" || word == "interface" || word == "object" ||
+                word == "struct" || word == "protocol" || word == "enum") {
+                return indentation(line) <= 4 ? std::optional<std::string>(signature(text, "{=")) : std::nullopt;
+            }
+            if (word.find('(') != std::string_view::npos || word == "=") {
+                break;
+            }
+        }
+        return std::nullopt;
+    }
+    if (language == "ruby") {
+        return keyword_symbol(line, 4, {"def ", "class ", "module "}, "");
+    }
+    if (language == "shell") {
+        std::string_view text = trim(line);
+        if (indentation(line) == 0 && (text.substr(0, 9) == "function " ||
+            (text.find("()") != std::string_view::npos && text.back() == '{' && text.find(' ') == text.find("()") + 2))) {
+            return signature(text);
+        }
+        return std::nullopt;
+    }
+    if (language == "markdown") {
+        return line.substr(0, 1) == "#" ? std::optional<std::string>(signature(line, "")) : std::nullopt;
+    }
+    if (language == "cmake") {
+        std::string_view text = trim(line);
+        if (starts_with_any(text, {"project(", "add_library(", "add_executable(", "function(", "macro("})) {
+            size_t open = text.find('(');
+            size_t end = text.find_first_of(" )", open + 1);
+            return std::string(text.substr(0, std::min(end, text.size()))) + ")";
+        }
+        return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+// The words of a prompt worth matching against paths and symbols
+std::vector<std::string> query_terms(const std::string& query) {
+    std::vector<std::string> terms;
+    std::string word;
+    auto flush = [&]() {
+        std::string lower = lowercase(word);
+        if (lower.size() >= 3 && !STOP_WORDS.count(lower) &&
+            std::find(terms.begin(), terms.end(), lower) == terms.end()) {
+            terms.push_back(std::move(lower));
+        }
+        word.clear();
+    };
+    for (unsigned char c : query) {
+        if (std::isalnum(c) || c == '_') {
+            word += static_cast<char>(c);
+        } else {
+            flush();
+        }
+    }
+    flush();
+    return terms;
+}
+
+} // anonymous namespace
+
+ProjectIndex::ProjectIndex(std::string root, std::shared_ptr<const PolicyChecker> policy)
+    : root_(root.empty() ? "." : std::move(root)), policy_(std::move(policy)) {}
+
+ProjectIndex::~ProjectIndex() {
+    stop();
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+    }
+#endif
+}
+
+void ProjectIndex::start() {
+    std::lock_guard<std::mutex> lock(refresh_mutex_);
+    if (started_) {
+        return;
+    }
+    started_ = true;
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        MAG_LOG_WARN("file_tool", "inotify unavailable (" << std::strerror(errno) << "); project index will rescan");
+    }
+#endif
+    update(walk(""), "", false);
+    MAG_LOG_INFO("file_tool", "Indexed " << size() << " files under " << root_
+                 << (watching() ? ", following changes with inotify"
+                                : ", rescanning every " + std::to_string(ContextConfig::RESCAN_SECONDS) + "s"));
+    watcher_ = std::thread([this] { watch_loop(); });
+}
+
+void ProjectIndex::stop() {
+    stopping_ = true;
+    wait_cv_.notify_all();
+    if (watcher_.joinable()) {
+        watcher_.join();
+    }
+}
+
+void ProjectIndex::refresh() {
+    std::lock_guard<std::mutex> lock(refresh_mutex_);
+    if (started_) {
+        refresh_locked();
+    }
+}
+
+void ProjectIndex::watch_loop() {
+    while (!stopping_) {
+        bool changed = true;
+#ifdef __linux__
+        if (watching()) {
+            pollfd events{inotify_fd_, POLLIN, 0};
+            changed = ::poll(&events, 1, POLL_INTERVAL_MS) > 0;
+        } else
+#endif
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex_);
+            wait_cv_.wait_for(lock, std::chrono::seconds(ContextConfig::RESCAN_SECONDS),
+                              [this] { return stopping_.load(); });
+        }
+        if (changed && !stopping_) {
+            try {
+                refresh();
+            } catch (const std::exception& e) {
+                MAG_LOG_ERROR("file_tool", "Project index refresh failed: " << e.what());
+            }
+        }
+    }
+}
+
+void ProjectIndex::refresh_locked() {
+    drain_events();
+    if (!watching() || rescan_) {
+        rescan_ = false;
+        changed_files_.clear();
+        changed_directories_.clear();
+        update(walk(""), "", false);
+        return;
+    }
+
+    std::set<std::string> directories;
+    directories.swap(changed_directories_);
+    std::set<std::string> files;
+    files.swap(changed_files_);
+
+    std::string last;
+    for (const std::string& directory : directories) {
+        if (!last.empty() && within(directory, last)) {
+            continue; // walked with its parent
+        }
+        last = directory;
+        update(walk(directory), directory, false);
+        unwatch_missing(directory);
+    }
+
+    // A changed file may still hold its old size and mtime (a rewrite within one tick), so it is always read
+    std::map<std::string, Stat> found;
+    std::vector<std::string> gone;
+    for (const std::string& path : files) {
+        if (std::any_of(directories.begin(), directories.end(),
+                        [&path](const std::string& directory) { return within(path, directory); })) {
+            continue;
+        }
+        struct stat st;
+        if (!hidden(path) && ::stat(absolute(path).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            found[path] = Stat{static_cast<uint64_t>(st.st_size), mtime_ns(st)};
+        } else {
+            gone.push_back(path);
+        }
+    }
+    if (!found.empty() || !gone.empty()) {
+        update(found, gone, true);
+    }
+}
+
+void ProjectIndex::drain_events() {
+#ifdef __linux__
+    if (inotify_fd_ < 0) {
+        return;
+    }
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = ::read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return; // drained (EAGAIN)
+        }
+        for (char* next = buffer; next < buffer + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(next);
+            next += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan_ = true;
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(watch);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                changed_directories_.insert(watch->second);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            std::string path = join(watch->second, event->name);
+            if (event->mask & IN_ISDIR) {
+                changed_directories_.insert(path);
+            } else {
+                changed_files_.insert(path);
+            }
+        }
+    }
+#endif
+}
+
+std::string ProjectIndex::absolute(const std::string& relative) const {
+    if (relative.empty()) {
+        return root_;
+    }
+    return (std::filesystem::path(root_) / relative).lexically_normal().string();
+}
+
+bool ProjectIndex::skipped_directory(const std::string& relative) const {
+    if (relative.empty()) {
+        return false;
+    }
+    std::string_view name = file_name(relative);
+    if (hidden(name) || SKIPPED_DIRECTORIES.count(name)) {
+        return true;
+    }
+    std::error_code ec;
+    return std::filesystem::exists(std::filesystem::path(absolute(relative)) / "CMakeCache.txt", ec);
+}
+
+bool ProjectIndex::allowed(const std::string& relative) const {
+    return !policy_ || policy_->is_allowed("file_tool", Operation::READ, absolute(relative));
+}
+
+void ProjectIndex::watch(const std::string& directory) {
+#ifdef __linux__
+    if (!watching()) {
+        return;
+    }
+    int wd = inotify_add_watch(inotify_fd_, absolute(directory).c_str(),
+                               IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                               IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (wd >= 0) {
+        watches_[wd] = directory;
+    } else if (errno == ENOSPC) {
+        watch_limit_reached_ = true;
+        MAG_LOG_WARN("file_tool", "inotify watch limit reached; project index will rescan every "
+                     << ContextConfig::RESCAN_SECONDS << "s instead");
+    }
+#else
+    (void)directory;
+#endif
+}
+
+void ProjectIndex::unwatch_missing(const std::string& directory) {
+#ifdef __linux__
+    std::error_code ec;
+    if (inotify_fd_ < 0 || std::filesystem::is_directory(absolute(directory), ec)) {
+        return;
+    }
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (it->second == directory || within(it->second, directory)) {
+            inotify_rm_watch(inotify_fd_, it->first);
+            it = watches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#else
+    (void)directory;
+#endif
+}
+
+std::map<std::string, ProjectIndex::Stat> ProjectIndex::walk(const std::string& directory) {
+    std::map<std::string, Stat> found;
+    std::error_code ec;
+    if (skipped_directory(directory) || !std::filesystem::is_directory(absolute(directory), ec)) {
+        return found;
+    }
+    watch(directory);
+
+    std::filesystem::path base(absolute(directory));
+    std::filesystem::recursive_directory_iterator it(
+        base, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::string relative = join(directory, it->path().lexically_relative(base).generic_string());
+        std::error_code type_ec;
+        if (it->is_directory(type_ec)) {
+            if (skipped_directory(relative)) {
+                it.disable_recursion_pending();
+            } else {
+                watch(relative);
+            }
+            continue;
+        }
+        if (hidden(relative) || !it->is_regular_file(type_ec)) {
+            continue;
+        }
+        if (found.size() >= ContextConfig::MAX_FILES) {
+            MAG_LOG_WARN("file_tool", "Project index stops at " << ContextConfig::MAX_FILES << " files");
+            break;
+        }
+        struct stat st;
+        if (::stat(it->path().c_str(), &st) == 0) {
+            found[relative] = Stat{static_cast<uint64_t>(st.st_size), mtime_ns(st)};
+        }
+    }
+    return found;
+}
+
+void ProjectIndex::update(const std::map<std::string, Stat>& found, const std::string& scope, bool force) {
+    std::string subtree = scope.empty() ? scope : scope + "/"; // "src-old/..." sorts between "src" and "src/"
+    std::vector<std::string> gone;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = files_.lower_bound(subtree); it != files_.end() && (scope.empty() || within(it->first, scope));
+             ++it) {
+            if (!found.count(it->first)) {
+                gone.push_back(it->first);
+            }
+        }
+        for (auto it = unindexed_.lower_bound(subtree);
+             it != unindexed_.end() && (scope.empty() || within(it->first, scope)); ++it) {
+            if (!found.count(it->first)) {
+                gone.push_back(it->first);
+            }
+        }
+    }
+    update(found, gone, force);
+}
+
+void ProjectIndex::update(const std::map<std::string, Stat>& found, const std::vector<std::string>& gone, bool force) {
+    // Work out what to read while holding the lock, then read without it
+    std::vector<std::pair<std::string, Stat>> stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [path, stat] : found) {
+            auto known = files_.find(path);
+            auto passed_over = unindexed_.find(path);
+            bool unchanged = known != files_.end()
+                ? known->second.size == stat.size && known->second.mtime_ns == stat.mtime_ns
+                : passed_over != unindexed_.end() && passed_over->second.size == stat.size &&
+                  passed_over->second.mtime_ns == stat.mtime_ns;
+            if (force || !unchanged) {
+                stale.emplace_back(path, stat);
+            }
+        }
+    }
+
+    std::vector<IndexedFile> loaded;
+    std::vector<std::pair<std::string, Stat>> rejected;
+    for (const auto& [path, stat] : stale) {
+        std::optional<IndexedFile> file = allowed(path) ? load(path, stat) : std::nullopt;
+        if (file) {
+            loaded.push_back(std::move(*file));
+        } else {
+            rejected.emplace_back(path, stat);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::string& path : gone) {
+        files_.erase(path);
+        unindexed_.erase(path);
+    }
+    for (const auto& [path, stat] : rejected) {
+        files_.erase(path);
+        unindexed_[path] = stat;
+    }
+    for (IndexedFile& file : loaded) {
+        auto known = files_.find(file.path);
+        unindexed_.erase(file.path);
+        if (known != files_.end()) {
+            known->second = std::move(file);
+        } else if (files_.size() < ContextConfig::MAX_FILES) {
+            std::string path = file.path;
+            files_.emplace(std::move(path), std::move(file));
+        }
+    }
+}
+
+std::optional<IndexedFile> ProjectIndex::load(const std::string& relative, const Stat& stat) {
+    // Read in chunks with pread, not mmap: a file is often indexed while an
+    // editor is still writing it, and a mapping truncated underneath us would
+    // raise SIGBUS. Only files small enough to outline are kept whole.
+    int fd = ::open(absolute(relative).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt; // gone, or not readable
+    }
+    files_read_.fetch_add(1, std::memory_order_relaxed);
+
+    IndexedFile file;
+    file.path = relative;
+    file.language = language_of(relative);
+    file.size = stat.size;
+    file.mtime_ns = stat.mtime_ns;
+    const bool outlined = !file.language.empty() && stat.size <= ContextConfig::MAX_OUTLINE_BYTES;
+
+    std::string content; // the whole file when outlined
+    std::string chunk(READ_CHUNK_BYTES, '\0');
+    uint64_t offset = 0;
+    bool read_failed = false;
+    char last = '\n';
+    while (true) {
+        ssize_t n = ::pread(fd, chunk.data(), chunk.size(), static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            read_failed = n < 0;
+            break;
+        }
+        std::string_view bytes(chunk.data(), static_cast<size_t>(n));
+        if (offset < BINARY_PROBE_BYTES &&
+            bytes.substr(0, BINARY_PROBE_BYTES - offset).find('\0') != std::string_view::npos) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        // Chained per chunk, so equal content still hashes equal
+        file.hash = Utils::hash64(bytes, file.hash);
+        file.lines += static_cast<size_t>(std::count(bytes.begin(), bytes.end(), '\n'));
+        last = bytes.back();
+        if (outlined && content.size() < ContextConfig::MAX_OUTLINE_BYTES) {
+            content.append(bytes.substr(0, ContextConfig::MAX_OUTLINE_BYTES - content.size()));
+        }
+        offset += static_cast<uint64_t>(n);
+    }
+    ::close(fd);
+    if (read_failed) {
+        return std::nullopt;
+    }
+    file.lines += last != '\n' ? 1 : 0;
+    if (outlined) {
+        file.symbols = outline(content, file.language);
+    }
+    return file;
+}
+
+std::optional<IndexedFile> ProjectIndex::find(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    if (it == files_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+size_t ProjectIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return files_.size();
+}
+
+std::string ProjectIndex::language_of(std::string_view path) {
+    std::string_view name = file_name(path);
+    if (name == "CMakeLists.txt") {
+        return "cmake";
+    }
+    if (name == "Makefile" || name == "GNUmakefile") {
+        return "make";
+    }
+    if (name == "Dockerfile") {
+        return "docker";
+    }
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) {
+        return "";
+    }
+    static const std::map<std::string, std::string, std::less<>> LANGUAGES = {
+        {"c", "c"}, {"h", "cpp"}, {"cc", "cpp"}, {"cpp", "cpp"}, {"cxx", "cpp"}, {"hh", "cpp"}, {"hpp", "cpp"},
+        {"hxx", "cpp"}, {"inl", "cpp"}, {"ipp", "cpp"}, {"py", "python"}, {"js", "javascript"},
+        {"jsx", "javascript"}, {"mjs", "javascript"}, {"cjs", "javascript"}, {"ts", "typescript"},
+        {"tsx", "typescript"}, {"go", "go"}, {"rs", "rust"}, {"java", "java"}, {"kt", "kotlin"},
+        {"kts", "kotlin"}, {"cs", "csharp"}, {"swift", "swift"}, {"rb", "ruby"}, {"sh", "shell"},
+        {"bash", "shell"}, {"zsh", "shell"}, {"md", "markdown"}, {"markdown", "markdown"}, {"json", "json"},
+        {"yaml", "yaml"}, {"yml", "yaml"}, {"toml", "toml"}, {"cmake", "cmake"}, {"proto", "protobuf"},
+        {"sql", "sql"}, {"html", "html"}, {"css", "css"}, {"txt", "text"}
+    };
+    auto language = LANGUAGES.find(lowercase(name.substr(dot + 1)));
+    return language == LANGUAGES.end() ? "" : language->second;
+}
+
+std::vector<std::string> ProjectIndex::outline(std::string_view content, std::string_view language,
+                                               size_t max_symbols) {
+    std::vector<std::string> symbols;
+    bool in_fence = false; // markdown code blocks hold '#' comments, not headings
+    size_t start = 0;
+    while (start < content.size() && symbols.size() < max_symbols) {
+        size_t end = content.find('\n', start);
+        end = end == std::string_view::npos ? content.size() : end;
+        std::string_view line = content.substr(start, end - start);
+        start = end + 1;
+
+        if (language == "markdown" && trim(line).substr(0, 3) == "```") {
+            in_fence = !in_fence;
+            continue;
+        }
+        if (in_fence) {
+            continue;
+        }
+        std::optional<std::string> symbol = outline_line(line, language);
+        if (symbol && !symbol->empty()) {
+            symbols.push_back(std::move(*symbol));
+        }
+    }
+    return symbols;
+}
+
+ContextSlice ProjectIndex::slice(const std::string& query, size_t budget_tokens) {
+    start();
+    budget_tokens = std::min(budget_tokens, ContextConfig::MAX_BUDGET_TOKENS);
+    std::shared_ptr<const TokenCounter> counter = HeuristicTokenCounter::shared();
+    std::vector<std::string> terms = query_terms(query);
+    std::string lower_query = lowercase(query);
+
+    ContextSlice slice;
+    slice.success = true;
+    std::string text;
+    auto fits = [&](const std::string& line) {
+        size_t tokens = counter->count(line);
+        if (slice.tokens + tokens > budget_tokens) {
+            return false;
+        }
+        text += line;
+        slice.tokens += tokens;
+        return true;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The shape of the tree: languages, then what sits at the top level
+    std::map<std::string, size_t> languages;
+    std::map<std::string, size_t> top_level;
+    for (const auto& [path, file] : files_) {
+        if (!file.language.empty() && file.language != "text") {
+            ++languages[file.language];
+        }
+        size_t slash = path.find('/');
+        ++top_level[slash == std::string::npos ? path : path.substr(0, slash + 1)];
+    }
+    std::vector<std::pair<std::string, size_t>> by_count(languages.begin(), languages.end());
+    std::stable_sort(by_count.begin(), by_count.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::string summary = "Project: " + std::to_string(files_.size()) + " files";
+    for (size_t i = 0; i < by_count.size() && i < SUMMARY_LANGUAGES; ++i) {
+        summary += (i == 0 ? " (" : ", ") + by_count[i].first + " " + std::to_string(by_count[i].second);
+    }
+    summary += by_count.empty() ? "\n" : ")\n";
+    std::string layout = "Top level:";
+    size_t listed = 0;
+    for (const auto& [entry, count] : top_level) {
+        if (listed++ == SUMMARY_TOP_LEVEL) {
+            layout += " ...";
+            break;
+        }
+        layout += (listed == 1 ? " " : ", ") + entry + (entry.back() == '/' ? " (" + std::to_string(count) + ")" : "");
+    }
+    if (!fits(summary) || !fits(layout + "\n")) {
+        slice.context = std::move(text);
+        return slice;
+    }
+
+    // Rank files by how well their path and symbols match the prompt
+    std::vector<std::pair<int, const IndexedFile*>> ranked;
+    for (const auto& [path, file] : files_) {
+        std::string_view name = file_name(path);
+        std::string stem = normalized(name.substr(0, name.find('.')));
+        int score = 0;
+        if (lower_query.find(lowercase(path)) != std::string::npos) {
+            score += 20;
+        } else if (name.size() >= 4 && lower_query.find(lowercase(name)) != std::string::npos) {
+            score += 10;
+        }
+        for (const std::string& term : terms) {
+            std::string wanted = normalized(term);
+            if (stem == wanted) {
+                score += 6;
+            } else if (!wanted.empty() && stem.find(wanted) != std::string::npos) {
+                score += 3;
+            } else if (contains_ignoring_case(path.substr(0, path.size() - name.size()), term)) {
+                score += 2;
+            }
+            int hits = 0;
+            for (const std::string& symbol : file.symbols) {
+                if (hits < 3 && contains_ignoring_case(symbol, term)) {
+                    ++hits;
+                }
+            }
+            score += hits;
+        }
+        if (score > 0) {
+            ranked.emplace_back(score, &file);
+        }
+    }
+    size_t candidates = std::min(ranked.size(), SLICE_CANDIDATES);
+    std::partial_sort(ranked.begin(), ranked.begin() + candidates, ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second->path < b.second->path;
+    });
+
+    for (size_t i = 0; i < candidates; ++i) {
+        const IndexedFile& file = *ranked[i].second;
+        std::string heading = (slice.files == 0 ? "Relevant files:\n" : "") + file.path + " (" +
+                              (file.language.empty() ? "" : file.language + ", ") +
+                              std::to_string(file.lines) + " lines)\n";
+        if (!fits(heading)) {
+            break;
+        }
+        ++slice.files;
+
+        // Symbols the prompt mentions first, then the rest in file order
+        std::vector<const std::string*> symbols;
+        for (const std::string& symbol : file.symbols) {
+            if (std::any_of(terms.begin(), terms.end(),
+                            [&symbol](const std::string& term) { return contains_ignoring_case(symbol, term); })) {
+                symbols.push_back(&symbol);
+            }
+        }
+        for (const std::string& symbol : file.symbols) {
+            if (std::find(symbols.begin(), symbols.end(), &symbol) == symbols.end()) {
+                symbols.push_back(&symbol);
+            }
+        }
+        for (size_t s = 0; s < symbols.size() && s < SLICE_SYMBOLS_PER_FILE; ++s) {
+            if (!fits("  " + *symbols[s] + "\n")) {
+                break;
+            }
+        }
+    }
+
+    slice.context = std::move(text);
+    return slice;
+}
+
+} // namespace mag
@@ -0,0 +1,210 @@
+#include "hedged_planner.h"
+#include "config.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <stdexcept>
+#include <thread>
+
+namespace mag {
+
+// ---------------------------------------------------------------------------
+// LatencyTracker
+
+LatencyTracker::LatencyTracker(size_t window_size) : window_size_(std::max<size_t>(1, window_size)) {
+    samples_.reserve(window_size_);
+}
+
+void LatencyTracker::record(std::chrono::milliseconds latency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (samples_.size() < window_size_) {
+        samples_.push_back(latency);
+    } else {
+        samples_[next_] = latency;
+    }
+    next_ = (next_ + 1) % window_size_;
+}
+
+std::optional<std::chrono::milliseconds> LatencyTracker::percentile(double p) const {
+    std::vector<std::chrono::milliseconds> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (samples_.empty()) {
+            return std::nullopt;
+        }
+        sorted = samples_;
+    }
+    p = std::clamp(p, 0.0, 100.0);
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    size_t index = rank == 0 ? 0 : rank - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+size_t LatencyTracker::sample_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return samples_.size();
+}
+
+// ---------------------------------------------------------------------------
+// HedgedPlanner
+
+namespace {
+
+// State shared between the coordinating thread and racing attempts
+struct Race {
+    explicit Race(size_t attempts) : settled(attempts, false), latencies(attempts) {}
+    
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::optional<HedgedPlanResult> winner;
+    size_t failures = 0;
+    std::string last_error;
+    std::vector<bool> settled; // per attempt: it returned or threw
+    std::vector<std::optional<std::chrono::milliseconds>> latencies; // of valid plans not served from cache
+};
+
+} // namespace
+
+HedgedPlanner::HedgedPlanner(std::vector<std::string> providers, PlanAttempt attempt,
+                             double percentile, size_t max_attempts)
+    : providers_(std::move(providers))
+    , attempt_(std::move(attempt))
+    , percentile_(percentile)
+    , max_attempts_(std::max<size_t>(1, max_attempts)) {
+    if (providers_.empty()) {
+        throw std::runtime_error("HedgedPlanner needs at least one provider");
+    }
+}
+
+LatencyTracker& HedgedPlanner::tracker_for(const std::string& provider) {
+    std::lock_guard<std::mutex> lock(trackers_mutex_);
+    auto& tracker = trackers_[provider];
+    if (!tracker) {
+        tracker = std::make_unique<LatencyTracker>(HedgeConfig::WINDOW_SIZE);
+    }
+    return *tracker;
+}
+
+void HedgedPlanner::record_latency(const std::string& provider, std::chrono::milliseconds latency) {
+    tracker_for(provider).record(latency);
+}
+
+std::chrono::milliseconds HedgedPlanner::hedge_delay(const std::string& provider) {
+    LatencyTracker& tracker = tracker_for(provider);
+    if (tracker.sample_count() < HedgeConfig::MIN_SAMPLES) {
+        return std::chrono::milliseconds(HedgeConfig::INITIAL_DELAY_MS);
+    }
+    auto observed = tracker.percentile(percentile_).value_or(std::chrono::milliseconds(HedgeConfig::INITIAL_DELAY_MS));
+    return std::clamp(observed, std::chrono::milliseconds(HedgeConfig::MIN_DELAY_MS),
+                      std::chrono::milliseconds(HedgeConfig::MAX_DELAY_MS));
+}
+
+HedgedPlanResult HedgedPlanner::plan(const std::string& user_prompt, const std::string& primary) {
+    std::vector<std::string> order = providers_;
+    if (!primary.empty()) {
+        order.erase(std::remove(order.begin(), order.end(), primary), order.end());
+        order.insert(order.begin(), primary);
+    }
+    size_t max_attempts = std::min(order.size(), max_attempts_);
+    
+    auto race = std::make_shared<Race>(max_attempts);
+    CancellationToken cancel;
+    std::vector<std::thread> attempts;
+    std::vector<std::chrono::steady_clock::time_point> started;
+    
+    auto launch = [&](size_t index) {
+        started.push_back(std::chrono::steady_clock::now());
+        attempts.emplace_back([this, race, cancel, user_prompt, index, provider = order[index], hedged = index > 0]() {
+            auto begin = std::chrono::steady_clock::now();
+            try {
+                ResponseMetadata metadata;
+                WriteFileCommand command = attempt_(provider, user_prompt, cancel, &metadata);
+                if (command.command.empty()) {
+                    throw std::runtime_error("response did not contain a command");
+                }
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - begin);
+                std::lock_guard<std::mutex> lock(race->mutex);
+                race->settled[index] = true;
+                if (!metadata.cache_hit) {
+                    race->latencies[index] = elapsed;
+                }
+                if (!race->winner) {
+                    race->winner = HedgedPlanResult{command, provider, hedged, metadata.cache_hit, elapsed, metadata.usage};
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                race->settled[index] = true;
+                ++race->failures;
+                race->last_error = provider + ": " + e.what();
+            }
+            race->cv.notify_all();
+        });
+    };
+    
+    size_t launched = 0;
+    launch(launched++);
+    auto next_hedge_at = std::chrono::steady_clock::now() + hedge_delay(order[0]);
+    
+    {
+        std::unique_lock<std::mutex> lock(race->mutex);
+        while (!race->winner) {
+            bool all_failed = race->failures == launched;
+            bool can_hedge = launched < max_attempts;
+            if (can_hedge && (all_failed || std::chrono::steady_clock::now() >= next_hedge_at)) {
+                MAG_LOG_INFO("llm", "Hedging plan request to " << order[launched]
+                             << (all_failed ? " after failure" : " after stall"));
+                lock.unlock();
+                launch(launched);
+                next_hedge_at = std::chrono::steady_clock::now() + hedge_delay(order[launched]);
+                ++launched;
+                lock.lock();
+                continue;
+            }
+            if (all_failed) {
+                break;
+            }
+            if (can_hedge) {
+                race->cv.wait_until(lock, next_hedge_at);
+            } else {
+                race->cv.wait(lock);
+            }
+        }
+    }
+    
+    // Attempts still running now would have taken at least this long
+    auto decided_at = std::chrono::steady_clock::now();
+    std::vector<bool> in_flight(attempts.size());
+    {
+        std::lock_guard<std::mutex> lock(race->mutex);
+        for (size_t i = 0; i < attempts.size(); ++i) {
+            in_flight[i] = !race->settled[i];
+        }
+    }
+    
+    // Losers abort their HTTP transfers; join so no attempt outlives this call
+    cancel.cancel();
+    for (auto& attempt : attempts) {
+        attempt.join();
+    }
+    
+    // Recording only winners would leave a stalled provider's window full of
+    // its fast answers and keep its hedge delay short; a loser counts with
+    // how long it had been waiting, a lower bound on its real latency.
+    for (size_t i = 0; i < attempts.size(); ++i) {
+        if (race->latencies[i]) {
+            record_latency(order[i], *race->latencies[i]);
+        } else if (in_flight[i]) {
+            record_latency(order[i], std::chrono::duration_cast<std::chrono::milliseconds>(decided_at - started[i]));
+        }
+    }
+    
+    if (!race->winner) {
+        throw std::runtime_error("All providers failed to produce a plan (last error: " + race->last_error + ")");
+    }
+    return *race->winner;
+}
+
+} // namespace mag
@@ -1,11 +1,52 @@
 #include "llm_client.h"
 #include "policy.h"
+#include "config.h"
+#include "logger.h"
+#include "metrics.h"
+#include "provider_resilience.h"
+#include "token_counter.h"
+#include "tracing.h"
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 namespace mag {
 
+namespace {
+
+// One attempt against a provider's breaker. An attempt that ends without
+// recording an outcome (cancelled, rate limited away, submit threw) gives
+// back a half-open probe, or the breaker would refuse requests forever.
+class BreakerAttempt {
+public:
+    BreakerAttempt(CircuitBreaker& breaker, CircuitBreaker::Permit permit) : breaker_(breaker), permit_(permit) {}
+    ~BreakerAttempt() {
+        if (!recorded_) {
+            breaker_.release_probe(permit_);
+        }
+    }
+    
+    BreakerAttempt(const BreakerAttempt&) = delete;
+    BreakerAttempt& operator=(const BreakerAttempt&) = delete;
+    
+    void success() {
+        recorded_ = true;
+        breaker_.record_success(permit_);
+    }
+    void failure() {
+        recorded_ = true;
+        breaker_.record_failure(permit_);
+    }
+    
+private:
+    CircuitBreaker& breaker_;
+    CircuitBreaker::Permit permit_;
+    bool recorded_ = false;
+};
+
+} // namespace
+
 LLMClient::LLMClient() {
     // Auto-detect provider
     std::string provider_name = ProviderFactory::detect_available_provider();
@@ -21,25 +62,82 @@ LLMClient::LLMClient(const std::string& provider_name, const std::string& api_ke
 
 void LLMClient::initialize_provider(const std::string& provider_name, const std::string& api_key, 
                                    const std::string& model) {
-    provider_ = ProviderFactory::create_provider(provider_name);
+    const ProviderDescriptor* descriptor = ProviderFactory::find_descriptor(provider_name);
+    if (!descriptor) {
+        throw std::runtime_error("Unsupported LLM provider: " + provider_name);
+    }
+    provider_name_ = provider_name;
+    provider_.reset();
+    provider_once_ = std::make_unique<std::once_flag>();
     api_key_ = api_key;
-    model_ = model.empty() ? provider_->get_default_model() : model;
+    // Only the replay provider has to load its capture to know its model
+    if (!model.empty()) {
+        model_ = model;
+    } else if (!descriptor->default_model.empty()) {
+        model_ = descriptor->default_model;
+    } else {
+        model_ = provider().get_default_model();
+    }
+    
+    // Built on the first request (or by prewarm), not here: it reads the policy from disk
+    system_prompts_.store(nullptr);
+}
+
+const LLMProvider& LLMClient::provider() const {
+    std::call_once(*provider_once_, [this] {
+        provider_ = ProviderFactory::create_provider(provider_name_);
+        provider_->set_prompt_caching(APIConfig::prompt_caching_enabled());
+    });
+    return *provider_;
+}
+
+void LLMClient::prewarm() const {
+    system_prompts();
+    provider();
+    // Same host as every request; offline providers have no URL
+    http_client_.prewarm(std::string(ProviderFactory::find_descriptor(provider_name_)->base_url));
+}
+
+std::shared_ptr<const LLMClient::SystemPrompts> LLMClient::system_prompts() const {
+    // Built against one snapshot, so all three agree; racing rebuilds produce the same prompts
+    std::shared_ptr<const PolicySnapshot> snapshot;
+    try {
+        snapshot = PolicyStore::instance().current();
+    } catch (const std::exception&) {
+        snapshot.reset();
+    }
+    std::unique_ptr<PolicyChecker> policy = snapshot ? std::make_unique<PolicyChecker>(snapshot) : nullptr;
+    uint64_t version = snapshot ? snapshot->version : 0;
+    std::shared_ptr<const SystemPrompts> prompts = system_prompts_.load(std::memory_order_acquire);
+    if (prompts && prompts->policy_version == version) {
+        return prompts;
+    }
     
-    // Generate policy-aware system prompt
-    system_prompt_ = generate_policy_aware_system_prompt();
+    auto rebuilt = std::make_shared<SystemPrompts>();
+    rebuilt->policy_version = version;
+    rebuilt->plan = generate_policy_aware_system_prompt(policy.get());
+    rebuilt->chat = generate_chat_system_prompt(policy.get(), true);
+    rebuilt->chat_history = generate_chat_system_prompt(policy.get(), false);
+    system_prompts_.store(rebuilt, std::memory_order_release);
+    return rebuilt;
 }
 
-std::string LLMClient::generate_policy_aware_system_prompt() const {
+std::string LLMClient::generate_policy_aware_system_prompt(const PolicyChecker* policy_checker) const {
     std::string base_prompt = "You are a helpful AI assistant that converts user requests into a single, specific JSON command. You must only respond with a JSON object. Do not add any conversational text or markdown formatting around the JSON.\n\n"
-                             "You can use TWO types of commands:\n"
-                             "1. \"WriteFile\" - for creating/editing files\n"
-                             "2. \"BashCommand\" - for executing shell commands\n\n"
+                             "You can use THREE types of commands:\n"
+                             "1. \"WriteFile\" - for creating files or rewriting them completely\n"
+                             "2. \"PatchFile\" - for small edits to an existing file\n"
+                             "3. \"BashCommand\" - for executing shell commands\n\n"
                              "Choose WriteFile for: file creation, editing, content manipulation\n"
+                             "Choose PatchFile when you know the exact lines to change in an existing file\n"
                              "Choose BashCommand for: building, testing, running commands, system operations\n\n";
     
     // Try to load current policy constraints
     try {
-        PolicyChecker policy;
+        if (!policy_checker) {
+            throw std::runtime_error("Policy unavailable");
+        }
+        const PolicyChecker& policy = *policy_checker;
         auto allowed_dirs = policy.get_allowed_directories("file_tool", "create");
         
         if (!allowed_dirs.empty()) {
@@ -58,8 +156,9 @@ std::string LLMClient::generate_policy_aware_system_prompt() const {
             
             // Load bash command policies
             auto bash_allowed = policy.get_allowed_directories("bash_tool", "create");
-            auto bash_tool_it = policy.get_settings().tools.find("bash_tool");
-            if (bash_tool_it != policy.get_settings().tools.end()) {
+            auto settings = policy.get_settings();
+            auto bash_tool_it = settings->tools.find("bash_tool");
+            if (bash_tool_it != settings->tools.end()) {
                 const auto& bash_policy = bash_tool_it->second.create;
                 
                 if (!bash_policy.allowed_commands.empty()) {
@@ -103,6 +202,12 @@ std::string LLMClient::generate_policy_aware_system_prompt() const {
                    "  \"path\": \"relative/path/to/file\",\n"
                    "  \"content\": \"file content here\"\n"
                    "}\n\n"
+                   "For PatchFile commands, content holds SEARCH/REPLACE blocks; each SEARCH text must match the file exactly once:\n"
+                   "{\n"
+                   "  \"command\": \"PatchFile\",\n"
+                   "  \"path\": \"relative/path/to/file\",\n"
+                   "  \"content\": \"<<<<<<< SEARCH\\nold lines\\n=======\\nnew lines\\n>>>>>>> REPLACE\\n\"\n"
+                   "}\n\n"
                    "For BashCommand commands:\n"
                    "{\n"
                    "  \"command\": \"BashCommand\",\n"
@@ -122,8 +227,14 @@ std::string LLMClient::generate_policy_aware_system_prompt() const {
 }
 
 std::string LLMClient::get_api_key_for_provider(const std::string& provider_name) const {
-    std::unique_ptr<LLMProvider> temp_provider = ProviderFactory::create_provider(provider_name);
-    std::string env_var = temp_provider->get_api_key_env_var();
+    const ProviderDescriptor* descriptor = ProviderFactory::find_descriptor(provider_name);
+    if (!descriptor) {
+        throw std::runtime_error("Unsupported LLM provider: " + provider_name);
+    }
+    if (!descriptor->requires_api_key) {
+        return "";
+    }
+    std::string env_var(descriptor->api_key_env);
     
     const char* api_key = std::getenv(env_var.c_str());
     if (!api_key || strlen(api_key) == 0) {
@@ -134,43 +245,38 @@ std::string LLMClient::get_api_key_for_provider(const std::string& provider_name
     return std::string(api_key);
 }
 
-WriteFileCommand LLMClient::get_plan_from_llm(const std::string& user_prompt) const {
+WriteFileCommand LLMClient::get_plan_from_llm(const std::string& user_prompt,
+                                             ResponseMetadata* metadata,
+                                             const CancellationToken* cancel) const {
     // Build request payload
-    nlohmann::json payload = provider_->build_request_payload(system_prompt_, user_prompt, model_);
+    nlohmann::json payload = provider().build_request_payload(system_prompts()->plan, user_prompt, model_);
     
     // Get headers
-    std::vector<std::string> headers = provider_->get_headers(api_key_);
+    std::vector<std::string> headers = provider().get_headers(api_key_);
     
-    std::string url = provider_->get_full_url(api_key_, model_);
+    std::string url = provider().get_full_url(api_key_, model_);
     std::string payload_str = payload.dump();
     
-    std::cout << "Making request to: " << url << std::endl;
-    std::cout << "Request payload: " << payload_str << std::endl;
-    
-    // Make HTTP request
-    HttpResponse response = http_client_.post(url, payload_str, headers);
-    
-    std::cout << "HTTP Response - Success: " << response.success 
-              << ", Status: " << response.status_code << std::endl;
-    std::cout << "[LLM-DEBUG] Raw API response: " << response.data << std::endl;
+    // The URL can carry the API key (Gemini), so log the provider instead
+    MAG_LOG_DEBUG("llm", "Plan request to " << provider().get_name() << "/" << model_);
+    MAG_LOG_DEBUG("llm", "Request payload: " << Logger::truncate(payload_str));
     
-    if (!response.success) {
-        throw std::runtime_error("HTTP request failed: " + response.error_message + 
-                                " (Status: " + std::to_string(response.status_code) + ")");
-    }
-    
-    // Parse response
-    WriteFileCommand parsed_command = provider_->parse_response(response.data);
-    std::cout << "[LLM-DEBUG] Parsed WriteFileCommand: {" 
-              << "\"command\": \"" << parsed_command.command << "\", "
-              << "\"path\": \"" << parsed_command.path << "\", "
-              << "\"content_length\": " << parsed_command.content.length() << " chars}" << std::endl;
+    // Make HTTP request (or answer from the response cache) and parse
+    WriteFileCommand parsed_command;
+    fetch_response_body(url, payload_str, headers, metadata, [&](const std::string& body) {
+        MAG_LOG_DEBUG("llm", "Raw API response: " << Logger::truncate(body));
+        parsed_command = provider().parse_response(body);
+    }, cancel);
+    MAG_LOG_DEBUG("llm", "Parsed WriteFileCommand: {"
+                  << "\"command\": \"" << parsed_command.command << "\", "
+                  << "\"path\": \"" << parsed_command.path << "\", "
+                  << "\"content_length\": " << parsed_command.content.length() << " chars}");
     
     return parsed_command;
 }
 
 std::string LLMClient::get_current_provider() const {
-    return provider_->get_name();
+    return provider_name_;
 }
 
 std::string LLMClient::get_current_model() const {
@@ -182,7 +288,7 @@ void LLMClient::set_provider(const std::string& provider_name, const std::string
     initialize_provider(provider_name, api_key, model);
 }
 
-std::string LLMClient::get_chat_response(const std::string& user_prompt) const {
+std::string LLMClient::generate_chat_system_prompt(const PolicyChecker* policy_checker, bool include_examples) const {
     // Todo-centric chat system prompt with tool access
     std::string chat_system_prompt = 
         "You are MAG (Multi-Agent Gateway), a helpful AI assistant with todo management capabilities. "
@@ -190,7 +296,10 @@ std::string LLMClient::get_chat_response(const std::string& user_prompt) const {
         
     // Add policy constraints dynamically
     try {
-        PolicyChecker policy;
+        if (!policy_checker) {
+            throw std::runtime_error("Policy unavailable");
+        }
+        const PolicyChecker& policy = *policy_checker;
         auto allowed_dirs = policy.get_allowed_directories("file_tool", "create");
         
         if (!allowed_dirs.empty()) {
@@ -257,7 +366,8 @@ std::string LLMClient::get_chat_response(const std::string& user_prompt) const {
         "   Title: Create complex Python script\n"
         "   Description: Script with embedded \"quotes\" and 'apostrophes' and newlines\n"
         "   Multi-line descriptions work perfectly!\n"
-        "   <TODO_SEPARATOR>\n\n"
+        "   <TODO_SEPARATOR>\n"
+        "   An optional 'Depends on: 3, 4' line before Description names todo IDs that must finish first\n\n"
         
         "WORKFLOW:\n"
         "1. When users request file operations (create, write, modify files), add them to the todo list\n"
@@ -271,8 +381,13 @@ std::string LLMClient::get_chat_response(const std::string& user_prompt) const {
         "- Simply mention that you've added the todo - don't use **Added:** formatting yourself\n"
         "- Let the system suggest execution - don't mention /do commands yourself\n\n"
         
-        "CRITICAL: You MUST use the actual function calls in your response for them to work!\n\n"
-        "EXAMPLES:\n"
+        "CRITICAL: You MUST use the actual function calls in your response for them to work!\n\n";
+    
+    if (!include_examples) {
+        return chat_system_prompt;
+    }
+    
+    chat_system_prompt += "EXAMPLES:\n"
         "User: 'create a hello world script'\n"
         "You: 'I'll create that for you! add_todo(\"Create hello world script\", \"Python script in src/ directory\") The todo has been added to your list. The system will suggest execution options.'\n\n"
         "User: 'create a counting script and execute it'\n"
@@ -296,141 +411,576 @@ std::string LLMClient::get_chat_response(const std::string& user_prompt) const {
         "User: 'show me my todos'\n"
         "You: 'Here are your current todos: list_todos()'";
     
+    return chat_system_prompt;
+}
+
+std::string LLMClient::get_chat_response(const std::string& user_prompt,
+                                         ResponseMetadata* metadata) const {
+    std::shared_ptr<const SystemPrompts> prompts = system_prompts();
+    const std::string& chat_system_prompt = prompts->chat;
+    
     // Build request payload with chat system prompt
-    nlohmann::json payload = provider_->build_request_payload(chat_system_prompt, user_prompt, model_);
+    nlohmann::json payload = provider().build_request_payload(chat_system_prompt, user_prompt, model_);
     
-    std::string url = provider_->get_full_url(api_key_, model_);
+    std::string url = provider().get_full_url(api_key_, model_);
     std::string payload_str = payload.dump();
     
     // Get headers
-    std::vector<std::string> headers = provider_->get_headers(api_key_);
+    std::vector<std::string> headers = provider().get_headers(api_key_);
+    
+    MAG_LOG_DEBUG("llm", "Chat request to " << provider().get_name() << "/" << model_);
+    
+    // Make HTTP request (or answer from the response cache)
+    std::string chat_text;
+    fetch_response_body(url, payload_str, headers, metadata, [&](const std::string& body) {
+        // For chat mode, we need to extract the text response without trying to parse as WriteFileCommand
+        chat_text = provider().parse_chat_response(body);
+    });
+    return chat_text;
+}
+
+std::string LLMClient::get_chat_response_with_history(HistoryView conversation_history,
+                                                     ResponseMetadata* metadata) const {
+    std::shared_ptr<const SystemPrompts> prompts = system_prompts();
+    const std::string& chat_system_prompt = prompts->chat_history;
+    
+    // Serialize the history straight into a per-thread buffer that keeps its capacity
+    // between requests, instead of copying it into a DOM and dumping that
+    thread_local std::string payload_str;
+    payload_str.clear();
+    payload_str.reserve(estimate_payload_size(chat_system_prompt, conversation_history));
+    provider().write_conversation_payload(payload_str, chat_system_prompt, conversation_history, model_);
+    
+    std::string url = provider().get_full_url(api_key_, model_);
+    
+    // Get headers
+    std::vector<std::string> headers = provider().get_headers(api_key_);
+    
+    MAG_LOG_DEBUG("llm", "Chat request with " << conversation_history.size() << " history messages to "
+                  << provider().get_name() << "/" << model_);
+    
+    // Make HTTP request (or answer from the response cache)
+    std::string chat_text;
+    ResponseMetadata local_metadata;
+    ResponseMetadata& response_metadata = metadata ? *metadata : local_metadata;
+    fetch_response_body(url, payload_str, headers, &response_metadata, [&](const std::string& body) {
+        // For chat mode, we need to extract the text response without trying to parse as WriteFileCommand
+        chat_text = provider().parse_chat_response(body);
+    });
+    estimate_prompt_tokens(response_metadata.usage, chat_system_prompt, conversation_history);
+    return chat_text;
+}
+
+std::string LLMClient::summarize_conversation(const std::vector<ConversationMessage>& turns,
+                                             const std::string& previous_summary,
+                                             ResponseMetadata* metadata) const {
+    static const std::string summary_system_prompt =
+        "You condense conversations between a user and a coding assistant. "
+        "Write a concise summary that preserves the user's goals, decisions made, "
+        "files and commands involved, todo items and their status, and any open questions. "
+        "Merge the existing summary, if any, with the new turns. "
+        "Reply with the summary text only.";
+    
+    std::string transcript;
+    if (!previous_summary.empty()) {
+        transcript += "Existing summary:\n" + previous_summary + "\n\n";
+    }
+    transcript += "New turns:\n";
+    for (const auto& message : turns) {
+        transcript.append(message.role.view()).append(": ").append(message.content.view()).append("\n\n");
+    }
+    
+    nlohmann::json payload = provider().build_request_payload(summary_system_prompt, transcript, model_);
+    std::vector<std::string> headers = provider().get_headers(api_key_);
+    
+    MAG_LOG_DEBUG("llm", "Summarizing " << turns.size() << " turns with " << provider().get_name() << "/" << model_);
+    
+    std::string summary;
+    fetch_response_body(provider().get_full_url(api_key_, model_), payload.dump(), headers, metadata,
+        [&](const std::string& body) { summary = provider().parse_chat_response(body); });
+    return summary;
+}
+
+bool LLMClient::supports_batches() const {
+    return provider().supports_batches();
+}
+
+PlanBatchStatus LLMClient::submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) const {
+    if (prompts.empty()) {
+        throw std::runtime_error("No prompts to submit");
+    }
+    const std::string& plan_system_prompt = system_prompts()->plan;
+    std::vector<std::pair<std::string, nlohmann::json>> requests;
+    requests.reserve(prompts.size());
+    for (const auto& [id, prompt] : prompts) {
+        requests.emplace_back(id, provider().build_request_payload(plan_system_prompt, prompt, model_));
+    }
     
-    std::cout << "Making chat request to: " << url << std::endl;
+    MAG_LOG_INFO("llm", "Submitting " << prompts.size() << " plan requests as a "
+                 << provider().get_name() << "/" << model_ << " batch job");
+    std::string reply = batch_call(provider().build_batch_submit(api_key_, requests));
+    if (auto create = provider().build_batch_create(api_key_, reply)) {
+        reply = batch_call(*create);
+    }
+    PlanBatchStatus status = provider().parse_batch_status(reply);
+    status.provider = provider().get_name();
+    return status;
+}
+
+PlanBatchStatus LLMClient::poll_plan_batch(const PlanBatchStatus& batch) const {
+    PlanBatchStatus status = provider().parse_batch_status(batch_call(provider().build_batch_poll(api_key_, batch.id)));
+    status.provider = provider().get_name();
+    return status;
+}
+
+std::vector<PlanBatchResult> LLMClient::collect_plan_batch(const PlanBatchStatus& batch) const {
+    std::vector<ProviderBatchEntry> entries =
+        provider().parse_batch_results(batch_call(provider().build_batch_results(api_key_, batch)));
     
-    // Make HTTP request
-    HttpResponse response = http_client_.post(url, payload_str, headers);
+    std::vector<PlanBatchResult> results;
+    results.reserve(entries.size());
+    for (auto& entry : entries) {
+        PlanBatchResult result;
+        result.id = std::move(entry.custom_id);
+        if (!entry.success) {
+            result.error_message = std::move(entry.error);
+        } else {
+            try {
+                result.command = provider().parse_response(entry.body);
+                result.success = true;
+            } catch (const std::exception& e) {
+                result.error_message = e.what();
+            }
+        }
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+std::string LLMClient::batch_call(const ProviderBatchCall& call) const {
+    HttpResponse response = call.get ? http_client_.get(call.url, call.headers)
+                                     : http_client_.post(call.url, call.payload, call.headers);
+    MAG_LOG_DEBUG("llm", "Batch call to " << provider().get_name() << " - Status: " << response.status_code);
+    if (!response.success) {
+        std::string failure = "HTTP request failed: " + response.error_message +
+                              " (Status: " + std::to_string(response.status_code) + ")";
+        if (!response.data.empty()) {
+            failure += ": " + Logger::truncate(response.data);
+        }
+        throw std::runtime_error(failure);
+    }
+    return response.data;
+}
+
+std::string LLMClient::with_project_context(const std::string& context, const std::string& prompt) {
+    if (context.empty()) {
+        return prompt;
+    }
+    std::string composed;
+    composed.reserve(context.size() + prompt.size() + 128);
+    composed.append("Project context (files and declarations in the working tree; read a file before relying on "
+                    "its details):\n");
+    composed.append(context);
+    if (context.back() != '\n') {
+        composed += '\n';
+    }
+    composed.append("\nTask:\n").append(prompt);
+    return composed;
+}
+
+std::vector<ConversationMessage> LLMClient::with_project_context(const std::string& context,
+                                                                 HistoryView conversation_history) {
+    std::vector<ConversationMessage> history(conversation_history.begin(), conversation_history.end());
+    if (context.empty()) {
+        return history;
+    }
+    for (auto message = history.rbegin(); message != history.rend(); ++message) {
+        if (message->role == "user") {
+            message->content = MessageText(with_project_context(context, message->content.str()));
+            message->token_count = 0; // no longer the counted text
+            break;
+        }
+    }
+    return history;
+}
+
+size_t LLMClient::estimate_payload_size(const std::string& system_prompt, HistoryView conversation_history) {
+    // Text plus per-message framing, with headroom for escapes
+    constexpr size_t FRAMING_BYTES = 256;
+    constexpr size_t PER_MESSAGE_BYTES = 64;
+    size_t bytes = FRAMING_BYTES + system_prompt.size();
+    for (const auto& message : conversation_history) {
+        bytes += PER_MESSAGE_BYTES + message.content.size();
+    }
+    return bytes + bytes / 8;
+}
+
+ProviderUsage LLMClient::collect_usage(const std::string& body, const HttpResponse* response) const {
+    ProviderUsage usage = provider().parse_usage(body);
+    if (!usage.reported) {
+        return usage;
+    }
+    usage.provider = provider().get_name();
+    if (usage.model.empty()) {
+        usage.model = model_;
+    }
+    if (response) {
+        // The header id is the one provider support asks for; the body's is the message id
+        for (const char* name : {"request-id", "x-request-id"}) {
+            std::string id = response->header(name);
+            if (!id.empty()) {
+                usage.request_id = std::move(id);
+                break;
+            }
+        }
+        for (const char* name : {"openai-processing-ms", "x-envoy-upstream-service-time"}) {
+            std::string value = response->header(name);
+            if (!value.empty()) {
+                usage.server_latency_ms = std::strtoll(value.c_str(), nullptr, 10);
+                break;
+            }
+        }
+    }
+    
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    auto tokens = [&](const char* type) -> Counter& {
+        return metrics.counter("mag_provider_tokens_total", {{"provider", usage.provider}, {"type", type}},
+                               "Tokens providers reported billing, by type");
+    };
+    tokens("input").add(usage.input_tokens);
+    tokens("output").add(usage.output_tokens);
+    tokens("cached").add(usage.cached_tokens);
+    tokens("cache_write").add(usage.cache_write_tokens);
+    if (usage.server_latency_ms >= 0) {
+        metrics.histogram("mag_provider_server_seconds", {{"provider", usage.provider}},
+                          "Processing time providers reported for a request")
+            .record(std::chrono::milliseconds(usage.server_latency_ms));
+    }
+    return usage;
+}
+
+void LLMClient::estimate_prompt_tokens(ProviderUsage& usage, const std::string& system_prompt,
+                                       HistoryView conversation_history) {
+    if (!usage.reported) {
+        return;
+    }
+    // The uncalibrated estimate, so the ratio does not feed on itself
+    const HeuristicTokenCounter& base = *HeuristicTokenCounter::shared();
+    size_t estimated = base.count_message(system_prompt);
+    for (const auto& message : conversation_history) {
+        estimated += base.count_message(message.content);
+    }
+    usage.estimated_input_tokens = estimated;
+}
+
+std::string LLMClient::stream_chat_response(const std::string& user_prompt,
+                                            const TokenCallback& on_token) const {
+    nlohmann::json payload = provider().build_request_payload(system_prompts()->chat, user_prompt, model_);
+    return stream_request(payload, on_token);
+}
+
+std::string LLMClient::stream_chat_response_with_history(HistoryView conversation_history,
+                                                         const TokenCallback& on_token) const {
+    nlohmann::json payload = provider().build_conversation_payload(system_prompts()->chat_history,
+                                                                   conversation_history, model_);
+    return stream_request(payload, on_token);
+}
+
+bool LLMClient::supports_streaming() const {
+    return provider().supports_streaming();
+}
+
+std::string LLMClient::stream_request(nlohmann::json payload, const TokenCallback& on_token) const {
+    std::vector<std::string> headers = provider().get_headers(api_key_);
+    
+    // Providers without streaming get a regular request delivered as one chunk
+    if (!provider().supports_streaming()) {
+        std::string text;
+        fetch_response_body(provider().get_full_url(api_key_, model_), payload.dump(), headers, nullptr,
+            [&](const std::string& body) { text = provider().parse_chat_response(body); });
+        if (on_token) {
+            on_token(text);
+        }
+        return text;
+    }
+    
+    provider().enable_streaming(payload);
+    headers.push_back("Accept: text/event-stream");
+    
+    std::string full_text;
+    std::string stream_error;
+    SseParser parser([&](const SseEvent& event) {
+        if (!stream_error.empty()) {
+            return;
+        }
+        try {
+            std::string delta = provider().parse_stream_event(event);
+            if (!delta.empty()) {
+                full_text += delta;
+                if (on_token) {
+                    on_token(delta);
+                }
+            }
+        } catch (const std::exception& e) {
+            stream_error = e.what();
+        }
+    });
+    
+    std::string url = provider().get_stream_url(api_key_, model_);
+    MAG_LOG_DEBUG("llm", "Streaming chat request to " << provider().get_name() << "/" << model_);
+    
+    // Same rate limit and breaker as fetch_response_body; no retries, as deltas may already be out
+    ProviderResilience& resilience = ProviderResilience::instance();
+    const std::string provider_name = provider().get_name();
+    CircuitBreaker& breaker = resilience.breaker(provider_name);
+    CircuitBreaker::Permit permit = breaker.allow_request();
+    if (!permit) {
+        throw ProviderUnavailableError("Provider " + provider_name + " is unavailable (circuit open)");
+    }
+    BreakerAttempt breaker_attempt(breaker, permit);
+    resilience.rate_limiter(provider_name, api_key_).acquire();
+    
+    HttpResponse response;
+    {
+        Span http("provider call");
+        http.set_attribute("provider", provider().get_name());
+        http.set_attribute("model", model_);
+        http.set_attribute("stream", "true");
+        response = http_client_.post_stream(url, payload.dump(), headers,
+            [&parser](const char* data, size_t length) { parser.feed(data, length); });
+        parser.finish();
+        if (!response.success) {
+            http.set_error(response.error_message);
+        }
+    }
     
     if (!response.success) {
+        MetricsRegistry::instance().counter("mag_provider_failures_total", {{"provider", provider_name}},
+                                            "Provider HTTP attempts that failed").add();
+        if (RetryPolicy::is_retryable(response)) {
+            breaker_attempt.failure();
+        } else {
+            breaker_attempt.success(); // the provider answered; a bad request or key is not an outage
+        }
         throw std::runtime_error("HTTP request failed: " + response.error_message + 
                                 " (Status: " + std::to_string(response.status_code) + ")");
     }
+    breaker_attempt.success();
+    if (!stream_error.empty()) {
+        throw std::runtime_error(stream_error);
+    }
     
-    // For chat mode, we need to extract the text response without trying to parse as WriteFileCommand
-    return provider_->parse_chat_response(response.data);
+    return full_text;
 }
 
-std::string LLMClient::get_chat_response_with_history(const std::vector<ConversationMessage>& conversation_history) const {
-    // Todo-centric chat system prompt with tool access
-    std::string chat_system_prompt = 
-        "You are MAG (Multi-Agent Gateway), a helpful AI assistant with todo management capabilities. "
-        "You are currently in CHAT MODE where you can have natural conversations AND manage a todo list.\n\n";
-        
-    // Add policy constraints dynamically
-    try {
-        PolicyChecker policy;
-        auto allowed_dirs = policy.get_allowed_directories("file_tool", "create");
-        
-        if (!allowed_dirs.empty()) {
-            chat_system_prompt += "IMPORTANT POLICY CONSTRAINTS:\n";
-            chat_system_prompt += "- When suggesting file operations, remember that files can ONLY be created in: ";
-            for (size_t i = 0; i < allowed_dirs.size(); ++i) {
-                chat_system_prompt += allowed_dirs[i];
-                if (i < allowed_dirs.size() - 1) chat_system_prompt += ", ";
+void LLMClient::fetch_response_body(const std::string& url, const std::string& payload,
+                                    const std::vector<std::string>& headers, ResponseMetadata* metadata,
+                                    const std::function<void(const std::string& body)>& parse,
+                                    const CancellationToken* cancel) const {
+    if (metadata) {
+        metadata->cache_hit = false;
+        metadata->usage = {};
+    }
+    
+    // The payload already carries the model, system prompt, history and user prompt
+    std::string cache_key;
+    if (response_cache_) {
+        cache_key = ResponseCache::make_key({provider().get_name(), model_, payload});
+        if (auto cached = response_cache_->get(cache_key)) {
+            try {
+                parse(*cached);
+                MAG_LOG_DEBUG("llm", "Response cache hit: " << cache_key);
+                MetricsRegistry::instance().counter("mag_provider_cache_hits_total", {{"provider", provider().get_name()}},
+                                                    "Provider calls answered from the response cache").add();
+                if (metadata) {
+                    metadata->cache_hit = true;
+                }
+                return;
+            } catch (const std::exception&) {
+                // Unparseable entry (e.g. provider format change); refetch below
+                response_cache_->erase(cache_key);
             }
-            chat_system_prompt += "\n";
-            chat_system_prompt += "- Files in other directories are NOT allowed\n";
-            chat_system_prompt += "- If someone asks for files elsewhere, suggest alternatives in allowed directories\n\n";
         }
-    } catch (const std::exception& e) {
-        // If policy loading fails, fall back to basic constraints
-        chat_system_prompt += "IMPORTANT POLICY CONSTRAINTS:\n"
-                             "- Please suggest creating files in appropriate directories\n"
-                             "- Avoid suggesting files in the project root\n\n";
     }
+    
+    // Offline providers answer without touching the network or its policies
+    if (auto local = provider().serve_locally(payload)) {
+        parse(*local);
+        ProviderUsage usage = collect_usage(*local, nullptr);
+        if (metadata) {
+            metadata->usage = std::move(usage);
+        }
+        return;
+    }
+    
+    if (url.empty()) {
+        throw std::runtime_error("HTTP request failed: Empty URL");
+    }
+    
+    // Rate limit, retry transient failures and trip the provider's breaker on repeated ones
+    ProviderResilience& resilience = ProviderResilience::instance();
+    const std::string provider_name = provider().get_name();
+    CircuitBreaker& breaker = resilience.breaker(provider_name);
+    TokenBucket& rate_limiter = resilience.rate_limiter(provider_name, api_key_);
+    const RetryPolicy& retry_policy = resilience.retry_policy();
+    
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    const MetricLabels provider_labels = {{"provider", provider_name}};
+    LatencyHistogram& http_latency = metrics.histogram("mag_provider_http_seconds", provider_labels,
+                                                       "One HTTP attempt against a provider API");
+    Counter& failures = metrics.counter("mag_provider_failures_total", provider_labels,
+                                        "Provider HTTP attempts that failed");
+    
+    HttpResponse response;
+    for (int attempt = 0;; ++attempt) {
+        CircuitBreaker::Permit permit = breaker.allow_request();
+        if (!permit) {
+            throw ProviderUnavailableError("Provider " + provider_name + " is unavailable (circuit open)");
+        }
+        BreakerAttempt breaker_attempt(breaker, permit);
+        if (!rate_limiter.acquire(cancel)) {
+            throw std::runtime_error("Request cancelled");
+        }
         
-    chat_system_prompt += "AVAILABLE TOOLS:\n"
-        "- add_todo(title, description): Add a new todo item (simple format)\n"
-        "- TODO_START/TODO_END blocks: Add complex todos with quotes/special chars\n"
-        "- list_todos(): Show current todos\n"
-        "- update_todo(id, title, description): Modify existing todo\n"
-        "- delete_todo(id): Remove todo item\n"
-        "\nWhen creating todos, you can suggest BOTH file operations AND bash commands:\n"
-        "- File operations: 'Create config.json with settings', 'Update README.md'\n"
-        "- Bash commands: Use EXACT command syntax like 'python3 src/script.py', 'make clean', 'npm install'\n"
-        "- For bash todos, be SPECIFIC with executable commands, not descriptions\n"
-        "- Examples: 'python3 src/app.py' (not 'run the Python app'), 'ls -la' (not 'list files')\n"
-        "- When creating script execution todos, use the exact command: 'python3 src/filename.py'\n"
-        "- The system will automatically route each todo to the appropriate tool (file_tool or bash_tool)\n"
-        "- mark_complete(id): Mark todo as done\n"
-        "\nAUTONOMOUS EXECUTION TOOLS:\n"
-        "- execute_next(): Execute the next pending todo autonomously\n"
-        "- execute_all(): Execute all pending todos autonomously  \n"
-        "- execute_todo(id): Execute a specific todo by ID\n"
-        "- request_user_approval(reason): Stop and ask user for approval when uncertain\n\n"
-        "EXECUTION COMMANDS (for the user):\n"
-        "- /do: Execute all pending todos\n"
-        "- /do next: Execute only the next pending todo\n"
-        "- /do until N: Execute todos until (not including) ID N\n"
-        "- /do N-M: Execute todos in range [start_id, end_id]\n"
-        "- /do N: Execute specific todo by ID\n\n"
+        HttpCallHandle call = http_client_.submit(url, payload, headers);
+        size_t cancel_registration = cancel ? cancel->on_cancel([call]() { call->cancel(); }) : 0;
+        {
+            Span http("provider call");
+            http.set_attribute("provider", provider_name);
+            http.set_attribute("model", model_);
+            ScopedTimer timer(http_latency);
+            response = call->wait();
+            if (http.active()) {
+                http.set_attribute("status", std::to_string(response.status_code));
+                http.set_attribute("attempt", std::to_string(attempt + 1));
+                if (!response.success) {
+                    http.set_error(response.error_message);
+                }
+            }
+        }
+        if (cancel) {
+            cancel->remove_callback(cancel_registration);
+            if (cancel->is_cancelled()) {
+                throw std::runtime_error("Request cancelled");
+            }
+        }
         
-        "AUTONOMOUS EXECUTION GUIDELINES:\n"
-        "- Use execute_next() or execute_all() when user clearly wants immediate action\n"
-        "- For 'create and execute' requests, create TWO todos:\n"
-        "  1. File creation todo (handled by file_tool)\n"
-        "  2. Execution todo with exact command (handled by bash_tool)\n"
-        "- Examples: 'create and run', 'build and test', 'make a script and execute it'\n"
-        "- Use request_user_approval(reason) when:\n"
-        "  * Operation might be risky or destructive\n"
-        "  * User's intent is unclear or ambiguous\n"
-        "  * Multiple approaches are possible\n"
-        "  * You need more information before proceeding\n"
-        "- NEVER use /do commands in responses (those are for CLI only)\n\n"
+        MAG_LOG_DEBUG("llm", "HTTP Response - Success: " << response.success
+                      << ", Status: " << response.status_code);
         
-        "TODO FORMATS:\n"
-        "1. Simple: add_todo(\"title\", \"description\") - for basic todos\n"
-        "2. Separator format for complex content with quotes/special chars:\n"
-        "   <TODO_SEPARATOR>\n"
-        "   Title: Create complex Python script\n"
-        "   Description: Script with embedded \"quotes\" and 'apostrophes' and newlines\n"
-        "   Multi-line descriptions work perfectly!\n"
-        "   <TODO_SEPARATOR>\n\n"
+        if (response.success) {
+            breaker_attempt.success();
+            break;
+        }
+        failures.add();
         
-        "WORKFLOW:\n"
-        "1. When users request file operations (create, write, modify files), add them to the todo list\n"
-        "2. Break complex requests into specific todo items\n"
-        "3. All todos are queued - the system will suggest when to execute them\n"
-        "4. Users have full control over execution with /do commands\n\n"
+        std::string failure = "HTTP request failed: " + response.error_message + 
+                              " (Status: " + std::to_string(response.status_code) + ")";
+        if (!RetryPolicy::is_retryable(response)) {
+            // The provider answered; a bad request or key is not an outage
+            breaker_attempt.success();
+            throw std::runtime_error(failure);
+        }
         
-        "RESPONSE FORMAT:\n"
-        "- Be conversational and helpful\n"
-        "- When adding todos, clearly state what you're adding (the system will automatically show **Added:** messages)\n"
-        "- Simply mention that you've added the todo - don't use **Added:** formatting yourself\n"
-        "- Let the system suggest execution - don't mention /do commands yourself\n\n"
+        breaker_attempt.failure();
+        auto hint = RetryPolicy::retry_after(response);
+        if (attempt >= retry_policy.max_retries || (hint && *hint > retry_policy.max_retry_after)) {
+            throw ProviderUnavailableError(failure + " after " + std::to_string(attempt + 1) + " attempt(s)");
+        }
         
-        "CRITICAL: You MUST use the actual function calls in your response for them to work!\n\n";
-    
-    // Build request payload with conversation history and chat system prompt
-    nlohmann::json payload = provider_->build_conversation_payload(chat_system_prompt, conversation_history, model_);
-    
-    std::string url = provider_->get_full_url(api_key_, model_);
-    std::string payload_str = payload.dump();
-    
-    // Get headers
-    std::vector<std::string> headers = provider_->get_headers(api_key_);
+        metrics.counter("mag_provider_retries_total", provider_labels, "Provider HTTP attempts that were retried").add();
+        auto delay = retry_policy.backoff(attempt, response);
+        MAG_LOG_WARN("llm", "Retrying " << provider_name << " in " << delay.count() << "ms (" << failure << ")");
+        if (!cancel) {
+            std::this_thread::sleep_for(delay);
+        } else if (cancel->wait_for(delay)) {
+            throw std::runtime_error("Request cancelled");
+        }
+    }
     
-    std::cout << "Making chat request with conversation history to: " << url << std::endl;
+    metrics.counter("mag_provider_bytes_total", {{"provider", provider_name}, {"direction", "out"}},
+                    "Provider request and response body bytes").add(payload.size());
+    metrics.counter("mag_provider_bytes_total", {{"provider", provider_name}, {"direction", "in"}},
+                    "Provider request and response body bytes").add(response.data.size());
     
-    // Make HTTP request
-    HttpResponse response = http_client_.post(url, payload_str, headers);
+    {
+        Span parse_span("parse response");
+        parse(response.data);
+    }
+    ProviderUsage usage = collect_usage(response.data, &response);
+    if (metadata) {
+        metadata->usage = std::move(usage);
+    }
+    if (response_cache_) {
+        response_cache_->put(cache_key, response.data);
+    }
+    if (recorder_) {
+        recorder_->record(provider_name, model_, payload, response.data);
+    }
+}
+
+LLMClientPool::LLMClientPool(const std::string& default_provider, const std::string& default_model)
+    : default_provider_(default_provider.empty() ? ProviderFactory::detect_available_provider() : default_provider)
+    , default_model_(default_model) {
+}
+
+const LLMClient& LLMClientPool::get(const std::string& provider_name, const std::string& model) {
+    const std::string& provider = provider_name.empty() ? default_provider_ : provider_name;
+    const std::string& actual_model = (provider_name.empty() && model.empty()) ? default_model_ : model;
+    std::string key = provider + "/" + actual_model;
     
-    if (!response.success) {
-        throw std::runtime_error("HTTP request failed: " + response.error_message + 
-                                " (Status: " + std::to_string(response.status_code) + ")");
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = clients_.find(key);
+    if (it != clients_.end()) {
+        return *it->second;
     }
     
-    // For chat mode, we need to extract the text response without trying to parse as WriteFileCommand
-    return provider_->parse_chat_response(response.data);
+    auto client = std::make_unique<LLMClient>(provider, "", actual_model);
+    client->set_response_cache(response_cache_);
+    client->set_recorder(recorder_);
+    const LLMClient& ready = *client;
+    clients_.emplace(key, std::move(client));
+    return ready;
+}
+
+std::vector<std::string> LLMClientPool::failover_order(const std::string& provider_name) const {
+    std::vector<std::string> order{provider_name.empty() ? default_provider_ : provider_name};
+    for (const auto& provider : ProviderFactory::detect_available_providers()) {
+        if (provider != order.front()) {
+            order.push_back(provider);
+        }
+    }
+    return order;
+}
+
+void LLMClientPool::prewarm(const std::string& provider_name) {
+    try {
+        get(provider_name).prewarm();
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("llm", "Prewarm of " << (provider_name.empty() ? default_provider_ : provider_name)
+                     << " failed: " << e.what());
+    }
+}
+
+size_t LLMClientPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return clients_.size();
+}
+
+void LLMClientPool::set_response_cache(std::shared_ptr<ResponseCache> cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    response_cache_ = cache;
+    for (auto& [key, client] : clients_) {
+        client->set_response_cache(cache);
+    }
+}
+
+void LLMClientPool::set_recorder(std::shared_ptr<ResponseRecorder> recorder) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    recorder_ = recorder;
+    for (auto& [key, client] : clients_) {
+        client->set_recorder(recorder);
+    }
 }
 
 } // namespace mag
\ No newline at end of file
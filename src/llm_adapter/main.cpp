@@ -1,147 +1,621 @@
 #include "llm_client.h"
+#include "hedged_planner.h"
+#include "tenant_registry.h"
 #include "message.h"
 #include "config.h"
+#include "worker_registry.h"
+#include "logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "thread_pool.h"
+#include "tracing.h"
+#include "network/nng_rep_server.h"
 #include <nng/nng.h>
-#include <nng/protocol/reqrep0/rep.h>
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 
 using namespace mag;
 
-int main() {
-    nng_socket sock;
-    int rv;
+/**
+ * @brief Registry of in-progress streamed chat replies
+ *
+ * Streams run on a pool of MAX_CONCURRENT_STREAMS threads and buffer text
+ * deltas; the orchestrator drains them with "stream_next" requests so REQ/REP
+ * stays one reply per request. A poll with nothing to return yet is parked
+ * as a deferred reply, holding no worker, and answered by the next delta or
+ * after STREAM_POLL_WAIT_MS.
+ */
+class StreamRegistry {
+public:
+    explicit StreamRegistry(LLMClientPool& clients)
+        : clients_(clients), executor_(NetworkConfig::MAX_CONCURRENT_STREAMS) {}
     
-    try {
-        // Initialize LLM client with auto-detection
-        LLMClient llm_client;
-        
-        std::cout << "Using " << llm_client.get_current_provider() 
-                  << " with model " << llm_client.get_current_model() << std::endl;
-        
-        // Create NNG reply socket
-        if ((rv = nng_rep0_open(&sock)) != 0) {
-            std::cerr << "nng_rep0_open: " << nng_strerror(rv) << std::endl;
-            return 1;
+    // clients is the requesting tenant's pool; null streams from the registry's own
+    std::string start(const std::string& provider_override, const std::string& user_prompt,
+                      LLMClientPool* clients = nullptr) {
+        auto stream = std::make_shared<Stream>();
+        std::string stream_id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            reap_expired();
+            if (executor_.queued() >= static_cast<size_t>(NetworkConfig::MAX_QUEUED_STREAMS)) {
+                throw std::runtime_error("Too many streamed replies waiting to start; try again shortly");
+            }
+            stream_id = "stream-" + std::to_string(++next_id_);
+            stream->id = stream_id;
+            streams_[stream_id] = stream;
         }
-        
-        // Listen on the specified URL
-        std::string url = NetworkConfig::get_llm_adapter_url();
-        if ((rv = nng_listen(sock, url.c_str(), nullptr, 0)) != 0) {
-            std::cerr << "nng_listen: " << nng_strerror(rv) << std::endl;
-            nng_close(sock);
-            return 1;
+
+        LLMClientPool& pool = clients ? *clients : clients_;
+        executor_.submit([this, &pool, stream, provider_override, user_prompt](size_t) {
+            try {
+                const LLMClient& client = pool.get(provider_override);
+                client.stream_chat_response(user_prompt, [this, &stream](const std::string& delta) {
+                    std::lock_guard<std::mutex> lock(stream->mutex);
+                    stream->pending += delta;
+                    answer_waiter(*stream);
+                });
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(stream->mutex);
+                stream->error = e.what();
+            }
+            bool finished = false;
+            {
+                std::lock_guard<std::mutex> lock(stream->mutex);
+                stream->done = true;
+                finished = answer_waiter(*stream);
+            }
+            if (finished) {
+                forget(stream->id);
+            }
+        });
+
+        return stream_id;
+    }
+
+    // Answers a stream_next through reply, at once if there is something to say
+    NNGRepServer::Deferral poll(const std::string& stream_id, WireFormat format,
+                                const std::shared_ptr<NNGRepServer::DeferredReply>& reply) {
+        NNGRepServer::Deferral deferral;
+        deferral.taken = true;
+        std::shared_ptr<Stream> stream;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = streams_.find(stream_id);
+            if (it == streams_.end()) {
+                reply->complete(NngMessage::encode({{"stream_id", stream_id}, {"delta", ""}, {"done", true},
+                                                    {"error", "Unknown stream: " + stream_id}}, format));
+                return deferral;
+            }
+            stream = it->second;
         }
-        
-        std::cout << "LLM Adapter listening on " << url << std::endl;
-        
-        // Main service loop
-        while (true) {
-        char* buf = nullptr;
-        size_t sz;
-        
-        // Receive message
-        if ((rv = nng_recv(sock, &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-            std::cerr << "nng_recv: " << nng_strerror(rv) << std::endl;
-            continue;
+
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            stream->last_activity = std::chrono::steady_clock::now();
+            if (stream->pending.empty() && !stream->done) {
+                stream->waiter = reply;
+                stream->format = format;
+                deferral.timeout = std::chrono::milliseconds(NetworkConfig::STREAM_POLL_WAIT_MS);
+                deferral.on_timeout = [this, stream, format]() { return expire(stream, format); };
+                return deferral;
+            }
+            reply->complete(NngMessage::encode(chunk_of(*stream), format));
+            finished = drained(*stream);
         }
-        
+        if (finished) {
+            forget(stream_id);
+        }
+        return deferral;
+    }
+
+private:
+    struct Stream {
+        std::mutex mutex;
+        std::string id;
+        std::string pending;
+        std::string error;
+        bool done = false;
+        std::chrono::steady_clock::time_point last_activity = std::chrono::steady_clock::now();
+        std::shared_ptr<NNGRepServer::DeferredReply> waiter; // a parked stream_next
+        WireFormat format = WireFormat::JSON;                // the waiter's
+    };
+
+    LLMClientPool& clients_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Stream>> streams_;
+    uint64_t next_id_ = 0;
+    ThreadPool executor_; // last, so running streams are joined before the registry goes
+
+    // All with stream.mutex held
+    static nlohmann::json chunk_of(const Stream& stream) {
+        nlohmann::json chunk = {{"stream_id", stream.id}, {"delta", stream.pending}, {"done", stream.done}};
+        if (!stream.error.empty()) {
+            chunk["error"] = stream.error;
+        }
+        return chunk;
+    }
+    
+    // The chunk went out; true when that was the last one
+    static bool drained(Stream& stream) {
+        stream.pending.clear();
+        stream.last_activity = std::chrono::steady_clock::now();
+        return stream.done;
+    }
+    
+    // Pending deltas go to a parked poll; true when that finished the stream
+    static bool answer_waiter(Stream& stream) {
+        if (!stream.waiter) {
+            return false;
+        }
+        std::shared_ptr<NNGRepServer::DeferredReply> waiter = std::move(stream.waiter);
+        // False once the poll timed out; its timeout reply then picks up what is pending
+        if (!waiter->complete(NngMessage::encode(chunk_of(stream), stream.format))) {
+            return false;
+        }
+        return drained(stream);
+    }
+    
+    // A parked poll's timeout, on an NNG thread: whatever arrived meanwhile, often nothing
+    NngMessage expire(const std::shared_ptr<Stream>& stream, WireFormat format) {
+        NngMessage reply;
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            stream->waiter.reset();
+            reply = NngMessage::encode(chunk_of(*stream), format);
+            finished = drained(*stream);
+        }
+        if (finished) {
+            forget(stream->id);
+        }
+        return reply;
+    }
+    
+    void forget(const std::string& stream_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streams_.erase(stream_id);
+    }
+
+    // Drop streams whose client went away without draining them
+    void reap_expired() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = streams_.begin(); it != streams_.end();) {
+            std::lock_guard<std::mutex> lock(it->second->mutex);
+            auto idle = std::chrono::duration_cast<std::chrono::seconds>(now - it->second->last_activity);
+            if (it->second->done && idle.count() > NetworkConfig::STREAM_IDLE_EXPIRY_SECONDS) {
+                it = streams_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+/**
+ * @brief LLM Adapter Service - turns orchestrator requests into provider calls
+ *
+ * One instance exists per worker thread, each with its own pool of ready
+ * LLM clients, so a provider override is a lookup rather than a rebuild.
+ * Requests from a named tenant use that tenant's clients instead.
+ */
+class LLMAdapterService {
+public:
+    LLMAdapterService(const std::string& default_provider, StreamRegistry& streams, TenantRegistry& tenants,
+                      std::shared_ptr<ResponseCache> response_cache,
+                      std::shared_ptr<ResponseRecorder> recorder, HedgedPlanner* planner)
+        : clients_(default_provider), streams_(streams), tenants_(tenants), planner_(planner) {
+        clients_.set_response_cache(std::move(response_cache));
+        clients_.set_recorder(std::move(recorder));
+    }
+    
+    const LLMClient& default_client() { return clients_.get(); }
+    void prewarm() { clients_.prewarm(); }
+
+    NngMessage handle_request(std::string_view request_data, ServiceMetrics::RequestScope& scope) {
+        std::string user_prompt;
+        std::string provider_override;
+        bool chat_mode = false;
+        bool stream = false;
+        bool envelope = false;
+        bool race = HedgeConfig::race_by_default();
+        std::string tenant;
+        std::vector<ConversationMessage> history;
+
+        // Parse the request (plain string, JSON or a binary encoding); structured
+        // replies go back in the request's encoding
+        WireFormat format = WireCodec::detect(request_data);
+        nlohmann::json request_json;
         try {
-            // Parse the request (could be plain string or JSON)
-            std::string request_data(buf, sz);
-            nng_free(buf, sz);
-            
-            std::string user_prompt;
-            std::string provider_override;
-            bool chat_mode = false;
-            
-            // Try to parse as JSON first
-            try {
-                nlohmann::json request_json = nlohmann::json::parse(request_data);
-                user_prompt = request_json["prompt"];
-                if (request_json.contains("provider")) {
-                    provider_override = request_json["provider"];
-                }
-                if (request_json.contains("chat_mode")) {
-                    chat_mode = request_json["chat_mode"];
+            Span parse("parse");
+            request_json = WireCodec::decode(request_data);
+        } catch (const nlohmann::json::exception&) {
+            request_json = nullptr;
+            format = WireFormat::JSON;
+        }
+
+        try {
+            if (request_json.is_object()) {
+                tenant = tenants_.resolve(request_json.value("tenant", ""));
+                if (request_json.contains("operation")) {
+                    scope.set_operation(request_json.value("operation", "unknown"));
+                    nlohmann::json reply = handle_operation(request_json, clients_for(tenant));
+                    if (reply.contains("error")) {
+                        scope.fail();
+                    }
+                    return NngMessage::encode(reply, format);
                 }
-                std::cout << "Received JSON request - Prompt: " << user_prompt;
-                if (!provider_override.empty()) {
-                    std::cout << ", Provider: " << provider_override;
+                user_prompt = request_json.value("prompt", "");
+                provider_override = request_json.value("provider", "");
+                chat_mode = request_json.value("chat_mode", false);
+                stream = request_json.value("stream", false);
+                envelope = request_json.value("envelope", false);
+                race = request_json.value("race", race);
+                if (request_json.contains("history") && request_json["history"].is_array()) {
+                    for (const auto& message : request_json["history"]) {
+                        history.push_back(ConversationMessage::from_json(message));
+                    }
                 }
-                if (chat_mode) {
-                    std::cout << ", Mode: chat";
+                // Project context rides along with this request only; the caller keeps its history without it
+                std::string context = request_json.value("context", "");
+                if (!context.empty()) {
+                    user_prompt = LLMClient::with_project_context(context, user_prompt);
+                    history = LLMClient::with_project_context(context, history);
                 }
-                std::cout << std::endl;
-            } catch (const nlohmann::json::exception&) {
+
+                MAG_LOG_DEBUG("llm_adapter", "Received JSON request - Prompt: " << Logger::truncate(user_prompt)
+                              << (provider_override.empty() ? "" : ", Provider: " + provider_override)
+                              << (tenant.empty() ? "" : ", Tenant: " + tenant)
+                              << (chat_mode ? ", Mode: chat" : "") << (stream ? " (streaming)" : ""));
+            } else {
                 // Not JSON, treat as plain prompt
-                user_prompt = request_data;
-                std::cout << "Received prompt: " << user_prompt << std::endl;
+                user_prompt = std::string(request_data);
+                MAG_LOG_DEBUG("llm_adapter", "Received prompt: " << Logger::truncate(user_prompt));
+            }
+
+            scope.set_operation(chat_mode ? (stream ? "stream" : "chat") : "plan");
+            LLMClientPool& clients = clients_for(tenant);
+            if (chat_mode && stream) {
+                std::string stream_id = streams_.start(provider_override, user_prompt,
+                                                       tenant.empty() ? nullptr : &clients);
+                MAG_LOG_DEBUG("llm_adapter", "Started " << stream_id);
+                return NngMessage::encode({{"stream_id", stream_id}}, format);
             }
-            
+
+            ResponseMetadata metadata;
             if (chat_mode) {
-                // Chat mode - return raw response
-                std::string chat_response;
-                if (!provider_override.empty()) {
-                    // Temporarily switch provider on existing client
-                    std::string original_provider = llm_client.get_current_provider();
-                    llm_client.set_provider(provider_override);
-                    chat_response = llm_client.get_chat_response(user_prompt);
-                    llm_client.set_provider(original_provider); // Switch back
-                    std::cout << "Used provider override: " << provider_override << std::endl;
-                } else {
-                    chat_response = llm_client.get_chat_response(user_prompt);
-                }
-                
-                std::cout << "Chat response: " << chat_response << std::endl;
-                
-                // Send raw response
-                if ((rv = nng_send(sock, const_cast<char*>(chat_response.c_str()), chat_response.length(), 0)) != 0) {
-                    std::cerr << "nng_send: " << nng_strerror(rv) << std::endl;
-                } else {
-                    std::cout << "Sent chat response" << std::endl;
+                // Chat mode - return raw response unless the caller asked for an envelope
+                std::string chat_response = call_provider(clients, provider_override, [&](const LLMClient& client) {
+                    if (!history.empty()) {
+                        return client.get_chat_response_with_history(history, &metadata);
+                    }
+                    return client.get_chat_response(user_prompt, &metadata);
+                });
+                MAG_LOG_DEBUG("llm_adapter", "Chat response: " << Logger::truncate(chat_response));
+                if (envelope) {
+                    nlohmann::json reply = {{"response", chat_response}, {"cache_hit", metadata.cache_hit}};
+                    if (metadata.usage.reported) {
+                        reply["usage"] = metadata.usage.to_json();
+                    }
+                    return NngMessage::encode(reply, format);
                 }
+                return NngMessage::copy_of(chat_response);
+            }
+
+            // File operation mode - parse as WriteFileCommand
+            WriteFileCommand command;
+            std::string plan_provider;
+            bool hedged = false;
+            if (race && planner_) {
+                HedgedPlanResult result = planner_->plan(user_prompt, provider_override);
+                command = result.command;
+                plan_provider = result.provider;
+                hedged = result.hedged;
+                metadata.cache_hit = result.cache_hit;
+                metadata.usage = result.usage;
+                MAG_LOG_INFO("llm_adapter", "Race won by " << plan_provider << " in " << result.latency.count()
+                             << "ms" << (hedged ? " (hedged)" : ""));
             } else {
-                // File operation mode - parse as WriteFileCommand
-                WriteFileCommand command;
-                if (!provider_override.empty()) {
-                    // Temporarily switch provider on existing client
-                    std::string original_provider = llm_client.get_current_provider();
-                    llm_client.set_provider(provider_override);
-                    command = llm_client.get_plan_from_llm(user_prompt);
-                    llm_client.set_provider(original_provider); // Switch back
-                    std::cout << "Used provider override: " << provider_override << std::endl;
-                } else {
-                    command = llm_client.get_plan_from_llm(user_prompt);
+                command = call_provider(clients, provider_override, [&](const LLMClient& client) {
+                    plan_provider = client.get_current_provider();
+                    return client.get_plan_from_llm(user_prompt, &metadata);
+                });
+            }
+
+            MAG_LOG_DEBUG("llm_adapter", "Plan from " << plan_provider << " - Command: '" << command.command
+                          << "', Path: '" << command.path
+                          << "', Content length: " << command.content.length());
+
+            nlohmann::json reply;
+            command.to_json(reply);
+            MessageHandler::encode_command_bytes(reply, command, format);
+            reply["cache_hit"] = metadata.cache_hit;
+            reply["provider"] = plan_provider;
+            if (metadata.usage.reported) {
+                reply["usage"] = metadata.usage.to_json();
+            }
+            if (hedged) {
+                reply["hedged"] = true;
+            }
+            return NngMessage::encode(reply, format);
+
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("llm_adapter", "Error processing request: " << e.what());
+            scope.fail();
+
+            return NngMessage::encode(error_reply(e.what()), format);
+        }
+    }
+
+    // An empty command the orchestrator already handles, plus the reason
+    static nlohmann::json error_reply(const std::string& message) {
+        return {{"command", "WriteFile"}, {"path", ""}, {"content", ""}, {"error", message}};
+    }
+
+private:
+    LLMClientPool clients_;
+    StreamRegistry& streams_;
+    TenantRegistry& tenants_;
+    HedgedPlanner* planner_; // null when fewer than two providers are configured
+
+    LLMClientPool& clients_for(const std::string& tenant) {
+        return tenant.empty() ? clients_ : tenants_.clients(tenant);
+    }
+
+    // Explicit provider overrides are honoured as-is; otherwise fail over when the default is down
+    template <typename Call>
+    static auto call_provider(LLMClientPool& clients, const std::string& provider_override, Call&& call)
+        -> decltype(call(std::declval<const LLMClient&>())) {
+        if (!provider_override.empty()) {
+            return call(clients.get(provider_override));
+        }
+        return clients.with_failover("", std::forward<Call>(call));
+    }
+
+    nlohmann::json handle_operation(const nlohmann::json& request, LLMClientPool& clients) {
+        std::string operation = request["operation"];
+
+        if (operation == "summarize") {
+            return handle_summarize(request, clients);
+        }
+
+        if (operation == "metrics") {
+            return MetricsRegistry::instance().to_json();
+        }
+
+        if (operation.rfind("plan_batch_", 0) == 0) {
+            return handle_plan_batch(operation, request, clients);
+        }
+
+        return {{"error", "Unknown operation: " + operation}};
+    }
+
+    // Context compaction: condense old turns with the (cheap) summary model
+    nlohmann::json handle_summarize(const nlohmann::json& request, LLMClientPool& clients) {
+        try {
+            std::vector<ConversationMessage> turns;
+            for (const auto& message : request.value("messages", nlohmann::json::array())) {
+                turns.push_back(ConversationMessage::from_json(message));
+            }
+            std::string previous_summary = request.value("previous_summary", "");
+
+            std::string provider = CompactionConfig::get_summary_provider();
+            std::string model = CompactionConfig::get_summary_model();
+            ResponseMetadata metadata;
+            std::string summary = call_provider(clients, provider, [&](const LLMClient& client) {
+                const LLMClient& summarizer = model.empty()
+                    ? client : clients.get(client.get_current_provider(), model);
+                return summarizer.summarize_conversation(turns, previous_summary, &metadata);
+            });
+            MAG_LOG_INFO("llm_adapter", "Summarized " << turns.size() << " turns into "
+                         << summary.size() << " bytes");
+            nlohmann::json reply = {{"summary", summary}};
+            if (metadata.usage.reported) {
+                reply["usage"] = metadata.usage.to_json();
+            }
+            return reply;
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("llm_adapter", "Summarize failed: " << e.what());
+            return {{"error", e.what()}};
+        }
+    }
+
+    // Provider batch jobs of plan requests; a job stays with the provider that took it, without failover
+    nlohmann::json handle_plan_batch(const std::string& operation, const nlohmann::json& request,
+                                     LLMClientPool& clients) {
+        try {
+            if (operation == "plan_batch_submit") {
+                std::vector<std::pair<std::string, std::string>> prompts;
+                for (const auto& item : request.value("prompts", nlohmann::json::array())) {
+                    prompts.emplace_back(item.at("id").get<std::string>(),
+                                         LLMClient::with_project_context(item.value("context", ""),
+                                                                         item.at("prompt").get<std::string>()));
+                }
+                const LLMClient& client = clients.get(request.value("provider", ""));
+                if (!client.supports_batches()) {
+                    return {{"error", client.get_current_provider() + " has no batch API"}};
                 }
-                
-                std::cout << "LLM response parsed - Command: '" << command.command 
-                          << "', Path: '" << command.path 
-                          << "', Content length: " << command.content.length() << std::endl;
-                
-                // Serialize and send response
-                std::string response = MessageHandler::serialize_command(command);
-                
-                if ((rv = nng_send(sock, const_cast<char*>(response.c_str()), response.length(), 0)) != 0) {
-                    std::cerr << "nng_send: " << nng_strerror(rv) << std::endl;
-                } else {
-                    std::cout << "Sent plan: " << response << std::endl;
+                nlohmann::json reply;
+                client.submit_plan_batch(prompts).to_json(reply["batch"]);
+                return reply;
+            }
+
+            PlanBatchStatus batch;
+            batch.from_json(request.at("batch"));
+            const LLMClient& client = clients.get(batch.provider);
+            if (operation == "plan_batch_status") {
+                nlohmann::json reply;
+                client.poll_plan_batch(batch).to_json(reply["batch"]);
+                return reply;
+            }
+            if (operation == "plan_batch_results") {
+                nlohmann::json reply = {{"results", nlohmann::json::array()}};
+                for (const auto& result : client.collect_plan_batch(batch)) {
+                    nlohmann::json item;
+                    result.to_json(item);
+                    reply["results"].push_back(std::move(item));
                 }
+                return reply;
             }
-            
+            return {{"error", "Unknown operation: " + operation}};
         } catch (const std::exception& e) {
-            nng_free(buf, sz);
-            std::cerr << "Error processing request: " << e.what() << std::endl;
-            
-            // Send error response
-            std::string error_response = R"({"command": "WriteFile", "path": "", "content": ""})";
-            nng_send(sock, const_cast<char*>(error_response.c_str()), error_response.length(), 0);
+            MAG_LOG_ERROR("llm_adapter", "Batch operation " << operation << " failed: " << e.what());
+            return {{"error", e.what()}};
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    int worker_count = ServiceConfig::get_llm_worker_count();
+    std::string default_provider; // empty = auto-detect from API keys
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--workers=", 0) == 0) {
+            worker_count = std::max(1, std::atoi(arg.substr(10).c_str()));
+        } else if (arg.rfind("--provider=", 0) == 0) {
+            default_provider = arg.substr(11); // e.g. --provider=replay for offline runs
+        }
+    }
+    
+    try {
+        Tracer::instance().set_service_name("llm_adapter");
+        
+        // Optional response cache shared by all workers (streamed replies bypass it)
+        std::shared_ptr<ResponseCache> response_cache;
+        std::string cache_dir = ResponseCacheConfig::get_directory();
+        if (!cache_dir.empty()) {
+            response_cache = std::make_shared<ResponseCache>(
+                cache_dir, ResponseCacheConfig::MEMORY_ENTRIES,
+                std::chrono::seconds(ResponseCacheConfig::get_ttl_seconds()),
+                ResponseCacheConfig::get_disk_entries());
+            std::cout << "Response cache enabled at " << cache_dir << std::endl;
+        }
+        
+        // Optional capture of live responses for the replay provider
+        std::shared_ptr<ResponseRecorder> recorder;
+        std::string record_file = ReplayConfig::get_record_file();
+        if (!record_file.empty()) {
+            recorder = std::make_shared<ResponseRecorder>(record_file);
+            std::cout << "Recording provider responses to " << record_file << std::endl;
+        }
+        
+        // One client pool per worker (auto-detected default provider)
+        LLMClientPool stream_clients(default_provider);
+        StreamRegistry streams(stream_clients);
+        
+        // Race mode needs a second provider to hedge to; its latency history is shared by all workers
+        LLMClientPool race_clients;
+        race_clients.set_response_cache(response_cache);
+        race_clients.set_recorder(recorder);
+        std::unique_ptr<HedgedPlanner> planner;
+        std::vector<std::string> available = ProviderFactory::detect_available_providers();
+        if (available.size() > 1) {
+            planner = std::make_unique<HedgedPlanner>(available,
+                [&race_clients](const std::string& provider, const std::string& prompt,
+                                const CancellationToken& cancel, ResponseMetadata* metadata) {
+                    return race_clients.get(provider).get_plan_from_llm(prompt, metadata, &cancel);
+                },
+                HedgeConfig::get_percentile(), HedgeConfig::MAX_ATTEMPTS);
+            std::cout << "Race mode available across " << available.size() << " providers"
+                      << (HedgeConfig::race_by_default() ? " (on by default)" : "") << std::endl;
+        }
+        
+        // Named tenants get their own clients and their own share of the workers
+        TenantRegistry tenants(default_provider);
+        tenants.configure(TenantConfig::get_weights(), TenantConfig::get_providers());
+        tenants.set_response_cache(response_cache);
+        tenants.set_recorder(recorder);
+        
+        std::vector<std::unique_ptr<LLMAdapterService>> services;
+        for (int i = 0; i < worker_count; ++i) {
+            services.push_back(std::make_unique<LLMAdapterService>(default_provider, streams, tenants,
+                                                                response_cache, recorder, planner.get()));
         }
+        
+        const LLMClient& default_client = services.front()->default_client();
+        std::cout << "Using " << default_client.get_current_provider()
+                  << " with model " << default_client.get_current_model() << std::endl;
+        
+        // Provider, system prompts and the provider connection are set up off the startup path
+        std::thread([&services] {
+            for (auto& service : services) {
+                service->prewarm();
+            }
+        }).detach();
+        
+        ThreadPool pool(worker_count);
+        for (const auto& [tenant, weight] : tenants.weights()) {
+            pool.set_weight(tenant, weight);
         }
+        ServiceMetrics metrics("llm_adapter");
+        Gauge& queued = MetricsRegistry::instance().gauge("mag_worker_queue_depth", {{"service", "llm_adapter"}},
+                                                          "Requests waiting for a free worker");
+        std::string url = NetworkConfig::get_llm_adapter_url();
+        // Parked stream polls hold a context each, on top of what the workers need
+        size_t contexts = worker_count * ServiceConfig::CONTEXTS_PER_WORKER + NetworkConfig::MAX_CONCURRENT_STREAMS;
+        NNGRepServer server(url, contexts, pool,
+            [&services, &metrics, &queued, &pool](size_t worker_index, std::string_view request) {
+                queued.set(static_cast<int64_t>(pool.queued()));
+                ServiceMetrics::RequestScope scope(metrics, request.size());
+                NngMessage reply = services[worker_index]->handle_request(request, scope);
+                scope.add_reply_bytes(reply.size());
+                return reply;
+            });
         
-        nng_close(sock);
+        // Stream polls wait for their next delta without taking a worker
+        server.set_deferrer([&streams](std::string_view request,
+                                       const std::shared_ptr<NNGRepServer::DeferredReply>& reply) {
+            if (request.find("stream_next") == std::string_view::npos) {
+                return NNGRepServer::Deferral{}; // not worth decoding
+            }
+            WireFormat format = WireCodec::detect(request);
+            nlohmann::json decoded = WireCodec::decode(request);
+            if (!decoded.is_object() || decoded.value("operation", "") != "stream_next") {
+                return NNGRepServer::Deferral{};
+            }
+            return streams.poll(decoded.value("stream_id", ""), format, reply);
+        });
+        
+        // Each tenant waits in its own queue, and one with a full queue is told so at once
+        size_t max_queued = TenantConfig::get_max_queued();
+        server.set_admitter([&tenants, &pool, max_queued](std::string_view request) {
+            NNGRepServer::Admission admission;
+            admission.key = tenants.tenant_of(request);
+            bool rejected = !admission.key.empty() && pool.queued(admission.key) >= max_queued;
+            if (rejected) {
+                admission.rejection = NngMessage::encode(LLMAdapterService::error_reply(
+                    "Too many requests queued for tenant " + admission.key + "; try again shortly"),
+                    WireCodec::detect(request));
+            }
+            MetricsRegistry::instance().counter("mag_tenant_requests_total",
+                {{"tenant", admission.key.empty() ? "default" : admission.key},
+                 {"outcome", rejected ? "rejected" : "queued"}},
+                "llm_adapter requests by tenant, queued for a worker or turned away").add(1);
+            return admission;
+        });
+        server.start();
+        
+        std::cout << "LLM Adapter listening on " << url << " with " << worker_count << " workers" << std::endl;
+        
+        // Lets pooled clients find this worker (MAG_WORKER_REGISTRY)
+        auto registration = WorkerRegistration::announce(EndpointConfig::Service::LLM_ADAPTER, url);
+        
+        // Prometheus scrape endpoint (MAG_METRICS_PORT_BASE)
+        auto metrics_server = MetricsServer::start(MetricsConfig::LLM_ADAPTER_OFFSET);
+        
+        // Requests are served from NNG callbacks and the pool
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
         
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
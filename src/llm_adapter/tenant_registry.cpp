@@ -0,0 +1,131 @@
+#include "tenant_registry.h"
+#include "json_extract.h"
+#include "message.h"
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace mag {
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+
+} // anonymous namespace
+
+TenantRegistry::TenantRegistry(std::string default_provider, size_t max_tenants)
+    : default_provider_(std::move(default_provider)), max_tenants_(max_tenants) {}
+
+std::optional<std::map<std::string, std::string>> TenantRegistry::parse_assignments(std::string_view spec) {
+    std::map<std::string, std::string> assignments;
+    std::stringstream stream{std::string(spec)};
+    std::string entry;
+    while (std::getline(stream, entry, ',')) {
+        entry = trim(entry);
+        if (entry.empty()) {
+            continue;
+        }
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            return std::nullopt;
+        }
+        std::string name = trim(entry.substr(0, equals));
+        std::string value = trim(entry.substr(equals + 1));
+        if (name.empty() || value.empty()) {
+            return std::nullopt;
+        }
+        assignments[name] = value;
+    }
+    return assignments;
+}
+
+void TenantRegistry::configure(std::string_view weights, std::string_view providers) {
+    auto weight_list = parse_assignments(weights);
+    auto provider_list = parse_assignments(providers);
+    if (!weight_list || !provider_list) {
+        throw std::invalid_argument("Tenant lists take the form name=value,name=value");
+    }
+
+    for (const auto& [tenant, value] : *weight_list) {
+        char* end = nullptr;
+        double weight = std::strtod(value.c_str(), &end);
+        if (!end || *end != '\0' || !(weight > 0)) {
+            throw std::invalid_argument("Tenant weight must be a positive number: " + tenant + "=" + value);
+        }
+        weights_[tenant] = weight;
+    }
+    for (const auto& [tenant, provider] : *provider_list) {
+        providers_[tenant] = provider;
+    }
+
+    // Configured tenants always get their own place, however many others show up
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [tenant, weight] : weights_) {
+        known_.insert(tenant);
+    }
+    for (const auto& [tenant, provider] : providers_) {
+        known_.insert(tenant);
+    }
+}
+
+std::string TenantRegistry::tenant_of(std::string_view request) {
+    std::optional<std::string> name;
+    if (WireCodec::detect(request) == WireFormat::JSON) {
+        try {
+            name = extract_json_string(request, {"tenant"});
+        } catch (const JsonExtractError&) {
+            // Not JSON after all (a plain prompt): the default tenant
+        }
+    } else {
+        // Binary requests are small next to the provider call they lead to
+        nlohmann::json decoded = WireCodec::decode(request);
+        if (decoded.is_object() && decoded.contains("tenant") && decoded["tenant"].is_string()) {
+            name = decoded["tenant"].get<std::string>();
+        }
+    }
+    return name ? resolve(*name) : std::string();
+}
+
+std::string TenantRegistry::resolve(const std::string& name) {
+    if (name.empty()) {
+        return name;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (known_.count(name)) {
+        return name;
+    }
+    if (known_.size() >= max_tenants_) {
+        return TenantConfig::OVERFLOW_TENANT;
+    }
+    known_.insert(name);
+    return name;
+}
+
+LLMClientPool& TenantRegistry::clients(const std::string& tenant) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<LLMClientPool>& pool = pools_[tenant];
+    if (!pool) {
+        pool = std::make_unique<LLMClientPool>(provider_for(tenant));
+        pool->set_response_cache(response_cache_);
+        pool->set_recorder(recorder_);
+    }
+    return *pool;
+}
+
+std::string TenantRegistry::provider_for(const std::string& tenant) const {
+    auto provider = providers_.find(tenant);
+    return provider != providers_.end() ? provider->second : default_provider_;
+}
+
+size_t TenantRegistry::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return known_.size();
+}
+
+} // namespace mag
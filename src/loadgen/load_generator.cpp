@@ -0,0 +1,400 @@
+#include "load_generator.h"
+#include "network/nng_req_client.h"
+#include "logger.h"
+#include "utils.h"
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace mag {
+
+namespace {
+
+constexpr std::array<LoadOperation, LoadGenerator::OPERATION_COUNT> OPERATIONS = {
+    LoadOperation::PLAN, LoadOperation::CHAT, LoadOperation::DRY_RUN,
+    LoadOperation::APPLY, LoadOperation::STAT, LoadOperation::EXECUTE,
+};
+
+size_t index_of(LoadOperation operation) {
+    return static_cast<size_t>(operation);
+}
+
+// Printable text of exactly `bytes` bytes, led by the sequence so requests differ
+std::string filler(uint64_t sequence, size_t bytes) {
+    std::string text = "#" + std::to_string(sequence) + " ";
+    while (text.size() < bytes) {
+        text += "the quick brown fox jumps over the lazy dog ";
+    }
+    text.resize(bytes);
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+
+double to_ms(uint64_t micros) {
+    return static_cast<double>(micros) / 1000.0;
+}
+
+nlohmann::json latency_json(const LatencyHistogram& latency) {
+    uint64_t count = latency.count();
+    return {
+        {"p50_ms", to_ms(latency.percentile_micros(0.50))},
+        {"p99_ms", to_ms(latency.percentile_micros(0.99))},
+        {"p999_ms", to_ms(latency.percentile_micros(0.999))},
+        {"max_ms", to_ms(latency.max_micros())},
+        {"mean_ms", count == 0 ? 0.0 : to_ms(latency.sum_micros()) / static_cast<double>(count)}
+    };
+}
+
+} // anonymous namespace
+
+LoadGenerator::LoadGenerator(LoadConfig config, Dispatch dispatch)
+    : config_(std::move(config)), dispatch_(std::move(dispatch)), format_(WireCodec::configured()) {
+    if (config_.concurrency == 0) {
+        config_.concurrency = 1;
+    }
+    if (config_.file_count == 0) {
+        config_.file_count = 1;
+    }
+    if (config_.mix.empty()) {
+        throw std::invalid_argument("Load mix has no operations");
+    }
+}
+
+EndpointConfig::Service LoadGenerator::service_of(LoadOperation operation) {
+    switch (operation) {
+        case LoadOperation::PLAN:
+        case LoadOperation::CHAT:
+            return EndpointConfig::Service::LLM_ADAPTER;
+        case LoadOperation::DRY_RUN:
+        case LoadOperation::APPLY:
+        case LoadOperation::STAT:
+            return EndpointConfig::Service::FILE_TOOL;
+        case LoadOperation::EXECUTE:
+            break;
+    }
+    return EndpointConfig::Service::BASH_TOOL;
+}
+
+const char* LoadGenerator::operation_name(LoadOperation operation) {
+    switch (operation) {
+        case LoadOperation::PLAN: return "plan";
+        case LoadOperation::CHAT: return "chat";
+        case LoadOperation::DRY_RUN: return "dry_run";
+        case LoadOperation::APPLY: return "apply";
+        case LoadOperation::STAT: return "stat";
+        case LoadOperation::EXECUTE: break;
+    }
+    return "execute";
+}
+
+std::optional<LoadOperation> LoadGenerator::parse_operation(const std::string& name) {
+    for (LoadOperation operation : OPERATIONS) {
+        if (name == operation_name(operation)) {
+            return operation;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::vector<LoadMixEntry>> LoadGenerator::parse_mix(const std::string& spec) {
+    std::vector<LoadMixEntry> mix;
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        item = trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        size_t colon = item.find(':');
+        auto operation = parse_operation(trim(item.substr(0, colon)));
+        if (!operation) {
+            return std::nullopt;
+        }
+        double weight = 1;
+        if (colon != std::string::npos) {
+            try {
+                weight = std::stod(item.substr(colon + 1));
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+        }
+        if (!(weight > 0)) {
+            return std::nullopt;
+        }
+        mix.push_back({*operation, weight});
+    }
+    if (mix.empty()) {
+        return std::nullopt;
+    }
+    return mix;
+}
+
+bool LoadGenerator::is_error_reply(std::string_view reply) {
+    nlohmann::json decoded;
+    try {
+        decoded = WireCodec::decode(reply);
+    } catch (const std::exception&) {
+        return true;
+    }
+    if (!decoded.is_object()) {
+        return false;
+    }
+    return decoded.contains("error") || !decoded.value("success", true);
+}
+
+std::string LoadGenerator::path_for(uint64_t sequence) const {
+    return config_.directory + "/load_" + std::to_string(sequence % config_.file_count) + ".txt";
+}
+
+NngMessage LoadGenerator::build_request(LoadOperation operation, uint64_t sequence) const {
+    NngMessage request;
+    switch (operation) {
+        case LoadOperation::PLAN:
+        case LoadOperation::CHAT: {
+            nlohmann::json j = {{"prompt", filler(sequence, config_.payload_bytes)}};
+            if (!config_.provider.empty()) {
+                j["provider"] = config_.provider;
+            }
+            if (operation == LoadOperation::CHAT) {
+                j["chat_mode"] = true;
+                j["envelope"] = true; // so a failure is distinguishable from a reply
+            }
+            return NngMessage::encode(j, format_);
+        }
+        case LoadOperation::DRY_RUN:
+        case LoadOperation::APPLY: {
+            WriteFileCommand command;
+            command.command = WriteFileCommand::WRITE;
+            command.path = path_for(sequence);
+            command.content = filler(sequence, config_.payload_bytes);
+            MessageHandler::serialize_file_request(operation_name(operation), command, format_, request);
+            return request;
+        }
+        case LoadOperation::STAT: {
+            ReadFileRequest read;
+            read.path = path_for(sequence);
+            MessageHandler::serialize_read_request("stat", read, format_, request);
+            return request;
+        }
+        case LoadOperation::EXECUTE:
+            break;
+    }
+    nlohmann::json j = {
+        {"operation", "execute"},
+        {"command", "echo " + filler(sequence, config_.payload_bytes)},
+        {"working_directory", Utils::get_current_working_directory()}
+    };
+    return NngMessage::encode(j, format_);
+}
+
+void LoadGenerator::issue(LoadOperation operation, uint64_t sequence, Clock::time_point due) {
+    OperationStats& stats = stats_[index_of(operation)];
+    try {
+        NngMessage reply = dispatch_(service_of(operation), build_request(operation, sequence));
+        if (is_error_reply(reply.body())) {
+            stats.errors.add();
+        } else {
+            stats.ok.add();
+        }
+    } catch (const RequestTimeoutError&) {
+        stats.timeouts.add();
+    } catch (const std::exception& e) {
+        MAG_LOG_DEBUG("loadgen", operation_name(operation) << " #" << sequence << " failed: " << e.what());
+        stats.failures.add();
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due);
+    stats.latency.record(latency);
+    overall_.record(latency);
+}
+
+void LoadGenerator::run() {
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + config_.duration;
+    if (config_.mode == LoadConfig::Mode::OPEN) {
+        run_open(deadline);
+    } else {
+        run_closed(deadline);
+    }
+    elapsed_seconds_ = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void LoadGenerator::run_closed(Clock::time_point deadline) {
+    std::vector<double> weights;
+    for (const LoadMixEntry& entry : config_.mix) {
+        weights.push_back(entry.weight);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < config_.concurrency; ++w) {
+        workers.emplace_back([this, w, deadline, &weights] {
+            std::mt19937_64 rng(config_.seed + w);
+            std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+            while (Clock::now() < deadline) {
+                uint64_t sequence = next_sequence_.fetch_add(1);
+                if (config_.max_requests > 0 && sequence >= config_.max_requests) {
+                    break;
+                }
+                issue(config_.mix[pick(rng)].operation, sequence, Clock::now());
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void LoadGenerator::run_open(Clock::time_point deadline) {
+    struct Ticket {
+        LoadOperation operation;
+        uint64_t sequence;
+        Clock::time_point due;
+    };
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Ticket> queue;
+    bool scheduled_all = false;
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < config_.concurrency; ++w) {
+        workers.emplace_back([&, deadline] {
+            while (true) {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait_until(lock, deadline, [&] { return !queue.empty() || scheduled_all; });
+                if (queue.empty() || Clock::now() >= deadline) {
+                    return;
+                }
+                Ticket ticket = queue.front();
+                queue.pop_front();
+                lock.unlock();
+                issue(ticket.operation, ticket.sequence, ticket.due);
+            }
+        });
+    }
+
+    // Fixed inter-arrival times; the schedule never waits for replies
+    std::vector<double> weights;
+    for (const LoadMixEntry& entry : config_.mix) {
+        weights.push_back(entry.weight);
+    }
+    std::mt19937_64 rng(config_.seed);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / (config_.rate > 0 ? config_.rate : 1.0)));
+    Clock::time_point first = Clock::now();
+
+    for (uint64_t sequence = 0;; ++sequence) {
+        if (config_.max_requests > 0 && sequence >= config_.max_requests) {
+            break;
+        }
+        Clock::time_point due = first + interval * static_cast<int64_t>(sequence);
+        if (due >= deadline) {
+            break;
+        }
+        std::this_thread::sleep_until(due);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({config_.mix[pick(rng)].operation, sequence, due});
+        }
+        ready.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        scheduled_all = true;
+    }
+    ready.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    unsent_ = queue.size();
+}
+
+nlohmann::json LoadGenerator::report() const {
+    uint64_t total = 0;
+    nlohmann::json operations = nlohmann::json::object();
+    double elapsed = elapsed_seconds_ > 0 ? elapsed_seconds_ : 1.0;
+
+    for (LoadOperation operation : OPERATIONS) {
+        const OperationStats& stats = stats_[index_of(operation)];
+        uint64_t count = stats.latency.count();
+        if (count == 0) {
+            continue;
+        }
+        total += count;
+        nlohmann::json entry = {
+            {"service", EndpointConfig::service_name(service_of(operation))},
+            {"requests", count},
+            {"ok", stats.ok.value()},
+            {"errors", stats.errors.value()},
+            {"timeouts", stats.timeouts.value()},
+            {"failures", stats.failures.value()},
+            {"throughput_rps", static_cast<double>(count) / elapsed}
+        };
+        entry.update(latency_json(stats.latency));
+        operations[operation_name(operation)] = entry;
+    }
+
+    nlohmann::json j = {
+        {"mode", config_.mode == LoadConfig::Mode::OPEN ? "open" : "closed"},
+        {"concurrency", config_.concurrency},
+        {"payload_bytes", config_.payload_bytes},
+        {"elapsed_seconds", elapsed_seconds_},
+        {"requests", total},
+        {"throughput_rps", static_cast<double>(total) / elapsed},
+        {"operations", operations}
+    };
+    if (config_.mode == LoadConfig::Mode::OPEN) {
+        j["target_rps"] = config_.rate;
+        j["unsent"] = unsent_;
+    }
+    j.update(latency_json(overall_));
+    return j;
+}
+
+std::string LoadGenerator::summary() const {
+    nlohmann::json r = report();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << r["requests"].get<uint64_t>() << " requests in " << r["elapsed_seconds"].get<double>() << "s ("
+        << r["mode"].get<std::string>() << " loop, concurrency " << config_.concurrency;
+    if (config_.mode == LoadConfig::Mode::OPEN) {
+        out << ", target " << config_.rate << " rps, " << unsent_ << " unsent";
+    }
+    out << ")\n";
+    out << std::left << std::setw(10) << "operation" << std::right
+        << std::setw(9) << "requests" << std::setw(8) << "errors" << std::setw(10) << "rps"
+        << std::setw(11) << "p50 ms" << std::setw(11) << "p99 ms" << std::setw(11) << "p999 ms"
+        << std::setw(11) << "max ms" << "\n";
+    auto row = [&](const std::string& name, const nlohmann::json& entry, uint64_t errors) {
+        out << std::left << std::setw(10) << name << std::right
+            << std::setw(9) << entry["requests"].get<uint64_t>() << std::setw(8) << errors
+            << std::setw(10) << entry["throughput_rps"].get<double>()
+            << std::setw(11) << entry["p50_ms"].get<double>() << std::setw(11) << entry["p99_ms"].get<double>()
+            << std::setw(11) << entry["p999_ms"].get<double>() << std::setw(11) << entry["max_ms"].get<double>()
+            << "\n";
+    };
+    uint64_t all_errors = 0;
+    for (const auto& [name, entry] : r["operations"].items()) {
+        uint64_t errors = entry["errors"].get<uint64_t>() + entry["timeouts"].get<uint64_t>() +
+                          entry["failures"].get<uint64_t>();
+        all_errors += errors;
+        row(name, entry, errors);
+    }
+    row("total", r, all_errors);
+    return out.str();
+}
+
+} // namespace mag
@@ -0,0 +1,167 @@
+#include "load_generator.h"
+#include "network/endpoint_pool.h"
+#include "config.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+
+using namespace mag;
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [OPTIONS]\n\n";
+    std::cout << "Sends synthetic requests straight to llm_adapter, file_tool and bash_tool_service\n";
+    std::cout << "over NNG (endpoints from .mag/network.json / MAG_*_URL) and reports throughput\n";
+    std::cout << "and p50/p99/p999 latency per operation.\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --mode=MODE          closed (default): each worker waits for its reply; open: fixed arrival rate\n";
+    std::cout << "  --concurrency=N      Workers sending requests (default: 8)\n";
+    std::cout << "  --rate=RPS           Open loop arrival rate in requests per second (default: 100)\n";
+    std::cout << "  --duration=SECONDS   Length of the run (default: 10)\n";
+    std::cout << "  --requests=N         Stop after N requests (default: no limit)\n";
+    std::cout << "  --payload=BYTES      Prompt, file content or echoed text size (default: 1024)\n";
+    std::cout << "  --mix=SPEC           Weighted operations, e.g. plan:1,dry_run:4,execute:2 (default: plan,dry_run,execute)\n";
+    std::cout << "                       Operations: plan, chat, dry_run, apply, stat, execute\n";
+    std::cout << "  --provider=NAME      Provider for plan and chat requests (default: replay)\n";
+    std::cout << "  --dir=DIR            Directory file requests point into (default: loadgen)\n";
+    std::cout << "  --timeout=MS         Per-request deadline (default: the services' configured timeouts)\n";
+    std::cout << "  --seed=N             Seed for the operation mix (default: 1)\n";
+    std::cout << "  --json=FILE          Also write the report as JSON (- for stdout)\n";
+    std::cout << "  --help               Show this help message\n\n";
+    std::cout << "Examples:\n";
+    std::cout << "  MAG_REPLAY_FILE=capture.jsonl MAG_REPLAY_STRICT=0 llm_adapter &  # replay provider, no API calls\n";
+    std::cout << "  " << program_name << " --mix=plan --concurrency=32 --duration=30\n";
+    std::cout << "  " << program_name << " --mode=open --rate=500 --mix=dry_run:3,stat:1 --json=report.json\n";
+}
+
+namespace {
+
+bool parse_positive(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return end != text.c_str() && *end == '\0' && value > 0;
+}
+
+std::chrono::milliseconds service_timeout(EndpointConfig::Service service) {
+    switch (service) {
+        case EndpointConfig::Service::LLM_ADAPTER:
+            return std::chrono::milliseconds(RequestTimeoutConfig::get_llm_timeout_ms());
+        case EndpointConfig::Service::FILE_TOOL:
+            return std::chrono::milliseconds(RequestTimeoutConfig::get_file_timeout_ms());
+        case EndpointConfig::Service::BASH_TOOL:
+            break;
+    }
+    return std::chrono::milliseconds(RequestTimeoutConfig::get_bash_timeout_ms());
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+    std::string json_file;
+    std::chrono::milliseconds timeout(0);
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') == std::string::npos ? arg.size() : arg.find('=') + 1);
+        double number = 0;
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg.find("--mode=") == 0) {
+            if (value == "open") {
+                config.mode = LoadConfig::Mode::OPEN;
+            } else if (value == "closed") {
+                config.mode = LoadConfig::Mode::CLOSED;
+            } else {
+                std::cerr << "Error: --mode must be open or closed" << std::endl;
+                return 1;
+            }
+        } else if (arg.find("--mix=") == 0) {
+            auto mix = LoadGenerator::parse_mix(value);
+            if (!mix) {
+                std::cerr << "Error: Invalid mix '" << value << "'" << std::endl;
+                std::cerr << "Valid operations: plan, chat, dry_run, apply, stat, execute" << std::endl;
+                return 1;
+            }
+            config.mix = *mix;
+        } else if (arg.find("--provider=") == 0) {
+            config.provider = value;
+        } else if (arg.find("--dir=") == 0) {
+            config.directory = value;
+        } else if (arg.find("--json=") == 0) {
+            json_file = value;
+        } else if (arg.find("--concurrency=") == 0 || arg.find("--rate=") == 0 || arg.find("--duration=") == 0 ||
+                   arg.find("--requests=") == 0 || arg.find("--payload=") == 0 || arg.find("--timeout=") == 0 ||
+                   arg.find("--seed=") == 0) {
+            std::string option = arg.substr(0, arg.find('='));
+            if (!parse_positive(value, number)) {
+                std::cerr << "Error: " << option << " needs a positive number" << std::endl;
+                return 1;
+            }
+            if (option == "--concurrency") {
+                config.concurrency = static_cast<size_t>(number);
+            } else if (option == "--rate") {
+                config.rate = number;
+            } else if (option == "--duration") {
+                config.duration = std::chrono::milliseconds(static_cast<int64_t>(number * 1000));
+            } else if (option == "--requests") {
+                config.max_requests = static_cast<size_t>(number);
+            } else if (option == "--payload") {
+                config.payload_bytes = static_cast<size_t>(number);
+            } else if (option == "--timeout") {
+                timeout = std::chrono::milliseconds(static_cast<int64_t>(number));
+            } else {
+                config.seed = static_cast<uint64_t>(number);
+            }
+        } else {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    try {
+        // One pool per service in the mix, spread over its workers like the real clients
+        std::map<EndpointConfig::Service, std::unique_ptr<EndpointPool>> pools;
+        for (const LoadMixEntry& entry : config.mix) {
+            EndpointConfig::Service service = LoadGenerator::service_of(entry.operation);
+            if (!pools.count(service)) {
+                pools[service] = std::make_unique<EndpointPool>(
+                    service, EndpointConfig::service_name(service),
+                    timeout.count() > 0 ? timeout : service_timeout(service));
+            }
+        }
+
+        LoadGenerator generator(config, [&pools](EndpointConfig::Service service, NngMessage request) {
+            return pools.at(service)->send(std::move(request));
+        });
+
+        std::cerr << "Running " << (config.mode == LoadConfig::Mode::OPEN ? "open" : "closed")
+                  << " loop load for " << config.duration.count() / 1000.0 << "s..." << std::endl;
+        generator.run();
+        std::cout << generator.summary();
+
+        if (!json_file.empty()) {
+            std::string report = generator.report().dump(2);
+            if (json_file == "-") {
+                std::cout << report << std::endl;
+            } else {
+                std::ofstream out(json_file);
+                if (!out) {
+                    std::cerr << "Error: Cannot write " << json_file << std::endl;
+                    return 1;
+                }
+                out << report << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
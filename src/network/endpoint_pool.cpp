@@ -0,0 +1,312 @@
+#include "network/endpoint_pool.h"
+#include "config.h"
+#include "logger.h"
+#include "worker_registry.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mag {
+
+void EndpointHealth::record(NNGReqClient::Outcome outcome, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (outcome) {
+        case NNGReqClient::Outcome::OK:
+            consecutive_failures_ = 0;
+            ejections_in_a_row_ = 0;
+            return;
+        case NNGReqClient::Outcome::CANCELLED:
+            return;
+        case NNGReqClient::Outcome::TIMED_OUT:
+        case NNGReqClient::Outcome::FAILED:
+            break;
+    }
+    
+    // A failure while ejected (calls already in flight) does not extend the cool-down
+    if (now < ejected_until_ || ++consecutive_failures_ < EndpointPoolConfig::EJECT_AFTER_FAILURES) {
+        return;
+    }
+    int64_t cooldown = EndpointPoolConfig::EJECT_BASE_MS;
+    for (size_t i = 0; i < ejections_in_a_row_ && cooldown < EndpointPoolConfig::EJECT_MAX_MS; ++i) {
+        cooldown *= 2;
+    }
+    cooldown = std::min<int64_t>(cooldown, EndpointPoolConfig::EJECT_MAX_MS);
+    ++ejections_in_a_row_;
+    ejected_until_ = now + std::chrono::milliseconds(cooldown);
+    
+    // Left at the threshold so the first failure after the cool-down ejects again
+    consecutive_failures_ = EndpointPoolConfig::EJECT_AFTER_FAILURES - 1;
+}
+
+bool EndpointHealth::available(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return now >= ejected_until_;
+}
+
+EndpointHealth::Clock::time_point EndpointHealth::ejected_until() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ejected_until_;
+}
+
+size_t EndpointHealth::consecutive_failures() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return consecutive_failures_;
+}
+
+EndpointPool::EndpointPool(EndpointConfig::Service service, std::string service_name,
+                           std::chrono::milliseconds default_timeout)
+    : EndpointPool(EndpointConfig::instance().urls(service), std::move(service_name), default_timeout,
+                   EndpointConfig::instance().registry_directory(), EndpointConfig::service_name(service)) {
+}
+
+EndpointPool::EndpointPool(const std::vector<std::string>& urls, std::string service_name,
+                           std::chrono::milliseconds default_timeout,
+                           std::string registry_directory, std::string registry_service)
+    : service_name_(std::move(service_name)), default_timeout_(default_timeout),
+      registry_directory_(std::move(registry_directory)), registry_service_(std::move(registry_service)) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& url : urls) {
+        if (std::none_of(endpoints_.begin(), endpoints_.end(), [&](const Endpoint& e) { return e.url == url; })) {
+            Endpoint endpoint;
+            endpoint.url = url;
+            endpoints_.push_back(std::move(endpoint));
+        }
+    }
+    std::vector<std::shared_ptr<NNGReqClient>> retired;
+    if (!registry_directory_.empty()) {
+        scan_registry(now, retired);
+    }
+    
+    bool any_connected = false;
+    for (auto& endpoint : endpoints_) {
+        any_connected |= connect(endpoint, now);
+    }
+    if (!any_connected && registry_directory_.empty()) {
+        // Same failure the single-endpoint client reported before pooling
+        throw std::runtime_error(endpoints_.empty() ? "No " + service_name_ + " endpoints configured"
+                                                    : endpoints_.front().last_error);
+    }
+    if (endpoints_.size() > 1 || !registry_directory_.empty()) {
+        MAG_LOG_INFO("nng", service_name_ << " pool with " << endpoints_.size() << " endpoints"
+                     << (registry_directory_.empty() ? "" : " (following " + registry_directory_ + ")"));
+    }
+}
+
+EndpointPool::~EndpointPool() = default;
+
+bool EndpointPool::connect(Endpoint& endpoint, Clock::time_point now) {
+    if (endpoint.client) {
+        return true;
+    }
+    if (now < endpoint.next_dial) {
+        return false;
+    }
+    try {
+        auto client = std::make_shared<NNGReqClient>(endpoint.url, service_name_, default_timeout_);
+        client->set_completion_hook([health = endpoint.health](NNGReqClient::Outcome outcome) {
+            health->record(outcome);
+        });
+        endpoint.client = std::move(client);
+        endpoint.last_error.clear();
+        return true;
+    } catch (const std::exception& e) {
+        if (endpoint.last_error.empty()) {
+            MAG_LOG_WARN("nng", service_name_ << " endpoint " << endpoint.url << " unreachable: " << e.what());
+        }
+        endpoint.last_error = e.what();
+        endpoint.next_dial = now + std::chrono::milliseconds(EndpointPoolConfig::REDIAL_INTERVAL_MS);
+        return false;
+    }
+}
+
+void EndpointPool::scan_registry(Clock::time_point now, std::vector<std::shared_ptr<NNGReqClient>>& retired) {
+    next_scan_ = now + std::chrono::milliseconds(EndpointPoolConfig::REGISTRY_SCAN_MS);
+    std::vector<std::string> live = WorkerRegistration::discover(registry_directory_, registry_service_);
+    
+    // Workers that left; calls still in flight to them are cancelled
+    auto gone = std::remove_if(endpoints_.begin(), endpoints_.end(), [&](const Endpoint& endpoint) {
+        return endpoint.registered && !std::binary_search(live.begin(), live.end(), endpoint.url);
+    });
+    for (auto it = gone; it != endpoints_.end(); ++it) {
+        MAG_LOG_INFO("nng", service_name_ << " worker " << it->url << " left");
+        retired.push_back(std::move(it->client));
+    }
+    endpoints_.erase(gone, endpoints_.end());
+    
+    for (const auto& url : live) {
+        if (std::none_of(endpoints_.begin(), endpoints_.end(), [&](const Endpoint& e) { return e.url == url; })) {
+            MAG_LOG_INFO("nng", service_name_ << " worker " << url << " joined");
+            Endpoint endpoint;
+            endpoint.url = url;
+            endpoint.registered = true;
+            endpoints_.push_back(std::move(endpoint));
+        }
+    }
+}
+
+std::shared_ptr<NNGReqClient> EndpointPool::pick(std::vector<std::shared_ptr<NNGReqClient>>& retired) {
+    auto now = Clock::now();
+    if (!registry_directory_.empty() && now >= next_scan_) {
+        scan_registry(now, retired);
+    }
+    if (endpoints_.empty()) {
+        throw std::runtime_error("No " + service_name_ + " endpoints available");
+    }
+    
+    // Least outstanding requests among the healthy endpoints; the start
+    // rotates so equally loaded endpoints take turns
+    Endpoint* best = nullptr;
+    size_t best_load = 0;
+    Endpoint* due_back_first = nullptr;
+    size_t count = endpoints_.size();
+    size_t start = rotation_++ % count;
+    for (size_t i = 0; i < count; ++i) {
+        Endpoint& endpoint = endpoints_[(start + i) % count];
+        if (!connect(endpoint, now)) {
+            continue;
+        }
+        if (!endpoint.health->available(now)) {
+            if (!due_back_first || endpoint.health->ejected_until() < due_back_first->health->ejected_until()) {
+                due_back_first = &endpoint;
+            }
+            continue;
+        }
+        size_t load = endpoint.client->in_flight();
+        if (!best || load < best_load) {
+            best = &endpoint;
+            best_load = load;
+        }
+    }
+    
+    if (!best) {
+        best = due_back_first;
+    }
+    if (!best) {
+        throw std::runtime_error("No " + service_name_ + " endpoint reachable: " + endpoints_.front().last_error);
+    }
+    return best->client;
+}
+
+std::shared_ptr<NNGReqClient> EndpointPool::pin() {
+    std::vector<std::shared_ptr<NNGReqClient>> retired; // destroyed after the lock is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pick(retired);
+}
+
+std::shared_ptr<NNGReqClient> EndpointPool::pin(const std::string& key) {
+    std::vector<std::shared_ptr<NNGReqClient>> retired; // destroyed after the lock is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto sticky = sticky_.find(key);
+    if (sticky != sticky_.end()) {
+        auto now = Clock::now();
+        for (auto& endpoint : endpoints_) {
+            if (endpoint.url == sticky->second && connect(endpoint, now) && endpoint.health->available(now)) {
+                return endpoint.client;
+            }
+        }
+        MAG_LOG_WARN("nng", service_name_ << " endpoint " << sticky->second << " for " << key
+                     << " is gone or unhealthy; moving it to another");
+    }
+    
+    std::shared_ptr<NNGReqClient> client = pick(retired);
+    for (const auto& endpoint : endpoints_) {
+        if (endpoint.client == client) {
+            sticky_[key] = endpoint.url;
+            break;
+        }
+    }
+    return client;
+}
+
+std::future<NngMessage> EndpointPool::send_async(NngMessage request, std::chrono::milliseconds timeout,
+                                                 const CancellationToken* cancel) {
+    return pin()->send_async(std::move(request), timeout, cancel);
+}
+
+NngMessage EndpointPool::send(NngMessage request, std::chrono::milliseconds timeout,
+                              const CancellationToken* cancel) {
+    return pin()->send(std::move(request), timeout, cancel);
+}
+
+std::future<std::string> EndpointPool::request_async(const std::string& payload, std::chrono::milliseconds timeout,
+                                                     const CancellationToken* cancel) {
+    return pin()->request_async(payload, timeout, cancel);
+}
+
+std::string EndpointPool::request(const std::string& payload, std::chrono::milliseconds timeout,
+                                  const CancellationToken* cancel) {
+    return pin()->request(payload, timeout, cancel);
+}
+
+void EndpointPool::add_endpoint(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& endpoint : endpoints_) {
+        if (endpoint.url == url) {
+            endpoint.registered = false; // now pinned by the caller, not the registry
+            return;
+        }
+    }
+    Endpoint endpoint;
+    endpoint.url = url;
+    connect(endpoint, Clock::now());
+    endpoints_.push_back(std::move(endpoint));
+}
+
+void EndpointPool::remove_endpoint(const std::string& url) {
+    std::shared_ptr<NNGReqClient> retired;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(endpoints_.begin(), endpoints_.end(), [&](const Endpoint& e) { return e.url == url; });
+    if (it != endpoints_.end()) {
+        retired = std::move(it->client);
+        endpoints_.erase(it);
+    }
+}
+
+void EndpointPool::cancel_all() {
+    std::vector<std::shared_ptr<NNGReqClient>> clients;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& endpoint : endpoints_) {
+            if (endpoint.client) {
+                clients.push_back(endpoint.client);
+            }
+        }
+    }
+    for (const auto& client : clients) {
+        client->cancel_all();
+    }
+}
+
+size_t EndpointPool::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const auto& endpoint : endpoints_) {
+        if (endpoint.client) {
+            total += endpoint.client->in_flight();
+        }
+    }
+    return total;
+}
+
+size_t EndpointPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return endpoints_.size();
+}
+
+std::vector<EndpointStatus> EndpointPool::status() const {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<EndpointStatus> result;
+    for (const auto& endpoint : endpoints_) {
+        EndpointStatus status;
+        status.url = endpoint.url;
+        status.connected = endpoint.client != nullptr;
+        status.available = status.connected && endpoint.health->available(now);
+        status.in_flight = status.connected ? endpoint.client->in_flight() : 0;
+        status.consecutive_failures = endpoint.health->consecutive_failures();
+        result.push_back(std::move(status));
+    }
+    return result;
+}
+
+} // namespace mag
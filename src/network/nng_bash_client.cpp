@@ -0,0 +1,260 @@
+#include "network/nng_bash_client.h"
+#include "config.h"
+#include "utils.h"
+#include "logger.h"
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+namespace mag {
+
+namespace {
+
+// bash_tool's shell for requests that name no session; its exports and cd's
+// only carry over if every such request reaches the same worker
+const std::string DEFAULT_SESSION = "default";
+
+CommandResult failed_result(const std::string& command, const std::string& error) {
+    CommandResult result;
+    result.command = command;
+    result.success = false;
+    result.stderr_output = error;
+    result.exit_code = -1;
+    return result;
+}
+
+std::string request_directory(const BashCommand& command) {
+    return command.working_directory.empty() ? Utils::get_current_working_directory() : command.working_directory;
+}
+
+// The result fields of an execute, status, wait or final execute_next reply
+void read_result(const nlohmann::json& reply, CommandResult& result) {
+    result.exit_code = reply.value("exit_code", -1);
+    result.success = reply.value("success", false);
+    result.timed_out = reply.value("timed_out", false);
+    result.cancelled = reply.value("cancelled", false);
+    result.cached = reply.value("cached", false);
+    if (reply.contains("stdout_output")) {
+        result.stdout_output = WireCodec::get_bytes(reply, "stdout_output");
+    }
+    if (reply.contains("stderr_output")) {
+        result.stderr_output = WireCodec::get_bytes(reply, "stderr_output");
+    }
+    result.stdout_bytes = reply.value("stdout_bytes", uint64_t{result.stdout_output.size()});
+    result.stderr_bytes = reply.value("stderr_bytes", uint64_t{result.stderr_output.size()});
+    result.stdout_log = reply.value("stdout_log", "");
+    result.stderr_log = reply.value("stderr_log", "");
+    result.working_directory = reply.value("working_directory_before", "");
+    result.pwd_after_execution = reply.value("working_directory_after", "");
+    if (reply.contains("usage")) {
+        const nlohmann::json& usage = reply["usage"];
+        result.usage.user_cpu = std::chrono::microseconds(usage.value("user_cpu_us", int64_t{0}));
+        result.usage.system_cpu = std::chrono::microseconds(usage.value("system_cpu_us", int64_t{0}));
+        result.usage.max_rss_kb = usage.value("max_rss_kb", uint64_t{0});
+        result.usage.blocks_read = usage.value("blocks_read", uint64_t{0});
+        result.usage.blocks_written = usage.value("blocks_written", uint64_t{0});
+    }
+    if (reply.contains("error_message")) {
+        result.stderr_output += reply.value("error_message", "");
+    }
+}
+
+} // anonymous namespace
+
+NNGBashClient::NNGBashClient()
+    : client_(std::make_unique<EndpointPool>(EndpointConfig::Service::BASH_TOOL, "bash tool",
+                                             std::chrono::milliseconds(RequestTimeoutConfig::get_bash_timeout_ms()))) {
+}
+
+NNGBashClient::~NNGBashClient() = default;
+
+CommandResult NNGBashClient::execute(const BashCommand& command) {
+    try {
+        // Create JSON in the format expected by bash_tool_service
+        nlohmann::json request;
+        request["operation"] = "execute";
+        request["command"] = command.bash_command;
+        request["working_directory"] = request_directory(command);
+        
+        WireFormat format = WireCodec::configured();
+        MAG_LOG_DEBUG("orchestrator", "Bash request (" << WireCodec::format_name(format) << "): "
+                      << Logger::truncate(request.dump()));
+        
+        NngMessage reply = client_->pin(DEFAULT_SESSION)->send(NngMessage::encode(request, format));
+        nlohmann::json response_json = WireCodec::decode(reply.body());
+        MAG_LOG_DEBUG("orchestrator", "Bash response: " << Logger::truncate(response_json.dump()));
+        
+        CommandResult result;
+        result.command = command.bash_command;  // Use the original command from request
+        read_result(response_json, result);
+        return result;
+    } catch (const RequestCancelledError& e) {
+        return failed_result(command.bash_command, e.what());
+    } catch (const std::exception& e) {
+        MAG_LOG_ERROR("orchestrator", "Exception in bash execution: " << e.what());
+        return failed_result(command.bash_command, "Bash execution error: " + std::string(e.what()));
+    }
+}
+
+CommandResult NNGBashClient::execute_stream(const BashCommand& command, const BashTool::OutputHandler& on_output) {
+    CancellationToken cancel;
+    {
+        std::lock_guard<std::mutex> lock(streaming_mutex_);
+        streaming_ = cancel;
+    }
+    
+    try {
+        // The job lives in one bash tool process, so every poll goes back to it;
+        // it runs in the default session, which lives there too
+        std::shared_ptr<NNGReqClient> worker = client_->pin(DEFAULT_SESSION);
+        WireFormat format = WireCodec::configured();
+        nlohmann::json request = {
+            {"operation", "execute_start"},
+            {"command", command.bash_command},
+            {"working_directory", request_directory(command)}
+        };
+        nlohmann::json started = WireCodec::decode(worker->send(NngMessage::encode(request, format)).body());
+        if (!started.contains("job_id")) {
+            // A bash tool without streaming: run it the old way
+            return IBashClient::execute_stream(command, on_output);
+        }
+        nlohmann::json poll = {{"operation", "execute_next"}, {"job_id", started["job_id"]}};
+        
+        CommandResult result;
+        result.command = command.bash_command;
+        bool cancel_sent = false;
+        while (true) {
+            if (cancel.is_cancelled() && !cancel_sent) {
+                // Kill the job, then keep draining it for its final result
+                nlohmann::json stop = {{"operation", "execute_cancel"}, {"job_id", started["job_id"]}};
+                worker->send(NngMessage::encode(stop, format));
+                cancel_sent = true;
+            }
+            
+            nlohmann::json chunk;
+            try {
+                chunk = WireCodec::decode(worker->send(NngMessage::encode(poll, format)).body());
+            } catch (const RequestCancelledError&) {
+                continue; // cancel_pending() cut the poll short; the job is stopped next time round
+            }
+            
+            std::string out = chunk.contains("stdout_delta") ? WireCodec::get_bytes(chunk, "stdout_delta") : "";
+            std::string err = chunk.contains("stderr_delta") ? WireCodec::get_bytes(chunk, "stderr_delta") : "";
+            result.stdout_output += out;
+            result.stderr_output += err;
+            if (on_output && !out.empty()) {
+                on_output(false, out);
+            }
+            if (on_output && !err.empty()) {
+                on_output(true, err);
+            }
+            
+            if (chunk.value("done", false)) {
+                read_result(chunk, result); // the output itself arrived in the deltas
+                return result;
+            }
+        }
+    } catch (const RequestCancelledError& e) {
+        return failed_result(command.bash_command, e.what());
+    } catch (const std::exception& e) {
+        MAG_LOG_ERROR("orchestrator", "Exception in streamed bash execution: " << e.what());
+        return failed_result(command.bash_command, "Bash execution error: " + std::string(e.what()));
+    }
+}
+
+std::vector<CommandResult> NNGBashClient::execute_concurrently(const std::vector<BashCommand>& commands) {
+    if (commands.size() < 2) {
+        return IBashClient::execute_concurrently(commands);
+    }
+    CancellationToken cancel;
+    {
+        std::lock_guard<std::mutex> lock(streaming_mutex_);
+        streaming_ = cancel;
+    }
+    
+    std::vector<CommandResult> results(commands.size());
+    std::vector<std::string> job_ids(commands.size());
+    std::vector<bool> finished(commands.size(), false);
+    try {
+        // The jobs live in one bash tool process; separate sessions let them run side by side
+        std::shared_ptr<NNGReqClient> worker = client_->pin();
+        WireFormat format = WireCodec::configured();
+        std::string tag = std::to_string(::getpid()) + "-" + std::to_string(++concurrent_batches_);
+        for (size_t i = 0; i < commands.size(); ++i) {
+            results[i].command = commands[i].bash_command;
+            nlohmann::json request = {
+                {"operation", "submit"},
+                {"command", commands[i].bash_command},
+                {"working_directory", request_directory(commands[i])},
+                {"session", "concurrent-" + tag + "-" + std::to_string(i)}
+            };
+            nlohmann::json submitted = WireCodec::decode(worker->send(NngMessage::encode(request, format)).body());
+            if (!submitted.contains("job_id")) {
+                if (i == 0) {
+                    return IBashClient::execute_concurrently(commands); // a bash tool without a job queue
+                }
+                throw std::runtime_error(submitted.value("error_message", "job was not accepted"));
+            }
+            job_ids[i] = submitted["job_id"];
+        }
+        
+        bool cancel_sent = false;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            while (true) {
+                if (cancel.is_cancelled() && !cancel_sent) {
+                    for (const std::string& job_id : job_ids) {
+                        worker->send(NngMessage::encode({{"operation", "cancel"}, {"job_id", job_id}}, format));
+                    }
+                    cancel_sent = true;
+                }
+                
+                nlohmann::json reply;
+                try {
+                    nlohmann::json wait = {{"operation", "wait"}, {"job_id", job_ids[i]},
+                                           {"wait_ms", NetworkConfig::STREAM_POLL_WAIT_MS}};
+                    reply = WireCodec::decode(worker->send(NngMessage::encode(wait, format)).body());
+                } catch (const RequestCancelledError&) {
+                    continue; // cancel_pending() cut the wait short; the jobs are stopped next time round
+                }
+                if (reply.value("done", false)) {
+                    read_result(reply, results[i]);
+                    finished[i] = true;
+                    break;
+                }
+            }
+        }
+        return results;
+    } catch (const std::exception& e) {
+        MAG_LOG_ERROR("orchestrator", "Exception in concurrent bash execution: " << e.what());
+        for (size_t i = 0; i < commands.size(); ++i) {
+            if (!finished[i]) {
+                results[i] = failed_result(commands[i].bash_command, "Bash execution error: " + std::string(e.what()));
+            }
+        }
+        return results;
+    }
+}
+
+LogChunk NNGBashClient::read_log(const std::string& path, uint64_t offset, size_t max_bytes) {
+    WireFormat format = WireCodec::configured();
+    nlohmann::json request = {{"operation", "read_log"}, {"path", path}, {"offset", offset}, {"length", max_bytes}};
+    nlohmann::json reply = WireCodec::decode(client_->send(NngMessage::encode(request, format)).body());
+    if (!reply.value("success", false)) {
+        throw std::runtime_error(reply.value("error_message", "Cannot read " + path));
+    }
+    LogChunk chunk;
+    chunk.data = WireCodec::get_bytes(reply, "data");
+    chunk.offset = reply.value("offset", offset);
+    chunk.total_bytes = reply.value("total_bytes", uint64_t{0});
+    chunk.eof = reply.value("eof", true);
+    return chunk;
+}
+
+void NNGBashClient::cancel_pending() {
+    {
+        std::lock_guard<std::mutex> lock(streaming_mutex_);
+        streaming_.cancel();
+    }
+    client_->cancel_all();
+}
+
+} // namespace mag
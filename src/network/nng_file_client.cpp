@@ -1,105 +1,159 @@
 #include "network/nng_file_client.h"
 #include "config.h"
-#include <nng/nng.h>
-#include <nng/protocol/reqrep0/req.h>
-#include <nlohmann/json.hpp>
+#include "utils.h"
+#include <deque>
 #include <stdexcept>
 
 namespace mag {
 
-NNGFileClient::NNGFileClient() : file_socket_(nullptr) {
-    initialize_socket();
+NNGFileClient::NNGFileClient()
+    : client_(std::make_unique<EndpointPool>(EndpointConfig::Service::FILE_TOOL, "file tool",
+                                             std::chrono::milliseconds(RequestTimeoutConfig::get_file_timeout_ms()))),
+      chunk_threshold_(FileTransferConfig::get_threshold()) {
 }
 
-NNGFileClient::~NNGFileClient() {
-    cleanup_socket();
+bool NNGFileClient::chunked(const WriteFileCommand& command) const {
+    return !command.is_patch() && command.content.size() > chunk_threshold_;
 }
 
-void NNGFileClient::initialize_socket() {
-    int rv;
-    
-    // Create file tool socket
-    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&file_socket_))) != 0) {
-        throw std::runtime_error("Failed to open file tool socket: " + std::string(nng_strerror(rv)));
+NNGFileClient::~NNGFileClient() = default;
+
+DryRunResult NNGFileClient::dry_run(const WriteFileCommand& command) {
+    return dry_run_async(command).get();
+}
+
+std::future<DryRunResult> NNGFileClient::dry_run_async(const WriteFileCommand& command) {
+    // Serialized straight into the outgoing message; NNG takes it from here
+    NngMessage request;
+    if (chunked(command)) {
+        FileTransferRequest digest;
+        digest.path = command.path;
+        digest.size = command.content.size();
+        digest.hash = Utils::hash64(command.content);
+        MessageHandler::serialize_transfer_request("dry_run_digest", digest, {}, WireCodec::configured(), request);
+    } else {
+        MessageHandler::serialize_file_request("dry_run", command, WireCodec::configured(), request);
     }
     
-    // Connect to file tool
-    std::string file_url = NetworkConfig::get_file_tool_url();
-    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&file_socket_), file_url.c_str(), nullptr, 0)) != 0) {
-        nng_close(*reinterpret_cast<nng_socket*>(&file_socket_));
-        throw std::runtime_error("Failed to connect to file tool: " + std::string(nng_strerror(rv)));
-    }
+    // The request is on the wire now; only decoding waits for get()
+    return std::async(std::launch::deferred, [reply = client_->send_async(std::move(request))]() mutable {
+        return MessageHandler::deserialize_dry_run_result(reply.get().body());
+    });
 }
 
-void NNGFileClient::cleanup_socket() {
-    if (file_socket_) {
-        nng_close(*reinterpret_cast<nng_socket*>(&file_socket_));
-        file_socket_ = nullptr;
+ApplyResult NNGFileClient::apply(const WriteFileCommand& command) {
+    if (chunked(command)) {
+        return apply_chunked(command);
     }
+    NngMessage request;
+    MessageHandler::serialize_file_request("apply", command, WireCodec::configured(), request);
+    return MessageHandler::deserialize_apply_result(client_->send(std::move(request)).body());
 }
 
-DryRunResult NNGFileClient::dry_run(const WriteFileCommand& command) {
-    nlohmann::json request = {
-        {"operation", "dry_run"},
-        {"command", {
-            {"command", command.command},
-            {"path", command.path},
-            {"content", command.content}
-        }}
-    };
-    
-    std::string request_str = request.dump();
-    int rv;
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&file_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to file tool: " + std::string(nng_strerror(rv)));
-    }
+ApplyResult NNGFileClient::apply_chunked(const WriteFileCommand& command) {
+    // The transfer lives in one file_tool process, so every step goes to the same worker
+    std::shared_ptr<NNGReqClient> worker = client_->pin();
+    WireFormat format = WireCodec::configured();
+    std::string_view content = command.content;
     
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&file_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from file tool: " + std::string(nng_strerror(rv)));
-    }
-    
-    std::string response(buf, sz);
-    nng_free(buf, sz);
+    FileTransferRequest transfer;
+    transfer.path = command.path;
+    transfer.size = content.size();
+    transfer.hash = Utils::hash64(content);
     
-    return MessageHandler::deserialize_dry_run_result(response);
-}
-
-ApplyResult NNGFileClient::apply(const WriteFileCommand& command) {
-    nlohmann::json request = {
-        {"operation", "apply"},
-        {"command", {
-            {"command", command.command},
-            {"path", command.path},
-            {"content", command.content}
-        }}
+    auto send = [&](const std::string& operation, std::string_view data) {
+        NngMessage request;
+        MessageHandler::serialize_transfer_request(operation, transfer, data, format, request);
+        return worker->send_async(std::move(request));
+    };
+    auto failed = [](const std::string& reason) {
+        ApplyResult result;
+        result.success = false;
+        result.error_message = reason;
+        result.execution_context.exit_code = 1;
+        result.execution_context.timestamp = std::chrono::system_clock::now();
+        return result;
     };
     
-    std::string request_str = request.dump();
-    int rv;
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&file_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to file tool: " + std::string(nng_strerror(rv)));
+    FileTransferReply begun = MessageHandler::deserialize_transfer_reply(send("write_begin", {}).get().body());
+    if (!begun.success || begun.chunk_size == 0) {
+        return failed(begun.error_message.empty() ? "Chunked write was refused" : begun.error_message);
     }
+    transfer.transfer_id = begun.transfer_id;
     
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&file_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from file tool: " + std::string(nng_strerror(rv)));
+    try {
+        // Keep WINDOW chunks on the wire; the worker writes each at its offset as it lands
+        std::deque<std::future<NngMessage>> in_flight;
+        std::string error;
+        auto settle_oldest = [&] {
+            FileTransferReply ack = MessageHandler::deserialize_transfer_reply(in_flight.front().get().body());
+            in_flight.pop_front();
+            if (!ack.success && error.empty()) {
+                error = ack.error_message;
+            }
+        };
+        for (uint64_t offset = 0; offset < content.size() && error.empty(); offset += begun.chunk_size) {
+            if (in_flight.size() >= FileTransferConfig::WINDOW) {
+                settle_oldest();
+            }
+            transfer.offset = offset;
+            in_flight.push_back(send("write_chunk", content.substr(offset, begun.chunk_size)));
+        }
+        while (!in_flight.empty()) {
+            settle_oldest();
+        }
+        if (!error.empty()) {
+            send("write_abort", {}).wait();
+            return failed(error);
+        }
+    } catch (...) {
+        try {
+            send("write_abort", {}).wait(); // best effort; the worker also expires idle transfers
+        } catch (const std::exception&) {
+        }
+        throw;
     }
     
-    std::string response(buf, sz);
-    nng_free(buf, sz);
-    
-    return MessageHandler::deserialize_apply_result(response);
+    return MessageHandler::deserialize_apply_result(send("write_commit", {}).get().body());
+}
+
+BatchDryRunResult NNGFileClient::dry_run_batch(const std::vector<WriteFileCommand>& commands) {
+    NngMessage request;
+    MessageHandler::serialize_file_batch_request("dry_run_batch", commands, false, WireCodec::configured(), request);
+    return MessageHandler::deserialize_batch_dry_run_result(client_->send(std::move(request)).body());
+}
+
+BatchApplyResult NNGFileClient::apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) {
+    NngMessage request;
+    MessageHandler::serialize_file_batch_request("apply_batch", commands, all_or_nothing, WireCodec::configured(),
+                                                 request);
+    return MessageHandler::deserialize_batch_apply_result(client_->send(std::move(request)).body());
+}
+
+ReadFileResult NNGFileClient::read(const ReadFileRequest& request) {
+    bool whole_file = !request.by_lines() && request.offset == 0 && request.length == 0;
+    NngMessage message;
+    MessageHandler::serialize_read_request(whole_file ? "read" : "read_range", request, WireCodec::configured(),
+                                           message);
+    return MessageHandler::deserialize_read_result(client_->send(std::move(message)).body());
+}
+
+FileStatResult NNGFileClient::stat(const std::string& path) {
+    ReadFileRequest request;
+    request.path = path;
+    NngMessage message;
+    MessageHandler::serialize_read_request("stat", request, WireCodec::configured(), message);
+    return MessageHandler::deserialize_stat_result(client_->send(std::move(message)).body());
+}
+
+ContextSlice NNGFileClient::context(const std::string& query, size_t budget_tokens) {
+    NngMessage message;
+    MessageHandler::serialize_context_request(query, budget_tokens, WireCodec::configured(), message);
+    return MessageHandler::deserialize_context_slice(client_->send(std::move(message)).body());
+}
+
+void NNGFileClient::cancel_pending() {
+    client_->cancel_all();
 }
 
-} // namespace mag
\ No newline at end of file
+} // namespace mag
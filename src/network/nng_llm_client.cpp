@@ -1,7 +1,6 @@
 #include "network/nng_llm_client.h"
 #include "config.h"
-#include <nng/nng.h>
-#include <nng/protocol/reqrep0/req.h>
+#include "json_writer.h"
 #include <nlohmann/json.hpp>
 #include <stdexcept>
 #include <regex>
@@ -9,40 +8,15 @@
 namespace mag {
 
 NNGLLMClient::NNGLLMClient(const std::string& provider_override) 
-    : llm_socket_(nullptr), current_provider_(provider_override) {
-    initialize_socket();
+    : client_(std::make_unique<EndpointPool>(EndpointConfig::Service::LLM_ADAPTER, "LLM adapter",
+                                             std::chrono::milliseconds(RequestTimeoutConfig::get_llm_timeout_ms())))
+    , current_provider_(provider_override)
+    , tenant_(TenantConfig::get_tenant()) {
 }
 
-NNGLLMClient::~NNGLLMClient() {
-    cleanup_socket();
-}
-
-void NNGLLMClient::initialize_socket() {
-    int rv;
-    
-    // Create LLM adapter socket
-    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&llm_socket_))) != 0) {
-        throw std::runtime_error("Failed to open LLM socket: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Connect to LLM adapter
-    std::string llm_url = NetworkConfig::get_llm_adapter_url();
-    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&llm_socket_), llm_url.c_str(), nullptr, 0)) != 0) {
-        nng_close(*reinterpret_cast<nng_socket*>(&llm_socket_));
-        throw std::runtime_error("Failed to connect to LLM adapter: " + std::string(nng_strerror(rv)));
-    }
-}
-
-void NNGLLMClient::cleanup_socket() {
-    if (llm_socket_) {
-        nng_close(*reinterpret_cast<nng_socket*>(&llm_socket_));
-        llm_socket_ = nullptr;
-    }
-}
+NNGLLMClient::~NNGLLMClient() = default;
 
 WriteFileCommand NNGLLMClient::request_plan(const std::string& user_prompt) {
-    int rv;
-    
     // Create request with optional provider override
     nlohmann::json request = {
         {"prompt", user_prompt}
@@ -51,33 +25,30 @@ WriteFileCommand NNGLLMClient::request_plan(const std::string& user_prompt) {
     if (!current_provider_.empty()) {
         request["provider"] = current_provider_;
     }
-    
-    std::string request_str = request.dump();
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&llm_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to LLM adapter: " + std::string(nng_strerror(rv)));
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
     }
-    
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&llm_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from LLM adapter: " + std::string(nng_strerror(rv)));
+    std::string context = project_context(user_prompt);
+    if (!context.empty()) {
+        request["context"] = context;
     }
     
-    std::string response(buf, sz);
-    nng_free(buf, sz);
-    
-    return MessageHandler::deserialize_command(response);
+    // The adapter answers a binary request with a binary plan (raw content bytes)
+    NngMessage reply = client_->send(NngMessage::encode(request, WireCodec::configured()));
+    nlohmann::json plan = WireCodec::decode(reply.body());
+    WriteFileCommand command;
+    command.from_json(plan);
+    if (plan.contains("usage")) {
+        report_usage(ProviderUsage::from_json(plan["usage"]));
+    }
+    return command;
 }
 
 GenericCommand NNGLLMClient::request_generic_plan(const std::string& user_prompt) {
     // For legacy NNG implementation, fallback to file operations
     WriteFileCommand legacy_cmd = request_plan(user_prompt);
     GenericCommand generic_cmd;
-    generic_cmd.type = OperationType::FILE_WRITE;
+    generic_cmd.type = legacy_cmd.is_patch() ? OperationType::FILE_PATCH : OperationType::FILE_WRITE;
     generic_cmd.description = legacy_cmd.command + " " + legacy_cmd.path;
     generic_cmd.file_path = legacy_cmd.path;
     generic_cmd.file_content = legacy_cmd.content;
@@ -85,37 +56,238 @@ GenericCommand NNGLLMClient::request_generic_plan(const std::string& user_prompt
 }
 
 std::string NNGLLMClient::request_chat(const std::string& user_prompt) {
-    int rv;
-    
     // Create request with chat mode indicator
     nlohmann::json request = {
         {"prompt", user_prompt},
-        {"chat_mode", true}
+        {"chat_mode", true},
+        {"envelope", true}
     };
     
     if (!current_provider_.empty()) {
         request["provider"] = current_provider_;
     }
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    std::string context = project_context(user_prompt);
+    if (!context.empty()) {
+        request["context"] = context;
+    }
+    
+    return open_chat_envelope(send_request(request.dump()));
+}
+
+std::string NNGLLMClient::open_chat_envelope(std::string reply) {
+    // Adapters that predate envelopes answer with the bare text, and failures
+    // come back as an error object; both are passed through as before
+    nlohmann::json envelope = nlohmann::json::parse(reply, nullptr, false);
+    if (!envelope.is_object() || !envelope.contains("response") || !envelope["response"].is_string()) {
+        return reply;
+    }
+    if (envelope.contains("usage")) {
+        report_usage(ProviderUsage::from_json(envelope["usage"]));
+    }
+    return envelope["response"].get<std::string>();
+}
+
+std::string NNGLLMClient::send_request(const std::string& request_str) {
+    return client_->request(request_str);
+}
+
+void NNGLLMClient::cancel_pending() {
+    client_->cancel_all();
+}
+
+std::string NNGLLMClient::request_chat_stream(const std::string& user_prompt,
+                                              const std::function<void(const std::string&)>& on_chunk) {
+    nlohmann::json request = {
+        {"prompt", user_prompt},
+        {"chat_mode", true},
+        {"stream", true}
+    };
+    
+    if (!current_provider_.empty()) {
+        request["provider"] = current_provider_;
+    }
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    std::string context = project_context(user_prompt);
+    if (!context.empty()) {
+        request["context"] = context;
+    }
+    
+    // The stream lives in one adapter process, so every poll goes back to it
+    std::shared_ptr<NNGReqClient> adapter = client_->pin();
+    nlohmann::json started = nlohmann::json::parse(adapter->request(request.dump()));
+    if (!started.contains("stream_id")) {
+        throw std::runtime_error("LLM adapter did not start a stream: " + started.value("error", "no stream_id"));
+    }
     
-    std::string request_str = request.dump();
+    // Drain the stream; each stream_next long-polls on the adapter side
+    nlohmann::json next_request = {
+        {"operation", "stream_next"},
+        {"stream_id", started["stream_id"]}
+    };
+    if (!tenant_.empty()) {
+        next_request["tenant"] = tenant_;
+    }
+    std::string next_str = next_request.dump();
+    std::string full_response;
     
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&llm_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to LLM adapter: " + std::string(nng_strerror(rv)));
+    while (true) {
+        nlohmann::json chunk = nlohmann::json::parse(adapter->request(next_str));
+        
+        std::string delta = chunk.value("delta", "");
+        if (!delta.empty()) {
+            full_response += delta;
+            if (on_chunk) {
+                on_chunk(delta);
+            }
+        }
+        
+        if (chunk.contains("error")) {
+            throw std::runtime_error("LLM stream failed: " + chunk["error"].get<std::string>());
+        }
+        if (chunk.value("done", false)) {
+            break;
+        }
     }
     
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&llm_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from LLM adapter: " + std::string(nng_strerror(rv)));
+    return full_response;
+}
+
+std::string NNGLLMClient::request_chat_with_history(HistoryView conversation_history) {
+    std::string_view user_prompt;
+    for (const auto& message : conversation_history) {
+        if (message.role == "user") {
+            user_prompt = message.content;
+        }
     }
     
-    std::string response(buf, sz);
-    nng_free(buf, sz);
+    // Written straight from the view; "prompt" keeps older adapters working,
+    // newer ones use the full history
+    std::string request;
+    JsonWriter writer(request);
+    writer.begin_object();
+    writer.key("chat_mode").value(true);
+    std::string context = project_context(std::string(user_prompt));
+    if (!context.empty()) {
+        writer.key("context").value(context);
+    }
+    writer.key("envelope").value(true);
+    writer.key("history").begin_array();
+    for (const auto& message : conversation_history) {
+        writer.begin_object();
+        writer.key("content").value(message.content);
+        writer.key("provider").value(message.provider);
+        writer.key("role").value(message.role);
+        writer.key("timestamp").value(message.timestamp());
+        writer.end_object();
+    }
+    writer.end_array();
+    writer.key("prompt").value(user_prompt);
+    if (!current_provider_.empty()) {
+        writer.key("provider").value(current_provider_);
+    }
+    if (!tenant_.empty()) {
+        writer.key("tenant").value(tenant_);
+    }
+    writer.end_object();
     
-    return response;
+    return open_chat_envelope(send_request(request));
+}
+
+std::string NNGLLMClient::request_summary(const std::vector<ConversationMessage>& turns,
+                                          const std::string& previous_summary) {
+    nlohmann::json messages = nlohmann::json::array();
+    for (const auto& message : turns) {
+        messages.push_back(message.to_json());
+    }
+    
+    nlohmann::json request = {
+        {"operation", "summarize"},
+        {"messages", std::move(messages)},
+        {"previous_summary", previous_summary}
+    };
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    
+    nlohmann::json reply = nlohmann::json::parse(send_request(request.dump()));
+    if (reply.contains("error")) {
+        throw std::runtime_error("LLM summary failed: " + reply["error"].get<std::string>());
+    }
+    if (reply.contains("usage")) {
+        report_usage(ProviderUsage::from_json(reply["usage"]));
+    }
+    return reply.value("summary", "");
+}
+
+PlanBatchStatus NNGLLMClient::submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) {
+    nlohmann::json items = nlohmann::json::array();
+    for (const auto& [id, prompt] : prompts) {
+        nlohmann::json item = {{"id", id}, {"prompt", prompt}};
+        std::string context = project_context(prompt);
+        if (!context.empty()) {
+            item["context"] = context;
+        }
+        items.push_back(std::move(item));
+    }
+    nlohmann::json request = {
+        {"operation", "plan_batch_submit"},
+        {"prompts", std::move(items)}
+    };
+    if (!current_provider_.empty()) {
+        request["provider"] = current_provider_;
+    }
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    
+    nlohmann::json reply = nlohmann::json::parse(send_request(request.dump()));
+    if (reply.contains("error")) {
+        throw std::runtime_error("Plan batch submit failed: " + reply["error"].get<std::string>());
+    }
+    PlanBatchStatus status;
+    status.from_json(reply.at("batch"));
+    return status;
+}
+
+PlanBatchStatus NNGLLMClient::poll_plan_batch(const PlanBatchStatus& batch) {
+    nlohmann::json request = {{"operation", "plan_batch_status"}};
+    batch.to_json(request["batch"]);
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    
+    nlohmann::json reply = nlohmann::json::parse(send_request(request.dump()));
+    if (reply.contains("error")) {
+        throw std::runtime_error("Plan batch status failed: " + reply["error"].get<std::string>());
+    }
+    PlanBatchStatus status;
+    status.from_json(reply.at("batch"));
+    return status;
+}
+
+std::vector<PlanBatchResult> NNGLLMClient::collect_plan_batch(const PlanBatchStatus& batch) {
+    nlohmann::json request = {{"operation", "plan_batch_results"}};
+    batch.to_json(request["batch"]);
+    if (!tenant_.empty()) {
+        request["tenant"] = tenant_;
+    }
+    
+    nlohmann::json reply = nlohmann::json::parse(send_request(request.dump()));
+    if (reply.contains("error")) {
+        throw std::runtime_error("Plan batch results failed: " + reply["error"].get<std::string>());
+    }
+    std::vector<PlanBatchResult> results;
+    for (const auto& item : reply.value("results", nlohmann::json::array())) {
+        PlanBatchResult result;
+        result.from_json(item);
+        results.push_back(std::move(result));
+    }
+    return results;
 }
 
 void NNGLLMClient::set_provider(const std::string& provider_name) {
@@ -0,0 +1,76 @@
+#include "network/nng_message.h"
+#include <nng/nng.h>
+#include <stdexcept>
+
+namespace mag {
+
+NngMessage::~NngMessage() {
+    if (msg_) {
+        nng_msg_free(msg_);
+    }
+}
+
+NngMessage& NngMessage::operator=(NngMessage&& other) noexcept {
+    if (this != &other) {
+        if (msg_) {
+            nng_msg_free(msg_);
+        }
+        msg_ = other.release();
+    }
+    return *this;
+}
+
+NngMessage NngMessage::allocate(size_t capacity) {
+    nng_msg* msg = nullptr;
+    int rv;
+    if ((rv = nng_msg_alloc(&msg, 0)) != 0) {
+        throw std::runtime_error("Failed to allocate message: " + std::string(nng_strerror(rv)));
+    }
+    NngMessage message(msg);
+    if (capacity > 0 && (rv = nng_msg_reserve(msg, capacity)) != 0) {
+        throw std::runtime_error("Failed to reserve " + std::to_string(capacity) + " message bytes: " +
+                                 std::string(nng_strerror(rv)));
+    }
+    return message;
+}
+
+NngMessage NngMessage::copy_of(std::string_view data) {
+    NngMessage message = allocate(data.size());
+    message.write(data.data(), data.size());
+    return message;
+}
+
+NngMessage NngMessage::encode(const nlohmann::json& j, WireFormat format) {
+    NngMessage message = allocate();
+    WireCodec::encode(j, format, message);
+    return message;
+}
+
+void NngMessage::write(const char* data, size_t size) {
+    if (!msg_) {
+        *this = allocate(size);
+    }
+    int rv;
+    if ((rv = nng_msg_append(msg_, data, size)) != 0) {
+        throw std::runtime_error("Failed to append to message: " + std::string(nng_strerror(rv)));
+    }
+}
+
+std::string_view NngMessage::body() const {
+    if (!msg_) {
+        return {};
+    }
+    return std::string_view(static_cast<const char*>(nng_msg_body(msg_)), nng_msg_len(msg_));
+}
+
+size_t NngMessage::size() const {
+    return msg_ ? nng_msg_len(msg_) : 0;
+}
+
+nng_msg* NngMessage::release() {
+    nng_msg* msg = msg_;
+    msg_ = nullptr;
+    return msg;
+}
+
+} // namespace mag
@@ -0,0 +1,284 @@
+#include "network/nng_rep_server.h"
+#include "logger.h"
+#include "tracing.h"
+#include <nng/nng.h>
+#include <nng/protocol/reqrep0/rep.h>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+
+namespace mag {
+
+struct NNGRepServer::Context {
+    enum class State { RECEIVING, WORKING, SENDING };
+    
+    NNGRepServer* server = nullptr;
+    nng_ctx ctx;
+    nng_aio* aio = nullptr;
+    nng_aio* timer = nullptr; // a deferred request's timeout
+    State state = State::RECEIVING;
+    std::shared_ptr<DeferredReply> deferred;
+    std::function<NngMessage()> on_timeout;
+};
+
+bool NNGRepServer::DeferredReply::complete(NngMessage reply) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_) {
+        return false;
+    }
+    completed_ = true;
+    reply_ = reply.get() ? std::move(reply) : NngMessage::allocate(); // an empty reply is still a reply
+    if (timer_armed_) {
+        // The timer callback sends it, so the context has one owner at a time (it runs on an NNG thread, not here)
+        nng_aio_cancel(context_->timer);
+    }
+    return true;
+}
+
+NNGRepServer::NNGRepServer(const std::string& url, size_t contexts, ThreadPool& pool, Handler handler)
+    : url_(url)
+    , context_count_(contexts == 0 ? 1 : contexts)
+    , pool_(pool)
+    , handler_(std::move(handler))
+    , socket_(nullptr) {
+}
+
+NNGRepServer::~NNGRepServer() {
+    stop();
+}
+
+void NNGRepServer::start() {
+    int rv;
+    
+    if ((rv = nng_rep0_open(reinterpret_cast<nng_socket*>(&socket_))) != 0) {
+        throw std::runtime_error("Failed to open REP socket: " + std::string(nng_strerror(rv)));
+    }
+    nng_socket sock = *reinterpret_cast<nng_socket*>(&socket_);
+    started_ = true;
+    
+    for (size_t i = 0; i < context_count_; ++i) {
+        auto context = std::make_unique<Context>();
+        context->server = this;
+        if ((rv = nng_aio_alloc(&context->aio, aio_callback, context.get())) != 0) {
+            stop();
+            throw std::runtime_error("Failed to allocate aio: " + std::string(nng_strerror(rv)));
+        }
+        if ((rv = nng_aio_alloc(&context->timer, timer_callback, context.get())) != 0) {
+            nng_aio_free(context->aio);
+            stop();
+            throw std::runtime_error("Failed to allocate aio: " + std::string(nng_strerror(rv)));
+        }
+        if ((rv = nng_ctx_open(&context->ctx, sock)) != 0) {
+            nng_aio_free(context->aio);
+            nng_aio_free(context->timer);
+            stop();
+            throw std::runtime_error("Failed to open context: " + std::string(nng_strerror(rv)));
+        }
+        contexts_.push_back(std::move(context));
+    }
+    
+    if ((rv = nng_listen(sock, url_.c_str(), nullptr, 0)) != 0) {
+        stop();
+        throw std::runtime_error("Failed to listen on " + url_ + ": " + std::string(nng_strerror(rv)));
+    }
+    
+    for (auto& context : contexts_) {
+        receive(context.get());
+    }
+}
+
+void NNGRepServer::stop() {
+    if (!started_) {
+        return;
+    }
+    stopping_.store(true);
+    
+    nng_close(*reinterpret_cast<nng_socket*>(&socket_));
+    for (auto& context : contexts_) {
+        // Waits for any running callback; a handler still on the pool finishes into a closed socket
+        nng_aio_stop(context->aio);
+        nng_aio_stop(context->timer); // ends a deferred request without a reply
+        nng_ctx_close(context->ctx);
+    }
+    
+    // Let in-flight handlers finish before their contexts go away
+    while (in_flight_.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto& context : contexts_) {
+        nng_aio_free(context->aio);
+        nng_aio_free(context->timer);
+    }
+    contexts_.clear();
+    started_ = false;
+}
+
+void NNGRepServer::aio_callback(void* arg) {
+    Context* context = static_cast<Context*>(arg);
+    context->server->on_io_complete(context);
+}
+
+void NNGRepServer::timer_callback(void* arg) {
+    Context* context = static_cast<Context*>(arg);
+    context->server->on_timer(context);
+}
+
+void NNGRepServer::receive(Context* context) {
+    context->state = Context::State::RECEIVING;
+    nng_ctx_recv(context->ctx, context->aio);
+}
+
+void NNGRepServer::on_io_complete(Context* context) {
+    int rv = nng_aio_result(context->aio);
+    
+    switch (context->state) {
+        case Context::State::RECEIVING: {
+            if (rv != 0) {
+                if (rv == NNG_ECLOSED || rv == NNG_ECANCELED || stopping_.load()) {
+                    return;
+                }
+                MAG_LOG_ERROR("nng", "nng_ctx_recv: " << nng_strerror(rv));
+                receive(context);
+                return;
+            }
+            
+            // Task must be copyable, so the message rides in a shared_ptr
+            auto request = std::make_shared<NngMessage>(nng_aio_get_msg(context->aio));
+            
+            // A traced caller puts its span ahead of the request; the handler's spans hang off it
+            std::string_view body = request->body();
+            TraceContext trace = TraceContext::strip_header(body).value_or(TraceContext{});
+            
+            if (deferrer_) {
+                auto deferred = std::make_shared<DeferredReply>();
+                deferred->context_ = context;
+                Deferral deferral;
+                try {
+                    deferral = deferrer_(body, deferred);
+                } catch (const std::exception& e) {
+                    MAG_LOG_WARN("nng", "Request deferral failed, queuing it: " << e.what());
+                }
+                if (deferral.taken) {
+                    defer(context, std::move(deferred), std::move(deferral));
+                    return;
+                }
+            }
+            
+            Admission admission;
+            if (admitter_) {
+                try {
+                    admission = admitter_(body);
+                } catch (const std::exception& e) {
+                    MAG_LOG_WARN("nng", "Request admission failed, using the default queue: " << e.what());
+                }
+            }
+            if (admission.rejection.get()) {
+                context->state = Context::State::SENDING;
+                nng_aio_set_msg(context->aio, admission.rejection.release());
+                nng_ctx_send(context->ctx, context->aio);
+                return;
+            }
+            
+            context->state = Context::State::WORKING;
+            in_flight_.fetch_add(1);
+            
+            // Provider calls block for seconds; never run them on the NNG callback thread
+            pool_.submit(admission.key, [this, context, request, body, trace](size_t worker_index) {
+                NngMessage reply;
+                try {
+                    TraceScope scope(trace);
+                    reply = handler_(worker_index, body);
+                    if (!reply.get()) {
+                        reply = NngMessage::allocate(); // an empty reply is still a reply
+                    }
+                } catch (const std::exception& e) {
+                    MAG_LOG_ERROR("nng", "Request handler failed: " << e.what());
+                    try {
+                        reply = NngMessage::copy_of(R"({"error": "internal error"})");
+                    } catch (const std::exception&) {
+                        reply = NngMessage();
+                    }
+                }
+                
+                finish(context, std::move(reply));
+            });
+            return;
+        }
+        
+        case Context::State::SENDING:
+            if (rv != 0) {
+                // Ownership stays with us when the send fails
+                NngMessage unsent(nng_aio_get_msg(context->aio));
+                if (rv == NNG_ECLOSED || stopping_.load()) {
+                    return;
+                }
+                MAG_LOG_ERROR("nng", "nng_ctx_send: " << nng_strerror(rv));
+            }
+            receive(context);
+            return;
+            
+        case Context::State::WORKING:
+            return;
+    }
+}
+
+void NNGRepServer::defer(Context* context, std::shared_ptr<DeferredReply> deferred, Deferral deferral) {
+    context->state = Context::State::WORKING;
+    in_flight_.fetch_add(1);
+    
+    std::unique_lock<std::mutex> lock(deferred->mutex_);
+    if (deferred->completed_) {
+        NngMessage reply = std::move(deferred->reply_);
+        lock.unlock();
+        finish(context, std::move(reply));
+        return;
+    }
+    context->deferred = std::move(deferred);
+    context->on_timeout = std::move(deferral.on_timeout);
+    context->deferred->timer_armed_ = true;
+    nng_sleep_aio(static_cast<nng_duration>(deferral.timeout.count()), context->timer);
+}
+
+void NNGRepServer::on_timer(Context* context) {
+    std::shared_ptr<DeferredReply> deferred = std::move(context->deferred);
+    std::function<NngMessage()> on_timeout = std::move(context->on_timeout);
+    if (!deferred) {
+        return;
+    }
+    
+    NngMessage reply;
+    bool expired = false;
+    {
+        std::lock_guard<std::mutex> lock(deferred->mutex_);
+        deferred->timer_armed_ = false;
+        expired = !deferred->completed_;
+        deferred->completed_ = true;
+        reply = std::move(deferred->reply_);
+    }
+    // Outside the lock: on_timeout may take locks that are held around complete()
+    if (expired && on_timeout && !stopping_.load()) {
+        try {
+            reply = on_timeout();
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("nng", "Deferred request timeout failed: " << e.what());
+        }
+    }
+    if (expired && !reply.get() && !stopping_.load()) {
+        reply = NngMessage::allocate(); // an empty reply is still a reply
+    }
+    finish(context, std::move(reply));
+}
+
+void NNGRepServer::finish(Context* context, NngMessage reply) {
+    if (stopping_.load() || !reply.get()) {
+        in_flight_.fetch_sub(1);
+        return;
+    }
+    
+    context->state = Context::State::SENDING;
+    nng_aio_set_msg(context->aio, reply.release());
+    nng_ctx_send(context->ctx, context->aio);
+    in_flight_.fetch_sub(1);
+}
+
+} // namespace mag
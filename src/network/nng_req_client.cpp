@@ -0,0 +1,315 @@
+#include "network/nng_req_client.h"
+#include "logger.h"
+#include "metrics.h"
+#include "tracing.h"
+#include <nng/nng.h>
+#include <nng/protocol/reqrep0/req.h>
+#include <optional>
+
+namespace mag {
+
+struct NNGReqClient::Call {
+    enum class State { IDLE, SENDING, RECEIVING };
+    
+    NNGReqClient* client = nullptr;
+    nng_ctx ctx;
+    nng_aio* aio = nullptr;
+    State state = State::IDLE;
+    
+    // Per call
+    uint64_t id = 0;
+    std::promise<NngMessage> promise;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point deadline;
+    std::chrono::milliseconds timeout{0};
+    bool cancelled = false;
+    std::optional<CancellationToken> token;
+    size_t cancel_registration = 0;
+    std::optional<SpanRecord> span; // when the caller is being traced
+};
+
+NNGReqClient::NNGReqClient(const std::string& url, std::string service_name,
+                           std::chrono::milliseconds default_timeout)
+    : service_name_(std::move(service_name)), default_timeout_(default_timeout), socket_(nullptr) {
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    const char* outcomes[] = {"ok", "timeout", "failed", "cancelled"}; // Outcome order
+    for (size_t i = 0; i < latency_.size(); ++i) {
+        latency_[i] = &metrics.histogram("mag_client_request_seconds",
+                                         {{"service", service_name_}, {"outcome", outcomes[i]}},
+                                         "Round trip of one request to a service");
+    }
+    bytes_sent_ = &metrics.counter("mag_client_bytes_total", {{"service", service_name_}, {"direction", "out"}},
+                                   "Bytes sent to and received from a service");
+    bytes_received_ = &metrics.counter("mag_client_bytes_total", {{"service", service_name_}, {"direction", "in"}},
+                                       "Bytes sent to and received from a service");
+    
+    int rv;
+    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&socket_))) != 0) {
+        throw std::runtime_error("Failed to open " + service_name_ + " socket: " + std::string(nng_strerror(rv)));
+    }
+    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&socket_), url.c_str(), nullptr, 0)) != 0) {
+        nng_close(*reinterpret_cast<nng_socket*>(&socket_));
+        throw std::runtime_error("Failed to connect to " + service_name_ + ": " + std::string(nng_strerror(rv)));
+    }
+}
+
+NNGReqClient::~NNGReqClient() {
+    cancel_all();
+    {
+        std::unique_lock<std::recursive_mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return calls_.empty(); });
+    }
+    
+    nng_close(*reinterpret_cast<nng_socket*>(&socket_));
+    for (auto& slot : slots_) {
+        nng_aio_stop(slot->aio);
+        nng_ctx_close(slot->ctx);
+        nng_aio_free(slot->aio);
+    }
+}
+
+NNGReqClient::Call* NNGReqClient::acquire_slot() {
+    if (!free_slots_.empty()) {
+        Call* slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+    
+    auto slot = std::make_unique<Call>();
+    slot->client = this;
+    int rv;
+    if ((rv = nng_aio_alloc(&slot->aio, aio_callback, slot.get())) != 0) {
+        throw std::runtime_error("Failed to allocate aio: " + std::string(nng_strerror(rv)));
+    }
+    if ((rv = nng_ctx_open(&slot->ctx, *reinterpret_cast<nng_socket*>(&socket_))) != 0) {
+        nng_aio_free(slot->aio);
+        throw std::runtime_error("Failed to open context: " + std::string(nng_strerror(rv)));
+    }
+    slots_.push_back(std::move(slot));
+    return slots_.back().get();
+}
+
+std::future<NngMessage> NNGReqClient::send_async(NngMessage request, std::chrono::milliseconds timeout,
+                                                 const CancellationToken* cancel) {
+    if (!request.get()) {
+        request = NngMessage::allocate();
+    }
+    
+    Call* call;
+    uint64_t id;
+    std::future<NngMessage> result;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        call = acquire_slot();
+        id = next_call_id_++;
+        call->id = id;
+        call->promise = std::promise<NngMessage>();
+        call->timeout = timeout.count() > 0 ? timeout : default_timeout_;
+        call->started = std::chrono::steady_clock::now();
+        call->deadline = call->started + call->timeout;
+        call->cancelled = false;
+        call->state = Call::State::IDLE;
+        call->span.reset();
+        calls_[id] = call;
+        result = call->promise.get_future();
+    }
+    
+    // Registered before the send so a token cancelled meanwhile is not missed;
+    // an already cancelled token runs cancel_call() right here
+    if (cancel) {
+        size_t registration = cancel->on_cancel([this, id] { cancel_call(id); });
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        call->token = *cancel;
+        call->cancel_registration = registration;
+    }
+    
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if (call->cancelled) {
+        lock.unlock();
+        finish(call, NNG_ECANCELED, NngMessage());
+        return result;
+    }
+    call->state = Call::State::SENDING;
+    
+    // The service's spans become children of this call's span
+    TraceContext parent = TraceContext::current();
+    if (Tracer::enabled() && parent.valid()) {
+        SpanRecord span;
+        span.context = {parent.trace_high, parent.trace_low, Tracer::new_span_id()};
+        span.parent_span_id = parent.span_id;
+        span.name = "nng " + service_name_;
+        span.start_unix_us = Tracer::now_unix_us();
+        span.thread_id = Tracer::current_thread_id();
+        span.attributes.emplace_back("bytes_out", std::to_string(request.size()));
+        char header[TraceContext::HEADER_SIZE];
+        span.context.write_header(header);
+        nng_msg_insert(request.get(), header, sizeof(header));
+        call->span = std::move(span);
+    }
+    bytes_sent_->add(request.size());
+    nng_aio_set_msg(call->aio, request.release()); // the aio owns it until the send completes
+    nng_aio_set_timeout(call->aio, static_cast<nng_duration>(call->timeout.count()));
+    nng_ctx_send(call->ctx, call->aio);
+    return result;
+}
+
+NngMessage NNGReqClient::send(NngMessage request, std::chrono::milliseconds timeout,
+                              const CancellationToken* cancel) {
+    return send_async(std::move(request), timeout, cancel).get();
+}
+
+std::future<std::string> NNGReqClient::request_async(const std::string& payload, std::chrono::milliseconds timeout,
+                                                     const CancellationToken* cancel) {
+    return std::async(std::launch::deferred,
+                      [reply = send_async(NngMessage::copy_of(payload), timeout, cancel)]() mutable {
+                          return std::string(reply.get().body());
+                      });
+}
+
+std::string NNGReqClient::request(const std::string& payload, std::chrono::milliseconds timeout,
+                                  const CancellationToken* cancel) {
+    return std::string(send(NngMessage::copy_of(payload), timeout, cancel).body());
+}
+
+void NNGReqClient::cancel_all() {
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        for (const auto& [id, call] : calls_) {
+            ids.push_back(id);
+        }
+    }
+    for (uint64_t id : ids) {
+        cancel_call(id);
+    }
+}
+
+size_t NNGReqClient::in_flight() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return calls_.size();
+}
+
+void NNGReqClient::cancel_call(uint64_t id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = calls_.find(id);
+    if (it == calls_.end()) {
+        return; // already finished
+    }
+    Call* call = it->second;
+    call->cancelled = true;
+    if (call->state != Call::State::IDLE) {
+        // The call may complete (and be recycled) inside this; do not touch it afterwards
+        nng_aio_cancel(call->aio);
+    }
+}
+
+void NNGReqClient::aio_callback(void* arg) {
+    Call* call = static_cast<Call*>(arg);
+    call->client->on_io_complete(call);
+}
+
+void NNGReqClient::on_io_complete(Call* call) {
+    int rv = nng_aio_result(call->aio);
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    
+    if (call->state == Call::State::SENDING) {
+        if (rv != 0) {
+            // Ownership stays with us when the send fails
+            NngMessage unsent(nng_aio_get_msg(call->aio));
+            lock.unlock();
+            finish(call, rv, NngMessage());
+            return;
+        }
+        if (call->cancelled) {
+            lock.unlock();
+            finish(call, NNG_ECANCELED, NngMessage());
+            return;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            call->deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            lock.unlock();
+            finish(call, NNG_ETIMEDOUT, NngMessage());
+            return;
+        }
+        call->state = Call::State::RECEIVING;
+        nng_aio_set_timeout(call->aio, static_cast<nng_duration>(remaining.count()));
+        nng_ctx_recv(call->ctx, call->aio);
+        return;
+    }
+    lock.unlock();
+    
+    if (rv != 0) {
+        finish(call, rv, NngMessage());
+        return;
+    }
+    finish(call, 0, NngMessage(nng_aio_get_msg(call->aio)));
+}
+
+void NNGReqClient::finish(Call* call, int rv, NngMessage reply) {
+    std::promise<NngMessage> promise;
+    std::optional<CancellationToken> token;
+    size_t registration;
+    std::chrono::milliseconds timeout;
+    std::chrono::steady_clock::time_point started;
+    std::optional<SpanRecord> span;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        promise = std::move(call->promise);
+        span = std::move(call->span);
+        call->span.reset();
+        token = std::move(call->token);
+        call->token.reset();
+        registration = call->cancel_registration;
+        timeout = call->timeout;
+        started = call->started;
+        calls_.erase(call->id);
+        call->state = Call::State::IDLE;
+        free_slots_.push_back(call); // the slot may be reused from here on
+        if (calls_.empty()) {
+            idle_.notify_all();
+        }
+    }
+    if (token) {
+        token->remove_callback(registration);
+    }
+    Outcome outcome = rv == 0 ? Outcome::OK
+                      : rv == NNG_ETIMEDOUT ? Outcome::TIMED_OUT
+                      : rv == NNG_ECANCELED ? Outcome::CANCELLED
+                      : Outcome::FAILED;
+    latency_[static_cast<size_t>(outcome)]->record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started));
+    bytes_received_->add(reply.size());
+    if (span) {
+        const char* outcomes[] = {"ok", "timeout", "failed", "cancelled"}; // Outcome order
+        span->duration_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        span->error = outcome != Outcome::OK;
+        span->attributes.emplace_back("outcome", outcomes[static_cast<size_t>(outcome)]);
+        span->attributes.emplace_back("bytes_in", std::to_string(reply.size()));
+        Tracer::instance().record(std::move(*span));
+    }
+    if (completion_hook_) {
+        completion_hook_(outcome);
+    }
+    
+    if (rv == 0) {
+        promise.set_value(std::move(reply));
+        return;
+    }
+    try {
+        if (rv == NNG_ETIMEDOUT) {
+            MAG_LOG_WARN("nng", service_name_ << " did not answer within " << timeout.count() << "ms");
+            throw RequestTimeoutError(service_name_ + " did not answer within " +
+                                      std::to_string(timeout.count()) + "ms");
+        }
+        if (rv == NNG_ECANCELED) {
+            throw RequestCancelledError("Request to " + service_name_ + " cancelled");
+        }
+        throw std::runtime_error("Request to " + service_name_ + " failed: " + std::string(nng_strerror(rv)));
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace mag
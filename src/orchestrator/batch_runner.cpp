@@ -0,0 +1,202 @@
+#include "batch_runner.h"
+#include "policy_config.h"
+#include "thread_pool.h"
+#include "logger.h"
+#include <chrono>
+#include <future>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace mag {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+} // anonymous namespace
+
+nlohmann::json BatchResult::to_json() const {
+    nlohmann::json j = {
+        {"line", line},
+        {"id", id},
+        {"status", status},
+        {"timings_ms", {{"plan", plan_ms}, {"dry_run", dry_run_ms}, {"apply", apply_ms}, {"total", total_ms}}}
+    };
+    if (!command.empty()) {
+        j["command"] = command;
+        j["path"] = path;
+    }
+    if (!error.empty()) {
+        j["error"] = error;
+    }
+    return j;
+}
+
+size_t BatchSummary::count(const std::string& status) const {
+    auto it = by_status.find(status);
+    return it == by_status.end() ? 0 : it->second;
+}
+
+BatchRunner::BatchRunner(ILLMClient& llm_client, IFileClient& file_client, PolicyChecker policy_checker,
+                         size_t concurrency, Approval approval)
+    : llm_client_(llm_client), file_client_(file_client), policy_checker_(std::move(policy_checker)),
+      concurrency_(concurrency > 0 ? concurrency : 1), approval_(approval) {}
+
+std::optional<BatchItem> BatchRunner::parse_line(const std::string& line, size_t line_number) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        return std::nullopt;
+    }
+    
+    BatchItem item;
+    item.line = line_number;
+    item.id = "line-" + std::to_string(line_number);
+    
+    nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return item; // an empty prompt fails in run_one with the line number
+    }
+    for (const char* key : {"id", "request_id"}) {
+        if (j.contains(key) && (j[key].is_string() || j[key].is_number())) {
+            item.id = j[key].is_string() ? j[key].get<std::string>() : j[key].dump();
+            break;
+        }
+    }
+    
+    if (j.contains("prompt") && j["prompt"].is_string()) {
+        item.prompt = j["prompt"];
+    } else {
+        // The shape of a backlog entry: a title and a longer body
+        for (const char* key : {"title", "body"}) {
+            if (j.contains(key) && j[key].is_string() && !j[key].get<std::string>().empty()) {
+                item.prompt += (item.prompt.empty() ? "" : "\n\n") + j[key].get<std::string>();
+            }
+        }
+    }
+    return item;
+}
+
+std::optional<BatchRunner::Approval> BatchRunner::parse_approval(const std::string& name) {
+    if (name == "policy") return Approval::POLICY;
+    if (name == "all") return Approval::ALL;
+    if (name == "none") return Approval::NONE;
+    return std::nullopt;
+}
+
+bool BatchRunner::approve(const WriteFileCommand& command, const DryRunResult& dry_run) const {
+    if (approver_) {
+        return approver_(command, dry_run);
+    }
+    switch (approval_) {
+        case Approval::ALL:
+            return true;
+        case Approval::NONE:
+            return false;
+        case Approval::POLICY:
+            break;
+    }
+    
+    // A patch or a diff means the file exists; otherwise the plan creates it
+    Operation operation = (command.is_patch() || !dry_run.diff.empty()) ? Operation::UPDATE : Operation::CREATE;
+    std::shared_ptr<const PolicySettings> settings = policy_checker_.get_settings();
+    const OperationPolicy* policy = settings->get_operation_policy("file_tool", operation);
+    return policy && !policy->confirmation_required;
+}
+
+BatchResult BatchRunner::run_one(const BatchItem& item) {
+    BatchResult result;
+    result.line = item.line;
+    result.id = item.id;
+    Clock::time_point started = Clock::now();
+    
+    try {
+        if (item.prompt.empty()) {
+            throw std::runtime_error("no prompt on line " + std::to_string(item.line));
+        }
+        
+        Clock::time_point stage = Clock::now();
+        WriteFileCommand command = llm_client_.request_plan(item.prompt);
+        result.plan_ms = elapsed_ms(stage);
+        result.command = command.command;
+        result.path = command.path;
+        if (command.path.empty()) {
+            throw std::runtime_error("LLM returned empty file path");
+        }
+        if (!command.is_file_change()) {
+            throw std::runtime_error("LLM returned unsupported command: " + command.command);
+        }
+        
+        if (!policy_checker_.is_allowed(command.path)) {
+            result.status = "denied";
+            result.error = "File path '" + command.path + "' is not allowed";
+        } else {
+            stage = Clock::now();
+            DryRunResult dry_run = file_client_.dry_run(command);
+            result.dry_run_ms = elapsed_ms(stage);
+            
+            if (!dry_run.success) {
+                result.status = "failed";
+                result.error = "Dry run failed: " + dry_run.error_message;
+            } else if (dry_run.unchanged) {
+                result.status = "unchanged";
+            } else if (approval_ == Approval::NONE && !approver_) {
+                result.status = "dry_run";
+            } else if (!approve(command, dry_run)) {
+                result.status = "needs_confirmation";
+            } else {
+                stage = Clock::now();
+                ApplyResult applied = file_client_.apply(command);
+                result.apply_ms = elapsed_ms(stage);
+                result.status = applied.success ? (applied.unchanged ? "unchanged" : "applied") : "failed";
+                result.error = applied.success ? "" : applied.error_message;
+            }
+        }
+    } catch (const std::exception& e) {
+        result.status = "failed";
+        result.error = e.what();
+    }
+    
+    result.total_ms = elapsed_ms(started);
+    return result;
+}
+
+BatchSummary BatchRunner::run(std::istream& input, std::ostream& output) {
+    BatchSummary summary;
+    Clock::time_point started = Clock::now();
+    std::mutex output_mutex;
+    
+    {
+        ThreadPool pool(concurrency_);
+        std::vector<std::future<void>> pending;
+        size_t line_number = 0;
+        for (std::string line; std::getline(input, line);) {
+            std::optional<BatchItem> item = parse_line(line, ++line_number);
+            if (!item) {
+                continue;
+            }
+            pending.push_back(pool.submit_with_result([this, item = std::move(*item), &output, &output_mutex,
+                                                       &summary](size_t) {
+                BatchResult result = run_one(item);
+                MAG_LOG_DEBUG("batch", result.id << ": " << result.status << " in " << result.total_ms << " ms");
+                
+                std::lock_guard<std::mutex> lock(output_mutex);
+                output << result.to_json().dump() << '\n' << std::flush;
+                ++summary.by_status[result.status];
+                ++summary.total;
+            }));
+        }
+        for (auto& done : pending) {
+            done.get();
+        }
+    }
+    
+    summary.wall_ms = elapsed_ms(started);
+    return summary;
+}
+
+} // namespace mag
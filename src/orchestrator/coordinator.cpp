@@ -1,49 +1,31 @@
 #include "coordinator.h"
+#include "todo_scheduler.h"
 #include "network/nng_llm_client.h"
 #include "network/nng_file_client.h"
+#include "network/nng_bash_client.h"
+#include "embedded_clients.h"
 #include "message.h"
 #include "config.h"
 #include "bash_tool.h"
 #include "utils.h"
-#include <nng/nng.h>
-#include <nng/protocol/reqrep0/req.h>
+#include "logger.h"
+#include "tracing.h"
 #include <nlohmann/json.hpp>
 #include <iostream>
+#include <iomanip>
 #include <stdexcept>
 #include <cstring>
-#include <regex>
-#include <thread>
-#include <chrono>
+#include <algorithm>
+#include <future>
+#include <set>
 
 namespace mag {
 
-// Helper function to escape regex special characters
-std::string regex_escape(const std::string& str) {
-    std::string result;
-    result.reserve(str.length() * 2); // Reserve space to avoid reallocation
-    
-    for (char c : str) {
-        switch (c) {
-            case '[': case ']': case '{': case '}': case '(': case ')':
-            case '*': case '+': case '?': case '.': case ',': case '\\':
-            case '^': case '$': case '|': case '#': case ' ': case '\t':
-            case '\n': case '\r':
-                result += '\\';
-                result += c;
-                break;
-            default:
-                result += c;
-                break;
-        }
-    }
-    return result;
-}
-
-Coordinator::Coordinator() : llm_socket_(nullptr), file_socket_(nullptr), bash_socket_(nullptr) {
+Coordinator::Coordinator() {
     initialize_with_defaults();
 }
 
-Coordinator::Coordinator(const std::string& provider_override) : llm_socket_(nullptr), file_socket_(nullptr), bash_socket_(nullptr) {
+Coordinator::Coordinator(const std::string& provider_override) {
     // Map friendly names to internal names
     if (provider_override == "chatgpt") {
         current_provider_ = "openai";
@@ -58,37 +40,86 @@ Coordinator::Coordinator(const std::string& provider_override) : llm_socket_(nul
 Coordinator::Coordinator(std::unique_ptr<ILLMClient> llm_client, 
                         std::unique_ptr<IFileClient> file_client,
                         PolicyChecker policy_checker,
-                        TodoManager todo_manager)
+                        TodoManager todo_manager,
+                        std::unique_ptr<IBashClient> bash_client)
     : policy_checker_(std::move(policy_checker))
     , todo_manager_(std::move(todo_manager))
     , llm_client_(std::move(llm_client))
     , file_client_(std::move(file_client))
-    , llm_socket_(nullptr)
-    , file_socket_(nullptr)
-    , bash_socket_(nullptr) {
-    // Interface-based constructor - no socket initialization needed
+    , bash_client_(std::move(bash_client)) {
     // Do NOT call initialize_with_defaults() as we have injected dependencies
 }
 
-Coordinator::~Coordinator() {
-    cleanup_sockets();
-}
+Coordinator::~Coordinator() = default;
 
 void Coordinator::initialize_with_defaults() {
-    // Create default NNG-based clients for backward compatibility
-    llm_client_ = std::make_unique<NNGLLMClient>(current_provider_);
-    file_client_ = std::make_unique<NNGFileClient>();
+    std::string journal_path = TodoConfig::get_journal_path();
+    if (!journal_path.empty()) {
+        try {
+            todo_manager_.attach_journal(journal_path);
+            MAG_LOG_INFO("orchestrator", "Resumed " << todo_manager_.count() << " todos from " << journal_path);
+        } catch (const std::exception& e) {
+            MAG_LOG_ERROR("orchestrator", "Todo journal unavailable: " << e.what());
+        }
+    }
     
-    // Initialize network sockets for communication with services
-    initialize_sockets();
+    if (EmbeddedConfig::is_enabled()) {
+        initialize_embedded();
+    } else {
+        // Default NNG-based clients talk to the services with deadlines
+        llm_client_ = std::make_unique<NNGLLMClient>(current_provider_);
+        file_client_ = std::make_unique<NNGFileClient>();
+        bash_client_ = std::make_unique<NNGBashClient>();
+    }
+    attach_project_context();
+}
+
+void Coordinator::initialize_embedded() {
+    // Everything runs in this process: no sockets, no services to wait for
+    llm_client_ = std::make_unique<EmbeddedLLMClient>(current_provider_);
+    file_client_ = std::make_unique<EmbeddedFileClient>();
+    bash_client_ = std::make_unique<EmbeddedBashClient>();
+    MAG_LOG_INFO("orchestrator", "Running in embedded mode");
+}
+
+void Coordinator::attach_project_context() {
+    size_t budget = ContextConfig::get_budget();
+    if (budget == 0) {
+        return;
+    }
+    // The file tool keeps the index; a failed lookup only costs the prompt its context
+    llm_client_->set_context_source([this, budget](const std::string& prompt) -> std::string {
+        try {
+            ContextSlice slice = file_client_->context(prompt, budget);
+            if (!slice.success) {
+                MAG_LOG_WARN("orchestrator", "No project context: " << slice.error_message);
+                return "";
+            }
+            MAG_LOG_DEBUG("orchestrator", "Project context: " << slice.files << " files, ~" << slice.tokens
+                          << " tokens");
+            return slice.context;
+        } catch (const std::exception& e) {
+            MAG_LOG_WARN("orchestrator", "No project context: " << e.what());
+            return "";
+        }
+    });
+    MAG_LOG_INFO("orchestrator", "Grounding prompts in up to " << budget << " tokens of project context");
 }
 
 void Coordinator::run(const std::string& user_prompt) {
+    // Every service call below carries this trace (MAG_TRACE)
+    Span span("request", Span::Kind::ROOT);
+    span.set_attribute("mode", chat_mode_ ? "chat" : "plan");
     try {
         std::cout << "Processing request: " << user_prompt << std::endl;
         
         // Check if we're in chat mode (default)
         if (chat_mode_) {
+            if (streaming_ && llm_client_) {
+                request_streamed_chat_from_llm(user_prompt);
+                return;
+            }
+            
             std::string response = request_chat_from_llm(user_prompt);
             std::cout << "Response: " << response << std::endl;
             
@@ -98,6 +129,12 @@ void Coordinator::run(const std::string& user_prompt) {
         
         // Step 1: Get plan from LLM
         WriteFileCommand command = request_plan_from_llm(user_prompt);
+        
+        // A usable plan's dry run is already on its way while the plan is shown
+        std::future<DryRunResult> pending_dry_run;
+        if (!command.path.empty() && command.is_file_change() && policy_checker_.is_allowed(command.path)) {
+            pending_dry_run = request_dry_run_async(command);
+        }
         std::cout << "LLM proposed: " << command.command << " " << command.path << std::endl;
         
         // Validate the command
@@ -106,25 +143,31 @@ void Coordinator::run(const std::string& user_prompt) {
             return;
         }
         
-        if (command.command != "WriteFile") {
+        if (!command.is_file_change()) {
             std::cout << "Error: LLM returned unsupported command: " << command.command << std::endl;
             return;
         }
         
         // Step 2: Check policy
-        if (!policy_checker_.is_allowed(command.path)) {
+        bool allowed;
+        {
+            Span policy("policy");
+            allowed = policy_checker_.is_allowed(command.path);
+        }
+        if (!allowed) {
             std::cout << "Policy Denied: File path '" << command.path << "' is not allowed." << std::endl;
             return;
         }
         
-        // Step 3: Perform dry run
-        DryRunResult dry_run_result = request_dry_run(command);
+        // Step 3: Collect the dry run
+        DryRunResult dry_run_result = pending_dry_run.get();
         if (!dry_run_result.success) {
             std::cout << "Dry run failed: " << dry_run_result.error_message << std::endl;
             return;
         }
         
         std::cout << dry_run_result.description << std::endl;
+        std::cout << dry_run_result.diff;
         
         // Step 4: Get user confirmation (unless always approve is enabled)
         if (!always_approve_ && !get_user_confirmation(dry_run_result)) {
@@ -137,18 +180,34 @@ void Coordinator::run(const std::string& user_prompt) {
         display_result(apply_result);
         
     } catch (const std::exception& e) {
+        span.set_error(e.what());
         std::cerr << "Error: " << e.what() << std::endl;
     }
 }
 
+BatchSummary Coordinator::run_batch(std::istream& input, std::ostream& output, size_t concurrency,
+                                    BatchRunner::Approval approval) {
+    if (!llm_client_ || !file_client_) {
+        throw std::runtime_error("Batch mode needs an LLM client and a file client");
+    }
+    BatchRunner runner(*llm_client_, *file_client_, policy_checker_, concurrency, approval);
+    return runner.run(input, output);
+}
+
 std::string Coordinator::run_with_conversation_history(const std::string& user_prompt, 
-                                                      const std::vector<ConversationMessage>& conversation_history) {
+                                                      HistoryView conversation_history) {
+    Span span("request", Span::Kind::ROOT);
+    span.set_attribute("history_messages", std::to_string(conversation_history.size()));
     try {
         std::cout << "Processing request with conversation history (" 
                   << conversation_history.size() << " messages): " << user_prompt << std::endl;
         
         // Check if we're in chat mode (default)
         if (chat_mode_) {
+            if (streaming_ && llm_client_) {
+                return request_streamed_chat_from_llm(user_prompt);
+            }
+            
             std::string response = request_chat_from_llm_with_history(user_prompt, conversation_history);
             std::cout << "Response: " << response << std::endl;
             
@@ -162,204 +221,69 @@ std::string Coordinator::run_with_conversation_history(const std::string& user_p
         return ""; // No response for non-chat mode
         
     } catch (const std::exception& e) {
+        span.set_error(e.what());
         std::cerr << "Error: " << e.what() << std::endl;
         return "Error: " + std::string(e.what());
     }
 }
 
-void Coordinator::initialize_sockets() {
-    int rv;
-    
-    // Create LLM adapter socket
-    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&llm_socket_))) != 0) {
-        throw std::runtime_error("Failed to open LLM socket: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Create file tool socket
-    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&file_socket_))) != 0) {
-        nng_close(*reinterpret_cast<nng_socket*>(&llm_socket_));
-        throw std::runtime_error("Failed to open file tool socket: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Create bash tool socket
-    if ((rv = nng_req0_open(reinterpret_cast<nng_socket*>(&bash_socket_))) != 0) {
-        nng_close(*reinterpret_cast<nng_socket*>(&llm_socket_));
-        nng_close(*reinterpret_cast<nng_socket*>(&file_socket_));
-        throw std::runtime_error("Failed to open bash tool socket: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Connect to LLM adapter
-    std::string llm_url = NetworkConfig::get_llm_adapter_url();
-    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&llm_socket_), llm_url.c_str(), nullptr, 0)) != 0) {
-        cleanup_sockets();
-        throw std::runtime_error("Failed to connect to LLM adapter: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Connect to file tool
-    std::string file_url = NetworkConfig::get_file_tool_url();
-    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&file_socket_), file_url.c_str(), nullptr, 0)) != 0) {
-        cleanup_sockets();
-        throw std::runtime_error("Failed to connect to file tool: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Connect to bash tool
-    std::string bash_url = NetworkConfig::get_bash_tool_url();
-    if ((rv = nng_dial(*reinterpret_cast<nng_socket*>(&bash_socket_), bash_url.c_str(), nullptr, 0)) != 0) {
-        cleanup_sockets();
-        throw std::runtime_error("Failed to connect to bash tool: " + std::string(nng_strerror(rv)));
-    }
-}
-
-void Coordinator::cleanup_sockets() {
-    if (llm_socket_) {
-        nng_close(*reinterpret_cast<nng_socket*>(&llm_socket_));
-        llm_socket_ = nullptr;
-    }
-    if (file_socket_) {
-        nng_close(*reinterpret_cast<nng_socket*>(&file_socket_));
-        file_socket_ = nullptr;
-    }
-    if (bash_socket_) {
-        nng_close(*reinterpret_cast<nng_socket*>(&bash_socket_));
-        bash_socket_ = nullptr;
-    }
-}
-
 WriteFileCommand Coordinator::request_plan_from_llm(const std::string& user_prompt) {
-    // Use interface if available (new design)
-    if (llm_client_) {
-        return llm_client_->request_plan(user_prompt);
-    }
-    
-    // Fallback to legacy NNG implementation
-    int rv;
-    
-    // Create request with optional provider override
-    nlohmann::json request = {
-        {"prompt", user_prompt}
-    };
-    
-    if (!current_provider_.empty()) {
-        request["provider"] = current_provider_;
-    }
-    
-    std::string request_str = request.dump();
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&llm_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to LLM adapter: " + std::string(nng_strerror(rv)));
+    if (!llm_client_) {
+        throw std::runtime_error("No LLM client configured");
     }
-    
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&llm_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from LLM adapter: " + std::string(nng_strerror(rv)));
-    }
-    
-    std::string response(buf, sz);
-    nng_free(buf, sz);
-    
-    return MessageHandler::deserialize_command(response);
+    return llm_client_->request_plan(user_prompt);
 }
 
 GenericCommand Coordinator::request_generic_plan_from_llm(const std::string& user_prompt) {
-    // Use interface if available (new design)
-    if (llm_client_) {
-        return llm_client_->request_generic_plan(user_prompt);
+    if (!llm_client_) {
+        throw std::runtime_error("No LLM client configured");
     }
-    
-    // Fallback: for legacy NNG implementation, create a GenericCommand from WriteFileCommand
-    WriteFileCommand legacy_cmd = request_plan_from_llm(user_prompt);
-    GenericCommand generic_cmd;
-    generic_cmd.type = OperationType::FILE_WRITE;
-    generic_cmd.description = legacy_cmd.command + " " + legacy_cmd.path;
-    generic_cmd.file_path = legacy_cmd.path;
-    generic_cmd.file_content = legacy_cmd.content;
-    return generic_cmd;
+    return llm_client_->request_generic_plan(user_prompt);
 }
 
 DryRunResult Coordinator::request_dry_run(const WriteFileCommand& command) {
-    // Use interface if available (new design)
-    if (file_client_) {
-        return file_client_->dry_run(command);
-    }
-    
-    // Fallback to legacy NNG implementation
-    nlohmann::json request = {
-        {"operation", "dry_run"},
-        {"command", {
-            {"command", command.command},
-            {"path", command.path},
-            {"content", command.content}
-        }}
-    };
-    
-    std::string request_str = request.dump();
-    int rv;
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&file_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to file tool: " + std::string(nng_strerror(rv)));
-    }
-    
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&file_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from file tool: " + std::string(nng_strerror(rv)));
+    return request_dry_run_async(command).get();
+}
+
+std::future<DryRunResult> Coordinator::request_dry_run_async(const WriteFileCommand& command) {
+    if (!file_client_) {
+        throw std::runtime_error("No file client configured");
     }
-    
-    std::string response(buf, sz);
-    nng_free(buf, sz);
-    
-    return MessageHandler::deserialize_dry_run_result(response);
+    return file_client_->dry_run_async(command);
 }
 
 ApplyResult Coordinator::request_apply(const WriteFileCommand& command) {
-    // Use interface if available (new design)
-    if (file_client_) {
-        return file_client_->apply(command);
+    if (!file_client_) {
+        throw std::runtime_error("No file client configured");
     }
-    
-    // Fallback to legacy NNG implementation
-    nlohmann::json request = {
-        {"operation", "apply"},
-        {"command", {
-            {"command", command.command},
-            {"path", command.path},
-            {"content", command.content}
-        }}
-    };
-    
-    std::string request_str = request.dump();
-    int rv;
-    
-    // Send request
-    if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&file_socket_), 
-                      const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-        throw std::runtime_error("Failed to send to file tool: " + std::string(nng_strerror(rv)));
+    return file_client_->apply(command);
+}
+
+BatchDryRunResult Coordinator::request_dry_run_batch(const std::vector<WriteFileCommand>& commands) {
+    if (!file_client_) {
+        throw std::runtime_error("No file client configured");
     }
-    
-    // Receive response
-    char* buf = nullptr;
-    size_t sz;
-    if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&file_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-        throw std::runtime_error("Failed to receive from file tool: " + std::string(nng_strerror(rv)));
+    return file_client_->dry_run_batch(commands);
+}
+
+BatchApplyResult Coordinator::request_apply_batch(const std::vector<WriteFileCommand>& commands,
+                                                  bool all_or_nothing) {
+    if (!file_client_) {
+        throw std::runtime_error("No file client configured");
     }
-    
-    std::string response(buf, sz);
-    nng_free(buf, sz);
-    
-    return MessageHandler::deserialize_apply_result(response);
+    return file_client_->apply_batch(commands, all_or_nothing);
 }
 
 bool Coordinator::get_user_confirmation(const DryRunResult& dry_run_result) {
+    std::lock_guard<std::mutex> lock(confirmation_mutex_);
     std::string input;
-    std::cout << "Apply this change? [y)es/n)o/a)lways]: ";
-    std::getline(std::cin, input);
+    const char* question = "Apply this change? [y)es/n)o/a)lways]: ";
+    if (line_reader_) {
+        input = line_reader_(question);
+    } else {
+        std::cout << question;
+        std::getline(std::cin, input);
+    }
     
     if (!input.empty()) {
         char choice = input[0];
@@ -403,53 +327,65 @@ void Coordinator::toggle_chat_mode() {
 }
 
 std::string Coordinator::request_chat_from_llm(const std::string& user_prompt) {
-    std::string response;
-    
-    // Use interface if available (new design)
-    if (llm_client_) {
-        response = llm_client_->request_chat(user_prompt);
-    } else {
-        // Fallback to legacy NNG implementation
-        int rv;
-        
-        // Create request with chat mode indicator
-        nlohmann::json request = {
-            {"prompt", user_prompt},
-            {"chat_mode", true}
-        };
-        
-        if (!current_provider_.empty()) {
-            request["provider"] = current_provider_;
-        }
-        
-        std::string request_str = request.dump();
-        
-        // Send request
-        if ((rv = nng_send(*reinterpret_cast<nng_socket*>(&llm_socket_), 
-                          const_cast<char*>(request_str.c_str()), request_str.length(), 0)) != 0) {
-            throw std::runtime_error("Failed to send to LLM adapter: " + std::string(nng_strerror(rv)));
-        }
-        
-        // Receive response
-        char* buf = nullptr;
-        size_t sz;
-        if ((rv = nng_recv(*reinterpret_cast<nng_socket*>(&llm_socket_), &buf, &sz, NNG_FLAG_ALLOC)) != 0) {
-            throw std::runtime_error("Failed to receive from LLM adapter: " + std::string(nng_strerror(rv)));
-        }
-        
-        response = std::string(buf, sz);
-        nng_free(buf, sz);
+    if (!llm_client_) {
+        throw std::runtime_error("No LLM client configured");
     }
+    std::string response = llm_client_->request_chat(user_prompt);
     
     // Parse and execute todo operations from the response
     return parse_and_execute_todo_operations(response);
 }
 
+std::string Coordinator::request_streamed_chat_from_llm(const std::string& user_prompt) {
+    std::cout << "Response: " << std::flush;
+    std::string processed;
+    std::string execution_log;
+    auto emit = [&processed](std::string_view text) {
+        processed += text;
+        std::cout << text << std::flush;
+    };
+    
+    // Todo list calls run as soon as they are complete. From the first call that
+    // executes todos on, the reply waits for the stream to end so a long run
+    // cannot stall it.
+    bool deferring = false;
+    std::string deferred;
+    ToolCallParser parser(
+        [&](std::string_view text) {
+            if (deferring) {
+                deferred += text;
+            } else {
+                emit(text);
+            }
+        },
+        [&](const ToolCall& call) {
+            deferring = deferring || call.executes();
+            if (deferring) {
+                deferred += call.text;
+            } else {
+                emit(run_tool_call(call, execution_log));
+            }
+        });
+    llm_client_->request_chat_stream(user_prompt, [&parser](const std::string& delta) {
+        parser.feed(delta);
+    });
+    parser.finish();
+    
+    ToolCallParser rest(emit, [&](const ToolCall& call) {
+        emit(run_tool_call(call, execution_log));
+    });
+    rest.feed(deferred);
+    rest.finish();
+    std::cout << std::endl;
+    report_tool_calls(execution_log);
+    return processed;
+}
+
 std::string Coordinator::request_chat_from_llm_with_history(const std::string& user_prompt,
-                                                           const std::vector<ConversationMessage>& conversation_history) {
-    // For now, use regular chat method - conversation history is handled by CLI level
-    // TODO: Extend protocol to support conversation history natively for richer context
-    std::string response = request_chat_from_llm(user_prompt);
+                                                           HistoryView conversation_history) {
+    // The history already ends with user_prompt; it may open with a compaction summary
+    std::string response = llm_client_ ? llm_client_->request_chat_with_history(conversation_history)
+                                       : request_chat_from_llm(user_prompt);
     
     // Parse and execute todo operations from the response
     return parse_and_execute_todo_operations(response);
@@ -482,250 +418,132 @@ void Coordinator::display_result(const ApplyResult& result) {
 }
 
 std::string Coordinator::parse_and_execute_todo_operations(const std::string& llm_response) {
-    std::string modified_response = llm_response;
+    // One pass over the reply; each call's result takes its place in the output
+    std::string modified_response;
+    modified_response.reserve(llm_response.size());
     std::string execution_log;
+    ToolCallParser parser(
+        [&modified_response](std::string_view text) { modified_response += text; },
+        [&](const ToolCall& call) { modified_response += run_tool_call(call, execution_log); });
+    parser.feed(llm_response);
+    parser.finish();
     
-    // Parse todo operations from the LLM response
-    // Look for patterns like add_todo(title, description) AND block format
-    std::regex add_todo_regex(R"(add_todo\s*\(\s*['"](.*?)['"]\s*,\s*['"](.*?)['"]\s*\))");
-    // Note: CodeBundler format now handled with string operations instead of regex
-    std::regex list_todos_regex(R"(list_todos\s*\(\s*\))");
-    std::regex mark_complete_regex(R"(mark_complete\s*\(\s*(\d+)\s*\))");
-    std::regex delete_todo_regex(R"(delete_todo\s*\(\s*(\d+)\s*\))");
-    
-    // Execution function calls for autonomous operation
-    std::regex execute_next_regex(R"(execute_next\s*\(\s*\))");
-    std::regex execute_all_regex(R"(execute_all\s*\(\s*\))");
-    std::regex execute_todo_regex(R"(execute_todo\s*\(\s*(\d+)\s*\))");
-    
-    // Safety mechanism for LLM to request user control
-    std::regex request_approval_regex(R"(request_user_approval\s*\(\s*['"](.*?)['"]\s*\))");
-    
-    // /do command parsing removed from LLM responses
-    // Only CLI user input should trigger /do commands
-    // LLM responses should only manage todos, not execute them
-    
-    std::smatch match;
-    
-    // Process add_todo operations
-    auto add_todo_start = modified_response.cbegin();
-    while (std::regex_search(add_todo_start, modified_response.cend(), match, add_todo_regex)) {
-        std::string title = match[1].str();
-        std::string description = match[2].str();
-        
-        // Execute the todo operation
-        int new_id = todo_manager_.add_todo(title, description);
-        execution_log += "\n[TODO] Added: " + title + " (ID: " + std::to_string(new_id) + ")";
-        
-        // Remove the function call from the response and replace with result
-        std::string replacement = "**Added:** " + title;
-        modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        
-        add_todo_start = modified_response.cbegin();
-    }
-    
-    // Process CodeBundler-style <TODO_SEPARATOR> format using string operations
-    size_t pos = 0;
-    while ((pos = modified_response.find("<TODO_SEPARATOR>", pos)) != std::string::npos) {
-        size_t start_separator = pos;
-        size_t content_start = pos + 16; // length of "<TODO_SEPARATOR>"
-        
-        // Find the newline after the opening separator
-        size_t newline_pos = modified_response.find('\n', content_start);
-        if (newline_pos == std::string::npos) break;
-        
-        // Find the closing separator
-        size_t end_pos = modified_response.find("\n<TODO_SEPARATOR>", newline_pos);
-        if (end_pos == std::string::npos) break;
-        
-        // Extract the content between separators
-        std::string content = modified_response.substr(newline_pos + 1, end_pos - newline_pos - 1);
-        
-        // Parse title and description
-        size_t title_pos = content.find("Title:");
-        size_t desc_pos = content.find("Description:");
-        
-        if (title_pos != std::string::npos && desc_pos != std::string::npos) {
-            size_t title_start = title_pos + 6; // length of "Title:"
-            size_t title_end = content.find('\n', title_start);
-            
-            std::string title = content.substr(title_start, title_end - title_start);
-            std::string description = content.substr(desc_pos + 12); // length of "Description:"
-            
-            // Trim whitespace
-            title.erase(0, title.find_first_not_of(" \t\r\n"));
-            title.erase(title.find_last_not_of(" \t\r\n") + 1);
-            description.erase(0, description.find_first_not_of(" \t\r\n"));
-            description.erase(description.find_last_not_of(" \t\r\n") + 1);
-            
-            // Execute the todo operation
-            int new_id = todo_manager_.add_todo(title, description);
-            execution_log += "\n[TODO] Added: " + title + " (ID: " + std::to_string(new_id) + ")";
-            
-            // Replace the entire block with result
-            std::string replacement = "**Added:** " + title;
-            size_t block_end = end_pos + 16; // include closing separator
-            modified_response.replace(start_separator, block_end - start_separator, replacement);
-            
-            // Update position for next search
-            pos = start_separator + replacement.length();
-        } else {
-            pos = end_pos + 16; // skip this block if malformed
+    report_tool_calls(execution_log);
+    return modified_response;
+}
+
+std::string Coordinator::run_tool_call(const ToolCall& call, std::string& execution_log) {
+    switch (call.kind) {
+        case ToolCall::Kind::ADD_TODO: {
+            int new_id = todo_manager_.add_todo(call.title, call.description, call.depends_on);
+            execution_log += "\n[TODO] Added: " + call.title + " (ID: " + std::to_string(new_id) + ")";
+            return "**Added:** " + call.title;
         }
-    }
-    
-    // Process list_todos operations
-    if (std::regex_search(modified_response, match, list_todos_regex)) {
-        auto todos = todo_manager_.list_todos(true); // include completed
-        std::string todo_list = "\n**Current Todos:**\n";
-        if (todos.empty()) {
-            todo_list += "- No todos yet\n";
-        } else {
-            for (const auto& todo : todos) {
-                std::string status_icon = (todo.status == TodoStatus::COMPLETED) ? "✅" : "⏳";
-                todo_list += "- " + status_icon + " " + std::to_string(todo.id) + ": " + todo.title + "\n";
-                if (!todo.description.empty()) {
-                    todo_list += "  " + todo.description + "\n";
+        
+        case ToolCall::Kind::LIST_TODOS: {
+            TodoView todos = todo_manager_.all(); // include completed
+            std::string todo_list = "\n**Current Todos:**\n";
+            if (todos.empty()) {
+                todo_list += "- No todos yet\n";
+            } else {
+                for (const auto& todo : todos) {
+                    std::string status_icon = (todo.status == TodoStatus::COMPLETED) ? "✅" : "⏳";
+                    todo_list += "- " + status_icon + " " + std::to_string(todo.id) + ": " + todo.title + "\n";
+                    if (!todo.description.empty()) {
+                        todo_list += "  " + todo.description + "\n";
+                    }
                 }
             }
+            return todo_list;
         }
-        modified_response = std::regex_replace(modified_response, list_todos_regex, todo_list);
-    }
-    
-    // Process mark_complete operations
-    auto complete_start = modified_response.cbegin();
-    while (std::regex_search(complete_start, modified_response.cend(), match, mark_complete_regex)) {
-        int todo_id = std::stoi(match[1].str());
         
-        if (todo_manager_.mark_completed(todo_id)) {
-            execution_log += "\n[TODO] Completed: ID " + std::to_string(todo_id);
-            std::string replacement = "**Completed:** Todo " + std::to_string(todo_id);
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        } else {
-            std::string replacement = "**Error:** Todo " + std::to_string(todo_id) + " not found";
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        }
+        case ToolCall::Kind::MARK_COMPLETE:
+            if (todo_manager_.mark_completed(call.id)) {
+                execution_log += "\n[TODO] Completed: ID " + std::to_string(call.id);
+                return "**Completed:** Todo " + std::to_string(call.id);
+            }
+            return "**Error:** Todo " + std::to_string(call.id) + " not found";
         
-        complete_start = modified_response.cbegin();
-    }
-    
-    // Process delete_todo operations
-    auto delete_start = modified_response.cbegin();
-    while (std::regex_search(delete_start, modified_response.cend(), match, delete_todo_regex)) {
-        int todo_id = std::stoi(match[1].str());
+        case ToolCall::Kind::DELETE_TODO:
+            if (todo_manager_.delete_todo(call.id)) {
+                execution_log += "\n[TODO] Deleted: ID " + std::to_string(call.id);
+                return "**Deleted:** Todo " + std::to_string(call.id);
+            }
+            return "**Error:** Todo " + std::to_string(call.id) + " not found";
         
-        if (todo_manager_.delete_todo(todo_id)) {
-            execution_log += "\n[TODO] Deleted: ID " + std::to_string(todo_id);
-            std::string replacement = "**Deleted:** Todo " + std::to_string(todo_id);
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        } else {
-            std::string replacement = "**Error:** Todo " + std::to_string(todo_id) + " not found";
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
+        // Execution calls let the LLM run todos when the user clearly wants it
+        case ToolCall::Kind::EXECUTE_NEXT: {
+            const TodoItem* next = todo_manager_.get_next_pending();
+            if (!next) {
+                return "**No pending todos to execute**";
+            }
+            TodoItem todo = *next;
+            todo_manager_.mark_in_progress(todo.id);
+            execute_single_todo(todo);
+            todo_manager_.mark_completed(todo.id);
+            execution_log += "\n[EXECUTE] Completed: " + todo.title + " (ID: " + std::to_string(todo.id) + ")";
+            return "**Executed:** " + todo.title;
         }
         
-        delete_start = modified_response.cbegin();
-    }
-    
-    // Process execution function calls for autonomous operation
-    // These allow LLM to autonomously execute todos when user clearly wants it
-    
-    // Process execute_next() calls
-    auto execute_next_start = modified_response.cbegin();
-    while (std::regex_search(execute_next_start, modified_response.cend(), match, execute_next_regex)) {
-        TodoItem* next = todo_manager_.get_next_pending();
-        if (next) {
-            todo_manager_.mark_in_progress(next->id);
-            execute_single_todo(*next);
-            todo_manager_.mark_completed(next->id);
-            execution_log += "\n[EXECUTE] Completed: " + next->title + " (ID: " + std::to_string(next->id) + ")";
-            
-            // Replace the function call with result
-            std::string replacement = "**Executed:** " + next->title;
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        } else {
-            std::string replacement = "**No pending todos to execute**";
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
+        case ToolCall::Kind::EXECUTE_ALL: {
+            auto pending_todos = todo_manager_.get_pending_todos();
+            int executed_count = 0;
+            start_plan_prefetch(pending_todos);
+            try {
+                for (const auto& todo : pending_todos) {
+                    todo_manager_.mark_in_progress(todo.id);
+                    execute_single_todo(todo);
+                    todo_manager_.mark_completed(todo.id);
+                    execution_log += "\n[EXECUTE] Completed: " + todo.title + " (ID: " + std::to_string(todo.id) + ")";
+                    executed_count++;
+                }
+            } catch (...) {
+                plan_prefetcher_.reset();
+                throw;
+            }
+            plan_prefetcher_.reset();
+            return "**Executed " + std::to_string(executed_count) + " pending todos**";
         }
         
-        execute_next_start = modified_response.cbegin();
-    }
-    
-    // Process execute_all() calls  
-    auto execute_all_start = modified_response.cbegin();
-    while (std::regex_search(execute_all_start, modified_response.cend(), match, execute_all_regex)) {
-        auto pending_todos = todo_manager_.get_pending_todos();
-        int executed_count = 0;
-        
-        for (const auto& todo : pending_todos) {
+        case ToolCall::Kind::EXECUTE_TODO: {
+            auto* found = todo_manager_.get_todo(call.id);
+            if (!found || found->status != TodoStatus::PENDING) {
+                return "**Error:** Todo " + std::to_string(call.id) + " not found or not pending";
+            }
+            TodoItem todo = *found;
             todo_manager_.mark_in_progress(todo.id);
             execute_single_todo(todo);
             todo_manager_.mark_completed(todo.id);
             execution_log += "\n[EXECUTE] Completed: " + todo.title + " (ID: " + std::to_string(todo.id) + ")";
-            executed_count++;
-        }
-        
-        std::string replacement = "**Executed " + std::to_string(executed_count) + " pending todos**";
-        modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        
-        execute_all_start = modified_response.cbegin();
-    }
-    
-    // Process execute_todo(id) calls
-    auto execute_todo_start = modified_response.cbegin();
-    while (std::regex_search(execute_todo_start, modified_response.cend(), match, execute_todo_regex)) {
-        int todo_id = std::stoi(match[1].str());
-        auto* todo = todo_manager_.get_todo(todo_id);
-        
-        if (todo && todo->status == TodoStatus::PENDING) {
-            todo_manager_.mark_in_progress(todo_id);
-            execute_single_todo(*todo);
-            todo_manager_.mark_completed(todo_id);
-            execution_log += "\n[EXECUTE] Completed: " + todo->title + " (ID: " + std::to_string(todo_id) + ")";
-            
-            std::string replacement = "**Executed:** " + todo->title;
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        } else {
-            std::string replacement = "**Error:** Todo " + std::to_string(todo_id) + " not found or not pending";
-            modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
+            return "**Executed:** " + todo.title;
         }
         
-        execute_todo_start = modified_response.cbegin();
+        // Safety mechanism for the LLM to hand control back to the user
+        case ToolCall::Kind::REQUEST_APPROVAL:
+            execution_log += "\n[APPROVAL REQUESTED] " + call.reason;
+            execution_log += "\n💡 The AI is requesting your approval. Use /todo to see pending items and /do commands to execute when ready.";
+            return "**⏸️  Requesting User Approval:** " + call.reason + "\n\nI've paused here to get your approval. Please review the pending todos and use /do commands when you're ready to proceed.";
     }
-    
-    // Process request_user_approval() calls - safety mechanism for LLM
-    auto approval_start = modified_response.cbegin();
-    while (std::regex_search(approval_start, modified_response.cend(), match, request_approval_regex)) {
-        std::string reason = match[1].str();
-        
-        // Show the approval request to user
-        execution_log += "\n[APPROVAL REQUESTED] " + reason;
-        execution_log += "\n💡 The AI is requesting your approval. Use /todo to see pending items and /do commands to execute when ready.";
-        
-        // Replace the function call with user-visible message
-        std::string replacement = "**⏸️  Requesting User Approval:** " + reason + "\n\nI've paused here to get your approval. Please review the pending todos and use /do commands when you're ready to proceed.";
-        modified_response = std::regex_replace(modified_response, std::regex(regex_escape(match[0].str())), replacement);
-        
-        approval_start = modified_response.cbegin();
+    return call.text;
+}
+
+void Coordinator::report_tool_calls(const std::string& execution_log) {
+    if (execution_log.empty()) {
+        return;
     }
+    std::cout << execution_log << std::endl;
     
-    // Add execution log if any operations were performed
-    if (!execution_log.empty()) {
-        std::cout << execution_log << std::endl;
-        
-        // Check if there are pending todos and suggest execution
-        auto pending_todos = todo_manager_.get_pending_todos();
-        if (!pending_todos.empty()) {
-            std::cout << "\n💡 Suggestion: You have " << pending_todos.size() 
-                      << " pending todo(s). Use '/do next' to execute the next one, "
-                      << "or '/do all' to execute all pending todos." << std::endl;
-        }
+    // Check if there are pending todos and suggest execution
+    size_t pending = todo_manager_.count_pending();
+    if (pending > 0) {
+        std::cout << "\n💡 Suggestion: You have " << pending 
+                  << " pending todo(s). Use '/do next' to execute the next one, "
+                  << "or '/do all' to execute all pending todos." << std::endl;
     }
-    
-    return modified_response;
 }
 
 void Coordinator::execute_next_todo() {
-    TodoItem* next = todo_manager_.get_next_pending();
+    const TodoItem* next = todo_manager_.get_next_pending();
     
     if (!next) {
         std::cout << "No pending todos to execute." << std::endl;
@@ -753,8 +571,14 @@ void Coordinator::execute_todos_until(int stop_id) {
     }
     
     std::cout << "Executing " << todos_to_execute.size() << " todo(s) until ID " << stop_id << "..." << std::endl;
+    begin_run();
+    start_plan_prefetch(todos_to_execute);
     
     for (const auto& todo : todos_to_execute) {
+        if (!execution_.proceed()) {
+            std::cout << "\nExecution interrupted." << std::endl;
+            break;
+        }
         try {
             std::cout << "\n--- Executing: " << todo.title << " ---" << std::endl;
             todo_manager_.mark_in_progress(todo.id);
@@ -767,6 +591,8 @@ void Coordinator::execute_todos_until(int stop_id) {
         }
     }
     
+    plan_prefetcher_.reset();
+    execution_.end();
     std::cout << "\nExecution stopped before ID " << stop_id << "." << std::endl;
 }
 
@@ -779,8 +605,14 @@ void Coordinator::execute_todos_range(int start_id, int end_id) {
     }
     
     std::cout << "Executing " << todos_to_execute.size() << " todo(s) in range [" << start_id << ", " << end_id << "]..." << std::endl;
+    begin_run();
+    start_plan_prefetch(todos_to_execute);
     
     for (const auto& todo : todos_to_execute) {
+        if (!execution_.proceed()) {
+            std::cout << "\nExecution interrupted." << std::endl;
+            break;
+        }
         try {
             std::cout << "\n--- Executing: " << todo.title << " ---" << std::endl;
             todo_manager_.mark_in_progress(todo.id);
@@ -793,6 +625,8 @@ void Coordinator::execute_todos_range(int start_id, int end_id) {
         }
     }
     
+    plan_prefetcher_.reset();
+    execution_.end();
     std::cout << "\nRange execution complete." << std::endl;
 }
 
@@ -804,40 +638,61 @@ void Coordinator::execute_todos() {
         return;
     }
     
-    // Initialize execution state
-    execution_state_ = ExecutionState::RUNNING;
-    should_stop_execution_ = false;
-    should_pause_execution_ = false;
+    begin_run();
     
     std::cout << "Executing " << pending_todos.size() << " pending todo(s)..." << std::endl;
     std::cout << "💡 Use /pause, /stop, or /cancel to control execution." << std::endl;
     
-    for (const auto& todo : pending_todos) {
-        // Check for stop/cancel requests
-        if (should_stop_execution_) {
+    size_t width = TodoConfig::get_parallelism();
+    if (width > 1) {
+        execute_todo_graph(pending_todos, width);
+        execution_.end();
+        std::cout << "\nTodo execution complete!" << std::endl;
+        return;
+    }
+    
+    start_plan_prefetch(pending_todos);
+    size_t next = 0;
+    while (next < pending_todos.size()) {
+        // Waits out a pause; a stop or cancel ends the run
+        if (!execution_.proceed()) {
             std::cout << "\nExecution interrupted." << std::endl;
             break;
         }
         
-        // Check for pause requests
-        while (should_pause_execution_ && execution_state_ == ExecutionState::PAUSED) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            if (should_stop_execution_) break;
+        // A run of consecutive file todos is dry-run and applied as one batch;
+        // bash todos in between keep their place in the order
+        if (!should_execute_as_bash_command(todo_prompt(pending_todos[next]))) {
+            size_t end = next;
+            while (end < pending_todos.size() && !should_execute_as_bash_command(todo_prompt(pending_todos[end]))) {
+                ++end;
+            }
+            execute_file_todo_batch(std::vector<TodoItem>(pending_todos.begin() + next, pending_todos.begin() + end));
+            next = end;
+            continue;
         }
         
-        if (should_stop_execution_) {
-            std::cout << "\nExecution interrupted." << std::endl;
-            break;
+        // With MAG_CONCURRENT_BASH=1 a run of consecutive bash todos runs at the same time
+        if (BashToolConfig::concurrent_todos()) {
+            size_t end = next;
+            while (end < pending_todos.size() && should_execute_as_bash_command(todo_prompt(pending_todos[end]))) {
+                ++end;
+            }
+            if (end - next > 1) {
+                execute_bash_todo_group(std::vector<TodoItem>(pending_todos.begin() + next, pending_todos.begin() + end));
+                next = end;
+                continue;
+            }
         }
         
+        const auto& todo = pending_todos[next++];
         try {
             std::cout << "\n--- Executing: " << todo.title << " ---" << std::endl;
             
             // Mark as in progress
             todo_manager_.mark_in_progress(todo.id);
             
-            // Execute the todo as a file operation
-            execute_single_todo(todo);
+            execute_todo_as_bash_command(todo);
             
             // Mark as completed
             todo_manager_.mark_completed(todo.id);
@@ -849,17 +704,65 @@ void Coordinator::execute_todos() {
         }
     }
     
-    // Reset execution state
-    execution_state_ = ExecutionState::STOPPED;
-    should_stop_execution_ = false;
-    should_pause_execution_ = false;
-    
-    if (!should_stop_execution_) {
+    plan_prefetcher_.reset();
+    bool interrupted = execution_.stopping();
+    execution_.end();
+    if (!interrupted) {
         std::cout << "\nTodo execution complete!" << std::endl;
     }
 }
 
+void Coordinator::execute_todo_graph(const std::vector<TodoItem>& todos, size_t width) {
+    std::set<int> in_run;
+    for (const auto& todo : todos) {
+        in_run.insert(todo.id);
+    }
+    std::set<int> unfinished;
+    for (const auto& todo : todo_manager_.all()) {
+        if (todo.status != TodoStatus::COMPLETED && !in_run.count(todo.id)) {
+            unfinished.insert(todo.id);
+        }
+    }
+    
+    auto is_bash = [this](const TodoItem& todo) { return should_execute_as_bash_command(todo_prompt(todo)); };
+    std::vector<TodoDependencies> dependencies = TodoScheduler::plan(todos, is_bash, unfinished);
+    std::cout << "Running up to " << width << " independent todo(s) at a time" << std::endl;
+    
+    // Workers only plan and execute; the todo list and the summary lines are updated here
+    TodoScheduler scheduler(width);
+    scheduler.run(
+        todos, dependencies, [this](const TodoItem& todo) { execute_single_todo(todo); },
+        [this](const TodoItem& todo) {
+            std::cout << "\n--- Executing: " << todo.title << " ---" << std::endl;
+            todo_manager_.mark_in_progress(todo.id);
+        },
+        [this](const TodoItem& todo, const TodoScheduler::Result& result) {
+            switch (result.outcome) {
+            case TodoScheduler::Outcome::COMPLETED:
+                todo_manager_.mark_completed(todo.id);
+                std::cout << "✅ Completed: " << todo.title << std::endl;
+                break;
+            case TodoScheduler::Outcome::FAILED:
+                std::cout << "❌ Failed: " << todo.title << " - " << result.error << std::endl;
+                break;
+            default:
+                std::cout << "⏭️  Skipped: " << todo.title << " - " << result.error << std::endl;
+                break;
+            }
+        },
+        [this]() {
+            if (execution_.proceed()) {
+                return false;
+            }
+            std::cout << "\nExecution interrupted; waiting for running todos." << std::endl;
+            return true;
+        });
+}
+
 void Coordinator::execute_single_todo(const TodoItem& todo) {
+    Span span("todo", Span::Kind::ROOT);
+    span.set_attribute("todo_id", std::to_string(todo.id));
+    
     // Determine if this should be a bash command or file operation
     std::string prompt = todo.title;
     if (!todo.description.empty()) {
@@ -867,8 +770,8 @@ void Coordinator::execute_single_todo(const TodoItem& todo) {
     }
     
     bool is_bash = should_execute_as_bash_command(prompt);
-    std::cout << "[ROUTING-DEBUG] Todo: \"" << prompt << "\" -> " 
-              << (is_bash ? "bash_tool" : "file_tool") << std::endl;
+    MAG_LOG_DEBUG("orchestrator", "Todo: \"" << prompt << "\" -> " 
+              << (is_bash ? "bash_tool" : "file_tool"));
     
     if (is_bash) {
         execute_todo_as_bash_command(todo);
@@ -878,73 +781,147 @@ void Coordinator::execute_single_todo(const TodoItem& todo) {
 }
 
 bool Coordinator::should_execute_as_bash_command(const std::string& prompt) {
-    // Simple heuristics to determine if this should be a bash command
-    std::string lower_prompt = prompt;
-    std::transform(lower_prompt.begin(), lower_prompt.end(), lower_prompt.begin(), ::tolower);
+    return local_planner()->plan(prompt).is_bash;
+}
+
+std::shared_ptr<const LocalCommandPlanner> Coordinator::local_planner() const {
+    // The policy's allowed_commands count as known commands, so follow its reloads
+    uint64_t version = policy_checker_.version();
+    std::shared_ptr<const LocalCommandPlanner> planner = local_planner_.load();
+    if (planner && planner->policy_version() == version) {
+        return planner;
+    }
+    std::vector<std::string> allowed_commands;
+    std::shared_ptr<const PolicySettings> settings = policy_checker_.get_settings();
+    auto bash = settings->tools.find("bash_tool");
+    if (bash != settings->tools.end()) {
+        allowed_commands = bash->second.create.allowed_commands;
+    }
+    planner = std::make_shared<const LocalCommandPlanner>(allowed_commands, version);
+    local_planner_.store(planner);
+    return planner;
+}
+
+BashCommand Coordinator::plan_bash_todo(const TodoItem& todo, bool check_policy) {
+    std::string prompt = todo_prompt(todo);
     
-    // Keywords that suggest bash commands
-    std::vector<std::string> bash_keywords = {
-        "run", "execute", "build", "compile", "make", "cmake", "npm", "yarn", "pip",
-        "install", "test", "cd ", "ls", "pwd", "mkdir", "chmod", "grep", "find",
-        "git ", "docker", "curl", "wget", "tar", "unzip", "export"
-    };
+    // A command spelled out in the todo is used as written; otherwise fall back to
+    // the keyword extraction
+    LocalPlan local = local_planner()->plan(prompt);
+    std::string bash_command = local.confident() && !local.command.empty() ? local.command
+                                                                           : extract_bash_command_from_prompt(prompt);
     
-    for (const auto& keyword : bash_keywords) {
-        if (lower_prompt.find(keyword) != std::string::npos) {
-            return true;
-        }
+    MAG_LOG_DEBUG("orchestrator", "Extracted command: \"" << bash_command 
+              << "\" from prompt: \"" << prompt << "\" (" << local.reason
+              << ", confidence " << local.confidence << ")");
+    
+    if (bash_command.empty()) {
+        throw std::runtime_error("Could not determine bash command from: " + prompt);
     }
     
-    return false;
+    // Create BashCommand and execute via bash_tool service
+    BashCommand cmd;
+    cmd.command = "execute";
+    cmd.bash_command = bash_command;
+    cmd.description = prompt;
+    if (!check_policy) {
+        return cmd;
+    }
+    
+    // Policy check for bash commands
+    bool is_allowed = policy_checker_.is_bash_command_allowed(cmd.bash_command);
+    MAG_LOG_DEBUG("orchestrator", "Command: \"" << cmd.bash_command 
+              << "\" -> " << (is_allowed ? "ALLOWED" : "BLOCKED"));
+    
+    if (!is_allowed) {
+        std::string reason = policy_checker_.get_bash_command_violation_reason(cmd.bash_command);
+        MAG_LOG_DEBUG("orchestrator", "Violation reason: " << reason);
+        throw std::runtime_error("Bash policy violation: " + reason + " (command: " + cmd.bash_command + ")");
+    }
+    return cmd;
 }
 
-void Coordinator::execute_todo_as_bash_command(const TodoItem& todo) {
-    try {
-        std::string prompt = todo.title;
-        if (!todo.description.empty()) {
-            prompt += " - " + todo.description;
+void Coordinator::execute_bash_todo_group(const std::vector<TodoItem>& todos) {
+    std::vector<const TodoItem*> running;
+    std::vector<BashCommand> commands;
+    for (const auto& todo : todos) {
+        try {
+            commands.push_back(plan_bash_todo(todo, false));
+            running.push_back(&todo);
+        } catch (const std::exception& e) {
+            std::cout << "❌ Failed: " << todo.title << " - Bash execution failed: " << e.what() << std::endl;
         }
-        
-        // For bash commands, we'll extract the command from the prompt
-        // In the future, we can enhance this to ask LLM for the specific command
-        std::string bash_command = extract_bash_command_from_prompt(prompt);
-        
-        std::cout << "[BASH-DEBUG] Extracted command: \"" << bash_command 
-                  << "\" from prompt: \"" << prompt << "\"" << std::endl;
-        
-        if (bash_command.empty()) {
-            throw std::runtime_error("Could not determine bash command from: " + prompt);
+    }
+    
+    // The whole group is checked against one policy snapshot before any of it starts
+    std::vector<std::string> command_lines;
+    for (const auto& command : commands) {
+        command_lines.push_back(command.bash_command);
+    }
+    std::vector<bool> allowed = policy_checker_.evaluate_bash_batch(command_lines);
+    size_t kept = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (!allowed[i]) {
+            std::string reason = policy_checker_.get_bash_command_violation_reason(commands[i].bash_command);
+            std::cout << "❌ Failed: " << running[i]->title << " - Bash execution failed: Bash policy violation: "
+                      << reason << " (command: " << commands[i].bash_command << ")" << std::endl;
+            continue;
         }
-        
-        std::cout << "Bash command: " << bash_command << std::endl;
-        
-        // Create BashCommand and execute via bash_tool service
-        BashCommand cmd;
-        cmd.command = "execute";
-        cmd.bash_command = bash_command;
-        cmd.description = prompt;
-        
-        // Policy check for bash commands
-        bool is_allowed = policy_checker_.is_bash_command_allowed(cmd.bash_command);
-        std::cout << "[POLICY-DEBUG] Command: \"" << cmd.bash_command 
-                  << "\" -> " << (is_allowed ? "ALLOWED" : "BLOCKED") << std::endl;
-        
-        if (!is_allowed) {
-            std::string reason = policy_checker_.get_bash_command_violation_reason(cmd.bash_command);
-            std::cout << "[POLICY-DEBUG] Violation reason: " << reason << std::endl;
-            throw std::runtime_error("Bash policy violation: " + reason + " (command: " + cmd.bash_command + ")");
+        todo_manager_.mark_in_progress(running[i]->id);
+        commands[kept] = std::move(commands[i]);
+        running[kept++] = running[i];
+    }
+    commands.resize(kept);
+    running.resize(kept);
+    if (commands.empty()) {
+        return;
+    }
+    
+    std::cout << "\n--- Running " << commands.size() << " bash todo(s) concurrently ---" << std::endl;
+    for (const auto& command : commands) {
+        std::cout << "Bash command: " << command.bash_command << std::endl;
+    }
+    
+    std::vector<CommandResult> results;
+    if (bash_client_) {
+        results = bash_client_->execute_concurrently(commands);
+    } else {
+        results.resize(commands.size());
+        for (auto& result : results) {
+            result.stderr_output = "Bash client not configured";
         }
+    }
+    
+    // Output is shown per todo once all of them are done, start and end only
+    for (size_t i = 0; i < running.size() && i < results.size(); ++i) {
+        std::cout << "\n--- " << running[i]->title << " ---" << std::endl;
+        std::cout << results[i].summary(BashToolConfig::SUMMARY_BYTES);
+        display_bash_result(results[i], true);
+        if (results[i].success) {
+            todo_manager_.mark_completed(running[i]->id);
+            std::cout << "✅ Completed: " << running[i]->title << std::endl;
+        } else {
+            std::cout << "❌ Failed: " << running[i]->title << " - Bash execution failed: exit code "
+                      << results[i].exit_code << std::endl;
+        }
+    }
+}
+
+void Coordinator::execute_todo_as_bash_command(const TodoItem& todo) {
+    try {
+        BashCommand cmd = plan_bash_todo(todo);
+        std::cout << "Bash command: " << cmd.bash_command << std::endl;
         
         CommandResult result = request_bash_execution(cmd);
         
-        std::cout << "[EXEC-DEBUG] Bash execution result: success=" << result.success 
+        MAG_LOG_DEBUG("orchestrator", "Bash execution result: success=" << result.success 
                   << ", exit_code=" << result.exit_code
                   << ", stdout_length=" << result.stdout_output.length()
                   << ", stderr_length=" << result.stderr_output.length()
-                  << ", pwd_after=" << result.pwd_after_execution << std::endl;
+                  << ", pwd_after=" << result.pwd_after_execution);
         
         // Display results
-        display_bash_result(result);
+        display_bash_result(result, true);
         
         if (!result.success) {
             throw std::runtime_error("Bash command failed with exit code: " + std::to_string(result.exit_code));
@@ -956,75 +933,278 @@ void Coordinator::execute_todo_as_bash_command(const TodoItem& todo) {
 }
 
 void Coordinator::execute_todo_as_file_operation(const TodoItem& todo) {
-    // Convert todo into a WriteFile request using the file operation mode
-    // Temporarily disable chat mode to use file operations
-    bool original_chat_mode = chat_mode_;
-    chat_mode_ = false;
+    // Convert todo into a WriteFile request; planning does not depend on chat_mode_, so it is
+    // left alone and todos can run side by side. The title and description are the prompt.
+    // Step 1: Get plan from LLM
+    WriteFileCommand command = request_todo_plan(todo);
+    
+    // Start the dry run of a permitted plan before printing it
+    std::future<DryRunResult> pending_dry_run;
+    if (!command.path.empty() && policy_checker_.is_allowed(command.path)) {
+        pending_dry_run = request_dry_run_async(command);
+    }
+    std::cout << "LLM proposed: " << command.command << " " << command.path << std::endl;
+    
+    // Validate the command
+    if (command.path.empty()) {
+        throw std::runtime_error("LLM did not provide a valid file path");
+    }
+    
+    // Step 2: Policy check
+    if (!policy_checker_.is_allowed(command.path)) {
+        throw std::runtime_error("Policy violation: " + command.path);
+    }
+    
+    // Step 3: Dry run
+    DryRunResult dry_run_result = pending_dry_run.get();
+    std::cout << "[DRY-RUN] " << dry_run_result.description << std::endl;
+    std::cout << dry_run_result.diff;
+    
+    if (dry_run_result.success) {
+        // For auto-execution, we skip user confirmation
+        // Step 4: Apply the changes
+        ApplyResult result = request_apply(command);
+        display_result(result);
+        
+        if (!result.success) {
+            throw std::runtime_error(result.error_message);
+        }
+    } else {
+        throw std::runtime_error("Dry run failed: " + dry_run_result.error_message);
+    }
+}
+
+std::string Coordinator::todo_prompt(const TodoItem& todo) const {
+    std::string prompt = todo.title;
+    if (!todo.description.empty()) {
+        prompt += " - " + todo.description;
+    }
+    return prompt;
+}
+
+WriteFileCommand Coordinator::request_todo_plan(const TodoItem& todo) {
+    std::string prompt = todo_prompt(todo);
+    if (plan_batches_.plans() > 0) {
+        if (auto planned = plan_batches_.take(prompt, plan_batch_context())) {
+            MAG_LOG_DEBUG("orchestrator", "Plan for todo " << todo.id << " from a provider batch job");
+            return *planned;
+        }
+    }
+    return plan_prefetcher_ ? plan_prefetcher_->take(prompt) : request_plan_from_llm(prompt);
+}
+
+void Coordinator::start_plan_prefetch(const std::vector<TodoItem>& todos) {
+    plan_prefetcher_.reset();
+    size_t depth = TodoConfig::get_prefetch_depth();
+    std::string batch_context = plan_batches_.plans() > 0 ? plan_batch_context() : "";
+    std::vector<std::string> prompts;
+    for (const auto& todo : todos) {
+        std::string prompt = todo_prompt(todo);
+        if (!should_execute_as_bash_command(prompt) &&
+            (batch_context.empty() || !plan_batches_.has_plan(prompt, batch_context))) {
+            prompts.push_back(prompt);
+        }
+    }
+    if (depth == 0 || prompts.size() < 2) {
+        return;
+    }
+    
+    // A plan is made from the todo's prompt and the system prompt, which follows the
+    // provider and the policy; a change to either makes prefetched plans stale
+    plan_prefetcher_ = std::make_unique<PlanPrefetcher>(
+        std::move(prompts), depth, [this](const std::string& prompt) { return request_plan_from_llm(prompt); },
+        [this] { return current_provider_ + '\0' + std::to_string(policy_checker_.version()); });
+}
+
+std::string Coordinator::plan_batch_context() const {
+    // The policy version restarts with each session; its settings do not
+    std::shared_ptr<const PolicySettings> settings = policy_checker_.get_settings();
+    std::string policy = settings ? PolicyConfig::settings_to_json(*settings).dump() : std::string();
+    return current_provider_ + ":" + Utils::hash_to_hex(Utils::hash64(policy));
+}
+
+void Coordinator::submit_plan_batch() {
+    std::string context = plan_batch_context();
+    PlanBatchStore::Job job;
+    job.context = context;
+    std::vector<std::pair<std::string, std::string>> prompts;
+    std::set<std::string> seen;
+    for (const auto& todo : todo_manager_.get_execution_queue()) {
+        if (prompts.size() >= TodoConfig::MAX_PLAN_BATCH) {
+            break;
+        }
+        std::string prompt = todo_prompt(todo);
+        if (should_execute_as_bash_command(prompt) || plan_batches_.covers(prompt, context) ||
+            !seen.insert(prompt).second) {
+            continue;
+        }
+        // Custom ids must be short and plain for every provider
+        std::string id = "todo-" + std::to_string(todo.id);
+        prompts.emplace_back(id, prompt);
+        job.prompts[id] = prompt;
+    }
+    if (prompts.empty()) {
+        std::cout << "No pending file todos need a plan" << std::endl;
+        return;
+    }
+    
+    job.status = llm_client_->submit_plan_batch(prompts);
+    plan_batches_.add_job(job);
+    std::cout << "📦 Submitted " << prompts.size() << " todo plans as " << job.status.provider
+              << " batch " << job.status.id << " (" << job.status.state << ")" << std::endl;
+    std::cout << "Check on it with /todo batch status; its plans are used once it has ended" << std::endl;
+}
+
+void Coordinator::check_plan_batches() {
+    std::vector<PlanBatchStore::Job> jobs = plan_batches_.jobs();
+    if (jobs.empty()) {
+        std::cout << "No plan batches in flight; " << plan_batches_.plans() << " batch plans ready" << std::endl;
+        return;
+    }
+    for (const auto& job : jobs) {
+        try {
+            PlanBatchStatus status = llm_client_->poll_plan_batch(job.status);
+            if (!status.ended) {
+                plan_batches_.update_job(status);
+                std::cout << "⏳ " << status.provider << " batch " << status.id << ": " << status.state << ", "
+                          << status.succeeded + status.failed << "/" << status.total << " done" << std::endl;
+                continue;
+            }
+            
+            // A job that failed as a whole may have no results to collect
+            std::vector<PlanBatchResult> results;
+            if (!status.results.empty()) {
+                results = llm_client_->collect_plan_batch(status);
+            }
+            size_t kept = plan_batches_.store_results(status.id, results);
+            std::cout << (kept == job.prompts.size() ? "✅ " : "⚠️  ") << status.provider << " batch " << status.id
+                      << " " << status.state << ": " << kept << "/" << job.prompts.size() << " plans ready" << std::endl;
+            if (!status.error_message.empty()) {
+                std::cout << "   " << status.error_message << std::endl;
+            }
+            for (const auto& result : results) {
+                if (!result.success) {
+                    std::cout << "   " << result.id << ": " << result.error_message << std::endl;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cout << "❌ Batch " << job.status.id << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+WriteFileCommand Coordinator::plan_file_todo(const TodoItem& todo) {
+    WriteFileCommand command = request_todo_plan(todo);
+    std::cout << "LLM proposed: " << command.command << " " << command.path << std::endl;
+    
+    if (command.path.empty()) {
+        throw std::runtime_error("LLM did not provide a valid file path");
+    }
+    return command;
+}
+
+void Coordinator::execute_file_todo_batch(const std::vector<TodoItem>& todos) {
+    // Plan every todo first; a todo that cannot be planned fails on its own
+    std::vector<WriteFileCommand> commands;
+    std::vector<const TodoItem*> planned;
+    for (const auto& todo : todos) {
+        if (execution_.stopping()) {
+            break;
+        }
+        std::cout << "\n--- Planning: " << todo.title << " ---" << std::endl;
+        todo_manager_.mark_in_progress(todo.id);
+        try {
+            commands.push_back(plan_file_todo(todo));
+            planned.push_back(&todo);
+        } catch (const std::exception& e) {
+            std::cout << "❌ Failed: " << todo.title << " - " << e.what() << std::endl;
+        }
+    }
+    
+    // Every planned path is checked against one policy snapshot before anything is sent
+    std::vector<std::string> paths;
+    for (const auto& command : commands) {
+        paths.push_back(command.path);
+    }
+    std::vector<bool> allowed = policy_checker_.evaluate_batch("file_tool", Operation::READ, paths);
+    size_t kept = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (!allowed[i]) {
+            std::cout << "❌ Failed: " << planned[i]->title << " - Policy violation: " << commands[i].path << std::endl;
+            continue;
+        }
+        commands[kept] = std::move(commands[i]);
+        planned[kept++] = planned[i];
+    }
+    commands.resize(kept);
+    planned.resize(kept);
+    if (commands.empty()) {
+        return;
+    }
     
     try {
-        // Use the todo title and description as the user prompt for file operations
-        std::string prompt = todo.title;
-        if (!todo.description.empty()) {
-            prompt += " - " + todo.description;
+        // One round trip validates the whole set, including paths written twice
+        BatchDryRunResult dry_run = request_dry_run_batch(commands);
+        std::vector<WriteFileCommand> to_apply;
+        std::vector<const TodoItem*> applying;
+        for (size_t i = 0; i < planned.size(); ++i) {
+            const DryRunResult& checked = dry_run.results.at(i);
+            if (checked.success) {
+                std::cout << "[DRY-RUN] " << checked.description << std::endl;
+                std::cout << checked.diff;
+                to_apply.push_back(std::move(commands[i]));
+                applying.push_back(planned[i]);
+            } else {
+                std::cout << "❌ Failed: " << planned[i]->title << " - Dry run failed: "
+                          << checked.error_message << std::endl;
+            }
         }
         
-        // Step 1: Get plan from LLM
-        WriteFileCommand command = request_plan_from_llm(prompt);
-        std::cout << "LLM proposed: " << command.command << " " << command.path << std::endl;
-        
-        // Validate the command
-        if (command.path.empty()) {
-            throw std::runtime_error("LLM did not provide a valid file path");
+        bool all_or_nothing = FileToolConfig::atomic_batches();
+        if (all_or_nothing && !dry_run.success) {
+            std::cout << "Batch not applied: every file must pass the dry run (MAG_ATOMIC_BATCH)" << std::endl;
+            return;
         }
-        
-        // Step 2: Policy check
-        if (!policy_checker_.is_allowed(command.path)) {
-            throw std::runtime_error("Policy violation: " + command.path);
+        if (to_apply.empty() || execution_.stopping()) {
+            return;
         }
         
-        // Step 3: Dry run
-        DryRunResult dry_run_result = request_dry_run(command);
-        std::cout << "[DRY-RUN] " << dry_run_result.description << std::endl;
-        
-        if (dry_run_result.success) {
-            // For auto-execution, we skip user confirmation
-            // Step 4: Apply the changes
-            ApplyResult result = request_apply(command);
-            display_result(result);
-            
-            if (!result.success) {
-                throw std::runtime_error(result.error_message);
+        BatchApplyResult applied = request_apply_batch(to_apply, all_or_nothing);
+        for (size_t i = 0; i < applying.size(); ++i) {
+            const ApplyResult& result = applied.results.at(i);
+            if (result.success) {
+                display_result(result);
+                todo_manager_.mark_completed(applying[i]->id);
+                std::cout << "✅ Completed: " << applying[i]->title << std::endl;
+            } else {
+                std::cout << "❌ Failed: " << applying[i]->title << " - " << result.error_message << std::endl;
             }
-        } else {
-            throw std::runtime_error("Dry run failed: " + dry_run_result.error_message);
         }
-        
-    } catch (...) {
-        // Restore chat mode before re-throwing
-        chat_mode_ = original_chat_mode;
-        throw;
+        if (applied.rolled_back) {
+            std::cout << "Batch rolled back: " << applied.error_message << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cout << "❌ Failed: file batch of " << commands.size() << " todo(s) - " << e.what() << std::endl;
     }
-    
-    // Restore chat mode
-    chat_mode_ = original_chat_mode;
 }
 
 void Coordinator::execute_generic_command(const GenericCommand& command) {
-    std::cout << "[GENERIC-DEBUG] Executing command type: " 
-              << (command.is_file_operation() ? "FILE_WRITE" : 
+    MAG_LOG_DEBUG("orchestrator", "Executing command type: " 
+              << (command.type == OperationType::FILE_PATCH ? "FILE_PATCH" :
+                  command.is_file_operation() ? "FILE_WRITE" : 
                   command.is_bash_operation() ? "BASH_COMMAND" : "UNKNOWN")
-              << ", description: \"" << command.description << "\"" << std::endl;
+              << ", description: \"" << command.description << "\"");
     
     if (command.is_file_operation()) {
         // Execute as file operation
         WriteFileCommand file_cmd = command.to_write_file_command();
-        std::cout << "[FILE-DEBUG] WriteFileCommand: path=\"" << file_cmd.path 
-                  << "\", content_length=" << file_cmd.content.length() << std::endl;
+        MAG_LOG_DEBUG("orchestrator", "WriteFileCommand: path=\"" << file_cmd.path 
+                  << "\", content_length=" << file_cmd.content.length());
         
         // Policy check
         bool file_allowed = policy_checker_.is_allowed(file_cmd.path);
-        std::cout << "[POLICY-DEBUG] File path: \"" << file_cmd.path 
-                  << "\" -> " << (file_allowed ? "ALLOWED" : "BLOCKED") << std::endl;
+        MAG_LOG_DEBUG("orchestrator", "File path: \"" << file_cmd.path 
+                  << "\" -> " << (file_allowed ? "ALLOWED" : "BLOCKED"));
         
         if (!file_allowed) {
             throw std::runtime_error("Policy violation: " + file_cmd.path);
@@ -1033,6 +1213,7 @@ void Coordinator::execute_generic_command(const GenericCommand& command) {
         // Dry run
         DryRunResult dry_run_result = request_dry_run(file_cmd);
         std::cout << "[DRY-RUN] " << dry_run_result.description << std::endl;
+        std::cout << dry_run_result.diff;
         
         if (dry_run_result.success) {
             // Apply the changes
@@ -1062,7 +1243,7 @@ void Coordinator::execute_generic_command(const GenericCommand& command) {
         std::cout << "Bash command: " << bash_cmd.bash_command << std::endl;
         
         CommandResult result = request_bash_execution(bash_cmd);
-        display_bash_result(result);
+        display_bash_result(result, true);
         
         if (!result.success) {
             throw std::runtime_error("Bash execution failed: " + result.stderr_output);
@@ -1156,11 +1337,31 @@ std::string Coordinator::extract_bash_command_from_prompt(const std::string& pro
     return prompt;
 }
 
-void Coordinator::display_bash_result(const CommandResult& result) {
+void Coordinator::display_bash_result(const CommandResult& result, bool output_shown) {
+    for (const std::string* log : {&result.stdout_log, &result.stderr_log}) {
+        if (!log->empty()) {
+            std::cout << "📄 Full output: " << *log << std::endl;
+        }
+    }
+    
+    if (result.cached) {
+        std::cout << "♻️  Nothing it reads has changed; reusing the previous result" << std::endl;
+    }
+    
+    const ResourceUsage& usage = result.usage;
+    if (usage.user_cpu.count() > 0 || usage.system_cpu.count() > 0 || usage.max_rss_kb > 0) {
+        std::cout << "⚙️  CPU " << std::fixed << std::setprecision(2) << usage.user_cpu.count() / 1e6 << "s user, "
+                  << usage.system_cpu.count() / 1e6 << "s system" << std::defaultfloat;
+        if (usage.max_rss_kb > 0) {
+            std::cout << ", peak memory " << (usage.max_rss_kb + 1023) / 1024 << " MiB";
+        }
+        std::cout << std::endl;
+    }
+    
     if (result.success) {
         std::cout << "✅ Command succeeded (exit code: " << result.exit_code << ")" << std::endl;
         
-        if (!result.stdout_output.empty()) {
+        if (!output_shown && !result.stdout_output.empty()) {
             std::cout << "📝 Output:\n" << result.stdout_output << std::endl;
         }
         
@@ -1168,13 +1369,19 @@ void Coordinator::display_bash_result(const CommandResult& result) {
             std::cout << "📍 Working directory: " << result.pwd_after_execution << std::endl;
         }
     } else {
-        std::cout << "❌ Command failed (exit code: " << result.exit_code << ")" << std::endl;
+        if (result.cancelled) {
+            std::cout << "🛑 Command cancelled (exit code: " << result.exit_code << ")" << std::endl;
+        } else if (result.timed_out) {
+            std::cout << "⏱️  Command timed out (exit code: " << result.exit_code << ")" << std::endl;
+        } else {
+            std::cout << "❌ Command failed (exit code: " << result.exit_code << ")" << std::endl;
+        }
         
-        if (!result.stderr_output.empty()) {
+        if (!output_shown && !result.stderr_output.empty()) {
             std::cout << "📝 Error output:\n" << result.stderr_output << std::endl;
         }
         
-        if (!result.stdout_output.empty()) {
+        if (!output_shown && !result.stdout_output.empty()) {
             std::cout << "📝 Standard output:\n" << result.stdout_output << std::endl;
         }
         
@@ -1185,9 +1392,7 @@ void Coordinator::display_bash_result(const CommandResult& result) {
 }
 
 void Coordinator::pause_execution() {
-    if (execution_state_ == ExecutionState::RUNNING) {
-        should_pause_execution_ = true;
-        execution_state_ = ExecutionState::PAUSED;
+    if (execution_.pause()) {
         std::cout << "\n⏸️  Execution paused. Use /resume to continue or /stop to stop completely." << std::endl;
     } else {
         std::cout << "No execution in progress to pause." << std::endl;
@@ -1195,9 +1400,7 @@ void Coordinator::pause_execution() {
 }
 
 void Coordinator::resume_execution() {
-    if (execution_state_ == ExecutionState::PAUSED) {
-        should_pause_execution_ = false;
-        execution_state_ = ExecutionState::RUNNING;
+    if (execution_.resume()) {
         std::cout << "▶️  Execution resumed." << std::endl;
     } else {
         std::cout << "No paused execution to resume." << std::endl;
@@ -1205,9 +1408,7 @@ void Coordinator::resume_execution() {
 }
 
 void Coordinator::stop_execution() {
-    if (execution_state_ == ExecutionState::RUNNING || execution_state_ == ExecutionState::PAUSED) {
-        should_stop_execution_ = true;
-        execution_state_ = ExecutionState::STOPPED;
+    if (execution_.stop()) {
         std::cout << "\n🛑 Execution stopped. Remaining todos are still pending." << std::endl;
     } else {
         std::cout << "No execution in progress to stop." << std::endl;
@@ -1215,89 +1416,58 @@ void Coordinator::stop_execution() {
 }
 
 void Coordinator::cancel_execution() {
-    if (execution_state_ == ExecutionState::RUNNING || execution_state_ == ExecutionState::PAUSED) {
-        should_stop_execution_ = true;
-        execution_state_ = ExecutionState::CANCELLED;
+    // A run's token aborts its requests; without a run, whatever is waiting on a
+    // service still gives up now rather than at its deadline
+    if (execution_.cancel()) {
         std::cout << "\n❌ Execution cancelled. Remaining todos are still pending." << std::endl;
     } else {
+        cancel_pending_requests();
         std::cout << "No execution in progress to cancel." << std::endl;
     }
 }
 
+void Coordinator::begin_run() {
+    CancellationToken cancelled = execution_.begin();
+    cancelled.on_cancel([this] { cancel_pending_requests(); });
+}
+
+void Coordinator::cancel_pending_requests() {
+    if (llm_client_) {
+        llm_client_->cancel_pending();
+    }
+    if (file_client_) {
+        file_client_->cancel_pending();
+    }
+    if (bash_client_) {
+        bash_client_->cancel_pending();
+    }
+}
+
 CommandResult Coordinator::request_bash_execution(const BashCommand& command) {
-    if (!bash_socket_) {
+    if (!bash_client_) {
         CommandResult result;
         result.success = false;
-        result.stderr_output = "Bash socket not initialized";
+        result.stderr_output = "Bash client not configured";
         result.exit_code = -1;
         return result;
     }
     
-    try {
-        // Create JSON in the format expected by bash_tool_service
-        nlohmann::json request;
-        request["operation"] = "execute";
-        request["command"] = command.bash_command;
-        request["working_directory"] = command.working_directory.empty() ? 
-            Utils::get_current_working_directory() : command.working_directory;
-        
-        std::string request_json = request.dump();
-        std::cout << "[BASH-REQUEST] Sending JSON: " << request_json << std::endl;
-        
-        // Send request to bash tool service
-        int rv = nng_send(*reinterpret_cast<nng_socket*>(&bash_socket_), 
-                         const_cast<void*>(static_cast<const void*>(request_json.c_str())), 
-                         request_json.length(), 0);
-        if (rv != 0) {
-            CommandResult result;
-            result.success = false;
-            result.stderr_output = "Failed to send bash command: " + std::string(nng_strerror(rv));
-            result.exit_code = -1;
-            return result;
-        }
-        
-        // Receive response from bash tool service
-        char* response_data;
-        size_t response_size;
-        rv = nng_recv(*reinterpret_cast<nng_socket*>(&bash_socket_), 
-                     &response_data, &response_size, NNG_FLAG_ALLOC);
-        if (rv != 0) {
-            CommandResult result;
-            result.success = false;
-            result.stderr_output = "Failed to receive bash response: " + std::string(nng_strerror(rv));
-            result.exit_code = -1;
-            return result;
-        }
-        
-        // Parse response as CommandResult JSON
-        std::string response_str(response_data, response_size);
-        nng_free(response_data, response_size);
-        std::cout << "[BASH-RESPONSE] Received JSON: " << response_str << std::endl;
-        
-        nlohmann::json response_json = nlohmann::json::parse(response_str);
-        CommandResult result;
-        result.command = command.bash_command;  // Use the original command from request
-        result.exit_code = response_json.value("exit_code", -1);
-        result.stdout_output = response_json.value("stdout_output", "");
-        result.stderr_output = response_json.value("stderr_output", "");
-        result.working_directory = response_json.value("working_directory_before", "");
-        result.pwd_after_execution = response_json.value("working_directory_after", "");
-        result.success = response_json.value("success", false);
-        
-        // Handle error responses from bash_tool_service
-        if (response_json.contains("error_message")) {
-            result.stderr_output = response_json.value("error_message", "");
-        }
-        
-        return result;
-    } catch (const std::exception& e) {
-        std::cout << "[BASH-ERROR] Exception in request_bash_execution: " << e.what() << std::endl;
-        CommandResult result;
-        result.success = false;
-        result.stderr_output = "Bash execution error: " + std::string(e.what());
-        result.exit_code = -1;
-        return result;
+    // stdout and stderr go to the terminal as the command produces them
+    bool at_line_start = true;
+    CommandResult result = bash_client_->execute_stream(command,
+        [&at_line_start](bool is_stderr, std::string_view chunk) {
+            if (chunk.empty()) {
+                return;
+            }
+            std::ostream& out = is_stderr ? std::cerr : std::cout;
+            out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            out.flush();
+            at_line_start = chunk.back() == '\n';
+        });
+    if (!at_line_start) {
+        std::cout << std::endl;
     }
+    return result;
 }
 
 } // namespace mag
\ No newline at end of file
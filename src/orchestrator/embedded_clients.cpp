@@ -0,0 +1,253 @@
+#include "embedded_clients.h"
+#include "config.h"
+#include "logger.h"
+#include <chrono>
+
+namespace mag {
+
+namespace {
+
+std::string normalize_provider_name(const std::string& provider_name) {
+    if (provider_name == "chatgpt") {
+        return "openai";
+    }
+    if (provider_name == "claude") {
+        return "anthropic";
+    }
+    return provider_name; // gemini, mistral use same names
+}
+
+std::string latest_user_prompt(HistoryView conversation_history) {
+    for (auto message = conversation_history.rbegin(); message != conversation_history.rend(); ++message) {
+        if (message->role == "user") {
+            return message->content.str();
+        }
+    }
+    return "";
+}
+
+} // anonymous namespace
+
+EmbeddedLLMClient::EmbeddedLLMClient(const std::string& provider_override)
+    : clients_(normalize_provider_name(provider_override)), current_provider_(normalize_provider_name(provider_override)) {
+    std::string cache_dir = ResponseCacheConfig::get_directory();
+    if (!cache_dir.empty()) {
+        clients_.set_response_cache(std::make_shared<ResponseCache>(
+            cache_dir, ResponseCacheConfig::MEMORY_ENTRIES,
+            std::chrono::seconds(ResponseCacheConfig::get_ttl_seconds()),
+            ResponseCacheConfig::get_disk_entries()));
+    }
+    std::string record_file = ReplayConfig::get_record_file();
+    if (!record_file.empty()) {
+        clients_.set_recorder(std::make_shared<ResponseRecorder>(record_file));
+    }
+    prewarm_ = std::async(std::launch::async, [this, provider = current_provider_] { clients_.prewarm(provider); });
+}
+
+template <typename Call>
+auto EmbeddedLLMClient::call_provider(const std::string& provider, Call&& call)
+    -> decltype(call(std::declval<const LLMClient&>())) {
+    if (!provider.empty()) {
+        return call(clients_.get(provider));
+    }
+    return clients_.with_failover("", std::forward<Call>(call));
+}
+
+WriteFileCommand EmbeddedLLMClient::request_plan(const std::string& user_prompt) {
+    CancellationToken cancel;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        cancel = pending_;
+    }
+    std::string prompt = LLMClient::with_project_context(project_context(user_prompt), user_prompt);
+    ResponseMetadata metadata;
+    WriteFileCommand command = call_provider(current_provider_, [&](const LLMClient& client) {
+        return client.get_plan_from_llm(prompt, &metadata, &cancel);
+    });
+    report_usage(metadata.usage);
+    return command;
+}
+
+GenericCommand EmbeddedLLMClient::request_generic_plan(const std::string& user_prompt) {
+    // Same shape as the networked client: plans are file writes
+    WriteFileCommand legacy_cmd = request_plan(user_prompt);
+    GenericCommand generic_cmd;
+    generic_cmd.type = legacy_cmd.is_patch() ? OperationType::FILE_PATCH : OperationType::FILE_WRITE;
+    generic_cmd.description = legacy_cmd.command + " " + legacy_cmd.path;
+    generic_cmd.file_path = legacy_cmd.path;
+    generic_cmd.file_content = legacy_cmd.content;
+    return generic_cmd;
+}
+
+std::string EmbeddedLLMClient::request_chat(const std::string& user_prompt) {
+    std::string prompt = LLMClient::with_project_context(project_context(user_prompt), user_prompt);
+    ResponseMetadata metadata;
+    std::string response = call_provider(current_provider_, [&](const LLMClient& client) {
+        return client.get_chat_response(prompt, &metadata);
+    });
+    report_usage(metadata.usage);
+    return response;
+}
+
+std::string EmbeddedLLMClient::request_chat_stream(const std::string& user_prompt,
+                                                   const std::function<void(const std::string&)>& on_chunk) {
+    // Deltas arrive on this thread straight from the HTTP transfer; no polling
+    std::string prompt = LLMClient::with_project_context(project_context(user_prompt), user_prompt);
+    return call_provider(current_provider_, [&](const LLMClient& client) {
+        return client.stream_chat_response(prompt, [&on_chunk](const std::string& delta) {
+            if (on_chunk) {
+                on_chunk(delta);
+            }
+        });
+    });
+}
+
+std::string EmbeddedLLMClient::request_chat_with_history(HistoryView conversation_history) {
+    // The context goes in a copy; the caller's history stays as it was
+    std::vector<ConversationMessage> grounded;
+    std::string context = project_context(latest_user_prompt(conversation_history));
+    if (!context.empty()) {
+        grounded = LLMClient::with_project_context(context, conversation_history);
+        conversation_history = grounded;
+    }
+    ResponseMetadata metadata;
+    std::string response = call_provider(current_provider_, [&](const LLMClient& client) {
+        return client.get_chat_response_with_history(conversation_history, &metadata);
+    });
+    report_usage(metadata.usage);
+    return response;
+}
+
+std::string EmbeddedLLMClient::request_summary(const std::vector<ConversationMessage>& turns,
+                                               const std::string& previous_summary) {
+    std::string provider = CompactionConfig::get_summary_provider();
+    std::string model = CompactionConfig::get_summary_model();
+    ResponseMetadata metadata;
+    std::string summary = call_provider(provider, [&](const LLMClient& client) {
+        const LLMClient& summarizer = model.empty()
+            ? client : clients_.get(client.get_current_provider(), model);
+        return summarizer.summarize_conversation(turns, previous_summary, &metadata);
+    });
+    report_usage(metadata.usage);
+    return summary;
+}
+
+PlanBatchStatus EmbeddedLLMClient::submit_plan_batch(const std::vector<std::pair<std::string, std::string>>& prompts) {
+    std::vector<std::pair<std::string, std::string>> grounded;
+    grounded.reserve(prompts.size());
+    for (const auto& [id, prompt] : prompts) {
+        grounded.emplace_back(id, LLMClient::with_project_context(project_context(prompt), prompt));
+    }
+    const LLMClient& client = clients_.get(current_provider_);
+    if (!client.supports_batches()) {
+        throw std::runtime_error(client.get_current_provider() + " has no batch API");
+    }
+    return client.submit_plan_batch(grounded);
+}
+
+PlanBatchStatus EmbeddedLLMClient::poll_plan_batch(const PlanBatchStatus& batch) {
+    return clients_.get(batch.provider).poll_plan_batch(batch);
+}
+
+std::vector<PlanBatchResult> EmbeddedLLMClient::collect_plan_batch(const PlanBatchStatus& batch) {
+    return clients_.get(batch.provider).collect_plan_batch(batch);
+}
+
+void EmbeddedLLMClient::set_provider(const std::string& provider_name) {
+    current_provider_ = normalize_provider_name(provider_name);
+}
+
+std::string EmbeddedLLMClient::get_current_provider() const {
+    return current_provider_;
+}
+
+void EmbeddedLLMClient::cancel_pending() {
+    // Requests made from now on get a fresh token
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.cancel();
+    pending_ = CancellationToken();
+}
+
+EmbeddedFileClient::EmbeddedFileClient() {
+    auto policy = std::make_shared<const PolicyChecker>();
+    file_tool_.set_read_policy(policy);
+    index_ = std::make_unique<ProjectIndex>(".", policy);
+}
+
+DryRunResult EmbeddedFileClient::dry_run(const WriteFileCommand& command) {
+    return file_tool_.dry_run(command);
+}
+
+ApplyResult EmbeddedFileClient::apply(const WriteFileCommand& command) {
+    return file_tool_.apply(command);
+}
+
+BatchDryRunResult EmbeddedFileClient::dry_run_batch(const std::vector<WriteFileCommand>& commands) {
+    return file_tool_.dry_run_batch(commands);
+}
+
+BatchApplyResult EmbeddedFileClient::apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) {
+    return file_tool_.apply_batch(commands, all_or_nothing);
+}
+
+ReadFileResult EmbeddedFileClient::read(const ReadFileRequest& request) {
+    return file_tool_.read(request);
+}
+
+FileStatResult EmbeddedFileClient::stat(const std::string& path) {
+    return file_tool_.stat(path);
+}
+
+ContextSlice EmbeddedFileClient::context(const std::string& query, size_t budget_tokens) {
+    return index_->slice(query, budget_tokens);
+}
+
+EmbeddedBashClient::EmbeddedBashClient() : working_directory_(bash_tool_.get_current_directory()) {
+    if (BashToolConfig::sessions_enabled()) {
+        bash_tool_.set_sessions(std::make_shared<ShellSessions>(
+            1, std::chrono::seconds(BashToolConfig::SESSION_IDLE_SECONDS), bash_tool_.limits()));
+    }
+}
+
+CommandResult EmbeddedBashClient::execute(const BashCommand& command) {
+    return execute_stream(command, nullptr);
+}
+
+CommandResult EmbeddedBashClient::execute_stream(const BashCommand& command, const BashTool::OutputHandler& on_output) {
+    std::string working_dir = command.working_directory.empty() ? working_directory_ : command.working_directory;
+    MAG_LOG_INFO("bash_tool", "Executing command: " << command.bash_command << " in directory: " << working_dir);
+    
+    CancellationToken cancel;
+    {
+        std::lock_guard<std::mutex> lock(running_mutex_);
+        running_ = cancel;
+    }
+    
+    try {
+        CommandResult result = bash_tool_.execute_command(command.bash_command, working_dir, -1, on_output, &cancel,
+                                                          "embedded");
+        if (!result.pwd_after_execution.empty()) {
+            working_directory_ = result.pwd_after_execution;
+        }
+        return result;
+    } catch (const std::exception& e) {
+        CommandResult result;
+        result.command = command.bash_command;
+        result.success = false;
+        result.stderr_output = "Command execution error: " + std::string(e.what());
+        result.exit_code = -1;
+        result.working_directory = working_dir;
+        return result;
+    }
+}
+
+LogChunk EmbeddedBashClient::read_log(const std::string& path, uint64_t offset, size_t max_bytes) {
+    return bash_tool_.read_log(path, offset, max_bytes);
+}
+
+void EmbeddedBashClient::cancel_pending() {
+    std::lock_guard<std::mutex> lock(running_mutex_);
+    running_.cancel();
+}
+
+} // namespace mag
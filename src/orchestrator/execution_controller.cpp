@@ -0,0 +1,92 @@
+#include "execution_controller.h"
+
+namespace mag {
+
+CancellationToken ExecutionController::begin() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = State::RUNNING;
+    active_ = true;
+    stopping_ = false;
+    token_ = CancellationToken();
+    return token_;
+}
+
+void ExecutionController::end() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_ = State::STOPPED;
+        active_ = false;
+        stopping_ = false;
+    }
+    changed_.notify_all();
+}
+
+bool ExecutionController::pause() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!active_ || state_ != State::RUNNING) {
+        return false;
+    }
+    state_ = State::PAUSED;
+    return true;
+}
+
+bool ExecutionController::resume() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active_ || state_ != State::PAUSED) {
+            return false;
+        }
+        state_ = State::RUNNING;
+    }
+    changed_.notify_all();
+    return true;
+}
+
+bool ExecutionController::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active_ || (state_ != State::RUNNING && state_ != State::PAUSED)) {
+            return false;
+        }
+        state_ = State::STOPPED;
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    return true;
+}
+
+bool ExecutionController::cancel() {
+    CancellationToken token;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!active_ || (state_ != State::RUNNING && state_ != State::PAUSED)) {
+            return false;
+        }
+        state_ = State::CANCELLED;
+        stopping_ = true;
+        token = token_;
+    }
+    changed_.notify_all();
+    
+    // Callbacks run here, outside the lock
+    token.cancel();
+    return true;
+}
+
+bool ExecutionController::proceed() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return state_ != State::PAUSED || stopping_; });
+    return !stopping_;
+}
+
+bool ExecutionController::stopping() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stopping_;
+}
+
+ExecutionController::State ExecutionController::state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+} // namespace mag
@@ -0,0 +1,173 @@
+#include "local_planner.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace mag {
+
+namespace {
+
+const std::vector<std::string> KNOWN_COMMANDS = {
+    "make", "cmake", "ctest", "ninja", "meson", "bazel", "gradle", "mvn", "npm", "npx", "yarn", "pnpm",
+    "node", "pip", "pip3", "python", "python3", "pytest", "cargo", "go", "git", "docker", "ls", "pwd",
+    "mkdir", "chmod", "grep", "find", "cd", "export", "tar", "unzip", "curl", "wget", "bash", "sh",
+    "cat", "echo", "touch", "cp", "mv", "rm", "gcc", "g++", "clang", "clang++"
+};
+
+// Title openings that ask for file content rather than a command
+const std::set<std::string> FILE_VERBS = {
+    "create", "write", "add", "update", "edit", "modify", "implement", "fix", "refactor",
+    "generate", "rename", "document", "rewrite", "extend"
+};
+
+// Commands whose first argument is a subcommand or target, as in "git status" or "make test"
+const std::set<std::string> SUBCOMMAND_TOOLS = {
+    "make", "cmake", "ninja", "meson", "bazel", "gradle", "mvn", "npm", "npx", "yarn", "pnpm",
+    "pip", "pip3", "cargo", "go", "git", "docker"
+};
+
+// Words that suggest a shell todo when nothing more specific matched
+const std::vector<std::string> BASH_KEYWORDS = {
+    "run", "execute", "build", "compile", "make", "cmake", "npm", "yarn", "pip",
+    "install", "test", "cd ", "ls", "pwd", "mkdir", "chmod", "grep", "find",
+    "git ", "docker", "curl", "wget", "tar", "unzip", "export"
+};
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> split_words(const std::string& text) {
+    std::vector<std::string> words;
+    std::istringstream stream(text);
+    for (std::string word; stream >> word;) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// The first backticked span, fenced or inline
+std::string backticked(const std::string& prompt) {
+    size_t open = prompt.find('`');
+    if (open == std::string::npos) {
+        return "";
+    }
+    if (prompt.compare(open, 3, "```") == 0) {
+        size_t body = prompt.find('\n', open);
+        size_t close = prompt.find("```", open + 3);
+        if (close == std::string::npos) {
+            return "";
+        }
+        // A language tag on the opening fence line is not part of the command
+        size_t start = (body != std::string::npos && body < close) ? body + 1 : open + 3;
+        return trim(prompt.substr(start, close - start));
+    }
+    size_t close = prompt.find('`', open + 1);
+    return close == std::string::npos ? "" : trim(prompt.substr(open + 1, close - open - 1));
+}
+
+bool is_script(const std::string& word) {
+    return word.rfind("./", 0) == 0 && word.size() > 2;
+}
+
+// A flag, path, pattern, number or quoted string, as opposed to an English word
+bool looks_like_argument(const std::string& word) {
+    if (word[0] == '-' || word[0] == '"' || word[0] == '\'') {
+        return true;
+    }
+    return word.find_first_of("/.=*$~:") != std::string::npos ||
+           std::all_of(word.begin(), word.end(), [](unsigned char c) { return std::isdigit(c); });
+}
+
+bool is_plain_word(const std::string& word) {
+    return std::all_of(word.begin(), word.end(), [](unsigned char c) { return std::islower(c) || c == '-'; });
+}
+
+} // anonymous namespace
+
+LocalCommandPlanner::LocalCommandPlanner(const std::vector<std::string>& allowed_commands, uint64_t policy_version)
+    : commands_(KNOWN_COMMANDS.begin(), KNOWN_COMMANDS.end()), policy_version_(policy_version) {
+    for (const auto& command : allowed_commands) {
+        commands_.insert(command);
+        policy_commands_.insert(command);
+    }
+}
+
+bool LocalCommandPlanner::is_command(const std::string& word) const {
+    // Case-sensitive: "Make install" and "Cat facts page" are titles, not command lines
+    return commands_.count(word) > 0 || is_script(word);
+}
+
+bool LocalCommandPlanner::is_command_line(const std::vector<std::string>& words, size_t from) const {
+    if (from >= words.size() || !is_command(words[from])) {
+        return false;
+    }
+    // Past the command, only arguments; an unknown grammar (a policy command)
+    // and the tools in SUBCOMMAND_TOOLS may take one subcommand word first, and
+    // a flag may take a value. "touch up README.md" is prose.
+    size_t next = from + 1;
+    const std::string& command = words[from];
+    if (next < words.size() && is_plain_word(words[next]) &&
+        (SUBCOMMAND_TOOLS.count(command) || policy_commands_.count(command))) {
+        ++next;
+    }
+    for (size_t i = next; i < words.size(); ++i) {
+        bool flag_value = i > next && words[i - 1][0] == '-' && is_plain_word(words[i]);
+        if (!looks_like_argument(words[i]) && !flag_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+LocalPlan LocalCommandPlanner::plan(const std::string& prompt) const {
+    // The title is the part of a todo prompt before " - description"
+    std::string title = trim(prompt.substr(0, prompt.find(" - ")));
+    std::vector<std::string> words = split_words(title);
+    std::string first = words.empty() ? "" : lowercase(words[0]);
+    
+    // "Add `make lint` to the Makefile" quotes a command but asks for a file edit
+    std::string quoted = FILE_VERBS.count(first) ? "" : backticked(prompt);
+    if (!quoted.empty()) {
+        std::vector<std::string> quoted_words = split_words(quoted);
+        if (is_command(quoted_words[0])) {
+            return {true, quoted, 0.95, "backticked command"};
+        }
+    }
+    
+    if ((first == "run" || first == "execute" || first == "exec") && words.size() > 1) {
+        if (is_command_line(words, 1)) {
+            return {true, trim(title.substr(words[0].size())), 0.9, "\"" + first + "\" followed by a command"};
+        }
+        return {true, "", 0.5, "\"" + first + "\" followed by prose"};
+    }
+    
+    if (is_command_line(words, 0)) {
+        return {true, title, 0.85, "title is a " + first + " command"};
+    }
+    
+    if (FILE_VERBS.count(first)) {
+        return {false, "", 0.8, "asks to " + first + " files"};
+    }
+    
+    std::string lower_prompt = lowercase(prompt);
+    for (const auto& keyword : BASH_KEYWORDS) {
+        if (lower_prompt.find(keyword) != std::string::npos) {
+            return {true, "", 0.4, "mentions \"" + trim(keyword) + "\""};
+        }
+    }
+    return {false, "", 0.6, "no command found"};
+}
+
+} // namespace mag
@@ -1,6 +1,12 @@
 #include "cli_interface.h"
 #include "coordinator.h"
+#include "config.h"
+#include "metrics_server.h"
+#include "endpoint_config.h"
+#include "tracing.h"
+#include <fstream>
 #include <iostream>
+#include <cstdlib>
 #include <string>
 
 using namespace mag;
@@ -9,11 +15,17 @@ void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [OPTIONS] [PROMPT]\n\n";
     std::cout << "Options:\n";
     std::cout << "  --provider=PROVIDER   Set LLM provider (gemini|chatgpt|claude|mistral)\n";
+    std::cout << "  --embedded           Run without the llm_adapter/file_tool/bash_tool services\n";
+    std::cout << "  --batch=FILE         Run every prompt in a JSONL file without prompting (- for stdin)\n";
+    std::cout << "  --concurrency=N      Batch prompts in flight (default: MAG_BATCH_CONCURRENCY or LLM workers)\n";
+    std::cout << "  --approve=MODE       Batch approval: policy (default), all or none (dry runs only)\n";
+    std::cout << "  --output=FILE        Write batch results there instead of stdout\n";
     std::cout << "  --help               Show this help message\n\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << "                                    # Interactive CLI mode\n";
     std::cout << "  " << program_name << " \"Create hello.py\"                  # CLI mode with auto-detected provider\n";
-    std::cout << "  " << program_name << " --provider=claude \"Create hello.py\" # CLI mode with specific provider\n\n";
+    std::cout << "  " << program_name << " --provider=claude \"Create hello.py\" # CLI mode with specific provider\n";
+    std::cout << "  " << program_name << " --batch=prompts.jsonl --approve=none # Dry-run a batch of prompts\n\n";
     std::cout << "Interactive Mode Commands:\n";
     std::cout << "  /gemini    - Switch to Gemini provider\n";
     std::cout << "  /chatgpt   - Switch to ChatGPT provider\n";
@@ -28,6 +40,10 @@ int main(int argc, char* argv[]) {
         std::string provider_override;
         std::string user_prompt;
         bool interactive_mode = true;
+        std::string batch_file;
+        std::string batch_output;
+        size_t batch_concurrency = 0;
+        BatchRunner::Approval batch_approval = BatchRunner::Approval::POLICY;
         
         // Parse command line arguments
         for (int i = 1; i < argc; ++i) {
@@ -36,6 +52,28 @@ int main(int argc, char* argv[]) {
             if (arg == "--help" || arg == "-h") {
                 print_usage(argv[0]);
                 return 0;
+            } else if (arg == "--embedded") {
+                // Read by every Coordinator this process creates
+                setenv("MAG_EMBEDDED", "1", 1);
+            } else if (arg.find("--batch=") == 0) {
+                batch_file = arg.substr(8);
+            } else if (arg.find("--concurrency=") == 0) {
+                int concurrency = std::atoi(arg.substr(14).c_str());
+                if (concurrency <= 0) {
+                    std::cerr << "Error: --concurrency needs a positive number" << std::endl;
+                    return 1;
+                }
+                batch_concurrency = static_cast<size_t>(concurrency);
+            } else if (arg.find("--approve=") == 0) {
+                auto approval = BatchRunner::parse_approval(arg.substr(10));
+                if (!approval) {
+                    std::cerr << "Error: Invalid approval mode '" << arg.substr(10) << "'" << std::endl;
+                    std::cerr << "Valid modes: policy, all, none" << std::endl;
+                    return 1;
+                }
+                batch_approval = *approval;
+            } else if (arg.find("--output=") == 0) {
+                batch_output = arg.substr(9);
             } else if (arg.find("--provider=") == 0) {
                 provider_override = arg.substr(11); // Length of "--provider="
                 // Validate provider
@@ -53,6 +91,47 @@ int main(int argc, char* argv[]) {
             }
         }
         
+        // Client-side latencies of the service calls (MAG_METRICS_PORT_BASE)
+        auto metrics_server = MetricsServer::start(MetricsConfig::ORCHESTRATOR_OFFSET);
+        
+        // Root of every request's trace when MAG_TRACE is set
+        Tracer::instance().set_service_name("orchestrator");
+        
+        if (!batch_file.empty()) {
+            std::ifstream file;
+            if (batch_file != "-") {
+                file.open(batch_file);
+                if (!file) {
+                    std::cerr << "Error: Cannot read batch file " << batch_file << std::endl;
+                    return 1;
+                }
+            }
+            std::ofstream output;
+            if (!batch_output.empty()) {
+                output.open(batch_output);
+                if (!output) {
+                    std::cerr << "Error: Cannot write " << batch_output << std::endl;
+                    return 1;
+                }
+            }
+            if (batch_concurrency == 0) {
+                size_t adapters = EndpointConfig::instance().urls(EndpointConfig::Service::LLM_ADAPTER).size();
+                batch_concurrency = BatchConfig::get_concurrency(adapters);
+            }
+            
+            Coordinator coordinator(provider_override);
+            BatchSummary summary = coordinator.run_batch(batch_file == "-" ? std::cin : file,
+                                                         batch_output.empty() ? std::cout : output,
+                                                         batch_concurrency, batch_approval);
+            std::cerr << "Batch: " << summary.total << " prompts in " << static_cast<long>(summary.wall_ms)
+                      << " ms with " << batch_concurrency << " in flight";
+            for (const auto& [status, count] : summary.by_status) {
+                std::cerr << ", " << count << " " << status;
+            }
+            std::cerr << std::endl;
+            return summary.count("failed") > 0 ? 1 : 0;
+        }
+        
         if (interactive_mode) {
             // Interactive CLI mode
             CLIInterface interface(provider_override);
@@ -0,0 +1,150 @@
+#include "plan_batch_store.h"
+#include "atomic_write.h"
+#include "logger.h"
+#include "utils.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+namespace mag {
+
+PlanBatchStore::PlanBatchStore(std::string path) : path_(std::move(path)) {
+    load();
+}
+
+void PlanBatchStore::add_job(Job job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+    save();
+}
+
+void PlanBatchStore::update_job(const PlanBatchStatus& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& job : jobs_) {
+        if (job.status.id == status.id) {
+            job.status = status;
+            save();
+            return;
+        }
+    }
+}
+
+size_t PlanBatchStore::store_results(const std::string& batch_id, const std::vector<PlanBatchResult>& results) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto job = std::find_if(jobs_.begin(), jobs_.end(), [&batch_id](const Job& j) { return j.status.id == batch_id; });
+    if (job == jobs_.end()) {
+        return 0;
+    }
+    size_t kept = 0;
+    for (const auto& result : results) {
+        auto prompt = job->prompts.find(result.id);
+        if (!result.success || prompt == job->prompts.end()) {
+            continue;
+        }
+        plans_[prompt->second] = Plan{result.command, job->context};
+        ++kept;
+    }
+    jobs_.erase(job);
+    save();
+    return kept;
+}
+
+std::vector<PlanBatchStore::Job> PlanBatchStore::jobs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_;
+}
+
+std::optional<WriteFileCommand> PlanBatchStore::take(const std::string& prompt, const std::string& context) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = plans_.find(prompt);
+    if (found == plans_.end()) {
+        return std::nullopt;
+    }
+    std::optional<WriteFileCommand> command;
+    if (found->second.context == context) {
+        command = std::move(found->second.command);
+    } else {
+        MAG_LOG_DEBUG("orchestrator", "Dropping a batch plan made for another provider or policy");
+    }
+    plans_.erase(found);
+    try {
+        save();
+    } catch (const std::exception& e) {
+        // The plan is still good; at worst it is handed out again next session
+        MAG_LOG_WARN("orchestrator", "Plan batch store not saved: " << e.what());
+    }
+    return command;
+}
+
+bool PlanBatchStore::has_plan(const std::string& prompt, const std::string& context) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = plans_.find(prompt);
+    return found != plans_.end() && found->second.context == context;
+}
+
+bool PlanBatchStore::covers(const std::string& prompt, const std::string& context) const {
+    if (has_plan(prompt, context)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(jobs_.begin(), jobs_.end(), [&](const Job& job) {
+        return job.context == context &&
+               std::any_of(job.prompts.begin(), job.prompts.end(),
+                           [&prompt](const auto& entry) { return entry.second == prompt; });
+    });
+}
+
+size_t PlanBatchStore::plans() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return plans_.size();
+}
+
+void PlanBatchStore::load() {
+    std::ifstream file(path_);
+    if (!file) {
+        return;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    try {
+        nlohmann::json state = nlohmann::json::parse(content.str());
+        for (const auto& item : state.value("jobs", nlohmann::json::array())) {
+            Job job;
+            job.status.from_json(item.at("batch"));
+            job.prompts = item.value("prompts", std::map<std::string, std::string>());
+            job.context = item.value("context", "");
+            jobs_.push_back(std::move(job));
+        }
+        for (const auto& item : state.value("plans", nlohmann::json::array())) {
+            Plan plan;
+            plan.command.from_json(item.at("command"));
+            plan.context = item.value("context", "");
+            plans_[item.at("prompt").get<std::string>()] = std::move(plan);
+        }
+    } catch (const std::exception& e) {
+        MAG_LOG_WARN("orchestrator", "Ignoring unreadable plan batch store " << path_ << ": " << e.what());
+        jobs_.clear();
+        plans_.clear();
+    }
+}
+
+void PlanBatchStore::save() const {
+    nlohmann::json state = {{"jobs", nlohmann::json::array()}, {"plans", nlohmann::json::array()}};
+    for (const auto& job : jobs_) {
+        nlohmann::json item = {{"prompts", job.prompts}, {"context", job.context}};
+        job.status.to_json(item["batch"]);
+        state["jobs"].push_back(std::move(item));
+    }
+    for (const auto& [prompt, plan] : plans_) {
+        nlohmann::json item = {{"prompt", prompt}, {"context", plan.context}};
+        plan.command.to_json(item["command"]);
+        state["plans"].push_back(std::move(item));
+    }
+
+    Utils::create_directories(path_); // its parent, e.g. .mag/
+    // Durable: a lost job id means a paid-for batch whose plans never arrive
+    write_file_atomically(path_, state.dump(), true);
+}
+
+} // namespace mag
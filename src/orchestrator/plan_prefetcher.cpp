@@ -0,0 +1,68 @@
+#include "plan_prefetcher.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace mag {
+
+PlanPrefetcher::PlanPrefetcher(std::vector<std::string> prompts, size_t depth, Planner planner, Context context)
+    : prompts_(std::move(prompts)), depth_(std::max<size_t>(depth, 1)), planner_(std::move(planner)),
+      context_(std::move(context)), pool_(depth_) {
+    fill();
+}
+
+PlanPrefetcher::~PlanPrefetcher() {
+    pool_.shutdown();
+    if (hits_ + stale_ + misses_ > 0) {
+        MAG_LOG_DEBUG("orchestrator", "Plan prefetch: " << hits_ << " hit(s), " << stale_ << " stale, "
+                  << misses_ << " miss(es), " << ahead_.size() << " unused");
+    }
+}
+
+WriteFileCommand PlanPrefetcher::take(const std::string& prompt) {
+    auto found = std::find_if(ahead_.begin(), ahead_.end(),
+                              [&prompt](const Pending& pending) { return pending.prompt == prompt; });
+    if (found == ahead_.end()) {
+        // Not requested yet: the run has moved past everything requested so far
+        auto upcoming = std::find(prompts_.begin() + next_, prompts_.end(), prompt);
+        if (upcoming != prompts_.end()) {
+            ahead_.clear();
+            next_ = static_cast<size_t>(upcoming - prompts_.begin()) + 1;
+        }
+        ++misses_;
+        fill();
+        return planner_(prompt);
+    }
+    
+    Pending pending = std::move(*found);
+    ahead_.erase(ahead_.begin(), found + 1);
+    std::string context = context_();
+    if (pending.context != context) {
+        // Everything else ahead was asked under the old context too
+        stale_ += 1 + ahead_.size();
+        for (auto& other : ahead_) {
+            other.plan = pool_.submit_with_result([this, prompt = other.prompt](size_t) { return planner_(prompt); });
+            other.context = context;
+        }
+        fill();
+        return planner_(prompt);
+    }
+    
+    ++hits_;
+    fill();
+    return pending.plan.get();
+}
+
+void PlanPrefetcher::fill() {
+    if (ahead_.size() >= depth_ || next_ >= prompts_.size()) {
+        return;
+    }
+    std::string context = context_();
+    while (ahead_.size() < depth_ && next_ < prompts_.size()) {
+        Pending pending{prompts_[next_], context, {}};
+        pending.plan = pool_.submit_with_result([this, prompt = prompts_[next_]](size_t) { return planner_(prompt); });
+        ahead_.push_back(std::move(pending));
+        ++next_;
+    }
+}
+
+} // namespace mag
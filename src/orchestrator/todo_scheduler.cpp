@@ -0,0 +1,224 @@
+#include "todo_scheduler.h"
+#include "path_resolver.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace mag {
+
+namespace {
+
+// Words of the title and description that look like file or directory paths
+std::vector<std::string> mentioned_paths(const TodoItem& todo) {
+    std::vector<std::string> paths;
+    std::istringstream words(todo.title + " " + todo.description);
+    std::string word;
+    while (words >> word) {
+        const std::string punctuation = "\"'`()[]{}<>,;:!?";
+        size_t begin = word.find_first_not_of(punctuation);
+        size_t end = word.find_last_not_of(punctuation + ".");
+        if (begin == std::string::npos || end == std::string::npos || end < begin) {
+            continue;
+        }
+        word = word.substr(begin, end - begin + 1);
+        if (word.rfind("./", 0) == 0) {
+            word.erase(0, 2);
+        }
+        size_t dot = word.rfind('.');
+        bool has_extension = dot != std::string::npos && dot > 0 && dot + 1 < word.size() &&
+                             std::isalnum(static_cast<unsigned char>(word[dot + 1]));
+        if (word.find('/') != std::string::npos || has_extension) {
+            paths.push_back(word);
+        }
+    }
+    return paths;
+}
+
+bool share_a_path(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    for (const auto& left : a) {
+        for (const auto& right : b) {
+            if (PathResolver::is_within(left, right) || PathResolver::is_within(right, left)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void add_unique(std::vector<size_t>& indices, size_t index) {
+    if (std::find(indices.begin(), indices.end(), index) == indices.end()) {
+        indices.push_back(index);
+    }
+}
+
+} // anonymous namespace
+
+std::vector<TodoDependencies> TodoScheduler::plan(const std::vector<TodoItem>& todos, const IsBash& is_bash,
+                                                  const std::set<int>& unfinished) {
+    std::vector<TodoDependencies> dependencies(todos.size());
+    std::map<int, size_t> index_of;
+    std::vector<std::vector<std::string>> paths;
+    std::vector<bool> bash;
+    for (size_t i = 0; i < todos.size(); ++i) {
+        index_of[todos[i].id] = i;
+        paths.push_back(mentioned_paths(todos[i]));
+        bash.push_back(is_bash(todos[i]));
+    }
+    
+    const size_t none = todos.size();
+    size_t last_bash = none;
+    for (size_t i = 0; i < todos.size(); ++i) {
+        TodoDependencies& waits = dependencies[i];
+        for (int id : todos[i].depends_on) {
+            auto it = index_of.find(id);
+            if (it != index_of.end()) {
+                if (it->second != i) {
+                    add_unique(waits.after, it->second);
+                }
+            } else if (unfinished.count(id)) {
+                waits.unmet.push_back(id);
+            }
+        }
+        
+        if (last_bash != none) {
+            add_unique(waits.after, last_bash);
+        }
+        for (size_t j = (last_bash == none ? 0 : last_bash + 1); j < i; ++j) {
+            if (bash[i] || share_a_path(paths[i], paths[j])) {
+                add_unique(waits.after, j);
+            }
+        }
+        if (bash[i]) {
+            last_bash = i;
+        }
+    }
+    return dependencies;
+}
+
+TodoScheduler::TodoScheduler(size_t width) : width_(std::max<size_t>(width, 1)) {
+}
+
+std::vector<TodoScheduler::Result> TodoScheduler::run(
+    const std::vector<TodoItem>& todos, const std::vector<TodoDependencies>& dependencies,
+    const std::function<void(const TodoItem&)>& run, const std::function<void(const TodoItem&)>& on_start,
+    const std::function<void(const TodoItem&, const Result&)>& on_finish,
+    const std::function<bool()>& should_stop) const {
+    enum class State { WAITING, RUNNING, DONE };
+    std::vector<Result> results(todos.size());
+    std::vector<State> states(todos.size(), State::WAITING);
+    std::vector<size_t> waiting_on(todos.size(), 0);
+    std::vector<std::vector<size_t>> dependents(todos.size());
+    for (size_t i = 0; i < todos.size(); ++i) {
+        for (size_t before : dependencies[i].after) {
+            dependents[before].push_back(i);
+            ++waiting_on[i];
+        }
+    }
+    
+    // A todo that cannot run takes everything downstream of it along
+    auto block = [&](size_t root, const std::string& reason) {
+        std::deque<std::pair<size_t, std::string>> queue = {{root, reason}};
+        while (!queue.empty()) {
+            auto [index, why] = queue.front();
+            queue.pop_front();
+            if (states[index] == State::DONE) {
+                continue;
+            }
+            states[index] = State::DONE;
+            results[index] = {Outcome::BLOCKED, why};
+            on_finish(todos[index], results[index]);
+            for (size_t dependent : dependents[index]) {
+                queue.emplace_back(dependent, "depends on #" + std::to_string(todos[index].id) + ", which did not run");
+            }
+        }
+    };
+    for (size_t i = 0; i < todos.size(); ++i) {
+        if (!dependencies[i].unmet.empty()) {
+            block(i, "depends on #" + std::to_string(dependencies[i].unmet.front()) + ", which has not completed");
+        }
+    }
+    
+    struct Finished {
+        size_t index;
+        bool ok;
+        std::string error;
+    };
+    std::mutex mutex;
+    std::condition_variable finished_cv;
+    std::deque<Finished> finished;
+    ThreadPool pool(std::min(width_, std::max<size_t>(todos.size(), 1)));
+    size_t running = 0;
+    bool stopped = false;
+    
+    while (true) {
+        for (size_t i = 0; i < todos.size() && running < width_ && !stopped; ++i) {
+            if (states[i] != State::WAITING || waiting_on[i] > 0) {
+                continue;
+            }
+            if (should_stop()) {
+                stopped = true;
+                break;
+            }
+            states[i] = State::RUNNING;
+            ++running;
+            on_start(todos[i]);
+            pool.submit([&, i](size_t) {
+                Finished done{i, true, ""};
+                try {
+                    run(todos[i]);
+                } catch (const std::exception& e) {
+                    done = {i, false, e.what()};
+                } catch (...) {
+                    done = {i, false, "unknown error"};
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(std::move(done));
+                finished_cv.notify_one();
+            });
+        }
+        if (running == 0) {
+            break; // everything done, stopped, or only cycles left
+        }
+        
+        std::deque<Finished> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished_cv.wait(lock, [&finished] { return !finished.empty(); });
+            batch.swap(finished);
+        }
+        for (Finished& done : batch) {
+            --running;
+            states[done.index] = State::DONE;
+            if (done.ok) {
+                results[done.index] = {Outcome::COMPLETED, ""};
+                on_finish(todos[done.index], results[done.index]);
+                for (size_t dependent : dependents[done.index]) {
+                    --waiting_on[dependent];
+                }
+            } else {
+                results[done.index] = {Outcome::FAILED, done.error};
+                on_finish(todos[done.index], results[done.index]);
+                for (size_t dependent : dependents[done.index]) {
+                    block(dependent, "depends on #" + std::to_string(todos[done.index].id) + ", which failed");
+                }
+            }
+        }
+    }
+    pool.shutdown();
+    
+    if (!stopped) {
+        for (size_t i = 0; i < todos.size(); ++i) {
+            if (states[i] == State::WAITING) {
+                block(i, "its dependencies form a cycle");
+            }
+        }
+    }
+    return results;
+}
+
+} // namespace mag
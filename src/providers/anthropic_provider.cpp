@@ -1,4 +1,9 @@
 #include "providers/anthropic_provider.h"
+#include "json_extract.h"
+#include "json_writer.h"
+#include "chat_turns.h"
+#include "config.h"
+#include <sstream>
 #include <stdexcept>
 
 namespace mag {
@@ -8,11 +13,21 @@ std::string AnthropicProvider::get_name() const {
 }
 
 std::string AnthropicProvider::get_api_url() const {
-    return "https://api.anthropic.com/v1/messages";
+    return APIConfig::ANTHROPIC_BASE_URL;
 }
 
 std::string AnthropicProvider::get_default_model() const {
-    return "claude-3-haiku-20240307";
+    return APIConfig::ANTHROPIC_DEFAULT_MODEL;
+}
+
+nlohmann::json AnthropicProvider::build_system(const std::string& system_prompt) const {
+    if (!prompt_caching_enabled() || system_prompt.empty()) {
+        return system_prompt;
+    }
+    // A cache breakpoint after the system block caches everything up to it
+    return nlohmann::json::array({
+        {{"type", "text"}, {"text", system_prompt}, {"cache_control", {{"type", "ephemeral"}}}}
+    });
 }
 
 nlohmann::json AnthropicProvider::build_request_payload(
@@ -24,7 +39,7 @@ nlohmann::json AnthropicProvider::build_request_payload(
         {"model", model},
         {"max_tokens", 1000},
         {"temperature", 0.1},
-        {"system", system_prompt},
+        {"system", build_system(system_prompt)},
         {"messages", {
             {{"role", "user"}, {"content", {{{"type", "text"}, {"text", user_prompt}}}}}
         }}
@@ -33,29 +48,110 @@ nlohmann::json AnthropicProvider::build_request_payload(
 
 nlohmann::json AnthropicProvider::build_conversation_payload(
     const std::string& system_prompt,
-    const std::vector<ConversationMessage>& conversation_history,
+    HistoryView conversation_history,
     const std::string& model
 ) const {
-    nlohmann::json messages = nlohmann::json::array();
+    nlohmann::json system = build_system(system_prompt);
     
-    // Convert conversation history to Anthropic format
+    // The Messages API has no "system" role; such turns (e.g. a compaction summary)
+    // follow the cached system prompt so its prefix stays reusable
     for (const auto& msg : conversation_history) {
-        nlohmann::json message = {
-            {"role", msg.role},
-            {"content", {{{"type", "text"}, {"text", msg.content}}}}
-        };
-        messages.push_back(message);
+        if (msg.role != "system") {
+            continue;
+        }
+        if (system.is_array()) {
+            system.push_back({{"type", "text"}, {"text", msg.content.view()}});
+        } else {
+            system = system.get<std::string>().append("\n\n").append(msg.content.view());
+        }
+    }
+    
+    // Turns must alternate starting with the user; merged messages become separate blocks
+    std::vector<ChatTurn> turns = group_chat_turns(conversation_history);
+    nlohmann::json messages = nlohmann::json::array();
+    for (const auto& turn : turns) {
+        nlohmann::json content = nlohmann::json::array();
+        for (const auto* msg : turn.messages) {
+            content.push_back({{"type", "text"}, {"text", msg->content.view()}});
+        }
+        messages.push_back({{"role", turn.role}, {"content", std::move(content)}});
+    }
+    
+    // A second breakpoint at the newest block caches the whole conversation prefix,
+    // so the next turn only pays for what it adds
+    if (prompt_caching_enabled() && !messages.empty()) {
+        messages.back()["content"].back()["cache_control"] = {{"type", "ephemeral"}};
     }
     
     return nlohmann::json{
         {"model", model},
         {"max_tokens", 1000},
         {"temperature", 0.1},
-        {"system", system_prompt},
+        {"system", system},
         {"messages", messages}
     };
 }
 
+void AnthropicProvider::write_conversation_payload(
+    std::string& out,
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    // Keys in sorted order so the bytes match build_conversation_payload().dump()
+    JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("max_tokens").value(1000);
+    
+    std::vector<ChatTurn> turns = group_chat_turns(conversation_history);
+    const bool caching = prompt_caching_enabled();
+    writer.key("messages").begin_array();
+    for (size_t t = 0; t < turns.size(); ++t) {
+        writer.begin_object();
+        writer.key("content").begin_array();
+        for (size_t m = 0; m < turns[t].messages.size(); ++m) {
+            writer.begin_object();
+            if (caching && t + 1 == turns.size() && m + 1 == turns[t].messages.size()) {
+                writer.key("cache_control").begin_object().key("type").value("ephemeral").end_object();
+            }
+            writer.key("text").value(turns[t].messages[m]->content).key("type").value("text");
+            writer.end_object();
+        }
+        writer.end_array();
+        writer.key("role").value(turns[t].role);
+        writer.end_object();
+    }
+    writer.end_array();
+    
+    writer.key("model").value(model);
+    
+    writer.key("system");
+    if (caching && !system_prompt.empty()) {
+        writer.begin_array();
+        writer.begin_object();
+        writer.key("cache_control").begin_object().key("type").value("ephemeral").end_object();
+        writer.key("text").value(system_prompt).key("type").value("text");
+        writer.end_object();
+        for (const auto& msg : conversation_history) {
+            if (msg.role == "system") {
+                writer.begin_object().key("text").value(msg.content).key("type").value("text").end_object();
+            }
+        }
+        writer.end_array();
+    } else {
+        writer.begin_string().append_string(system_prompt);
+        for (const auto& msg : conversation_history) {
+            if (msg.role == "system") {
+                writer.append_string("\n\n").append_string(msg.content);
+            }
+        }
+        writer.end_string();
+    }
+    
+    writer.key("temperature").value(0.1);
+    writer.end_object();
+}
+
 std::vector<std::string> AnthropicProvider::get_headers(const std::string& api_key) const {
     return {
         "Content-Type: application/json",
@@ -66,49 +162,169 @@ std::vector<std::string> AnthropicProvider::get_headers(const std::string& api_k
 
 WriteFileCommand AnthropicProvider::parse_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from Anthropic API response format
-        if (json_response.contains("content") && json_response["content"].is_array() && 
-            !json_response["content"].empty()) {
-            
-            std::string content = json_response["content"][0]["text"];
-            
-            // Parse the content as JSON to get the WriteFile command
-            nlohmann::json command_json = nlohmann::json::parse(content);
-            
-            WriteFileCommand command;
-            command.from_json(command_json);
-            
-            return command;
-        } else {
+        // Extract only content[0].text from the Anthropic API response format
+        std::optional<std::string> content = extract_json_string(response, {"content", 0, "text"});
+        if (!content) {
             throw std::runtime_error("Invalid Anthropic API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        
+        // Decode the WriteFile command from the content without an intermediate DOM
+        return decode_write_file_command(*content);
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Anthropic response: " + std::string(e.what()));
     }
 }
 
 std::string AnthropicProvider::parse_chat_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from Anthropic API response format
-        if (json_response.contains("content") && json_response["content"].is_array() && 
-            !json_response["content"].empty()) {
-            
-            std::string content = json_response["content"][0]["text"];
-            return content; // Return raw text for chat mode
-        } else {
+        // Extract the content from the Anthropic API response format
+        std::optional<std::string> content = extract_json_string(response, {"content", 0, "text"});
+        if (!content) {
             throw std::runtime_error("Invalid Anthropic API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        return std::move(*content); // Return raw text for chat mode
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Anthropic chat response: " + std::string(e.what()));
     }
 }
 
+ProviderUsage AnthropicProvider::parse_usage(const std::string& response) const {
+    ProviderUsage usage;
+    try {
+        nlohmann::json fields = extract_json_members(response, {"id", "model", "usage"});
+        if (!fields.contains("usage") || !fields["usage"].is_object()) {
+            return usage;
+        }
+        // Cached prefixes are reported separately from the uncached remainder
+        const nlohmann::json& counts = fields["usage"];
+        usage.cached_tokens = counts.value("cache_read_input_tokens", uint64_t{0});
+        usage.cache_write_tokens = counts.value("cache_creation_input_tokens", uint64_t{0});
+        usage.input_tokens = counts.value("input_tokens", uint64_t{0}) + usage.cached_tokens + usage.cache_write_tokens;
+        usage.output_tokens = counts.value("output_tokens", uint64_t{0});
+        usage.model = fields.value("model", "");
+        usage.request_id = fields.value("id", "");
+        usage.reported = true;
+    } catch (const std::exception&) {
+        return {};
+    }
+    return usage;
+}
+
 std::string AnthropicProvider::get_api_key_env_var() const {
     return "ANTHROPIC_API_KEY";
 }
 
-} // namespace mag
\ No newline at end of file
+std::string AnthropicProvider::parse_stream_event(const SseEvent& event) const {
+    if (event.event == "error") {
+        std::string message = event.data;
+        try {
+            if (auto error_message = extract_json_string(event.data, {"error", "message"})) {
+                message = std::move(*error_message);
+            }
+        } catch (const JsonExtractError&) {
+            // Keep the raw payload as the message
+        }
+        throw std::runtime_error("Anthropic stream error: " + message);
+    }
+    
+    if (event.event != "content_block_delta") {
+        return "";
+    }
+    
+    try {
+        if (auto text = extract_json_string(event.data, {"delta", "text"})) {
+            return std::move(*text);
+        }
+    } catch (const JsonExtractError&) {
+        // Malformed events are skipped
+    }
+    return "";
+}
+
+ProviderBatchCall AnthropicProvider::build_batch_submit(
+    const std::string& api_key,
+    const std::vector<std::pair<std::string, nlohmann::json>>& requests
+) const {
+    nlohmann::json batch_requests = nlohmann::json::array();
+    for (const auto& [custom_id, payload] : requests) {
+        batch_requests.push_back({{"custom_id", custom_id}, {"params", payload}});
+    }
+    ProviderBatchCall call;
+    call.url = APIConfig::ANTHROPIC_BATCHES_URL;
+    call.payload = nlohmann::json{{"requests", std::move(batch_requests)}}.dump();
+    call.headers = get_headers(api_key);
+    return call;
+}
+
+ProviderBatchCall AnthropicProvider::build_batch_poll(const std::string& api_key,
+                                                      const std::string& batch_id) const {
+    ProviderBatchCall call;
+    call.url = std::string(APIConfig::ANTHROPIC_BATCHES_URL) + "/" + batch_id;
+    call.headers = get_headers(api_key);
+    call.get = true;
+    return call;
+}
+
+ProviderBatchCall AnthropicProvider::build_batch_results(const std::string& api_key,
+                                                         const PlanBatchStatus& status) const {
+    if (status.results.empty()) {
+        throw std::runtime_error("Anthropic batch " + status.id + " has no results yet");
+    }
+    ProviderBatchCall call;
+    call.url = status.results;
+    call.headers = get_headers(api_key);
+    call.get = true;
+    return call;
+}
+
+PlanBatchStatus AnthropicProvider::parse_batch_status(const std::string& response) const {
+    nlohmann::json batch = nlohmann::json::parse(response, nullptr, false);
+    if (!batch.is_object() || !batch.contains("id") || !batch["id"].is_string()) {
+        throw std::runtime_error("Invalid Anthropic batch response");
+    }
+    PlanBatchStatus status;
+    status.id = batch["id"];
+    status.state = batch.value("processing_status", "");
+    status.ended = status.state == "ended";
+    if (batch.contains("request_counts") && batch["request_counts"].is_object()) {
+        const nlohmann::json& counts = batch["request_counts"];
+        status.succeeded = counts.value("succeeded", size_t{0});
+        status.failed = counts.value("errored", size_t{0}) + counts.value("canceled", size_t{0}) +
+                        counts.value("expired", size_t{0});
+        status.total = status.succeeded + status.failed + counts.value("processing", size_t{0});
+    }
+    if (batch.contains("results_url") && batch["results_url"].is_string()) {
+        status.results = batch["results_url"];
+    }
+    return status;
+}
+
+std::vector<ProviderBatchEntry> AnthropicProvider::parse_batch_results(const std::string& response) const {
+    std::vector<ProviderBatchEntry> entries;
+    std::istringstream lines(response);
+    std::string text;
+    while (std::getline(lines, text)) {
+        nlohmann::json line = nlohmann::json::parse(text, nullptr, false);
+        if (!line.is_object() || !line.contains("custom_id") || !line.contains("result") ||
+            !line["result"].is_object()) {
+            continue; // blank or truncated
+        }
+        ProviderBatchEntry entry;
+        entry.custom_id = line.value("custom_id", "");
+        const nlohmann::json& result = line["result"];
+        std::string type = result.value("type", "");
+        if (type == "succeeded" && result.contains("message")) {
+            entry.success = true;
+            entry.body = result["message"].dump();
+        } else if (result.contains("error") && result["error"].is_object() && result["error"].contains("error") &&
+                   result["error"]["error"].is_object()) {
+            entry.error = result["error"]["error"].value("message", type);
+        } else {
+            entry.error = type.empty() ? "request failed" : type;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+} // namespace mag
@@ -1,10 +1,18 @@
 #include "providers/gemini_provider.h"
 #include "config.h"
+#include "logger.h"
+#include "json_extract.h"
+#include "json_writer.h"
+#include "chat_turns.h"
 #include <stdexcept>
-#include <iostream>
 
 namespace mag {
 
+namespace {
+// candidates[0].content.parts[0].text, shared by full responses and stream chunks
+const JsonPath TEXT_PATH = {"candidates", 0, "content", "parts", 0, "text"};
+}
+
 std::string GeminiProvider::get_name() const {
     return "gemini";
 }
@@ -46,28 +54,30 @@ nlohmann::json GeminiProvider::build_request_payload(
 
 nlohmann::json GeminiProvider::build_conversation_payload(
     const std::string& system_prompt,
-    const std::vector<ConversationMessage>& conversation_history,
+    HistoryView conversation_history,
     const std::string& model
 ) const {
-    nlohmann::json contents = nlohmann::json::array();
-    
-    // Convert conversation history to Gemini format
+    // Gemini only accepts alternating "user" and "model" turns; system turns join the instruction
+    nlohmann::json system_parts = nlohmann::json::array({{{"text", system_prompt}}});
     for (const auto& msg : conversation_history) {
-        nlohmann::json message = {
-            {"parts", {
-                {{"text", msg.content}}
-            }},
-            {"role", msg.role == "assistant" ? "model" : msg.role}  // Gemini uses "model" instead of "assistant"
-        };
-        contents.push_back(message);
+        if (msg.role == "system") {
+            system_parts.push_back({{"text", msg.content.view()}});
+        }
+    }
+    
+    nlohmann::json contents = nlohmann::json::array();
+    for (const auto& turn : group_chat_turns(conversation_history, {.assistant_role = "model"})) {
+        nlohmann::json parts = nlohmann::json::array();
+        for (const auto* msg : turn.messages) {
+            parts.push_back({{"text", msg->content.view()}});
+        }
+        contents.push_back({{"parts", std::move(parts)}, {"role", turn.role}});
     }
     
     return nlohmann::json{
         {"contents", contents},
         {"systemInstruction", {
-            {"parts", {
-                {{"text", system_prompt}}
-            }},
+            {"parts", system_parts},
             {"role", "user"}
         }},
         {"generationConfig", {
@@ -77,6 +87,48 @@ nlohmann::json GeminiProvider::build_conversation_payload(
     };
 }
 
+void GeminiProvider::write_conversation_payload(
+    std::string& out,
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    // Keys in sorted order so the bytes match build_conversation_payload().dump()
+    JsonWriter writer(out);
+    writer.begin_object();
+    
+    writer.key("contents").begin_array();
+    for (const auto& turn : group_chat_turns(conversation_history, {.assistant_role = "model"})) {
+        writer.begin_object();
+        writer.key("parts").begin_array();
+        for (const auto* msg : turn.messages) {
+            writer.begin_object().key("text").value(msg->content).end_object();
+        }
+        writer.end_array();
+        writer.key("role").value(turn.role);
+        writer.end_object();
+    }
+    writer.end_array();
+    
+    writer.key("generationConfig").begin_object();
+    writer.key("maxOutputTokens").value(1000).key("temperature").value(0.1);
+    writer.end_object();
+    
+    writer.key("systemInstruction").begin_object();
+    writer.key("parts").begin_array();
+    writer.begin_object().key("text").value(system_prompt).end_object();
+    for (const auto& msg : conversation_history) {
+        if (msg.role == "system") {
+            writer.begin_object().key("text").value(msg.content).end_object();
+        }
+    }
+    writer.end_array();
+    writer.key("role").value("user");
+    writer.end_object();
+    
+    writer.end_object();
+}
+
 std::vector<std::string> GeminiProvider::get_headers(const std::string& api_key) const {
     return {
         "Content-Type: application/json"
@@ -84,88 +136,100 @@ std::vector<std::string> GeminiProvider::get_headers(const std::string& api_key)
 }
 
 WriteFileCommand GeminiProvider::parse_response(const std::string& response) const {
-    std::cout << "Gemini Provider: Parsing response..." << std::endl;
-    std::cout << "Response length: " << response.length() << std::endl;
-    std::cout << "First 200 chars: " << response.substr(0, 200) << std::endl;
+    MAG_LOG_DEBUG("gemini", "Parsing response of " << response.length() << " bytes: "
+                  << Logger::truncate(response, 200));
     
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
+        // Extract only candidates[0].content.parts[0].text from the Gemini API response format
+        std::optional<std::string> content = extract_json_string(response, TEXT_PATH);
+        if (!content) {
+            throw std::runtime_error("Invalid Gemini API response format");
+        }
+        MAG_LOG_DEBUG("gemini", "Extracted text content: " << Logger::truncate(*content));
         
-        // Extract the content from Gemini API response format
-        if (json_response.contains("candidates") && json_response["candidates"].is_array() && 
-            !json_response["candidates"].empty()) {
+        // Remove markdown code block formatting if present (a view, not a copy)
+        std::string_view json_content = *content;
+        
+        // Look for ```json and ``` markers
+        size_t start_pos = json_content.find("```json");
+        if (start_pos != std::string_view::npos) {
+            start_pos += 7; // Length of "```json"
+            // Skip any whitespace/newlines after ```json
+            while (start_pos < json_content.length() && 
+                   (json_content[start_pos] == '\n' || json_content[start_pos] == '\r' || json_content[start_pos] == ' ')) {
+                start_pos++;
+            }
             
-            auto candidate = json_response["candidates"][0];
-            if (candidate.contains("content") && candidate["content"].contains("parts") &&
-                candidate["content"]["parts"].is_array() && !candidate["content"]["parts"].empty()) {
-                
-                std::string content = candidate["content"]["parts"][0]["text"];
-                std::cout << "Extracted text content: " << content << std::endl;
-                
-                // Remove markdown code block formatting if present
-                std::string json_content = content;
-                
-                // Look for ```json and ``` markers
-                size_t start_pos = json_content.find("```json");
-                if (start_pos != std::string::npos) {
-                    start_pos += 7; // Length of "```json"
-                    // Skip any whitespace/newlines after ```json
-                    while (start_pos < json_content.length() && 
-                           (json_content[start_pos] == '\n' || json_content[start_pos] == '\r' || json_content[start_pos] == ' ')) {
-                        start_pos++;
-                    }
-                    
-                    size_t end_pos = json_content.find("```", start_pos);
-                    if (end_pos != std::string::npos) {
-                        json_content = json_content.substr(start_pos, end_pos - start_pos);
-                    }
-                }
-                
-                std::cout << "Cleaned JSON content: " << json_content << std::endl;
-                
-                // Parse the content as JSON to get the WriteFile command
-                nlohmann::json command_json = nlohmann::json::parse(json_content);
-                
-                WriteFileCommand command;
-                command.from_json(command_json);
-                
-                return command;
+            size_t end_pos = json_content.find("```", start_pos);
+            if (end_pos != std::string_view::npos) {
+                json_content = json_content.substr(start_pos, end_pos - start_pos);
             }
         }
         
-        throw std::runtime_error("Invalid Gemini API response format");
+        MAG_LOG_DEBUG("gemini", "Cleaned JSON content: " << Logger::truncate(json_content));
+        
+        // Decode the WriteFile command from the content without an intermediate DOM
+        return decode_write_file_command(json_content);
         
-    } catch (const nlohmann::json::exception& e) {
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Gemini response: " + std::string(e.what()));
     }
 }
 
 std::string GeminiProvider::parse_chat_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
         // Extract the content from Gemini API response format
-        if (json_response.contains("candidates") && json_response["candidates"].is_array() && 
-            !json_response["candidates"].empty()) {
-            
-            auto candidate = json_response["candidates"][0];
-            if (candidate.contains("content") && candidate["content"].contains("parts") &&
-                candidate["content"]["parts"].is_array() && !candidate["content"]["parts"].empty()) {
-                
-                std::string content = candidate["content"]["parts"][0]["text"];
-                return content; // Return raw text for chat mode
-            }
+        std::optional<std::string> content = extract_json_string(response, TEXT_PATH);
+        if (!content) {
+            throw std::runtime_error("Invalid Gemini API response format");
         }
+        return std::move(*content); // Return raw text for chat mode
         
-        throw std::runtime_error("Invalid Gemini API response format");
-        
-    } catch (const nlohmann::json::exception& e) {
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Gemini chat response: " + std::string(e.what()));
     }
 }
 
+ProviderUsage GeminiProvider::parse_usage(const std::string& response) const {
+    ProviderUsage usage;
+    try {
+        nlohmann::json fields = extract_json_members(response, {"responseId", "modelVersion", "usageMetadata"});
+        if (!fields.contains("usageMetadata") || !fields["usageMetadata"].is_object()) {
+            return usage;
+        }
+        // Thinking tokens are billed as output
+        const nlohmann::json& counts = fields["usageMetadata"];
+        usage.input_tokens = counts.value("promptTokenCount", uint64_t{0});
+        usage.output_tokens = counts.value("candidatesTokenCount", uint64_t{0}) +
+                              counts.value("thoughtsTokenCount", uint64_t{0});
+        usage.cached_tokens = counts.value("cachedContentTokenCount", uint64_t{0});
+        usage.model = fields.value("modelVersion", "");
+        usage.request_id = fields.value("responseId", "");
+        usage.reported = true;
+    } catch (const std::exception&) {
+        return {};
+    }
+    return usage;
+}
+
 std::string GeminiProvider::get_api_key_env_var() const {
     return "GEMINI_API_KEY";
 }
 
+std::string GeminiProvider::get_stream_url(const std::string& api_key, const std::string& model) const {
+    std::string actual_model = model.empty() ? get_default_model() : model;
+    return std::string(APIConfig::GEMINI_BASE_URL) + "/" + actual_model + ":streamGenerateContent?alt=sse&key=" + api_key;
+}
+
+std::string GeminiProvider::parse_stream_event(const SseEvent& event) const {
+    try {
+        if (auto text = extract_json_string(event.data, TEXT_PATH)) {
+            return std::move(*text);
+        }
+    } catch (const JsonExtractError&) {
+        // Malformed chunks are skipped
+    }
+    return "";
+}
+
 } // namespace mag
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "providers/mistral_provider.h"
+#include "json_extract.h"
+#include "json_writer.h"
+#include "chat_turns.h"
+#include "config.h"
 #include <stdexcept>
 
 namespace mag {
@@ -8,11 +12,11 @@ std::string MistralProvider::get_name() const {
 }
 
 std::string MistralProvider::get_api_url() const {
-    return "https://api.mistral.ai/v1/chat/completions";
+    return APIConfig::MISTRAL_BASE_URL;
 }
 
 std::string MistralProvider::get_default_model() const {
-    return "mistral-small-latest";
+    return APIConfig::MISTRAL_DEFAULT_MODEL;
 }
 
 nlohmann::json MistralProvider::build_request_payload(
@@ -34,22 +38,31 @@ nlohmann::json MistralProvider::build_request_payload(
 
 nlohmann::json MistralProvider::build_conversation_payload(
     const std::string& system_prompt,
-    const std::vector<ConversationMessage>& conversation_history,
+    HistoryView conversation_history,
     const std::string& model
 ) const {
     nlohmann::json messages = nlohmann::json::array();
     
-    // Add system message first
+    // Mistral rejects system messages after the first turn, so they join the leading one
+    std::string system_content = system_prompt;
+    for (const auto& msg : conversation_history) {
+        if (msg.role == "system") {
+            system_content.append("\n\n").append(msg.content.view());
+        }
+    }
     messages.push_back({
         {"role", "system"},
-        {"content", system_prompt}
+        {"content", system_content}
     });
     
     // Convert conversation history to Mistral format
     for (const auto& msg : conversation_history) {
+        if (msg.role == "system") {
+            continue;
+        }
         nlohmann::json message = {
-            {"role", msg.role},
-            {"content", msg.content}
+            {"role", openai_role(msg)},
+            {"content", msg.content.view()}
         };
         messages.push_back(message);
     }
@@ -62,6 +75,37 @@ nlohmann::json MistralProvider::build_conversation_payload(
     };
 }
 
+void MistralProvider::write_conversation_payload(
+    std::string& out,
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    // Keys in sorted order so the bytes match build_conversation_payload().dump()
+    JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("max_tokens").value(1000);
+    
+    writer.key("messages").begin_array();
+    writer.begin_object().key("content").begin_string().append_string(system_prompt);
+    for (const auto& msg : conversation_history) {
+        if (msg.role == "system") {
+            writer.append_string("\n\n").append_string(msg.content);
+        }
+    }
+    writer.end_string().key("role").value("system").end_object();
+    for (const auto& msg : conversation_history) {
+        if (msg.role != "system") {
+            writer.begin_object().key("content").value(msg.content).key("role").value(openai_role(msg)).end_object();
+        }
+    }
+    writer.end_array();
+    
+    writer.key("model").value(model);
+    writer.key("temperature").value(0.1);
+    writer.end_object();
+}
+
 std::vector<std::string> MistralProvider::get_headers(const std::string& api_key) const {
     return {
         "Content-Type: application/json",
@@ -71,49 +115,68 @@ std::vector<std::string> MistralProvider::get_headers(const std::string& api_key
 
 WriteFileCommand MistralProvider::parse_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from Mistral API response format (OpenAI-compatible)
-        if (json_response.contains("choices") && json_response["choices"].is_array() && 
-            !json_response["choices"].empty()) {
-            
-            std::string content = json_response["choices"][0]["message"]["content"];
-            
-            // Parse the content as JSON to get the WriteFile command
-            nlohmann::json command_json = nlohmann::json::parse(content);
-            
-            WriteFileCommand command;
-            command.from_json(command_json);
-            
-            return command;
-        } else {
+        // Extract only choices[0].message.content from the Mistral API response format (OpenAI-compatible)
+        std::optional<std::string> content = extract_json_string(response, {"choices", 0, "message", "content"});
+        if (!content) {
             throw std::runtime_error("Invalid Mistral API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        
+        // Decode the WriteFile command from the content without an intermediate DOM
+        return decode_write_file_command(*content);
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Mistral response: " + std::string(e.what()));
     }
 }
 
 std::string MistralProvider::parse_chat_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from Mistral API response format (OpenAI-compatible)
-        if (json_response.contains("choices") && json_response["choices"].is_array() && 
-            !json_response["choices"].empty()) {
-            
-            std::string content = json_response["choices"][0]["message"]["content"];
-            return content; // Return raw text for chat mode
-        } else {
+        // Extract the content from the Mistral API response format (OpenAI-compatible)
+        std::optional<std::string> content = extract_json_string(response, {"choices", 0, "message", "content"});
+        if (!content) {
             throw std::runtime_error("Invalid Mistral API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        return std::move(*content); // Return raw text for chat mode
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse Mistral chat response: " + std::string(e.what()));
     }
 }
 
+ProviderUsage MistralProvider::parse_usage(const std::string& response) const {
+    ProviderUsage usage;
+    try {
+        nlohmann::json fields = extract_json_members(response, {"id", "model", "usage"});
+        if (!fields.contains("usage") || !fields["usage"].is_object()) {
+            return usage;
+        }
+        const nlohmann::json& counts = fields["usage"];
+        usage.input_tokens = counts.value("prompt_tokens", uint64_t{0});
+        usage.output_tokens = counts.value("completion_tokens", uint64_t{0});
+        usage.model = fields.value("model", "");
+        usage.request_id = fields.value("id", "");
+        usage.reported = true;
+    } catch (const std::exception&) {
+        return {};
+    }
+    return usage;
+}
+
 std::string MistralProvider::get_api_key_env_var() const {
     return "MISTRAL_API_KEY";
 }
 
+std::string MistralProvider::parse_stream_event(const SseEvent& event) const {
+    if (event.data == "[DONE]") {
+        return "";
+    }
+    
+    try {
+        if (auto content = extract_json_string(event.data, {"choices", 0, "delta", "content"})) {
+            return std::move(*content);
+        }
+    } catch (const JsonExtractError&) {
+        // Malformed chunks are skipped
+    }
+    return "";
+}
+
 } // namespace mag
\ No newline at end of file
@@ -1,4 +1,10 @@
 #include "providers/openai_provider.h"
+#include "json_extract.h"
+#include "json_writer.h"
+#include "chat_turns.h"
+#include "config.h"
+#include "utils.h"
+#include <sstream>
 #include <stdexcept>
 
 namespace mag {
@@ -8,11 +14,11 @@ std::string OpenAIProvider::get_name() const {
 }
 
 std::string OpenAIProvider::get_api_url() const {
-    return "https://api.openai.com/v1/chat/completions";
+    return APIConfig::OPENAI_BASE_URL;
 }
 
 std::string OpenAIProvider::get_default_model() const {
-    return "gpt-3.5-turbo";
+    return APIConfig::OPENAI_DEFAULT_MODEL;
 }
 
 nlohmann::json OpenAIProvider::build_request_payload(
@@ -33,7 +39,7 @@ nlohmann::json OpenAIProvider::build_request_payload(
 
 nlohmann::json OpenAIProvider::build_conversation_payload(
     const std::string& system_prompt,
-    const std::vector<ConversationMessage>& conversation_history,
+    HistoryView conversation_history,
     const std::string& model
 ) const {
     nlohmann::json messages = nlohmann::json::array();
@@ -44,11 +50,11 @@ nlohmann::json OpenAIProvider::build_conversation_payload(
         {"content", system_prompt}
     });
     
-    // Convert conversation history to OpenAI format
+    // Convert conversation history to OpenAI format; system turns are fine mid-conversation
     for (const auto& msg : conversation_history) {
         nlohmann::json message = {
-            {"role", msg.role},
-            {"content", msg.content}
+            {"role", openai_role(msg)},
+            {"content", msg.content.view()}
         };
         messages.push_back(message);
     }
@@ -61,6 +67,29 @@ nlohmann::json OpenAIProvider::build_conversation_payload(
     };
 }
 
+void OpenAIProvider::write_conversation_payload(
+    std::string& out,
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    // Keys in sorted order so the bytes match build_conversation_payload().dump()
+    JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("max_tokens").value(1000);
+    
+    writer.key("messages").begin_array();
+    writer.begin_object().key("content").value(system_prompt).key("role").value("system").end_object();
+    for (const auto& msg : conversation_history) {
+        writer.begin_object().key("content").value(msg.content).key("role").value(openai_role(msg)).end_object();
+    }
+    writer.end_array();
+    
+    writer.key("model").value(model);
+    writer.key("temperature").value(0.1);
+    writer.end_object();
+}
+
 std::vector<std::string> OpenAIProvider::get_headers(const std::string& api_key) const {
     return {
         "Content-Type: application/json",
@@ -70,49 +99,196 @@ std::vector<std::string> OpenAIProvider::get_headers(const std::string& api_key)
 
 WriteFileCommand OpenAIProvider::parse_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from OpenAI API response format
-        if (json_response.contains("choices") && json_response["choices"].is_array() && 
-            !json_response["choices"].empty()) {
-            
-            std::string content = json_response["choices"][0]["message"]["content"];
-            
-            // Parse the content as JSON to get the WriteFile command
-            nlohmann::json command_json = nlohmann::json::parse(content);
-            
-            WriteFileCommand command;
-            command.from_json(command_json);
-            
-            return command;
-        } else {
+        // Extract only choices[0].message.content from the OpenAI API response format
+        std::optional<std::string> content = extract_json_string(response, {"choices", 0, "message", "content"});
+        if (!content) {
             throw std::runtime_error("Invalid OpenAI API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        
+        // Decode the WriteFile command from the content without an intermediate DOM
+        return decode_write_file_command(*content);
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse OpenAI response: " + std::string(e.what()));
     }
 }
 
 std::string OpenAIProvider::parse_chat_response(const std::string& response) const {
     try {
-        nlohmann::json json_response = nlohmann::json::parse(response);
-        
-        // Extract the content from OpenAI API response format
-        if (json_response.contains("choices") && json_response["choices"].is_array() && 
-            !json_response["choices"].empty()) {
-            
-            std::string content = json_response["choices"][0]["message"]["content"];
-            return content; // Return raw text for chat mode
-        } else {
+        // Extract the content from the OpenAI API response format
+        std::optional<std::string> content = extract_json_string(response, {"choices", 0, "message", "content"});
+        if (!content) {
             throw std::runtime_error("Invalid OpenAI API response format");
         }
-    } catch (const nlohmann::json::exception& e) {
+        return std::move(*content); // Return raw text for chat mode
+    } catch (const JsonExtractError& e) {
         throw std::runtime_error("Failed to parse OpenAI chat response: " + std::string(e.what()));
     }
 }
 
+ProviderUsage OpenAIProvider::parse_usage(const std::string& response) const {
+    ProviderUsage usage;
+    try {
+        nlohmann::json fields = extract_json_members(response, {"id", "model", "usage"});
+        if (!fields.contains("usage") || !fields["usage"].is_object()) {
+            return usage;
+        }
+        const nlohmann::json& counts = fields["usage"];
+        usage.input_tokens = counts.value("prompt_tokens", uint64_t{0});
+        usage.output_tokens = counts.value("completion_tokens", uint64_t{0});
+        if (counts.contains("prompt_tokens_details") && counts["prompt_tokens_details"].is_object()) {
+            usage.cached_tokens = counts["prompt_tokens_details"].value("cached_tokens", uint64_t{0});
+        }
+        usage.model = fields.value("model", "");
+        usage.request_id = fields.value("id", "");
+        usage.reported = true;
+    } catch (const std::exception&) {
+        return {};
+    }
+    return usage;
+}
+
 std::string OpenAIProvider::get_api_key_env_var() const {
     return "OPENAI_API_KEY";
 }
 
-} // namespace mag
\ No newline at end of file
+std::string OpenAIProvider::parse_stream_event(const SseEvent& event) const {
+    if (event.data == "[DONE]") {
+        return "";
+    }
+    
+    try {
+        if (auto content = extract_json_string(event.data, {"choices", 0, "delta", "content"})) {
+            return std::move(*content);
+        }
+    } catch (const JsonExtractError&) {
+        // Malformed chunks are skipped
+    }
+    return "";
+}
+
+ProviderBatchCall OpenAIProvider::build_batch_submit(
+    const std::string& api_key,
+    const std::vector<std::pair<std::string, nlohmann::json>>& requests
+) const {
+    // One chat completion request per line
+    std::string lines;
+    for (const auto& [custom_id, payload] : requests) {
+        nlohmann::json line = {
+            {"custom_id", custom_id},
+            {"method", "POST"},
+            {"url", "/v1/chat/completions"},
+            {"body", payload}
+        };
+        lines += line.dump();
+        lines += '\n';
+    }
+    
+    // Uploaded as a multipart form; JSON escaping keeps the boundary out of the lines
+    std::string boundary = "mag-batch-" + Utils::hash_to_hex(Utils::hash64(lines));
+    ProviderBatchCall call;
+    call.url = APIConfig::OPENAI_FILES_URL;
+    call.payload = "--" + boundary + "\r\n"
+                   "Content-Disposition: form-data; name=\"purpose\"\r\n\r\n"
+                   "batch\r\n"
+                   "--" + boundary + "\r\n"
+                   "Content-Disposition: form-data; name=\"file\"; filename=\"requests.jsonl\"\r\n"
+                   "Content-Type: application/jsonl\r\n\r\n" +
+                   lines + "\r\n"
+                   "--" + boundary + "--\r\n";
+    call.headers = {
+        "Content-Type: multipart/form-data; boundary=" + boundary,
+        "Authorization: Bearer " + api_key
+    };
+    return call;
+}
+
+std::optional<ProviderBatchCall> OpenAIProvider::build_batch_create(const std::string& api_key,
+                                                                    const std::string& submit_response) const {
+    nlohmann::json file = nlohmann::json::parse(submit_response, nullptr, false);
+    if (!file.is_object() || !file.contains("id") || !file["id"].is_string()) {
+        throw std::runtime_error("OpenAI did not accept the batch input file");
+    }
+    ProviderBatchCall call;
+    call.url = APIConfig::OPENAI_BATCHES_URL;
+    call.payload = nlohmann::json{
+        {"input_file_id", file["id"]},
+        {"endpoint", "/v1/chat/completions"},
+        {"completion_window", "24h"}
+    }.dump();
+    call.headers = get_headers(api_key);
+    return call;
+}
+
+ProviderBatchCall OpenAIProvider::build_batch_poll(const std::string& api_key, const std::string& batch_id) const {
+    ProviderBatchCall call;
+    call.url = std::string(APIConfig::OPENAI_BATCHES_URL) + "/" + batch_id;
+    call.headers = get_headers(api_key);
+    call.get = true;
+    return call;
+}
+
+ProviderBatchCall OpenAIProvider::build_batch_results(const std::string& api_key,
+                                                      const PlanBatchStatus& status) const {
+    if (status.results.empty()) {
+        throw std::runtime_error("OpenAI batch " + status.id + " has no output file");
+    }
+    ProviderBatchCall call;
+    call.url = std::string(APIConfig::OPENAI_FILES_URL) + "/" + status.results + "/content";
+    call.headers = get_headers(api_key);
+    call.get = true;
+    return call;
+}
+
+PlanBatchStatus OpenAIProvider::parse_batch_status(const std::string& response) const {
+    nlohmann::json batch = nlohmann::json::parse(response, nullptr, false);
+    if (!batch.is_object() || !batch.contains("id") || !batch["id"].is_string()) {
+        throw std::runtime_error("Invalid OpenAI batch response");
+    }
+    PlanBatchStatus status;
+    status.id = batch["id"];
+    status.state = batch.value("status", "");
+    status.ended = status.state == "completed" || status.state == "failed" || status.state == "expired" ||
+                   status.state == "cancelled";
+    if (batch.contains("request_counts") && batch["request_counts"].is_object()) {
+        const nlohmann::json& counts = batch["request_counts"];
+        status.total = counts.value("total", size_t{0});
+        status.succeeded = counts.value("completed", size_t{0});
+        status.failed = counts.value("failed", size_t{0});
+    }
+    if (batch.contains("output_file_id") && batch["output_file_id"].is_string()) {
+        status.results = batch["output_file_id"];
+    }
+    if (batch.contains("errors") && batch["errors"].is_object() && batch["errors"].contains("data") &&
+        batch["errors"]["data"].is_array() && !batch["errors"]["data"].empty()) {
+        status.error_message = batch["errors"]["data"][0].value("message", "");
+    }
+    return status;
+}
+
+std::vector<ProviderBatchEntry> OpenAIProvider::parse_batch_results(const std::string& response) const {
+    std::vector<ProviderBatchEntry> entries;
+    std::istringstream lines(response);
+    std::string text;
+    while (std::getline(lines, text)) {
+        nlohmann::json line = nlohmann::json::parse(text, nullptr, false);
+        if (!line.is_object() || !line.contains("custom_id")) {
+            continue; // blank or truncated
+        }
+        ProviderBatchEntry entry;
+        entry.custom_id = line.value("custom_id", "");
+        const nlohmann::json& response_part = line.contains("response") ? line["response"] : nlohmann::json();
+        int status_code = response_part.is_object() ? response_part.value("status_code", 0) : 0;
+        if (line.contains("error") && line["error"].is_object()) {
+            entry.error = line["error"].value("message", "request failed");
+        } else if (status_code != 200 || !response_part.contains("body")) {
+            entry.error = "HTTP error: " + std::to_string(status_code);
+        } else {
+            entry.success = true;
+            entry.body = response_part["body"].dump();
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+} // namespace mag
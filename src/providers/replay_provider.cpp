@@ -0,0 +1,221 @@
+#include "providers/replay_provider.h"
+#include "response_cache.h"
+#include "config.h"
+#include "utils.h"
+#include "logger.h"
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace mag {
+
+namespace {
+
+// Provider-side cache markers are an optimisation, not part of what was asked
+void strip_cache_markers(nlohmann::json& j) {
+    if (j.is_object()) {
+        j.erase("cache_control");
+        for (auto& [key, value] : j.items()) {
+            strip_cache_markers(value);
+        }
+    } else if (j.is_array()) {
+        for (auto& value : j) {
+            strip_cache_markers(value);
+        }
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// ResponseRecorder
+
+ResponseRecorder::ResponseRecorder(const std::string& capture_file) : capture_file_(capture_file) {
+    Utils::create_directories(capture_file_);
+}
+
+void ResponseRecorder::record(const std::string& provider, const std::string& model,
+                              const std::string& payload, const std::string& response) {
+    nlohmann::json request = nlohmann::json::parse(payload, nullptr, false);
+    nlohmann::json line = {
+        {"key", ReplayProvider::request_key(payload)},
+        {"provider", provider},
+        {"model", model},
+        {"request", request.is_discarded() ? nlohmann::json(payload) : request},
+        {"response", response}
+    };
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream file(capture_file_, std::ios::app);
+    if (!file) {
+        MAG_LOG_ERROR("replay", "Failed to append to capture file " << capture_file_);
+        return;
+    }
+    file << line.dump() << "\n";
+    ++recorded_;
+}
+
+size_t ResponseRecorder::recorded() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recorded_;
+}
+
+// ---------------------------------------------------------------------------
+// ReplayProvider
+
+ReplayProvider::ReplayProvider()
+    : ReplayProvider(ReplayConfig::get_capture_file(), ReplayConfig::get_format(),
+                     ReplayConfig::get_latency_ms(), ReplayConfig::get_jitter_ms(),
+                     ReplayConfig::is_strict()) {
+}
+
+ReplayProvider::ReplayProvider(const std::string& capture_file, const std::string& format,
+                               int latency_ms, int jitter_ms, bool strict)
+    : capture_file_(capture_file)
+    , format_(format)
+    , latency_ms_(std::max(0, latency_ms))
+    , jitter_ms_(std::max(0, jitter_ms))
+    , strict_(strict) {
+}
+
+std::string ReplayProvider::request_key(const std::string& payload) {
+    nlohmann::json request = nlohmann::json::parse(payload, nullptr, false);
+    if (request.is_discarded() || !request.is_object()) {
+        return ResponseCache::make_key({"replay", payload});
+    }
+    request.erase("model");
+    request.erase("stream");
+    strip_cache_markers(request);
+    return ResponseCache::make_key({"replay", request.dump()});
+}
+
+void ReplayProvider::load() const {
+    std::ifstream file(capture_file_);
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            nlohmann::json j = nlohmann::json::parse(line);
+            ReplayEntry entry{j.value("key", ""), j.value("provider", ""), j.value("model", ""),
+                              j.at("response").get<std::string>()};
+            if (entry.key.empty() && j.contains("request")) {
+                const auto& request = j["request"];
+                entry.key = request_key(request.is_string() ? request.get<std::string>() : request.dump());
+            }
+            by_key_.emplace(entry.key, entries_.size());
+            entries_.push_back(std::move(entry));
+        } catch (const nlohmann::json::exception& e) {
+            MAG_LOG_WARN("replay", "Skipping capture line " << line_number << " of " << capture_file_
+                         << ": " << e.what());
+        }
+    }
+    
+    std::string format = format_;
+    if (format.empty()) {
+        format = entries_.empty() || entries_.front().provider.empty() ? "anthropic" : entries_.front().provider;
+    }
+    if (format == "replay") {
+        throw std::runtime_error("Replay capture cannot use the replay format");
+    }
+    format_provider_ = ProviderFactory::create_provider(format);
+}
+
+const LLMProvider& ReplayProvider::format_provider() const {
+    std::call_once(loaded_, [this] { load(); });
+    return *format_provider_;
+}
+
+size_t ReplayProvider::entry_count() const {
+    format_provider();
+    return entries_.size();
+}
+
+std::string ReplayProvider::get_name() const {
+    return "replay";
+}
+
+std::string ReplayProvider::get_api_url() const {
+    return "replay://" + capture_file_;
+}
+
+std::string ReplayProvider::get_default_model() const {
+    return format_provider().get_default_model();
+}
+
+nlohmann::json ReplayProvider::build_request_payload(
+    const std::string& system_prompt,
+    const std::string& user_prompt,
+    const std::string& model
+) const {
+    return format_provider().build_request_payload(system_prompt, user_prompt, model);
+}
+
+nlohmann::json ReplayProvider::build_conversation_payload(
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    return format_provider().build_conversation_payload(system_prompt, conversation_history, model);
+}
+
+void ReplayProvider::write_conversation_payload(
+    std::string& out,
+    const std::string& system_prompt,
+    HistoryView conversation_history,
+    const std::string& model
+) const {
+    format_provider().write_conversation_payload(out, system_prompt, conversation_history, model);
+}
+
+std::vector<std::string> ReplayProvider::get_headers(const std::string& api_key) const {
+    return {"Content-Type: application/json"};
+}
+
+WriteFileCommand ReplayProvider::parse_response(const std::string& response) const {
+    return format_provider().parse_response(response);
+}
+
+std::string ReplayProvider::parse_chat_response(const std::string& response) const {
+    return format_provider().parse_chat_response(response);
+}
+
+ProviderUsage ReplayProvider::parse_usage(const std::string& response) const {
+    return format_provider().parse_usage(response);
+}
+
+std::string ReplayProvider::get_api_key_env_var() const {
+    return "MAG_REPLAY_FILE";
+}
+
+std::optional<std::string> ReplayProvider::serve_locally(const std::string& payload) const {
+    format_provider();
+    inject_latency();
+    
+    auto it = by_key_.find(request_key(payload));
+    if (it != by_key_.end()) {
+        return entries_[it->second].response;
+    }
+    if (strict_ || entries_.empty()) {
+        throw std::runtime_error("No recorded response for this request in " + capture_file_);
+    }
+    return entries_[next_entry_.fetch_add(1) % entries_.size()].response;
+}
+
+void ReplayProvider::inject_latency() const {
+    if (latency_ms_ == 0 && jitter_ms_ == 0) {
+        return;
+    }
+    int delay = latency_ms_;
+    if (jitter_ms_ > 0) {
+        thread_local std::mt19937 rng(std::random_device{}());
+        delay += std::uniform_int_distribution<int>(0, jitter_ms_)(rng);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+}
+
+} // namespace mag
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include "bash_jobs.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace mag;
+
+namespace {
+
+// A job that records when it ran and takes `duration` unless cancelled
+BashJobQueue::Runner timed_job(std::string name, std::chrono::milliseconds duration,
+                               std::vector<std::string>* order = nullptr, std::mutex* order_mutex = nullptr,
+                               std::atomic<int>* running = nullptr, std::atomic<int>* peak = nullptr) {
+    return [=](const BashTool::OutputHandler& on_output, const CancellationToken& cancel) {
+        if (running) {
+            int now = ++*running;
+            int seen = peak->load();
+            while (now > seen && !peak->compare_exchange_weak(seen, now)) {
+            }
+        }
+        if (order) {
+            std::lock_guard<std::mutex> lock(*order_mutex);
+            order->push_back(name);
+        }
+        on_output(false, name + " started\n");
+        auto deadline = std::chrono::steady_clock::now() + duration;
+        while (std::chrono::steady_clock::now() < deadline && !cancel.is_cancelled()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        if (running) {
+            --*running;
+        }
+        CommandResult result;
+        result.command = name;
+        result.cancelled = cancel.is_cancelled();
+        result.success = !result.cancelled;
+        result.exit_code = result.cancelled ? 143 : 0;
+        result.stdout_output = name + " started\n";
+        return result;
+    };
+}
+
+BashJobStatus wait_for(BashJobQueue& jobs, const std::string& job_id) {
+    auto status = jobs.wait(job_id, std::chrono::seconds(10));
+    EXPECT_TRUE(status.has_value());
+    EXPECT_EQ(status->state, BashJobState::DONE);
+    return *status;
+}
+
+} // anonymous namespace
+
+TEST(BashJobQueueTest, RunsSessionsSideBySideUpToTheWorkerCount) {
+    BashJobQueue jobs(2);
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    std::vector<std::string> ids;
+    for (int i = 0; i < 4; ++i) {
+        ids.push_back(jobs.submit("s" + std::to_string(i), "job",
+                                  timed_job("job", std::chrono::milliseconds(100), nullptr, nullptr, &running, &peak)));
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& id : ids) {
+        EXPECT_TRUE(wait_for(jobs, id).result.success);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    EXPECT_EQ(peak.load(), 2);
+    EXPECT_LT(elapsed, std::chrono::milliseconds(350)); // two rounds, not four
+}
+
+TEST(BashJobQueueTest, KeepsTheOrderWithinASession) {
+    BashJobQueue jobs(4);
+    std::vector<std::string> order;
+    std::mutex order_mutex;
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    
+    std::string first = jobs.submit("build", "a", timed_job("a", std::chrono::milliseconds(80), &order, &order_mutex,
+                                                            &running, &peak));
+    std::string second = jobs.submit("build", "b", timed_job("b", std::chrono::milliseconds(10), &order, &order_mutex,
+                                                             &running, &peak));
+    std::string other = jobs.submit("lint", "c", timed_job("c", std::chrono::milliseconds(10), &order, &order_mutex));
+    
+    wait_for(jobs, first);
+    wait_for(jobs, second);
+    wait_for(jobs, other);
+    
+    EXPECT_EQ(peak.load(), 1); // a and b never overlapped
+    ASSERT_EQ(order.size(), 3u);
+    EXPECT_EQ(order[0], "a");
+    EXPECT_EQ(order[2], "b"); // c did not wait behind the build session
+}
+
+TEST(BashJobQueueTest, CancelsQueuedAndRunningJobs) {
+    BashJobQueue jobs(1);
+    std::string running = jobs.submit("s", "long", timed_job("long", std::chrono::seconds(30)));
+    std::string queued = jobs.submit("s", "next", timed_job("next", std::chrono::milliseconds(1)));
+    
+    auto listed = jobs.list();
+    ASSERT_EQ(listed.size(), 2u);
+    EXPECT_EQ(listed[0].job_id, running);
+    EXPECT_EQ(listed[1].state, BashJobState::QUEUED);
+    
+    EXPECT_TRUE(jobs.cancel(queued));
+    BashJobStatus never_ran = wait_for(jobs, queued);
+    EXPECT_TRUE(never_ran.result.cancelled);
+    EXPECT_TRUE(never_ran.result.stdout_output.empty());
+    
+    EXPECT_TRUE(jobs.cancel(running));
+    EXPECT_TRUE(wait_for(jobs, running).result.cancelled);
+    
+    EXPECT_FALSE(jobs.cancel("job-unknown"));
+    EXPECT_FALSE(jobs.status("job-unknown").has_value());
+}
+
+TEST(BashJobQueueTest, StreamedJobsHandOverTheirOutputOnce) {
+    BashJobQueue jobs(1);
+    std::string job_id = jobs.submit("s", "echo", timed_job("echo", std::chrono::milliseconds(50)), true);
+    
+    std::string streamed;
+    while (true) {
+        auto status = jobs.take_output(job_id, std::chrono::milliseconds(200));
+        ASSERT_TRUE(status.has_value());
+        streamed += status->stdout_delta;
+        if (status->state == BashJobState::DONE) {
+            EXPECT_TRUE(status->result.success);
+            break;
+        }
+    }
+    EXPECT_EQ(streamed, "echo started\n");
+    EXPECT_FALSE(jobs.status(job_id).has_value()); // the single reader has seen the end
+}
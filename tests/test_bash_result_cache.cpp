@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "bash_result_cache.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace mag;
+
+class BashResultCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_dir_ = std::filesystem::temp_directory_path() / ("mag_bash_cache_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(test_dir_ / "src");
+        write("src/main.cpp", "int main() {}\n");
+        write("notes.txt", "hello\n");
+        settle();
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(test_dir_);
+    }
+    
+    void write(const std::string& name, const std::string& content) {
+        std::ofstream(test_dir_ / name) << content;
+    }
+    
+    // Backdate every mtime past the racy window, as if the tree had been left alone
+    void settle() {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(test_dir_)) {
+            std::filesystem::last_write_time(entry.path(), past_);
+        }
+        std::filesystem::last_write_time(test_dir_, past_);
+    }
+    
+    CommandResult run(const std::string& command) {
+        return bash_tool_.execute_command(command, test_dir_.string());
+    }
+    
+    std::filesystem::path test_dir_;
+    std::filesystem::file_time_type past_ = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    BashTool bash_tool_;
+    BashResultCache cache_{{}, 8, std::chrono::seconds(60), 1000};
+};
+
+TEST_F(BashResultCacheTest, OnlyReadOnlyCommandsAreCacheable) {
+    EXPECT_TRUE(cache_.is_cacheable("ls -la"));
+    EXPECT_TRUE(cache_.is_cacheable("grep -rn 'a | b' src | wc -l"));
+    EXPECT_TRUE(cache_.is_cacheable("find . -name \"*.cpp\""));
+    EXPECT_TRUE(cache_.is_cacheable("git status --short"));
+    EXPECT_TRUE(cache_.is_cacheable("tree -L 2 src"));
+    EXPECT_TRUE(cache_.is_cacheable("file -b main.cpp"));
+    
+    EXPECT_FALSE(cache_.is_cacheable("make"));
+    EXPECT_FALSE(cache_.is_cacheable("ls > listing.txt"));
+    EXPECT_FALSE(cache_.is_cacheable("cat $HOME/notes"));
+    EXPECT_FALSE(cache_.is_cacheable("ls; rm -rf src"));
+    EXPECT_FALSE(cache_.is_cacheable("ls && make"));
+    EXPECT_FALSE(cache_.is_cacheable("cat \"$(whoami)\""));
+    EXPECT_FALSE(cache_.is_cacheable("find . -delete"));
+    EXPECT_FALSE(cache_.is_cacheable("sort -uo out.txt in.txt"));
+    EXPECT_FALSE(cache_.is_cacheable("tree -o tree.txt src"));
+    EXPECT_FALSE(cache_.is_cacheable("tree --output=tree.txt"));
+    EXPECT_FALSE(cache_.is_cacheable("file -C -m magic"));
+    EXPECT_FALSE(cache_.is_cacheable("file --compile"));
+    EXPECT_FALSE(cache_.is_cacheable("tail -f log.txt"));
+    EXPECT_FALSE(cache_.is_cacheable("git commit -m 'x'"));
+    EXPECT_FALSE(cache_.is_cacheable("ls || true"));
+    
+    // The policy narrows the read-only programs further
+    BashResultCache narrow({"ls", "make"}, 8, std::chrono::seconds(60), 1000);
+    EXPECT_TRUE(narrow.is_cacheable("ls src"));
+    EXPECT_FALSE(narrow.is_cacheable("cat notes.txt"));
+    EXPECT_FALSE(narrow.is_cacheable("make"));
+}
+
+TEST_F(BashResultCacheTest, ServesResultsUntilWhatTheyReadChanges) {
+    std::string dir = test_dir_.string();
+    std::string command = "grep -rn main src";
+    
+    auto before = cache_.fingerprint(command, dir);
+    ASSERT_TRUE(before.has_value());
+    EXPECT_FALSE(cache_.lookup(command, dir, *before).has_value());
+    cache_.store(command, dir, *before, run(command));
+    
+    auto again = cache_.fingerprint(command, dir);
+    ASSERT_EQ(again, before);
+    auto hit = cache_.lookup(command, dir, *again);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_NE(hit->stdout_output.find("src/main.cpp:1:int main() {}"), std::string::npos);
+    EXPECT_EQ(cache_.hits(), 1u);
+    
+    // Files the command does not name leave it alone; its own tree does not
+    write("notes.txt", "changed\n");
+    settle();
+    EXPECT_EQ(cache_.fingerprint(command, dir), before);
+    write("src/extra.cpp", "int extra;\n");
+    settle();
+    auto after = cache_.fingerprint(command, dir);
+    ASSERT_TRUE(after.has_value());
+    EXPECT_NE(after, before);
+    EXPECT_FALSE(cache_.lookup(command, dir, *after).has_value());
+    
+    // The same command elsewhere is a different entry
+    EXPECT_FALSE(cache_.lookup(command, (test_dir_ / "src").string(), *after).has_value());
+}
+
+TEST_F(BashResultCacheTest, RefusesWhatItCannotTrust) {
+    std::string dir = test_dir_.string();
+    
+    write("src/fresh.cpp", "just written\n"); // too recent to rely on its mtime
+    EXPECT_FALSE(cache_.fingerprint("ls src", dir).has_value());
+    settle();
+    EXPECT_TRUE(cache_.fingerprint("ls src", dir).has_value());
+    
+    BashResultCache tiny({}, 8, std::chrono::seconds(60), 2);
+    EXPECT_FALSE(tiny.fingerprint("find .", dir).has_value()); // more entries than it may stat
+    EXPECT_FALSE(cache_.fingerprint("make", dir).has_value());
+    
+    // Missing files count: creating one is a change
+    auto missing = cache_.fingerprint("cat absent.txt", dir);
+    ASSERT_TRUE(missing.has_value());
+    write("absent.txt", "now here\n");
+    settle();
+    EXPECT_NE(cache_.fingerprint("cat absent.txt", dir), missing);
+    
+    // Timed out runs are not kept
+    auto fingerprint = cache_.fingerprint("ls", dir);
+    ASSERT_TRUE(fingerprint.has_value());
+    CommandResult timed_out = run("ls");
+    timed_out.timed_out = true;
+    cache_.store("ls", dir, *fingerprint, timed_out);
+    EXPECT_FALSE(cache_.lookup("ls", dir, *fingerprint).has_value());
+}
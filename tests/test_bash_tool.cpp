@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+#include "bash_tool.h"
+#include "process_runner.h"
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+using namespace mag;
+
+class BashToolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        test_dir_ = std::filesystem::temp_directory_path() / ("mag_bash_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(test_dir_ / "a dir with \"quotes\" and $(spaces)");
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(test_dir_);
+    }
+    
+    std::filesystem::path test_dir_;
+    BashTool bash_tool_;
+};
+
+TEST_F(BashToolTest, CapturesStdoutAndStderrSeparately) {
+    CommandResult result = bash_tool_.execute_command("echo out; echo err >&2; exit 3", test_dir_.string());
+    
+    EXPECT_EQ(result.stdout_output, "out\n");
+    EXPECT_EQ(result.stderr_output, "err\n");
+    EXPECT_EQ(result.exit_code, 3);
+    EXPECT_FALSE(result.success);
+    EXPECT_FALSE(result.timed_out);
+}
+
+TEST_F(BashToolTest, TracksTheWorkingDirectoryWithoutQuotingIt) {
+    std::string odd = (test_dir_ / "a dir with \"quotes\" and $(spaces)").string();
+    CommandResult result = bash_tool_.execute_command("pwd", odd);
+    EXPECT_TRUE(result.success) << result.stderr_output;
+    EXPECT_EQ(result.stdout_output, odd + "\n");
+    EXPECT_EQ(result.pwd_after_execution, odd);
+    
+    CommandResult moved = bash_tool_.execute_command("cd .. && echo moved", odd);
+    EXPECT_EQ(moved.stdout_output, "moved\n"); // the pwd report stays out of the output
+    EXPECT_EQ(moved.pwd_after_execution, test_dir_.string());
+    
+    CommandResult missing = bash_tool_.execute_command("echo never", (test_dir_ / "missing").string());
+    EXPECT_FALSE(missing.success);
+    EXPECT_TRUE(missing.stdout_output.empty());
+    EXPECT_EQ(missing.pwd_after_execution, (test_dir_ / "missing").string()); // falls back to the request
+}
+
+TEST_F(BashToolTest, KillsTheProcessGroupAtTheTimeout) {
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = bash_tool_.execute_command("echo started; sleep 30 & sleep 30", test_dir_.string(), 300);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    EXPECT_TRUE(result.timed_out);
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.stdout_output, "started\n");
+    EXPECT_NE(result.stderr_output.find("timed out"), std::string::npos);
+    EXPECT_LT(elapsed, std::chrono::seconds(5));
+}
+
+TEST_F(BashToolTest, RunnerEscalatesToSigkillAndReadsLargeOutput) {
+    ProcessSpec stubborn;
+    stubborn.argv = {"bash", "-c", "trap '' TERM; sleep 30"};
+    stubborn.timeout = std::chrono::milliseconds(100);
+    stubborn.kill_grace = std::chrono::milliseconds(100);
+    ProcessOutput killed = ProcessRunner::run(stubborn);
+    EXPECT_TRUE(killed.timed_out);
+    EXPECT_EQ(killed.exit_code, 128 + SIGKILL);
+    
+    ProcessSpec chatty;
+    chatty.argv = {"bash", "-c", "head -c 3000000 /dev/zero; echo end; head -c 1000 /dev/zero >&2"};
+    chatty.max_output_bytes = 1000000;
+    ProcessOutput output = ProcessRunner::run(chatty);
+    EXPECT_EQ(output.exit_code, 0);
+    EXPECT_EQ(output.stdout_bytes, 3000004u);
+    EXPECT_LT(output.stdout_output.size(), 2000100u); // the start and the end, and a note between them
+    EXPECT_NE(output.stdout_output.find("[... 1000004 bytes omitted ...]"), std::string::npos);
+    EXPECT_EQ(output.stdout_output.substr(output.stdout_output.size() - 4), "end\n");
+    EXPECT_EQ(output.stderr_output.size(), 1000u);
+    EXPECT_TRUE(output.stdout_log.empty()); // no spill directory
+    EXPECT_TRUE(output.truncated);
+    
+    EXPECT_THROW(ProcessRunner::run(ProcessSpec{}), std::invalid_argument);
+}
+
+TEST_F(BashToolTest, StreamsOutputWhileRunningAndStopsOnCancel) {
+    CancellationToken cancel;
+    std::vector<std::pair<bool, std::string>> chunks;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration first_chunk_at{};
+    
+    CommandResult result = bash_tool_.execute_command("echo first; echo oops >&2; sleep 30", test_dir_.string(), -1,
+        [&](bool is_stderr, std::string_view chunk) {
+            if (chunks.empty()) {
+                first_chunk_at = std::chrono::steady_clock::now() - start;
+            }
+            chunks.emplace_back(is_stderr, std::string(chunk));
+            if (is_stderr) {
+                cancel.cancel();
+            }
+        }, &cancel);
+    
+    ASSERT_GE(chunks.size(), 2u);
+    EXPECT_EQ(chunks[0], std::make_pair(false, std::string("first\n")));
+    EXPECT_EQ(chunks[1], std::make_pair(true, std::string("oops\n")));
+    EXPECT_LT(first_chunk_at, std::chrono::seconds(5));
+    EXPECT_TRUE(result.cancelled);
+    EXPECT_FALSE(result.timed_out);
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.stdout_output, "first\n");
+    EXPECT_NE(result.stderr_output.find("cancelled"), std::string::npos);
+}
+
+TEST_F(BashToolTest, SessionsKeepShellStateBetweenCommands) {
+    bash_tool_.set_sessions(std::make_shared<ShellSessions>(4, std::chrono::seconds(600)));
+    std::string dir = test_dir_.string();
+    
+    CommandResult setup = bash_tool_.execute_command("export GREETING=hi; greet() { echo \"$GREETING $1\"; }; cd ..",
+                                                     dir, -1, nullptr, nullptr, "work");
+    EXPECT_TRUE(setup.success) << setup.stderr_output;
+    EXPECT_EQ(setup.pwd_after_execution, test_dir_.parent_path().string());
+    
+    CommandResult used = bash_tool_.execute_command("greet there; false", dir, -1, nullptr, nullptr, "work");
+    EXPECT_EQ(used.stdout_output, "hi there\n");
+    EXPECT_EQ(used.exit_code, 1);
+    EXPECT_EQ(used.pwd_after_execution, dir); // each command starts in the directory it names
+    
+    CommandResult other = bash_tool_.execute_command("echo \"[$GREETING]\"", dir, -1, nullptr, nullptr, "other");
+    EXPECT_EQ(other.stdout_output, "[]\n");
+    
+    CommandResult unshared = bash_tool_.execute_command("echo \"[$GREETING]\"", dir);
+    EXPECT_EQ(unshared.stdout_output, "[]\n");
+}
+
+TEST_F(BashToolTest, SessionStartsAfreshAfterExitOrTimeout) {
+    bash_tool_.set_sessions(std::make_shared<ShellSessions>(4, std::chrono::seconds(600)));
+    std::string dir = test_dir_.string();
+    
+    bash_tool_.execute_command("export MARK=1", dir, -1, nullptr, nullptr, "s");
+    CommandResult exited = bash_tool_.execute_command("echo bye; exit 7", dir, -1, nullptr, nullptr, "s");
+    EXPECT_EQ(exited.stdout_output, "bye\n");
+    EXPECT_EQ(exited.exit_code, 7);
+    EXPECT_EQ(exited.pwd_after_execution, dir);
+    EXPECT_FALSE(exited.error_message.empty());
+    
+    CommandResult after_exit = bash_tool_.execute_command("echo \"[$MARK]\"", dir, -1, nullptr, nullptr, "s");
+    EXPECT_EQ(after_exit.stdout_output, "[]\n");
+    
+    bash_tool_.execute_command("export MARK=2", dir, -1, nullptr, nullptr, "s");
+    CommandResult slow = bash_tool_.execute_command("sleep 30", dir, 200, nullptr, nullptr, "s");
+    EXPECT_TRUE(slow.timed_out);
+    CommandResult after_timeout = bash_tool_.execute_command("echo \"[$MARK]\"", dir, -1, nullptr, nullptr, "s");
+    EXPECT_EQ(after_timeout.stdout_output, "[]\n");
+    EXPECT_TRUE(after_timeout.success);
+}
+
+TEST_F(BashToolTest, SessionPoolEvictsTheLeastRecentlyUsedShell) {
+    ShellSessions sessions(2, std::chrono::seconds(600));
+    ProcessSpec spec;
+    std::string dir = test_dir_.string();
+    bool fresh = false;
+    
+    sessions.run("a", "X=a", dir, spec, &fresh);
+    EXPECT_TRUE(fresh);
+    sessions.run("b", "X=b", dir, spec);
+    ProcessOutput a = sessions.run("a", "echo $X", dir, spec, &fresh);
+    EXPECT_FALSE(fresh);
+    EXPECT_EQ(a.stdout_output, "a\n");
+    
+    sessions.run("c", "X=c", dir, spec); // b was used least recently
+    EXPECT_EQ(sessions.size(), 2u);
+    ProcessOutput b = sessions.run("b", "echo \"[$X]\"", dir, spec, &fresh);
+    EXPECT_TRUE(fresh);
+    EXPECT_EQ(b.stdout_output, "[]\n");
+    
+    ShellSessions short_lived(4, std::chrono::seconds(0));
+    short_lived.run("a", "true", dir, spec);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    short_lived.run("b", "true", dir, spec);
+    EXPECT_EQ(short_lived.size(), 1u); // a was idle too long
+    EXPECT_TRUE(short_lived.close("b"));
+    EXPECT_EQ(short_lived.size(), 0u);
+}
+
+TEST_F(BashToolTest, CaptureKeepsTheStartAndEndAndSpillsTheRest) {
+    OutputCapture small(4, test_dir_.string());
+    EXPECT_EQ(small.append("abc"), 3u);
+    EXPECT_EQ(small.append("defgh"), 1u); // the head is full after "d"
+    small.finish();
+    EXPECT_EQ(small.text(), "abcdefgh");    // nothing dropped, so no log either
+    EXPECT_FALSE(small.truncated());
+    EXPECT_TRUE(small.log_path().empty());
+    
+    OutputCapture ring(4, test_dir_.string());
+    ring.append("0123");
+    for (char c = 'a'; c <= 'z'; ++c) {
+        ring.append(std::string(1, c));
+    }
+    ring.finish();
+    EXPECT_TRUE(ring.truncated());
+    EXPECT_EQ(ring.total_bytes(), 30u);
+    EXPECT_EQ(ring.text(), "0123\n[... 22 bytes omitted; full output in " + ring.log_path() + " ...]\nwxyz");
+    EXPECT_EQ(ring.continuation().substr(0, 5), "\n[...");
+    
+    BashTool tool;
+    tool.set_output_limits(4, test_dir_.string());
+    EXPECT_EQ(ring.log_path().substr(0, test_dir_.string().size()), test_dir_.string());
+    LogChunk all = tool.read_log(ring.log_path(), 0, 1000);
+    EXPECT_EQ(all.data, "0123abcdefghijklmnopqrstuvwxyz");
+    EXPECT_TRUE(all.eof);
+    LogChunk part = tool.read_log(ring.log_path(), 28, 1000);
+    EXPECT_EQ(part.data, "yz");
+    EXPECT_EQ(part.total_bytes, 30u);
+    
+    EXPECT_THROW(tool.read_log("/etc/passwd", 0, 10), std::invalid_argument);
+    EXPECT_THROW(tool.read_log(test_dir_.string() + "/../" + test_dir_.filename().string() + "/../passwd", 0, 10),
+                 std::invalid_argument);
+}
+
+TEST_F(BashToolTest, ChattyCommandsKeepABoundedResultAndAFullLog) {
+    bash_tool_.set_output_limits(1000, test_dir_.string());
+    std::string streamed;
+    CommandResult result = bash_tool_.execute_command("seq 1 100000", test_dir_.string(), -1,
+        [&streamed](bool, std::string_view chunk) { streamed.append(chunk); });
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.stdout_bytes, 588895u);
+    EXPECT_LT(result.stdout_output.size(), 2200u);
+    EXPECT_EQ(streamed, result.stdout_output); // head live, the rest when done
+    EXPECT_EQ(result.stdout_output.substr(0, 4), "1\n2\n");
+    EXPECT_EQ(result.stdout_output.substr(result.stdout_output.size() - 7), "100000\n");
+    ASSERT_FALSE(result.stdout_log.empty());
+    EXPECT_EQ(std::filesystem::file_size(result.stdout_log), 588895u);
+    
+    std::string summary = result.summary(200);
+    EXPECT_LT(summary.size(), 600u);
+    EXPECT_NE(summary.find(result.stdout_log), std::string::npos);
+    EXPECT_NE(summary.find("100000"), std::string::npos);
+}
+
+TEST_F(BashToolTest, ReportsResourceUsageAndEnforcesLimits) {
+    const char* burn = "i=0; while [ $i -lt 200000 ]; do i=$((i+1)); done";
+    CommandResult busy = bash_tool_.execute_command(burn, test_dir_.string());
+    EXPECT_TRUE(busy.success);
+    EXPECT_GT(busy.usage.user_cpu.count() + busy.usage.system_cpu.count(), 0);
+    EXPECT_GT(busy.usage.max_rss_kb, 0u);
+    
+    ResourceLimits limits;
+    limits.cpu_seconds = 1;
+    limits.file_bytes = 4096;
+    bash_tool_.set_limits(limits);
+    CommandResult reported = bash_tool_.execute_command("ulimit -S -t; ulimit -H -t; ulimit -f", test_dir_.string());
+    EXPECT_TRUE(reported.success);
+    EXPECT_EQ(reported.stdout_output, "1\n6\n4\n"); // in force from the start; bash counts -f in KiB
+    
+    CommandResult spinning = bash_tool_.execute_command("while :; do :; done", test_dir_.string(), 10000);
+    EXPECT_FALSE(spinning.success);
+    EXPECT_FALSE(spinning.timed_out);
+    EXPECT_EQ(spinning.exit_code, 128 + SIGXCPU);
+    EXPECT_NE(spinning.error_message.find("CPU time limit"), std::string::npos);
+    
+    CommandResult writer = bash_tool_.execute_command("head -c 100000 /dev/zero > big.bin", test_dir_.string());
+    EXPECT_FALSE(writer.success);
+    EXPECT_LE(std::filesystem::file_size(test_dir_ / "big.bin"), 4096u);
+}
+
+TEST_F(BashToolTest, SessionCommandsReportTheirOwnCpuTime) {
+    bash_tool_.set_sessions(std::make_shared<ShellSessions>(2, std::chrono::seconds(60)));
+    CommandResult busy = bash_tool_.execute_command("i=0; while [ $i -lt 200000 ]; do i=$((i+1)); done",
+                                                    test_dir_.string(), -1, nullptr, nullptr, "s");
+    EXPECT_TRUE(busy.success);
+    auto busy_cpu = busy.usage.user_cpu + busy.usage.system_cpu;
+    EXPECT_GT(busy_cpu.count(), 0);
+    
+    CommandResult idle = bash_tool_.execute_command("true", test_dir_.string(), -1, nullptr, nullptr, "s");
+    EXPECT_TRUE(idle.success);
+    EXPECT_LT(idle.usage.user_cpu + idle.usage.system_cpu, busy_cpu); // only its own share, not the total
+    EXPECT_EQ(idle.pwd_after_execution, test_dir_.string());
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "batch_runner.h"
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+using namespace mag;
+
+namespace {
+
+// Plans "src/<prompt>.cpp" after a delay, so overlapping requests show up in the wall time
+class SlowPlanner : public ILLMClient {
+public:
+    WriteFileCommand request_plan(const std::string& user_prompt) override {
+        int now = ++in_flight;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        --in_flight;
+        
+        WriteFileCommand command;
+        command.command = WriteFileCommand::WRITE;
+        command.path = user_prompt == "escape" ? "/etc/passwd" : "src/" + user_prompt + ".cpp";
+        command.content = "// " + user_prompt;
+        return command;
+    }
+    
+    GenericCommand request_generic_plan(const std::string&) override { return {}; }
+    std::string request_chat(const std::string&) override { return ""; }
+    void set_provider(const std::string&) override {}
+    std::string get_current_provider() const override { return "test"; }
+    
+    std::atomic<int> in_flight{0};
+    std::atomic<int> peak{0};
+};
+
+class RecordingFiles : public IFileClient {
+public:
+    DryRunResult dry_run(const WriteFileCommand& command) override {
+        DryRunResult result;
+        result.success = true;
+        result.description = "Would write " + command.path;
+        return result;
+    }
+    
+    ApplyResult apply(const WriteFileCommand&) override {
+        ++applied;
+        ApplyResult result;
+        result.success = true;
+        return result;
+    }
+    
+    std::atomic<int> applied{0};
+};
+
+PolicyChecker policy(bool confirm_creates) {
+    PolicySettings settings;
+    settings.tools["file_tool"].create.confirmation_required = confirm_creates;
+    return PolicyChecker(std::make_shared<const PolicySnapshot>(settings, 1));
+}
+
+std::vector<nlohmann::json> lines(const std::string& output) {
+    std::vector<nlohmann::json> results;
+    std::istringstream stream(output);
+    for (std::string line; std::getline(stream, line);) {
+        results.push_back(nlohmann::json::parse(line));
+    }
+    return results;
+}
+
+} // anonymous namespace
+
+TEST(BatchRunnerTest, RunsPromptsConcurrentlyAndReportsStageTimings) {
+    SlowPlanner llm;
+    RecordingFiles files;
+    BatchRunner runner(llm, files, policy(true), 8, BatchRunner::Approval::ALL);
+    
+    std::stringstream input;
+    for (int i = 0; i < 8; ++i) {
+        input << nlohmann::json{{"request_id", "req-" + std::to_string(i)}, {"prompt", "file" + std::to_string(i)}}.dump()
+              << "\n";
+    }
+    std::ostringstream output;
+    BatchSummary summary = runner.run(input, output);
+    
+    EXPECT_EQ(summary.total, 8u);
+    EXPECT_EQ(summary.count("applied"), 8u);
+    EXPECT_EQ(files.applied.load(), 8);
+    EXPECT_GT(llm.peak.load(), 1);
+    EXPECT_LT(summary.wall_ms, 8 * 40.0);
+    
+    std::vector<nlohmann::json> results = lines(output.str());
+    ASSERT_EQ(results.size(), 8u);
+    for (const auto& result : results) {
+        EXPECT_EQ(result["id"].get<std::string>().rfind("req-", 0), 0u);
+        EXPECT_GE(result["timings_ms"]["plan"].get<double>(), 40.0);
+        EXPECT_GE(result["timings_ms"]["total"].get<double>(), result["timings_ms"]["plan"].get<double>());
+    }
+}
+
+TEST(BatchRunnerTest, PolicyDecidesWhatIsAppliedWithoutPrompting) {
+    SlowPlanner llm;
+    RecordingFiles files;
+    std::istringstream input("{\"prompt\": \"one\"}\n\n{\"prompt\": \"escape\"}\nnot json\n");
+    
+    std::ostringstream confirmed;
+    BatchSummary summary = BatchRunner(llm, files, policy(true), 2).run(input, confirmed);
+    EXPECT_EQ(summary.total, 3u); // the blank line is not a prompt
+    EXPECT_EQ(summary.count("needs_confirmation"), 1u);
+    EXPECT_EQ(summary.count("denied"), 1u);
+    EXPECT_EQ(summary.count("failed"), 1u);
+    EXPECT_EQ(files.applied.load(), 0);
+    
+    BatchRunner trusted(llm, files, policy(false), 2);
+    EXPECT_EQ(trusted.run_one({1, "a", "one"}).status, "applied");
+    
+    BatchRunner hooked(llm, files, policy(false), 2);
+    hooked.set_approver([](const WriteFileCommand& command, const DryRunResult&) { return command.path != "src/one.cpp"; });
+    EXPECT_EQ(hooked.run_one({1, "a", "one"}).status, "needs_confirmation");
+    
+    BatchRunner dry(llm, files, policy(false), 2, BatchRunner::Approval::NONE);
+    EXPECT_EQ(dry.run_one({1, "a", "one"}).status, "dry_run");
+    EXPECT_EQ(files.applied.load(), 1);
+}
+
+TEST(BatchRunnerTest, ParsesPromptOrTitleAndBody) {
+    auto item = BatchRunner::parse_line(R"({"request_id": "user-1", "title": "Add caching", "body": "Cache it."})", 3);
+    ASSERT_TRUE(item);
+    EXPECT_EQ(item->id, "user-1");
+    EXPECT_EQ(item->prompt, "Add caching\n\nCache it.");
+    
+    item = BatchRunner::parse_line(R"({"id": 7, "prompt": "Create hello.py"})", 4);
+    EXPECT_EQ(item->id, "7");
+    EXPECT_EQ(item->prompt, "Create hello.py");
+    
+    EXPECT_FALSE(BatchRunner::parse_line("   ", 5));
+    EXPECT_EQ(BatchRunner::parse_line("oops", 6)->id, "line-6");
+}
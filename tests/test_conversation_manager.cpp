@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include "conversation_manager.h"
+#include <atomic>
+#include <filesystem>
+
+using namespace mag;
+
+class ConversationCompactionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_compaction_test";
+        std::filesystem::remove_all(dir_);
+        manager_.set_storage_directory(dir_.string());
+    }
+    
+    void TearDown() override {
+        manager_.wait_for_compaction();
+        manager_.clear_history();
+        std::filesystem::remove_all(dir_);
+    }
+    
+    // Every "mN" costs the same number of tokens, overhead included
+    static size_t per_message() { return HeuristicTokenCounter().count_message("m0"); }
+    
+    void add_turns(int count) {
+        for (int i = 0; i < count; ++i) {
+            manager_.add_user_message("m" + std::to_string(next_turn_++ % 10));
+        }
+    }
+    
+    std::filesystem::path dir_;
+    ConversationManager manager_;
+    std::atomic<int> calls_{0};
+    int next_turn_ = 0;
+};
+
+TEST_F(ConversationCompactionTest, SummarizesOldTurnsOnceAndKeepsRecentVerbatim) {
+    std::vector<std::string> seen;
+    manager_.enable_compaction([&](const std::vector<ConversationMessage>& turns, const std::string& previous) {
+        ++calls_;
+        EXPECT_TRUE(previous.empty());
+        for (const auto& turn : turns) {
+            seen.push_back(turn.content.str());
+        }
+        return std::string("user sent m0..m3");
+    }, 6 * per_message(), 2);
+    
+    add_turns(6);             // exactly at the threshold
+    manager_.wait_for_compaction();
+    EXPECT_EQ(calls_.load(), 0);
+    
+    add_turns(1);             // crosses it: m0..m4 are summarized, m5 and m6 stay
+    manager_.wait_for_compaction();
+    EXPECT_EQ(calls_.load(), 1);
+    EXPECT_EQ(seen, (std::vector<std::string>{"m0", "m1", "m2", "m3", "m4"}));
+    
+    auto history = manager_.get_history();
+    ASSERT_EQ(history.size(), 3u);
+    EXPECT_TRUE(ConversationManager::is_summary(history[0]));
+    EXPECT_EQ(history[0].content, std::string(ConversationManager::SUMMARY_PREFIX) + "user sent m0..m3");
+    EXPECT_EQ(history[1].content, "m5");
+    EXPECT_EQ(history[2].content, "m6");
+    
+    size_t expected_tokens = 0;
+    for (const auto& message : history) {
+        expected_tokens += message.token_count;
+    }
+    EXPECT_EQ(manager_.get_token_count(), expected_tokens);
+}
+
+TEST_F(ConversationCompactionTest, LaterCompactionsExtendThePreviousSummary) {
+    std::string last_previous;
+    manager_.enable_compaction([&](const std::vector<ConversationMessage>& turns, const std::string& previous) {
+        last_previous = previous;
+        return "summary" + std::to_string(++calls_);
+    }, 4 * per_message(), 1);
+    
+    add_turns(5);
+    manager_.wait_for_compaction();
+    ASSERT_EQ(calls_.load(), 1);
+    
+    add_turns(5);
+    manager_.wait_for_compaction();
+    ASSERT_EQ(calls_.load(), 2);
+    EXPECT_EQ(last_previous, "summary1");
+    
+    auto history = manager_.get_history();
+    EXPECT_EQ(history.front().content, std::string(ConversationManager::SUMMARY_PREFIX) + "summary2");
+    EXPECT_EQ(std::count_if(history.begin(), history.end(), ConversationManager::is_summary), 1);
+}
+
+TEST_F(ConversationCompactionTest, FailedOrStaleSummariesLeaveHistoryUntouched) {
+    manager_.enable_compaction([&](const std::vector<ConversationMessage>&, const std::string&) -> std::string {
+        ++calls_;
+        throw std::runtime_error("adapter down");
+    }, 2 * per_message(), 1);
+    
+    add_turns(4);
+    manager_.wait_for_compaction();
+    EXPECT_GE(calls_.load(), 1);
+    EXPECT_EQ(manager_.get_message_count(), 4u);
+    EXPECT_FALSE(ConversationManager::is_summary(manager_.get_history().front()));
+    
+    // A summary for a session that has since been cleared is discarded
+    manager_.enable_compaction([](const std::vector<ConversationMessage>&, const std::string&) {
+        return std::string("stale");
+    }, 0, 0);
+    manager_.add_user_message("trigger");
+    manager_.clear_history();
+    manager_.wait_for_compaction();
+    manager_.add_user_message("fresh");
+    ASSERT_EQ(manager_.get_message_count(), 1u);
+    EXPECT_EQ(manager_.get_history()[0].content, "fresh");
+}
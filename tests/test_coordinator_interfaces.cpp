@@ -2,6 +2,8 @@
 #include "coordinator.h"
 #include "interfaces/llm_client_interface.h"
 #include "interfaces/file_client_interface.h"
+#include "interfaces/bash_client_interface.h"
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -64,6 +66,22 @@ public:
     ApplyResult mock_apply_response;
 };
 
+class TestBashClient : public IBashClient {
+public:
+    CommandResult execute(const BashCommand& command) override {
+        execute_calls.push_back(command);
+        CommandResult result;
+        result.command = command.bash_command;
+        result.exit_code = 0;
+        result.success = true;
+        result.stdout_output = "ok";
+        result.execution_duration = std::chrono::milliseconds(1);
+        return result;
+    }
+    
+    std::vector<BashCommand> execute_calls;
+};
+
 class CoordinatorInterfaceTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -151,6 +169,30 @@ TEST_F(CoordinatorInterfaceTest, FileOperationCallsFileClient) {
     EXPECT_EQ(file_client_ptr->apply_calls[0].path, "tests/test_hello.py");
 }
 
+TEST_F(CoordinatorInterfaceTest, ConfirmationsComeFromTheLineReader) {
+    llm_client_ptr->mock_plan_response.command = "WriteFile";
+    llm_client_ptr->mock_plan_response.path = "src/confirmed.py";
+    file_client_ptr->mock_dry_run_response.success = true;
+    file_client_ptr->mock_apply_response.success = true;
+    
+    std::vector<std::string> questions;
+    std::string reply = "n";
+    coordinator->set_line_reader([&](const std::string& question) {
+        questions.push_back(question);
+        return reply;
+    });
+    coordinator->set_chat_mode(false);
+    
+    coordinator->run("Create confirmed.py");
+    EXPECT_EQ(questions.size(), 1u);
+    EXPECT_TRUE(file_client_ptr->apply_calls.empty());
+    
+    reply = "y";
+    coordinator->run("Create confirmed.py");
+    EXPECT_EQ(questions.size(), 2u);
+    EXPECT_EQ(file_client_ptr->apply_calls.size(), 1u);
+}
+
 TEST_F(CoordinatorInterfaceTest, ProviderSwitchingCallsLLMClient) {
     coordinator->set_provider("claude");
     
@@ -198,4 +240,62 @@ TEST_F(CoordinatorInterfaceTest, ExecuteSingleTodoUsesInterfaces) {
     EXPECT_EQ(llm_client_ptr->plan_requests[0], "Create hello world - Python script");
 }
 
-} // namespace mag
\ No newline at end of file
+TEST(CoordinatorBashClientTest, BashTodoUsesInjectedBashClient) {
+    auto test_bash = std::make_unique<TestBashClient>();
+    TestBashClient* bash_client_ptr = test_bash.get();
+    Coordinator coordinator(std::make_unique<TestLLMClient>(), std::make_unique<TestFileClient>(),
+                            PolicyChecker(), TodoManager(), std::move(test_bash));
+    
+    TodoItem todo;
+    todo.id = 1;
+    todo.title = "Run git status";
+    todo.status = TodoStatus::PENDING;
+    coordinator.execute_single_todo(todo);
+    
+    ASSERT_EQ(bash_client_ptr->execute_calls.size(), 1);
+    EXPECT_EQ(bash_client_ptr->execute_calls[0].bash_command, "git status");
+}
+
+// Counts the batch round trips; items still go through TestFileClient
+class BatchCountingFileClient : public TestFileClient {
+public:
+    BatchDryRunResult dry_run_batch(const std::vector<WriteFileCommand>& commands) override {
+        ++dry_run_batches;
+        return IFileClient::dry_run_batch(commands);
+    }
+    
+    BatchApplyResult apply_batch(const std::vector<WriteFileCommand>& commands, bool all_or_nothing) override {
+        ++apply_batches;
+        return IFileClient::apply_batch(commands, all_or_nothing);
+    }
+    
+    int dry_run_batches = 0;
+    int apply_batches = 0;
+};
+
+TEST(CoordinatorBatchTest, ExecuteTodosBatchesConsecutiveFileWrites) {
+    auto test_llm = std::make_unique<TestLLMClient>();
+    auto test_file = std::make_unique<BatchCountingFileClient>();
+    TestLLMClient* llm_client_ptr = test_llm.get();
+    BatchCountingFileClient* file_client_ptr = test_file.get();
+    llm_client_ptr->mock_plan_response = {"WriteFile", "tests/generated.py", "print(1)"};
+    file_client_ptr->mock_dry_run_response.success = true;
+    file_client_ptr->mock_dry_run_response.description = "ok";
+    file_client_ptr->mock_apply_response.success = true;
+    file_client_ptr->mock_apply_response.description = "written";
+    Coordinator coordinator(std::move(test_llm), std::move(test_file));
+    
+    int first = coordinator.get_todo_manager().add_todo("Create the module");
+    int second = coordinator.get_todo_manager().add_todo("Create the helpers");
+    coordinator.execute_todos();
+    
+    // Both plans go to the file tool in one dry run and one apply
+    EXPECT_EQ(llm_client_ptr->plan_requests.size(), 2u);
+    EXPECT_EQ(file_client_ptr->dry_run_batches, 1);
+    EXPECT_EQ(file_client_ptr->apply_batches, 1);
+    EXPECT_EQ(file_client_ptr->apply_calls.size(), 2u);
+    EXPECT_EQ(coordinator.get_todo_manager().get_todo(first)->status, TodoStatus::COMPLETED);
+    EXPECT_EQ(coordinator.get_todo_manager().get_todo(second)->status, TodoStatus::COMPLETED);
+}
+
+} // namespace mag
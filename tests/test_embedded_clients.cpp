@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "embedded_clients.h"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace mag {
+
+class EmbeddedClientsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / ("mag_embedded_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(dir_ / "sub");
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+    
+    std::filesystem::path dir_;
+};
+
+TEST_F(EmbeddedClientsTest, FileClientWritesInProcess) {
+    EmbeddedFileClient client;
+    WriteFileCommand command;
+    command.command = "WriteFile";
+    command.path = (dir_ / "hello.txt").string();
+    command.content = "hello\n";
+    
+    DryRunResult dry_run = client.dry_run(command);
+    EXPECT_TRUE(dry_run.success);
+    EXPECT_FALSE(std::filesystem::exists(command.path));
+    
+    ApplyResult applied = client.apply(command);
+    ASSERT_TRUE(applied.success);
+    std::ifstream file(command.path);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "hello\n");
+}
+
+TEST_F(EmbeddedClientsTest, BashClientKeepsWorkingDirectoryBetweenCommands) {
+    EmbeddedBashClient client;
+    BashCommand cd;
+    cd.bash_command = "cd sub";
+    cd.working_directory = dir_.string();
+    CommandResult first = client.execute(cd);
+    ASSERT_TRUE(first.success) << first.stderr_output;
+    
+    // No working directory given: the next command starts where the last one ended
+    BashCommand pwd;
+    pwd.bash_command = "pwd";
+    CommandResult second = client.execute(pwd);
+    ASSERT_TRUE(second.success) << second.stderr_output;
+    EXPECT_NE(second.stdout_output.find("sub"), std::string::npos);
+    EXPECT_EQ(std::filesystem::path(client.working_directory()).filename(), "sub");
+}
+
+TEST_F(EmbeddedClientsTest, BashClientStreamsOutputAndCancels) {
+    EmbeddedBashClient client;
+    BashCommand command;
+    command.command = "execute";
+    command.bash_command = "echo building; sleep 30";
+    command.working_directory = dir_.string();
+    
+    std::string seen;
+    CommandResult result = client.execute_stream(command, [&](bool is_stderr, std::string_view chunk) {
+        if (!is_stderr) {
+            seen.append(chunk);
+            client.cancel_pending(); // as /cancel would after seeing the first error
+        }
+    });
+    
+    EXPECT_EQ(seen, "building\n");
+    EXPECT_TRUE(result.cancelled);
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.stdout_output, "building\n");
+}
+
+} // namespace mag
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "endpoint_config.h"
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+using namespace mag;
+
+class EndpointConfigTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_file_ = (std::filesystem::temp_directory_path() / "mag_network_test.json").string();
+        std::filesystem::remove(config_file_);
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove(config_file_);
+    }
+    
+    EndpointConfig load() {
+        return EndpointConfig::load(config_file_, [this](const char* name) -> std::optional<std::string> {
+            auto it = env_.find(name);
+            if (it == env_.end()) {
+                return std::nullopt;
+            }
+            return it->second;
+        });
+    }
+    
+    std::string config_file_;
+    std::map<std::string, std::string> env_;
+};
+
+TEST_F(EndpointConfigTest, DefaultsToTcpLoopback) {
+    EndpointConfig config = load();
+    EXPECT_EQ(config.url(EndpointConfig::Service::LLM_ADAPTER), "tcp://127.0.0.1:5555");
+    EXPECT_EQ(config.url(EndpointConfig::Service::FILE_TOOL), "tcp://127.0.0.1:5556");
+    EXPECT_EQ(config.url(EndpointConfig::Service::BASH_TOOL), "tcp://127.0.0.1:5557");
+}
+
+TEST_F(EndpointConfigTest, IpcEndpointsArePerInstance) {
+    env_ = {{"MAG_TRANSPORT", "ipc"}, {"MAG_INSTANCE", "alice"}, {"MAG_IPC_DIR", "/run/mag"}};
+    EndpointConfig config = load();
+    EXPECT_EQ(config.url(EndpointConfig::Service::FILE_TOOL), "ipc:///run/mag/mag-alice-file_tool.ipc");
+    
+    env_["MAG_INSTANCE"] = "bob";
+    EXPECT_NE(load().url(EndpointConfig::Service::FILE_TOOL), config.url(EndpointConfig::Service::FILE_TOOL));
+    
+    env_["MAG_TRANSPORT"] = "inproc";
+    EXPECT_EQ(load().url(EndpointConfig::Service::BASH_TOOL), "inproc://mag-bob-bash_tool");
+}
+
+TEST_F(EndpointConfigTest, EnvironmentOverridesTheConfigFile) {
+    {
+        std::ofstream file(config_file_);
+        file << R"({"transport": "tcp", "port_base": 7000, "endpoints": {"bash_tool": "ipc:///tmp/custom.ipc"}})";
+    }
+    EndpointConfig from_file = load();
+    EXPECT_EQ(from_file.url(EndpointConfig::Service::LLM_ADAPTER), "tcp://127.0.0.1:7000");
+    EXPECT_EQ(from_file.url(EndpointConfig::Service::FILE_TOOL), "tcp://127.0.0.1:7001");
+    EXPECT_EQ(from_file.url(EndpointConfig::Service::BASH_TOOL), "ipc:///tmp/custom.ipc");
+    
+    env_ = {{"MAG_PORT_BASE", "8000"}, {"MAG_LLM_ADAPTER_URL", "tcp://10.0.0.5:9000"}};
+    EndpointConfig overridden = load();
+    EXPECT_EQ(overridden.url(EndpointConfig::Service::LLM_ADAPTER), "tcp://10.0.0.5:9000");
+    EXPECT_EQ(overridden.url(EndpointConfig::Service::FILE_TOOL), "tcp://127.0.0.1:8001");
+}
+
+TEST_F(EndpointConfigTest, ServicesCanListSeveralWorkers) {
+    {
+        std::ofstream file(config_file_);
+        file << R"({"worker_registry": "/tmp/mag-workers",
+                    "endpoints": {"llm_adapter": ["tcp://10.0.0.1:5555", "tcp://10.0.0.2:5555"]}})";
+    }
+    EndpointConfig from_file = load();
+    EXPECT_EQ(from_file.urls(EndpointConfig::Service::LLM_ADAPTER),
+              (std::vector<std::string>{"tcp://10.0.0.1:5555", "tcp://10.0.0.2:5555"}));
+    EXPECT_EQ(from_file.url(EndpointConfig::Service::LLM_ADAPTER), "tcp://10.0.0.1:5555");
+    EXPECT_EQ(from_file.urls(EndpointConfig::Service::FILE_TOOL).size(), 1u);
+    EXPECT_EQ(from_file.registry_directory(), "/tmp/mag-workers");
+    
+    env_ = {{"MAG_BASH_TOOL_URL", "ipc:///tmp/b1.ipc, ipc:///tmp/b2.ipc"}};
+    EXPECT_EQ(load().urls(EndpointConfig::Service::BASH_TOOL),
+              (std::vector<std::string>{"ipc:///tmp/b1.ipc", "ipc:///tmp/b2.ipc"}));
+}
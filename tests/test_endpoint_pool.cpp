@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "network/endpoint_pool.h"
+#include "network/nng_rep_server.h"
+#include "config.h"
+#include "thread_pool.h"
+#include "worker_registry.h"
+#include <filesystem>
+#include <fstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace mag;
+
+TEST(EndpointHealthTest, RepeatedFailuresEjectForAGrowingCoolDown) {
+    EndpointHealth health;
+    auto now = EndpointHealth::Clock::now();
+    
+    for (size_t i = 0; i + 1 < EndpointPoolConfig::EJECT_AFTER_FAILURES; ++i) {
+        health.record(NNGReqClient::Outcome::TIMED_OUT, now);
+    }
+    health.record(NNGReqClient::Outcome::CANCELLED, now); // not the worker's fault
+    EXPECT_TRUE(health.available(now));
+    
+    health.record(NNGReqClient::Outcome::FAILED, now);
+    EXPECT_FALSE(health.available(now));
+    auto first_return = health.ejected_until();
+    EXPECT_EQ(first_return - now, std::chrono::milliseconds(EndpointPoolConfig::EJECT_BASE_MS));
+    
+    // Back on probation: one more failure ejects again, for twice as long
+    health.record(NNGReqClient::Outcome::FAILED, first_return);
+    EXPECT_EQ(health.ejected_until() - first_return, std::chrono::milliseconds(2 * EndpointPoolConfig::EJECT_BASE_MS));
+    
+    // A success clears everything
+    health.record(NNGReqClient::Outcome::OK, health.ejected_until());
+    EXPECT_EQ(health.consecutive_failures(), 0u);
+}
+
+TEST(WorkerRegistrationTest, DiscoverListsLiveWorkersAndDropsStaleOnes) {
+    std::string dir = (std::filesystem::temp_directory_path() / ("mag_registry_test_" + std::to_string(::getpid()))).string();
+    std::filesystem::remove_all(dir);
+    
+    // A pid that certainly is not running any more
+    pid_t child = ::fork();
+    if (child == 0) {
+        ::_exit(0);
+    }
+    ::waitpid(child, nullptr, 0);
+    std::filesystem::create_directories(dir + "/llm_adapter");
+    std::ofstream(dir + "/llm_adapter/" + std::to_string(child) + ".url") << "tcp://127.0.0.1:6000\n";
+    
+    {
+        WorkerRegistration registration(dir, "llm_adapter", "tcp://127.0.0.1:6001");
+        EXPECT_EQ(WorkerRegistration::discover(dir, "llm_adapter"), std::vector<std::string>{"tcp://127.0.0.1:6001"});
+        EXPECT_FALSE(std::filesystem::exists(dir + "/llm_adapter/" + std::to_string(child) + ".url"));
+        EXPECT_TRUE(WorkerRegistration::discover(dir, "bash_tool").empty());
+    }
+    EXPECT_TRUE(WorkerRegistration::discover(dir, "llm_adapter").empty());
+    std::filesystem::remove_all(dir);
+}
+
+// Two echo workers over inproc; each reply names the worker that produced it
+class EndpointPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool_ = std::make_unique<ThreadPool>(4);
+        for (const std::string name : {"a", "b"}) {
+            auto server = std::make_unique<NNGRepServer>(url_for(name), 2, *pool_,
+                [name](size_t, std::string_view request) {
+                    if (request.substr(0, 4) == "slow") {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                    }
+                    return NngMessage::copy_of(name);
+                });
+            try {
+                server->start();
+            } catch (const std::exception& e) {
+                GTEST_SKIP() << "NNG transport unavailable: " << e.what();
+            }
+            servers_.push_back(std::move(server));
+        }
+    }
+    
+    static std::string url_for(const std::string& name) { return "inproc://mag-pool-test-" + name; }
+    
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<std::unique_ptr<NNGRepServer>> servers_;
+};
+
+TEST_F(EndpointPoolTest, RequestsGoToTheLeastBusyWorker) {
+    EndpointPool endpoints({url_for("a"), url_for("b")}, "echo", std::chrono::milliseconds(5000));
+    ASSERT_EQ(endpoints.size(), 2u);
+    
+    auto slow = endpoints.request_async("slow");
+    // Whichever worker took the slow call, the next ones go to the other
+    std::string busy = endpoints.status()[0].in_flight > 0 ? "a" : "b";
+    EXPECT_NE(endpoints.request("fast 1"), busy);
+    EXPECT_NE(endpoints.request("fast 2"), busy);
+    EXPECT_EQ(slow.get(), busy);
+    
+    endpoints.remove_endpoint(url_for(busy));
+    EXPECT_EQ(endpoints.size(), 1u);
+    EXPECT_NE(endpoints.request("after removal"), busy);
+}
+
+TEST_F(EndpointPoolTest, KeysStayOnTheirWorker) {
+    EndpointPool endpoints({url_for("a"), url_for("b")}, "echo", std::chrono::milliseconds(5000));
+    
+    // A session keeps its worker even while that worker is the busier one
+    std::string session_worker = endpoints.pin("default")->request("first");
+    auto slow = endpoints.pin("default")->request_async("slow");
+    EXPECT_EQ(endpoints.pin("default")->request("second"), session_worker);
+    EXPECT_NE(endpoints.request("unpinned"), session_worker);
+    EXPECT_EQ(slow.get(), session_worker);
+    
+    // Its worker leaving moves it to one that remains
+    endpoints.remove_endpoint(url_for(session_worker));
+    std::string moved = endpoints.pin("default")->request("third");
+    EXPECT_NE(moved, session_worker);
+    EXPECT_EQ(endpoints.pin("default")->request("fourth"), moved);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "execution_controller.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace mag;
+
+TEST(ExecutionControllerTest, PauseBlocksUntilResumed) {
+    ExecutionController controller;
+    EXPECT_FALSE(controller.pause()); // no run yet
+    controller.begin();
+    EXPECT_TRUE(controller.proceed());
+    
+    ASSERT_TRUE(controller.pause());
+    EXPECT_EQ(controller.state(), ExecutionController::State::PAUSED);
+    auto proceeded = std::async(std::launch::async, [&controller] { return controller.proceed(); });
+    EXPECT_EQ(proceeded.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+    
+    ASSERT_TRUE(controller.resume());
+    ASSERT_EQ(proceeded.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_TRUE(proceeded.get());
+    
+    controller.end();
+    EXPECT_EQ(controller.state(), ExecutionController::State::STOPPED);
+}
+
+TEST(ExecutionControllerTest, StopWakesAPausedRun) {
+    ExecutionController controller;
+    controller.begin();
+    controller.pause();
+    auto proceeded = std::async(std::launch::async, [&controller] { return controller.proceed(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    
+    ASSERT_TRUE(controller.stop());
+    EXPECT_FALSE(proceeded.get());
+    EXPECT_TRUE(controller.stopping());
+    EXPECT_FALSE(controller.resume());
+    
+    // The next run starts clean
+    controller.end();
+    controller.begin();
+    EXPECT_FALSE(controller.stopping());
+    EXPECT_TRUE(controller.proceed());
+}
+
+TEST(ExecutionControllerTest, CancelFiresTheRunsToken) {
+    ExecutionController controller;
+    EXPECT_FALSE(controller.cancel());
+    
+    std::atomic<int> aborted{0};
+    CancellationToken first = controller.begin();
+    first.on_cancel([&aborted] { ++aborted; });
+    ASSERT_TRUE(controller.cancel());
+    EXPECT_EQ(aborted.load(), 1);
+    EXPECT_TRUE(first.is_cancelled());
+    EXPECT_EQ(controller.state(), ExecutionController::State::CANCELLED);
+    EXPECT_FALSE(controller.proceed());
+    EXPECT_FALSE(controller.cancel()); // once per run
+    controller.end();
+    
+    CancellationToken second = controller.begin();
+    EXPECT_FALSE(second.is_cancelled());
+    controller.end();
+}
@@ -1,8 +1,12 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "file_operations.h"
+#include "utils.h"
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 using namespace mag;
 
@@ -90,4 +94,452 @@ TEST_F(FileOperationsTest, ApplyWithDirectoryCreation) {
     std::string file_content((std::istreambuf_iterator<char>(file)),
                             std::istreambuf_iterator<char>());
     EXPECT_EQ(content, file_content);
-}
\ No newline at end of file
+}
+
+TEST_F(FileOperationsTest, BatchDryRunRejectsDuplicatePaths) {
+    std::vector<WriteFileCommand> commands(3);
+    for (auto& command : commands) {
+        command.command = "WriteFile";
+        command.content = "x";
+    }
+    commands[0].path = test_dir_ + "/a.txt";
+    commands[1].path = test_dir_ + "/b.txt";
+    commands[2].path = test_dir_ + "/a.txt";
+    
+    BatchDryRunResult result = file_tool_->dry_run_batch(commands);
+    
+    EXPECT_FALSE(result.success);
+    ASSERT_EQ(result.results.size(), 3u);
+    EXPECT_TRUE(result.results[0].success);
+    EXPECT_TRUE(result.results[1].success);
+    EXPECT_FALSE(result.results[2].success);
+    EXPECT_THAT(result.results[2].error_message, testing::HasSubstr("item 1"));
+    
+    // All-or-nothing refuses the batch before writing anything
+    BatchApplyResult applied = file_tool_->apply_batch(commands, true);
+    EXPECT_FALSE(applied.success);
+    EXPECT_FALSE(std::filesystem::exists(commands[0].path));
+    EXPECT_FALSE(std::filesystem::exists(commands[1].path));
+}
+
+TEST_F(FileOperationsTest, AtomicBatchRestoresFilesWhenAWriteFails) {
+    std::string existing = test_dir_ + "/existing.txt";
+    std::string blocker = test_dir_ + "/blocker";
+    std::ofstream(existing) << "original";
+    std::ofstream(blocker) << "a file where a directory is needed";
+    
+    std::vector<WriteFileCommand> commands(3);
+    commands[0].path = existing;
+    commands[1].path = test_dir_ + "/created.txt";
+    commands[2].path = blocker + "/child.txt"; // passes the dry run, fails to write
+    for (auto& command : commands) {
+        command.command = "WriteFile";
+        command.content = "new";
+    }
+    
+    BatchApplyResult atomic = file_tool_->apply_batch(commands, true);
+    EXPECT_FALSE(atomic.success);
+    EXPECT_TRUE(atomic.rolled_back);
+    ASSERT_EQ(atomic.results.size(), 3u);
+    EXPECT_FALSE(atomic.results[0].success);
+    std::ifstream restored(existing);
+    std::string content((std::istreambuf_iterator<char>(restored)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, "original");
+    EXPECT_FALSE(std::filesystem::exists(commands[1].path));
+    
+    // Item by item, the writes that can succeed do
+    BatchApplyResult independent = file_tool_->apply_batch(commands, false);
+    EXPECT_FALSE(independent.success);
+    EXPECT_FALSE(independent.rolled_back);
+    EXPECT_TRUE(independent.results[0].success);
+    EXPECT_TRUE(independent.results[1].success);
+    EXPECT_FALSE(independent.results[2].success);
+    EXPECT_TRUE(std::filesystem::exists(commands[1].path));
+}
+
+TEST_F(FileOperationsTest, ApplyReplacesFilesInPlaceWithoutLeftovers) {
+    std::string target = test_dir_ + "/script.sh";
+    std::string link = test_dir_ + "/current.sh";
+    std::ofstream(target) << "old";
+    std::filesystem::permissions(target, std::filesystem::perms::owner_all | std::filesystem::perms::group_read);
+    std::filesystem::create_symlink("script.sh", link);
+    
+    ApplyResult result = file_tool_->apply(link, "new");
+    ASSERT_TRUE(result.success) << result.error_message;
+    
+    // The link survives, the file behind it is replaced and keeps its mode
+    EXPECT_TRUE(std::filesystem::is_symlink(link));
+    std::ifstream file(target);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, "new");
+    EXPECT_EQ(std::filesystem::status(target).permissions(),
+              std::filesystem::perms::owner_all | std::filesystem::perms::group_read);
+    
+    std::vector<WriteFileCommand> commands(2);
+    commands[0].path = target;
+    commands[1].path = test_dir_ + "/nested/other.txt";
+    for (auto& command : commands) {
+        command.command = "WriteFile";
+        command.content = "batched";
+    }
+    FileTool fast(false);
+    EXPECT_TRUE(fast.apply_batch(commands, true).success);
+    EXPECT_TRUE(std::filesystem::exists(commands[1].path));
+    
+    // No temp or backup files are left next to the targets
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(test_dir_)) {
+        EXPECT_EQ(entry.path().filename().string().find(".mag-"), std::string::npos) << entry.path();
+    }
+}
+
+TEST_F(FileOperationsTest, PatchFileEditsInPlaceAndShowsTheDiff) {
+    std::string path = test_dir_ + "/config.ini";
+    std::ofstream(path) << "[server]\nport = 80\nhost = localhost\n";
+    
+    WriteFileCommand command;
+    command.command = WriteFileCommand::PATCH;
+    command.path = path;
+    command.content = "<<<<<<< SEARCH\nport = 80\n=======\nport = 8080\n>>>>>>> REPLACE\n";
+    
+    DryRunResult dry_run = file_tool_->dry_run(command);
+    ASSERT_TRUE(dry_run.success) << dry_run.error_message;
+    EXPECT_THAT(dry_run.description, testing::HasSubstr("+1 -1 lines"));
+    EXPECT_THAT(dry_run.diff, testing::HasSubstr("-port = 80\n+port = 8080\n"));
+    
+    ApplyResult applied = file_tool_->apply(command);
+    ASSERT_TRUE(applied.success) << applied.error_message;
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, "[server]\nport = 8080\nhost = localhost\n");
+    
+    // Applying it again no longer matches and leaves the file alone
+    EXPECT_FALSE(file_tool_->dry_run(command).success);
+    EXPECT_FALSE(file_tool_->apply(command).success);
+    
+    // Whole-file writes over an existing file also come with a diff
+    EXPECT_THAT(file_tool_->dry_run(path, "[server]\n").diff, testing::HasSubstr("-host = localhost\n"));
+}
+
+TEST_F(FileOperationsTest, IdenticalWritesAreSkippedAsUnchanged) {
+    std::string path = test_dir_ + "/Makefile";
+    ASSERT_TRUE(file_tool_->apply(path, "all:\n\techo hi\n").success);
+    
+    // An old mtime keeps the cache entry out of the racy window
+    auto old_time = std::filesystem::last_write_time(path) - std::chrono::hours(1);
+    std::filesystem::last_write_time(path, old_time);
+    
+    DryRunResult dry_run = file_tool_->dry_run(path, "all:\n\techo hi\n");
+    EXPECT_TRUE(dry_run.success);
+    EXPECT_TRUE(dry_run.unchanged);
+    EXPECT_TRUE(dry_run.diff.empty());
+    
+    ApplyResult result = file_tool_->apply(path, "all:\n\techo hi\n");
+    EXPECT_TRUE(result.success);
+    EXPECT_TRUE(result.unchanged);
+    EXPECT_THAT(result.description, testing::HasSubstr("[UNCHANGED]"));
+    EXPECT_EQ(std::filesystem::last_write_time(path), old_time);
+    EXPECT_GE(file_tool_->content_hashes().hits(), 1u);
+    
+    // Same size, different bytes: written as usual
+    result = file_tool_->apply(path, "all:\n\techo ho\n");
+    EXPECT_TRUE(result.success);
+    EXPECT_FALSE(result.unchanged);
+    EXPECT_NE(std::filesystem::last_write_time(path), old_time);
+    
+    // Batches skip unchanged items too
+    BatchApplyResult batch = file_tool_->apply_batch({
+        WriteFileCommand{"WriteFile", path, "all:\n\techo ho\n"},
+        WriteFileCommand{"WriteFile", test_dir_ + "/other.txt", "x"}}, true);
+    ASSERT_TRUE(batch.success);
+    EXPECT_TRUE(batch.results[0].unchanged);
+    EXPECT_FALSE(batch.results[1].unchanged);
+}
+
+TEST(ContentHashCacheTest, ReadsOnlyWhenTheFileMayHaveChanged) {
+    std::string dir = "test_output_hash_cache";
+    std::filesystem::create_directories(dir);
+    std::string path = dir + "/a.txt";
+    std::ofstream(path) << "hello";
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) - std::chrono::hours(1));
+    
+    ContentHashCache cache;
+    EXPECT_FALSE(cache.matches(path, "hello world")); // size differs: no read
+    EXPECT_EQ(cache.reads(), 0u);
+    EXPECT_TRUE(cache.matches(path, "hello"));
+    EXPECT_FALSE(cache.matches(path, "jello"));
+    EXPECT_TRUE(cache.matches(path, "hello"));
+    EXPECT_EQ(cache.reads(), 1u);
+    EXPECT_EQ(cache.hits(), 2u);
+    
+    // A file renamed over the path is a different inode, so it is read again
+    std::ofstream(dir + "/b.txt") << "jello";
+    std::filesystem::rename(dir + "/b.txt", path);
+    EXPECT_TRUE(cache.matches(path, "jello"));
+    EXPECT_EQ(cache.reads(), 2u);
+    
+    // A fresh write is racy, so remember() keeps nothing for it
+    std::ofstream(path) << "hallo";
+    cache.remember(path, "hallo");
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.matches(path, "jello"));
+    EXPECT_EQ(cache.reads(), 3u);
+    
+    // Bytes that were already settled are trusted without a read
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) - std::chrono::hours(1));
+    cache.remember(path, "hallo");
+    EXPECT_TRUE(cache.matches(path, "hallo"));
+    EXPECT_EQ(cache.reads(), 3u);
+    EXPECT_FALSE(cache.matches(path, "/nonexistent/file"));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(FileOperationsTest, ParallelBatchWritesEveryFileAndSharesDirectories) {
+    FileTool parallel(false, 4);
+    ASSERT_EQ(parallel.io_threads(), 4u);
+    
+    std::vector<WriteFileCommand> commands;
+    for (int i = 0; i < 40; ++i) {
+        commands.push_back({"WriteFile", test_dir_ + "/pkg" + std::to_string(i % 3) + "/sub/f" + std::to_string(i) + ".txt",
+                            "file " + std::to_string(i) + "\n"});
+    }
+    BatchApplyResult batch = parallel.apply_batch(commands, true);
+    ASSERT_TRUE(batch.success) << batch.error_message;
+    for (int i = 0; i < 40; ++i) {
+        std::ifstream file(commands[i].path);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(content, commands[i].content);
+    }
+    
+    // A failing item still rolls every parallel-staged sibling back
+    commands[5].content = "changed\n";
+    commands[20].path = test_dir_ + "/pkg0";  // a directory
+    batch = parallel.apply_batch(commands, true);
+    EXPECT_FALSE(batch.success);
+    std::ifstream file(commands[5].path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, "file 5\n");
+}
+
+TEST_F(FileOperationsTest, ConcurrentWritesToOnePathEndWhole) {
+    FileTool shared(false, 1);
+    std::string path = test_dir_ + "/contended.txt";
+    std::atomic<int> failures{0};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 8; ++t) {
+        writers.emplace_back([&, t] {
+            for (int i = 0; i < 20; ++i) {
+                WriteFileCommand patch{"PatchFile", path,
+                    "<<<<<<< SEARCH\n=======\n" + std::string(100, static_cast<char>('a' + t)) + "\n>>>>>>> REPLACE\n"};
+                // Only the first writer finds an empty file; the rest fail cleanly
+                shared.apply(patch);
+                if (!shared.apply(path, std::string(1000, static_cast<char>('a' + t))).success) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    EXPECT_EQ(failures.load(), 0);
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(content.size(), 1000u);
+    EXPECT_EQ(content, std::string(1000, content[0]));
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(test_dir_), std::filesystem::directory_iterator()), 1);
+}
+
+TEST(PathLocksTest, SamePathWaitersRunInArrivalOrder) {
+    PathLocks locks;
+    std::mutex order_mutex;
+    std::vector<int> order;
+    
+    PathLocks::Guard first = locks.lock({"dir/a.txt"});
+    PathLocks::Guard unrelated = locks.lock({"dir/b.txt"}); // different path: no wait
+    
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 4; ++i) {
+        waiters.emplace_back([&, i] {
+            PathLocks::Guard guard = locks.lock({"./dir/../dir/a.txt", "dir/c.txt"});
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        });
+        // Let each waiter take its ticket before the next one starts
+        while (locks.queued("dir/a.txt") < static_cast<size_t>(i) + 2) {
+            std::this_thread::yield();
+        }
+    }
+    first.release();
+    for (auto& waiter : waiters) {
+        waiter.join();
+    }
+    EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3}));
+    unrelated.release();
+    EXPECT_EQ(locks.queued("dir/a.txt") + locks.queued("dir/b.txt") + locks.queued("dir/c.txt"), 0u);
+}
+
+TEST_F(FileOperationsTest, ReadsLineAndByteRangesFromTheMapping) {
+    std::string path = test_dir_ + "/lines.txt";
+    std::ofstream(path) << "one\ntwo\nthree\nfour";
+    
+    ReadFileRequest request;
+    request.path = path;
+    ReadFileResult whole = file_tool_->read(request);
+    ASSERT_TRUE(whole.success) << whole.error_message;
+    EXPECT_EQ(whole.content, "one\ntwo\nthree\nfour");
+    EXPECT_EQ(whole.file_size, 18u);
+    
+    request.first_line = 2;
+    request.last_line = 3;
+    FileSlice slice = file_tool_->read_slice(request);
+    ASSERT_TRUE(slice.result.success);
+    EXPECT_TRUE(slice.file->mapped());
+    EXPECT_TRUE(slice.copy); // small slices are copied out of the mapping
+    EXPECT_EQ(slice.content, "two\nthree\n");
+    EXPECT_EQ(slice.result.offset, 4u);
+    EXPECT_EQ(slice.result.last_line, 3u);
+    
+    request.first_line = 4;
+    request.last_line = 0; // to the end
+    EXPECT_EQ(file_tool_->read(request).content, "four");
+    request.first_line = 9;
+    ReadFileResult past_end = file_tool_->read(request);
+    EXPECT_TRUE(past_end.success);
+    EXPECT_TRUE(past_end.content.empty());
+    EXPECT_EQ(past_end.first_line, 0u);
+    request.first_line = 3;
+    request.last_line = 2;
+    EXPECT_FALSE(file_tool_->read(request).success);
+    
+    ReadFileRequest bytes;
+    bytes.path = path;
+    bytes.offset = 8;
+    bytes.length = 3;
+    EXPECT_EQ(file_tool_->read(bytes).content, "thr");
+    
+    // Replies stop at the limit, on a line boundary for line reads
+    std::string big_path = test_dir_ + "/big.txt";
+    std::string line(1000, 'y');
+    line += '\n';
+    {
+        std::ofstream big(big_path);
+        for (size_t i = 0; i < 2 * FileToolConfig::MAX_READ_BYTES / line.size(); ++i) {
+            big << line;
+        }
+    }
+    ReadFileRequest lines;
+    lines.path = big_path;
+    lines.first_line = 1;
+    ReadFileResult capped = file_tool_->read(lines);
+    EXPECT_TRUE(capped.truncated);
+    EXPECT_LE(capped.content.size(), FileToolConfig::MAX_READ_BYTES);
+    EXPECT_EQ(capped.content.size() % line.size(), 0u);
+    EXPECT_EQ(capped.last_line, capped.content.size() / line.size());
+    FileSlice large = file_tool_->read_slice(lines);
+    EXPECT_FALSE(large.copy);
+    EXPECT_EQ(large.content.size(), capped.content.size());
+    
+    EXPECT_FALSE(file_tool_->read(ReadFileRequest{test_dir_ + "/missing.txt"}).success);
+    EXPECT_FALSE(file_tool_->read(ReadFileRequest{test_dir_}).success);
+}
+
+TEST_F(FileOperationsTest, MappedFileNoticesTruncationUnderneathIt) {
+    std::string path = test_dir_ + "/shrinking.txt";
+    std::ofstream(path) << std::string(8192, 'z');
+    
+    MappedFile file(path);
+    ASSERT_TRUE(file.mapped());
+    EXPECT_TRUE(file.intact());
+    std::filesystem::resize_file(path, 100);
+    EXPECT_FALSE(file.intact());
+    // Read through the descriptor, never the lost pages
+    EXPECT_EQ(file.read_at(50, 4096), std::string(50, 'z'));
+    EXPECT_TRUE(file.read_at(4096, 10).empty());
+}
+
+TEST_F(FileOperationsTest, StatAndReadsFollowTheReadPolicy) {
+    std::string path = test_dir_ + "/notes.txt";
+    std::ofstream(path) << "hello";
+    
+    FileStatResult stat = file_tool_->stat(path);
+    ASSERT_TRUE(stat.success);
+    EXPECT_TRUE(stat.exists);
+    EXPECT_FALSE(stat.is_directory);
+    EXPECT_EQ(stat.size, 5u);
+    EXPECT_GT(stat.modified, 0);
+    FileStatResult missing = file_tool_->stat(test_dir_ + "/nope");
+    EXPECT_TRUE(missing.success);
+    EXPECT_FALSE(missing.exists);
+    
+    // The default policy only lets file_tool read under src/, tests/ and docs/
+    file_tool_->set_read_policy(std::make_shared<const PolicyChecker>());
+    ReadFileResult denied = file_tool_->read(ReadFileRequest{path});
+    EXPECT_FALSE(denied.success);
+    EXPECT_THAT(denied.error_message, testing::HasSubstr("Policy"));
+    EXPECT_FALSE(file_tool_->stat(path).success);
+}
+
+TEST_F(FileOperationsTest, ChunkedTransfersAssembleOutOfOrderChunks) {
+    std::string path = test_dir_ + "/assets/blob.bin";
+    std::string content(2 * FileTransferConfig::CHUNK_BYTES + 1234, '\0');
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>((i * 7919) >> 3);
+    }
+    uint64_t hash = Utils::hash64(content);
+    size_t chunk = FileTransferConfig::CHUNK_BYTES;
+    
+    EXPECT_FALSE(file_tool_->dry_run_digest(path, content.size(), hash).unchanged);
+    
+    FileTransferReply begun = file_tool_->begin_transfer(path, content.size(), hash);
+    ASSERT_TRUE(begun.success) << begun.error_message;
+    EXPECT_EQ(begun.chunk_size, chunk);
+    const std::string& id = begun.transfer_id;
+    
+    EXPECT_FALSE(file_tool_->write_chunk(id, 100, std::string_view(content).substr(100, chunk)).success);
+    EXPECT_FALSE(file_tool_->write_chunk(id, 0, std::string_view(content).substr(0, 10)).success);
+    for (size_t offset : {2 * chunk, size_t{0}, chunk}) {
+        FileTransferReply ack = file_tool_->write_chunk(id, offset, std::string_view(content).substr(offset, chunk));
+        ASSERT_TRUE(ack.success) << ack.error_message;
+    }
+    EXPECT_FALSE(std::filesystem::exists(path)); // nothing visible before the commit
+    
+    ApplyResult committed = file_tool_->commit_transfer(id);
+    ASSERT_TRUE(committed.success) << committed.error_message;
+    std::ifstream file(path, std::ios::binary);
+    std::string written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_TRUE(written == content);
+    EXPECT_EQ(file_tool_->active_transfers(), 0u);
+    EXPECT_FALSE(file_tool_->commit_transfer(id).success); // already used
+    
+    // The same content again is reported unchanged
+    EXPECT_TRUE(file_tool_->dry_run_digest(path, content.size(), hash).unchanged);
+    FileTransferReply again = file_tool_->begin_transfer(path, content.size(), hash);
+    for (size_t offset = 0; offset < content.size(); offset += chunk) {
+        file_tool_->write_chunk(again.transfer_id, offset, std::string_view(content).substr(offset, chunk));
+    }
+    EXPECT_TRUE(file_tool_->commit_transfer(again.transfer_id).unchanged);
+    
+    // Incomplete or mismatched transfers fail and leave no temp files behind
+    FileTransferReply partial = file_tool_->begin_transfer(path, content.size(), hash + 1);
+    file_tool_->write_chunk(partial.transfer_id, 0, std::string_view(content).substr(0, chunk));
+    EXPECT_FALSE(file_tool_->commit_transfer(partial.transfer_id).success);
+    FileTransferReply wrong = file_tool_->begin_transfer(path, content.size(), hash + 1);
+    for (size_t offset = 0; offset < content.size(); offset += chunk) {
+        file_tool_->write_chunk(wrong.transfer_id, offset, std::string_view(content).substr(offset, chunk));
+    }
+    ApplyResult mismatched = file_tool_->commit_transfer(wrong.transfer_id);
+    EXPECT_FALSE(mismatched.success);
+    EXPECT_THAT(mismatched.error_message, testing::HasSubstr("hash"));
+    FileTransferReply dropped = file_tool_->begin_transfer(path, 5, 0);
+    EXPECT_TRUE(file_tool_->abort_transfer(dropped.transfer_id));
+    
+    // An announced size beyond the policy limit is refused before anything is staged
+    uint64_t limit = GlobalPolicy().max_file_size_mb * 1024 * 1024;
+    FileTransferReply oversized = file_tool_->begin_transfer(path, limit + 1, 0);
+    EXPECT_FALSE(oversized.success);
+    EXPECT_THAT(oversized.error_message, testing::HasSubstr("exceeds the limit"));
+    EXPECT_FALSE(file_tool_->begin_transfer(path, UINT64_MAX, 0).success);
+    EXPECT_EQ(file_tool_->active_transfers(), 0u);
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(test_dir_ + "/assets"),
+                            std::filesystem::directory_iterator()), 1);
+}
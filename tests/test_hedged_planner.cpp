@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include "hedged_planner.h"
+#include "config.h"
+#include <atomic>
+#include <thread>
+
+using namespace mag;
+using namespace std::chrono_literals;
+
+namespace {
+
+WriteFileCommand make_plan(const std::string& path) {
+    WriteFileCommand command;
+    command.command = "WriteFile";
+    command.path = path;
+    return command;
+}
+
+// Sleeps in small steps so the attempt reacts to cancellation like an aborted transfer
+bool sleep_unless_cancelled(std::chrono::milliseconds duration, const CancellationToken& cancel) {
+    auto until = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < until) {
+        if (cancel.is_cancelled()) {
+            return false;
+        }
+        std::this_thread::sleep_for(5ms);
+    }
+    return true;
+}
+
+void warm_up(HedgedPlanner& planner, const std::string& provider, std::chrono::milliseconds latency) {
+    for (size_t i = 0; i < HedgeConfig::MIN_SAMPLES; ++i) {
+        planner.record_latency(provider, latency);
+    }
+}
+
+} // namespace
+
+TEST(CancellationTokenTest, CallbacksRunOnceAndCopiesShareState) {
+    CancellationToken token;
+    CancellationToken copy = token;
+    int calls = 0;
+    token.on_cancel([&calls] { ++calls; });
+    size_t removed = token.on_cancel([&calls] { calls += 100; });
+    token.remove_callback(removed);
+    
+    copy.cancel();
+    copy.cancel();
+    EXPECT_TRUE(token.is_cancelled());
+    EXPECT_EQ(calls, 1);
+    
+    token.on_cancel([&calls] { ++calls; }); // already cancelled: runs immediately
+    EXPECT_EQ(calls, 2);
+}
+
+TEST(LatencyTrackerTest, NearestRankPercentileOverWindow) {
+    LatencyTracker tracker(100);
+    EXPECT_FALSE(tracker.percentile(95).has_value());
+    for (int i = 1; i <= 100; ++i) {
+        tracker.record(std::chrono::milliseconds(i));
+    }
+    EXPECT_EQ(tracker.percentile(50)->count(), 50);
+    EXPECT_EQ(tracker.percentile(95)->count(), 95);
+    EXPECT_EQ(tracker.percentile(100)->count(), 100);
+    
+    // The window slides: old samples are overwritten
+    for (int i = 0; i < 100; ++i) {
+        tracker.record(1000ms);
+    }
+    EXPECT_EQ(tracker.sample_count(), 100u);
+    EXPECT_EQ(tracker.percentile(50)->count(), 1000);
+}
+
+TEST(HedgedPlannerTest, FastPrimaryIsNotHedged) {
+    std::atomic<int> calls{0};
+    HedgedPlanner planner({"primary", "secondary"},
+        [&calls](const std::string& provider, const std::string&, const CancellationToken&, ResponseMetadata*) {
+            ++calls;
+            return make_plan(provider);
+        }, 95, 2);
+    
+    HedgedPlanResult result = planner.plan("prompt");
+    EXPECT_EQ(result.provider, "primary");
+    EXPECT_FALSE(result.hedged);
+    EXPECT_EQ(calls.load(), 1);
+}
+
+TEST(HedgedPlannerTest, StalledPrimaryLosesToSecondaryAndIsCancelled) {
+    std::atomic<bool> primary_cancelled{false};
+    HedgedPlanner planner({"primary", "secondary"},
+        [&](const std::string& provider, const std::string&, const CancellationToken& cancel, ResponseMetadata*) {
+            if (provider == "primary") {
+                if (!sleep_unless_cancelled(5s, cancel)) {
+                    primary_cancelled = true;
+                    throw std::runtime_error("Request cancelled");
+                }
+            }
+            return make_plan(provider);
+        }, 95, 2);
+    warm_up(planner, "primary", 10ms);
+    EXPECT_EQ(planner.hedge_delay("primary").count(), HedgeConfig::MIN_DELAY_MS);
+    
+    auto begin = std::chrono::steady_clock::now();
+    HedgedPlanResult result = planner.plan("prompt");
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    
+    EXPECT_EQ(result.provider, "secondary");
+    EXPECT_TRUE(result.hedged);
+    EXPECT_TRUE(primary_cancelled.load());
+    EXPECT_LT(elapsed, 2s);
+}
+
+TEST(HedgedPlannerTest, CancelledLoserRecordsHowLongItWaited) {
+    HedgedPlanner planner({"primary", "secondary"},
+        [](const std::string& provider, const std::string&, const CancellationToken& cancel, ResponseMetadata*) {
+            if (!sleep_unless_cancelled(provider == "primary" ? 5s : 200ms, cancel)) {
+                throw std::runtime_error("Request cancelled");
+            }
+            return make_plan(provider);
+        }, 100, 2);
+    warm_up(planner, "primary", 300ms);
+    
+    HedgedPlanResult result = planner.plan("prompt");
+    EXPECT_EQ(result.provider, "secondary");
+    // Hedged at 300 ms, decided some 200 ms later: the primary waited at least that long
+    EXPECT_GE(planner.hedge_delay("primary"), 450ms);
+    EXPECT_LT(planner.hedge_delay("primary"), 5s);
+    
+    warm_up(planner, "secondary", 10ms);
+    EXPECT_GE(planner.hedge_delay("secondary"), 200ms); // the winner's own sample
+}
+
+TEST(HedgedPlannerTest, FailedPrimaryFailsOverImmediately) {
+    HedgedPlanner planner({"primary", "secondary"},
+        [](const std::string& provider, const std::string&, const CancellationToken&, ResponseMetadata*) {
+            if (provider == "primary") {
+                return WriteFileCommand{}; // parsed but empty: not a valid plan
+            }
+            return make_plan(provider);
+        }, 95, 2);
+    
+    auto begin = std::chrono::steady_clock::now();
+    HedgedPlanResult result = planner.plan("prompt");
+    EXPECT_EQ(result.provider, "secondary");
+    EXPECT_LT(std::chrono::steady_clock::now() - begin,
+              std::chrono::milliseconds(HedgeConfig::INITIAL_DELAY_MS));
+}
+
+TEST(HedgedPlannerTest, PrimaryOverrideAndTotalFailure) {
+    std::vector<std::string> asked;
+    std::mutex asked_mutex;
+    HedgedPlanner planner({"a", "b", "c"},
+        [&](const std::string& provider, const std::string&, const CancellationToken&, ResponseMetadata*)
+            -> WriteFileCommand {
+            std::lock_guard<std::mutex> lock(asked_mutex);
+            asked.push_back(provider);
+            throw std::runtime_error("unavailable");
+        }, 95, 2);
+    
+    EXPECT_THROW(planner.plan("prompt", "c"), std::runtime_error);
+    ASSERT_EQ(asked.size(), 2u); // capped by max_attempts
+    EXPECT_EQ(asked[0], "c");
+    EXPECT_EQ(asked[1], "a");
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "http_client.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace mag;
+
+class HttpClientTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        if (silent_fd_ >= 0) {
+            close(silent_fd_);
+        }
+    }
+
+    // A local port that accepts connections and never answers, so calls stay in flight
+    std::string silent_url() {
+        silent_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (silent_fd_ < 0 || bind(silent_fd_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+            listen(silent_fd_, 16) != 0 ||
+            getsockname(silent_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            ADD_FAILURE() << "cannot open a local listening socket";
+            return unreachable_url;
+        }
+        return "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/";
+    }
+
+    // Nothing listens on port 1, so requests fail fast without leaving the host
+    const std::string unreachable_url = "http://127.0.0.1:1/";
+    int silent_fd_ = -1;
+};
+
+TEST_F(HttpClientTest, PostReportsConnectionFailure) {
+    HttpClient client;
+    HttpResponse response = client.post(unreachable_url, "{}", {"Content-Type: application/json"});
+
+    EXPECT_FALSE(response.success);
+    EXPECT_FALSE(response.error_message.empty());
+}
+
+TEST_F(HttpClientTest, SubmitAllowsMultipleRequestsInFlight) {
+    HttpClient client;
+    std::vector<HttpCallHandle> calls;
+    for (int i = 0; i < 4; ++i) {
+        calls.push_back(client.submit(unreachable_url, "{}", {}));
+    }
+
+    for (auto& call : calls) {
+        HttpResponse response = call->wait();
+        EXPECT_TRUE(call->is_done());
+        EXPECT_FALSE(response.success);
+    }
+}
+
+TEST_F(HttpClientTest, ClientsShareOneTransport) {
+    std::string url = silent_url();
+    HttpTransport& transport = HttpTransport::instance();
+    size_t before = transport.in_flight();
+
+    HttpClient first;
+    HttpClient second;
+    HttpCallHandle first_call = first.submit(url, "{}", {});
+    HttpCallHandle second_call = second.submit(url, "{}", {});
+    // Both clients' calls are queued on the one process-wide transport
+    EXPECT_EQ(transport.in_flight(), before + 2);
+
+    first_call->cancel();
+    second_call->cancel();
+    first_call->wait();
+    second_call->wait();
+    EXPECT_EQ(transport.in_flight(), before);
+}
+
+TEST_F(HttpClientTest, CancelCompletesCall) {
+    HttpClient client;
+    HttpCallHandle call = client.submit(silent_url(), "{}", {});
+    // Never answered: only the cancel can complete it
+    EXPECT_FALSE(call->wait_for(std::chrono::milliseconds(100)));
+    call->cancel();
+
+    ASSERT_TRUE(call->wait_for(std::chrono::seconds(5)));
+    HttpResponse response = call->wait();
+    EXPECT_FALSE(response.success);
+    EXPECT_EQ(response.error_message, "Request cancelled");
+}
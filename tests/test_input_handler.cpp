@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "input_handler.h"
+#include <unistd.h>
+
+using namespace mag;
+
+namespace {
+
+// Only the default event-loop reading; everything else is a no-op
+class PolledInput : public InputHandler {
+public:
+    std::string get_line(const std::string&) override { return ""; }
+    void add_history(const std::string&) override {}
+    void save_history() override {}
+    void load_history() override {}
+    void setup_completion(const std::vector<std::string>&) override {}
+    bool supports_advanced_features() const override { return false; }
+};
+
+// Points stdin at a pipe for the length of a test
+class PipedStdin {
+public:
+    PipedStdin() {
+        saved_ = ::dup(STDIN_FILENO);
+        int fds[2];
+        EXPECT_EQ(::pipe(fds), 0);
+        ::dup2(fds[0], STDIN_FILENO);
+        ::close(fds[0]);
+        writer_ = fds[1];
+    }
+    
+    ~PipedStdin() {
+        close_writer();
+        ::dup2(saved_, STDIN_FILENO);
+        ::close(saved_);
+    }
+    
+    void type(const std::string& text) { EXPECT_EQ(::write(writer_, text.data(), text.size()), static_cast<ssize_t>(text.size())); }
+    
+    void close_writer() {
+        if (writer_ >= 0) {
+            ::close(writer_);
+            writer_ = -1;
+        }
+    }
+
+private:
+    int saved_;
+    int writer_;
+};
+
+} // anonymous namespace
+
+TEST(InputHandlerTest, WaitForLineReturnsLinesWakeupsAndEnd) {
+    PipedStdin input;
+    int wake[2];
+    ASSERT_EQ(::pipe(wake), 0);
+    PolledInput handler;
+    std::string line;
+    
+    // Type-ahead: two lines and part of a third arrive at once
+    input.type("/pause\r\nsecond\nthi");
+    ASSERT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::LINE);
+    EXPECT_EQ(line, "/pause");
+    ASSERT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::LINE);
+    EXPECT_EQ(line, "second");
+    
+    // A finished job wakes the loop without a complete line
+    ASSERT_EQ(::write(wake[1], "d", 1), 1);
+    EXPECT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::WOKEN);
+    char drained;
+    ASSERT_EQ(::read(wake[0], &drained, 1), 1);
+    
+    input.type("rd\n");
+    ASSERT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::LINE);
+    EXPECT_EQ(line, "third");
+    
+    input.type("last");
+    input.close_writer();
+    ASSERT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::LINE);
+    EXPECT_EQ(line, "last");
+    EXPECT_EQ(handler.wait_for_line("", wake[0], line), InputHandler::InputEvent::END);
+    
+    ::close(wake[0]);
+    ::close(wake[1]);
+}
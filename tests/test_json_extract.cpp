@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "json_extract.h"
+#include "providers/anthropic_provider.h"
+#include "providers/gemini_provider.h"
+#include "providers/openai_provider.h"
+#include <nlohmann/json.hpp>
+
+using namespace mag;
+
+TEST(JsonExtractTest, FindsNestedStringByPath) {
+    std::string doc = R"({"id":"x","choices":[{"index":0,"message":{"role":"assistant","content":"one"}},)"
+                      R"({"index":1,"message":{"content":"two"}}],"usage":{"total_tokens":5}})";
+    
+    EXPECT_EQ(extract_json_string(doc, {"choices", 0, "message", "content"}), "one");
+    EXPECT_EQ(extract_json_string(doc, {"choices", 1, "message", "content"}), "two");
+    EXPECT_EQ(extract_json_string(doc, {"id"}), "x");
+    EXPECT_FALSE(extract_json_string(doc, {"choices", 2, "message", "content"}).has_value());
+    EXPECT_FALSE(extract_json_string(doc, {"usage", "total_tokens"}).has_value());  // not a string
+    EXPECT_FALSE(extract_json_string(doc, {"missing"}).has_value());
+}
+
+TEST(JsonExtractTest, DecodesEscapesAndIgnoresLookalikeKeys) {
+    std::string doc = R"({"other":{"content":[{"text":"decoy"}]},"content":[{"type":"text","text":"a\"b\ncé"}]})";
+    EXPECT_EQ(extract_json_string(doc, {"content", 0, "text"}), "a\"b\nc\xc3\xa9");
+}
+
+TEST(JsonExtractTest, StopsAtTheValueAndReportsEarlierErrors) {
+    // Garbage after the target is never reached
+    EXPECT_EQ(extract_json_string(R"({"a":"found", garbage)", {"a"}), "found");
+    EXPECT_THROW(extract_json_string(R"({"a": tru, "b":"x"})", {"b"}), JsonExtractError);
+    EXPECT_THROW(extract_json_string("", {"a"}), JsonExtractError);
+}
+
+TEST(JsonExtractTest, ExtractsNamedMembersInOneWalk) {
+    std::string doc = R"({"id":"msg_1","content":[{"text":"{\"usage\":1}"}],"model":"m",)"
+                      R"("usage":{"input_tokens":10,"details":[1,{"cached":2}]},"stop":null})";
+    nlohmann::json members = extract_json_members(doc, {"id", "usage", "missing"});
+    EXPECT_EQ(members.size(), 2u);
+    EXPECT_EQ(members["id"], "msg_1");
+    EXPECT_EQ(members["usage"]["input_tokens"], 10);
+    EXPECT_EQ(members["usage"]["details"][1]["cached"], 2);
+    
+    // Parsing stops once every member is in, so trailing garbage is never reached
+    EXPECT_EQ(extract_json_members(R"({"a":{"b":[]}, garbage)", {"a"})["a"]["b"], nlohmann::json::array());
+    EXPECT_THROW(extract_json_members(R"({"a": tru, "b":1})", {"b"}), JsonExtractError);
+    EXPECT_TRUE(extract_json_members(R"(["id"])", {"id"}).empty());
+}
+
+TEST(JsonExtractTest, DecodesWriteFileCommandWithoutDom) {
+    WriteFileCommand command = decode_write_file_command(
+        R"({"command":"WriteFile","meta":{"path":"nested/ignored"},"path":"out.txt",)"
+        R"("content":"line1\nline2","request_execution":true})");
+    EXPECT_EQ(command.command, "WriteFile");
+    EXPECT_EQ(command.path, "out.txt");
+    EXPECT_EQ(command.content, "line1\nline2");
+    EXPECT_TRUE(command.request_execution);
+    
+    EXPECT_THROW(decode_write_file_command(R"({"command":"WriteFile","path":"a"})"), JsonExtractError);
+    EXPECT_THROW(decode_write_file_command(R"({"command":"WriteFile","path":7,"content":""})"), JsonExtractError);
+    EXPECT_THROW(decode_write_file_command(R"(["command"])"), JsonExtractError);
+    EXPECT_THROW(decode_write_file_command(R"({"command":"WriteFile",)"), JsonExtractError);
+}
+
+TEST(JsonExtractTest, ProvidersParseLargeContentThroughExtractor) {
+    std::string big(1 << 20, 'x');
+    nlohmann::json inner = {{"command", "WriteFile"}, {"path", "big.txt"}, {"content", big}};
+    
+    nlohmann::json anthropic_body = {{"content", {{{"type", "text"}, {"text", inner.dump()}}}}};
+    WriteFileCommand command = AnthropicProvider().parse_response(anthropic_body.dump());
+    EXPECT_EQ(command.path, "big.txt");
+    EXPECT_EQ(command.content.size(), big.size());
+    
+    nlohmann::json openai_body = {{"choices", {{{"message", {{"content", inner.dump()}}}}}}};
+    EXPECT_EQ(OpenAIProvider().parse_response(openai_body.dump()).content.size(), big.size());
+    
+    nlohmann::json gemini_body = {{"candidates", {{{"content", {{"parts", {{{"text",
+        "```json\n" + inner.dump() + "\n```"}}}}}}}}}};
+    EXPECT_EQ(GeminiProvider().parse_response(gemini_body.dump()).path, "big.txt");
+    
+    EXPECT_THROW(AnthropicProvider().parse_response(R"({"content":[]})"), std::runtime_error);
+    EXPECT_THROW(OpenAIProvider().parse_chat_response("not json"), std::runtime_error);
+}
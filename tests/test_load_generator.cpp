@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include "load_generator.h"
+#include "network/nng_req_client.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace mag;
+
+TEST(LoadGeneratorTest, ParsesWeightedMixes) {
+    auto mix = LoadGenerator::parse_mix("plan:2, dry_run:0.5,execute");
+    ASSERT_TRUE(mix);
+    ASSERT_EQ(mix->size(), 3u);
+    EXPECT_EQ((*mix)[0].operation, LoadOperation::PLAN);
+    EXPECT_DOUBLE_EQ((*mix)[0].weight, 2);
+    EXPECT_EQ((*mix)[1].operation, LoadOperation::DRY_RUN);
+    EXPECT_DOUBLE_EQ((*mix)[1].weight, 0.5);
+    EXPECT_DOUBLE_EQ((*mix)[2].weight, 1);
+
+    EXPECT_FALSE(LoadGenerator::parse_mix(""));
+    EXPECT_FALSE(LoadGenerator::parse_mix("plan,upload"));
+    EXPECT_FALSE(LoadGenerator::parse_mix("plan:zero"));
+    EXPECT_FALSE(LoadGenerator::parse_mix("plan:-1"));
+}
+
+TEST(LoadGeneratorTest, BuildsRequestsInEachServiceProtocol) {
+    LoadConfig config;
+    config.payload_bytes = 300;
+    config.file_count = 4;
+    LoadGenerator generator(config, nullptr);
+
+    nlohmann::json plan = WireCodec::decode(generator.build_request(LoadOperation::PLAN, 1).body());
+    EXPECT_EQ(plan["prompt"].get<std::string>().size(), 300u);
+    EXPECT_EQ(plan["provider"], "replay");
+    EXPECT_FALSE(plan.contains("chat_mode"));
+
+    nlohmann::json chat = WireCodec::decode(generator.build_request(LoadOperation::CHAT, 1).body());
+    EXPECT_TRUE(chat["chat_mode"].get<bool>());
+
+    nlohmann::json dry_run = WireCodec::decode(generator.build_request(LoadOperation::DRY_RUN, 6).body());
+    EXPECT_EQ(dry_run["operation"], "dry_run");
+    WriteFileCommand command;
+    command.from_json(dry_run["command"]);
+    EXPECT_EQ(command.path, "loadgen/load_2.txt"); // paths cycle through file_count
+    EXPECT_EQ(command.content.size(), 300u);
+
+    nlohmann::json stat = WireCodec::decode(generator.build_request(LoadOperation::STAT, 3).body());
+    EXPECT_EQ(stat["operation"], "stat");
+
+    nlohmann::json execute = WireCodec::decode(generator.build_request(LoadOperation::EXECUTE, 1).body());
+    EXPECT_EQ(execute["operation"], "execute");
+    EXPECT_EQ(execute["command"].get<std::string>().rfind("echo ", 0), 0u);
+
+    EXPECT_EQ(LoadGenerator::service_of(LoadOperation::CHAT), EndpointConfig::Service::LLM_ADAPTER);
+    EXPECT_EQ(LoadGenerator::service_of(LoadOperation::STAT), EndpointConfig::Service::FILE_TOOL);
+    EXPECT_EQ(LoadGenerator::service_of(LoadOperation::EXECUTE), EndpointConfig::Service::BASH_TOOL);
+}
+
+TEST(LoadGeneratorTest, ClosedLoopCountsOutcomesPerOperation) {
+    LoadConfig config;
+    config.concurrency = 4;
+    config.max_requests = 300;
+    config.mix = {{LoadOperation::PLAN, 1}, {LoadOperation::DRY_RUN, 1}, {LoadOperation::EXECUTE, 1}};
+
+    std::atomic<int> sent{0};
+    LoadGenerator generator(config, [&](EndpointConfig::Service service, NngMessage) {
+        ++sent;
+        switch (service) {
+            case EndpointConfig::Service::LLM_ADAPTER:
+                return NngMessage::encode({{"command", "WriteFile"}, {"path", "a.txt"}}, WireFormat::JSON);
+            case EndpointConfig::Service::FILE_TOOL:
+                return NngMessage::encode({{"success", false}, {"error_message", "denied"}}, WireFormat::JSON);
+            case EndpointConfig::Service::BASH_TOOL:
+                break;
+        }
+        throw RequestTimeoutError("bash tool did not answer");
+    });
+    generator.run();
+
+    EXPECT_EQ(sent.load(), 300);
+    nlohmann::json report = generator.report();
+    EXPECT_EQ(report["requests"], 300);
+    EXPECT_EQ(report["mode"], "closed");
+
+    const nlohmann::json& operations = report["operations"];
+    ASSERT_TRUE(operations.contains("plan"));
+    EXPECT_EQ(operations["plan"]["ok"], operations["plan"]["requests"]);
+    EXPECT_EQ(operations["dry_run"]["errors"], operations["dry_run"]["requests"]);
+    EXPECT_EQ(operations["execute"]["timeouts"], operations["execute"]["requests"]);
+    EXPECT_EQ(operations["dry_run"]["service"], "file_tool");
+    EXPECT_GT(operations["plan"]["requests"].get<int>(), 50); // the mix is roughly even
+    EXPECT_GE(report["p999_ms"].get<double>(), report["p50_ms"].get<double>());
+    EXPECT_NE(generator.summary().find("dry_run"), std::string::npos);
+}
+
+TEST(LoadGeneratorTest, OpenLoopMeasuresFromTheScheduledTime) {
+    LoadConfig config;
+    config.mode = LoadConfig::Mode::OPEN;
+    config.concurrency = 1;
+    config.rate = 200; // one every 5ms against a 20ms service
+    config.duration = std::chrono::milliseconds(300);
+    config.mix = {{LoadOperation::STAT, 1}};
+
+    LoadGenerator generator(config, [](EndpointConfig::Service, NngMessage) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return NngMessage::encode({{"success", true}}, WireFormat::JSON);
+    });
+    generator.run();
+
+    nlohmann::json report = generator.report();
+    EXPECT_EQ(report["mode"], "open");
+    // The backlog builds up: queued requests wait, and the rest are never sent
+    EXPECT_GT(report["unsent"].get<int>(), 0);
+    EXPECT_GT(report["p99_ms"].get<double>(), 60.0);
+    EXPECT_LT(report["requests"].get<int>(), 60);
+}
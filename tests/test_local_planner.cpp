@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include "local_planner.h"
+
+using namespace mag;
+
+TEST(LocalPlannerTest, ExplicitCommandsAreUsedAsWritten) {
+    LocalCommandPlanner planner;
+    
+    LocalPlan run = planner.plan("Run git status - Check the working tree");
+    EXPECT_TRUE(run.is_bash);
+    EXPECT_TRUE(run.confident());
+    EXPECT_EQ(run.command, "git status");
+    
+    LocalPlan quoted = planner.plan("Build the project - Use `cmake --build build -j4`");
+    EXPECT_TRUE(quoted.is_bash);
+    EXPECT_EQ(quoted.command, "cmake --build build -j4");
+    
+    LocalPlan bare = planner.plan("make test");
+    EXPECT_TRUE(bare.confident());
+    EXPECT_EQ(bare.command, "make test");
+    
+    LocalPlan script = planner.plan("./configure --prefix=/usr");
+    EXPECT_EQ(script.command, "./configure --prefix=/usr");
+}
+
+TEST(LocalPlannerTest, FileTodosAndProseAreNotCommands) {
+    LocalCommandPlanner planner;
+    
+    EXPECT_FALSE(planner.plan("Create hello world - Python script").is_bash);
+    EXPECT_FALSE(planner.plan("First task - Description of first task").is_bash);
+    EXPECT_FALSE(planner.plan("Add `make lint` to the Makefile").is_bash);
+    
+    // Prose after a command word still looks like shell work but has no command to use
+    LocalPlan find = planner.plan("Find the bug in the parser");
+    EXPECT_TRUE(find.is_bash);
+    EXPECT_FALSE(find.confident());
+    EXPECT_TRUE(find.command.empty());
+    
+    LocalPlan run = planner.plan("Run the unit tests");
+    EXPECT_TRUE(run.is_bash);
+    EXPECT_FALSE(run.confident());
+}
+
+TEST(LocalPlannerTest, ProseOpeningWithACommandWordIsNotRunAsWritten) {
+    LocalCommandPlanner planner;
+    
+    for (const char* title : {"Make install", "touch up README.md", "Cat facts page", "Go modules cleanup",
+                              "go modules cleanup", "cat facts page"}) {
+        LocalPlan plan = planner.plan(title);
+        EXPECT_FALSE(plan.confident() && !plan.command.empty()) << title << " -> " << plan.command;
+    }
+    EXPECT_FALSE(planner.plan("Cat facts page").is_bash); // as before the planner: a file todo
+    
+    LocalPlan make = planner.plan("make install");
+    EXPECT_TRUE(make.confident());
+    EXPECT_EQ(make.command, "make install");
+    EXPECT_EQ(planner.plan("ls -la src/").command, "ls -la src/");
+    EXPECT_EQ(planner.plan("git commit -m wip").command, "git commit -m wip");
+}
+
+TEST(LocalPlannerTest, PolicyCommandsAreKnown) {
+    EXPECT_FALSE(LocalCommandPlanner().plan("terraform plan").confident());
+    
+    LocalCommandPlanner planner({"terraform"}, 7);
+    EXPECT_EQ(planner.policy_version(), 7u);
+    LocalPlan plan = planner.plan("terraform plan");
+    EXPECT_TRUE(plan.confident());
+    EXPECT_EQ(plan.command, "terraform plan");
+}
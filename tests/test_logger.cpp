@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include "logger.h"
+#include "mpmc_queue.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace mag;
+
+class LoggerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Logger& logger = Logger::instance();
+        logger.configure("info");
+        logger.set_format(LogFormat::TEXT);
+        logger.set_sink([this](const std::string& line) { lines_.push_back(line); });
+    }
+    
+    void TearDown() override {
+        Logger& logger = Logger::instance();
+        logger.set_sink(nullptr);
+        logger.configure("info");
+    }
+    
+    // Only touched by the logger thread until flush() returns
+    std::vector<std::string> lines_;
+};
+
+TEST_F(LoggerTest, FiltersByLevelAndComponent) {
+    Logger& logger = Logger::instance();
+    logger.configure("warn,llm=debug,bash=off");
+    
+    EXPECT_TRUE(logger.enabled(LogLevel::DEBUG, "llm"));
+    EXPECT_FALSE(logger.enabled(LogLevel::TRACE, "llm"));
+    EXPECT_FALSE(logger.enabled(LogLevel::INFO, "orchestrator"));
+    EXPECT_TRUE(logger.enabled(LogLevel::ERROR, "orchestrator"));
+    EXPECT_FALSE(logger.enabled(LogLevel::ERROR, "bash"));
+    
+    EXPECT_THROW(logger.configure("loud"), std::runtime_error);
+}
+
+TEST_F(LoggerTest, DisabledMessagesAreNeverBuilt) {
+    int evaluated = 0;
+    auto expensive = [&evaluated]() { ++evaluated; return std::string("payload"); };
+    
+    MAG_LOG_DEBUG("llm", "dump " << expensive());
+    EXPECT_EQ(evaluated, 0);
+    
+    MAG_LOG_INFO("llm", "dump " << expensive());
+    EXPECT_EQ(evaluated, 1);
+}
+
+TEST_F(LoggerTest, BackgroundSinkReceivesFormattedRecords) {
+    MAG_LOG_INFO("file_tool", "first");
+    MAG_LOG_WARN("file_tool", "second " << 2);
+    Logger::instance().flush();
+    
+    ASSERT_EQ(lines_.size(), 2u);
+    EXPECT_NE(lines_[0].find("INFO  [file_tool] first"), std::string::npos);
+    EXPECT_NE(lines_[1].find("WARN  [file_tool] second 2"), std::string::npos);
+    
+    Logger::instance().set_format(LogFormat::JSON);
+    MAG_LOG_ERROR("llm", "quote \" inside");
+    Logger::instance().flush();
+    ASSERT_EQ(lines_.size(), 3u);
+    nlohmann::json record = nlohmann::json::parse(lines_[2]);
+    EXPECT_EQ(record["level"], "ERROR");
+    EXPECT_EQ(record["component"], "llm");
+    EXPECT_EQ(record["msg"], "quote \" inside");
+}
+
+TEST_F(LoggerTest, ConcurrentProducersAreAllWritten) {
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([t]() {
+            for (int i = 0; i < 500; ++i) {
+                MAG_LOG_INFO("load", t << ":" << i);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    Logger::instance().flush();
+    
+    // Anything over queue capacity is dropped and reported rather than blocking
+    size_t records = std::count_if(lines_.begin(), lines_.end(),
+                                   [](const std::string& line) { return line.find("[load]") != std::string::npos; });
+    EXPECT_EQ(records + Logger::instance().dropped(), 2000u);
+}
+
+TEST_F(LoggerTest, TruncatesLargePayloads) {
+    std::string payload(1000, 'x');
+    std::string shortened = Logger::truncate(payload, 10);
+    EXPECT_EQ(shortened, "xxxxxxxxxx...(990 more bytes)");
+    EXPECT_EQ(Logger::truncate("small", 10), "small");
+}
+
+TEST(MpmcQueueTest, PreservesEveryItemAcrossThreads) {
+    MpmcQueue<int> queue(1000);
+    EXPECT_EQ(queue.capacity(), 1024u);
+    
+    std::atomic<long> sum{0};
+    std::atomic<int> popped{0};
+    std::vector<std::thread> threads;
+    for (int p = 0; p < 2; ++p) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 1; i <= 5000; ++i) {
+                int value = i + p * 5000;
+                while (!queue.try_push(std::move(value))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < 2; ++c) {
+        threads.emplace_back([&]() {
+            int value;
+            while (popped.load() < 10000) {
+                if (queue.try_pop(value)) {
+                    sum += value;
+                    ++popped;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(sum.load(), 10000L * 10001 / 2);
+    EXPECT_TRUE(queue.empty());
+}
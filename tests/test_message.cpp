@@ -52,4 +52,132 @@ TEST_F(MessageTest, ApplyResultSerialization) {
     EXPECT_EQ(result.description, deserialized.description);
     EXPECT_EQ(result.success, deserialized.success);
     EXPECT_EQ(result.error_message, deserialized.error_message);
-}
\ No newline at end of file
+}
+
+TEST_F(MessageTest, BinaryWireFormatsCarryRawBytes) {
+    WriteFileCommand cmd;
+    cmd.command = "WriteFile";
+    cmd.path = "data.bin";
+    cmd.content = std::string("quote \" newline \n nul ", 22) + '\0' + "\xff\xfe not utf-8";
+    
+    for (WireFormat format : {WireFormat::MSGPACK, WireFormat::CBOR}) {
+        std::string wire = MessageHandler::serialize_command(cmd, format);
+        EXPECT_EQ(WireCodec::detect(wire), format);
+        // Content is stored verbatim, not escaped or re-encoded
+        EXPECT_NE(wire.find(cmd.content), std::string::npos);
+        
+        WriteFileCommand decoded = MessageHandler::deserialize_command(wire);
+        EXPECT_EQ(decoded.content, cmd.content);
+        EXPECT_EQ(decoded.path, cmd.path);
+        
+        nlohmann::json request = WireCodec::decode(MessageHandler::serialize_file_request("apply", cmd, format));
+        EXPECT_EQ(request["operation"], "apply");
+        EXPECT_EQ(WireCodec::get_bytes(request["command"], "content"), cmd.content);
+    }
+}
+
+TEST_F(MessageTest, ApplyResultOutputRoundTripsInEveryFormat) {
+    ApplyResult result;
+    result.description = "ran";
+    result.success = true;
+    result.error_message = "";
+    result.execution_context.command_output = "line 1\nline 2\t\x01";
+    result.execution_context.command_stderr = "warning";
+    result.execution_context.exit_code = 3;
+    
+    for (WireFormat format : {WireFormat::JSON, WireFormat::MSGPACK, WireFormat::CBOR}) {
+        ApplyResult decoded = MessageHandler::deserialize_apply_result(
+            MessageHandler::serialize_apply_result(result, format));
+        EXPECT_EQ(decoded.execution_context.command_output, result.execution_context.command_output)
+            << WireCodec::format_name(format);
+        EXPECT_EQ(decoded.execution_context.command_stderr, "warning");
+        EXPECT_EQ(decoded.execution_context.exit_code, 3);
+    }
+}
+
+TEST_F(MessageTest, TextIsNeverMistakenForBinary) {
+    EXPECT_EQ(WireCodec::detect("{\"prompt\":\"hi\"}"), WireFormat::JSON);
+    EXPECT_EQ(WireCodec::detect("create a hello world script"), WireFormat::JSON);
+    EXPECT_EQ(WireCodec::detect("\xc3\xa9" "crire un script"), WireFormat::JSON);
+    EXPECT_EQ(WireCodec::detect(""), WireFormat::JSON);
+    EXPECT_EQ(WireCodec::parse_format("cbor"), WireFormat::CBOR);
+    EXPECT_EQ(WireCodec::parse_format("bogus"), WireFormat::JSON);
+}
+
+TEST_F(MessageTest, FileBatchesRoundTripInEveryFormat) {
+    std::vector<WriteFileCommand> commands(2);
+    commands[0] = {"WriteFile", "a.txt", "alpha"};
+    commands[1] = {"WriteFile", "b.txt", "beta"};
+    
+    BatchApplyResult result;
+    result.success = false;
+    result.rolled_back = true;
+    result.error_message = "disk full";
+    result.results.resize(2);
+    result.results[0].success = false;
+    result.results[0].execution_context.command_output = "out\x01";
+    result.results[1].success = false;
+    result.results[1].error_message = "disk full";
+    
+    for (WireFormat format : {WireFormat::JSON, WireFormat::MSGPACK, WireFormat::CBOR}) {
+        nlohmann::json request = WireCodec::decode(
+            MessageHandler::serialize_file_batch_request("apply_batch", commands, true, format));
+        EXPECT_EQ(request["operation"], "apply_batch");
+        EXPECT_TRUE(request["all_or_nothing"].get<bool>());
+        ASSERT_EQ(request["commands"].size(), 2u);
+        WriteFileCommand second;
+        second.from_json(request["commands"][1]);
+        EXPECT_EQ(second.content, "beta");
+        
+        BatchApplyResult decoded = MessageHandler::deserialize_batch_apply_result(
+            MessageHandler::serialize_batch_apply_result(result, format));
+        EXPECT_TRUE(decoded.rolled_back) << WireCodec::format_name(format);
+        ASSERT_EQ(decoded.results.size(), 2u);
+        EXPECT_EQ(decoded.results[0].execution_context.command_output, "out\x01");
+        EXPECT_EQ(decoded.results[1].error_message, "disk full");
+    }
+}
+
+namespace {
+
+struct StringSink : WireSink {
+    std::string data;
+    void write(const char* bytes, size_t size) override { data.append(bytes, size); }
+};
+
+} // anonymous namespace
+
+TEST_F(MessageTest, ReadResultsCarrySlicesAppendedOutsideTheDom) {
+    ReadFileResult result;
+    result.success = true;
+    result.offset = 7;
+    result.file_size = 90000;
+    result.first_line = 2;
+    result.last_line = 4;
+    result.truncated = true;
+    
+    for (WireFormat format : {WireFormat::JSON, WireFormat::MSGPACK, WireFormat::CBOR}) {
+        // Cover every length header: immediate, 1, 2 and 4 bytes
+        for (size_t size : {size_t{5}, size_t{200}, size_t{3000}, size_t{70000}}) {
+            std::string content(size, 'x');
+            if (format != WireFormat::JSON) {
+                content[1] = '\0';
+            }
+            StringSink sink;
+            MessageHandler::serialize_read_result(result, content, format, sink);
+            EXPECT_EQ(WireCodec::detect(sink.data), format);
+            
+            ReadFileResult decoded = MessageHandler::deserialize_read_result(sink.data);
+            EXPECT_TRUE(decoded.success);
+            EXPECT_EQ(decoded.content, content) << WireCodec::format_name(format) << " " << size;
+            EXPECT_EQ(decoded.offset, 7u);
+            EXPECT_EQ(decoded.file_size, 90000u);
+            EXPECT_EQ(decoded.last_line, 4u);
+            EXPECT_TRUE(decoded.truncated);
+        }
+    }
+    
+    StringSink sink;
+    EXPECT_THROW(WireCodec::encode_with_bytes({{"content", 1}}, "content", "x", WireFormat::MSGPACK, sink),
+                 std::invalid_argument);
+}
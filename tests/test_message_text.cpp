@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "message_text.h"
+#include "llm_provider.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mag;
+
+TEST(MessageTextTest, InternedStringsShareOneCopy) {
+    InternedString a("anthropic");
+    InternedString b(std::string("anthropic"));
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_EQ(a, "anthropic");
+    EXPECT_FALSE(a == InternedString("openai"));
+
+    InternedString empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_EQ(empty, InternedString(""));
+}
+
+TEST(MessageTextTest, ArenaPacksTextsIntoSharedBlocks) {
+    TextArena arena;
+    MessageText first = arena.store("hello");
+    MessageText second = arena.store("world");
+    EXPECT_EQ(first, "hello");
+    EXPECT_EQ(second, "world");
+    EXPECT_TRUE(first.shares_block_with(second));
+    EXPECT_EQ(first.block_capacity(), TextArena::BLOCK_SIZE);
+
+    // Large texts get their own block, sized to fit
+    std::string big(TextArena::LARGE_TEXT + 1, 'x');
+    MessageText large = arena.store(big);
+    EXPECT_FALSE(large.shares_block_with(first));
+    EXPECT_EQ(large.block_capacity(), big.size());
+
+    // A full block is left to its texts and a new one started
+    std::string chunk(TextArena::LARGE_TEXT, 'y');
+    MessageText last;
+    for (size_t i = 0; i < TextArena::BLOCK_SIZE / chunk.size() + 1; ++i) {
+        last = arena.store(chunk);
+    }
+    EXPECT_FALSE(last.shares_block_with(first));
+    EXPECT_EQ(first, "hello");
+
+    // Only texts built on their own are copied in
+    MessageText standalone("standalone");
+    EXPECT_EQ(standalone.block_capacity(), standalone.size());
+    MessageText adopted = arena.adopt(standalone);
+    EXPECT_TRUE(adopted.shares_block_with(last));
+    EXPECT_TRUE(arena.adopt(first).shares_block_with(first));
+}
+
+TEST(MessageTextTest, TextsOutliveTheArena) {
+    MessageText kept;
+    {
+        TextArena arena;
+        arena.store("dropped");
+        kept = arena.store("kept");
+    }
+    std::thread reader([copy = kept]() { EXPECT_EQ(copy, "kept"); });
+    reader.join();
+    EXPECT_EQ(kept.str(), "kept");
+
+    MessageText moved = std::move(kept);
+    EXPECT_TRUE(kept.empty());
+    EXPECT_EQ(moved, "kept");
+}
+
+TEST(MessageTextTest, MessagesAreCompactAndKeepTheirTimestamps) {
+    // Two interned pointers, a text handle and three integers
+    EXPECT_LE(sizeof(ConversationMessage), 56u);
+
+    ConversationMessage message("assistant", "hi", "openai");
+    message.timestamp_ms = 1700000000123;
+    EXPECT_EQ(message.timestamp(), "2023-11-14T22:13:20.123Z");
+
+    nlohmann::json j = message.to_json();
+    EXPECT_EQ(j["timestamp"], "2023-11-14T22:13:20.123Z");
+    ConversationMessage restored = ConversationMessage::from_json(j);
+    EXPECT_EQ(restored.timestamp_ms, message.timestamp_ms);
+    EXPECT_EQ(restored.role, "assistant");
+    EXPECT_EQ(restored.provider, "openai");
+    EXPECT_EQ(restored.content, "hi");
+
+    EXPECT_EQ(ConversationMessage::parse_timestamp("2023-11-14T22:13:20Z"), 1700000000000);
+    EXPECT_FALSE(ConversationMessage::parse_timestamp("yesterday"));
+    EXPECT_FALSE(ConversationMessage::parse_timestamp("2023-02-30T00:00:00Z"));
+}
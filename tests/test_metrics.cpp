@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include "metrics.h"
+#include "metrics_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace mag;
+
+namespace {
+
+// Plain GET against the loopback metrics server; empty if it cannot connect
+std::string http_get(int port, const std::string& path) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return "";
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return "";
+    }
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return response;
+}
+
+} // anonymous namespace
+
+TEST(MetricsTest, HistogramPercentilesStayWithinBucketResolution) {
+    for (uint64_t v : {uint64_t{0}, uint64_t{31}, uint64_t{32}, uint64_t{1000}, uint64_t{123456789}}) {
+        size_t index = LatencyHistogram::bucket_index(v);
+        EXPECT_LE(LatencyHistogram::bucket_lower_bound(index), v);
+        EXPECT_GE(LatencyHistogram::bucket_upper_bound(index), v);
+        EXPECT_EQ(LatencyHistogram::bucket_index(LatencyHistogram::bucket_upper_bound(index) + 1), index + 1);
+    }
+    EXPECT_EQ(LatencyHistogram::bucket_index(LatencyHistogram::MAX_MICROS * 4), LatencyHistogram::BUCKET_COUNT - 1);
+    
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile_micros(0.99), 0u);
+    for (uint64_t micros = 1; micros <= 100000; ++micros) {
+        histogram.record_micros(micros);
+    }
+    EXPECT_EQ(histogram.count(), 100000u);
+    EXPECT_EQ(histogram.max_micros(), 100000u);
+    EXPECT_EQ(histogram.sum_micros(), uint64_t{100000} * 100001 / 2);
+    
+    // One bucket spans at most 1/32 of its values
+    EXPECT_NEAR(static_cast<double>(histogram.percentile_micros(0.5)), 50000.0, 50000.0 / 32);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile_micros(0.99)), 99000.0, 99000.0 / 32);
+    EXPECT_EQ(histogram.percentile_micros(1.0), 100000u);
+    EXPECT_EQ(histogram.count_at_or_below(31), 31u);
+}
+
+TEST(MetricsTest, PrometheusExportHasCumulativeBuckets) {
+    MetricsRegistry registry;
+    registry.counter("mag_test_total", {{"path", "a\"b"}}, "Test counter").add(3);
+    registry.gauge("mag_test_depth").set(-2);
+    LatencyHistogram& histogram = registry.histogram("mag_test_seconds", {{"operation", "apply"}}, "Test latency");
+    histogram.record(std::chrono::microseconds(300));
+    histogram.record(std::chrono::milliseconds(2));
+    histogram.record(std::chrono::seconds(2));
+    EXPECT_EQ(&histogram, &registry.histogram("mag_test_seconds", {{"operation", "apply"}}));
+    
+    std::string text = registry.to_prometheus();
+    EXPECT_NE(text.find("# HELP mag_test_total Test counter\n# TYPE mag_test_total counter\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_total{path=\"a\\\"b\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_depth -2\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE mag_test_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_seconds_bucket{operation=\"apply\",le=\"0.0005\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_seconds_bucket{operation=\"apply\",le=\"0.005\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_seconds_bucket{operation=\"apply\",le=\"2.5\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_seconds_bucket{operation=\"apply\",le=\"+Inf\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("mag_test_seconds_count{operation=\"apply\"} 3\n"), std::string::npos);
+    
+    nlohmann::json snapshot = registry.to_json();
+    ASSERT_EQ(snapshot["histograms"].size(), 1u);
+    EXPECT_EQ(snapshot["histograms"][0]["count"], 3);
+    EXPECT_EQ(snapshot["histograms"][0]["labels"]["operation"], "apply");
+    EXPECT_EQ(snapshot["counters"][0]["value"], 3);
+}
+
+TEST(MetricsTest, UpdatesAreExactUnderConcurrency) {
+    MetricsRegistry registry;
+    ServiceMetrics service("test_service", registry);
+    constexpr int THREADS = 8;
+    constexpr int PER_THREAD = 5000;
+    
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < PER_THREAD; ++i) {
+                ServiceMetrics::RequestScope scope(service, 10);
+                scope.set_operation("apply");
+                scope.add_reply_bytes(1);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    EXPECT_EQ(registry.histogram("mag_request_seconds", {{"service", "test_service"}, {"operation", "apply"}}).count(),
+              static_cast<uint64_t>(THREADS * PER_THREAD));
+    EXPECT_EQ(registry.counter("mag_request_bytes_total", {{"service", "test_service"}, {"direction", "in"}}).value(),
+              static_cast<uint64_t>(THREADS * PER_THREAD * 10));
+    EXPECT_EQ(service.in_flight().value(), 0);
+}
+
+TEST(MetricsTest, ServerAnswersOnlyTheMetricsPath) {
+    std::unique_ptr<MetricsServer> server;
+    try {
+        server = std::make_unique<MetricsServer>(0);
+    } catch (const std::exception& e) {
+        GTEST_SKIP() << "No loopback TCP: " << e.what();
+    }
+    MetricsRegistry::instance().counter("mag_test_scrapes_total").add();
+    
+    std::string response = http_get(server->port(), "/metrics");
+    if (response.empty()) {
+        GTEST_SKIP() << "Cannot connect over loopback";
+    }
+    EXPECT_EQ(response.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    EXPECT_NE(response.find("text/plain; version=0.0.4"), std::string::npos);
+    EXPECT_NE(response.find("mag_test_scrapes_total 1\n"), std::string::npos);
+    
+    EXPECT_EQ(http_get(server->port(), "/").rfind("HTTP/1.1 404", 0), 0u);
+}
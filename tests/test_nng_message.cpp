@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+#include "network/nng_message.h"
+#include <string>
+
+using namespace mag;
+
+TEST(NngMessageTest, EncodesTheSameBytesAsTheStringApi) {
+    WriteFileCommand cmd;
+    cmd.command = "WriteFile";
+    cmd.path = "src/data.txt";
+    cmd.content = "line\n" + std::string(10000, 'x'); // larger than the sink buffer
+    
+    for (WireFormat format : {WireFormat::JSON, WireFormat::MSGPACK, WireFormat::CBOR}) {
+        NngMessage msg;
+        MessageHandler::serialize_file_request("dry_run", cmd, format, msg);
+        EXPECT_EQ(msg.body(), MessageHandler::serialize_file_request("dry_run", cmd, format))
+            << WireCodec::format_name(format);
+        
+        nlohmann::json decoded = WireCodec::decode(msg.body());
+        EXPECT_EQ(decoded["operation"], "dry_run");
+        
+        nlohmann::json reply = {{"success", true}, {"output", "done"}};
+        EXPECT_EQ(NngMessage::encode(reply, format).body(), WireCodec::encode(reply, format));
+    }
+}
+
+TEST(NngMessageTest, OwnershipMovesWithTheHandle) {
+    NngMessage first = NngMessage::copy_of("payload");
+    ASSERT_NE(first.get(), nullptr);
+    
+    NngMessage second = std::move(first);
+    EXPECT_EQ(first.get(), nullptr);
+    EXPECT_TRUE(first.empty());
+    EXPECT_EQ(second.body(), "payload");
+    
+    second.write("+more", 5);
+    EXPECT_EQ(second.body(), "payload+more");
+    EXPECT_EQ(second.size(), 12u);
+}
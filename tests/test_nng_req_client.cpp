@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include "network/nng_req_client.h"
+#include "network/nng_rep_server.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mag {
+
+// Echo service over inproc; a request starting with "slow" is answered after 500ms
+class NNGReqClientTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool_ = std::make_unique<ThreadPool>(4);
+        server_ = std::make_unique<NNGRepServer>(url_, 4, *pool_, [](size_t, std::string_view request) {
+            if (request.substr(0, 4) == "slow") {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            }
+            return NngMessage::copy_of("echo:" + std::string(request));
+        });
+        try {
+            server_->start();
+        } catch (const std::exception& e) {
+            GTEST_SKIP() << "NNG transport unavailable: " << e.what();
+        }
+    }
+    
+    void TearDown() override {
+        server_.reset();
+        pool_.reset();
+    }
+    
+    std::string url_ = "inproc://mag-req-client-test";
+    std::unique_ptr<ThreadPool> pool_;
+    std::unique_ptr<NNGRepServer> server_;
+};
+
+TEST_F(NNGReqClientTest, PipelinedRequestsAreAnsweredIndependently) {
+    NNGReqClient client(url_, "echo", std::chrono::milliseconds(5000));
+    
+    auto slow = client.request_async("slow one");
+    auto fast = client.request_async("fast one");
+    
+    // The fast reply does not queue behind the slow one
+    ASSERT_EQ(fast.wait_for(std::chrono::milliseconds(400)), std::future_status::ready);
+    EXPECT_EQ(fast.get(), "echo:fast one");
+    EXPECT_EQ(slow.get(), "echo:slow one");
+    EXPECT_EQ(client.in_flight(), 0u);
+}
+
+TEST_F(NNGReqClientTest, DeadlineAndCancellationEndTheWait) {
+    NNGReqClient client(url_, "echo", std::chrono::milliseconds(100));
+    EXPECT_THROW(client.request("slow timeout"), RequestTimeoutError);
+    
+    CancellationToken cancel;
+    auto pending = client.request_async("slow cancelled", std::chrono::milliseconds(5000), &cancel);
+    cancel.cancel();
+    EXPECT_THROW(pending.get(), RequestCancelledError);
+    
+    // An already cancelled token never reaches the wire
+    EXPECT_THROW(client.request("fast", std::chrono::milliseconds(0), &cancel), RequestCancelledError);
+    EXPECT_EQ(client.request("fast", std::chrono::milliseconds(5000)), "echo:fast");
+}
+
+TEST(NNGRepServerTest, DeferredRepliesHoldNoWorker) {
+    ThreadPool pool(1);
+    std::mutex mutex;
+    std::shared_ptr<NNGRepServer::DeferredReply> parked;
+    std::string url = "inproc://mag-rep-deferred-test";
+    NNGRepServer server(url, 4, pool, [](size_t, std::string_view request) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        return NngMessage::copy_of("echo:" + std::string(request));
+    });
+    server.set_deferrer([&](std::string_view request, const std::shared_ptr<NNGRepServer::DeferredReply>& reply) {
+        NNGRepServer::Deferral deferral;
+        deferral.taken = request == "wait" || request == "idle";
+        deferral.timeout = std::chrono::milliseconds(request == "wait" ? 5000 : 50);
+        deferral.on_timeout = [] { return NngMessage::copy_of("expired"); };
+        if (request == "wait") {
+            std::lock_guard<std::mutex> lock(mutex);
+            parked = reply;
+        }
+        return deferral;
+    });
+    try {
+        server.start();
+    } catch (const std::exception& e) {
+        GTEST_SKIP() << "NNG transport unavailable: " << e.what();
+    }
+    
+    NNGReqClient client(url, "deferred", std::chrono::milliseconds(5000));
+    auto waiting = client.request_async("wait");
+    auto slow = client.request_async("slow"); // the only worker is busy from here on
+    std::shared_ptr<NNGRepServer::DeferredReply> reply;
+    for (int i = 0; i < 100 && !reply; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::lock_guard<std::mutex> lock(mutex);
+        reply = parked;
+    }
+    ASSERT_TRUE(reply);
+    
+    EXPECT_TRUE(reply->complete(NngMessage::copy_of("woken")));
+    EXPECT_FALSE(reply->complete(NngMessage::copy_of("again")));
+    ASSERT_EQ(waiting.wait_for(std::chrono::milliseconds(300)), std::future_status::ready);
+    EXPECT_EQ(waiting.get(), "woken");
+    
+    EXPECT_EQ(client.request("idle"), "expired");
+    EXPECT_EQ(slow.get(), "echo:slow");
+}
+
+} // namespace mag
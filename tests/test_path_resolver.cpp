@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include "path_resolver.h"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace mag;
+
+class PathResolverTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        original_cwd_ = std::filesystem::current_path();
+        base_ = std::filesystem::canonical(std::filesystem::temp_directory_path()) /
+                ("mag_path_resolver_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(base_ / "repo" / "src" / "deep");
+        std::filesystem::create_directories(base_ / "repo2");
+        std::filesystem::create_directories(base_ / "outside");
+        std::ofstream(base_ / "repo" / "src" / "deep" / "a.cpp") << "int a;\n";
+        std::filesystem::current_path(base_ / "repo");
+    }
+    
+    void TearDown() override {
+        std::filesystem::current_path(original_cwd_);
+        std::filesystem::remove_all(base_);
+    }
+    
+    std::filesystem::path original_cwd_;
+    std::filesystem::path base_;
+    PathResolver resolver_;
+};
+
+TEST_F(PathResolverTest, ComparesWholeComponents) {
+    EXPECT_TRUE(PathResolver::is_within("/repo", "/repo"));
+    EXPECT_TRUE(PathResolver::is_within("/repo/src/a.cpp", "/repo"));
+    EXPECT_TRUE(PathResolver::is_within("/repo/src", "/repo/"));
+    EXPECT_TRUE(PathResolver::is_within("/anything", "/"));
+    EXPECT_FALSE(PathResolver::is_within("/repo2/a.cpp", "/repo"));
+    EXPECT_FALSE(PathResolver::is_within("/re", "/repo"));
+    
+    std::string sibling = (base_ / "repo2" / "a.cpp").string();
+    EXPECT_FALSE(resolver_.is_within_cwd(sibling));
+}
+
+TEST_F(PathResolverTest, CachesDirectoriesUntilTheyChange) {
+    EXPECT_TRUE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    EXPECT_EQ(resolver_.misses(), 1u);
+    EXPECT_TRUE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    EXPECT_TRUE(resolver_.is_within_cwd("./src//deep/new.cpp"));
+    EXPECT_TRUE(resolver_.is_within_cwd((base_ / "repo" / "src" / "deep" / "b.cpp").string()));
+    EXPECT_EQ(resolver_.hits(), 3u);
+    EXPECT_EQ(resolver_.misses(), 1u);
+    
+    EXPECT_TRUE(resolver_.is_within_cwd("a.cpp"));
+    EXPECT_TRUE(resolver_.is_within_cwd("."));
+    EXPECT_TRUE(resolver_.is_within_cwd("src/new_dir/x.cpp")); // not there yet
+    EXPECT_FALSE(resolver_.is_within_cwd("../outside/x"));
+    EXPECT_FALSE(resolver_.is_within_cwd("src/../../outside/x"));
+    EXPECT_FALSE(resolver_.is_within_cwd("/etc/passwd"));
+    
+    // Moving a level out and leaving a symlink in its place is noticed
+    std::filesystem::rename(base_ / "repo" / "src", base_ / "outside" / "src");
+    std::filesystem::create_directory_symlink(base_ / "outside" / "src", base_ / "repo" / "src");
+    EXPECT_FALSE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    
+    // So is a symlink as the last component
+    std::filesystem::create_symlink(base_ / "outside", base_ / "repo" / "escape");
+    EXPECT_FALSE(resolver_.is_within_cwd("escape"));
+}
+
+TEST_F(PathResolverTest, KeepsTheSnapshotWhenFilesAreAddedToTheWorkingDirectory) {
+    EXPECT_TRUE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    EXPECT_EQ(resolver_.misses(), 1u);
+    
+    std::ofstream(base_ / "repo" / "sibling.txt") << "x";
+    EXPECT_TRUE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    EXPECT_EQ(resolver_.size(), 1u);
+    EXPECT_EQ(resolver_.hits(), 1u);
+    EXPECT_EQ(resolver_.misses(), 1u);
+}
+
+TEST_F(PathResolverTest, FollowsTheWorkingDirectory) {
+    EXPECT_TRUE(resolver_.is_within_cwd("src/deep/a.cpp"));
+    EXPECT_EQ(resolver_.size(), 1u);
+    EXPECT_EQ(resolver_.cwd(), (base_ / "repo").string());
+    
+    std::filesystem::current_path(base_ / "repo2");
+    EXPECT_EQ(resolver_.cwd(), (base_ / "repo2").string());
+    EXPECT_EQ(resolver_.size(), 0u);
+    EXPECT_FALSE(resolver_.is_within_cwd((base_ / "repo" / "src" / "deep" / "a.cpp").string()));
+    EXPECT_TRUE(resolver_.is_within_cwd("notes/todo.md"));
+}
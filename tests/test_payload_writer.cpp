@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "json_writer.h"
+#include "history_buffer.h"
+#include "llm_provider.h"
+#include <nlohmann/json.hpp>
+
+using namespace mag;
+
+namespace {
+
+std::vector<ConversationMessage> tricky_history() {
+    return {
+        ConversationMessage("system", "[Summary]\nearlier \"turns\""),
+        ConversationMessage("user", "tab\there, quote \" backslash \\ and \x01 control"),
+        ConversationMessage("assistant", "unicode: h\xC3\xA9llo \xE2\x9C\x93 / slash", "openai"),
+        ConversationMessage("user", std::string(5000, 'x') + "\r\n"),
+        ConversationMessage("tool", "unknown role"),
+        ConversationMessage("assistant", ""),
+        ConversationMessage("assistant", "two in a row")
+    };
+}
+
+} // anonymous namespace
+
+TEST(JsonWriterTest, MatchesNlohmannDump) {
+    std::string out;
+    JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("a").value(1000);
+    writer.key("b").begin_array().value(true).value(0.1).value(2.0).value("s\"\n\x1f").end_array();
+    writer.key("c").begin_object().end_object();
+    writer.key("d").begin_string().append_string("x").append_string("\t").end_string();
+    writer.end_object();
+    
+    nlohmann::json expected = {
+        {"a", 1000},
+        {"b", {true, 0.1, 2.0, "s\"\n\x1f"}},
+        {"c", nlohmann::json::object()},
+        {"d", "x\t"}
+    };
+    EXPECT_EQ(out, expected.dump());
+}
+
+TEST(PayloadWriterTest, ProvidersWriteTheSameBytesAsTheirDom) {
+    auto history = tricky_history();
+    const std::string system_prompt = "You are \"MAG\".\nBe brief.";
+    
+    for (const auto& name : {"anthropic", "openai", "mistral", "gemini"}) {
+        auto provider = ProviderFactory::create_provider(name);
+        ASSERT_TRUE(provider) << name;
+        for (bool caching : {true, false}) {
+            provider->set_prompt_caching(caching);
+            std::string out = "prefix:"; // appends, never truncates
+            provider->write_conversation_payload(out, system_prompt, history, "model-x");
+            EXPECT_EQ(out, "prefix:" + provider->build_conversation_payload(system_prompt, history, "model-x").dump())
+                << name << (caching ? " (caching)" : "");
+        }
+    }
+}
+
+TEST(HistoryBufferTest, ViewStaysContiguousAcrossFrontRemoval) {
+    HistoryBuffer buffer;
+    for (int i = 0; i < 40; ++i) {
+        buffer.push_back(ConversationMessage("user", "m" + std::to_string(i)));
+    }
+    for (int i = 0; i < 30; ++i) {
+        buffer.pop_front();
+    }
+    ASSERT_EQ(buffer.size(), 10u);
+    EXPECT_EQ(buffer.front().content, "m30");
+    
+    buffer.push_front(ConversationMessage("system", "summary"));
+    HistoryView view = buffer.view();
+    ASSERT_EQ(view.size(), 11u);
+    EXPECT_EQ(view[0].content, "summary");
+    EXPECT_EQ(view[1].content, "m30");
+    EXPECT_EQ(view.back().content, "m39");
+    EXPECT_EQ(&view[0] + 10, &view[10]);
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include "plan_batch_store.h"
+#include "providers/openai_provider.h"
+#include "providers/anthropic_provider.h"
+#include "config.h"
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+using namespace mag;
+
+namespace {
+
+std::vector<std::pair<std::string, nlohmann::json>> two_requests(const LLMProvider& provider) {
+    return {{"todo-1", provider.build_request_payload("system", "first", provider.get_default_model())},
+            {"todo-2", provider.build_request_payload("system", "second", provider.get_default_model())}};
+}
+
+std::string plan_text(const std::string& path) {
+    return nlohmann::json{{"command", "WriteFile"}, {"path", path}, {"content", "x"}}.dump();
+}
+
+} // namespace
+
+TEST(PlanBatchTest, OpenAIUploadsJsonlThenCreatesTheBatch) {
+    OpenAIProvider provider;
+    ProviderBatchCall upload = provider.build_batch_submit("key", two_requests(provider));
+    EXPECT_EQ(upload.url, APIConfig::OPENAI_FILES_URL);
+    EXPECT_FALSE(upload.get);
+    ASSERT_EQ(upload.headers.size(), 2u);
+    std::string boundary = upload.headers[0].substr(upload.headers[0].find("boundary=") + 9);
+    EXPECT_EQ(upload.headers[0].rfind("Content-Type: multipart/form-data; boundary=mag-batch-", 0), 0u);
+    EXPECT_EQ(upload.headers[1], "Authorization: Bearer key");
+    EXPECT_NE(upload.payload.find("name=\"purpose\"\r\n\r\nbatch\r\n"), std::string::npos);
+    EXPECT_NE(upload.payload.rfind("--" + boundary + "--\r\n"), std::string::npos);
+
+    // One request per line between the file part's headers and the closing boundary
+    size_t start = upload.payload.find("application/jsonl\r\n\r\n") + 21;
+    std::string first_line = upload.payload.substr(start, upload.payload.find('\n', start) - start);
+    nlohmann::json line = nlohmann::json::parse(first_line);
+    EXPECT_EQ(line["custom_id"], "todo-1");
+    EXPECT_EQ(line["url"], "/v1/chat/completions");
+    EXPECT_EQ(line["body"]["messages"].back()["content"], "first");
+
+    auto create = provider.build_batch_create("key", R"({"id": "file-abc", "purpose": "batch"})");
+    ASSERT_TRUE(create);
+    EXPECT_EQ(create->url, APIConfig::OPENAI_BATCHES_URL);
+    nlohmann::json body = nlohmann::json::parse(create->payload);
+    EXPECT_EQ(body["input_file_id"], "file-abc");
+    EXPECT_EQ(body["completion_window"], "24h");
+    EXPECT_THROW(provider.build_batch_create("key", R"({"error": {}})"), std::runtime_error);
+}
+
+TEST(PlanBatchTest, OpenAIStatusAndResults) {
+    OpenAIProvider provider;
+    PlanBatchStatus running = provider.parse_batch_status(
+        R"({"id": "batch_1", "status": "in_progress", "output_file_id": null,
+            "request_counts": {"total": 2, "completed": 1, "failed": 0}})");
+    EXPECT_EQ(running.id, "batch_1");
+    EXPECT_FALSE(running.ended);
+    EXPECT_EQ(running.total, 2u);
+    EXPECT_EQ(running.succeeded, 1u);
+    EXPECT_TRUE(running.results.empty());
+    EXPECT_THROW(provider.build_batch_results("key", running), std::runtime_error);
+    EXPECT_EQ(provider.build_batch_poll("key", "batch_1").url, std::string(APIConfig::OPENAI_BATCHES_URL) + "/batch_1");
+
+    PlanBatchStatus done = provider.parse_batch_status(
+        R"({"id": "batch_1", "status": "completed", "output_file_id": "file-out",
+            "request_counts": {"total": 2, "completed": 1, "failed": 1}})");
+    EXPECT_TRUE(done.ended);
+    ProviderBatchCall fetch = provider.build_batch_results("key", done);
+    EXPECT_TRUE(fetch.get);
+    EXPECT_EQ(fetch.url, std::string(APIConfig::OPENAI_FILES_URL) + "/file-out/content");
+
+    nlohmann::json ok = {{"custom_id", "todo-1"}, {"error", nullptr},
+                         {"response", {{"status_code", 200},
+                                       {"body", {{"choices", {{{"message", {{"content", plan_text("a.txt")}}}}}}}}}}};
+    nlohmann::json failed = nlohmann::json::parse(
+        R"({"custom_id": "todo-2", "error": null, "response": {"status_code": 400, "body": {"error": {"message": "bad"}}}})");
+    std::vector<ProviderBatchEntry> entries =
+        provider.parse_batch_results(ok.dump() + "\n" + failed.dump() + "\n{\"custom_id\": \"todo-3\", \"resp");
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_TRUE(entries[0].success);
+    EXPECT_EQ(provider.parse_response(entries[0].body).path, "a.txt");
+    EXPECT_FALSE(entries[1].success);
+    EXPECT_EQ(entries[1].custom_id, "todo-2");
+    EXPECT_EQ(entries[1].error, "HTTP error: 400");
+}
+
+TEST(PlanBatchTest, AnthropicSubmitsOnceAndReadsResults) {
+    AnthropicProvider provider;
+    ProviderBatchCall submit = provider.build_batch_submit("key", two_requests(provider));
+    EXPECT_EQ(submit.url, APIConfig::ANTHROPIC_BATCHES_URL);
+    EXPECT_FALSE(provider.build_batch_create("key", "{}"));
+    nlohmann::json body = nlohmann::json::parse(submit.payload);
+    ASSERT_EQ(body["requests"].size(), 2u);
+    EXPECT_EQ(body["requests"][1]["custom_id"], "todo-2");
+    EXPECT_EQ(body["requests"][1]["params"]["messages"].back()["content"][0]["text"], "second");
+
+    PlanBatchStatus status = provider.parse_batch_status(
+        R"({"id": "msgbatch_1", "processing_status": "ended",
+            "request_counts": {"processing": 0, "succeeded": 1, "errored": 1, "canceled": 0, "expired": 1},
+            "results_url": "https://api.anthropic.com/v1/messages/batches/msgbatch_1/results"})");
+    EXPECT_TRUE(status.ended);
+    EXPECT_EQ(status.total, 3u);
+    EXPECT_EQ(status.failed, 2u);
+    EXPECT_EQ(provider.build_batch_results("key", status).url, status.results);
+
+    nlohmann::json ok = {{"custom_id", "todo-1"},
+                         {"result", {{"type", "succeeded"},
+                                     {"message", {{"content", {{{"type", "text"}, {"text", plan_text("b.txt")}}}}}}}}};
+    nlohmann::json errored = {{"custom_id", "todo-2"},
+                              {"result", {{"type", "errored"},
+                                          {"error", {{"type", "error"}, {"error", {{"message", "overloaded"}}}}}}}};
+    nlohmann::json expired = {{"custom_id", "todo-3"}, {"result", {{"type", "expired"}}}};
+    std::vector<ProviderBatchEntry> entries =
+        provider.parse_batch_results(ok.dump() + "\n" + errored.dump() + "\n" + expired.dump() + "\n");
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_EQ(provider.parse_response(entries[0].body).path, "b.txt");
+    EXPECT_EQ(entries[1].error, "overloaded");
+    EXPECT_EQ(entries[2].error, "expired");
+}
+
+TEST(PlanBatchTest, StatusAndResultsRoundTrip) {
+    PlanBatchStatus status;
+    status.id = "batch_1";
+    status.provider = "openai";
+    status.state = "failed";
+    status.ended = true;
+    status.total = 3;
+    status.error_message = "invalid input file";
+    nlohmann::json j;
+    status.to_json(j);
+    PlanBatchStatus copy;
+    copy.from_json(j);
+    EXPECT_EQ(copy.provider, "openai");
+    EXPECT_TRUE(copy.ended);
+    EXPECT_EQ(copy.total, 3u);
+    EXPECT_EQ(copy.error_message, "invalid input file");
+
+    PlanBatchResult result;
+    result.id = "todo-4";
+    result.success = true;
+    result.command.command = "WriteFile";
+    result.command.path = "c.txt";
+    result.command.content = "hello";
+    result.to_json(j);
+    PlanBatchResult result_copy;
+    result_copy.from_json(j);
+    EXPECT_TRUE(result_copy.success);
+    EXPECT_EQ(result_copy.command.content, "hello");
+}
+
+TEST(PlanBatchTest, StoreKeepsPlansAcrossSessionsForTheirContext) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "mag_plan_batch_test";
+    std::filesystem::remove_all(dir);
+    std::string path = (dir / "plan_batches.json").string();
+
+    {
+        PlanBatchStore store(path);
+        PlanBatchStore::Job job;
+        job.status.id = "batch_1";
+        job.status.provider = "anthropic";
+        job.prompts = {{"todo-1", "create a.txt"}, {"todo-2", "create b.txt"}};
+        job.context = "anthropic:1";
+        store.add_job(job);
+        EXPECT_TRUE(store.covers("create a.txt", "anthropic:1"));
+        EXPECT_FALSE(store.covers("create a.txt", "openai:1"));
+        EXPECT_FALSE(store.has_plan("create a.txt", "anthropic:1"));
+    }
+
+    PlanBatchStore store(path);
+    ASSERT_EQ(store.jobs().size(), 1u);
+    EXPECT_EQ(store.jobs()[0].prompts.at("todo-2"), "create b.txt");
+
+    PlanBatchResult a;
+    a.id = "todo-1";
+    a.success = true;
+    a.command.command = "WriteFile";
+    a.command.path = "a.txt";
+    PlanBatchResult b;
+    b.id = "todo-2";
+    b.error_message = "expired";
+    EXPECT_EQ(store.store_results("batch_1", {a, b}), 1u);
+    EXPECT_TRUE(store.jobs().empty());
+    EXPECT_EQ(store.plans(), 1u);
+
+    PlanBatchStore reloaded(path);
+    EXPECT_TRUE(reloaded.has_plan("create a.txt", "anthropic:1"));
+    auto plan = reloaded.take("create a.txt", "anthropic:1");
+    ASSERT_TRUE(plan);
+    EXPECT_EQ(plan->path, "a.txt");
+    EXPECT_FALSE(reloaded.take("create a.txt", "anthropic:1")); // once
+
+    // A plan made under another provider or policy is dropped, not handed out
+    {
+        PlanBatchStore::Job job;
+        job.status.id = "batch_2";
+        job.prompts = {{"todo-1", "create a.txt"}};
+        job.context = "anthropic:1";
+        reloaded.add_job(job);
+        reloaded.store_results("batch_2", {a});
+    }
+    EXPECT_FALSE(reloaded.take("create a.txt", "anthropic:2"));
+    EXPECT_EQ(reloaded.plans(), 0u);
+
+    std::ofstream(path) << "{not json";
+    EXPECT_EQ(PlanBatchStore(path).plans(), 0u);
+    std::filesystem::remove_all(dir);
+}
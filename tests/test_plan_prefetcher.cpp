@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "plan_prefetcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace mag;
+
+namespace {
+
+// Answers each prompt with a plan naming it, after a delay, and records what was asked
+struct RecordingPlanner {
+    std::mutex mutex;
+    std::vector<std::string> asked;
+    std::chrono::milliseconds delay{0};
+    
+    PlanPrefetcher::Planner planner() {
+        return [this](const std::string& prompt) {
+            std::this_thread::sleep_for(delay);
+            std::lock_guard<std::mutex> lock(mutex);
+            asked.push_back(prompt);
+            WriteFileCommand command;
+            command.command = "WriteFile";
+            command.path = prompt + ".txt";
+            return command;
+        };
+    }
+};
+
+} // anonymous namespace
+
+TEST(PlanPrefetcherTest, PlansAheadWhileTheCurrentTodoRuns) {
+    RecordingPlanner recorder;
+    recorder.delay = std::chrono::milliseconds(100);
+    auto started = std::chrono::steady_clock::now();
+    {
+        PlanPrefetcher prefetcher({"a", "b", "c", "d"}, 2, recorder.planner(), [] { return "ctx"; });
+        for (const char* prompt : {"a", "b", "c", "d"}) {
+            EXPECT_EQ(prefetcher.take(prompt).path, std::string(prompt) + ".txt");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100)); // dry run, confirmation, apply
+        }
+        EXPECT_EQ(prefetcher.hits(), 4u);
+        EXPECT_EQ(prefetcher.misses(), 0u);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    
+    // Serially this is 4 plans plus 4 todos; only the first plan is waited for
+    EXPECT_LT(elapsed, std::chrono::milliseconds(700));
+    EXPECT_EQ(recorder.asked.size(), 4u);
+}
+
+TEST(PlanPrefetcherTest, AsksAgainWhenTheContextChanges) {
+    RecordingPlanner recorder;
+    std::atomic<int> version{1};
+    PlanPrefetcher prefetcher({"a", "b", "c"}, 2, recorder.planner(),
+                              [&version] { return "policy " + std::to_string(version.load()); });
+    EXPECT_EQ(prefetcher.take("a").path, "a.txt");
+    
+    // The policy reloads while "a" runs; "b" was planned under the old one
+    version = 2;
+    EXPECT_EQ(prefetcher.take("b").path, "b.txt");
+    EXPECT_EQ(prefetcher.take("c").path, "c.txt");
+    EXPECT_EQ(prefetcher.hits(), 2u);
+    EXPECT_EQ(prefetcher.stale(), 2u); // "b", and "c" that was already on its way
+}
+
+TEST(PlanPrefetcherTest, SkipsTodosThatAreNotTaken) {
+    RecordingPlanner recorder;
+    {
+        PlanPrefetcher prefetcher({"a", "b", "c", "d"}, 1, recorder.planner(), [] { return "ctx"; });
+        EXPECT_EQ(prefetcher.take("c").path, "c.txt"); // "a" was in flight, "b" never asked for
+        EXPECT_EQ(prefetcher.take("x").path, "x.txt"); // not part of the run
+        EXPECT_EQ(prefetcher.take("d").path, "d.txt");
+        EXPECT_EQ(prefetcher.misses(), 2u);
+        EXPECT_EQ(prefetcher.hits(), 1u);
+    }
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    std::sort(recorder.asked.begin(), recorder.asked.end());
+    EXPECT_EQ(recorder.asked, std::vector<std::string>({"a", "c", "d", "x"}));
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "policy.h"
+#include <fstream>
 
 using namespace mag;
 
@@ -28,4 +29,56 @@ TEST_F(PolicyTest, DisallowedPaths) {
 TEST_F(PolicyTest, RelativePathTraversal) {
     EXPECT_FALSE(policy_checker_->is_allowed("src/../../../etc/passwd"));
     EXPECT_FALSE(policy_checker_->is_allowed("../src/main.cpp"));
-}
\ No newline at end of file
+}
+
+TEST_F(PolicyTest, ReloadsWhenThePolicyFileChanges) {
+    PolicyStore& store = PolicyStore::instance();
+    store.refresh();
+    auto original = store.current();
+    PolicyChecker pinned(original);
+    
+    PolicySettings changed = original->settings;
+    changed.tools["file_tool"].create.allowed_directories.push_back("bin/");
+    std::string error_message;
+    ASSERT_TRUE(PolicyConfig::save(changed, error_message)) << error_message;
+    EXPECT_TRUE(store.refresh());
+    EXPECT_FALSE(store.refresh()); // nothing changed since
+    
+    auto reloaded = store.current();
+    EXPECT_GT(reloaded->version, original->version);
+    EXPECT_TRUE(policy_checker_->is_allowed("file_tool", Operation::CREATE, "bin/tool"));
+    EXPECT_FALSE(pinned.is_allowed("file_tool", Operation::CREATE, "bin/tool"));
+    
+    // A broken file leaves the last good policy in force
+    std::ofstream(PolicyConfig::get_policy_file_path()) << "{ not json";
+    EXPECT_FALSE(store.refresh());
+    EXPECT_EQ(store.current(), reloaded);
+    
+    ASSERT_TRUE(PolicyConfig::save(original->settings, error_message)) << error_message;
+    EXPECT_TRUE(store.refresh());
+    EXPECT_FALSE(policy_checker_->is_allowed("file_tool", Operation::CREATE, "bin/tool"));
+}
+
+TEST_F(PolicyTest, EvaluatesWholePlansAndRemembersDecisions) {
+    auto snapshot = PolicyStore::instance().current();
+    PolicyChecker pinned(snapshot);
+    std::vector<std::string> paths = {"src/main.cpp", "./src/util.cpp", "src/../bin/tool", "/etc/passwd",
+                                      "src/main.cpp"};
+    std::vector<bool> expected = {true, true, false, false, true};
+    EXPECT_EQ(pinned.evaluate_batch("file_tool", Operation::READ, paths), expected);
+    size_t remembered = snapshot->decisions.size();
+    EXPECT_GE(remembered, 2u);
+    
+    for (const auto& path : paths) {
+        pinned.is_allowed(path);
+    }
+    EXPECT_EQ(snapshot->decisions.size(), remembered); // answered from the cache
+    
+    std::vector<bool> commands = pinned.evaluate_bash_batch({"ls -la", "sudo rm -rf /", "ls -la"});
+    EXPECT_EQ(commands, (std::vector<bool>{pinned.is_bash_command_allowed("ls -la"), false,
+                                           pinned.is_bash_command_allowed("ls -la")}));
+    
+    // A new snapshot starts without decisions
+    PolicySnapshot fresh(snapshot->settings, snapshot->version + 1);
+    EXPECT_EQ(fresh.decisions.size(), 0u);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include "policy_matcher.h"
+#include "bash_tool.h"
+#include <random>
+
+using namespace mag;
+
+TEST(PolicyMatcherTest, PrefixTrieMatchesStoredPrefixes) {
+    PrefixTrie trie;
+    EXPECT_TRUE(trie.empty());
+    EXPECT_FALSE(trie.matches("src/main.cpp"));
+    
+    trie.insert("src/");
+    trie.insert("tests/unit/");
+    EXPECT_TRUE(trie.matches("src/main.cpp"));
+    EXPECT_TRUE(trie.matches("src/"));
+    EXPECT_TRUE(trie.matches("tests/unit/a.cpp"));
+    EXPECT_FALSE(trie.matches("src"));
+    EXPECT_FALSE(trie.matches("tests/integration/a.cpp"));
+    EXPECT_FALSE(trie.matches("docs/src/a.md"));
+    
+    trie.insert("");
+    EXPECT_TRUE(trie.matches("anything"));
+}
+
+TEST(PolicyMatcherTest, FindsEveryOccurrenceOfEveryPattern) {
+    MultiPatternMatcher matcher({"he", "she", "his", "hers", ""});
+    std::vector<std::pair<size_t, size_t>> found;
+    matcher.find("ushers", [&found](size_t pattern, size_t start) {
+        found.emplace_back(pattern, start);
+        return false;
+    });
+    std::vector<std::pair<size_t, size_t>> expected = {{4, 0}, {1, 1}, {0, 2}, {3, 2}};
+    EXPECT_EQ(found, expected);
+    
+    MultiPatternMatcher folded({"sudo rm"}, true);
+    EXPECT_TRUE(folded.contains_any("echo; SUDO RM -rf x"));
+    EXPECT_FALSE(MultiPatternMatcher({"sudo rm"}).contains_any("SUDO RM"));
+    EXPECT_FALSE(MultiPatternMatcher().contains_any("anything"));
+}
+
+TEST(PolicyMatcherTest, AgreesWithSubstringSearch) {
+    std::mt19937 rng(7);
+    auto random_string = [&rng](size_t max_length) {
+        std::string text(rng() % (max_length + 1), ' ');
+        for (char& c : text) {
+            c = "abc -"[rng() % 5];
+        }
+        return text;
+    };
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::string> patterns;
+        for (int i = 0; i < 20; ++i) {
+            patterns.push_back(random_string(4));
+        }
+        MultiPatternMatcher matcher(patterns);
+        for (int i = 0; i < 20; ++i) {
+            std::string text = random_string(30);
+            bool expected = std::any_of(patterns.begin(), patterns.end(),
+                                        [&text](const std::string& p) { return text.find(p) != std::string::npos; });
+            ASSERT_EQ(matcher.contains_any(text), expected) << text;
+        }
+    }
+}
+
+TEST(PolicyMatcherTest, CompiledPolicyKeepsThePolicyMeaning) {
+    PolicySettings settings;
+    settings.tools["file_tool"].read.allowed_directories = {"src/", "docs"};
+    settings.tools["file_tool"].delete_op.allowed_directories = {};
+    settings.tools["todo_tool"].read.allowed_directories = {""};
+    for (int i = 0; i < 500; ++i) {
+        settings.tools["bash_tool"].create.blocked_commands.push_back("forbidden" + std::to_string(i));
+    }
+    CompiledPolicy policy(settings);
+    
+    EXPECT_TRUE(policy.is_operation_allowed("file_tool", Operation::READ, "src/main.cpp"));
+    EXPECT_TRUE(policy.is_operation_allowed("file_tool", Operation::READ, "docs-old/a.md")); // string prefix
+    EXPECT_FALSE(policy.is_operation_allowed("file_tool", Operation::READ, "bin/a"));
+    EXPECT_FALSE(policy.is_operation_allowed("file_tool", Operation::DELETE, "src/main.cpp"));
+    EXPECT_TRUE(policy.is_operation_allowed("todo_tool", Operation::READ, "anywhere"));
+    EXPECT_FALSE(policy.is_operation_allowed("no_tool", Operation::READ, "src/main.cpp"));
+    EXPECT_EQ(policy.allowed_directories("file_tool", Operation::READ),
+              settings.tools["file_tool"].read.allowed_directories);
+    EXPECT_TRUE(policy.allowed_directories("no_tool", Operation::READ).empty());
+    
+    EXPECT_TRUE(policy.is_extension_blocked(".pem"));
+    EXPECT_FALSE(policy.is_extension_blocked(".cpp"));
+    
+    EXPECT_TRUE(policy.is_bash_command_allowed("make -j8"));
+    EXPECT_FALSE(policy.is_bash_command_allowed("makefoo"));
+    EXPECT_TRUE(policy.is_bash_command_blocked("ls; sudo true"));
+    EXPECT_TRUE(policy.is_bash_command_blocked("echo forbidden499"));
+    EXPECT_FALSE(policy.is_bash_command_allowed("ls forbidden42"));
+    EXPECT_FALSE(policy.is_bash_command_blocked("ls forbid"));
+    
+    settings.tools.erase("bash_tool");
+    EXPECT_TRUE(CompiledPolicy(settings).is_bash_command_blocked("ls"));
+}
+
+TEST(PolicyMatcherTest, BashToolScreensCommandsAsBefore) {
+    BashTool tool;
+    EXPECT_TRUE(tool.is_command_allowed("ls -la"));
+    EXPECT_FALSE(tool.is_command_allowed("REBOOT now"));
+    EXPECT_FALSE(tool.is_command_allowed("echo x && shutdown"));
+    EXPECT_FALSE(tool.is_command_allowed("echo rebooting")); // a word starting with a blocked one counts
+    EXPECT_FALSE(tool.is_command_allowed("cat x > /dev/null"));
+    EXPECT_FALSE(tool.is_command_allowed("ls | xargs rm"));
+    EXPECT_FALSE(tool.is_command_allowed("RM -RF build"));
+    EXPECT_TRUE(tool.is_command_allowed("echo reformat")); // only at the start of a word
+    EXPECT_TRUE(tool.is_command_allowed("grep -r harm src"));
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include "project_index.h"
+#include "llm_client.h"
+#include <filesystem>
+#include <fstream>
+
+using namespace mag;
+
+class ProjectIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_project_index_test";
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+
+    void write(const std::string& relative, const std::string& content) {
+        std::filesystem::path path = dir_ / relative;
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    std::filesystem::path dir_;
+};
+
+TEST_F(ProjectIndexTest, KnowsLanguagesByExtensionAndName) {
+    EXPECT_EQ(ProjectIndex::language_of("src/main.cpp"), "cpp");
+    EXPECT_EQ(ProjectIndex::language_of("include/config.h"), "cpp");
+    EXPECT_EQ(ProjectIndex::language_of("tools/run.py"), "python");
+    EXPECT_EQ(ProjectIndex::language_of("web/app.TSX"), "typescript");
+    EXPECT_EQ(ProjectIndex::language_of("src/CMakeLists.txt"), "cmake");
+    EXPECT_EQ(ProjectIndex::language_of("Makefile"), "make");
+    EXPECT_EQ(ProjectIndex::language_of("LICENSE"), "");
+    EXPECT_EQ(ProjectIndex::language_of(".gitignore"), "");
+}
+
+TEST_F(ProjectIndexTest, OutlinesDeclarationsNotStatements) {
+    std::string header =
+        "#pragma once\n"
+        "namespace mag {\n"
+        "class Forward;\n"
+        "class ThreadPool {\n"
+        "public:\n"
+        "    explicit ThreadPool(size_t threads);\n"
+        "    void submit(std::function<void()> task);\n"
+        "    size_t size() const { return workers_.size(); }\n"
+        "};\n"
+        "}\n";
+    std::vector<std::string> symbols = ProjectIndex::outline(header, "cpp");
+    ASSERT_EQ(symbols.size(), 4u);
+    EXPECT_EQ(symbols[0], "class ThreadPool");
+    EXPECT_EQ(symbols[1], "explicit ThreadPool(size_t threads)");
+    EXPECT_EQ(symbols[2], "void submit(std::function<void()> task)");
+    EXPECT_EQ(symbols[3], "size_t size() const");
+
+    std::string source =
+        "#include \"thread_pool.h\"\n"
+        "ThreadPool::ThreadPool(size_t threads) {\n"
+        "    start(threads);\n"
+        "    if (threads == 0) {\n"
+        "        return;\n"
+        "    }\n"
+        "    std::thread worker(run, this);\n"
+        "}\n"
+        "static int helper(const Task& task, int* count) { return 0; }\n";
+    symbols = ProjectIndex::outline(source, "cpp");
+    ASSERT_EQ(symbols.size(), 2u);
+    EXPECT_EQ(symbols[0], "ThreadPool::ThreadPool(size_t threads)");
+    EXPECT_EQ(symbols[1], "static int helper(const Task& task, int* count)");
+
+    std::string python =
+        "import os\n"
+        "class Planner:\n"
+        "    def plan(self, prompt):\n"
+        "        def inner():\n"
+        "            pass\n"
+        "async def main():\n"
+        "    pass\n";
+    symbols = ProjectIndex::outline(python, "python");
+    ASSERT_EQ(symbols.size(), 3u);
+    EXPECT_EQ(symbols[0], "class Planner");
+    EXPECT_EQ(symbols[1], "def plan(self, prompt)");
+    EXPECT_EQ(symbols[2], "async def main()");
+
+    EXPECT_EQ(ProjectIndex::outline("# Title\n```\n# not a heading\n```\n## Usage\n", "markdown"),
+              (std::vector<std::string>{"# Title", "## Usage"}));
+}
+
+TEST_F(ProjectIndexTest, SliceRanksMatchingFilesWithinBudget) {
+    write("src/scheduler/thread_pool.cpp", "void ThreadPool::submit(Task task) {\n}\n");
+    write("src/scheduler/thread_pool.h", "class ThreadPool {\n    void submit(Task task);\n};\n");
+    write("src/net/http_client.cpp", "void HttpClient::post(const std::string& url) {\n}\n");
+    write("README.md", "# Project\n");
+
+    ProjectIndex index(dir_.string());
+    ContextSlice slice = index.slice("Make the thread pool submit faster", 2000);
+    ASSERT_TRUE(slice.success);
+    EXPECT_EQ(index.size(), 4u);
+    EXPECT_EQ(slice.context.rfind("Project: 4 files (cpp 3, markdown 1)\n", 0), 0u) << slice.context;
+    EXPECT_NE(slice.context.find("Top level: README.md, src/ (3)"), std::string::npos);
+    EXPECT_NE(slice.context.find("src/scheduler/thread_pool.h (cpp, 3 lines)\n  class ThreadPool\n"),
+              std::string::npos) << slice.context;
+    EXPECT_NE(slice.context.find("  void ThreadPool::submit(Task task)"), std::string::npos);
+    EXPECT_EQ(slice.context.find("http_client"), std::string::npos);
+    EXPECT_EQ(slice.files, 2u);
+    EXPECT_LE(slice.tokens, 2000u);
+
+    // A small budget keeps the summary and drops what does not fit
+    ContextSlice small = index.slice("thread pool", 20);
+    EXPECT_LE(small.tokens, 20u);
+    EXPECT_LT(small.context.size(), slice.context.size());
+    index.stop();
+}
+
+TEST_F(ProjectIndexTest, RefreshRereadsOnlyChangedFiles) {
+    write("a.cpp", "void a_function(int x) {}\n");
+    write("b.cpp", "void b_function(int x) {}\n");
+
+    ProjectIndex index(dir_.string());
+    index.start();
+    // Without the watcher thread, changes are picked up only by refresh() below;
+    // otherwise it may read a file mid-write and again once it is complete
+    index.stop();
+    EXPECT_EQ(index.files_read(), 2u);
+    uint64_t old_hash = index.find("a.cpp")->hash;
+
+    write("a.cpp", "void a_function(int x) {}\nvoid a_second(int y) {}\n");
+    write("sub/c.py", "def c_function():\n    pass\n");
+    std::filesystem::remove(dir_ / "b.cpp");
+    index.refresh();
+
+    ASSERT_TRUE(index.find("a.cpp"));
+    EXPECT_NE(index.find("a.cpp")->hash, old_hash);
+    EXPECT_EQ(index.find("a.cpp")->symbols.size(), 2u);
+    EXPECT_FALSE(index.find("b.cpp"));
+    ASSERT_TRUE(index.find("sub/c.py"));
+    EXPECT_EQ(index.find("sub/c.py")->language, "python");
+    EXPECT_EQ(index.files_read(), 4u);
+
+    // Nothing changed: nothing read
+    index.refresh();
+    EXPECT_EQ(index.files_read(), 4u);
+}
+
+TEST_F(ProjectIndexTest, ReadsLargeFilesInChunks) {
+    std::string line = "int value_" + std::string(90, 'x') + ";\n";
+    std::string big;
+    while (big.size() < 200 * 1024) {
+        big += line;
+    }
+    big += "class LastChunk {\n};\n";
+    write("big.cpp", big);
+    write("copy.cpp", big);
+    write("unterminated.txt", big + "tail");
+
+    ProjectIndex index(dir_.string());
+    index.start();
+    index.stop();
+    ASSERT_TRUE(index.find("big.cpp"));
+    EXPECT_EQ(index.find("big.cpp")->lines, big.size() / line.size() + 2);
+    EXPECT_EQ(index.find("big.cpp")->hash, index.find("copy.cpp")->hash);
+    ASSERT_FALSE(index.find("big.cpp")->symbols.empty());
+    EXPECT_NE(index.find("big.cpp")->symbols.back().find("LastChunk"), std::string::npos);
+    ASSERT_TRUE(index.find("unterminated.txt"));
+    EXPECT_EQ(index.find("unterminated.txt")->lines, big.size() / line.size() + 3);
+    EXPECT_NE(index.find("unterminated.txt")->hash, index.find("big.cpp")->hash);
+}
+
+TEST_F(ProjectIndexTest, SkipsHiddenBuildAndBinaryFiles) {
+    write("main.cpp", "int main() {}\n");
+    write(".git/config", "[core]\n");
+    write(".env", "KEY=secret\n");
+    write("node_modules/lib/index.js", "function f() {}\n");
+    write("build/CMakeCache.txt", "CMAKE_BUILD_TYPE=Release\n");
+    write("build/generated.cpp", "int generated() {}\n");
+    write("logo.png", std::string("\x89PNG\0\0\0", 7));
+
+    ProjectIndex index(dir_.string(), nullptr);
+    index.start();
+    EXPECT_EQ(index.size(), 1u);
+    EXPECT_TRUE(index.find("main.cpp"));
+    EXPECT_FALSE(index.find(".env"));
+    EXPECT_FALSE(index.find("build/generated.cpp"));
+    EXPECT_FALSE(index.find("logo.png"));
+    index.stop();
+}
+
+TEST_F(ProjectIndexTest, ContextGoesAheadOfTheLatestUserMessage) {
+    EXPECT_EQ(LLMClient::with_project_context("", "fix it"), "fix it");
+    std::string prompt = LLMClient::with_project_context("a.cpp (cpp, 1 lines)", "fix it");
+    EXPECT_NE(prompt.find("a.cpp (cpp, 1 lines)\n\nTask:\nfix it"), std::string::npos);
+
+    std::vector<ConversationMessage> history = {
+        ConversationMessage("user", "first"), ConversationMessage("assistant", "reply"),
+        ConversationMessage("user", "second")
+    };
+    std::vector<ConversationMessage> grounded = LLMClient::with_project_context("ctx", history);
+    ASSERT_EQ(grounded.size(), 3u);
+    EXPECT_EQ(grounded[0].content.view(), "first");
+    EXPECT_EQ(grounded[2].content.view(), LLMClient::with_project_context("ctx", "second"));
+    EXPECT_EQ(history[2].content.view(), "second");
+}
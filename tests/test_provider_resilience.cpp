@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include "provider_resilience.h"
+#include "llm_client.h"
+#include <thread>
+
+using namespace mag;
+using namespace std::chrono_literals;
+
+namespace {
+
+HttpResponse response_with(long status, std::map<std::string, std::string> headers = {}) {
+    HttpResponse response = HttpResponse::failure("HTTP error: " + std::to_string(status), status);
+    response.headers = std::move(headers);
+    return response;
+}
+
+} // namespace
+
+TEST(TokenBucketTest, BurstThenWaitForRefill) {
+    TokenBucket bucket(10.0, 2.0); // one token every 100ms
+    EXPECT_EQ(bucket.try_acquire().count(), 0);
+    EXPECT_EQ(bucket.try_acquire().count(), 0);
+    
+    auto wait = bucket.try_acquire();
+    EXPECT_GT(wait.count(), 0);
+    EXPECT_LE(wait.count(), 100);
+    
+    CancellationToken cancel;
+    cancel.cancel();
+    EXPECT_FALSE(bucket.acquire(&cancel));
+    EXPECT_TRUE(bucket.acquire());
+}
+
+TEST(RetryPolicyTest, ClassifiesRetryableResponses) {
+    EXPECT_TRUE(RetryPolicy::is_retryable(response_with(0)));
+    EXPECT_TRUE(RetryPolicy::is_retryable(response_with(429)));
+    EXPECT_TRUE(RetryPolicy::is_retryable(response_with(503)));
+    EXPECT_TRUE(RetryPolicy::is_retryable(response_with(529)));
+    EXPECT_FALSE(RetryPolicy::is_retryable(response_with(400)));
+    EXPECT_FALSE(RetryPolicy::is_retryable(response_with(401)));
+}
+
+TEST(RetryPolicyTest, HonoursRetryAfterHeaders) {
+    EXPECT_FALSE(RetryPolicy::retry_after(response_with(429)).has_value());
+    EXPECT_EQ(RetryPolicy::retry_after(response_with(429, {{"retry-after", "7"}}))->count(), 7000);
+    EXPECT_EQ(RetryPolicy::retry_after(response_with(429, {{"retry-after-ms", "250"}}))->count(), 250);
+    EXPECT_EQ(RetryPolicy::retry_after(response_with(503, {{"retry-after", "Wed, 21 Oct 2015 07:28:00 GMT"}}))->count(), 0);
+    EXPECT_FALSE(RetryPolicy::retry_after(response_with(503, {{"retry-after", "soon"}})).has_value());
+    EXPECT_FALSE(RetryPolicy::retry_after(response_with(503, {{"retry-after", "-5"}})).has_value());
+    EXPECT_FALSE(RetryPolicy::retry_after(response_with(429, {{"retry-after-ms", "nan"}})).has_value());
+    
+    // Oversized hints are capped rather than overflowing
+    const auto cap = RetryPolicy::MAX_RETRY_AFTER_HINT;
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(429, {{"retry-after", "99999999999999999999999"}})), cap);
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(429, {{"retry-after", "9223372036854775"}})), cap);
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(429, {{"retry-after-ms", "1e300"}})), cap);
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(429, {{"retry-after-ms", "1e400"}})), cap);
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(429, {{"retry-after-ms", "inf"}})), cap);
+    EXPECT_EQ(*RetryPolicy::retry_after(response_with(503, {{"retry-after", "Fri, 01 Jan 9999 00:00:00 GMT"}})), cap);
+    
+    RetryPolicy policy{3, 100ms, 1000ms, 5000ms};
+    EXPECT_EQ(policy.backoff(0, response_with(429, {{"retry-after", "2"}})).count(), 2000);
+    EXPECT_EQ(policy.backoff(0, response_with(429, {{"retry-after", "60"}})).count(), 5000);
+    EXPECT_EQ(policy.backoff(0, response_with(429, {{"retry-after", "99999999999999999999999"}})).count(), 5000);
+}
+
+TEST(RetryPolicyTest, JitteredBackoffStaysWithinExponentialCeiling) {
+    RetryPolicy policy{5, 100ms, 1000ms, 5000ms};
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_LE(policy.backoff(0, response_with(500)).count(), 100);
+        EXPECT_LE(policy.backoff(2, response_with(500)).count(), 400);
+        EXPECT_LE(policy.backoff(10, response_with(500)).count(), 1000);
+    }
+}
+
+TEST(CircuitBreakerTest, OpensAfterThresholdAndProbesWhenHalfOpen) {
+    CircuitBreaker breaker(2, 50ms);
+    breaker.record_failure(breaker.allow_request());
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::CLOSED);
+    breaker.record_failure(breaker.allow_request());
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::OPEN);
+    EXPECT_FALSE(breaker.allow_request());
+    
+    std::this_thread::sleep_for(60ms);
+    CircuitBreaker::Permit probe = breaker.allow_request();
+    EXPECT_TRUE(probe.probe);
+    EXPECT_FALSE(breaker.allow_request()); // others still fail fast
+    breaker.record_failure(probe);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::OPEN);
+    
+    std::this_thread::sleep_for(60ms);
+    probe = breaker.allow_request();
+    ASSERT_TRUE(probe);
+    breaker.record_success(probe);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::CLOSED);
+    EXPECT_TRUE(breaker.allow_request());
+}
+
+TEST(CircuitBreakerTest, ReleasedProbeLetsTheNextRequestProbe) {
+    CircuitBreaker breaker(1, 50ms);
+    breaker.record_failure(breaker.allow_request());
+    std::this_thread::sleep_for(60ms);
+    CircuitBreaker::Permit probe = breaker.allow_request();
+    EXPECT_TRUE(probe);
+    EXPECT_FALSE(breaker.allow_request());
+    
+    // The probe was cancelled before the provider answered
+    breaker.release_probe(probe);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::HALF_OPEN);
+    EXPECT_TRUE(breaker.allow_request());
+}
+
+TEST(CircuitBreakerTest, OnlyTheProbeDecidesAHalfOpenBreaker) {
+    CircuitBreaker breaker(1, 50ms);
+    CircuitBreaker::Permit early = breaker.allow_request();  // admitted while CLOSED
+    CircuitBreaker::Permit tripping = breaker.allow_request();
+    breaker.record_failure(tripping);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::OPEN);
+    
+    std::this_thread::sleep_for(60ms);
+    CircuitBreaker::Permit probe = breaker.allow_request();
+    ASSERT_TRUE(probe.probe);
+    
+    // Late outcomes of the request admitted before the breaker opened change nothing
+    breaker.release_probe(early);
+    breaker.record_failure(early);
+    EXPECT_FALSE(breaker.allow_request()); // the probe slot is still taken
+    breaker.record_success(early);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::HALF_OPEN);
+    
+    breaker.record_success(probe);
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::CLOSED);
+    breaker.record_failure(probe); // reported twice: already spent
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::CLOSED);
+}
+
+TEST(ProviderFailoverTest, FailsOverToNextAvailableProvider) {
+    setenv("OPENAI_API_KEY", "fake-key", 1);
+    setenv("MISTRAL_API_KEY", "fake-key", 1);
+    
+    LLMClientPool pool("openai");
+    std::vector<std::string> tried;
+    std::string served_by = pool.with_failover("", [&tried](const LLMClient& client) {
+        tried.push_back(client.get_current_provider());
+        if (client.get_current_provider() != "mistral") {
+            throw ProviderUnavailableError("circuit open");
+        }
+        return client.get_current_provider();
+    });
+    
+    EXPECT_EQ(served_by, "mistral");
+    ASSERT_GE(tried.size(), 2u);
+    EXPECT_EQ(tried.front(), "openai");
+    
+    // Ordinary errors are not failed over
+    EXPECT_THROW(pool.with_failover("", [](const LLMClient&) -> int {
+        throw std::runtime_error("bad request");
+    }), std::runtime_error);
+    
+    unsetenv("OPENAI_API_KEY");
+    unsetenv("MISTRAL_API_KEY");
+}
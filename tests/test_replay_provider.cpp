@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "providers/replay_provider.h"
+#include "providers/anthropic_provider.h"
+#include "llm_client.h"
+#include <filesystem>
+
+using namespace mag;
+
+class ReplayProviderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        capture_dir_ = "test_replay";
+        capture_file_ = capture_dir_ + "/capture.jsonl";
+        std::filesystem::remove_all(capture_dir_);
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(capture_dir_);
+    }
+    
+    static std::string anthropic_body(const std::string& text) {
+        return nlohmann::json{{"content", {{{"type", "text"}, {"text", text}}}}}.dump();
+    }
+    
+    std::string capture_dir_;
+    std::string capture_file_;
+};
+
+TEST_F(ReplayProviderTest, ReplaysRecordedResponseForMatchingRequest) {
+    AnthropicProvider anthropic;
+    std::string payload = anthropic.build_request_payload("system", "create hello.txt", "claude-live").dump();
+    std::string plan = R"({"command": "WriteFile", "path": "hello.txt", "content": "hi"})";
+    
+    ResponseRecorder recorder(capture_file_);
+    recorder.record("anthropic", "claude-live", payload, anthropic_body(plan));
+    EXPECT_EQ(recorder.recorded(), 1u);
+    
+    ReplayProvider replay(capture_file_, "", 0, 0, true);
+    EXPECT_EQ(replay.entry_count(), 1u);
+    EXPECT_EQ(replay.get_default_model(), anthropic.get_default_model());
+    
+    // Same request with the replay's own model still matches
+    std::string replayed_payload = replay.build_request_payload("system", "create hello.txt",
+                                                                replay.get_default_model()).dump();
+    auto body = replay.serve_locally(replayed_payload);
+    ASSERT_TRUE(body.has_value());
+    WriteFileCommand command = replay.parse_response(*body);
+    EXPECT_EQ(command.path, "hello.txt");
+    
+    std::string other = replay.build_request_payload("system", "something else", "m").dump();
+    EXPECT_THROW(replay.serve_locally(other), std::runtime_error);
+}
+
+TEST_F(ReplayProviderTest, LenientModeRotatesThroughCapture) {
+    ResponseRecorder recorder(capture_file_);
+    recorder.record("anthropic", "m", R"({"a":1})", anthropic_body("first"));
+    recorder.record("anthropic", "m", R"({"a":2})", anthropic_body("second"));
+    
+    ReplayProvider replay(capture_file_, "", 0, 0, false);
+    EXPECT_EQ(replay.parse_chat_response(*replay.serve_locally("unrecorded")), "first");
+    EXPECT_EQ(replay.parse_chat_response(*replay.serve_locally("unrecorded")), "second");
+    EXPECT_EQ(replay.parse_chat_response(*replay.serve_locally(R"({"a":2})")), "second");
+}
+
+TEST_F(ReplayProviderTest, LLMClientRunsOfflineWithInjectedLatency) {
+    ResponseRecorder recorder(capture_file_);
+    recorder.record("anthropic", "m", "{}",
+                    anthropic_body(R"({"command": "WriteFile", "path": "out.txt", "content": "x"})"));
+    
+    setenv("MAG_REPLAY_FILE", capture_file_.c_str(), 1);
+    setenv("MAG_REPLAY_STRICT", "0", 1);
+    setenv("MAG_REPLAY_LATENCY_MS", "30", 1);
+    
+    LLMClient client("replay");
+    EXPECT_EQ(client.get_current_provider(), "replay");
+    
+    auto begin = std::chrono::steady_clock::now();
+    WriteFileCommand command = client.get_plan_from_llm("any prompt");
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    
+    EXPECT_EQ(command.path, "out.txt");
+    EXPECT_GE(elapsed, std::chrono::milliseconds(30));
+    
+    unsetenv("MAG_REPLAY_FILE");
+    unsetenv("MAG_REPLAY_STRICT");
+    unsetenv("MAG_REPLAY_LATENCY_MS");
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "response_cache.h"
+#include "utils.h"
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace mag;
+
+class ResponseCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        cache_dir_ = "test_response_cache";
+        std::filesystem::remove_all(cache_dir_);
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(cache_dir_);
+    }
+    
+    std::string cache_dir_;
+};
+
+TEST(UtilsHashTest, Hash64MatchesXxh64Reference) {
+    EXPECT_EQ(Utils::hash_to_hex(Utils::hash64("")), "ef46db3751d8e999");
+    EXPECT_EQ(Utils::hash_to_hex(Utils::hash64("abc")), "44bc2cf5ad770999");
+    EXPECT_NE(Utils::hash64("abc", 1), Utils::hash64("abc"));
+}
+
+TEST_F(ResponseCacheTest, KeysAreStableAndFieldBoundariesMatter) {
+    std::string key = ResponseCache::make_key({"openai", "gpt", "payload"});
+    EXPECT_EQ(key.size(), 32u);
+    EXPECT_EQ(key, ResponseCache::make_key({"openai", "gpt", "payload"}));
+    EXPECT_NE(ResponseCache::make_key({"ab", "c"}), ResponseCache::make_key({"a", "bc"}));
+    EXPECT_NE(key, ResponseCache::make_key({"mistral", "gpt", "payload"}));
+}
+
+TEST_F(ResponseCacheTest, MemoryTierHitsAndMisses) {
+    ResponseCache cache("", 4, std::chrono::seconds(60));
+    EXPECT_FALSE(cache.get("k1").has_value());
+    cache.put("k1", "body-1");
+    
+    auto hit = cache.get("k1");
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(*hit, "body-1");
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+}
+
+TEST_F(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+    ResponseCache cache("", 2, std::chrono::seconds(60));
+    cache.put("a", "1");
+    cache.put("b", "2");
+    cache.get("a");       // b is now the oldest
+    cache.put("c", "3");
+    
+    EXPECT_EQ(cache.memory_size(), 2u);
+    EXPECT_TRUE(cache.get("a").has_value());
+    EXPECT_FALSE(cache.get("b").has_value());
+    EXPECT_TRUE(cache.get("c").has_value());
+}
+
+TEST_F(ResponseCacheTest, DiskTierSurvivesRestart) {
+    {
+        ResponseCache cache(cache_dir_, 4, std::chrono::seconds(60));
+        cache.put("persisted", "{\"ok\":true}");
+    }
+    EXPECT_TRUE(std::filesystem::exists(cache_dir_ + "/persisted.json"));
+    
+    ResponseCache reopened(cache_dir_, 4, std::chrono::seconds(60));
+    auto hit = reopened.get("persisted");
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(*hit, "{\"ok\":true}");
+    EXPECT_EQ(reopened.memory_size(), 1u); // promoted into memory
+}
+
+TEST_F(ResponseCacheTest, ExpiredDiskEntriesAreMisses) {
+    std::filesystem::create_directories(cache_dir_);
+    std::ofstream(cache_dir_ + "/stale.json") << nlohmann::json{{"created_at", 0}, {"body", "old"}}.dump();
+    std::ofstream(cache_dir_ + "/corrupt.json") << "{\"created_at\":";
+    
+    ResponseCache cache(cache_dir_, 4, std::chrono::seconds(60));
+    EXPECT_FALSE(cache.get("stale").has_value());
+    EXPECT_FALSE(cache.get("corrupt").has_value());
+    EXPECT_FALSE(std::filesystem::exists(cache_dir_ + "/stale.json"));
+}
+
+TEST_F(ResponseCacheTest, DiskTierIsPrunedOldestFirst) {
+    std::filesystem::create_directories(cache_dir_);
+    auto now = std::filesystem::file_time_type::clock::now();
+    for (int i = 0; i < 5; ++i) {
+        std::string path = cache_dir_ + "/old" + std::to_string(i) + ".json";
+        std::ofstream(path) << nlohmann::json{{"created_at", 0}, {"body", "x"}}.dump();
+        std::filesystem::last_write_time(path, now - std::chrono::minutes(10 - i));
+    }
+    std::ofstream(cache_dir_ + "/expired.json") << "{}";
+    std::filesystem::last_write_time(cache_dir_ + "/expired.json", now - std::chrono::hours(2));
+    
+    // Construction drops the expired file, then the oldest beyond the cap
+    ResponseCache cache(cache_dir_, 4, std::chrono::seconds(3600), 3);
+    EXPECT_EQ(cache.disk_size(), 3u);
+    EXPECT_FALSE(std::filesystem::exists(cache_dir_ + "/expired.json"));
+    EXPECT_FALSE(std::filesystem::exists(cache_dir_ + "/old0.json"));
+    EXPECT_FALSE(std::filesystem::exists(cache_dir_ + "/old1.json"));
+    EXPECT_TRUE(std::filesystem::exists(cache_dir_ + "/old4.json"));
+    
+    // And so do puts, every PRUNE_INTERVAL of them
+    for (size_t i = 0; i < ResponseCache::PRUNE_INTERVAL; ++i) {
+        cache.put("new" + std::to_string(i), "y");
+    }
+    EXPECT_EQ(cache.disk_size(), 3u);
+}
+
+TEST_F(ResponseCacheTest, EraseRemovesBothTiers) {
+    ResponseCache cache(cache_dir_, 4, std::chrono::seconds(60));
+    cache.put("gone", "x");
+    cache.erase("gone");
+    
+    EXPECT_FALSE(cache.get("gone").has_value());
+    EXPECT_FALSE(std::filesystem::exists(cache_dir_ + "/gone.json"));
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include "session_index.h"
+#include "session_journal.h"
+#include "conversation_manager.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace mag;
+
+class SessionIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_session_index_test";
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+    
+    static SessionInfo info(const std::string& id, const std::string& activity, size_t count) {
+        return {id, "2024-01-01T00:00:00", activity, "openai", count};
+    }
+    
+    std::filesystem::path dir_;
+};
+
+TEST_F(SessionIndexTest, ListsNewestFirstAndPages) {
+    SessionIndex index(dir_.string());
+    index.update(info("a", "2024-01-01T10:00:00", 1));
+    index.update(info("b", "2024-01-01T12:00:00", 2));
+    index.update(info("c", "2024-01-01T11:00:00", 3));
+    index.update(info("a", "2024-01-01T13:00:00", 4)); // moves to the front
+    
+    auto all = index.list();
+    ASSERT_EQ(all.size(), 3u);
+    EXPECT_EQ(all[0].id, "a");
+    EXPECT_EQ(all[0].message_count, 4u);
+    EXPECT_EQ(all[1].id, "b");
+    EXPECT_EQ(all[2].id, "c");
+    
+    auto page = index.list(1, 1);
+    ASSERT_EQ(page.size(), 1u);
+    EXPECT_EQ(page[0].id, "b");
+    EXPECT_TRUE(index.list(5, 10).empty());
+    
+    // A second instance reads the persisted index
+    SessionIndex reopened(dir_.string());
+    auto found = reopened.find("c");
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->message_count, 3u);
+    EXPECT_FALSE(reopened.find("missing").has_value());
+}
+
+TEST_F(SessionIndexTest, RebuildsFromSessionFilesWhenMissingOrStale) {
+    {
+        SessionJournal journal((dir_ / "journaled.jsonl").string());
+        ConversationMessage message("user", "hello");
+        journal.append_message(message);
+        journal.append_metadata({{"last_activity", "2024-02-01T00:00:00"}, {"last_provider", "gemini"}});
+    }
+    {
+        std::ofstream legacy(dir_ / "legacy.json");
+        legacy << R"({"session_id":"legacy","last_activity":"2024-01-01T00:00:00","messages":[{"role":"user","content":"x"},{"role":"assistant","content":"y"}]})";
+    }
+    
+    SessionIndex index(dir_.string());
+    auto all = index.list();
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(all[0].id, "journaled");
+    EXPECT_EQ(all[0].last_provider, "gemini");
+    EXPECT_EQ(all[1].id, "legacy");
+    EXPECT_EQ(all[1].message_count, 2u);
+    ASSERT_TRUE(std::filesystem::exists(index.path()));
+    
+    // A session file appearing behind the index's back makes it stale
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        SessionJournal journal((dir_ / "external.jsonl").string());
+        journal.append_message(ConversationMessage("user", "hi"));
+        journal.append_metadata({{"last_activity", "2024-03-01T00:00:00"}});
+    }
+    EXPECT_EQ(index.size(), 3u);
+    EXPECT_EQ(index.list(0, 1)[0].id, "external");
+}
+
+TEST_F(SessionIndexTest, ManagerKeepsTheIndexCurrentOnSave) {
+    ConversationManager manager;
+    manager.set_storage_directory(dir_.string());
+    manager.add_user_message("one");
+    manager.add_assistant_message("two", "anthropic");
+    manager.save_to_disk();
+    
+    auto found = manager.find_session(manager.get_current_session_id());
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->message_count, 2u);
+    EXPECT_EQ(found->last_provider, "anthropic");
+    EXPECT_EQ(manager.get_session_count(), 1u);
+    EXPECT_EQ(manager.get_available_sessions(), std::vector<std::string>{manager.get_current_session_id()});
+    manager.clear_history();
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include "session_journal.h"
+#include "conversation_manager.h"
+#include <filesystem>
+#include <fstream>
+
+using namespace mag;
+
+class SessionJournalTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_session_journal_test";
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+        path_ = (dir_ / "session.jsonl").string();
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+    
+    static ConversationMessage message(uint64_t sequence, const std::string& content) {
+        ConversationMessage msg("user", content);
+        msg.sequence = sequence;
+        return msg;
+    }
+    
+    static std::vector<std::string> contents(const JournalSnapshot& snapshot) {
+        std::vector<std::string> result;
+        for (const auto& msg : snapshot.messages) {
+            result.push_back(msg.content.str());
+        }
+        return result;
+    }
+    
+    std::filesystem::path dir_;
+    std::string path_;
+};
+
+TEST_F(SessionJournalTest, RoundTripsMessagesAndLatestMetadata) {
+    {
+        SessionJournal journal(path_);
+        journal.append_message(message(0, "first"));
+        journal.append_message(message(1, "second"));
+        journal.append_metadata({{"last_provider", "openai"}});
+        journal.append_metadata({{"last_provider", "anthropic"}});
+    }
+    
+    JournalSnapshot snapshot = SessionJournal::read(path_);
+    EXPECT_EQ(contents(snapshot), (std::vector<std::string>{"first", "second"}));
+    EXPECT_EQ(snapshot.metadata["last_provider"], "anthropic");
+    EXPECT_EQ(snapshot.next_sequence, 2u);
+    EXPECT_TRUE(snapshot.complete);
+}
+
+TEST_F(SessionJournalTest, TailReadReturnsOnlyTheNewestMessages) {
+    {
+        SessionJournal journal(path_);
+        for (uint64_t i = 0; i < 100; ++i) {
+            journal.append_message(message(i, "m" + std::to_string(i)));
+        }
+    }
+    
+    JournalSnapshot snapshot = SessionJournal::read(path_, 3);
+    EXPECT_EQ(contents(snapshot), (std::vector<std::string>{"m97", "m98", "m99"}));
+    EXPECT_FALSE(snapshot.complete);
+}
+
+TEST_F(SessionJournalTest, DropSummaryAndClearRecordsShapeTheLiveHistory) {
+    {
+        SessionJournal journal(path_);
+        for (uint64_t i = 0; i < 5; ++i) {
+            journal.append_message(message(i, "m" + std::to_string(i)));
+        }
+        journal.append_drop(2, 2);
+        ConversationMessage summary("system", "summary", "summary");
+        summary.sequence = 2;
+        journal.append_summary(summary);
+        journal.append_message(message(5, "m5"));
+    }
+    
+    JournalSnapshot snapshot = SessionJournal::read(path_);
+    EXPECT_TRUE(snapshot.has_summary);
+    EXPECT_EQ(contents(snapshot), (std::vector<std::string>{"summary", "m3", "m4", "m5"}));
+    
+    {
+        SessionJournal journal(path_);
+        journal.append_clear(4);
+        journal.append_message(message(0, "fresh"));
+    }
+    EXPECT_EQ(contents(SessionJournal::read(path_)), (std::vector<std::string>{"fresh"}));
+}
+
+TEST_F(SessionJournalTest, SkipsATornFinalLine) {
+    {
+        SessionJournal journal(path_);
+        journal.append_message(message(0, "whole"));
+    }
+    {
+        std::ofstream out(path_, std::ios::app);
+        out << R"({"type":"message","role":"user","content":"tor)";
+    }
+    
+    EXPECT_EQ(contents(SessionJournal::read(path_)), (std::vector<std::string>{"whole"}));
+}
+
+TEST_F(SessionJournalTest, CompactionRewritesOnlyTheLiveState) {
+    SessionJournal journal(path_);
+    journal.set_compact_after(10);
+    for (uint64_t i = 0; i < 20; ++i) {
+        journal.append_message(message(i, std::string(100, 'x')));
+    }
+    journal.append_drop(18, 18);
+    ASSERT_TRUE(journal.needs_compaction());
+    
+    auto before = std::filesystem::file_size(path_);
+    journal.compact();
+    EXPECT_LT(std::filesystem::file_size(path_), before / 4);
+    EXPECT_FALSE(journal.needs_compaction());
+    
+    journal.append_message(message(20, "after"));
+    JournalSnapshot snapshot = SessionJournal::read(path_);
+    ASSERT_EQ(snapshot.messages.size(), 3u);
+    EXPECT_EQ(snapshot.messages.back().content, "after");
+    EXPECT_EQ(snapshot.next_sequence, 21u);
+}
+
+TEST_F(SessionJournalTest, ManagerKeepsProviderUsageWithTheSession) {
+    ProviderUsage usage;
+    usage.reported = true;
+    usage.provider = "anthropic";
+    usage.model = "claude";
+    usage.input_tokens = 100;
+    usage.cached_tokens = 80;
+    usage.output_tokens = 7;
+    usage.server_latency_ms = 300;
+    
+    std::string session_id;
+    {
+        ConversationManager manager;
+        manager.set_storage_directory(dir_.string());
+        session_id = manager.get_current_session_id();
+        manager.add_user_message("one");
+        manager.record_usage(usage);
+        manager.usage_recorder()(usage);
+        usage.model = "claude-haiku";
+        manager.record_usage(usage);
+        manager.save_to_disk();
+        EXPECT_EQ(manager.get_usage_totals().requests, 3u);
+    }
+    
+    ConversationManager resumed;
+    resumed.set_storage_directory(dir_.string());
+    EXPECT_EQ(resumed.get_usage_totals().requests, 0u);
+    ASSERT_TRUE(resumed.load_session(session_id));
+    auto by_model = resumed.get_usage_by_model();
+    ASSERT_EQ(by_model.size(), 2u);
+    EXPECT_EQ(by_model["anthropic/claude"].requests, 2u);
+    EXPECT_EQ(by_model["anthropic/claude"].input_tokens, 200u);
+    EXPECT_EQ(by_model["anthropic/claude"].server_latency_ms, 600u);
+    EXPECT_EQ(resumed.get_usage_totals().output_tokens, 21u);
+    
+    resumed.start_new_session();
+    EXPECT_TRUE(resumed.get_usage_by_model().empty());
+}
+
+TEST_F(SessionJournalTest, ManagerResumesAJournaledSession) {
+    std::string session_id;
+    {
+        ConversationManager manager;
+        manager.set_storage_directory(dir_.string());
+        session_id = manager.get_current_session_id();
+        manager.add_user_message("one");
+        manager.add_assistant_message("two", "openai");
+        manager.add_user_message("three");
+        manager.trim_to_last_n_messages(2);
+        manager.save_to_disk();
+    }
+    
+    ConversationManager resumed;
+    resumed.set_storage_directory(dir_.string());
+    ASSERT_TRUE(resumed.load_session(session_id));
+    auto history = resumed.get_history();
+    ASSERT_EQ(history.size(), 2u);
+    EXPECT_EQ(history[0].content, "two");
+    EXPECT_EQ(history[1].content, "three");
+    EXPECT_EQ(resumed.get_last_provider_used(), "openai");
+    
+    resumed.add_user_message("four");
+    resumed.clear_history();
+    ConversationManager reloaded;
+    reloaded.set_storage_directory(dir_.string());
+    ASSERT_TRUE(reloaded.load_session(session_id));
+    EXPECT_TRUE(reloaded.is_empty());
+}
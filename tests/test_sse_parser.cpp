@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "sse_parser.h"
+#include "providers/anthropic_provider.h"
+#include "providers/openai_provider.h"
+#include "providers/gemini_provider.h"
+#include <vector>
+
+using namespace mag;
+
+class SseParserTest : public ::testing::Test {
+protected:
+    std::vector<SseEvent> events;
+    SseParser parser{[this](const SseEvent& event) { events.push_back(event); }};
+};
+
+TEST_F(SseParserTest, ParsesCompleteEvents) {
+    parser.feed("event: ping\ndata: {\"a\":1}\n\ndata: second\n\n");
+    
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].event, "ping");
+    EXPECT_EQ(events[0].data, "{\"a\":1}");
+    EXPECT_EQ(events[1].event, "message");
+    EXPECT_EQ(events[1].data, "second");
+}
+
+TEST_F(SseParserTest, HandlesEventsSplitAcrossChunks) {
+    parser.feed("da");
+    parser.feed("ta: hel");
+    EXPECT_TRUE(events.empty());
+    parser.feed("lo\r");
+    parser.feed("\n\r\n");
+    
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].data, "hello");
+}
+
+TEST_F(SseParserTest, JoinsMultipleDataLinesAndSkipsComments) {
+    parser.feed(": keep-alive\ndata: line one\ndata: line two\n\n");
+    
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].data, "line one\nline two");
+}
+
+TEST_F(SseParserTest, FinishFlushesUnterminatedEvent) {
+    parser.feed("data: tail");
+    EXPECT_TRUE(events.empty());
+    parser.finish();
+    
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].data, "tail");
+}
+
+TEST_F(SseParserTest, ProvidersExtractTextDeltas) {
+    AnthropicProvider anthropic;
+    SseEvent anthropic_event{"content_block_delta",
+        R"({"type":"content_block_delta","index":0,"delta":{"type":"text_delta","text":"Hi"}})", ""};
+    EXPECT_EQ(anthropic.parse_stream_event(anthropic_event), "Hi");
+    EXPECT_EQ(anthropic.parse_stream_event(SseEvent{"message_stop", "{}", ""}), "");
+    EXPECT_THROW(anthropic.parse_stream_event(SseEvent{"error", R"({"error":{"message":"overloaded"}})", ""}),
+                 std::runtime_error);
+    
+    OpenAIProvider openai;
+    EXPECT_EQ(openai.parse_stream_event(SseEvent{"message", R"({"choices":[{"delta":{"content":"there"}}]})", ""}),
+              "there");
+    EXPECT_EQ(openai.parse_stream_event(SseEvent{"message", "[DONE]", ""}), "");
+    
+    GeminiProvider gemini;
+    EXPECT_EQ(gemini.parse_stream_event(SseEvent{"message",
+        R"({"candidates":[{"content":{"parts":[{"text":"!"}]}}]})", ""}), "!");
+    EXPECT_NE(gemini.get_stream_url("key").find(":streamGenerateContent?alt=sse"), std::string::npos);
+}
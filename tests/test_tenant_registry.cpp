@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "tenant_registry.h"
+#include "message.h"
+#include <stdexcept>
+
+using namespace mag;
+
+TEST(TenantRegistryTest, ParsesAssignmentLists) {
+    auto parsed = TenantRegistry::parse_assignments(" alice = 2, bob=1,,");
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(parsed->size(), 2u);
+    EXPECT_EQ(parsed->at("alice"), "2");
+    EXPECT_EQ(parsed->at("bob"), "1");
+    
+    EXPECT_TRUE(TenantRegistry::parse_assignments("")->empty());
+    EXPECT_FALSE(TenantRegistry::parse_assignments("alice"));
+    EXPECT_FALSE(TenantRegistry::parse_assignments("=2"));
+    EXPECT_FALSE(TenantRegistry::parse_assignments("alice="));
+}
+
+TEST(TenantRegistryTest, ConfiguresWeightsAndProviders) {
+    TenantRegistry tenants("anthropic");
+    tenants.configure("alice=2,bob=0.5", "bob=openai");
+    EXPECT_DOUBLE_EQ(tenants.weights().at("alice"), 2.0);
+    EXPECT_DOUBLE_EQ(tenants.weights().at("bob"), 0.5);
+    EXPECT_EQ(tenants.provider_for("bob"), "openai");
+    EXPECT_EQ(tenants.provider_for("alice"), "anthropic");
+    EXPECT_EQ(tenants.size(), 2u);
+    
+    EXPECT_THROW(tenants.configure("carol=0", ""), std::invalid_argument);
+    EXPECT_THROW(tenants.configure("carol=lots", ""), std::invalid_argument);
+    EXPECT_THROW(tenants.configure("", "carol"), std::invalid_argument);
+}
+
+TEST(TenantRegistryTest, FindsTheTenantInAnyWireFormat) {
+    TenantRegistry tenants;
+    EXPECT_EQ(tenants.tenant_of(R"({"prompt": "hi", "tenant": "alice"})"), "alice");
+    EXPECT_EQ(tenants.tenant_of(R"({"prompt": "hi"})"), "");
+    EXPECT_EQ(tenants.tenant_of("plain prompt text"), "");
+    
+    nlohmann::json request = {{"prompt", "hi"}, {"tenant", "bob"}};
+    EXPECT_EQ(tenants.tenant_of(WireCodec::encode(request, WireFormat::MSGPACK)), "bob");
+    EXPECT_EQ(tenants.tenant_of(WireCodec::encode(request, WireFormat::CBOR)), "bob");
+}
+
+TEST(TenantRegistryTest, SharesOneTenantOnceFull) {
+    TenantRegistry tenants("", 2);
+    tenants.configure("alice=1", "");
+    EXPECT_EQ(tenants.resolve("bob"), "bob");
+    EXPECT_EQ(tenants.resolve("carol"), TenantConfig::OVERFLOW_TENANT);
+    EXPECT_EQ(tenants.resolve("dave"), TenantConfig::OVERFLOW_TENANT);
+    
+    // Names already seen, configured or not, keep their own place
+    EXPECT_EQ(tenants.resolve("alice"), "alice");
+    EXPECT_EQ(tenants.resolve("bob"), "bob");
+    EXPECT_EQ(tenants.resolve(""), "");
+    EXPECT_EQ(tenants.size(), 2u);
+}
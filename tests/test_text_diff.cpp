@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include "text_diff.h"
+#include <random>
+
+using namespace mag;
+
+namespace {
+
+std::string numbered_lines(size_t count) {
+    std::string text;
+    for (size_t i = 1; i <= count; ++i) {
+        text += "line " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+} // anonymous namespace
+
+TEST(TextDiffTest, SmallEditMakesOneMinimalHunk) {
+    std::string before = numbered_lines(5000);
+    std::string after = before;
+    after.replace(after.find("line 2500\n"), 10, "line 2500 changed\nline 2500b\n");
+    
+    TextDiff diff = diff_lines(before, after, "big.txt");
+    EXPECT_EQ(diff.lines_added, 2u);
+    EXPECT_EQ(diff.lines_removed, 1u);
+    EXPECT_EQ(diff.unified,
+              "--- a/big.txt\n+++ b/big.txt\n"
+              "@@ -2497,7 +2497,8 @@\n"
+              " line 2497\n line 2498\n line 2499\n"
+              "-line 2500\n+line 2500 changed\n+line 2500b\n"
+              " line 2501\n line 2502\n line 2503\n");
+    EXPECT_EQ(apply_patch(before, diff.unified), after);
+    EXPECT_TRUE(diff_lines(before, before, "big.txt").empty());
+}
+
+TEST(TextDiffTest, RandomEditsRoundTripThroughApplyPatch) {
+    std::mt19937 rng(7);
+    for (int round = 0; round < 50; ++round) {
+        std::vector<std::string> lines;
+        for (int i = 0; i < 60; ++i) {
+            lines.push_back("l" + std::to_string(rng() % 8) + "\n"); // repeats make the search work
+        }
+        std::string before;
+        for (const auto& line : lines) {
+            before += line;
+        }
+        for (int edit = 0; edit < 6; ++edit) {
+            size_t at = rng() % lines.size();
+            switch (rng() % 3) {
+                case 0: lines.erase(lines.begin() + static_cast<long>(at)); break;
+                case 1: lines.insert(lines.begin() + static_cast<long>(at), "new\n"); break;
+                default: lines[at] = "changed\n"; break;
+            }
+        }
+        std::string after;
+        for (const auto& line : lines) {
+            after += line;
+        }
+        if (round % 2 == 0) {
+            after.pop_back(); // exercise "\ No newline at end of file"
+        }
+        
+        TextDiff diff = diff_lines(before, after, "f", round % 4);
+        EXPECT_EQ(apply_patch(before, diff.unified), after) << diff.unified;
+    }
+}
+
+TEST(TextDiffTest, HunksAreFoundByContextWhenLineNumbersAreWrong) {
+    std::string before = numbered_lines(30);
+    std::string patch =
+        "--- a/f\n+++ b/f\n"
+        "@@ -3,3 +3,3 @@\n"   // really at line 20
+        " line 19\n-line 20\n+line twenty\n line 21\n";
+    std::string after = apply_patch(before, patch);
+    EXPECT_THAT(after, testing::HasSubstr("line 19\nline twenty\nline 21\n"));
+    EXPECT_EQ(after.size(), before.size() + 4);
+    
+    EXPECT_THROW(apply_patch(before, "@@ -1 +1 @@\n-line 99\n+x\n"), PatchError);
+    EXPECT_THROW(apply_patch(before, "just some text"), PatchError);
+}
+
+TEST(TextDiffTest, SearchReplaceBlocksMustMatchOnce) {
+    std::string before = "int a = 1;\nint b = 2;\nint c = 2;\n";
+    std::string patch =
+        "<<<<<<< SEARCH\nint a = 1;\n=======\nint a = 10;\n>>>>>>> REPLACE\n"
+        "<<<<<<< SEARCH\nint c = 2;\n=======\n>>>>>>> REPLACE\n";
+    EXPECT_TRUE(is_search_replace_patch(patch));
+    EXPECT_EQ(apply_patch(before, patch), "int a = 10;\nint b = 2;\n");
+    
+    EXPECT_THROW(apply_patch(before, "<<<<<<< SEARCH\n= 2;\n=======\nx\n>>>>>>> REPLACE\n"), PatchError);
+    EXPECT_THROW(apply_patch(before, "<<<<<<< SEARCH\nint d;\n=======\nx\n>>>>>>> REPLACE\n"), PatchError);
+    EXPECT_THROW(apply_patch(before, "<<<<<<< SEARCH\nint a = 1;\n=======\n"), PatchError);
+    
+    // The last line of a file without a trailing newline still matches
+    EXPECT_EQ(apply_patch("x\ny", "<<<<<<< SEARCH\ny\n=======\nz\n>>>>>>> REPLACE\n"), "x\nz");
+    EXPECT_EQ(apply_patch("", "<<<<<<< SEARCH\n=======\nnew file\n>>>>>>> REPLACE\n"), "new file\n");
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include "thread_pool.h"
+#include <atomic>
+#include <future>
+#include <set>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace mag;
+
+class ThreadPoolTest : public ::testing::Test {};
+
+TEST_F(ThreadPoolTest, RunsAllSubmittedTasks) {
+    std::atomic<int> counter{0};
+    {
+        ThreadPool pool(4);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&counter](size_t) { counter.fetch_add(1); });
+        }
+    } // destructor drains the queue
+    
+    EXPECT_EQ(counter.load(), 100);
+}
+
+TEST_F(ThreadPoolTest, PassesWorkerIndexWithinPoolSize) {
+    ThreadPool pool(3);
+    std::mutex mutex;
+    std::set<size_t> seen;
+    std::vector<std::future<void>> results;
+    for (int i = 0; i < 30; ++i) {
+        results.push_back(pool.submit_with_result([&](size_t worker) {
+            std::lock_guard<std::mutex> lock(mutex);
+            seen.insert(worker);
+        }));
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+    
+    for (size_t worker : seen) {
+        EXPECT_LT(worker, 3u);
+    }
+}
+
+TEST_F(ThreadPoolTest, FuturesCarryResultsAndExceptions) {
+    ThreadPool pool(2);
+    auto value = pool.submit_with_result([](size_t) { return 42; });
+    auto failure = pool.submit_with_result([](size_t) -> int { throw std::runtime_error("boom"); });
+    
+    EXPECT_EQ(value.get(), 42);
+    EXPECT_THROW(failure.get(), std::runtime_error);
+}
+
+TEST_F(ThreadPoolTest, RejectsWorkAfterShutdown) {
+    ThreadPool pool(1);
+    pool.shutdown();
+    EXPECT_THROW(pool.submit([](size_t) {}), std::runtime_error);
+}
+
+namespace {
+
+// Runs the keyed tasks on a one-worker pool held busy until all are queued,
+// and returns the keys in the order the tasks ran
+std::string run_order(ThreadPool& pool, const std::vector<std::string>& keys) {
+    std::promise<void> started;
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.submit([&started, open](size_t) {
+        started.set_value();
+        open.wait();
+    });
+    started.get_future().wait();
+    
+    std::mutex mutex;
+    std::string order;
+    for (const std::string& key : keys) {
+        pool.submit(key, [&mutex, &order, key](size_t) {
+            std::lock_guard<std::mutex> lock(mutex);
+            order += key;
+        });
+    }
+    EXPECT_EQ(pool.queued(), keys.size());
+    gate.set_value();
+    pool.shutdown();
+    return order;
+}
+
+} // anonymous namespace
+
+TEST_F(ThreadPoolTest, KeysTakeTurnsRatherThanFirstComeFirstServed) {
+    ThreadPool pool(1);
+    // A flood from one key doesn't hold up another key's requests behind it
+    EXPECT_EQ(run_order(pool, {"a", "a", "a", "a", "a", "a", "b", "b", "b"}), "abababaaa");
+}
+
+TEST_F(ThreadPoolTest, WeightsSetEachKeysShare) {
+    ThreadPool pool(1);
+    pool.set_weight("a", 2);
+    EXPECT_EQ(run_order(pool, {"a", "a", "a", "a", "a", "a", "b", "b", "b"}), "abaabaaba");
+    EXPECT_THROW(pool.set_weight("b", 0), std::invalid_argument);
+}
+
+TEST_F(ThreadPoolTest, CountsQueuedTasksPerKey) {
+    ThreadPool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    pool.submit("a", [open](size_t) { open.wait(); });
+    pool.submit("a", [](size_t) {});
+    pool.submit("b", [](size_t) {});
+    pool.submit("b", [](size_t) {});
+    
+    // The first task may or may not have been picked up yet
+    EXPECT_GE(pool.queued("a"), 1u);
+    EXPECT_EQ(pool.queued("b"), 2u);
+    EXPECT_EQ(pool.queued("c"), 0u);
+    gate.set_value();
+    pool.shutdown();
+    EXPECT_EQ(pool.queued(), 0u);
+}
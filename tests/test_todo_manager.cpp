@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "todo_manager.h"
+#include "todo_journal.h"
+#include "config.h"
+#include <filesystem>
+#include <fstream>
+
+using namespace mag;
+
+class TodoManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_todo_manager_test";
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+        path_ = (dir_ / "todos.jsonl").string();
+    }
+    
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+    
+    static std::vector<int> ids(const TodoView& view) {
+        std::vector<int> result;
+        for (const auto& todo : view) {
+            result.push_back(todo.id);
+        }
+        return result;
+    }
+    
+    std::filesystem::path dir_;
+    std::string path_;
+};
+
+TEST_F(TodoManagerTest, StatusViewsFollowChangesInIdOrder) {
+    TodoManager manager;
+    for (int i = 1; i <= 5; ++i) {
+        manager.add_todo("Task " + std::to_string(i));
+    }
+    manager.mark_completed(2);
+    manager.mark_in_progress(4);
+    
+    EXPECT_EQ(ids(manager.all()), (std::vector<int>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(ids(manager.with_status(TodoStatus::PENDING)), (std::vector<int>{1, 3, 5}));
+    EXPECT_EQ(ids(manager.with_status(TodoStatus::COMPLETED)), (std::vector<int>{2}));
+    EXPECT_EQ(manager.count_pending(), 3u);
+    
+    // Going back to pending restores the todo's place in the queue
+    manager.mark_pending(4);
+    manager.delete_todo(1);
+    EXPECT_EQ(manager.get_next_pending()->id, 3);
+    EXPECT_EQ(ids(manager.with_status(TodoStatus::PENDING)), (std::vector<int>{3, 4, 5}));
+    EXPECT_EQ(manager.get_todos_range(4, 5).size(), 2u);
+    EXPECT_EQ(manager.get_todos_until(5).size(), 2u);
+    EXPECT_EQ(manager.list_todos().size(), 3u);
+    EXPECT_EQ(manager.list_todos(true).size(), 4u);
+}
+
+TEST_F(TodoManagerTest, JournalReplaysTheListAfterACrash) {
+    {
+        TodoManager manager;
+        manager.attach_journal(path_);
+        manager.add_todo("Create the schema", "", {});
+        manager.add_todo("Migrate users", "", {1});
+        manager.add_todo("Drop old table");
+        manager.mark_completed(1);
+        manager.mark_in_progress(2);
+        manager.delete_todo(3);
+    } // no save: every change is already in the journal
+    
+    // A torn record from a crash mid-write is ignored
+    std::ofstream(path_, std::ios::app) << "{\"type\":\"todo\",\"id\":";
+    
+    TodoManager resumed;
+    resumed.attach_journal(path_);
+    ASSERT_EQ(resumed.count(), 2u);
+    EXPECT_EQ(resumed.get_todo(1)->status, TodoStatus::COMPLETED);
+    EXPECT_EQ(resumed.get_todo(2)->status, TodoStatus::PENDING); // was cut off while running
+    EXPECT_EQ(resumed.get_todo(2)->depends_on, std::vector<int>{1});
+    EXPECT_EQ(resumed.add_todo("Verify"), 4); // deleted ids are not reused
+}
+
+TEST_F(TodoManagerTest, JournalCompactsSupersededRecords) {
+    TodoManager manager;
+    manager.attach_journal(path_);
+    int id = manager.add_todo("Flip");
+    for (size_t i = 0; i < JournalConfig::COMPACT_AFTER_DROPPED + 10; ++i) {
+        (i % 2 == 0) ? manager.mark_in_progress(id) : manager.mark_pending(id);
+    }
+    
+    std::ifstream file(path_);
+    size_t lines = 0;
+    for (std::string line; std::getline(file, line);) {
+        ++lines;
+    }
+    EXPECT_LT(lines, JournalConfig::COMPACT_AFTER_DROPPED);
+    EXPECT_EQ(TodoJournal::read(path_)["todos"].size(), 1u);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "todo_scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace mag;
+
+namespace {
+
+TodoItem todo(int id, const std::string& title, std::vector<int> depends_on = {}) {
+    TodoItem item;
+    item.id = id;
+    item.title = title;
+    item.status = TodoStatus::PENDING;
+    item.depends_on = std::move(depends_on);
+    return item;
+}
+
+bool is_bash(const TodoItem& item) {
+    return item.title.rfind("run ", 0) == 0;
+}
+
+} // anonymous namespace
+
+TEST(TodoSchedulerTest, InfersDependenciesFromKindAndPaths) {
+    std::vector<TodoItem> todos = {
+        todo(1, "write tests/foo_test.cpp"),
+        todo(2, "write docs/bar.md"),
+        todo(3, "update tests/foo_test.cpp with more cases"),
+        todo(4, "run make test"),
+        todo(5, "write src/extra.cpp"),
+        todo(6, "write notes", {2, 9, 42}),
+    };
+    auto dependencies = TodoScheduler::plan(todos, is_bash, {9});
+    
+    EXPECT_TRUE(dependencies[0].after.empty());
+    EXPECT_TRUE(dependencies[1].after.empty()); // independent of the tests
+    EXPECT_EQ(dependencies[2].after, std::vector<size_t>({0}));
+    EXPECT_EQ(dependencies[3].after, std::vector<size_t>({0, 1, 2}));
+    EXPECT_EQ(dependencies[4].after, std::vector<size_t>({3}));
+    EXPECT_EQ(dependencies[5].after, std::vector<size_t>({1, 3}));
+    EXPECT_EQ(dependencies[5].unmet, std::vector<int>({9})); // 42 no longer exists
+}
+
+TEST(TodoSchedulerTest, RunsIndependentTodosAtTheSameTime) {
+    std::vector<TodoItem> todos = {todo(1, "a"), todo(2, "b"), todo(3, "c"), todo(4, "d", {1, 2, 3})};
+    auto dependencies = TodoScheduler::plan(todos, is_bash);
+    
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    std::mutex order_mutex;
+    std::vector<int> finished;
+    TodoScheduler scheduler(3);
+    auto results = scheduler.run(
+        todos, dependencies,
+        [&](const TodoItem&) {
+            int now = ++running;
+            int seen = peak.load();
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            --running;
+        },
+        [](const TodoItem&) {},
+        [&](const TodoItem& item, const TodoScheduler::Result&) {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            finished.push_back(item.id);
+        },
+        [] { return false; });
+    
+    EXPECT_EQ(peak.load(), 3);
+    ASSERT_EQ(finished.size(), 4u);
+    EXPECT_EQ(finished.back(), 4);
+    for (const auto& result : results) {
+        EXPECT_EQ(result.outcome, TodoScheduler::Outcome::COMPLETED);
+    }
+}
+
+TEST(TodoSchedulerTest, FailuresBlockDependentsOnly) {
+    std::vector<TodoItem> todos = {todo(1, "a"), todo(2, "b", {1}), todo(3, "c", {2}), todo(4, "d"),
+                                   todo(5, "e", {6}), todo(6, "f", {5}), todo(7, "g", {8})};
+    auto dependencies = TodoScheduler::plan(todos, is_bash, {8});
+    
+    std::vector<int> started;
+    TodoScheduler scheduler(2);
+    auto results = scheduler.run(
+        todos, dependencies,
+        [](const TodoItem& item) {
+            if (item.id == 1) {
+                throw std::runtime_error("boom");
+            }
+        },
+        [&started](const TodoItem& item) { started.push_back(item.id); },
+        [](const TodoItem&, const TodoScheduler::Result&) {},
+        [] { return false; });
+    
+    EXPECT_EQ(started, std::vector<int>({1, 4}));
+    EXPECT_EQ(results[0].outcome, TodoScheduler::Outcome::FAILED);
+    EXPECT_EQ(results[0].error, "boom");
+    EXPECT_EQ(results[1].outcome, TodoScheduler::Outcome::BLOCKED);
+    EXPECT_EQ(results[1].error, "depends on #1, which failed");
+    EXPECT_EQ(results[2].outcome, TodoScheduler::Outcome::BLOCKED);
+    EXPECT_EQ(results[3].outcome, TodoScheduler::Outcome::COMPLETED);
+    EXPECT_EQ(results[4].outcome, TodoScheduler::Outcome::BLOCKED); // a cycle
+    EXPECT_EQ(results[5].outcome, TodoScheduler::Outcome::BLOCKED);
+    EXPECT_EQ(results[6].error, "depends on #8, which has not completed");
+    
+    // Stopping leaves the rest unrun
+    int calls = 0;
+    auto stopped = scheduler.run(
+        todos, dependencies, [](const TodoItem&) {}, [](const TodoItem&) {},
+        [](const TodoItem&, const TodoScheduler::Result&) {}, [&calls] { return ++calls > 1; });
+    EXPECT_EQ(stopped[0].outcome, TodoScheduler::Outcome::COMPLETED);
+    EXPECT_EQ(stopped[3].outcome, TodoScheduler::Outcome::NOT_RUN);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include "token_counter.h"
+#include "conversation_manager.h"
+#include "providers/anthropic_provider.h"
+#include "providers/gemini_provider.h"
+#include "providers/openai_provider.h"
+#include <filesystem>
+
+using namespace mag;
+
+TEST(TokenCounterTest, HeuristicFollowsBpeSplits) {
+    HeuristicTokenCounter counter;
+    EXPECT_EQ(counter.count(""), 0u);
+    EXPECT_EQ(counter.count("hello world"), 2u);            // the space merges into "world"
+    EXPECT_EQ(counter.count("internationalization"), 4u);   // long words split every few letters
+    EXPECT_EQ(counter.count("1234567"), 3u);                // digits group in threes
+    EXPECT_EQ(counter.count("f(x);"), 5u);                  // each punctuation mark is a token
+    EXPECT_EQ(counter.count("\xe4\xbd\xa0\xe5\xa5\xbd"), 2u);  // one per code point, not per byte
+    EXPECT_EQ(counter.count("a\n\nb"), 3u);
+    EXPECT_EQ(counter.count_message("hi"), 1u + counter.message_overhead());
+}
+
+TEST(TokenCounterTest, CalibrationScalesTowardsReportedUsage) {
+    CalibratedTokenCounter counter;
+    EXPECT_DOUBLE_EQ(counter.ratio(), 1.0);
+    
+    counter.calibrate(100, 150);
+    EXPECT_DOUBLE_EQ(counter.ratio(), 1.5);   // first report replaces the prior
+    EXPECT_EQ(counter.count("hello world"), 3u);
+    
+    counter.calibrate(100, 100);
+    EXPECT_NEAR(counter.ratio(), 1.5 + CalibratedTokenCounter::SMOOTHING * (1.0 - 1.5), 1e-9);
+    
+    counter.calibrate(10, 1000);              // outliers are clamped
+    EXPECT_LE(counter.ratio(), CalibratedTokenCounter::MAX_RATIO);
+    counter.calibrate(0, 50);                 // nothing to compare against
+    EXPECT_EQ(counter.samples(), 3u);
+}
+
+TEST(TokenCounterTest, ProvidersReportPromptTokens) {
+    EXPECT_EQ(OpenAIProvider().parse_prompt_tokens(
+        R"({"choices":[{"message":{"content":"x"}}],"usage":{"prompt_tokens":42,"completion_tokens":3}})"), 42u);
+    EXPECT_EQ(AnthropicProvider().parse_prompt_tokens(
+        R"({"content":[],"usage":{"input_tokens":10,"cache_read_input_tokens":900,"output_tokens":5}})"), 910u);
+    EXPECT_EQ(GeminiProvider().parse_prompt_tokens(R"({"usageMetadata":{"promptTokenCount":7}})"), 7u);
+    EXPECT_FALSE(OpenAIProvider().parse_prompt_tokens(R"({"choices":[]})").has_value());
+}
+
+TEST(TokenCounterTest, ProvidersReportUsage) {
+    ProviderUsage openai = OpenAIProvider().parse_usage(
+        R"({"id":"chatcmpl-1","model":"gpt-4o-2024-08-06","choices":[],)"
+        R"("usage":{"prompt_tokens":1200,"completion_tokens":30,"prompt_tokens_details":{"cached_tokens":1024}}})");
+    ASSERT_TRUE(openai.reported);
+    EXPECT_EQ(openai.model, "gpt-4o-2024-08-06");
+    EXPECT_EQ(openai.request_id, "chatcmpl-1");
+    EXPECT_EQ(openai.input_tokens, 1200u);
+    EXPECT_EQ(openai.output_tokens, 30u);
+    EXPECT_EQ(openai.cached_tokens, 1024u);
+    
+    ProviderUsage anthropic = AnthropicProvider().parse_usage(
+        R"({"id":"msg_1","model":"claude","content":[],"usage":{"input_tokens":10,)"
+        R"("cache_read_input_tokens":900,"cache_creation_input_tokens":50,"output_tokens":5}})");
+    EXPECT_EQ(anthropic.input_tokens, 960u);
+    EXPECT_EQ(anthropic.cached_tokens, 900u);
+    EXPECT_EQ(anthropic.cache_write_tokens, 50u);
+    EXPECT_EQ(anthropic.output_tokens, 5u);
+    
+    ProviderUsage gemini = GeminiProvider().parse_usage(
+        R"({"candidates":[],"usageMetadata":{"promptTokenCount":7,"candidatesTokenCount":3,)"
+        R"("thoughtsTokenCount":2,"cachedContentTokenCount":4},"modelVersion":"gemini-2.0","responseId":"r1"})");
+    EXPECT_EQ(gemini.output_tokens, 5u);
+    EXPECT_EQ(gemini.cached_tokens, 4u);
+    EXPECT_EQ(gemini.model, "gemini-2.0");
+    
+    EXPECT_FALSE(OpenAIProvider().parse_usage("not json").reported);
+    EXPECT_FALSE(AnthropicProvider().parse_usage(R"({"usage":{"input_tokens":"ten"}})").reported);
+    
+    UsageTotals totals;
+    totals.add(openai);
+    totals.add(anthropic);
+    totals.add(ProviderUsage{}); // unreported responses are not counted
+    EXPECT_EQ(totals.requests, 2u);
+    EXPECT_EQ(totals.input_tokens, 2160u);
+    EXPECT_NEAR(totals.cache_hit_ratio(), 1924.0 / 2160.0, 1e-9);
+    EXPECT_EQ(UsageTotals::from_json(totals.to_json()).cached_tokens, totals.cached_tokens);
+}
+
+class ConversationTokenTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "mag_token_counter_test";
+        std::filesystem::remove_all(dir_);
+        manager_.set_storage_directory(dir_.string());
+    }
+    
+    void TearDown() override {
+        manager_.clear_history();
+        std::filesystem::remove_all(dir_);
+    }
+    
+    std::filesystem::path dir_;
+    ConversationManager manager_;
+};
+
+TEST_F(ConversationTokenTest, RunningTotalTracksAddsAndTrims) {
+    HeuristicTokenCounter counter;
+    manager_.add_user_message("hello world");
+    manager_.add_assistant_message("internationalization", "openai");
+    manager_.add_user_message("f(x);");
+    
+    size_t expected = counter.count_message("hello world") + counter.count_message("internationalization") +
+                      counter.count_message("f(x);");
+    EXPECT_EQ(manager_.get_token_count(), expected);
+    EXPECT_EQ(manager_.get_history()[1].token_count, counter.count_message("internationalization"));
+    
+    manager_.trim_to_last_n_messages(2);
+    EXPECT_EQ(manager_.get_token_count(), expected - counter.count_message("hello world"));
+}
+
+TEST_F(ConversationTokenTest, TrimKeepsNewestMessagesThatFit) {
+    for (int i = 0; i < 10; ++i) {
+        manager_.add_user_message("word");   // 1 token + overhead each
+    }
+    size_t per_message = HeuristicTokenCounter().count_message("word");
+    
+    manager_.trim_to_token_limit(per_message * 3);
+    EXPECT_EQ(manager_.get_message_count(), 3u);
+    EXPECT_EQ(manager_.get_token_count(), per_message * 3);
+    
+    // The most recent message survives even when it alone is over the limit
+    manager_.trim_to_token_limit(1);
+    EXPECT_EQ(manager_.get_message_count(), 1u);
+    
+    auto doubled = std::make_shared<CalibratedTokenCounter>();
+    doubled->calibrate(1, 2);
+    manager_.set_token_counter(doubled);
+    EXPECT_EQ(manager_.get_token_count(), doubled->count_message("word"));
+}
+
+TEST_F(ConversationTokenTest, UsageReportsCalibrateLaterCounts) {
+    std::string text = "calibrate the counter with what the provider billed";
+    HeuristicTokenCounter heuristic;
+    manager_.add_user_message(text);
+    EXPECT_EQ(manager_.get_token_count(), heuristic.count_message(text));
+    
+    // The adapter estimated 100 prompt tokens and was billed for 200
+    ProviderUsage usage;
+    usage.reported = true;
+    usage.provider = "openai";
+    usage.input_tokens = 200;
+    usage.estimated_input_tokens = 100;
+    usage = ProviderUsage::from_json(usage.to_json()); // as it arrives over the wire
+    manager_.usage_recorder()(usage);
+    
+    CalibratedTokenCounter doubled;
+    doubled.calibrate(1, 2);
+    manager_.add_user_message(text);
+    EXPECT_EQ(manager_.get_history()[1].token_count, doubled.count_message(text));
+    EXPECT_GT(manager_.get_history()[1].token_count, manager_.get_history()[0].token_count);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "tool_call_parser.h"
+
+using namespace mag;
+
+namespace {
+
+// Feeds the reply in pieces of the given size and writes each call as [kind:argument]
+std::string render(const std::string& reply, size_t piece) {
+    std::string output;
+    ToolCallParser parser([&output](std::string_view text) { output += text; },
+                          [&output](const ToolCall& call) {
+                              output += "[" + std::to_string(static_cast<int>(call.kind)) + ":" + call.title +
+                                        call.reason + (call.id ? std::to_string(call.id) : "") + "]";
+                          });
+    for (size_t i = 0; i < reply.size(); i += piece) {
+        parser.feed(std::string_view(reply).substr(i, piece));
+    }
+    parser.finish();
+    return output;
+}
+
+} // anonymous namespace
+
+TEST(ToolCallParserTest, ReadsEveryCallInOrder) {
+    std::string reply =
+        "Plan: add_todo(\"Write tests\", 'cover the \"parser\"') then\n"
+        "<TODO_SEPARATOR>\nTitle: Build it\nDepends on: 1, 2\nDescription: run make\n  twice\n<TODO_SEPARATOR>\n"
+        "list_todos( ) mark_complete( 3 ) delete_todo(4) execute_next() execute_all()\n"
+        "execute_todo(12) request_user_approval('Is this ok?')";
+    auto calls = ToolCallParser::parse(reply);
+    
+    ASSERT_EQ(calls.size(), 9u);
+    EXPECT_EQ(calls[0].kind, ToolCall::Kind::ADD_TODO);
+    EXPECT_EQ(calls[0].title, "Write tests");
+    EXPECT_EQ(calls[0].description, "cover the \"parser\"");
+    EXPECT_EQ(calls[0].text, "add_todo(\"Write tests\", 'cover the \"parser\"')");
+    EXPECT_EQ(calls[1].kind, ToolCall::Kind::ADD_TODO);
+    EXPECT_EQ(calls[1].title, "Build it");
+    EXPECT_EQ(calls[1].description, "run make\n  twice");
+    EXPECT_EQ(calls[1].depends_on, std::vector<int>({1, 2}));
+    EXPECT_EQ(calls[2].kind, ToolCall::Kind::LIST_TODOS);
+    EXPECT_EQ(calls[3].kind, ToolCall::Kind::MARK_COMPLETE);
+    EXPECT_EQ(calls[3].id, 3);
+    EXPECT_EQ(calls[4].kind, ToolCall::Kind::DELETE_TODO);
+    EXPECT_EQ(calls[5].kind, ToolCall::Kind::EXECUTE_NEXT);
+    EXPECT_EQ(calls[6].kind, ToolCall::Kind::EXECUTE_ALL);
+    EXPECT_EQ(calls[7].kind, ToolCall::Kind::EXECUTE_TODO);
+    EXPECT_EQ(calls[7].id, 12);
+    EXPECT_TRUE(calls[7].executes());
+    EXPECT_EQ(calls[8].reason, "Is this ok?");
+}
+
+TEST(ToolCallParserTest, LeavesNearMissesAsText) {
+    std::string reply =
+        "Use add_todo to plan, mark_complete(x) is wrong, list_todos(1) too,\n"
+        "add_todo(\"split\nacross lines\", \"no\") and\n"
+        "<TODO_SEPARATOR>\nno fields here\n<TODO_SEPARATOR>\ndone.";
+    EXPECT_EQ(render(reply, reply.size()), reply);
+    EXPECT_TRUE(ToolCallParser::parse(reply).empty());
+    
+    // An unfinished call at the end is passed through when the reply ends
+    EXPECT_EQ(render("ok add_todo(\"a\", \"b", 3), "ok add_todo(\"a\", \"b");
+    EXPECT_EQ(render("see execute_", 1), "see execute_");
+}
+
+TEST(ToolCallParserTest, StreamedPiecesGiveTheSameResult) {
+    std::string reply =
+        "First add_todo( 'a', \"b\" ), then <TODO_SEPARATOR>\nTitle: c\nDescription: d\n<TODO_SEPARATOR>\n"
+        "and execute_todo(7) plus request_user_approval(\"why\"). Delete delete_todo(2)!";
+    std::string whole = render(reply, reply.size());
+    EXPECT_EQ(whole, "First [0:a], then [0:c]\nand [6:7] plus [7:why]. Delete [3:2]!");
+    for (size_t piece : {1u, 2u, 5u, 17u}) {
+        EXPECT_EQ(render(reply, piece), whole) << "piece size " << piece;
+    }
+    
+    // Calls come out as soon as they close, before the rest of the reply
+    std::vector<std::string> seen;
+    ToolCallParser parser([&seen](std::string_view text) { seen.push_back(std::string(text)); },
+                          [&seen](const ToolCall& call) { seen.push_back("call " + call.text); });
+    parser.feed("Hi list_to");
+    EXPECT_EQ(seen, std::vector<std::string>({"Hi "}));
+    parser.feed("dos() ok");
+    EXPECT_EQ(seen, std::vector<std::string>({"Hi ", "call list_todos()", " ok"}));
+}
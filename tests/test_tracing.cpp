@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include "tracing.h"
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <unistd.h>
+
+using namespace mag;
+
+namespace {
+
+// Keeps every exported span for inspection
+class CapturingExporter : public SpanExporter {
+public:
+    explicit CapturingExporter(std::shared_ptr<std::vector<SpanRecord>> spans) : spans_(std::move(spans)) {}
+    void export_spans(const std::vector<SpanRecord>& spans, const std::string&) override {
+        spans_->insert(spans_->end(), spans.begin(), spans.end());
+    }
+
+private:
+    std::shared_ptr<std::vector<SpanRecord>> spans_;
+};
+
+const SpanRecord* find_span(const std::vector<SpanRecord>& spans, const std::string& name) {
+    for (const SpanRecord& span : spans) {
+        if (span.name == name) {
+            return &span;
+        }
+    }
+    return nullptr;
+}
+
+SpanRecord sample_span() {
+    SpanRecord span;
+    span.context = {0x0123456789abcdefULL, 0xfedcba9876543210ULL, 0x1122334455667788ULL};
+    span.parent_span_id = 0x99;
+    span.name = "nng file_tool";
+    span.start_unix_us = 1700000000000000;
+    span.duration_us = 250;
+    span.thread_id = 42;
+    span.error = true;
+    span.attributes = {{"bytes_out", "128"}};
+    return span;
+}
+
+} // anonymous namespace
+
+TEST(TracingTest, TraceparentRoundTrips) {
+    TraceContext context{0x0123456789abcdefULL, 0xfedcba9876543210ULL, 0x1122334455667788ULL};
+    EXPECT_EQ(context.traceparent(), "00-0123456789abcdeffedcba9876543210-1122334455667788-01");
+
+    auto parsed = TraceContext::parse_traceparent(context.traceparent());
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(parsed->trace_high, context.trace_high);
+    EXPECT_EQ(parsed->trace_low, context.trace_low);
+    EXPECT_EQ(parsed->span_id, context.span_id);
+
+    EXPECT_FALSE(TraceContext::parse_traceparent(""));
+    EXPECT_FALSE(TraceContext::parse_traceparent("00-00000000000000000000000000000000-1122334455667788-01"));
+    EXPECT_FALSE(TraceContext::parse_traceparent("00-0123456789ABCDEFfedcba9876543210-1122334455667788-01"));
+}
+
+TEST(TracingTest, HeaderIsStrippedFromTheRequestBody) {
+    TraceContext context{1, 2, 3};
+    char header[TraceContext::HEADER_SIZE];
+    context.write_header(header);
+    std::string request = std::string(header, sizeof(header)) + "{\"operation\":\"stat\"}";
+
+    std::string_view body = request;
+    auto stripped = TraceContext::strip_header(body);
+    ASSERT_TRUE(stripped);
+    EXPECT_EQ(stripped->trace_low, 2u);
+    EXPECT_EQ(stripped->span_id, 3u);
+    EXPECT_EQ(body, "{\"operation\":\"stat\"}");
+
+    // Untraced requests pass through untouched
+    std::string_view plain = "{\"operation\":\"stat\",\"path\":\"a_fairly_long_path.txt\"}";
+    EXPECT_FALSE(TraceContext::strip_header(plain));
+    EXPECT_EQ(plain.front(), '{');
+}
+
+TEST(TracingTest, SpansNestUnderTheCurrentContext) {
+    // Only root spans start a trace; everything else needs a parent
+    {
+        Span orphan("orphan");
+        EXPECT_FALSE(orphan.active());
+    }
+
+    auto spans = std::make_shared<std::vector<SpanRecord>>();
+    Tracer::instance().add_exporter(std::make_unique<CapturingExporter>(spans));
+
+    TraceContext root_context;
+    {
+        Span root("request", Span::Kind::ROOT);
+        ASSERT_TRUE(root.active());
+        root_context = root.context();
+        EXPECT_EQ(TraceContext::current().span_id, root_context.span_id);
+        {
+            Span child("policy");
+            child.set_attribute("operation", "read");
+            child.set_error("denied");
+        }
+        EXPECT_EQ(TraceContext::current().span_id, root_context.span_id);
+    }
+    EXPECT_FALSE(TraceContext::current().valid());
+
+    // A context carried over from another process parents spans on this side
+    {
+        TraceScope remote(TraceContext{7, 8, 9});
+        Span handler("file_tool stat");
+        EXPECT_TRUE(handler.active());
+    }
+    Tracer::instance().flush();
+
+    const SpanRecord* root = find_span(*spans, "request");
+    const SpanRecord* child = find_span(*spans, "policy");
+    const SpanRecord* handler = find_span(*spans, "file_tool stat");
+    ASSERT_TRUE(root && child && handler);
+    EXPECT_EQ(root->parent_span_id, 0u);
+    EXPECT_EQ(child->context.trace_low, root_context.trace_low);
+    EXPECT_EQ(child->parent_span_id, root_context.span_id);
+    EXPECT_TRUE(child->error);
+    EXPECT_EQ(child->attributes.front().first, "operation");
+    EXPECT_GE(root->duration_us, child->duration_us);
+    EXPECT_EQ(handler->context.trace_low, 8u);
+    EXPECT_EQ(handler->parent_span_id, 9u);
+}
+
+TEST(TracingTest, OtlpJsonFollowsTheExportRequestShape) {
+    nlohmann::json request = nlohmann::json::parse(OtlpExporter::to_json({sample_span()}, "file_tool"));
+
+    const nlohmann::json& resource = request["resourceSpans"][0];
+    EXPECT_EQ(resource["resource"]["attributes"][0]["key"], "service.name");
+    EXPECT_EQ(resource["resource"]["attributes"][0]["value"]["stringValue"], "file_tool");
+
+    const nlohmann::json& span = resource["scopeSpans"][0]["spans"][0];
+    EXPECT_EQ(span["traceId"], "0123456789abcdeffedcba9876543210");
+    EXPECT_EQ(span["spanId"], "1122334455667788");
+    EXPECT_EQ(span["parentSpanId"], "0000000000000099");
+    EXPECT_EQ(span["startTimeUnixNano"], "1700000000000000000");
+    EXPECT_EQ(span["endTimeUnixNano"], "1700000000000250000");
+    EXPECT_EQ(span["status"]["code"], 2);
+    EXPECT_EQ(span["attributes"][0]["value"]["stringValue"], "128");
+}
+
+TEST(TracingTest, ChromeTraceFileIsSharedBetweenWriters) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() /
+        ("mag_trace_test_" + std::to_string(::getpid())) / "trace.json";
+    std::filesystem::remove_all(path.parent_path());
+
+    ChromeTraceExporter first(path.string());
+    ChromeTraceExporter second(path.string());
+    first.export_spans({sample_span()}, "orchestrator");
+    second.export_spans({sample_span()}, "file_tool");
+    first.export_spans({sample_span()}, "orchestrator");
+
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string text = contents.str();
+    ASSERT_EQ(text.rfind("[\n", 0), 0u);
+
+    // The viewers accept the unterminated array; close it to parse here
+    text.erase(text.find_last_of(','));
+    nlohmann::json events = nlohmann::json::parse(text + "]");
+    ASSERT_EQ(events.size(), 5u); // two process names and three spans
+    EXPECT_EQ(events[0]["ph"], "M");
+    EXPECT_EQ(events[1]["ph"], "X");
+    EXPECT_EQ(events[1]["dur"], 250);
+    EXPECT_EQ(events[1]["args"]["bytes_out"], "128");
+    EXPECT_EQ(events[2]["args"]["name"], "file_tool");
+
+    std::filesystem::remove_all(path.parent_path());
+}